@@ -24,4 +24,5 @@
 #define SYS_sleep  20
 #define SYS_uptime 21
 #define SYS_getprocs 22
+#define SYS_getprocsat 23
 #endif // _SYSCALL_H_
@@ -7,6 +7,7 @@ struct buf {
   uint sector;
   struct buf *prev; // LRU cache list
   struct buf *next;
+  struct buf *hnext; // hash bucket chain
   struct buf *qnext; // disk queue
   uchar data[512];
 };
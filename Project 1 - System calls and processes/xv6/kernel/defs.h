@@ -111,6 +111,7 @@ int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int             getprocs(struct ProcessInfo*);
+int             getprocsat(struct ProcessInfo*, int, int*, int, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
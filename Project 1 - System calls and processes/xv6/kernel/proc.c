@@ -443,22 +443,47 @@ procdump(void)
   }
 }
 
+// Copy the processes in use into processInfoTable, which has
+// room for n > 0, starting from slot *cursor of the process table.
+// Only those in state state are copied unless state is -1, and
+// only the one with pid pid unless pid is -1.  Sets *cursor to
+// the slot to go on from, NPROC once every slot has been seen.
+// Entries are packed, and all of them come from one look at the
+// table under ptable.lock.  Returns how many there are.
 int
-getprocs(struct ProcessInfo* processInfoTable)
+getprocsat(struct ProcessInfo *processInfoTable, int n, int *cursor, int state, int pid)
 {
   struct proc *p;
-  int i;
-  int result = 0;
-  for (p = ptable.proc, i = 0; p < &ptable.proc[NPROC] && i < NPROC; p++, i++) {
-    if (p->state == UNUSED) continue;
-    result++;
-    processInfoTable[i].pid = p->pid;
-    processInfoTable[i].ppid = (i == 0) ? -1 : p->parent->pid;
-    processInfoTable[i].state = p->state;
-    processInfoTable[i].sz = p->sz;
-    int j;
-    for (j = 0; j < 16; j++) processInfoTable[i].name[j] = p->name[j];
+  struct ProcessInfo *pi;
+
+  pi = processInfoTable;
+  acquire(&ptable.lock);
+  for(p = &ptable.proc[*cursor]; p < &ptable.proc[NPROC] && pi < processInfoTable + n; p++){
+    if(p->state == UNUSED)
+      continue;
+    if((state != -1 && p->state != state) || (pid != -1 && p->pid != pid))
+      continue;
+    pi->pid = p->pid;
+    // Exit hands children to init, so a parent is always there;
+    // only init has none.
+    pi->ppid = p->parent ? p->parent->pid : -1;
+    pi->state = p->state;
+    pi->sz = p->sz;
+    safestrcpy(pi->name, p->name, sizeof(pi->name));
+    pi++;
   }
-  p = NULL;
-  return result;
+  release(&ptable.lock);
+  *cursor = p - ptable.proc;
+  return pi - processInfoTable;
+}
+
+// Copy all processes in use into processInfoTable, which has
+// room for NPROC.
+int
+getprocs(struct ProcessInfo* processInfoTable)
+{
+  int cursor;
+
+  cursor = 0;
+  return getprocsat(processInfoTable, NPROC, &cursor, -1, -1);
 }
\ No newline at end of file
@@ -77,6 +77,7 @@ struct proc {
 };
 
 int getprocs(struct ProcessInfo*);
+int getprocsat(struct ProcessInfo*, int, int*, int, int);
 
 // Process memory is laid out contiguously, low addresses first:
 //   text
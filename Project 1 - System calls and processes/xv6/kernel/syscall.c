@@ -103,7 +103,8 @@ static int (*syscalls[])(void) = {
 [SYS_wait]    sys_wait,
 [SYS_write]   sys_write,
 [SYS_uptime]  sys_uptime,
-[SYS_getprocs]sys_getprocs
+[SYS_getprocs]sys_getprocs,
+[SYS_getprocsat] sys_getprocsat,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
@@ -24,4 +24,5 @@ int sys_wait(void);
 int sys_write(void);
 int sys_uptime(void);
 int sys_getprocs(void);
+int sys_getprocsat(void);
 #endif // _SYSFUNC_H_
@@ -94,4 +94,22 @@ sys_getprocs(void) {
   struct ProcessInfo *p;
   if (argptr(0, (char**)&p, sizeof(struct ProcessInfo) * NPROC) < 0) return -1; 
   return getprocs(p);
+}
+
+int
+sys_getprocsat(void)
+{
+  struct ProcessInfo *p;
+  int n, *cursor, state, pid;
+
+  if(argint(1, &n) < 0 || n <= 0 || argptr(2, (char**)&cursor, sizeof(*cursor)) < 0 ||
+     argint(3, &state) < 0 || argint(4, &pid) < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(argptr(0, (char**)&p, sizeof(struct ProcessInfo) * n) < 0)
+    return -1;
+  if(*cursor < 0 || *cursor > NPROC)
+    return -1;
+  return getprocsat(p, n, cursor, state, pid);
 }
\ No newline at end of file
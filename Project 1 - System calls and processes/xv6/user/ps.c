@@ -4,8 +4,11 @@
 #include "ProcessInfo.h"
 #include "param.h"
 
+#define PAGE 8  // processes fetched per getprocsat call
+
+// usage: ps [pid]
 int
-main(void)
+main(int argc, char *argv[])
 {
   enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
   static char *states[] = {
@@ -16,14 +19,20 @@ main(void)
   [RUNNING]   "run   ",
   [ZOMBIE]    "zombie"
   };
-  // struct ProcessInfo* processInfoTable = (struct ProcessInfo*) malloc((uint)(NPROC * sizeof(struct ProcessInfo)));
-  struct ProcessInfo processInfoTable[NPROC];
-  int numberOfCurrentProcesses = getprocs(processInfoTable);
-  int i;
+  struct ProcessInfo processInfoTable[PAGE];
+  int cursor, pid, n, i;
   int lineNumber;
-  for (i = 0, lineNumber = 1; i < numberOfCurrentProcesses; i++, lineNumber++)
-    printf(1, "%d  %d  %s  %d  %s\n", lineNumber, processInfoTable[i].ppid, states[processInfoTable[i].state], processInfoTable[i].sz, processInfoTable[i].name);
-  // free((void *)processInfoTable);
-  // processInfoTable = NULL;
+
+  pid = argc > 1 ? atoi(argv[1]) : -1;
+  cursor = 0;
+  lineNumber = 1;
+  while(cursor < NPROC){
+    if((n = getprocsat(processInfoTable, PAGE, &cursor, -1, pid)) < 0){
+      printf(2, "ps: getprocsat failed\n");
+      exit();
+    }
+    for (i = 0; i < n; i++, lineNumber++)
+      printf(1, "%d  %d  %s  %d  %s\n", lineNumber, processInfoTable[i].ppid, states[processInfoTable[i].state], processInfoTable[i].sz, processInfoTable[i].name);
+  }
   exit();
-}
\ No newline at end of file
+}
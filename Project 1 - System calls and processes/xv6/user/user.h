@@ -26,6 +26,7 @@ char* sbrk(int);
 int sleep(int);
 int uptime(void);
 int getprocs(struct ProcessInfo*);
+int getprocsat(struct ProcessInfo*, int, int*, int, int);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
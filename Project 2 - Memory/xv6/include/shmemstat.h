@@ -0,0 +1,13 @@
+#ifndef _SHMEMSTAT_H_
+#define _SHMEMSTAT_H_
+
+// Shared memory statistics, for use with shmem_stat syscall
+
+struct shmemstat {
+  int npages;    // shmem_access pages in use
+  int nsegs;     // shmem_create segments in use
+  int segpages;  // pages held by those segments
+  int attached;  // process attachments to both
+};
+
+#endif // _SHMEMSTAT_H_
@@ -25,5 +25,10 @@
 #define SYS_uptime 21
 #define SYS_shmem_access 22
 #define SYS_shmem_count 23
+#define SYS_shmem_create 24
+#define SYS_shmem_attach 25
+#define SYS_shmem_stat 26
+#define SYS_futex_wait 27
+#define SYS_futex_wake 28
 
 #endif // _SYSCALL_H_
\ No newline at end of file
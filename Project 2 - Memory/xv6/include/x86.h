@@ -139,6 +139,37 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Read the time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
+// n / d, and the remainder in *rem if rem isn't 0.  Plain 64-bit
+// division would call into libgcc, which isn't linked.
+static inline uint64
+div64(uint64 n, uint d, uint *rem)
+{
+  uint hi, lo, r;
+
+  hi = (uint)(n >> 32) / d;
+  asm("divl %4" : "=a" (lo), "=d" (r) : "a" ((uint)n), "d" ((uint)(n >> 32) % d), "rm" (d));
+  if(rem)
+    *rem = r;
+  return (uint64)hi << 32 | lo;
+}
+
+// Tell the CPU this is a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
 static inline void
 lcr0(uint val)
 {
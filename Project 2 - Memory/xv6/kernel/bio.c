@@ -4,6 +4,14 @@
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
+//
+// Lookups go through a hash table keyed by (dev, sector) so that
+// a cache hit does not have to walk the LRU list.  Each hash bucket
+// has its own lock, which protects the bucket chain and the flags
+// of the buffers on it.  bcache.lock protects the LRU list and
+// serializes eviction, the only operation that moves a buffer from
+// one bucket to another.  Never acquire bcache.lock while holding
+// a bucket lock.
 // 
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
@@ -27,6 +35,13 @@
 #include "spinlock.h"
 #include "buf.h"
 
+#define NBUCKET 13  // number of hash buckets; prime spreads sectors
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;  // chain through hnext
+};
+
 struct {
   struct spinlock lock;
   struct buf buf[NBUF];
@@ -34,14 +49,57 @@ struct {
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
   struct buf head;
+
+  // Hash table of all buffers, keyed by (dev, sector).
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+static struct bucket*
+bhash(uint dev, uint sector)
+{
+  return &bcache.bucket[(dev * 31 + sector) % NBUCKET];
+}
+
+// Unlink b from the chain of bucket bk.  Caller must hold bk->lock.
+static void
+bunhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      b->hnext = 0;
+      return;
+    }
+  }
+  panic("bunhash");
+}
+
+// Find the buffer for sector on device dev in bucket bk.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint sector)
+{
+  struct buf *b;
+
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->sector == sector)
+      return b;
+  return 0;
+}
+
 void
 binit(void)
 {
   struct buf *b;
+  struct bucket *bk;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head = 0;
+  }
 
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
@@ -52,6 +110,10 @@ binit(void)
     b->dev = -1;
     bcache.head.next->prev = b;
     bcache.head.next = b;
+
+    bk = bhash(b->dev, b->sector);
+    b->hnext = bk->head;
+    bk->head = b;
   }
 }
 
@@ -62,32 +124,53 @@ static struct buf*
 bget(uint dev, uint sector)
 {
   struct buf *b;
+  struct bucket *bk, *vk;
 
-  acquire(&bcache.lock);
+  bk = bhash(dev, sector);
+  acquire(&bk->lock);
 
  loop:
   // Try for cached block.
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->sector == sector){
-      if(!(b->flags & B_BUSY)){
-        b->flags |= B_BUSY;
-        release(&bcache.lock);
-        return b;
-      }
-      sleep(b, &bcache.lock);
-      goto loop;
+  if((b = bfind(bk, dev, sector)) != 0){
+    if(!(b->flags & B_BUSY)){
+      b->flags |= B_BUSY;
+      release(&bk->lock);
+      return b;
     }
+    sleep(b, &bk->lock);
+    goto loop;
   }
+  release(&bk->lock);
 
-  // Allocate fresh block.
+  // Miss: serialize with other evictions, then look again
+  // in case another CPU brought the block in meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if(bfind(bk, dev, sector) != 0){
+    release(&bcache.lock);
+    goto loop;
+  }
+
+  // Allocate fresh block, recycling the least recently used one.
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+    vk = bhash(b->dev, b->sector);
+    if(vk != bk)
+      acquire(&vk->lock);
     if((b->flags & B_BUSY) == 0){
+      bunhash(vk, b);
+      if(vk != bk)
+        release(&vk->lock);
       b->dev = dev;
       b->sector = sector;
       b->flags = B_BUSY;
+      b->hnext = bk->head;
+      bk->head = b;
+      release(&bk->lock);
       release(&bcache.lock);
       return b;
     }
+    if(vk != bk)
+      release(&vk->lock);
   }
   panic("bget: no buffers");
 }
@@ -118,21 +201,26 @@ bwrite(struct buf *b)
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if((b->flags & B_BUSY) == 0)
     panic("brelse");
 
+  // b is still B_BUSY, so eviction cannot move it while
+  // it is being put at the head of the LRU list.
   acquire(&bcache.lock);
-
   b->next->prev = b->prev;
   b->prev->next = b->next;
   b->next = bcache.head.next;
   b->prev = &bcache.head;
   bcache.head.next->prev = b;
   bcache.head.next = b;
+  release(&bcache.lock);
 
+  bk = bhash(b->dev, b->sector);
+  acquire(&bk->lock);
   b->flags &= ~B_BUSY;
   wakeup(b);
-
-  release(&bcache.lock);
+  release(&bk->lock);
 }
 
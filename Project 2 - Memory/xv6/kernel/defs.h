@@ -7,6 +7,7 @@ struct file;
 struct inode;
 struct pipe;
 struct proc;
+struct shmemstat;
 struct spinlock;
 struct stat;
 
@@ -108,6 +109,8 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             futexwait(uint, int);
+int             futexwake(uint);
 void            yield(void);
 
 // swtch.S
@@ -173,6 +176,10 @@ void*           shmem_access(int);
 int             shmem_count(int);
 void            freeshmems(struct proc*);
 void            forkshmems(struct proc*);
+void            freeshmsegs(struct proc*);
+int             shmem_create(int, int);
+void*           shmem_attach(int);
+void            shmem_stat(struct shmemstat*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -82,6 +82,7 @@ exec(char *path, char **argv)
   safestrcpy(proc->name, last, sizeof(proc->name));
 
   // Commit to the user image.
+  freeshmsegs(proc);
   oldpgdir = proc->pgdir;
   proc->pgdir = pgdir;
   proc->sz = sz;
@@ -119,6 +119,9 @@ struct segdesc {
 #define PGSIZE		4096		// bytes mapped by a page
 #define PGSHIFT		12		// log2(PGSIZE)
 #define NSHMEM    4    // largest number of share memory pages
+#define NSHMSEG   8    // shared memory segments (shmem_create)
+#define SHMSEGPAGES 128 // largest segment, in pages
+#define SHMSEGTOP (USERTOP - NSHMEM*PGSIZE) // segments are attached below here
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
 #define PDXSHIFT	22		// offset of PDX in a linear address
@@ -13,6 +13,8 @@ struct {
 
 static struct proc *initproc;
 
+struct spinlock futexlock;  // makes futexwait's check and sleep atomic
+
 int nextpid = 1;
 extern void forkret(void);
 extern void trapret(void);
@@ -23,6 +25,7 @@ void
 pinit(void)
 {
   initlock(&ptable.lock, "ptable");
+  initlock(&futexlock, "futex");
 }
 
 // Look in the process table for an UNUSED proc.
@@ -71,6 +74,8 @@ found:
   p->nshmems = 0;
   int  i;
   for (i = 0; i < NSHMEM; i++) p->shmems[i] = NULL;
+  p->shmsegbase = SHMSEGTOP;
+  for (i = 0; i < NSHMSEG; i++) p->shmsegs[i] = NULL;
 
   return p;
 }
@@ -394,6 +399,50 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Physical address of the word at user address addr, or 0.
+// Processes sharing memory share its futex channel.
+static int*
+futexaddr(uint addr)
+{
+  char *pa;
+
+  if(addr % sizeof(int) || addr >= USERTOP)
+    return 0;
+  if((pa = uva2ka(proc->pgdir, (char*)PGROUNDDOWN(addr))) == 0)
+    return 0;
+  return (int*)(pa + addr % PGSIZE);
+}
+
+// Sleep until a futexwake on addr, unless the word there no
+// longer holds val.  Returns -1 if addr isn't a mapped word.
+int
+futexwait(uint addr, int val)
+{
+  int *w;
+
+  if((w = futexaddr(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  if(*w == val && !proc->killed)
+    sleep(w, &futexlock);
+  release(&futexlock);
+  return 0;
+}
+
+// Wake every process in futexwait on addr.
+int
+futexwake(uint addr)
+{
+  int *w;
+
+  if((w = futexaddr(addr)) == 0)
+    return -1;
+  acquire(&futexlock);
+  wakeup(w);
+  release(&futexlock);
+  return 0;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
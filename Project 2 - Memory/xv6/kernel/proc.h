@@ -76,6 +76,8 @@ struct proc {
   char name[16];               // Process name (debugging)
   int nshmems;                 // Number of currently active shared memory pages
   void *shmems[NSHMEM];        // Shared memory pointer arrays currently
+  uint shmsegbase;             // Lowest address of attached segments
+  void *shmsegs[NSHMSEG];      // Where each segment is attached, or NULL
 };
 
 // Process memory is laid out contiguously, low addresses first:
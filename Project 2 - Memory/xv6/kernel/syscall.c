@@ -105,6 +105,11 @@ static int (*syscalls[])(void) = {
 [SYS_uptime]  sys_uptime,
 [SYS_shmem_access] sys_shmem_access,
 [SYS_shmem_count] sys_shmem_count,
+[SYS_shmem_create] sys_shmem_create,
+[SYS_shmem_attach] sys_shmem_attach,
+[SYS_shmem_stat] sys_shmem_stat,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
@@ -25,5 +25,10 @@ int sys_write(void);
 int sys_uptime(void);
 int sys_shmem_access(void);
 int sys_shmem_count(void);
+int sys_shmem_create(void);
+int sys_shmem_attach(void);
+int sys_shmem_stat(void);
+int sys_futex_wait(void);
+int sys_futex_wake(void);
 
 #endif // _SYSFUNC_H_
\ No newline at end of file
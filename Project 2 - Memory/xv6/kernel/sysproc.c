@@ -5,6 +5,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "sysfunc.h"
+#include "shmemstat.h"
 
 int
 sys_fork(void)
@@ -103,4 +104,45 @@ sys_shmem_count(void)
   int page_number;
   if (argint(0, &page_number) < 0) return -1;
   return (int)shmem_count(page_number);
+}
+
+int
+sys_shmem_create(void)
+{
+  int key, size;
+  if (argint(0, &key) < 0 || argint(1, &size) < 0) return -1;
+  return shmem_create(key, size);
+}
+
+int
+sys_shmem_attach(void)
+{
+  int key;
+  if (argint(0, &key) < 0) return -1;
+  return (int)shmem_attach(key);
+}
+
+int
+sys_shmem_stat(void)
+{
+  struct shmemstat *st;
+  if (argptr(0, (void*)&st, sizeof(*st)) < 0) return -1;
+  shmem_stat(st);
+  return 0;
+}
+
+int
+sys_futex_wait(void)
+{
+  int addr, val;
+  if (argint(0, &addr) < 0 || argint(1, &val) < 0) return -1;
+  return futexwait(addr, val);
+}
+
+int
+sys_futex_wake(void)
+{
+  int addr;
+  if (argint(0, &addr) < 0) return -1;
+  return futexwake(addr);
 }
\ No newline at end of file
@@ -5,9 +5,26 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "shmemstat.h"
 
 int shmems_counter[NSHMEM]; // Record the number of processes that are currently sharing the shared page specified by the page_number argument
 void *shmems_addr[NSHMEM]; // Record the address of the currently active shared page specified by the page_number argument
+struct spinlock shmemlock; // Protects shmems_counter, shmems_addr and shmsegs
+
+// Shared memory segments made by shmem_create.  shmem_attach maps
+// all of a segment's pages, below SHMSEGTOP and any segment the
+// process attached before; forked children stay attached.  A
+// segment is freed when the last process attached to it exits
+// or execs.
+struct shmseg {
+  int key;
+  int npages;                  // 0 if the slot is unused
+  int count;                   // processes attached
+  char *pages[SHMSEGPAGES];
+} shmsegs[NSHMSEG];
+
+static void shmsegunmap(struct proc*, int);
 
 extern char data[];  // defined in data.S
 
@@ -234,7 +251,7 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz + PGSIZE * (1 + proc->nshmems) > USERTOP)
+  if(newsz + PGSIZE * (1 + proc->nshmems) > USERTOP || newsz > proc->shmsegbase)
     return 0;
   if(newsz < oldsz)
     return oldsz;
@@ -300,20 +317,81 @@ freevm(pde_t *pgdir)
 void
 freeshmems(struct proc *p) {
   int i;
+  acquire(&shmemlock);
   for (i = 0; i < NSHMEM; i++) {
     if(p->shmems[i]) {
-      if (shmems_counter[i] == 1 && shmems_addr[i]) kfree((char*)shmems_addr[i]);
+      if (shmems_counter[i] == 1 && shmems_addr[i]) {
+        kfree((char*)shmems_addr[i]);
+        shmems_addr[i] = NULL;
+      }
       shmems_counter[i]--;
     }    
   }
+  release(&shmemlock);
+  freeshmsegs(p);
 }
 
 void
 forkshmems(struct proc *p) {
-  int i;
+  int i, j;
+  struct shmseg *s;
+
+  acquire(&shmemlock);
   for (i = 0; i < NSHMEM; i++)
     if(proc->shmems[i])
       shmems_counter[i]++;
+
+  // The child's page table has no segments yet; map them there too.
+  p->shmsegbase = proc->shmsegbase;
+  for (i = 0; i < NSHMSEG; i++) {
+    p->shmsegs[i] = NULL;
+    if (proc->shmsegs[i] == NULL)
+      continue;
+    s = &shmsegs[i];
+    for (j = 0; j < s->npages; j++)
+      if (mappages(p->pgdir, (char*)proc->shmsegs[i] + j*PGSIZE, PGSIZE, PADDR(s->pages[j]), PTE_W|PTE_U) < 0)
+        break;
+    p->shmsegs[i] = proc->shmsegs[i];
+    s->count++;
+    if (j < s->npages)
+      shmsegunmap(p, i);
+  }
+  release(&shmemlock);
+}
+
+// Unmap segment i from p, freeing it if p was the last process
+// attached.  Caller holds shmemlock.
+static void
+shmsegunmap(struct proc *p, int i)
+{
+  struct shmseg *s;
+  pte_t *pte;
+  int j;
+
+  s = &shmsegs[i];
+  for (j = 0; j < s->npages; j++)
+    if ((pte = walkpgdir(p->pgdir, (char*)p->shmsegs[i] + j*PGSIZE, 0)) != 0)
+      *pte = 0;
+  p->shmsegs[i] = NULL;
+  if (--s->count == 0) {
+    for (j = 0; j < s->npages; j++)
+      kfree(s->pages[j]);
+    s->npages = 0;
+  }
+}
+
+// Detach all of p's segments, before its page table goes away.
+void
+freeshmsegs(struct proc *p)
+{
+  int i;
+
+  acquire(&shmemlock);
+  for (i = 0; i < NSHMSEG; i++)
+    if (p->shmsegs[i])
+      shmsegunmap(p, i);
+  release(&shmemlock);
+  p->shmsegbase = SHMSEGTOP;
 }
 // Given a parent process's page table, create a copy
 // of it for a child.
@@ -354,7 +432,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -391,6 +469,7 @@ void
 shmeminit(void)
 {
   int i;
+  initlock(&shmemlock, "shmem");
   for (i = 0; i < NSHMEM; i++) {
     shmems_counter[i] = 0;
     shmems_addr[i] = NULL;
@@ -400,24 +479,156 @@ shmeminit(void)
 void*
 shmem_access(int page_number)
 {
+  pte_t *pte;
+  void *va;
+
   if (page_number < 0 || page_number >= NSHMEM || proc->nshmems < 0 || proc->nshmems >= NSHMEM) return NULL;
+  acquire(&shmemlock);
   if (proc->shmems[page_number]) {
-    if (mappages(proc->pgdir, proc->shmems[page_number], PGSIZE, PADDR(shmems_addr[page_number]), PTE_W|PTE_U) < 0) return NULL;
-    return proc->shmems[page_number];
+    // Inherited across fork: map it if this page table doesn't yet.
+    va = proc->shmems[page_number];
+    pte = walkpgdir(proc->pgdir, va, 0);
+    if ((pte == 0 || (*pte & PTE_P) == 0) &&
+        mappages(proc->pgdir, va, PGSIZE, PADDR(shmems_addr[page_number]), PTE_W|PTE_U) < 0)
+      va = NULL;
+    release(&shmemlock);
+    return va;
   }
   void *newSharedMemoryPageAddr = (void *)(USERTOP - (proc->nshmems + 1) * PGSIZE);
-  if (proc->sz >= (int)newSharedMemoryPageAddr) return NULL;
-  if ((shmems_addr[page_number] = kalloc()) == 0) panic("shmem_access: unable to allocate physical shared memory page");
-  if (mappages(proc->pgdir, newSharedMemoryPageAddr, PGSIZE, PADDR(shmems_addr[page_number]), PTE_W|PTE_U) < 0) return NULL;
+  if (proc->sz >= (int)newSharedMemoryPageAddr) {
+    release(&shmemlock);
+    return NULL;
+  }
+  // Another process may be using the page already.
+  if (shmems_addr[page_number] == NULL &&
+      (shmems_addr[page_number] = kalloc()) == 0)
+    panic("shmem_access: unable to allocate physical shared memory page");
+  if (mappages(proc->pgdir, newSharedMemoryPageAddr, PGSIZE, PADDR(shmems_addr[page_number]), PTE_W|PTE_U) < 0) {
+    if (shmems_counter[page_number] == 0) {
+      kfree((char*)shmems_addr[page_number]);
+      shmems_addr[page_number] = NULL;
+    }
+    release(&shmemlock);
+    return NULL;
+  }
   proc->nshmems++;
   shmems_counter[page_number]++;
   proc->shmems[page_number] = newSharedMemoryPageAddr;
+  release(&shmemlock);
   return newSharedMemoryPageAddr;
 }
 
+// Make a segment of size bytes, zeroed, named key.  Returns -1
+// if key is taken, size is too big, or out of memory.
+int
+shmem_create(int key, int size)
+{
+  struct shmseg *s, *fs;
+  int i, n;
+
+  if (size <= 0 || size > SHMSEGPAGES * PGSIZE)
+    return -1;
+  n = PGROUNDUP(size) / PGSIZE;
+  fs = 0;
+  acquire(&shmemlock);
+  for (s = shmsegs; s < shmsegs + NSHMSEG; s++) {
+    if (s->npages && s->key == key)
+      goto bad;
+    if (s->npages == 0 && fs == 0)
+      fs = s;
+  }
+  if (fs == 0)
+    goto bad;
+  for (i = 0; i < n; i++) {
+    if ((fs->pages[i] = kalloc()) == 0) {
+      while (--i >= 0)
+        kfree(fs->pages[i]);
+      goto bad;
+    }
+    memset(fs->pages[i], 0, PGSIZE);
+  }
+  fs->key = key;
+  fs->count = 0;
+  fs->npages = n;
+  release(&shmemlock);
+  return 0;
+
+bad:
+  release(&shmemlock);
+  return -1;
+}
+
+// Map the segment named key into the current process.  Returns
+// its address, or NULL if there is no such segment or no room.
+void*
+shmem_attach(int key)
+{
+  struct shmseg *s;
+  char *va;
+  int i, j;
+
+  va = NULL;
+  acquire(&shmemlock);
+  for (s = shmsegs; s < shmsegs + NSHMSEG; s++)
+    if (s->npages && s->key == key)
+      break;
+  if (s == shmsegs + NSHMSEG)
+    goto out;
+  i = s - shmsegs;
+  if (proc->shmsegs[i]) {
+    va = proc->shmsegs[i];
+    goto out;
+  }
+  if (proc->shmsegbase < PGROUNDUP(proc->sz) + s->npages * PGSIZE)
+    goto out;
+  va = (char*)proc->shmsegbase - s->npages * PGSIZE;
+  for (j = 0; j < s->npages; j++) {
+    if (mappages(proc->pgdir, va + j*PGSIZE, PGSIZE, PADDR(s->pages[j]), PTE_W|PTE_U) < 0) {
+      while (--j >= 0)
+        *walkpgdir(proc->pgdir, va + j*PGSIZE, 0) = 0;
+      va = NULL;
+      goto out;
+    }
+  }
+  s->count++;
+  proc->shmsegs[i] = va;
+  proc->shmsegbase = (uint)va;
+out:
+  release(&shmemlock);
+  return va;
+}
+
 int
 shmem_count(int page_number)
 {
+  int n;
   if (page_number < 0 || page_number >= NSHMEM || proc->nshmems < 0 || proc->nshmems >= NSHMEM) return -1;
-  return shmems_counter[page_number];
+  acquire(&shmemlock);
+  n = shmems_counter[page_number];
+  release(&shmemlock);
+  return n;
+}
+
+// Fill in statistics about all shared memory.
+void
+shmem_stat(struct shmemstat *st)
+{
+  struct shmseg *s;
+  int i;
+
+  memset(st, 0, sizeof(*st));
+  acquire(&shmemlock);
+  for (i = 0; i < NSHMEM; i++) {
+    if (shmems_addr[i])
+      st->npages++;
+    st->attached += shmems_counter[i];
+  }
+  for (s = shmsegs; s < shmsegs + NSHMSEG; s++) {
+    if (s->npages) {
+      st->nsegs++;
+      st->segpages += s->npages;
+      st->attached += s->count;
+    }
+  }
+  release(&shmemlock);
 }
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "ring.h"
+
+// IPC bandwidth and latency, between a parent and a forked child.
+//
+//   ipcbench [-m mb]
+//
+// Bandwidth moves mb MB (4 by default) one way:
+//
+//   pipe N    write()s of N bytes into a pipe
+//   shmem     a shmem_access page, half of it data, handed back
+//             and forth by polling a flag
+//   ring N    ring_send of N-byte messages through a ring in a
+//             shmem_create segment
+//
+// Latency is the median round trip of a 4-byte message over
+// NRTT trips, for a pipe pair, a polled shmem page and a ring
+// pair.  The polled transport spins, so it only makes sense with
+// more than one CPU.
+//
+// Times are TSC cycles, turned into microseconds by counting the
+// cycles in CALTICKS timer ticks, taken as 1/100 s each.
+
+#define PGSIZE   4096
+#define CHUNK    2048  // bytes per shmem handoff
+#define SHMPAGE  3     // shmem_access page used
+#define RINGKEY  0x1bc
+#define RINGSIZE (4*PGSIZE)
+#define NRTT     1000
+#define CALTICKS 20
+#define TICKHZ   100
+
+int stdout = 1;
+
+// Layout of the shmem_access page.
+struct shpage {
+  volatile uint full;  // data holds a chunk for the consumer
+  volatile uint ping;  // round trips: 1 from the parent, 2 back
+  char pad[56];
+  char data[CHUNK];
+};
+
+static uint mhz;  // TSC cycles per microsecond
+static uint total;
+static char buf[PGSIZE];
+static uint rtt[NRTT];
+
+// Count TSC cycles over CALTICKS ticks.
+static void
+calibrate(void)
+{
+  uint64 c0, c1;
+  int t;
+
+  t = uptime();
+  while(uptime() == t)
+    ;
+  c0 = rdtsc();
+  t += 1 + CALTICKS;
+  while(uptime() < t)
+    ;
+  c1 = rdtsc();
+  mhz = div64(div64((c1 - c0) * TICKHZ, CALTICKS, 0), 1000000, 0);
+  if(mhz == 0)
+    mhz = 1;
+}
+
+static void
+fail(char *msg)
+{
+  printf(stdout, "ipcbench: %s failed\n", msg);
+  exit();
+}
+
+// Print bytes moved in cycles as MB/s.
+static void
+rate(char *name, int size, uint64 cycles)
+{
+  uint x, kc;
+
+  kc = div64(cycles, 1000, 0);
+  if(kc == 0)
+    kc = 1;
+  x = div64((uint64)total * mhz, kc, 0);  // MB/s times 1000
+  if(size)
+    printf(stdout, "%s %d %d.%d MB/s\n", name, size, x / 1000, x % 1000 / 100);
+  else
+    printf(stdout, "%s %d.%d MB/s\n", name, x / 1000, x % 1000 / 100);
+}
+
+// Sort the round trips and print the median as microseconds.
+static void
+latency(char *name)
+{
+  uint x, ns;
+  int i, j;
+
+  for(i = 1; i < NRTT; i++){
+    x = rtt[i];
+    for(j = i; j > 0 && rtt[j-1] > x; j--)
+      rtt[j] = rtt[j-1];
+    rtt[j] = x;
+  }
+  ns = div64((uint64)rtt[NRTT/2] * 1000, mhz, 0);
+  printf(stdout, "%s rtt %d.%d us\n", name, ns / 1000, ns % 1000 / 100);
+}
+
+static void
+pipebw(int size)
+{
+  uint64 t0;
+  int fds[2], n, got;
+
+  if(pipe(fds) < 0)
+    fail("pipe");
+  t0 = rdtsc();
+  if(fork() == 0){
+    close(fds[0]);
+    for(n = 0; n < total; n += size)
+      if(write(fds[1], buf, size) != size)
+        fail("pipe write");
+    exit();
+  }
+  close(fds[1]);
+  for(got = 0; (n = read(fds[0], buf, sizeof(buf))) > 0; got += n)
+    ;
+  close(fds[0]);
+  wait();
+  if(got != total)
+    fail("pipe read");
+  rate("pipe", size, rdtsc() - t0);
+}
+
+static void
+pipelat(void)
+{
+  int to[2], from[2], i;
+  uint64 t0;
+
+  if(pipe(to) < 0 || pipe(from) < 0)
+    fail("pipe");
+  if(fork() == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], buf, 4) == 4)
+      write(from[1], buf, 4);
+    exit();
+  }
+  close(to[0]);
+  close(from[1]);
+  for(i = 0; i < NRTT; i++){
+    t0 = rdtsc();
+    if(write(to[1], buf, 4) != 4 || read(from[0], buf, 4) != 4)
+      fail("pipe round trip");
+    rtt[i] = rdtsc() - t0;
+  }
+  close(to[1]);
+  close(from[0]);
+  wait();
+  latency("pipe");
+}
+
+static void
+shmembw(struct shpage *sp)
+{
+  uint64 t0;
+  int n;
+
+  sp->full = 0;
+  t0 = rdtsc();
+  if(fork() == 0){
+    for(n = 0; n < total; n += CHUNK){
+      while(sp->full)
+        pause();
+      memmove(sp->data, buf, CHUNK);
+      xchg(&sp->full, 1);
+    }
+    exit();
+  }
+  for(n = 0; n < total; n += CHUNK){
+    while(!sp->full)
+      pause();
+    memmove(buf, sp->data, CHUNK);
+    xchg(&sp->full, 0);
+  }
+  wait();
+  rate("shmem", 0, rdtsc() - t0);
+}
+
+static void
+shmemlat(struct shpage *sp)
+{
+  uint64 t0;
+  int i;
+
+  sp->ping = 0;
+  if(fork() == 0){
+    for(i = 0; i < NRTT; i++){
+      while(sp->ping != 1)
+        pause();
+      xchg(&sp->ping, 2);
+    }
+    exit();
+  }
+  for(i = 0; i < NRTT; i++){
+    t0 = rdtsc();
+    xchg(&sp->ping, 1);
+    while(sp->ping != 2)
+      pause();
+    rtt[i] = rdtsc() - t0;
+  }
+  wait();
+  latency("shmem");
+}
+
+static void
+ringbw(struct ring *r, int size)
+{
+  uint64 t0;
+  int n;
+
+  if(ring_init(r, RINGSIZE, size) < 0)
+    fail("ring_init");
+  t0 = rdtsc();
+  if(fork() == 0){
+    for(n = 0; n < total; n += size)
+      ring_send(r, buf);
+    exit();
+  }
+  for(n = 0; n < total; n += size)
+    ring_recv(r, buf);
+  wait();
+  rate("ring", size, rdtsc() - t0);
+}
+
+static void
+ringlat(struct ring *r)
+{
+  struct ring *back;
+  uint64 t0;
+  int i;
+
+  back = (struct ring*)((char*)r + RINGSIZE/2);
+  if(ring_init(r, RINGSIZE/2, 4) < 0 || ring_init(back, RINGSIZE/2, 4) < 0)
+    fail("ring_init");
+  if(fork() == 0){
+    for(i = 0; i < NRTT; i++){
+      ring_recv(r, buf);
+      ring_send(back, buf);
+    }
+    exit();
+  }
+  for(i = 0; i < NRTT; i++){
+    t0 = rdtsc();
+    ring_send(r, buf);
+    ring_recv(back, buf);
+    rtt[i] = rdtsc() - t0;
+  }
+  wait();
+  latency("ring");
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int sizes[] = { 64, 512, 4096 };
+  struct shpage *sp;
+  struct ring *r;
+  int i;
+
+  total = 4;
+  if(argc > 2 && strcmp(argv[1], "-m") == 0)
+    total = atoi(argv[2]);
+  if(total < 1 || total > 1024){
+    printf(stdout, "usage: ipcbench [-m mb]\n");
+    exit();
+  }
+  total *= 1024*1024;
+  if((sp = shmem_access(SHMPAGE)) == 0)
+    fail("shmem_access");
+  shmem_create(RINGKEY, RINGSIZE);
+  if((r = shmem_attach(RINGKEY)) == 0)
+    fail("shmem_attach");
+
+  calibrate();
+  printf(stdout, "ipcbench: %d MB each way, TSC %d MHz\n", total >> 20, mhz);
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    pipebw(sizes[i]);
+  shmembw(sp);
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    ringbw(r, sizes[i]);
+  pipelat();
+  shmemlat(sp);
+  ringlat(r);
+  exit();
+}
@@ -21,6 +21,9 @@ USER_PROGS := \
 	usertests_2_2\
 	sharedmem_simpletests\
 	ta_tests_2_ec\
+	shmsegtest\
+	ringtest\
+	ipcbench\
 
 USER_PROGS := $(addprefix user/, $(USER_PROGS))
 
@@ -29,7 +32,8 @@ USER_LIBS := \
 	ulib.o\
 	usys.o\
 	printf.o\
-	umalloc.o
+	umalloc.o\
+	ring.o
 
 USER_LIBS := $(addprefix user/, $(USER_LIBS))
 
@@ -0,0 +1,118 @@
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "ring.h"
+
+#define SPINS 1000  // tries before sleeping in ring_send/ring_recv
+
+// Keep the compiler from moving memory accesses across this.
+#define barrier() asm volatile("" ::: "memory")
+
+// Lay out a ring in the size bytes at r, for messages of msgsize
+// bytes.  Call once, before attaching producers and the consumer.
+// Returns the number of slots, or -1 if not even one fits.
+int
+ring_init(struct ring *r, uint size, uint msgsize)
+{
+  uint n;
+
+  if(msgsize == 0 || size < sizeof(*r) + msgsize)
+    return -1;
+  for(n = 1; sizeof(*r) + 2*n*msgsize <= size; n *= 2)
+    ;
+  r->head = r->tail = 0;
+  r->plock = r->pwait = r->cwait = 0;
+  r->nslots = n;
+  r->msgsize = msgsize;
+  return n;
+}
+
+// Add a message, if there is room.  Returns 0, or -1 if full.
+int
+ring_put(struct ring *r, void *msg)
+{
+  uint h;
+
+  while(xchg(&r->plock, 1) != 0)
+    ;
+  h = r->head;
+  if(h - r->tail == r->nslots){
+    xchg(&r->plock, 0);
+    return -1;
+  }
+  memmove(r->data + (h % r->nslots) * r->msgsize, msg, r->msgsize);
+  barrier();
+  xchg(&r->head, h + 1);  // publish; also orders the cwait load below
+  xchg(&r->plock, 0);
+  if(r->cwait)
+    futex_wake(&r->head);
+  return 0;
+}
+
+// Take the oldest message, if any.  Returns 0, or -1 if empty.
+int
+ring_get(struct ring *r, void *msg)
+{
+  uint t;
+
+  t = r->tail;
+  if(r->head == t)
+    return -1;
+  barrier();
+  memmove(msg, r->data + (t % r->nslots) * r->msgsize, r->msgsize);
+  xchg(&r->tail, t + 1);
+  if(r->pwait)
+    futex_wake(&r->tail);
+  return 0;
+}
+
+// Count producers waiting for room; several may wait at once.
+static void
+pwaitadd(struct ring *r, int n)
+{
+  while(xchg(&r->plock, 1) != 0)
+    ;
+  r->pwait += n;
+  xchg(&r->plock, 0);
+}
+
+// Add a message, waiting for room.
+void
+ring_send(struct ring *r, void *msg)
+{
+  uint t;
+  int i;
+
+  for(;;){
+    for(i = 0; i < SPINS; i++)
+      if(ring_put(r, msg) == 0)
+        return;
+    // Announce the wait before the last look, so a consumer
+    // emptying a slot now is sure to see it.  futex_wait checks
+    // tail again, so a slot freed since we read t isn't missed.
+    pwaitadd(r, 1);
+    t = r->tail;
+    if(r->head - t == r->nslots)
+      futex_wait(&r->tail, t);
+    pwaitadd(r, -1);
+  }
+}
+
+// Take the oldest message, waiting for one.
+void
+ring_recv(struct ring *r, void *msg)
+{
+  uint h;
+  int i;
+
+  for(;;){
+    for(i = 0; i < SPINS; i++)
+      if(ring_get(r, msg) == 0)
+        return;
+    h = r->head;
+    xchg(&r->cwait, 1);
+    if(r->head == h && h == r->tail)
+      futex_wait(&r->head, h);
+    xchg(&r->cwait, 0);
+  }
+}
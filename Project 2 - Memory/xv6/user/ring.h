@@ -0,0 +1,27 @@
+#ifndef _RING_H_
+#define _RING_H_
+
+// A ring of fixed-size messages laid out in shared memory (a
+// shmem_access page or a shmem_create segment), for one consumer
+// and one or more producers.  ring_put and ring_get never block;
+// ring_send and ring_recv spin for a while, then sleep in
+// futex_wait until the other side makes progress.
+
+struct ring {
+  volatile uint head;     // next slot to fill (producers)
+  volatile uint tail;     // next slot to empty (consumer)
+  volatile uint plock;    // serializes producers (MPSC)
+  volatile uint pwait;    // producers waiting for room
+  volatile uint cwait;    // the consumer is waiting for a message
+  uint nslots;            // slots; a power of 2
+  uint msgsize;           // bytes per message
+  char data[];
+};
+
+int ring_init(struct ring*, uint, uint);
+int ring_put(struct ring*, void*);
+int ring_get(struct ring*, void*);
+void ring_send(struct ring*, void*);
+void ring_recv(struct ring*, void*);
+
+#endif // _RING_H_
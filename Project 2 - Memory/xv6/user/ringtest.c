@@ -0,0 +1,67 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ring.h"
+
+#define PGSIZE 4096
+#define NPROD 2
+#define NMSG 2000  // many times what the ring holds
+
+int stdout = 1;
+
+void
+fail(char *msg)
+{
+  printf(stdout, "ring test failed: %s\n", msg);
+  exit();
+}
+
+int
+main(void)
+{
+  struct ring *r;
+  int i, m, n, next[NPROD];
+
+  printf(stdout, "ring test\n");
+  if(shmem_create(7, 2*PGSIZE) != 0 || (r = shmem_attach(7)) == 0)
+    fail("shared memory");
+  if((n = ring_init(r, 2*PGSIZE, sizeof(int))) < 1)
+    fail("init");
+  if(ring_get(r, &m) != -1)
+    fail("get from an empty ring");
+  for(i = 0; i < n; i++)
+    if(ring_put(r, &i) != 0)
+      fail("put");
+  if(ring_put(r, &i) != -1)
+    fail("put into a full ring");
+  for(i = 0; i < n; i++)
+    if(ring_get(r, &m) != 0 || m != i)
+      fail("get");
+
+  // Producers fill the ring faster than we drain it, so both
+  // sides end up sleeping in futex_wait.
+  for(i = 0; i < NPROD; i++){
+    if(fork() == 0){
+      for(m = 0; m < NMSG; m++){
+        n = i << 16 | m;
+        ring_send(r, &n);
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < NPROD; i++)
+    next[i] = 0;
+  for(n = 0; n < NPROD * NMSG; n++){
+    ring_recv(r, &m);
+    i = m >> 16;
+    if(i < 0 || i >= NPROD || (m & 0xffff) != next[i])
+      fail("message out of order");
+    next[i]++;
+    if(n % 500 == 0)
+      sleep(1);
+  }
+  for(i = 0; i < NPROD; i++)
+    wait();
+  printf(stdout, "ring test ok\n");
+  exit();
+}
@@ -0,0 +1,85 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "shmemstat.h"
+
+#define PGSIZE 4096
+#define SIZE (64*PGSIZE)
+
+int stdout = 1;
+
+void
+fail(char *msg)
+{
+  printf(stdout, "shmseg test failed: %s\n", msg);
+  exit();
+}
+
+int
+main(void)
+{
+  char *a, *b;
+  int i, pid;
+  struct shmemstat st, st2;
+
+  printf(stdout, "shmseg test\n");
+  if(shmem_create(1, SIZE) != 0)
+    fail("create");
+  if(shmem_create(1, PGSIZE) != -1)
+    fail("create with a taken key");
+  if(shmem_create(2, 1024*1024) != -1)
+    fail("create too big");
+  if(shmem_attach(3) != 0)
+    fail("attach to a missing key");
+
+  if((a = shmem_attach(1)) == 0)
+    fail("attach");
+  if(shmem_attach(1) != a)
+    fail("second attach moved");
+
+  // A forked child is attached already.
+  pid = fork();
+  if(pid == 0){
+    if((b = shmem_attach(1)) != a)
+      fail("attach in child");
+    for(i = 0; i < SIZE; i += PGSIZE)
+      b[i] = i / PGSIZE;
+    exit();
+  }
+  wait();
+  for(i = 0; i < SIZE; i += PGSIZE)
+    if(a[i] != i / PGSIZE)
+      fail("child's writes not seen");
+
+  pid = fork();
+  if(pid == 0){
+    a[SIZE-1] = 'x';
+    exit();
+  }
+  wait();
+  if(a[SIZE-1] != 'x')
+    fail("second child's write not seen");
+  if(sbrk(640*1024) != (char*)-1)
+    fail("heap grew over the segment");
+
+  // Many children attaching and exiting at once leave the counts
+  // where they were.
+  if(shmem_stat(&st) != 0 || st.nsegs < 1 || st.segpages < SIZE/PGSIZE)
+    fail("stat");
+  for(i = 0; i < 8; i++){
+    pid = fork();
+    if(pid == 0){
+      shmem_access(0);
+      shmem_attach(1);
+      exit();
+    }
+  }
+  for(i = 0; i < 8; i++)
+    wait();
+  shmem_stat(&st2);
+  if(st2.attached != st.attached || st2.segpages != st.segpages || st2.npages != st.npages)
+    fail("counts changed after children exited");
+
+  printf(stdout, "shmseg test ok\n");
+  exit();
+}
@@ -1,6 +1,7 @@
 #ifndef _USER_H_
 #define _USER_H_
 
+struct shmemstat;
 struct stat;
 
 // system calls
@@ -27,6 +28,11 @@ int sleep(int);
 int uptime(void);
 void* shmem_access(int);
 int shmem_count(int);
+int shmem_create(int, int);
+void* shmem_attach(int);
+int shmem_stat(struct shmemstat*);
+int futex_wait(volatile void*, int);
+int futex_wake(volatile void*);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
@@ -0,0 +1,77 @@
+#ifndef _ATOMIC_H_
+#define _ATOMIC_H_
+// Atomic operations on 32-bit words, for threads and processes
+// sharing memory.  Each locked instruction is also a full memory
+// barrier, and each function a compiler barrier, so none of them
+// needs an mfence around it.
+
+// Atomically set *addr to newval if it holds old.
+// Returns what *addr held.
+static inline uint
+atomic_cas(volatile uint *addr, uint old, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc", "memory");
+  return result;
+}
+
+// Atomically add n to *addr.  Returns what *addr held before.
+static inline uint
+atomic_fetch_add(volatile uint *addr, uint n)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "cc", "memory");
+  return n;
+}
+
+// Atomically set *addr to newval.  Returns what it held.
+static inline uint
+atomic_xchg(volatile uint *addr, uint newval)
+{
+  asm volatile("xchgl %0, %1" :
+               "+r" (newval), "+m" (*addr) :
+               :
+               "memory");
+  return newval;
+}
+
+// Plain loads and stores of aligned words are atomic, and x86
+// keeps them in order, except for a store followed by a load of
+// another word; these only keep the compiler from moving them.
+static inline uint
+atomic_load(volatile uint *addr)
+{
+  uint v = *addr;
+
+  asm volatile("" : : : "memory");
+  return v;
+}
+
+static inline void
+atomic_store(volatile uint *addr, uint v)
+{
+  asm volatile("" : : : "memory");
+  *addr = v;
+}
+
+// Full memory barrier: orders a store before a later load.
+static inline void
+mfence(void)
+{
+  asm volatile("mfence" : : : "memory");
+}
+
+// Tell the CPU this is a spin-wait loop.
+static inline void
+cpu_relax(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
+#endif // _ATOMIC_H_
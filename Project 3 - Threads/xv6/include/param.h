@@ -15,5 +15,9 @@
 #define USERTOP  0xA0000 // end of user address space
 #define PHYSTOP  0x1000000 // use phys mem up to here as free pool
 #define MAXARG       32  // max exec arguments
+#define TLSSIZE     128  // thread-local bytes at the bottom of a stack page
+#define DEFTICKETS  100  // a new process's scheduler tickets
+#define MAXTICKETS 10000 // most tickets settickets allows
+#define MAXRTPRIO    99  // highest real-time priority setrtprio allows
 
 #endif // _PARAM_H_
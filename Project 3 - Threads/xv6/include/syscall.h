@@ -27,6 +27,17 @@
 #define SYS_join   23
 #define SYS_cv_wait 24
 #define SYS_cv_signal 25
-#define SYS_find_ustack 26
+#define SYS_futex_wait 27
+#define SYS_futex_wake 28
+#define SYS_cv_broadcast 29
+#define SYS_vfork 30
+#define SYS_settickets 31
+#define SYS_setgang 32
+#define SYS_yield_to 33
+#define SYS_setrtprio 34
+#define SYS_futex_wait_pi 35
+#define SYS_join_any 36
+#define SYS_thread_exit 37
+#define SYS_sysinfo 38
 
 #endif // _SYSCALL_H_
\ No newline at end of file
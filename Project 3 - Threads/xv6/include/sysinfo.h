@@ -0,0 +1,27 @@
+#ifndef _SYSINFO_H_
+#define _SYSINFO_H_
+
+#include "param.h"
+
+// What the sysinfo syscall reports about the machine, so that
+// programs can size thread pools and caches to it.  Ticks are
+// timer interrupts taken by that CPU, busy if a thread was
+// running, idle if it was in the scheduler.
+
+struct cpustat {
+  uint apicid;    // Local APIC ID
+  uint online;    // Has it started?
+  uint busy;      // Ticks running a thread
+  uint idle;      // Ticks in the scheduler
+  uint switches;  // Threads switched to
+};
+
+struct sysinfo {
+  uint ncpu;        // CPUs found by mpinit
+  uint nonline;     // ... of which started
+  uint freepages;   // Free physical pages
+  uint totalpages;  // All the pages kalloc manages
+  struct cpustat cpu[NCPU];  // The first ncpu are filled in
+};
+
+#endif // _SYSINFO_H_
@@ -37,6 +37,10 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_RESCHED     20      // IPI: a process is runnable (see resched)
+#define IRQ_TLB         21      // IPI: flush the TLB (see tlbshootdown)
+#define IRQ_PREEMPT     22      // IPI: yield (see gangstart, resched)
 #define IRQ_SPURIOUS    31
+#define NIRQ            32
 
 #endif // _TRAPS_H_
\ No newline at end of file
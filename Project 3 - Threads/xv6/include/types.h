@@ -6,11 +6,59 @@
 typedef unsigned int   uint;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
+typedef unsigned long long uint64;
 typedef uint pde_t;
 
 typedef uint lock_t;
 typedef uint cond_t;
 
+// Spin-then-sleep mutex of uthreadlib.c, with contention counts.
+typedef struct {
+  uint state;      // 0 free, 1 held, 2 held and maybe waited for
+  uint acquires;   // Times locked
+  uint contended;  // Times it was held when a thread came to lock it
+  uint parks;      // Times a thread slept in the kernel waiting for it
+  uint owner;      // Holder's thread-local storage address, or 0
+} mutex_t;
+
+// Reader-writer lock of uthreadlib.c, built on lock_t and cond_t.
+typedef struct {
+  lock_t lock;         // Guards the fields below
+  cond_t rcond;        // Readers wait here
+  cond_t wcond;        // Writers wait here
+  int readers;         // Readers holding it
+  int writer;          // Held by a writer?
+  int writerswaiting;  // Writers waiting; new readers hold back for them
+} rwlock_t;
+
+// Counting semaphore of uthreadlib.c, on a futex.
+typedef struct {
+  uint count;    // Units available
+  uint waiters;  // Threads that may be asleep in sem_wait
+} sem_t;
+
+// Sense-reversing barrier of uthreadlib.c.  A phase ends when the
+// last of n threads arrives and flips sense, which the others
+// sleep on meanwhile.
+typedef struct {
+  uint n;      // Threads that meet at it
+  uint left;   // Yet to arrive this phase
+  uint sense;  // Flips at the end of each phase
+} barrier_t;
+
+// Countdown latch of uthreadlib.c: waiters block until count
+// reaches 0, once.
+typedef struct {
+  uint count;  // Countdowns still to come
+} latch_t;
+
+// Counting semaphore for the green threads of green.c.
+typedef struct {
+  int count;
+  struct gthread *head;  // Green threads blocked on it, oldest first
+  struct gthread *tail;
+} gsem_t;
+
 #ifndef NULL
 #define NULL (0)
 #endif
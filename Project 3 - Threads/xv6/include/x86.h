@@ -126,6 +126,24 @@ sti(void)
   asm volatile("sti");
 }
 
+// Enable interrupts and halt until one comes, with no chance
+// of an interrupt between the two.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
+// Read the time-stamp counter.
+static inline uint64
+rdtsc(void)
+{
+  uint64 t;
+
+  asm volatile("rdtsc" : "=A" (t));
+  return t;
+}
+
 static inline uint
 xchg(volatile uint *addr, uint newval)
 {
@@ -139,6 +157,38 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically set *addr to newval if it holds old.
+// Returns what *addr held.
+static inline uint
+cmpxchg(volatile uint *addr, uint old, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (old) :
+               "cc");
+  return result;
+}
+
+// Atomically add n to *addr, returning what it held.
+static inline uint
+xadd(volatile uint *addr, uint n)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "memory", "cc");
+  return n;
+}
+
+// Tell the CPU this is a spin-wait loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
 static inline void
 lcr0(uint val)
 {
@@ -153,6 +203,20 @@ rcr0(void)
   return val;
 }
 
+static inline void
+lcr4(uint val)
+{
+  asm volatile("movl %0,%%cr4" : : "r" (val));
+}
+
+static inline uint
+rcr4(void)
+{
+  uint val;
+  asm volatile("movl %%cr4,%0" : "=r" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
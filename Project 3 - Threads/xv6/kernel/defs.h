@@ -66,6 +66,7 @@ void            ioapicinit(void);
 char*           kalloc(void);
 void            kfree(char*);
 void            kinit(void);
+void            kstat(uint*, uint*);
 
 // kbd.c
 void            kbdintr(void);
@@ -75,6 +76,7 @@ int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(int);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -104,16 +106,29 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setgang(int);
+int             yield_to(int);
+int             setrtprio(int);
+void            pilend(struct proc*);
+void            pireturn(void);
+int             futex_wait_pi(uint*, uint, uint);
+int             settickets(int);
+int             setvm(pde_t*, uint);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+int             vfork(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 int             clone(void(*fcn)(void*), void* arg, void* stack);
 int             join(int pid);
+int             join_any(int *status);
+void            thread_exit(int status);
 void            cv_wait(cond_t* conditionVariable, lock_t* lock);
 void            cv_signal(cond_t* conditionVariable);
-int             find_ustack(int pid);
+void            cv_broadcast(cond_t* conditionVariable);
+int             futex_wait(uint*, uint);
+int             futex_wake(uint*, int);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
@@ -126,8 +141,6 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
-void            acquire_lock_t(lock_t* lock);
-void            release_lock_t(lock_t* lock);
 
 // string.c
 int             memcmp(const void*, const void*, uint);
@@ -151,6 +164,8 @@ void            timerinit(void);
 
 // trap.c
 void            idtinit(void);
+void            ipiset(int, void(*)(void));
+void            ipisend(int, int);
 extern uint     ticks;
 void            tvinit(void);
 extern struct spinlock tickslock;
@@ -174,7 +189,10 @@ int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
+void            tlbshootdown(pde_t*);
+int             unmapuvm(pde_t*, uint, uint, char**);
 int             copyout(pde_t*, uint, void*, uint);
+void            clearpteu(pde_t*, char*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -12,11 +12,11 @@ exec(char *path, char **argv)
 {
   char *s, *last;
   int i, off;
-  uint argc, sz, sp, ustack[3+MAXARG+1];
+  uint argc, sz, sp, tls, ustack[3+MAXARG+1];
   struct elfhdr elf;
   struct inode *ip;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  pde_t *pgdir;
 
   if((ip = namei(path)) == 0)
     return -1;
@@ -75,20 +75,27 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
+  // The bottom of the stack page is the main thread's local
+  // storage, its first word holding its own address.
+  tls = sz - PGSIZE;
+  if(sp < tls + TLSSIZE || copyout(pgdir, tls, &tls, sizeof(tls)) < 0)
+    goto bad;
+
+  // Commit to the user image.
+  if(setvm(pgdir, sz) < 0)
+    goto bad;
+  pgdir = 0;
+  proc->tls = tls;
+  switchuvm(proc);
+
   // Save program name for debugging.
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
   safestrcpy(proc->name, last, sizeof(proc->name));
 
-  // Commit to the user image.
-  oldpgdir = proc->pgdir;
-  proc->pgdir = pgdir;
-  proc->sz = sz;
   proc->tf->eip = elf.entry;  // main
   proc->tf->esp = sp;
-  switchuvm(proc);
-  freevm(oldpgdir);
 
   return 0;
 
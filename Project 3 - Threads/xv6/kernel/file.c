@@ -4,8 +4,14 @@
 #include "fs.h"
 #include "file.h"
 #include "spinlock.h"
+#include "x86.h"
 
 struct devsw devsw[NDEV];
+
+// ftable.lock guards taking a free file (ref 0) and freeing one.
+// Otherwise references change by atomic instructions, with no
+// lock: filedup's caller has a reference, so f can't be freed
+// meanwhile, and fileclose locks only to drop the last one.
 struct {
   struct spinlock lock;
   struct file file[NFILE];
@@ -39,11 +45,8 @@ filealloc(void)
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(xadd(&f->ref, 1) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -52,16 +55,19 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  uint r;
 
+  while((r = f->ref) > 1)
+    if(cmpxchg(&f->ref, r, r - 1) == r)
+      return;
   acquire(&ftable.lock);
   if(f->ref < 1)
     panic("fileclose");
-  if(--f->ref > 0){
+  if(xadd(&f->ref, -1) > 1){
     release(&ftable.lock);
     return;
   }
   ff = *f;
-  f->ref = 0;
   f->type = FD_NONE;
   release(&ftable.lock);
   
@@ -2,7 +2,7 @@
 #define _FILE_H_
 struct file {
   enum { FD_NONE, FD_PIPE, FD_INODE } type;
-  int ref; // reference count
+  volatile uint ref; // reference count; see filedup
   char readable;
   char writable;
   struct pipe *pipe;
@@ -16,8 +16,9 @@ struct file {
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
-  int ref;            // Reference count
+  volatile uint ref;  // Reference count; see idup
   int flags;          // I_BUSY, I_VALID
+  struct proc *holder;  // Thread that set I_BUSY in ilock
 
   short type;         // copy of disk inode
   short major;
@@ -20,6 +20,7 @@
 #include "buf.h"
 #include "fs.h"
 #include "file.h"
+#include "x86.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -111,6 +112,9 @@ bfree(int dev, uint b)
 // ip->ref counts the number of pointer references to this cached
 // inode; references are typically kept in struct file and in proc->cwd.
 // When ip->ref falls to zero, the inode is no longer cached.
+// icache.lock guards taking a free inode (ref 0) and dropping the
+// last reference; otherwise ip->ref changes by atomic instructions
+// and idup and iput take no lock.
 // It is an error to use an inode without holding a reference to it.
 //
 // Processes are only allowed to read and write inode
@@ -199,7 +203,7 @@ iget(uint dev, uint inum)
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+      xadd(&ip->ref, 1);
       release(&icache.lock);
       return ip;
     }
@@ -226,9 +230,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  xadd(&ip->ref, 1);
   return ip;
 }
 
@@ -243,9 +245,12 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquire(&icache.lock);
-  while(ip->flags & I_BUSY)
+  while(ip->flags & I_BUSY){
+    pilend(ip->holder);
     sleep(ip, &icache.lock);
+  }
   ip->flags |= I_BUSY;
+  ip->holder = proc;
   release(&icache.lock);
 
   if(!(ip->flags & I_VALID)){
@@ -273,14 +278,22 @@ iunlock(struct inode *ip)
 
   acquire(&icache.lock);
   ip->flags &= ~I_BUSY;
+  ip->holder = 0;
   wakeup(ip);
   release(&icache.lock);
+  pireturn();
 }
 
 // Caller holds reference to unlocked ip.  Drop reference.
 void
 iput(struct inode *ip)
 {
+  uint r;
+
+  // Not the last reference: drop it without the lock.
+  while((r = ip->ref) > 1)
+    if(cmpxchg(&ip->ref, r, r - 1) == r)
+      return;
   acquire(&icache.lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
     // inode is no longer used: truncate and free inode.
@@ -295,7 +308,7 @@ iput(struct inode *ip)
     ip->flags = 0;
     wakeup(ip);
   }
-  ip->ref--;
+  xadd(&ip->ref, -1);
   release(&icache.lock);
 }
 
@@ -571,8 +584,11 @@ namex(char *path, int nameiparent, char *name)
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(proc->cwd);
+  else {
+    acquire(&proc->files->lock);
+    ip = idup(proc->files->cwd);
+    release(&proc->files->lock);
+  }
 
   while((path = skipelem(path, name)) != 0){
     ilock(ip);
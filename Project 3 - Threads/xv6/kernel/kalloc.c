@@ -15,6 +15,8 @@ struct run {
 struct {
   struct spinlock lock;
   struct run *freelist;
+  uint nfree;   // pages on freelist
+  uint npage;   // pages kinit gave it
 } kmem;
 
 extern char end[]; // first address after kernel loaded from ELF file
@@ -29,6 +31,7 @@ kinit(void)
   p = (char*)PGROUNDUP((uint)end);
   for(; p + PGSIZE <= (char*)PHYSTOP; p += PGSIZE)
     kfree(p);
+  kmem.npage = kmem.nfree;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -50,6 +53,7 @@ kfree(char *v)
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
+  kmem.nfree++;
   release(&kmem.lock);
 }
 
@@ -63,9 +67,22 @@ kalloc(void)
 
   acquire(&kmem.lock);
   r = kmem.freelist;
-  if(r)
+  if(r){
     kmem.freelist = r->next;
+    kmem.nfree--;
+  }
   release(&kmem.lock);
   return (char*)r;
 }
 
+// Set *nfree and *npage to the free and the total number of
+// pages.
+void
+kstat(uint *nfree, uint *npage)
+{
+  acquire(&kmem.lock);
+  *nfree = kmem.nfree;
+  *npage = kmem.npage;
+  release(&kmem.lock);
+}
+
@@ -167,3 +167,15 @@ lapicstartap(uchar apicid, uint addr)
     microdelay(200);
   }
 }
+
+// Send the CPU with APIC id apicid an interrupt at vector.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
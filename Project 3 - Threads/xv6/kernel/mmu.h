@@ -39,6 +39,8 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+#define CR4_PGE		0x00000080	// Page Global Enable
+
 // Segment Descriptor
 struct segdesc {
   uint lim_15_0 : 16;  // Low bits of segment limit
@@ -134,6 +136,7 @@ struct segdesc {
 #define PTE_A		0x020	// Accessed
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
+#define PTE_G		0x100	// Global: kept in the TLB across cr3 loads
 #define PTE_MBZ		0x180	// Bits must be zero
 
 // Address in page table or page directory entry
@@ -5,12 +5,37 @@
 #include "x86.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "traps.h"
 
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct proc *free;  // UNUSED procs, through freenext
+  uint64 vtime;       // Pass of the last process scheduled
+  int next;           // Where the next scheduling scan starts
+  struct vmspace *gang;  // Process whose threads go first, if any
+  uint gangend;          // ... until this tick
+  int nrt;               // Threads with a real-time priority
 } ptable;
 
+#define STRIDE1 (1 << 20)  // a process's stride is STRIDE1 / tickets
+
+// Address spaces; one per process, whatever its thread count.
+// Protected by ptable.lock.
+static struct vmspace vmtable[NPROC];
+
+// File tables; one per process, whatever its thread count.
+// Their refs are protected by ptable.lock.
+static struct files filestable[NPROC];
+
+// Futex wait queues, hashed by (address space, addr) so that the
+// threads of one process meet on the same word.  Protected by
+// ptable.lock.
+#define NFUTEXQ 64
+#define FUTEXQ(vm, addr) \
+  (&futexq[(((uint)(vm) / sizeof(struct vmspace)) ^ ((uint)(addr) >> 2)) % NFUTEXQ])
+static struct proc *futexq[NFUTEXQ];
+
 static struct proc *initproc;
 
 int nextpid = 1;
@@ -18,16 +43,297 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
-struct spinlock lgp;
+static void shrinkvm(struct vmspace *vm, uint sz);
+static void vforkdone(void);
+
+#define NSHRINK 32  // pages growproc frees per TLB shootdown
+
+// IRQ_RESCHED only has to wake the CPU from hlt.
+static void
+reschedintr(void)
+{
+}
 
 void
 pinit(void)
 {
+  struct vmspace *vm;
+  struct files *fs;
+  struct proc *p;
+
   initlock(&ptable.lock, "ptable");
+  for(p = &ptable.proc[NPROC-1]; p >= ptable.proc; p--){
+    p->freenext = ptable.free;
+    ptable.free = p;
+  }
+  for(vm = vmtable; vm < &vmtable[NPROC]; vm++)
+    initlock(&vm->lock, "vmspace");
+  for(fs = filestable; fs < &filestable[NPROC]; fs++)
+    initlock(&fs->lock, "files");
+  ipiset(IRQ_RESCHED, reschedintr);
+  ipiset(IRQ_PREEMPT, reschedintr);  // trap yields
+}
+
+// p's real-time priority, or more if threads waiting on its
+// locks have lent it theirs.
+static int
+prio(struct proc *p)
+{
+  return p->inherit > p->rtprio ? p->inherit : p->rtprio;
+}
+
+// p just became RUNNABLE: wake one halted CPU, other than this
+// one, to run it.  If none is halted and p is real-time, have the
+// CPU running the least urgent thread below it yield to it, even
+// if that is this one, so it needn't wait for a tick.
+static void
+resched(struct proc *p)
+{
+  struct cpu *c, *low;
+  struct proc *q;
+  int pr, lowpr;
+
+  __sync_synchronize();  // p->state before the reads of c->idle
+  for(c = cpus; c < cpus + ncpu; c++){
+    if(c != cpu && c->idle && xchg(&c->idle, 0)){
+      ipisend(c - cpus, IRQ_RESCHED);
+      return;
+    }
+  }
+  if((pr = prio(p)) == 0)
+    return;
+  low = 0;
+  lowpr = pr;
+  for(c = cpus; c < cpus + ncpu; c++){
+    if((q = c->proc) == 0)
+      return;  // in scheduler(), about to look
+    if(prio(q) < lowpr){
+      low = c;
+      lowpr = prio(q);
+    }
+  }
+  if(low)
+    ipisend(low - cpus, IRQ_PREEMPT);
+}
+
+// The current thread is going to sleep on a lock that h holds:
+// lend h its priority, and whatever h is asleep on in turn, so a
+// less urgent holder can't keep it waiting while others run.
+// Caller holds ptable.lock.
+static void
+pilend1(struct proc *h)
+{
+  int pr, n;
+
+  if(h == 0 || h == proc || (pr = prio(proc)) == 0)
+    return;
+  proc->piowner = h;
+  for(n = 0; h && n < NPROC; h = h->piowner, n++){
+    if(h->inherit >= pr)
+      break;
+    h->inherit = pr;
+    if(h->state == RUNNABLE)
+      resched(h);
+  }
+}
+
+void
+pilend(struct proc *h)
+{
+  if(h == 0 || prio(proc) == 0)
+    return;
+  acquire(&ptable.lock);
+  pilend1(h);
+  release(&ptable.lock);
+}
+
+// The current thread let go of a lock and woke next to take it,
+// if next isn't 0; threads still asleep on futex addr now lend to
+// next instead.  Keep only what waiters on its other locks lend.
+// Caller holds ptable.lock.
+static void
+pireturn1(uint *addr, struct proc *next)
+{
+  struct proc *p;
+
+  if(proc->inherit == 0)
+    return;
+  proc->inherit = 0;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != SLEEPING || p->piowner != proc)
+      continue;
+    if(next && addr && p->fxaddr == addr){
+      p->piowner = next;
+      if(next->inherit < prio(p))
+        next->inherit = prio(p);
+    } else if(proc->inherit < prio(p))
+      proc->inherit = prio(p);
+  }
+}
+
+void
+pireturn(void)
+{
+  if(proc->inherit == 0)
+    return;
+  acquire(&ptable.lock);
+  pireturn1(0, 0);
+  release(&ptable.lock);
+}
+
+// Halt until an interrupt if nothing is RUNNABLE.  Setting
+// cpu->idle with interrupts off, before looking, means a resched
+// that comes after the look sees it and sends the IPI, which
+// waits for the sti in stihlt.
+static void
+idle(void)
+{
+  struct proc *p;
+
+  cli();
+  xchg(&cpu->idle, 1);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNABLE)
+      break;
+  if(p == &ptable.proc[NPROC])
+    stihlt();
+  cpu->idle = 0;
+  sti();
+}
+
+// Make an address space of pgdir holding sz bytes, with one user.
+// It takes the current process's tickets, and starts level with
+// the processes now running.  Returns 0 if there is none free.
+static struct vmspace*
+vmalloc(pde_t *pgdir, uint sz)
+{
+  struct vmspace *vm;
+
+  acquire(&ptable.lock);
+  for(vm = vmtable; vm < &vmtable[NPROC]; vm++){
+    if(vm->ref == 0){
+      vm->ref = 1;
+      vm->pgdir = pgdir;
+      vm->sz = sz;
+      vm->tickets = proc && proc->vm ? proc->vm->tickets : DEFTICKETS;
+      vm->pass = ptable.vtime;
+      vm->gang = proc && proc->vm ? proc->vm->gang : 0;
+      release(&ptable.lock);
+      return vm;
+    }
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// Drop a reference to vm, freeing it with the last one.
+// Caller holds ptable.lock.
+static void
+vmput(struct vmspace *vm)
+{
+  if(vm->ref < 1)
+    panic("vmput");
+  if(--vm->ref == 0){
+    freevm(vm->pgdir);
+    vm->pgdir = 0;
+  }
+}
+
+// Make an empty file table with one user.
+// Returns 0 if there is none free.
+static struct files*
+filesalloc(void)
+{
+  struct files *fs;
+
+  acquire(&ptable.lock);
+  for(fs = filestable; fs < &filestable[NPROC]; fs++){
+    if(fs->ref == 0){
+      fs->ref = 1;
+      release(&ptable.lock);
+      return fs;
+    }
+  }
+  release(&ptable.lock);
+  return 0;
+}
+
+// A copy of the current process's file table, for fork: each
+// open file and the current directory get another reference.
+static struct files*
+filesdup(void)
+{
+  struct files *fs;
+  int fd;
+
+  if((fs = filesalloc()) == 0)
+    return 0;
+  acquire(&proc->files->lock);
+  for(fd = 0; fd < NOFILE; fd++)
+    if(proc->files->ofile[fd])
+      fs->ofile[fd] = filedup(proc->files->ofile[fd]);
+  fs->cwd = idup(proc->files->cwd);
+  release(&proc->files->lock);
+  return fs;
+}
+
+// Drop a reference to fs, closing its files with the last one.
+// Only a thread using fs can add a reference to it, so once ref
+// is 1 nothing else can, and the files are closed before fs is
+// marked free.
+static void
+filesput(struct files *fs)
+{
+  int fd;
+
+  acquire(&ptable.lock);
+  if(fs->ref < 1)
+    panic("filesput");
+  if(fs->ref > 1){
+    fs->ref--;
+    release(&ptable.lock);
+    return;
+  }
+  release(&ptable.lock);
+
+  for(fd = 0; fd < NOFILE; fd++){
+    if(fs->ofile[fd]){
+      fileclose(fs->ofile[fd]);
+      fs->ofile[fd] = 0;
+    }
+  }
+  iput(fs->cwd);
+  fs->cwd = 0;
+
+  acquire(&ptable.lock);
+  fs->ref = 0;
+  release(&ptable.lock);
+}
+
+// Free p, whose user state is gone, and put it back on the free
+// list.  Caller holds ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  if(p->kstack)
+    kfree(p->kstack);
+  p->kstack = 0;
+  p->state = UNUSED;
+  p->pid = 0;
+  p->parent = 0;
+  p->gnext = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  if(p->rtprio)
+    ptable.nrt--;
+  p->rtprio = 0;
+  p->inherit = 0;
+  p->freenext = ptable.free;
+  ptable.free = p;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
+// Take an UNUSED proc off the free list.
+// If there is one, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
 static struct proc*
@@ -37,23 +343,32 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-  release(&ptable.lock);
-  return 0;
-
-found:
+  if((p = ptable.free) == 0){
+    release(&ptable.lock);
+    return 0;
+  }
+  ptable.free = p->freenext;
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->rtprio = proc ? proc->rtprio : 0;
+  if(p->rtprio)
+    ptable.nrt++;
   release(&ptable.lock);
   p->isThread = 0;
   p->parent = proc;
-  initlock(&p->lock, "proc"); // 1) clone: Requirement 12
+  p->vm = 0;
+  p->files = 0;
+  p->tls = 0;
+  p->threads = 0;
+  p->zombies = 0;
+  p->gnext = 0;
+  p->xstatus = 0;
 
   // Allocate kernel stack if possible.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -80,62 +395,127 @@ void
 userinit(void)
 {
   struct proc *p;
+  pde_t *pgdir;
   extern char _binary_initcode_start[], _binary_initcode_size[];
   
   p = allocproc();
-  acquire(&ptable.lock);
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
-  inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  inituvm(pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+  if((p->vm = vmalloc(pgdir, PGSIZE)) == 0)
+    panic("userinit: no vmspace");
+  acquire(&ptable.lock);
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
   p->tf->es = p->tf->ds;
   p->tf->ss = p->tf->ds;
+  p->tf->gs = (SEG_UTLS << 3) | DPL_USER;
   p->tf->eflags = FL_IF;
   p->tf->esp = PGSIZE;
   p->tf->eip = 0;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  if((p->files = filesalloc()) == 0)
+    panic("userinit: no files");
+  p->files->cwd = namei("/");
 
   p->state = RUNNABLE;
   release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Return the old size on success, -1 on failure.
+// The address space's lock keeps threads growing it at
+// once from racing.  1) clone: Requirement 12
 int
 growproc(int n)
 {
-  struct proc *p;
-  if (proc->isThread == 0) acquire(&proc->lock);
-  else {
-    for (p = proc; p->isThread == 1; p = p->parent);
-    proc->parent = p;
-    acquire(&proc->parent->lock);
-  }
-  uint sz;
-  sz = proc->sz;
+  struct vmspace *vm;
+  uint sz, oldsz;
+
+  vm = proc->vm;
+  acquire(&vm->lock);
+  oldsz = sz = vm->sz;
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0) {
-      if (proc->isThread == 0) release(&proc->lock);
-      else release(&proc->parent->lock);
+    if((sz = allocuvm(vm->pgdir, sz, sz + n)) == 0){
+      release(&vm->lock);
       return -1;
     }
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0) {
-      if (proc->isThread == 0) release(&proc->lock);
-      else release(&proc->parent->lock);
+    if((uint)-n >= sz){
+      release(&vm->lock);
       return -1;
     }
+    shrinkvm(vm, sz + n);
+    release(&vm->lock);
+    return oldsz;
   }
-  proc->sz = sz;
+  vm->sz = sz;
+  switchuvm(proc);
+  release(&vm->lock);
+  return oldsz;
+}
+
+// Shrink vm to sz bytes, NSHRINK pages at a time.  Other threads
+// may have the pages in their CPUs' TLBs, so each chunk is freed
+// only after a tlbshootdown, which must run without vm->lock.
+// Stops early if another thread resizes vm meanwhile.  Caller
+// holds vm->lock.
+static void
+shrinkvm(struct vmspace *vm, uint sz)
+{
+  char *pages[NSHRINK];
+  uint lo;
+  int i, n;
+
+  while(vm->sz > sz){
+    lo = vm->sz - NSHRINK*PGSIZE;
+    if(lo < sz || lo > vm->sz)
+      lo = sz;
+    n = unmapuvm(vm->pgdir, lo, vm->sz, pages);
+    vm->sz = lo;
+    release(&vm->lock);
+    tlbshootdown(vm->pgdir);
+    for(i = 0; i < n; i++)
+      kfree(pages[i]);
+    acquire(&vm->lock);
+    if(vm->sz != lo)
+      break;
+  }
+}
+
+// Give the current thread the new user image pgdir, sz bytes
+// long, freeing the old one unless other threads still use it.
+// Returns -1 if there is no address space free.
+int
+setvm(pde_t *pgdir, uint sz)
+{
+  struct vmspace *vm, *old;
+  pde_t *oldpgdir;
+
+  old = proc->vm;
+  acquire(&ptable.lock);
+  if(old->ref == 1){
+    oldpgdir = old->pgdir;
+    old->pgdir = pgdir;
+    old->sz = sz;
+    vforkdone();
+    release(&ptable.lock);
+    switchuvm(proc);
+    freevm(oldpgdir);
+    return 0;
+  }
+  release(&ptable.lock);
+  if((vm = vmalloc(pgdir, sz)) == 0)
+    return -1;
+  acquire(&ptable.lock);
+  proc->vm = vm;
+  vmput(old);
+  vforkdone();
+  release(&ptable.lock);
   switchuvm(proc);
-  if (proc->isThread == 0) release(&proc->lock);
-  else release(&proc->parent->lock);
   return 0;
 }
 
@@ -145,38 +525,163 @@ growproc(int n)
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
 
+  struct vmspace *vm;
+  pde_t *pgdir;
+  uint sz;
+
   // Allocate process.
   if((np = allocproc()) == 0)
     return -1;
+  if((np->files = filesdup()) == 0){
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
 
-  // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  // Copy process state from p, holding off threads that
+  // would change it meanwhile.
+  vm = proc->vm;
+  acquire(&vm->lock);
+  sz = vm->sz;
+  pgdir = copyuvm(vm->pgdir, sz);
+  release(&vm->lock);
+  if(pgdir == 0 || (np->vm = vmalloc(pgdir, sz)) == 0){
+    if(pgdir)
+      freevm(pgdir);
+    filesput(np->files);
+    np->files = 0;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
-  np->sz = proc->sz;
   np->parent = proc;
+  np->tls = proc->tls;
   *np->tf = *proc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
-
-  for(i = 0; i < NOFILE; i++)
-    if(proc->ofile[i])
-      np->ofile[i] = filedup(proc->ofile[i]);
-  np->cwd = idup(proc->cwd);
  
   pid = np->pid;
   np->state = RUNNABLE;
+  resched(np);
+  safestrcpy(np->name, proc->name, sizeof(proc->name));
+  return pid;
+}
+
+// Like fork, but the child borrows the parent's address space
+// instead of copying it, and the parent waits until the child
+// has called exec or exit and so given it back.  Meanwhile the
+// child runs on the parent's stack: it mustn't return from the
+// function that called vfork, or change what the parent will
+// read there.
+int
+vfork(void)
+{
+  int pid;
+  struct proc *np;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  if((np->files = filesdup()) == 0){
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
+  np->parent = proc;
+  np->tls = proc->tls;
+  *np->tf = *proc->tf;
+  np->tf->eax = 0;
   safestrcpy(np->name, proc->name, sizeof(proc->name));
+  pid = np->pid;
+
+  acquire(&ptable.lock);
+  np->vm = proc->vm;
+  np->vm->ref++;
+  np->vforked = 1;
+  np->state = RUNNABLE;
+  resched(np);
+  // Even if killed: the child is on our stack.
+  while(np->vforked)
+    sleep(np, &ptable.lock);
+  release(&ptable.lock);
   return pid;
 }
 
+// Give a vfork parent its memory back.  Caller holds ptable.lock.
+static void
+vforkdone(void)
+{
+  if(proc->vforked){
+    proc->vforked = 0;
+    wakeup1(proc);
+  }
+}
+
+// Mark the threads of main thread t killed, waking those asleep.
+// Caller holds ptable.lock.
+static void
+killthreads(struct proc *t)
+{
+  struct proc *p;
+
+  for(p = t->threads; p; p = p->gnext){
+    p->killed = 1;
+    if(p->state == SLEEPING){
+      p->state = RUNNABLE;
+      resched(p);
+    }
+  }
+}
+
+// Take thread p off the list at *pp, if it is there.  Returns
+// whether it was.  Caller holds ptable.lock.
+static int
+unlinkthread(struct proc **pp, struct proc *p)
+{
+  for(; *pp; pp = &(*pp)->gnext){
+    if(*pp == p){
+      *pp = p->gnext;
+      p->gnext = 0;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Free thread p, which has exited and been taken off its main
+// thread's zombie list.  Caller holds ptable.lock.
+static void
+freethread(struct proc *p)
+{
+  vmput(p->vm);
+  p->vm = 0;
+  freeproc(p);
+}
+
+// Wait for the current main thread's killed threads to exit
+// and free them.  Caller holds ptable.lock.
+static void
+reapthreads(void)
+{
+  struct proc *p;
+
+  for(;;){
+    while((p = proc->zombies) != 0){
+      proc->zombies = p->gnext;
+      freethread(p);
+    }
+    if(proc->threads == 0)
+      break;
+    sleep(proc, &ptable.lock);  // See wakeup1 call in exit.
+  }
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -184,31 +689,41 @@ void
 exit(void)
 {
   struct proc *p;
-  int fd;
 
   if(proc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd]){
-      fileclose(proc->ofile[fd]);
-      proc->ofile[fd] = 0;
-    }
+  // The main thread takes its threads down first.
+  // 1) clone: Requirement 11
+  if(proc->threads || proc->zombies){
+    acquire(&ptable.lock);
+    killthreads(proc);
+    reapthreads();
+    release(&ptable.lock);
   }
 
-  iput(proc->cwd);
-  proc->cwd = 0;
+  // Close all open files, unless other threads still use them.
+  filesput(proc->files);
+  proc->files = 0;
 
   acquire(&ptable.lock);
 
-  // Parent might be sleeping in wait().
+  // A thread moves to its main thread's zombie list, where
+  // join_any finds it at the head.
+  if(proc->isThread){
+    unlinkthread(&proc->parent->threads, proc);
+    proc->gnext = proc->parent->zombies;
+    proc->parent->zombies = proc;
+  }
+
+  // Parent might be sleeping in wait(), join or vfork().
   wakeup1(proc->parent);
+  vforkdone();
 
-  // Pass abandoned children to init.
-  // 1) clone: Requirement 11
+  // Pass abandoned children to init.  The threads are gone,
+  // save for one that is exiting itself; its parent stays.
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(proc->isThread == 0 && p->parent == proc){
+    if(p->isThread == 0 && p->parent == proc){
       p->parent = initproc;
       if(p->state == ZOMBIE)
         wakeup1(initproc);
@@ -249,14 +764,9 @@ wait(void)
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
+        vmput(p->vm);
+        p->vm = 0;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -273,6 +783,92 @@ wait(void)
   }
 }
 
+// The RUNNABLE thread to run next, or 0.  Real-time threads
+// come first, the highest priority first.  Otherwise it is one
+// whose process has the lowest pass.  The scan starts after the
+// last one picked, so threads of one process, and processes or
+// real-time threads level with each other, take turns.  A
+// process that has been asleep is brought up to ptable.vtime,
+// so it can't save up its share.  Caller holds ptable.lock.
+static struct proc*
+pickproc(void)
+{
+  struct proc *p, *best;
+  int i;
+
+  if(ptable.nrt > 0){
+    best = 0;
+    for(i = 0; i < NPROC; i++){
+      p = &ptable.proc[(ptable.next + i) % NPROC];
+      if(p->state == RUNNABLE && prio(p) > 0 &&
+         (best == 0 || prio(p) > prio(best)))
+        best = p;
+    }
+    if(best){
+      ptable.next = best - ptable.proc + 1;
+      return best;
+    }
+  }
+
+  if(ptable.gang && (int)(ticks - ptable.gangend) < 0){
+    for(i = 0; i < NPROC; i++){
+      p = &ptable.proc[(ptable.next + i) % NPROC];
+      if(p->state == RUNNABLE && p->vm == ptable.gang){
+        ptable.next = p - ptable.proc + 1;
+        return p;
+      }
+    }
+  }
+  ptable.gang = 0;
+
+  best = 0;
+  for(i = 0; i < NPROC; i++){
+    p = &ptable.proc[(ptable.next + i) % NPROC];
+    if(p->state != RUNNABLE)
+      continue;
+    if(p->vm->pass < ptable.vtime)
+      p->vm->pass = ptable.vtime;
+    if(best == 0 || p->vm->pass < best->vm->pass)
+      best = p;
+  }
+  if(best)
+    ptable.next = best - ptable.proc + 1;
+  return best;
+}
+
+// Gang scheduling: vm's threads are to run together, as this CPU
+// starts one of them.  Until the next tick but one, pickproc
+// hands out vm's RUNNABLE threads before anything else, and
+// other CPUs are sent IRQ_PREEMPT, which makes them yield, or woken
+// if idle, one for each such thread.  So threads that spin on
+// each other's locks aren't left waiting for a holder that
+// isn't running.  Caller holds ptable.lock.
+static void
+gangstart(struct vmspace *vm)
+{
+  struct proc *p;
+  struct cpu *c;
+  int n;
+
+  ptable.gang = vm;
+  ptable.gangend = ticks + 2;
+  n = 0;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state == RUNNABLE && p->vm == vm)
+      n++;
+  for(c = cpus; c < cpus + ncpu && n > 0; c++){
+    if(c == cpu)
+      continue;
+    if(c->idle && xchg(&c->idle, 0)){
+      ipisend(c - cpus, IRQ_RESCHED);
+      n--;
+    } else if(c->proc && c->proc->vm != vm){
+      ipisend(c - cpus, IRQ_PREEMPT);
+      n--;
+    }
+  }
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -280,20 +876,32 @@ wait(void)
 //  - swtch to start running that process
 //  - eventually that process transfers control
 //      via swtch back to the scheduler.
+//
+// Scheduling is by stride: each process (all its threads
+// together) has tickets and a pass, and the thread to run is
+// one of the process with the lowest pass, which then advances
+// by STRIDE1/tickets.  So processes get CPU time in proportion
+// to their tickets, however many threads each has.  Real-time
+// threads run ahead of all that, and aren't charged.
 void
 scheduler(void)
 {
   struct proc *p;
+  int n;
 
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
+    // Run up to NPROC turns, then let interrupts in.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
+    for(n = 0; n < NPROC && (p = pickproc()) != 0; n++){
+      if(prio(p) == 0){
+        ptable.vtime = p->vm->pass;
+        p->vm->pass += STRIDE1 / p->vm->tickets;
+      }
+      if(p->vm->gang && ptable.gang != p->vm)
+        gangstart(p->vm);
 
       // Switch to chosen process.  It is the process's job
       // to release ptable.lock and then reacquire it
@@ -301,18 +909,72 @@ scheduler(void)
       proc = p;
       switchuvm(p);
       p->state = RUNNING;
+      cpu->nswitch++;
       swtch(&cpu->scheduler, proc->context);
-      switchkvm();
 
       // Process is done running for now.
       // It should have changed its p->state before coming back.
+      // Its page table stays loaded, so the next process goes
+      // straight to its own, or keeps it if they share it.
       proc = 0;
     }
+    // Once ptable.lock is released, wait() may free that page
+    // table; go back to the kernel's.
+    switchkvm();
     release(&ptable.lock);
-
+    if(n == 0)
+      idle();
   }
 }
 
+// Run the current process's threads together (see gangstart) if
+// on is set, else apart.  Returns whether they were together.
+int
+setgang(int on)
+{
+  int was;
+
+  acquire(&ptable.lock);
+  was = proc->vm->gang;
+  proc->vm->gang = on != 0;
+  release(&ptable.lock);
+  return was;
+}
+
+// Give the current thread real-time priority pr, from 1 to
+// MAXRTPRIO, or make it normal again if pr is 0.  Threads it
+// creates inherit it.  Returns the old priority, or -1 if pr is
+// out of range.
+int
+setrtprio(int pr)
+{
+  int was;
+
+  if(pr < 0 || pr > MAXRTPRIO)
+    return -1;
+  acquire(&ptable.lock);
+  was = proc->rtprio;
+  ptable.nrt += (pr != 0) - (was != 0);
+  proc->rtprio = pr;
+  release(&ptable.lock);
+  if(pr < was)
+    yield();
+  return was;
+}
+
+// Give the current process n tickets, for all its threads.
+// Returns -1 if n is out of range.
+int
+settickets(int n)
+{
+  if(n < 1 || n > MAXTICKETS)
+    return -1;
+  acquire(&ptable.lock);
+  proc->vm->tickets = n;
+  release(&ptable.lock);
+  return 0;
+}
+
 // Enter scheduler.  Must hold only ptable.lock
 // and have changed proc->state.
 void
@@ -343,6 +1005,56 @@ yield(void)
   release(&ptable.lock);
 }
 
+// Run p, a RUNNABLE thread of the current process, on this CPU
+// now, in place of the current thread, which stays RUNNABLE for
+// scheduler() or another switchto to resume.  One swtch, without
+// going through scheduler() and its scan.  p's process has been
+// charged for this turn already.  Caller holds only ptable.lock,
+// as for sched.
+static void
+switchto(struct proc *p)
+{
+  struct proc *me;
+  int intena;
+
+  if(cpu->ncli != 1)
+    panic("switchto locks");
+  if(p->state != RUNNABLE || p->vm != proc->vm)
+    panic("switchto");
+  me = proc;
+  me->state = RUNNABLE;
+  resched(me);
+  p->state = RUNNING;
+  proc = p;
+  switchuvm(p);
+  cpu->nswitch++;
+  intena = cpu->intena;
+  swtch(&me->context, p->context);
+  cpu->intena = intena;
+}
+
+// Give the rest of this turn to thread pid of the current
+// process.  Returns 0 once the caller runs again, or -1 if pid
+// isn't another thread of it that is RUNNABLE, as when it is
+// running on another CPU already.
+int
+yield_to(int pid)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->pid == pid && p->state == RUNNABLE && p->vm == proc->vm)
+      break;
+  if(p == &ptable.proc[NPROC] || p == proc){
+    release(&ptable.lock);
+    return -1;
+  }
+  switchto(p);
+  release(&ptable.lock);
+  return 0;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -383,6 +1095,7 @@ sleep(void *chan, struct spinlock *lk)
 
   // Tidy up.
   proc->chan = 0;
+  proc->piowner = 0;
 
   // Reacquire original lock.
   if(lk != &ptable.lock){  //DOC: sleeplock2
@@ -399,8 +1112,10 @@ wakeup1(void *chan)
   struct proc *p;
 
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
+    if(p->state == SLEEPING && p->chan == chan){
       p->state = RUNNABLE;
+      resched(p);
+    }
 }
 
 // Wake up all processes sleeping on chan.
@@ -425,8 +1140,12 @@ kill(int pid)
     if(p->pid == pid){
       p->killed = 1;
       // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
+      if(p->state == SLEEPING){
         p->state = RUNNABLE;
+        resched(p);
+      }
+      // Its threads needn't wait for it to exit to stop.
+      killthreads(p);
       release(&ptable.lock);
       return 0;
     }
@@ -510,54 +1229,99 @@ Here is a list of specific requirements related to the clone syscall:
     Hint: walk through the code path for the sbrk syscall.  You will need to use a lock in there somewhere.
 **/
 
+// Add a stack page to the current address space for a new thread,
+// above a guard page that faults if the stack overflows into it.
+// Returns the stack page, or 0 if out of memory.
+static void*
+allocustack(void)
+{
+  struct vmspace *vm;
+  uint base, sz;
+
+  vm = proc->vm;
+  acquire(&vm->lock);
+  base = PGROUNDUP(vm->sz);
+  if((sz = allocuvm(vm->pgdir, vm->sz, base + 2*PGSIZE)) == 0){
+    release(&vm->lock);
+    return 0;
+  }
+  clearpteu(vm->pgdir, (char*)base);
+  vm->sz = sz;
+  release(&vm->lock);
+  return (void*)(base + PGSIZE);
+}
+
+// A null stack asks clone to allocate one, with a guard page.
 int
 clone(void(*fcn)(void*), void* arg, void* stack) // Prequirement 01
 {
   if ((uint) stack % PGSIZE != 0) return -1; // Prequirement 10
+  if (stack != 0 && (uint)stack + PGSIZE > proc->vm->sz) return -1;
 
-  int i, tid;
-  struct proc *thread, *p;
+  int tid;
+  uint ustack[2];
+  struct proc *thread;
   
   if ((thread = allocproc()) == 0) return -1; // Prequirement 08
+  if (stack == 0 && (stack = allocustack()) == 0)
+    goto bad;
 
   *(thread->tf) = *(proc->tf);
   thread->isThread = 1; // Prequirement 11
-  thread->pgdir = proc->pgdir; // Prequirement 02
-  thread->sz = proc->sz;
   thread->ustack = (char*)stack;
 
   // BEGIN: Prequirement 09
-  for (p = proc; p->isThread == 1; p = p->parent) ;
-  thread->parent = p;
+  thread->parent = proc->isThread ? proc->parent : proc;
   // thread->parentlock = &(p->lock); // 1) clone: Requirement 12
   // while (thread->parent->isThread == 1) thread->parent = thread->parent->parent;
   // cprintf("thread->parent = %d\tproc = %d\n", thread->parent, proc);
   // cprintf("thread->parent->isThread = %d\tproc->isThread = %d\n", thread->parent->isThread, proc->isThread);
   // END: Prequirement 09
   
-  // BEGIN: Prequirement 05
-  *((uint*)(stack + PGSIZE - 8)) = 0xffffffff; // Prequirement 07
-  *((void**)(stack + PGSIZE - 4)) = arg;
-  thread->tf->esp = (uint)stack;
-  if (copyout(proc->pgdir, thread->tf->esp, (void*)stack, (uint)PGSIZE) < 0) return -1;
+  // BEGIN: Prequirement 05.  Only the words the thread starts
+  // with are written.
+  ustack[0] = 0xffffffff; // Prequirement 07
+  ustack[1] = (uint)arg;
+  // Thread-local storage is the bottom TLSSIZE bytes of the stack
+  // page; its first word holds its own address.
+  thread->tls = (uint)stack;
+  if (copyout(proc->vm->pgdir, (uint)stack + PGSIZE - 8, ustack, sizeof(ustack)) < 0 ||
+      copyout(proc->vm->pgdir, (uint)stack, &thread->tls, sizeof(thread->tls)) < 0)
+    goto bad;
   thread->tf->esp = (uint)(stack + PGSIZE - 8);
   // END: Prequirement 05
+
+  // Prequirement 02.  Join the main thread's list, unless
+  // the group is being killed (Prequirement 11).
+  acquire(&ptable.lock);
+  if (proc->killed) {
+    freeproc(thread);
+    release(&ptable.lock);
+    return -1;
+  }
+  thread->vm = proc->vm;
+  thread->vm->ref++;
+  thread->files = proc->files;  // Prequirement 03
+  thread->files->ref++;
+  thread->gnext = thread->parent->threads;
+  thread->parent->threads = thread;
+  release(&ptable.lock);
   thread->tf->eip = (uint)fcn; // Prequirement 04
   // thread->tf->ebp = arg;
 
   thread->tf->eax = 0;
-
-  // BEGIN: Prequirement 03
-  for (i = 0; i < NOFILE; i++)
-    if (proc->ofile[i])
-      thread->ofile[i] = filedup(proc->ofile[i]);
-  thread->cwd = idup(proc->cwd);
-  // END: Prequirement 03
   
   tid = thread->pid;
   thread->state = RUNNABLE;
+  resched(thread);
   safestrcpy(thread->name, proc->name, sizeof(proc->name));
   return tid;
+
+bad:
+  acquire(&ptable.lock);
+  freeproc(thread);
+  release(&ptable.lock);
+  return -1;
 }
 
 // 2) join
@@ -584,128 +1348,282 @@ join(int pid) // Prequirement 01
 {
   if (proc->pid == pid) return -1; // Prequirement 03
 
-  struct proc *p;
-  int havekids;
+  struct proc *p, *main;
 
+  // Only threads on the caller's own main thread's list can be
+  // joined; that rules out processes (Prequirement 04) and other
+  // groups' threads (Prequirement 05).
+  main = proc->isThread ? proc->parent : proc;
   acquire(&ptable.lock);
   for (;;) {
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
-      if (p->pid == pid) {
-        // BEGIN: Prequirement 04
-        if (p->isThread == 0) {
-          // cprintf("p->isThread == 0\n");
-          release(&ptable.lock);
-          return -1;
-        }
-        // END: Prequirement 04
-
-        // BEGIN: Prequirement 05
-        if (p->pgdir != proc->pgdir) {
-          // cprintf("p->pgdir != proc->pgdir\n");
-          release(&ptable.lock);
-          return -1;          
-        }
-        // END: Prequirement 05
-
-        // BEGIN: Prequirement 05
-        if (proc->isThread == 1 && p->parent != proc->parent) {
-          // cprintf("p->parent != proc->parent\n");
-          // cprintf("p->parent = %d\tproc->parent = %d\n", p->parent, proc->parent);
-          // cprintf("p->parent->isThread = %d\tproc->parent->isThread = %d\n", p->parent->isThread, proc->parent->isThread);
-          release(&ptable.lock);
-          return -1;           
-        }
-        // END: Prequirement 05
-
-        havekids = 1;
-
-        if (p->state == ZOMBIE) { // Prequirement 03
-          kfree(p->kstack);
-          p->kstack = 0;
-          p->state = UNUSED;
-          p->pid = 0;
-          p->parent = 0;
-          p->name[0] = 0;
-          p->killed = 0;
-          release(&ptable.lock);
-          return pid;
-        }      
-      }
+    for (p = main->zombies; p && p->pid != pid; p = p->gnext)
+      ;
+    if (p) { // Prequirement 03
+      unlinkthread(&main->zombies, p);
+      freethread(p); // Prequirement 06
+      release(&ptable.lock);
+      return pid;
     }
-    if (!havekids || proc->killed) {
-      // cprintf("!havekids || proc->killed\n");
+    for (p = main->threads; p && p->pid != pid; p = p->gnext)
+      ;
+    if (p == 0 || proc->killed) {
       release(&ptable.lock);
-      return -1;         
+      return -1;
     }
-    sleep(proc, &ptable.lock);
+    // Threads wake their main thread when they exit.
+    sleep(main, &ptable.lock);
   }
 }
 
-// BEGIN: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
+// Wait for any thread of the caller's group but itself to exit,
+// free it as join does, and return its pid, with the status it
+// passed to thread_exit in *status.  Exited threads wait at the
+// head of their main thread's zombie list, so the first one is
+// taken without a search.  Returns -1 if there is no other
+// thread, or if killed.
+int
+join_any(int *status)
+{
+  struct proc *p, *main;
+  int pid;
+
+  main = proc->isThread ? proc->parent : proc;
+  acquire(&ptable.lock);
+  for (;;) {
+    if ((p = main->zombies) != 0) {
+      main->zombies = p->gnext;
+      pid = p->pid;
+      *status = p->xstatus;
+      freethread(p);
+      release(&ptable.lock);
+      return pid;
+    }
+    for (p = main->threads; p && p == proc; p = p->gnext)
+      ;
+    if (p == 0 || proc->killed) {
+      release(&ptable.lock);
+      return -1;
+    }
+    sleep(main, &ptable.lock);
+  }
+}
+
+// End the calling thread with status, for join_any to report.
+// A main thread exits as exit does, and status is lost.
 void
-cv_wait(cond_t* conditionVariable, lock_t* lock)
+thread_exit(int status)
 {
-  if(proc == 0) panic("sleep");
+  proc->xstatus = status;
+  exit();
+}
 
-  if(lock == 0) panic("sleep without lock");
+// Put thread p at the tail of the futex queue for addr.
+// Caller holds ptable.lock.
+static void
+fxqueue(struct proc *p, uint *addr)
+{
+  struct proc **pp;
 
-  if(lock != (lock_t*)&ptable.lock){
-    acquire(&ptable.lock);
-    release_lock_t(lock);
-  }
+  for(pp = FUTEXQ(p->vm, addr); *pp; pp = &(*pp)->fxnext)
+    ;
+  p->fxaddr = addr;
+  p->fxnext = 0;
+  *pp = p;
+}
 
-  proc->chan = (void *)conditionVariable;
-  proc->state = SLEEPING;
-  sched();
+// Sleep until fxwake takes the current thread off its futex
+// queue, or it is killed.  Caller holds ptable.lock.
+static void
+fxsleep(void)
+{
+  struct proc **pp;
+
+  while(proc->fxaddr && !proc->killed)
+    sleep(&proc->fxaddr, &ptable.lock);
+  if(proc->fxaddr){
+    for(pp = FUTEXQ(proc->vm, proc->fxaddr); *pp != proc; pp = &(*pp)->fxnext)
+      ;
+    *pp = proc->fxnext;
+    proc->fxaddr = 0;
+  }
+}
 
-  proc->chan = 0;
+// Wake up to n threads of the current process queued on addr,
+// oldest first.  Returns how many, and sets *first, unless first
+// is 0, to the first one it made RUNNABLE, or 0 if none.
+// Caller holds ptable.lock.
+static int
+fxwake(uint *addr, int n, struct proc **first)
+{
+  struct proc *p, **pp;
+  int woken;
+
+  woken = 0;
+  if(first)
+    *first = 0;
+  pp = FUTEXQ(proc->vm, addr);
+  while((p = *pp) != 0 && woken < n){
+    if(p->fxaddr != addr || p->vm != proc->vm){
+      pp = &p->fxnext;
+      continue;
+    }
+    *pp = p->fxnext;
+    p->fxaddr = 0;
+    if(p->state == SLEEPING){
+      p->state = RUNNABLE;
+      if(first && *first == 0)
+        *first = p;
+      resched(p);
+    }
+    woken++;
+  }
+  return woken;
+}
 
-  if(lock != (lock_t*)&ptable.lock){
+// Sleep on the futex word addr if it still holds val.  Returns 0
+// when woken by futex_wake, -1 if *addr != val or killed.
+int
+futex_wait(uint *addr, uint val)
+{
+  acquire(&ptable.lock);
+  if(*addr != val){
     release(&ptable.lock);
-    acquire_lock_t(lock);
+    return -1;
   }
+  fxqueue(proc, addr);
+  fxsleep();
+  release(&ptable.lock);
+  return proc->killed ? -1 : 0;
 }
-// END: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
 
-// BEGIN: Wake the threads that are waiting on conditionVariable.
-void
-cv_signal(cond_t* conditionVariable)
+// futex_wait for a lock held by the thread whose thread-local
+// storage is at owner (see mutex_lock).  If that thread is
+// RUNNABLE, run it now instead (see switchto) and return 0, as it
+// can't let go of the lock before it runs.  Otherwise sleep, and
+// lend it the caller's priority meanwhile.
+int
+futex_wait_pi(uint *addr, uint val, uint owner)
 {
-  struct proc *p;
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if (p->state == SLEEPING && p->chan == (void*)conditionVariable)
-      p->state = RUNNABLE;
+  struct proc *h;
+
+  acquire(&ptable.lock);
+  if(*addr != val){
+    release(&ptable.lock);
+    return -1;
+  }
+  for(h = ptable.proc; h < &ptable.proc[NPROC]; h++)
+    if(h->tls == owner && h->vm == proc->vm && h != proc &&
+       (h->state == RUNNABLE || h->state == RUNNING || h->state == SLEEPING))
+      break;
+  if(h == &ptable.proc[NPROC])
+    h = 0;
+  if(h && h->state == RUNNABLE){
+    switchto(h);
+    release(&ptable.lock);
+    return 0;
+  }
+  fxqueue(proc, addr);
+  pilend1(h);
+  fxsleep();
+  release(&ptable.lock);
+  return proc->killed ? -1 : 0;
 }
-// END: Wake the threads that are waiting on conditionVariable.
 
+// Wake up to n threads sleeping on the futex word addr.
+// Returns how many were woken.  A thread cv_signal moved here
+// runs next, on this CPU (see cv_signal).
 int
-find_ustack(int pid)
+futex_wake(uint *addr, int n)
 {
   struct proc *p;
-  int havekids;
+  int woken;
 
   acquire(&ptable.lock);
-  for(;;){
-    // Scan through table looking for zombie children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->isThread == 0 || p->pid != pid) // 3) side effects: Requirement 01
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        release(&ptable.lock);
-        return (int)p->ustack;
-      }
-    }
-
-    // No point waiting if we don't have any children.
-    if(!havekids || proc->killed){
-      release(&ptable.lock);
-      return -1;
-    }
+  woken = fxwake(addr, n, &p);
+  pireturn1(addr, p);
+  if(p && p->cvmoved && prio(p) >= prio(proc))
+    switchto(p);
+  release(&ptable.lock);
+  return woken;
+}
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(proc, &ptable.lock);  //DOC: wait-sleep
+// The user mutex protocol of uthreadlib.c: 0 free, 1 held,
+// 2 held and maybe contended.  A thread that was queued on lock
+// before must take it as 2, as there may be others still queued.
+// Caller holds ptable.lock.
+static void
+ulock(lock_t *lock, int queued)
+{
+  if(!queued && xchg(lock, 1) == 0)
+    return;
+  while(xchg(lock, 2) != 0 && !proc->killed){
+    fxqueue(proc, lock);
+    fxsleep();
   }
-}
\ No newline at end of file
+}
+
+static void
+uunlock(lock_t *lock)
+{
+  if(xchg(lock, 0) == 2)
+    fxwake(lock, 1, 0);
+}
+
+// BEGIN: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
+void
+cv_wait(cond_t* conditionVariable, lock_t* lock)
+{
+  if(proc == 0) panic("cv_wait");
+
+  // Queue before unlocking, so a cv_signal right after
+  // the unlock still finds us.
+  acquire(&ptable.lock);
+  proc->cvlock = lock;
+  fxqueue(proc, conditionVariable);
+  uunlock(lock);
+  fxsleep();
+  ulock(lock, proc->cvmoved);
+  proc->cvmoved = 0;
+  release(&ptable.lock);
+}
+// END: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
+
+// BEGIN: Wake the thread that has waited longest on conditionVariable.
+// It is the thread to run next, unless it is less urgent: if the
+// lock it takes back is free it runs now, on this CPU (see
+// switchto).  If the lock is
+// held, waking it would only have it sleep again on the lock, so
+// it moves to the lock's futex queue, marked contended, and the
+// futex_wake of the unlock hands over to it.
+void
+cv_signal(cond_t* conditionVariable)
+{
+  struct proc *p, **pp;
+  uint *lock;
+
+  acquire(&ptable.lock);
+  for(pp = FUTEXQ(proc->vm, conditionVariable); (p = *pp) != 0; pp = &p->fxnext)
+    if(p->fxaddr == conditionVariable && p->vm == proc->vm)
+      break;
+  if(p && p->state == SLEEPING && (lock = p->cvlock) != 0 &&
+     (uint)lock + sizeof(*lock) <= proc->vm->sz &&
+     (*lock == 2 || cmpxchg(lock, 1, 2) == 1)){
+    *pp = p->fxnext;
+    fxqueue(p, lock);
+    p->cvmoved = 1;
+  } else if(fxwake(conditionVariable, 1, &p) && p && !proc->killed &&
+            prio(p) >= prio(proc))
+    switchto(p);
+  release(&ptable.lock);
+}
+// END: Wake the thread that has waited longest on conditionVariable.
+
+// BEGIN: Wake all the threads that are waiting on conditionVariable.
+void
+cv_broadcast(cond_t* conditionVariable)
+{
+  acquire(&ptable.lock);
+  fxwake(conditionVariable, NPROC, 0);
+  release(&ptable.lock);
+}
+// END: Wake all the threads that are waiting on conditionVariable.
@@ -8,7 +8,8 @@
 #define SEG_UCODE 4  // user code
 #define SEG_UDATA 5  // user data+stack
 #define SEG_TSS   6  // this process's task state
-#define NSEGS     7
+#define SEG_UTLS  7  // this thread's local storage, user %gs
+#define NSEGS     8
 
 // Per-CPU state
 struct cpu {
@@ -19,6 +20,13 @@ struct cpu {
   volatile uint booted;        // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  volatile uint idle;          // Halted in scheduler(); see resched
+  pde_t *pgdir;                // User page table loaded, or 0
+  volatile uchar tlbreq[NCPU]; // CPUs asking it to flush its TLB
+  volatile uchar tlbdone[NCPU];// ... and told it has
+  uint busyticks;              // Timer ticks taken running a thread
+  uint idleticks;              // ... and in the scheduler
+  uint nswitch;                // Threads switched to
 
   // Cpu-local storage variables; see below
   struct cpu *cpu;
@@ -59,24 +67,55 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// User address space, shared by all the threads of a process.
+struct vmspace {
+  struct spinlock lock;        // Held while sz and the mappings change
+  pde_t* pgdir;                // Page table
+  uint sz;                     // Size of process memory (bytes)
+  int ref;                     // Threads using it; guarded by ptable.lock
+  int tickets;                 // Share of the CPU; see scheduler
+  uint64 pass;                 // Stride scheduler's virtual time for it
+  int gang;                    // Run its threads together; see gangstart
+};
+
+// Open files and current directory, shared by all the threads
+// of a process.
+struct files {
+  struct spinlock lock;        // Held while ofile and cwd change
+  struct file *ofile[NOFILE];  // Open files
+  struct inode *cwd;           // Current directory
+  int ref;                     // Threads using it; guarded by ptable.lock
+};
+
 // Per-process state
 struct proc {
-  uint sz;                     // Size of process memory (bytes)
-  pde_t* pgdir;                // Page table
+  struct vmspace *vm;          // Address space
   char *kstack;                // Bottom of kernel stack for this process
   char *ustack;                // Bottom of user stack for this process
+  uint tls;                    // Base of user %gs: its stack page
   enum procstate state;        // Process state
   volatile int pid;            // Process ID
   struct proc *parent;         // Parent process
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
+  uint *fxaddr;                // If non-zero, queued on this futex word
+  struct proc *fxnext;         // Next on its futex queue
+  uint *cvlock;                // In cv_wait: the lock it takes back
+  int cvmoved;                 // cv_signal moved it to cvlock's queue
+  int rtprio;                  // Real-time priority, or 0; see pickproc
+  int inherit;                 // Priority lent by waiters on its locks
+  struct proc *piowner;        // Asleep on a lock: the holder it lent to
   int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
+  struct files *files;         // Open files and current directory
   char name[16];               // Process name (debugging)
   int isThread;                // Process = 0 and Thread = 1
-  struct spinlock lock;        // mutex
+  struct proc *threads;        // Main thread: its running threads
+  struct proc *zombies;        // Main thread: its exited threads, until joined
+  struct proc *gnext;          // Thread: next in its main thread's list
+  int xstatus;                 // Thread: what it passed to thread_exit
+  int vforked;                 // Borrowing its parent's memory; see vfork
+  struct proc *freenext;       // Next on ptable.free, if UNUSED
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -38,12 +38,6 @@ acquire(struct spinlock *lk)
   getcallerpcs(&lk, lk->pcs);
 }
 
-void
-acquire_lock_t(lock_t* lock)
-{
-  while(xchg(lock, 1) != 0) ;
-}
-
 // Release the lock.
 void
 release(struct spinlock *lk)
@@ -68,13 +62,6 @@ release(struct spinlock *lk)
   popcli();
 }
 
-void
-release_lock_t(lock_t* lock)
-{
-  xchg(lock, 0);
-  // popcli();
-}
-
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -18,7 +18,7 @@
 int
 fetchint(struct proc *p, uint addr, int *ip)
 {
-  if(addr >= p->sz || addr+4 > p->sz)
+  if(addr >= p->vm->sz || addr+4 > p->vm->sz)
     return -1;
   *ip = *(int*)(addr);
   return 0;
@@ -32,10 +32,10 @@ fetchstr(struct proc *p, uint addr, char **pp)
 {
   char *s, *ep;
 
-  if(addr >= p->sz)
+  if(addr >= p->vm->sz)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)p->sz;
+  ep = (char*)p->vm->sz;
   for(s = *pp; s < ep; s++)
     if(*s == 0)
       return s - *pp;
@@ -59,7 +59,7 @@ argptr(int n, char **pp, int size)
   
   if(argint(n, &i) < 0)
     return -1;
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  if((uint)i >= proc->vm->sz || (uint)i+size > proc->vm->sz)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -89,6 +89,7 @@ static int (*syscalls[])(void) = {
 [SYS_exec]    sys_exec,
 [SYS_exit]    sys_exit,
 [SYS_fork]    sys_fork,
+[SYS_vfork]   sys_vfork,
 [SYS_fstat]   sys_fstat,
 [SYS_getpid]  sys_getpid,
 [SYS_kill]    sys_kill,
@@ -108,7 +109,17 @@ static int (*syscalls[])(void) = {
 [SYS_join]    sys_join,
 [SYS_cv_wait] sys_cv_wait,
 [SYS_cv_signal] sys_cv_signal,
-[SYS_find_ustack] sys_find_ustack,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_cv_broadcast] sys_cv_broadcast,
+[SYS_settickets] sys_settickets,
+[SYS_setgang] sys_setgang,
+[SYS_yield_to] sys_yield_to,
+[SYS_setrtprio] sys_setrtprio,
+[SYS_futex_wait_pi] sys_futex_wait_pi,
+[SYS_join_any] sys_join_any,
+[SYS_thread_exit] sys_thread_exit,
+[SYS_sysinfo] sys_sysinfo,
 };
 
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
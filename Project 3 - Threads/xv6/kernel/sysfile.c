@@ -11,21 +11,28 @@
 #include "sysfunc.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
-// and return both the descriptor and the corresponding struct file.
+// and return both the descriptor and the corresponding struct file,
+// with a reference the caller must drop with fileclose: another
+// thread may close fd meanwhile.
 static int
 argfd(int n, int *pfd, struct file **pf)
 {
   int fd;
   struct file *f;
+  struct files *fs;
 
-  if(argint(n, &fd) < 0)
+  if(argint(n, &fd) < 0 || fd < 0 || fd >= NOFILE)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0)
+  fs = proc->files;
+  acquire(&fs->lock);
+  if((f = fs->ofile[fd]) != 0)
+    filedup(f);
+  release(&fs->lock);
+  if(f == 0)
     return -1;
   if(pfd)
     *pfd = fd;
-  if(pf)
-    *pf = f;
+  *pf = f;
   return 0;
 }
 
@@ -34,14 +41,19 @@ argfd(int n, int *pfd, struct file **pf)
 static int
 fdalloc(struct file *f)
 {
+  struct files *fs;
   int fd;
 
+  fs = proc->files;
+  acquire(&fs->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd] == 0){
-      proc->ofile[fd] = f;
+    if(fs->ofile[fd] == 0){
+      fs->ofile[fd] = f;
+      release(&fs->lock);
       return fd;
     }
   }
+  release(&fs->lock);
   return -1;
 }
 
@@ -53,9 +65,10 @@ sys_dup(void)
   
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(f)) < 0){
+    fileclose(f);
     return -1;
-  filedup(f);
+  }
   return fd;
 }
 
@@ -63,24 +76,28 @@ int
 sys_read(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return fileread(f, p, n);
+  r = fileread(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 int
 sys_write(void)
 {
   struct file *f;
-  int n;
+  int n, r;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argint(2, &n) < 0 || argptr(1, &p, n) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filewrite(f, p, n);
+  r = filewrite(f, p, n);
+  fileclose(f);
+  return r;
 }
 
 int
@@ -88,10 +105,19 @@ sys_close(void)
 {
   int fd;
   struct file *f;
+  struct files *fs;
   
-  if(argfd(0, &fd, &f) < 0)
+  if(argint(0, &fd) < 0 || fd < 0 || fd >= NOFILE)
+    return -1;
+  // Another thread may be closing fd too; only one gets f.
+  fs = proc->files;
+  acquire(&fs->lock);
+  if((f = fs->ofile[fd]) == 0){
+    release(&fs->lock);
     return -1;
-  proc->ofile[fd] = 0;
+  }
+  fs->ofile[fd] = 0;
+  release(&fs->lock);
   fileclose(f);
   return 0;
 }
@@ -101,10 +127,13 @@ sys_fstat(void)
 {
   struct file *f;
   struct stat *st;
+  int r;
   
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argptr(1, (void*)&st, sizeof(*st)) < 0 || argfd(0, 0, &f) < 0)
     return -1;
-  return filestat(f, st);
+  r = filestat(f, st);
+  fileclose(f);
+  return r;
 }
 
 // Create the path new as a link to the same inode as old.
@@ -327,7 +356,7 @@ int
 sys_chdir(void)
 {
   char *path;
-  struct inode *ip;
+  struct inode *ip, *old;
 
   if(argstr(0, &path) < 0 || (ip = namei(path)) == 0)
     return -1;
@@ -337,8 +366,11 @@ sys_chdir(void)
     return -1;
   }
   iunlock(ip);
-  iput(proc->cwd);
-  proc->cwd = ip;
+  acquire(&proc->files->lock);
+  old = proc->files->cwd;
+  proc->files->cwd = ip;
+  release(&proc->files->lock);
+  iput(old);
   return 0;
 }
 
@@ -382,7 +414,7 @@ sys_pipe(void)
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
     if(fd0 >= 0)
-      proc->ofile[fd0] = 0;
+      proc->files->ofile[fd0] = 0;
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -27,6 +27,17 @@ int sys_clone(void);
 int sys_join(void);
 int sys_cv_wait(void);
 int sys_cv_signal(void);
-int sys_find_ustack(void);
+int sys_futex_wait(void);
+int sys_futex_wake(void);
+int sys_cv_broadcast(void);
+int sys_vfork(void);
+int sys_settickets(void);
+int sys_setgang(void);
+int sys_yield_to(void);
+int sys_setrtprio(void);
+int sys_futex_wait_pi(void);
+int sys_join_any(void);
+int sys_thread_exit(void);
+int sys_sysinfo(void);
 
 #endif // _SYSFUNC_H_
\ No newline at end of file
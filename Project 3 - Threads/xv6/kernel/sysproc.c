@@ -6,6 +6,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "sysfunc.h"
+#include "sysinfo.h"
 
 int
 sys_fork(void)
@@ -13,6 +14,12 @@ sys_fork(void)
   return fork();
 }
 
+int
+sys_vfork(void)
+{
+  return vfork();
+}
+
 int
 sys_exit(void)
 {
@@ -50,8 +57,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = proc->sz;
-  if(growproc(n) < 0)
+  if((addr = growproc(n)) < 0)
     return -1;
   return addr;
 }
@@ -90,6 +96,32 @@ sys_uptime(void)
   return xticks;
 }
 
+// Report the CPUs, what each has been doing, and free memory.
+int
+sys_sysinfo(void)
+{
+  struct sysinfo *si;
+  struct cpustat *s;
+  struct cpu *c;
+
+  if(argptr(0, (char**)&si, sizeof(*si)) < 0)
+    return -1;
+  memset(si, 0, sizeof(*si));
+  si->ncpu = ncpu;
+  for(c = cpus; c < cpus + ncpu; c++){
+    s = &si->cpu[c - cpus];
+    s->apicid = c->id;
+    s->online = c->booted;
+    s->busy = c->busyticks;
+    s->idle = c->idleticks;
+    s->switches = c->nswitch;
+    if(c->booted)
+      si->nonline++;
+  }
+  kstat(&si->freepages, &si->totalpages);
+  return 0;
+}
+
 int
 sys_clone(void)
 { 
@@ -99,7 +131,7 @@ sys_clone(void)
   void *stack;
   if (argptr(0, (char**)&fcn, 4) < 0) return -1;
   if (argptr(1, (char**)&arg, 4) < 0) return -1;
-  if (argptr(2, (char**)&stack, 2 * PGSIZE) < 0) return -1;
+  if (argint(2, (int*)&stack) < 0) return -1; // checked by clone
   return clone(fcn, arg, stack);
 }
 
@@ -112,6 +144,30 @@ sys_join(void)
   return join(pid); 
 }
 
+int
+sys_join_any(void)
+{
+  // int join_any(int* tid, int* status);
+  int *tid, *status;
+  int pid, xstatus;
+  if (argptr(0, (char**)&tid, sizeof(*tid)) < 0) return -1;
+  if (argptr(1, (char**)&status, sizeof(*status)) < 0) return -1;
+  if ((pid = join_any(&xstatus)) < 0) return -1;
+  *tid = pid;
+  *status = xstatus;
+  return pid;
+}
+
+int
+sys_thread_exit(void)
+{
+  // void thread_exit(int status);
+  int status;
+  if (argint(0, &status) < 0) return -1;
+  thread_exit(status);
+  return 0;  // not reached
+}
+
 // BEGIN: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
 int
 sys_cv_wait(void)
@@ -126,7 +182,7 @@ sys_cv_wait(void)
 }
 // END: Release the lock pointed to by lock and put the caller to sleep.  Assumes that lock is held when this is called.  When signaled, the thread awakens and reacquires the lock.
 
-// BEGIN: Wake the threads that are waiting on conditionVariable.
+// BEGIN: Wake the thread that has waited longest on conditionVariable.
 int
 sys_cv_signal(void)
 {
@@ -136,13 +192,89 @@ sys_cv_signal(void)
   cv_signal(conditionVariable);
   return 0;
 }
-// END: Wake the threads that are waiting on conditionVariable.
+// END: Wake the thread that has waited longest on conditionVariable.
+
+// BEGIN: Wake all the threads that are waiting on conditionVariable.
+int
+sys_cv_broadcast(void)
+{
+  // void cv_broadcast(cond_t* conditionVariable);
+  cond_t* conditionVariable;
+  if (argptr(0, (char**)&conditionVariable, 4) < 0) return -1;
+  cv_broadcast(conditionVariable);
+  return 0;
+}
+// END: Wake all the threads that are waiting on conditionVariable.
+
+int
+sys_futex_wait(void)
+{
+  // int futex_wait(uint* addr, uint val);
+  uint* addr;
+  int val;
+  if (argptr(0, (char**)&addr, 4) < 0 || (uint)addr % 4) return -1;
+  if (argint(1, &val) < 0) return -1;
+  return futex_wait(addr, val);
+}
 
 int
-sys_find_ustack(void)
+sys_futex_wake(void)
+{
+  // int futex_wake(uint* addr, int n);
+  uint* addr;
+  int n;
+  if (argptr(0, (char**)&addr, 4) < 0 || (uint)addr % 4) return -1;
+  if (argint(1, &n) < 0) return -1;
+  return futex_wake(addr, n);
+}
+
+int
+sys_settickets(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return settickets(n);
+}
+
+int
+sys_setgang(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return setgang(on);
+}
+
+int
+sys_yield_to(void)
 {
-  // int find_ustack(int pid);
   int pid;
-  if (argint(0, &pid) < 0) return -1;
-  return find_ustack(pid);
-}
\ No newline at end of file
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return yield_to(pid);
+}
+
+int
+sys_setrtprio(void)
+{
+  int pr;
+
+  if(argint(0, &pr) < 0)
+    return -1;
+  return setrtprio(pr);
+}
+
+int
+sys_futex_wait_pi(void)
+{
+  // int futex_wait_pi(uint* addr, uint val, uint owner);
+  uint* addr;
+  int val, owner;
+  if (argptr(0, (char**)&addr, 4) < 0 || (uint)addr % 4) return -1;
+  if (argint(1, &val) < 0 || argint(2, &owner) < 0) return -1;
+  return futex_wait_pi(addr, val, owner);
+}
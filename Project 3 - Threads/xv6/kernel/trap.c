@@ -12,6 +12,22 @@ struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
 struct spinlock tickslock;
 uint ticks;
+static void (*ipihandler[NIRQ])(void);  // See ipiset
+
+// Have fn handle the IPIs sent at irq, which no device may use.
+// It runs with interrupts off and needn't send the EOI.
+void
+ipiset(int irq, void (*fn)(void))
+{
+  ipihandler[irq] = fn;
+}
+
+// Interrupt cpus[i] at irq.
+void
+ipisend(int i, int irq)
+{
+  lapicipi(cpus[i].id, T_IRQ0 + irq);
+}
 
 void
 tvinit(void)
@@ -46,6 +62,10 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
+    if(proc)
+      cpu->busyticks++;
+    else
+      cpu->idleticks++;
     if(cpu->id == 0){
       acquire(&tickslock);
       ticks++;
@@ -77,6 +97,12 @@ trap(struct trapframe *tf)
     break;
    
   default:
+    if(tf->trapno >= T_IRQ0 && tf->trapno < T_IRQ0 + NIRQ &&
+       ipihandler[tf->trapno - T_IRQ0]){
+      ipihandler[tf->trapno - T_IRQ0]();
+      lapiceoi();
+      break;
+    }
     if(proc == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -97,9 +123,10 @@ trap(struct trapframe *tf)
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick, or when asked to.
   // If interrupts were on while locks held, would need to check nlock.
-  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(proc && proc->state == RUNNING &&
+     (tf->trapno == T_IRQ0+IRQ_TIMER || tf->trapno == T_IRQ0+IRQ_PREEMPT))
     yield();
 
   // Check if the process has been killed since we yielded
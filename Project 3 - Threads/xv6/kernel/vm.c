@@ -6,10 +6,12 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
 
 extern char data[];  // defined in data.S
 
 static pde_t *kpgdir;  // for use in scheduler()
+static void tlbintr(void);
 
 // Allocate one page table for the machine for the kernel address
 // space for scheduler processes.
@@ -17,6 +19,7 @@ void
 kvmalloc(void)
 {
   kpgdir = setupkvm();
+  ipiset(IRQ_TLB, tlbintr);
 }
 
 // Set up CPU's kernel segment descriptors.
@@ -113,6 +116,9 @@ mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
 //   end..PHYSTOP     : mapped direct (kernel heap and user pages)
 //   0xfe000000..0    : mapped direct (devices such as ioapic)
 //
+// The kernel mappings are the same in every page table, so they
+// are global (PTE_G): loading cr3 flushes only the user entries.
+//
 // The kernel allocates memory for its heap and for user memory
 // between kernend and the end of physical memory (PHYSTOP).
 // The virtual address space of each user program includes the kernel
@@ -143,7 +149,7 @@ setupkvm(void)
   memset(pgdir, 0, PGSIZE);
   k = kmap;
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->p, k->e - k->p, (uint)k->p, k->perm) < 0)
+    if(mappages(pgdir, k->p, k->e - k->p, (uint)k->p, k->perm|PTE_G) < 0)
       return 0;
 
   return pgdir;
@@ -159,6 +165,7 @@ vmenable(void)
   cr0 = rcr0();
   cr0 |= CR0_PG;
   lcr0(cr0);
+  lcr4(rcr4() | CR4_PGE);  // honor PTE_G
 }
 
 // Switch h/w page table register to the kernel-only page table,
@@ -166,10 +173,14 @@ vmenable(void)
 void
 switchkvm(void)
 {
-  lcr3(PADDR(kpgdir));   // switch to the kernel page table
+  if(rcr3() != PADDR(kpgdir))
+    lcr3(PADDR(kpgdir));   // switch to the kernel page table
+  cpu->pgdir = 0;
 }
 
 // Switch TSS and h/w page table to correspond to process p.
+// If p uses the page table already loaded (a thread of the
+// last process), the TLB is kept.
 void
 switchuvm(struct proc *p)
 {
@@ -179,9 +190,14 @@ switchuvm(struct proc *p)
   cpu->ts.ss0 = SEG_KDATA << 3;
   cpu->ts.esp0 = (uint)proc->kstack + KSTACKSIZE;
   ltr(SEG_TSS << 3);
-  if(p->pgdir == 0)
+  // Takes effect when trapret reloads the user's %gs.
+  cpu->gdt[SEG_UTLS] = SEG(STA_W, p->tls, PGSIZE-1, DPL_USER);
+  if(p->vm == 0 || p->vm->pgdir == 0)
     panic("switchuvm: no pgdir");
-  lcr3(PADDR(p->pgdir));  // switch to new address space
+  if(rcr3() != PADDR(p->vm->pgdir)){
+    cpu->pgdir = p->vm->pgdir;  // before the load, for tlbshootdown
+    lcr3(PADDR(p->vm->pgdir));  // switch to new address space
+  }
   popcli();
 }
 
@@ -275,9 +291,85 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
       *pte = 0;
     }
   }
+  if(rcr3() == PADDR(pgdir))
+    lcr3(PADDR(pgdir));  // flush the entries just removed
   return newsz;
 }
 
+// Unmap the user pages in [lo, hi) of pgdir, putting them in
+// pages for the caller to free once no TLB holds them (see
+// tlbshootdown).  Returns how many there were.
+int
+unmapuvm(pde_t *pgdir, uint lo, uint hi, char **pages)
+{
+  pte_t *pte;
+  uint a;
+  int n;
+
+  n = 0;
+  for(a = PGROUNDUP(lo); a < hi; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P) != 0){
+      pages[n++] = (char*)PTE_ADDR(*pte);
+      *pte = 0;
+    }
+  }
+  if(rcr3() == PADDR(pgdir))
+    lcr3(PADDR(pgdir));
+  return n;
+}
+
+// IRQ_TLB: flush the TLB for the CPUs that asked, then tell them.
+static void
+tlbintr(void)
+{
+  uchar req[NCPU];
+  int i;
+
+  for(i = 0; i < ncpu; i++)
+    if((req[i] = cpu->tlbreq[i]) != 0)
+      cpu->tlbreq[i] = 0;
+  lcr3(rcr3());
+  for(i = 0; i < ncpu; i++)
+    if(req[i])
+      cpu->tlbdone[i] = 1;
+}
+
+// Make the other CPUs with pgdir loaded flush their TLBs, and
+// wait until they have, so that pages just unmapped from it can
+// be freed.  A CPU taking up pgdir later loads %cr3, which
+// flushes anyway.  Call with no locks held: a CPU spinning for
+// one would never take the IPI.  Requests to this CPU are served
+// while it waits, so two CPUs shooting at each other don't
+// deadlock.
+void
+tlbshootdown(pde_t *pgdir)
+{
+  struct cpu *c;
+  uchar sent[NCPU];
+  int me, i;
+
+  pushcli();
+  me = cpu - cpus;
+  __sync_synchronize();  // PTE stores before the reads of c->pgdir
+  for(c = cpus; c < cpus + ncpu; c++){
+    i = c - cpus;
+    sent[i] = c != cpu && c->pgdir == pgdir;
+    if(!sent[i])
+      continue;
+    c->tlbdone[me] = 0;
+    c->tlbreq[me] = 1;
+    ipisend(i, IRQ_TLB);
+  }
+  for(i = 0; i < ncpu; i++){
+    while(sent[i] && !cpus[i].tlbdone[me]){
+      tlbintr();
+      pause();
+    }
+  }
+  popcli();
+}
+
 // Free a page table and all the physical memory pages
 // in the user part.
 void
@@ -316,7 +408,7 @@ copyuvm(pde_t *pgdir, uint sz)
     if((mem = kalloc()) == 0)
       goto bad;
     memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, PADDR(mem), PTE_W|PTE_U) < 0)
+    if(mappages(d, (void*)i, PGSIZE, PADDR(mem), *pte & (PTE_W|PTE_U)) < 0)
       goto bad;
   }
   return d;
@@ -326,6 +418,18 @@ bad:
   return 0;
 }
 
+// Clear PTE_U on a page, so that user code faults on it.
+// Used for the guard page below a thread stack.
+void
+clearpteu(pde_t *pgdir, char *uva)
+{
+  pte_t *pte;
+
+  if((pte = walkpgdir(pgdir, uva, 0)) == 0)
+    panic("clearpteu");
+  *pte &= ~PTE_U;
+}
+
 // Map user virtual address to kernel physical address.
 char*
 uva2ka(pde_t *pgdir, char *uva)
@@ -19,9 +19,9 @@
 
 #define BLOCK_SIZE (512)
 
-int nblocks = 995;
+int nblocks = 2019;
 int ninodes = 200;
-int size = 1024;
+int size = 2048;
 
 int fsfd;
 struct superblock sb;
@@ -217,7 +217,7 @@ main(int argc, char *argv[])
     exit(1);
   }
 
-  mkfs(995, 200, 1024);
+  mkfs(nblocks, ninodes, size);
 
   root_dir = opendir(argv[2]);
 
@@ -0,0 +1,129 @@
+/* more threads than CPUs keep in step through a barrier, start
+ * and finish on latches, and pass items through a bounded buffer
+ * counted by semaphores */
+#include "types.h"
+#include "user.h"
+
+#define NTHREAD 8
+#define NPHASE 50
+#define NSLOT 4
+#define NITEM 500
+
+int ppid;
+barrier_t bar;
+latch_t start, done;
+volatile int phase[NTHREAD];
+volatile int last;
+
+sem_t empty, full;
+mutex_t m;
+int ring[NSLOT], head, tail;
+volatile int sum;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+stepper(void *arg)
+{
+   int me = (int)arg;
+   int p, i;
+
+   latch_wait(&start);
+   for (p = 1; p <= NPHASE; p++) {
+      phase[me] = p;
+      if (barrier_wait(&bar))
+         __sync_fetch_and_add(&last, 1);
+      for (i = 0; i < NTHREAD; i++)
+         assert(phase[i] == p);
+      if (barrier_wait(&bar))
+         __sync_fetch_and_add(&last, 1);
+   }
+   latch_countdown(&done);
+   exit();
+}
+
+void
+producer(void *arg)
+{
+   int i;
+
+   for (i = 1; i <= NITEM; i++) {
+      sem_wait(&empty);
+      mutex_lock(&m);
+      ring[tail++ % NSLOT] = i;
+      mutex_unlock(&m);
+      sem_post(&full);
+   }
+   exit();
+}
+
+void
+consumer(void *arg)
+{
+   int i, v;
+
+   for (i = 0; i < NITEM; i++) {
+      sem_wait(&full);
+      mutex_lock(&m);
+      v = ring[head++ % NSLOT];
+      mutex_unlock(&m);
+      sem_post(&empty);
+      __sync_fetch_and_add(&sum, v);
+   }
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, tid[NTHREAD];
+   sem_t s;
+   ppid = getpid();
+
+   sem_init(&s, 2);
+   assert(sem_trywait(&s) && sem_trywait(&s) && !sem_trywait(&s));
+   sem_post(&s);
+   sem_wait(&s);
+   assert(!sem_trywait(&s));
+
+   // Barrier, with latches to start and finish.
+   barrier_init(&bar, NTHREAD);
+   latch_init(&start, 1);
+   latch_init(&done, NTHREAD);
+   for (i = 0; i < NTHREAD; i++) {
+      tid[i] = thread_create(stepper, (void*)i);
+      assert(tid[i] > 0);
+   }
+   sleep(1);
+   for (i = 0; i < NTHREAD; i++)
+      assert(phase[i] == 0);
+   latch_countdown(&start);
+   latch_wait(&done);
+   for (i = 0; i < NTHREAD; i++)
+      assert(phase[i] == NPHASE);
+   assert(last == 2*NPHASE);
+   for (i = 0; i < NTHREAD; i++)
+      assert(thread_join(tid[i]) == tid[i]);
+
+   // Bounded buffer: two producers, two consumers.
+   sem_init(&empty, NSLOT);
+   sem_init(&full, 0);
+   mutex_init(&m);
+   for (i = 0; i < 4; i++) {
+      tid[i] = thread_create(i < 2 ? producer : consumer, 0);
+      assert(tid[i] > 0);
+   }
+   for (i = 0; i < 4; i++)
+      assert(thread_join(tid[i]) == tid[i]);
+   assert(sum == NITEM*(NITEM+1));
+   assert(empty.count == NSLOT && full.count == 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,107 @@
+/* a thread closing an fd another thread is writing to doesn't
+ * pull the file out from under the write: the write finishes, and
+ * the file closes only when it does; threads using an fd while
+ * another closes and reopens it over and over are fine */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+#include "stat.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define NUSER 2
+#define ROUNDS 500
+#define NBYTE 1024  // more than a pipe holds
+
+int ppid;
+int p[2];
+char buf[NBYTE];
+volatile int writing;
+volatile int fd = -1;
+volatile int done;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+writer(void *arg_ptr)
+{
+   int i;
+
+   for (i = 0; i < NBYTE; i++)
+      buf[i] = i;
+   writing = 1;
+   assert(write(p[1], buf, NBYTE) == NBYTE);
+   exit();
+}
+
+// Read, stat and dup whatever fd is now; each may fail, but
+// none may crash.
+void
+user(void *arg_ptr)
+{
+   struct stat st;
+   char c;
+   int d;
+
+   while (!done) {
+      read(fd, &c, 1);
+      fstat(fd, &st);
+      if ((d = dup(fd)) >= 0)
+         close(d);
+   }
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, n, tid, tids[NUSER];
+   char c;
+
+   ppid = getpid();
+
+   // Closed while a write sleeps on the full pipe: the reader
+   // sees end of file only after all of it.
+   assert(pipe(p) == 0);
+   tid = thread_create(writer, NULL);
+   assert(tid > 0);
+   while (!writing)
+      ;
+   sleep(10);
+   assert(close(p[1]) == 0);
+   assert(write(p[1], &c, 1) < 0);
+   for (n = 0; read(p[0], &c, 1) == 1; n++)
+      assert(c == (char)n);
+   assert(n == NBYTE);
+   assert(thread_join(tid) == tid);
+   close(p[0]);
+
+   // Closed and reopened while other threads use it.
+   fd = open("closerace.tmp", O_CREATE | O_RDWR);
+   assert(fd >= 0);
+   assert(write(fd, "abc", 3) == 3);
+   for (i = 0; i < NUSER; i++) {
+      tids[i] = thread_create(user, NULL);
+      assert(tids[i] > 0);
+   }
+   for (i = 0; i < ROUNDS; i++) {
+      assert(close(fd) == 0);
+      fd = open("closerace.tmp", O_RDWR);
+      assert(fd >= 0);
+   }
+   done = 1;
+   for (i = 0; i < NUSER; i++)
+      assert(thread_join(tids[i]) == tids[i]);
+   close(fd);
+   assert(unlink("closerace.tmp") == 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,62 @@
+/* cv_signal wakes one waiter, cv_broadcast wakes the rest */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define N 4
+int ppid;
+volatile int woken = 0;
+lock_t lock;
+cond_t cond;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, pids[N];
+   ppid = getpid();
+
+   lock_init(&lock);
+   for (i = 0; i < N; i++) {
+      pids[i] = thread_create(worker, NULL);
+      assert(pids[i] > 0);
+   }
+   sleep(50);
+   assert(woken == 0);
+
+   lock_acquire(&lock);
+   cv_signal(&cond);
+   lock_release(&lock);
+   sleep(50);
+   assert(woken == 1);
+
+   lock_acquire(&lock);
+   cv_broadcast(&cond);
+   lock_release(&lock);
+   for (i = 0; i < N; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+   assert(woken == N);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   lock_acquire(&lock);
+   cv_wait(&cond, &lock);
+   woken++;
+   lock_release(&lock);
+   exit();
+}
@@ -0,0 +1,84 @@
+/* sysinfo reports every CPU online, with ticks and switches that
+ * grow as threads run, and free pages that fall as memory is
+ * used; a pool asked for 0 workers gets one per CPU */
+#include "types.h"
+#include "user.h"
+#include "sysinfo.h"
+
+#define NPAGE 16
+
+int ppid;
+volatile int ran;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Sums of busy ticks and of switches over the CPUs.
+void
+totals(struct sysinfo *si, uint *busy, uint *switches)
+{
+   uint i;
+
+   *busy = *switches = 0;
+   for (i = 0; i < si->ncpu; i++) {
+      *busy += si->cpu[i].busy;
+      *switches += si->cpu[i].switches;
+   }
+}
+
+void
+task(void *arg)
+{
+   __sync_add_and_fetch(&ran, 1);
+}
+
+int
+main(int argc, char *argv[])
+{
+   struct sysinfo si, si2;
+   struct threadpool *pool;
+   uint i, busy, sw, busy2, sw2;
+   int t;
+   ppid = getpid();
+
+   assert(sysinfo((struct sysinfo*)0xffffffff) == -1);
+   assert(sysinfo(&si) == 0);
+   assert(si.ncpu >= 1 && si.ncpu <= NCPU);
+   assert(si.nonline == si.ncpu);
+   for (i = 0; i < si.ncpu; i++)
+      assert(si.cpu[i].online);
+   assert(si.freepages > 0 && si.freepages < si.totalpages);
+
+   // Touching new heap takes pages off the free list.
+   assert(sbrk(NPAGE*4096) != (char*)-1);
+   assert(sysinfo(&si2) == 0);
+   assert(si2.totalpages == si.totalpages);
+   assert(si2.freepages + NPAGE <= si.freepages);
+
+   // Spinning is busy time; sleeping switches to other threads.
+   totals(&si2, &busy, &sw);
+   t = uptime();
+   while (uptime() < t + 5)
+      ;
+   sleep(2);
+   assert(sysinfo(&si2) == 0);
+   totals(&si2, &busy2, &sw2);
+   assert(busy2 > busy);
+   assert(sw2 > sw);
+
+   pool = threadpool_create(0);
+   assert(pool != 0);
+   for (i = 0; i < 100; i++)
+      threadpool_submit(pool, task, 0);
+   threadpool_wait(pool);
+   assert(ran == 100);
+   threadpool_destroy(pool);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
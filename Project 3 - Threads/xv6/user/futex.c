@@ -0,0 +1,77 @@
+/* futex_wait sleeps until futex_wake; contended locks sleep too */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+int ppid;
+volatile uint word;
+lock_t lock;
+int global = 0;
+int num_threads = 8;
+int loops = 20;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void waiter(void *arg_ptr);
+void worker(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, pids[8];
+   ppid = getpid();
+
+   // A stale value or an empty queue returns at once.
+   word = 0;
+   assert(futex_wait((uint*)&word, 1) == -1);
+   assert(futex_wake((uint*)&word, 1) == 0);
+
+   int thread_pid = thread_create(waiter, NULL);
+   assert(thread_pid > 0);
+   sleep(20);
+   word = 1;
+   assert(futex_wake((uint*)&word, 1) == 1);
+   assert(thread_join(thread_pid) == thread_pid);
+
+   // Holders sleep with the lock held, so the others must wait for it.
+   lock_init(&lock);
+   for (i = 0; i < num_threads; i++) {
+      pids[i] = thread_create(worker, NULL);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+   assert(global == num_threads * loops);
+   assert(lock == 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+waiter(void *arg_ptr) {
+   while (word == 0)
+      futex_wait((uint*)&word, 0);
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   int i, tmp;
+   for (i = 0; i < loops; i++) {
+      lock_acquire(&lock);
+      tmp = global;
+      sleep(1);
+      global = tmp + 1;
+      lock_release(&lock);
+   }
+   exit();
+}
@@ -0,0 +1,95 @@
+/* setgang runs a process's threads at the same time, so two
+ * threads passing a token by spinning hand it over more often
+ * while other processes compete for the CPUs */
+#include "types.h"
+#include "user.h"
+
+#define NHOG 2
+#define RUNTICKS 100
+
+int ppid;
+volatile int token, stop;
+volatile uint passes;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Wait for the token to be ours, then hand it on.
+void
+player(void *arg)
+{
+   int me = (int)arg;
+
+   while (!stop) {
+      while (token != me && !stop)
+         ;
+      token = !me;
+      passes++;
+   }
+   exit();
+}
+
+// Passes made in RUNTICKS with gang scheduling on or off, run
+// in a child so the counters start afresh.
+uint
+play(int on)
+{
+   int p[2], t0, t1;
+   uint n;
+
+   assert(pipe(p) == 0);
+   if (fork() == 0) {
+      assert(setgang(on) == 0);
+      token = 0;
+      t0 = thread_create(player, (void*)0);
+      t1 = thread_create(player, (void*)1);
+      assert(t0 > 0 && t1 > 0);
+      sleep(RUNTICKS);
+      stop = 1;
+      assert(thread_join(t0) == t0 && thread_join(t1) == t1);
+      n = passes;
+      assert(write(p[1], &n, sizeof(n)) == sizeof(n));
+      exit();
+   }
+   assert(read(p[0], &n, sizeof(n)) == sizeof(n));
+   assert(wait() > 0);
+   close(p[0]);
+   close(p[1]);
+   return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, hog[NHOG];
+   uint apart, together;
+   ppid = getpid();
+
+   assert(setgang(1) == 0);
+   assert(setgang(0) == 1);
+
+   // Keep the CPUs busy with other processes.
+   for (i = 0; i < NHOG; i++) {
+      if ((hog[i] = fork()) == 0)
+         for (;;)
+            ;
+      assert(hog[i] > 0);
+   }
+
+   apart = play(0);
+   together = play(1);
+   printf(1, "gang: %d passes apart, %d together\n", apart, together);
+   assert(together > apart);
+
+   for (i = 0; i < NHOG; i++) {
+      kill(hog[i]);
+      assert(wait() > 0);
+   }
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,298 @@
+// Green threads: many user-level threads run over a few clone()
+// threads ("carriers").
+//
+// A green thread runs until it yields, blocks on a gsem_t or
+// returns, and then switches with gswtch to its carrier's
+// scheduler loop, which picks the next ready one.  Switching
+// never enters the kernel, and the number of green threads is
+// bounded by memory rather than by NPROC.
+//
+// One lock, rt.lock, guards the run queue, every gsem_t and the
+// green threads' state.  It is held across each switch: a green
+// thread takes it before switching to its carrier, and the
+// carrier requeues or frees it and drops the lock only once it
+// is off that thread's stack; the carrier in turn switches to a
+// green thread holding it, and the thread releases it.  So no
+// carrier can start a thread whose registers are still being
+// saved.
+
+#include "types.h"
+#include "user.h"
+
+#define NCARRIER 8
+#define GSTACKSIZE 1024  // bytes of stack per green thread
+
+// Saved registers, laid out as gswtch pushes them.
+struct gcontext {
+  uint edi;
+  uint esi;
+  uint ebx;
+  uint ebp;
+  uint eip;
+};
+
+enum gstate { GREADY, GBLOCKED, GDEAD };
+
+struct gthread {
+  struct gcontext *ctx;
+  enum gstate state;
+  struct gthread *next;  // On the run queue, a gsem_t or the free list
+  void (*fcn)(void*);
+  void *arg;
+  char *stack;
+};
+
+struct carrier {
+  struct gcontext *ctx;  // Its scheduler loop
+  struct gthread *cur;   // Green thread it is running
+  char *tls;             // Its thread_tls(), to tell who is calling
+  int pid;
+};
+
+static struct {
+  lock_t lock;
+  cond_t ready;          // Idle carriers wait here
+  cond_t done;           // gthread_wait waits here
+  struct gthread *head;  // Run queue
+  struct gthread *tail;
+  struct gthread *free;  // Exited green threads, kept with their stacks
+  int live;              // Green threads not yet exited
+  int stop;
+  int n;
+  struct carrier c[NCARRIER];
+} rt;
+
+void gswtch(struct gcontext **old, struct gcontext *new);
+
+// The carrier running the calling green thread.
+static struct carrier*
+mycarrier(void)
+{
+  char *tls;
+  int i;
+
+  tls = thread_tls();
+  for(i = 0; i < rt.n; i++)
+    if(rt.c[i].tls == tls)
+      return &rt.c[i];
+  return 0;
+}
+
+// Put g on the run queue and wake a carrier.  Caller holds rt.lock.
+static void
+ready(struct gthread *g)
+{
+  g->state = GREADY;
+  g->next = 0;
+  if(rt.tail)
+    rt.tail->next = g;
+  else
+    rt.head = g;
+  rt.tail = g;
+  cv_signal(&rt.ready);
+}
+
+// Switch from the calling green thread back to its carrier, having
+// set its state.  Caller holds rt.lock, and holds it again on return.
+static void
+gsched(void)
+{
+  struct carrier *c;
+
+  c = mycarrier();
+  gswtch(&c->cur->ctx, c->ctx);
+}
+
+// Where a new green thread starts, holding rt.lock.
+static void
+gstart(void)
+{
+  struct gthread *g;
+
+  g = mycarrier()->cur;
+  lock_release(&rt.lock);
+  g->fcn(g->arg);
+  gthread_exit();
+}
+
+static void
+carrier(void *arg)
+{
+  struct carrier *c = arg;
+  struct gthread *g;
+
+  c->tls = thread_tls();
+  lock_acquire(&rt.lock);
+  for(;;){
+    while((g = rt.head) == 0 && !rt.stop)
+      cv_wait(&rt.ready, &rt.lock);
+    if(g == 0)
+      break;
+    if((rt.head = g->next) == 0)
+      rt.tail = 0;
+    c->cur = g;
+    gswtch(&c->ctx, g->ctx);
+
+    // Back, holding rt.lock, with g switched out.
+    c->cur = 0;
+    if(g->state == GREADY)
+      ready(g);
+    else if(g->state == GDEAD){
+      g->next = rt.free;
+      rt.free = g;
+      if(--rt.live == 0)
+        cv_broadcast(&rt.done);
+    }
+  }
+  lock_release(&rt.lock);
+  exit();
+}
+
+// BEGIN: Start n carrier threads for green threads to run on.  Returns -1 if n is out of range or they can't be made.
+int
+gthread_init(int n)
+{
+  int i;
+
+  if(n < 1 || n > NCARRIER || rt.n > 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    if((rt.c[i].pid = thread_create(carrier, &rt.c[i])) < 0)
+      break;
+    rt.n++;
+  }
+  if(rt.n < n){
+    gthread_wait();
+    return -1;
+  }
+  return 0;
+}
+// END: Start n carrier threads for green threads to run on.  Returns -1 if n is out of range or they can't be made.
+
+// BEGIN: Create a green thread running fcn(arg), reusing an exited one's stack if there is one.  Returns -1 if out of memory.
+int
+gthread_create(void (*fcn)(void*), void* arg)
+{
+  struct gthread *g;
+  uint *sp;
+
+  lock_acquire(&rt.lock);
+  if((g = rt.free) != 0)
+    rt.free = g->next;
+  else if((g = malloc(sizeof(*g))) != 0 && (g->stack = malloc(GSTACKSIZE)) == 0){
+    free(g);
+    g = 0;
+  }
+  if(g == 0){
+    lock_release(&rt.lock);
+    return -1;
+  }
+  g->fcn = fcn;
+  g->arg = arg;
+  // gstart never returns; a zero return address catches it
+  // if it ever does.
+  sp = (uint*)(g->stack + GSTACKSIZE);
+  *--sp = 0;
+  g->ctx = (struct gcontext*)sp - 1;
+  memset(g->ctx, 0, sizeof(*g->ctx));
+  g->ctx->eip = (uint)gstart;
+  rt.live++;
+  ready(g);
+  lock_release(&rt.lock);
+  return 0;
+}
+// END: Create a green thread running fcn(arg), reusing an exited one's stack if there is one.  Returns -1 if out of memory.
+
+// BEGIN: Let other green threads run.  Only for green threads.
+void
+gthread_yield(void)
+{
+  lock_acquire(&rt.lock);
+  mycarrier()->cur->state = GREADY;
+  gsched();
+  lock_release(&rt.lock);
+}
+// END: Let other green threads run.  Only for green threads.
+
+// BEGIN: End the calling green thread.  Returning from its function does the same.
+void
+gthread_exit(void)
+{
+  lock_acquire(&rt.lock);
+  mycarrier()->cur->state = GDEAD;
+  gsched();
+}
+// END: End the calling green thread.  Returning from its function does the same.
+
+// BEGIN: Wait for every green thread to exit, then stop the carriers.  Called from outside the green threads, such as by main.
+void
+gthread_wait(void)
+{
+  int i;
+
+  lock_acquire(&rt.lock);
+  while(rt.live > 0)
+    cv_wait(&rt.done, &rt.lock);
+  rt.stop = 1;
+  cv_broadcast(&rt.ready);
+  lock_release(&rt.lock);
+  // Forget the carriers' stacks too: new carriers reuse them.
+  for(i = 0; i < rt.n; i++){
+    thread_join(rt.c[i].pid);
+    rt.c[i].tls = 0;
+  }
+  rt.n = 0;
+  rt.stop = 0;
+}
+// END: Wait for every green thread to exit, then stop the carriers.  Called from outside the green threads, such as by main.
+
+// BEGIN: Initialize the semaphore pointed to by s to count.
+void
+gsem_init(gsem_t* s, int count)
+{
+  s->count = count;
+  s->head = s->tail = 0;
+}
+// END: Initialize the semaphore pointed to by s to count.
+
+// BEGIN: Take one from s, blocking the calling green thread, but not its carrier, until there is one.  Only for green threads.
+void
+gsem_wait(gsem_t* s)
+{
+  struct gthread *g;
+
+  lock_acquire(&rt.lock);
+  if(s->count > 0){
+    s->count--;
+    lock_release(&rt.lock);
+    return;
+  }
+  g = mycarrier()->cur;
+  g->state = GBLOCKED;
+  g->next = 0;
+  if(s->tail)
+    s->tail->next = g;
+  else
+    s->head = g;
+  s->tail = g;
+  gsched();
+  lock_release(&rt.lock);
+}
+// END: Take one from s, blocking the calling green thread, but not its carrier, until there is one.  Only for green threads.
+
+// BEGIN: Give one to s, which readies its longest-blocked green thread if there is one.  Any thread may call this.
+void
+gsem_post(gsem_t* s)
+{
+  struct gthread *g;
+
+  lock_acquire(&rt.lock);
+  if((g = s->head) != 0){
+    if((s->head = g->next) == 0)
+      s->tail = 0;
+    ready(g);
+  } else
+    s->count++;
+  lock_release(&rt.lock);
+}
+// END: Give one to s, which readies its longest-blocked green thread if there is one.  Any thread may call this.
@@ -0,0 +1,90 @@
+/* a main thread's exit or kill takes all its threads with it */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define N 40
+
+int ppid;
+int fds[2];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void sleeper(void *arg_ptr);
+void spinner(void *arg_ptr);
+
+// Fork a process that starts N threads running fn, sends their
+// pids down the pipe, and then exits if doexit, else waits.
+int
+group(void (*fn)(void*), int doexit, int *tids)
+{
+   int i, pid;
+
+   pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      for (i = 0; i < N; i++) {
+         tids[i] = thread_create(fn, NULL);
+         assert(tids[i] > 0);
+      }
+      assert(write(fds[1], tids, sizeof(int) * N) == sizeof(int) * N);
+      if (doexit)
+         exit();
+      for (;;)
+         sleep(1000);
+   }
+   assert(read(fds[0], tids, sizeof(int) * N) == sizeof(int) * N);
+   return pid;
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, pid, tids[N];
+   ppid = getpid();
+
+   assert(pipe(fds) == 0);
+
+   // The main thread exits; its threads go too, asleep or not.
+   pid = group(sleeper, 1, tids);
+   assert(wait() == pid);
+   for (i = 0; i < N; i++)
+      assert(kill(tids[i]) == -1);
+   pid = group(spinner, 1, tids);
+   assert(wait() == pid);
+   for (i = 0; i < N; i++)
+      assert(kill(tids[i]) == -1);
+
+   // It is killed.
+   pid = group(spinner, 0, tids);
+   assert(kill(pid) == 0);
+   assert(wait() == pid);
+   for (i = 0; i < N; i++)
+      assert(kill(tids[i]) == -1);
+
+   // None of them is joinable from here.
+   assert(join(pid) == -1);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+sleeper(void *arg_ptr) {
+   for (;;)
+      sleep(1000);
+}
+
+void
+spinner(void *arg_ptr) {
+   for (;;)
+      ;
+}
@@ -0,0 +1,92 @@
+/* green threads, more of them than NPROC, switch and block in user space */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define N 200   // green threads, well past NPROC
+#define LOOPS 10
+
+int ppid;
+gsem_t go, finished;
+volatile int yields = 0;
+volatile int woke = 0;
+int turns[N];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+spinner(void *arg_ptr)
+{
+   int i, id = (int)arg_ptr;
+
+   for (i = 0; i < LOOPS; i++) {
+      turns[id]++;
+      __sync_add_and_fetch(&yields, 1);
+      gthread_yield();
+   }
+}
+
+// Blocks until main posts go, then tells main it ran.
+void
+blocker(void *arg_ptr)
+{
+   gsem_wait(&go);
+   __sync_add_and_fetch(&woke, 1);
+   gsem_post(&finished);
+}
+
+// Waits for all the blockers, from inside a green thread.
+void
+collector(void *arg_ptr)
+{
+   int i;
+
+   for (i = 0; i < N; i++)
+      gsem_wait(&finished);
+   assert(woke == N);
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i;
+   ppid = getpid();
+
+   assert(N > NPROC);
+   assert(gthread_init(0) == -1);
+   assert(gthread_init(3) == 0);
+
+   for (i = 0; i < N; i++)
+      assert(gthread_create(spinner, (void*)i) == 0);
+   gthread_wait();
+   assert(yields == N * LOOPS);
+   for (i = 0; i < N; i++)
+      assert(turns[i] == LOOPS);
+
+   // Blocked green threads hold no carrier; the collector and
+   // the posts still get to run.  Their stacks are the spinners'.
+   assert(gthread_init(2) == 0);
+   gsem_init(&go, 0);
+   gsem_init(&finished, 0);
+   for (i = 0; i < N; i++)
+      assert(gthread_create(blocker, NULL) == 0);
+   assert(gthread_create(collector, NULL) == 0);
+   sleep(10);
+   assert(woke == 0);
+   for (i = 0; i < N; i++)
+      gsem_post(&go);
+   gthread_wait();
+   assert(woke == N);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,77 @@
+/* realloc grows in place, calloc zeroes and free shrinks the heap */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define PGSIZE (4096)
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+   char *a, *b, *c, *sz;
+   int i;
+   ppid = getpid();
+
+   // b sits just below a; once a is free, b can grow into it.
+   a = malloc(2000);
+   b = malloc(2000);
+   assert(a != NULL && b != NULL && b + 2000 < a);
+   memset(b, 'b', 2000);
+   free(a);
+   c = realloc(b, 3500);
+   assert(c == b);
+   for (i = 0; i < 2000; i++)
+      assert(c[i] == 'b');
+
+   // Moving keeps the data; small blocks have room to grow.
+   a = malloc(10);
+   strcpy(a, "realloc");
+   a = realloc(a, 12);
+   assert(strcmp(a, "realloc") == 0);
+   a = realloc(a, 300);
+   assert(strcmp(a, "realloc") == 0);
+   free(a);
+   free(c);
+   assert(realloc(NULL, 10) != NULL);
+
+   // Reused memory is zeroed, fresh memory is anyway.
+   a = malloc(20000);
+   memset(a, 0xff, 20000);
+   free(a);
+   for (i = 0; i < 2; i++) {
+      a = calloc(5000, 4);
+      assert(a != NULL);
+      for (c = a; c < a + 20000; c++)
+         assert(*c == 0);
+      memset(a, 0xff, 20000);
+      free(a);
+   }
+   assert(calloc(0x10000, 0x10000) == NULL);
+
+   // A big free block at the top goes back to the kernel.
+   sz = sbrk(0);
+   a = malloc(200000);
+   assert(a != NULL && sbrk(0) > sz + 200000 - PGSIZE);
+   memset(a, 'a', 200000);
+   free(a);
+   assert(sbrk(0) <= sz + 2 * PGSIZE);
+   a = malloc(200000);
+   assert(a != NULL);
+   a[199999] = 'a';
+   free(a);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,85 @@
+/* join_any reaps threads in the order they finish, each with the
+ * status it passed to thread_exit, until there are none left; a
+ * thread that just exits reports 0, and join still finds a thread
+ * that join_any passed over */
+#include "types.h"
+#include "user.h"
+
+#define NTHREAD 8
+
+int ppid;
+int tid[NTHREAD];
+volatile int finished;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Thread i finishes after the ones before it, with status 100+i.
+void
+worker(void *arg)
+{
+   int me = (int)arg;
+
+   while (finished < me)
+      sleep(1);
+   thread_exit(100 + me);
+}
+
+void
+plain(void *arg)
+{
+   exit();
+}
+
+// A thread on its own has no one to join.
+void
+alone(void *arg)
+{
+   int t, status;
+
+   assert(join_any(&t, &status) == -1);
+   thread_exit(7);
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, t, status, p;
+   ppid = getpid();
+
+   assert(join_any(&t, &status) == -1);
+
+   for (i = 0; i < NTHREAD; i++) {
+      tid[i] = thread_create(worker, (void*)i);
+      assert(tid[i] > 0);
+   }
+   for (i = 0; i < NTHREAD; i++) {
+      t = thread_join_any(&status);
+      assert(t == tid[i]);
+      assert(status == 100 + i);
+      finished++;
+   }
+   assert(thread_join_any(&status) == -1);
+
+   // Plain exit is status 0; of two exited threads, join takes
+   // one and join_any the other.
+   t = thread_create(plain, 0);
+   assert(t > 0);
+   p = thread_create(alone, 0);
+   assert(p > 0);
+   sleep(50);
+   assert(thread_join(t) == t);
+   assert(thread_join_any(&status) == p && status == 7);
+   t = thread_create(plain, 0);
+   assert(t > 0);
+   assert(thread_join_any(&status) == t && status == 0);
+   assert(join(t) == -1);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,236 @@
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+
+// Lock scalability benchmark.
+//
+//   lockbench [-t maxthreads] [test ...]
+//
+// Runs each test with 1, 2, 4, ... up to maxthreads threads (8 by
+// default) for RUNTICKS timer ticks and prints the operations per
+// second, taking a tick as 1/100 s, and per thread:
+//
+//   spin     a bare xchg spinlock, as lock_t once was
+//   lock     lock_acquire and lock_release
+//   mutex    mutex_lock and mutex_unlock
+//   cv       a token passed from thread to thread, each waiting
+//            for its turn in cv_wait and handing on with cv_signal
+//   atomic   a locked add to a shared counter
+//
+// Every lock guards a shared counter, which must come out equal to
+// the operations counted.
+
+#define NTHREAD  8
+#define RUNTICKS 100
+#define TICKHZ   100
+
+struct test {
+  char *name;
+  void (*run)(int);
+};
+
+// Per-thread counts, a cache line each.
+static struct {
+  uint n;
+  char pad[60];
+} ops[NTHREAD];
+
+static volatile int ready, go, stop;
+static int nthread;
+static volatile uint counter;
+static volatile uint spinlock;
+static lock_t lock;
+static mutex_t mutex;
+static cond_t turncv[NTHREAD];
+static volatile int turn;
+
+// Atomically add v to *addr.
+static inline void
+atomicadd(volatile uint *addr, uint v)
+{
+  asm volatile("lock; addl %1, %0" : "+m" (*addr) : "r" (v) : "cc");
+}
+
+static void
+spin(int id)
+{
+  while(!stop){
+    while(xchg(&spinlock, 1) != 0)
+      pause();
+    counter++;
+    xchg(&spinlock, 0);
+    ops[id].n++;
+  }
+}
+
+static void
+lockrun(int id)
+{
+  while(!stop){
+    lock_acquire(&lock);
+    counter++;
+    lock_release(&lock);
+    ops[id].n++;
+  }
+}
+
+static void
+mutexrun(int id)
+{
+  while(!stop){
+    mutex_lock(&mutex);
+    counter++;
+    mutex_unlock(&mutex);
+    ops[id].n++;
+  }
+}
+
+static void
+cv(int id)
+{
+  lock_acquire(&lock);
+  while(!stop){
+    while(turn != id && !stop)
+      cv_wait(&turncv[id], &lock);
+    if(stop)
+      break;
+    counter++;
+    ops[id].n++;
+    turn = (id + 1) % nthread;
+    cv_signal(&turncv[turn]);
+  }
+  lock_release(&lock);
+}
+
+static void
+atomic(int id)
+{
+  while(!stop){
+    atomicadd(&counter, 1);
+    ops[id].n++;
+  }
+}
+
+static struct test tests[] = {
+  { "spin",   spin },
+  { "lock",   lockrun },
+  { "mutex",  mutexrun },
+  { "cv",     cv },
+  { "atomic", atomic },
+};
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+static struct test *cur;
+
+static void
+worker(void *arg)
+{
+  int id = (int)arg;
+
+  atomicadd((uint*)&ready, 1);
+  while(!go)
+    pause();
+  cur->run(id);
+  exit();
+}
+
+static void
+bench(struct test *t, int n)
+{
+  int pids[NTHREAD], i, t0, t1;
+  uint sum;
+
+  cur = t;
+  nthread = n;
+  ready = go = stop = 0;
+  counter = 0;
+  spinlock = 0;
+  lock_init(&lock);
+  mutex_init(&mutex);
+  turn = 0;
+  for(i = 0; i < n; i++){
+    ops[i].n = 0;
+    if((pids[i] = thread_create(worker, (void*)i)) < 0){
+      printf(1, "lockbench: thread_create failed\n");
+      stop = go = 1;
+      n = i;
+      break;
+    }
+  }
+  while(ready < n)
+    sleep(1);
+  t0 = uptime();
+  go = 1;
+  sleep(RUNTICKS);
+  stop = 1;
+  t1 = uptime();
+  if(t->run == cv){
+    lock_acquire(&lock);
+    for(i = 0; i < n; i++)
+      cv_signal(&turncv[i]);
+    lock_release(&lock);
+  }
+  sum = 0;
+  for(i = 0; i < n; i++){
+    thread_join(pids[i]);
+    sum += ops[i].n;
+  }
+  if(n < nthread)
+    return;
+  if(sum != counter){
+    printf(1, "%s %d: counted %d, counter %d\n", t->name, n, sum, counter);
+    return;
+  }
+  if(t1 <= t0)
+    t1 = t0 + 1;
+  printf(1, "%s %d %d %d\n", t->name, n, sum / (t1 - t0) * TICKHZ,
+         sum / (t1 - t0) * TICKHZ / n);
+}
+
+static void
+usage(void)
+{
+  int i;
+
+  printf(2, "usage: lockbench [-t maxthreads] [test ...]\ntests:");
+  for(i = 0; i < NTEST; i++)
+    printf(2, " %s", tests[i].name);
+  printf(2, "\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, k, n, max;
+
+  max = NTHREAD;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-t") == 0){
+    max = atoi(argv[2]);
+    i = 3;
+  }
+  if(max < 1 || max > NTHREAD)
+    usage();
+  for(j = i; j < argc; j++){
+    for(k = 0; k < NTEST; k++)
+      if(strcmp(argv[j], tests[k].name) == 0)
+        break;
+    if(k == NTEST)
+      usage();
+  }
+
+  printf(1, "TEST THREADS OPS/S OPS/S/THREAD\n");
+  for(k = 0; k < NTEST; k++){
+    if(i < argc){
+      for(j = i; j < argc; j++)
+        if(strcmp(argv[j], tests[k].name) == 0)
+          break;
+      if(j == argc)
+        continue;
+    }
+    for(n = 1; n <= max; n *= 2)
+      bench(&tests[k], n);
+  }
+  exit();
+}
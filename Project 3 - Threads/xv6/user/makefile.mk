@@ -36,6 +36,32 @@ USER_PROGS := \
 	cond\
 	cond2\
 	cond3\
+	cond4\
+	futex\
+	mutex\
+	rwlock\
+	sbrkrace\
+	tstack\
+	groupexit\
+	tls\
+	tpool\
+	gthreads\
+	malloctest\
+	heaptest\
+	shrinktest\
+	vforktest\
+	sharedfd\
+	closerace\
+	procbench\
+	lockbench\
+	stride\
+	gang\
+	yieldto\
+	rtprio\
+	barrier\
+	mpmc\
+	joinany\
+	cpus\
 
 USER_PROGS := $(addprefix user/, $(USER_PROGS))
 
@@ -49,7 +75,8 @@ USER_LIBS := \
 
 USER_LIBS := $(addprefix user/, $(USER_LIBS))
 
-USER_OBJECTS = $(USER_PROGS:%=%.o) $(USER_LIBS)
+USER_OBJECTS = $(USER_PROGS:%=%.o) $(USER_LIBS) user/threadpool.o \
+	user/green.o user/gswtch.o user/mpmcq.o
 
 USER_DEPS := $(USER_OBJECTS:.o=.d)
 
@@ -107,6 +134,20 @@ user/bin/%: user/%.o $(USER_LIBS) | user/bin
 user/bin/forktest: user/forktest.o user/ulib.o user/usys.o | user/bin
 	$(LD) $(LDFLAGS) $(USER_LDFLAGS) --output=$@ $^
 
+# threadpool.c is linked in only where it is used, to keep the
+# file system image small.
+user/bin/tpool: user/tpool.o user/threadpool.o $(USER_LIBS) | user/bin
+	$(LD) $(LDFLAGS) $(USER_LDFLAGS) --output=$@ $^
+
+user/bin/cpus: user/cpus.o user/threadpool.o $(USER_LIBS) | user/bin
+	$(LD) $(LDFLAGS) $(USER_LDFLAGS) --output=$@ $^
+
+user/bin/gthreads: user/gthreads.o user/green.o user/gswtch.o $(USER_LIBS) | user/bin
+	$(LD) $(LDFLAGS) $(USER_LDFLAGS) --output=$@ $^
+
+user/bin/mpmc: user/mpmc.o user/mpmcq.o $(USER_LIBS) | user/bin
+	$(LD) $(LDFLAGS) $(USER_LDFLAGS) --output=$@ $^
+
 # default recipe for object files
 user/%.o: user/%.c
 	$(CC) $(CPPFLAGS) $(USER_CPPFLAGS) $(CFLAGS) $(USER_CFLAGS) -c -o $@ $<
@@ -0,0 +1,92 @@
+/* threads calling malloc and free at once never share a block */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define NLIVE 16
+
+int ppid;
+int num_threads = 6;
+int loops = 300;
+uint sizes[] = { 1, 8, 24, 100, 500, 2000, 5000 };
+char *handoff[6];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+void check(char *p, uint n, int c);
+
+int
+main(int argc, char *argv[])
+{
+   int i, pids[6], ids[6];
+   ppid = getpid();
+
+   for (i = 0; i < num_threads; i++) {
+      ids[i] = i;
+      pids[i] = thread_create(worker, &ids[i]);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+
+   // Blocks one thread left behind can be freed by another.
+   for (i = 0; i < num_threads; i++) {
+      check(handoff[i], 100, 'a' + i);
+      free(handoff[i]);
+   }
+   free(NULL);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   int i, j, id;
+   uint seed;
+   char *live[NLIVE];
+   uint n[NLIVE];
+
+   id = *(int*)arg_ptr;
+   seed = id + 1;
+   memset(live, 0, sizeof(live));
+   for (i = 0; i < loops; i++) {
+      seed = seed * 1103515245 + 12345;
+      j = (seed >> 16) % NLIVE;
+      if (live[j]) {
+         check(live[j], n[j], id + j);
+         free(live[j]);
+      }
+      n[j] = sizes[(seed >> 8) % (sizeof(sizes)/sizeof(sizes[0]))];
+      live[j] = malloc(n[j]);
+      assert(live[j] != NULL);
+      memset(live[j], id + j, n[j]);
+   }
+   for (j = 0; j < NLIVE; j++)
+      if (live[j]) {
+         check(live[j], n[j], id + j);
+         free(live[j]);
+      }
+
+   handoff[id] = malloc(100);
+   assert(handoff[id] != NULL);
+   memset(handoff[id], 'a' + id, 100);
+   exit();
+}
+
+void
+check(char *p, uint n, int c) {
+   uint i;
+
+   for (i = 0; i < n; i++)
+      assert(p[i] == (char)c);
+}
@@ -0,0 +1,108 @@
+/* the lock-free queue of mpmcq.c is FIFO, reports full and empty,
+ * and loses and duplicates nothing with several producers and
+ * consumers at once */
+#include "types.h"
+#include "user.h"
+#include "atomic.h"
+
+#define NPROD 3
+#define NCONS 3
+#define NITEM 3000
+
+int ppid;
+struct mpmcq *q;
+volatile uint popped, total;
+volatile uint seen[NPROD][NITEM];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+producer(void *arg)
+{
+   int me = (int)arg;
+   int i;
+
+   for (i = 0; i < NITEM; i++)
+      while (mpmcq_push(q, (void*)(me << 16 | i)) < 0)
+         cpu_relax();
+   exit();
+}
+
+// Each producer's items reach any one consumer in order.
+void
+consumer(void *arg)
+{
+   int last[NPROD], i, p;
+   void *v;
+
+   for (i = 0; i < NPROD; i++)
+      last[i] = -1;
+   while (atomic_load(&popped) < NPROD*NITEM) {
+      if (mpmcq_pop(q, &v) < 0) {
+         cpu_relax();
+         continue;
+      }
+      p = (uint)v >> 16;
+      i = (uint)v & 0xffff;
+      assert(p < NPROD && i < NITEM);
+      assert(i > last[p]);
+      last[p] = i;
+      assert(atomic_fetch_add(&seen[p][i], 1) == 0);
+      atomic_fetch_add(&total, i);
+      atomic_fetch_add(&popped, 1);
+   }
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, tid[NPROD + NCONS];
+   uint x;
+   void *v;
+   ppid = getpid();
+
+   // The atomics.
+   x = 5;
+   assert(atomic_cas(&x, 4, 9) == 5 && x == 5);
+   assert(atomic_cas(&x, 5, 9) == 5 && x == 9);
+   assert(atomic_fetch_add(&x, 3) == 9 && x == 12);
+   assert(atomic_xchg(&x, 1) == 12 && x == 1);
+   mfence();
+
+   // One thread.
+   assert(mpmcq_create(3) == 0);
+   q = mpmcq_create(4);
+   assert(q != 0);
+   assert(mpmcq_pop(q, &v) < 0);
+   for (i = 0; i < 4; i++)
+      assert(mpmcq_push(q, (void*)i) == 0);
+   assert(mpmcq_push(q, (void*)4) < 0);
+   for (i = 0; i < 4; i++)
+      assert(mpmcq_pop(q, &v) == 0 && (int)v == i);
+   assert(mpmcq_pop(q, &v) < 0);
+   mpmcq_destroy(q);
+
+   // Many.
+   q = mpmcq_create(64);
+   assert(q != 0);
+   for (i = 0; i < NPROD + NCONS; i++) {
+      tid[i] = thread_create(i < NPROD ? producer : consumer, (void*)i);
+      assert(tid[i] > 0);
+   }
+   for (i = 0; i < NPROD + NCONS; i++)
+      assert(thread_join(tid[i]) == tid[i]);
+   assert(popped == NPROD*NITEM);
+   assert(total == NPROD*(NITEM*(NITEM-1)/2));
+   assert(mpmcq_pop(q, &v) < 0);
+   mpmcq_destroy(q);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,109 @@
+// Bounded lock-free queue for many producers and many consumers.
+//
+// This is Vyukov's array queue.  Each slot has a sequence number
+// that says whose turn it is: a slot at position pos (counting
+// from 0 forever, modulo the size) is free for the producer of
+// pos when seq == pos, and full for the consumer of pos when
+// seq == pos + 1.  A producer claims pos by moving tail past it
+// with a cmpxchg, stores the value, and then sets seq; the
+// consumer does the same with head, and leaves seq at pos + size
+// for the producer a lap later.  So neither side ever waits on a
+// lock, and the two ends touch different words except when the
+// queue is nearly empty or full.
+
+#include "types.h"
+#include "user.h"
+#include "atomic.h"
+
+struct slot {
+  volatile uint seq;
+  void *v;
+};
+
+struct mpmcq {
+  volatile uint tail;  // Next position to push to
+  char pad0[60];       // Keep the ends on their own cache lines
+  volatile uint head;  // Next position to pop from
+  char pad1[60];
+  uint mask;           // Slots - 1
+  struct slot s[];
+};
+
+// A queue with room for n values, n a power of two, or 0.
+struct mpmcq*
+mpmcq_create(uint n)
+{
+  struct mpmcq *q;
+  uint i;
+
+  if(n == 0 || (n & (n - 1)) != 0)
+    return 0;
+  if((q = malloc(sizeof(*q) + n*sizeof(struct slot))) == 0)
+    return 0;
+  q->tail = q->head = 0;
+  q->mask = n - 1;
+  for(i = 0; i < n; i++)
+    q->s[i].seq = i;
+  return q;
+}
+
+void
+mpmcq_destroy(struct mpmcq *q)
+{
+  free(q);
+}
+
+// Add v at the tail.  Returns 0, or -1 if the queue is full.
+int
+mpmcq_push(struct mpmcq *q, void *v)
+{
+  struct slot *s;
+  uint pos;
+  int d;
+
+  pos = atomic_load(&q->tail);
+  for(;;){
+    s = &q->s[pos & q->mask];
+    d = (int)(atomic_load(&s->seq) - pos);
+    if(d == 0){
+      if(atomic_cas(&q->tail, pos, pos + 1) == pos)
+        break;
+      pos = atomic_load(&q->tail);
+    } else if(d < 0){
+      return -1;  // a lap behind: full
+    } else {
+      pos = atomic_load(&q->tail);
+    }
+  }
+  s->v = v;
+  atomic_store(&s->seq, pos + 1);
+  return 0;
+}
+
+// Take the value at the head into *v.  Returns 0, or -1 if the
+// queue is empty.
+int
+mpmcq_pop(struct mpmcq *q, void **v)
+{
+  struct slot *s;
+  uint pos;
+  int d;
+
+  pos = atomic_load(&q->head);
+  for(;;){
+    s = &q->s[pos & q->mask];
+    d = (int)(atomic_load(&s->seq) - (pos + 1));
+    if(d == 0){
+      if(atomic_cas(&q->head, pos, pos + 1) == pos)
+        break;
+      pos = atomic_load(&q->head);
+    } else if(d < 0){
+      return -1;  // not yet pushed: empty
+    } else {
+      pos = atomic_load(&q->head);
+    }
+  }
+  *v = s->v;
+  atomic_store(&s->seq, pos + q->mask + 1);
+  return 0;
+}
@@ -0,0 +1,253 @@
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+
+// Process and thread lifecycle microbenchmarks.
+//
+//   procbench [-n iterations] [test ...]
+//
+// Each test times n iterations one at a time with rdtsc and prints
+// the minimum, median and 99th percentile, in TSC cycles:
+//
+//   fork       fork, child exits, parent waits
+//   vfork      the same with vfork
+//   forkexec   fork, child execs procbench -x, which exits, wait
+//   vforkexec  the same with vfork
+//   clone      clone a thread that exits, join it
+//   thread     thread_create and thread_join
+//   pingpong   one byte to a child and back over two pipes, which
+//              is two context switches
+//
+// The default is all of them, NDEFAULT iterations each.
+
+#define PGSIZE   4096
+#define NDEFAULT 200
+#define NMAX     2000
+
+struct test {
+  char *name;
+  int (*run)(uint*, int);
+};
+
+static char *self;
+static uint samples[NMAX];
+static char stack[2*PGSIZE];
+
+static int
+bfork(uint *s, int n)
+{
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = fork()) < 0)
+      return -1;
+    if(pid == 0)
+      exit();
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+  return 0;
+}
+
+static int
+bvfork(uint *s, int n)
+{
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = vfork()) < 0)
+      return -1;
+    if(pid == 0)
+      exit();
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+  return 0;
+}
+
+static int
+runexec(uint *s, int n, int (*forkfn)(void))
+{
+  char *argv[] = { self, "-x", 0 };
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = forkfn()) < 0)
+      return -1;
+    if(pid == 0){
+      exec(self, argv);
+      exit();
+    }
+    wait();
+    s[i] = rdtsc() - t0;
+  }
+  return 0;
+}
+
+static int
+bforkexec(uint *s, int n)
+{
+  return runexec(s, n, fork);
+}
+
+static int
+bvforkexec(uint *s, int n)
+{
+  return runexec(s, n, vfork);
+}
+
+static void
+quit(void *arg)
+{
+  exit();
+}
+
+static int
+bclone(uint *s, int n)
+{
+  uint64 t0;
+  char *stk;
+  int i, pid;
+
+  stk = stack + PGSIZE - (uint)stack % PGSIZE;
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = clone(quit, 0, stk)) < 0 || join(pid) != pid)
+      return -1;
+    s[i] = rdtsc() - t0;
+  }
+  return 0;
+}
+
+static int
+bthread(uint *s, int n)
+{
+  uint64 t0;
+  int i, pid;
+
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if((pid = thread_create(quit, 0)) < 0 || thread_join(pid) != pid)
+      return -1;
+    s[i] = rdtsc() - t0;
+  }
+  return 0;
+}
+
+static int
+bpingpong(uint *s, int n)
+{
+  int to[2], from[2], i, pid;
+  uint64 t0;
+  char c;
+
+  if(pipe(to) < 0 || pipe(from) < 0)
+    return -1;
+  if((pid = fork()) < 0)
+    return -1;
+  if(pid == 0){
+    close(to[1]);
+    close(from[0]);
+    while(read(to[0], &c, 1) == 1)
+      write(from[1], &c, 1);
+    exit();
+  }
+  close(to[0]);
+  close(from[1]);
+  for(i = 0; i < n; i++){
+    t0 = rdtsc();
+    if(write(to[1], &c, 1) != 1 || read(from[0], &c, 1) != 1)
+      break;
+    s[i] = rdtsc() - t0;
+  }
+  close(to[1]);
+  close(from[0]);
+  wait();
+  return i == n ? 0 : -1;
+}
+
+static struct test tests[] = {
+  { "fork",      bfork },
+  { "vfork",     bvfork },
+  { "forkexec",  bforkexec },
+  { "vforkexec", bvforkexec },
+  { "clone",     bclone },
+  { "thread",    bthread },
+  { "pingpong",  bpingpong },
+};
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+static void
+bench(struct test *t, int n)
+{
+  int i, j;
+  uint x;
+
+  if(t->run(samples, n) < 0){
+    printf(1, "%s failed\n", t->name);
+    return;
+  }
+  for(i = 1; i < n; i++){
+    x = samples[i];
+    for(j = i; j > 0 && samples[j-1] > x; j--)
+      samples[j] = samples[j-1];
+    samples[j] = x;
+  }
+  printf(1, "%s %d %d %d\n", t->name, samples[0], samples[n/2], samples[n*99/100]);
+}
+
+static void
+usage(void)
+{
+  int i;
+
+  printf(2, "usage: procbench [-n iterations] [test ...]\ntests:");
+  for(i = 0; i < NTEST; i++)
+    printf(2, " %s", tests[i].name);
+  printf(2, "\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, j, k, n;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit();
+  self = argv[0];
+  n = NDEFAULT;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-n") == 0){
+    n = atoi(argv[2]);
+    i = 3;
+  }
+  if(n < 1 || n > NMAX)
+    usage();
+  for(j = i; j < argc; j++){
+    for(k = 0; k < NTEST; k++)
+      if(strcmp(argv[j], tests[k].name) == 0)
+        break;
+    if(k == NTEST)
+      usage();
+  }
+
+  printf(1, "TEST MIN MEDIAN P99 (TSC cycles, %d runs)\n", n);
+  for(k = 0; k < NTEST; k++){
+    if(i < argc){
+      for(j = i; j < argc; j++)
+        if(strcmp(argv[j], tests[k].name) == 0)
+          break;
+      if(j == argc)
+        continue;
+    }
+    bench(&tests[k], n);
+  }
+  exit();
+}
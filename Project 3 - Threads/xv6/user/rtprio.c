@@ -0,0 +1,130 @@
+/* real-time threads run ahead of everything else: one waking from
+ * sleep runs at once though hogs fill the CPUs, and one waiting on
+ * a mutex held by a normal thread lends it its priority, so hogs of
+ * middling priority can't hold it up */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+#define NHOG 4
+#define HOGTICKS 100
+
+int ppid;
+mutex_t m;
+volatile int held, hogsup;
+volatile int waited;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Fork NHOG processes that spin until tick end.
+void
+hogs(int end)
+{
+   int i, pid;
+
+   for (i = 0; i < NHOG; i++) {
+      pid = fork();
+      assert(pid >= 0);
+      if (pid == 0) {
+         while (uptime() < end)
+            ;
+         exit();
+      }
+   }
+}
+
+// Normal priority: hold m for 5 ticks, once the hogs are up.
+void
+low(void *arg)
+{
+   int t;
+
+   mutex_lock(&m);
+   held = 1;
+   while (!hogsup)
+      ;
+   t = uptime();
+   while (uptime() < t + 5)
+      ;
+   mutex_unlock(&m);
+   exit();
+}
+
+void
+high(void *arg)
+{
+   int t;
+
+   assert(setrtprio(20) == 0);
+   while (!hogsup)
+      sleep(1);
+   t = uptime();
+   mutex_lock(&m);
+   waited = uptime() - t;
+   mutex_unlock(&m);
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, t, d, worst, l, h;
+   ppid = getpid();
+
+   assert(setrtprio(-1) == -1);
+   assert(setrtprio(MAXRTPRIO + 1) == -1);
+   assert(setrtprio(5) == 0);
+   assert(setrtprio(0) == 5);
+
+   // Wakeup latency among normal hogs.
+   if (fork() == 0) {
+      hogs(uptime() + HOGTICKS);
+      assert(setrtprio(30) == 0);
+      worst = 0;
+      for (i = 0; i < 20; i++) {
+         t = uptime();
+         sleep(1);
+         d = uptime() - t;
+         if (d > worst)
+            worst = d;
+      }
+      printf(1, "rtprio: worst wakeup %d ticks\n", worst);
+      assert(worst <= 2);
+      for (i = 0; i < NHOG; i++)
+         assert(wait() > 0);
+      exit();
+   }
+   assert(wait() > 0);
+
+   // Priority inheritance through a mutex.
+   if (fork() == 0) {
+      mutex_init(&m);
+      l = thread_create(low, 0);
+      assert(l > 0);
+      while (!held)
+         ;
+      h = thread_create(high, 0);
+      assert(h > 0);
+      assert(setrtprio(10) == 0);
+      hogs(uptime() + HOGTICKS);
+      hogsup = 1;
+      assert(setrtprio(0) == 10);
+      assert(thread_join(h) == h);
+      assert(thread_join(l) == l);
+      for (i = 0; i < NHOG; i++)
+         assert(wait() > 0);
+      printf(1, "rtprio: waited %d ticks for the mutex\n", waited);
+      assert(waited < HOGTICKS / 2);
+      exit();
+   }
+   assert(wait() > 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
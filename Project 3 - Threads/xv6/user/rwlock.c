@@ -0,0 +1,92 @@
+/* rwlock_rdlock is shared among readers, rwlock_wrlock is exclusive */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+int ppid;
+rwlock_t rw;
+int global = 0;
+volatile int inside = 0;
+volatile int maxinside = 0;
+int num_readers = 4;
+int num_writers = 4;
+int loops = 10;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void reader(void *arg_ptr);
+void writer(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, pids[8];
+   ppid = getpid();
+
+   rwlock_init(&rw);
+   rwlock_rdlock(&rw);
+   rwlock_rdlock(&rw);
+   assert(rw.readers == 2 && rw.writer == 0);
+   rwlock_unlock(&rw);
+   rwlock_unlock(&rw);
+   rwlock_wrlock(&rw);
+   assert(rw.readers == 0 && rw.writer == 1);
+   rwlock_unlock(&rw);
+
+   for (i = 0; i < num_readers; i++) {
+      pids[i] = thread_create(reader, NULL);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_writers; i++) {
+      pids[num_readers + i] = thread_create(writer, NULL);
+      assert(pids[num_readers + i] > 0);
+   }
+   for (i = 0; i < num_readers + num_writers; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+
+   assert(global == num_writers * loops);
+   // Readers sleep holding rw, so they must have overlapped.
+   assert(maxinside > 1);
+   assert(rw.readers == 0 && rw.writer == 0 && rw.writerswaiting == 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+reader(void *arg_ptr) {
+   int i, n;
+   for (i = 0; i < loops; i++) {
+      rwlock_rdlock(&rw);
+      n = __sync_add_and_fetch(&inside, 1);
+      if (n > maxinside)
+         maxinside = n;
+      sleep(2);
+      __sync_sub_and_fetch(&inside, 1);
+      rwlock_unlock(&rw);
+   }
+   exit();
+}
+
+void
+writer(void *arg_ptr) {
+   int i, tmp;
+   for (i = 0; i < loops; i++) {
+      rwlock_wrlock(&rw);
+      // No reader is inside while a writer holds rw.
+      assert(inside == 0);
+      tmp = global;
+      sleep(1);
+      global = tmp + 1;
+      rwlock_unlock(&rw);
+   }
+   exit();
+}
@@ -0,0 +1,88 @@
+/* threads growing the address space at once get disjoint memory */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define PGSIZE (4096)
+
+int ppid;
+int num_threads = 8;
+int loops = 20;
+char *pages[8][20];
+int fds[2];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+void idle(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, j, k, l, pids[8], ids[8];
+   char *start, *end;
+   ppid = getpid();
+
+   assert(pipe(fds) == 0);
+   // Make the stacks first; reusing them takes no memory.
+   for (i = 0; i < num_threads; i++)
+      pids[i] = thread_create(idle, NULL);
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+
+   start = sbrk(0);
+   for (i = 0; i < num_threads; i++) {
+      ids[i] = i;
+      pids[i] = thread_create(worker, &ids[i]);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+
+   // No page was handed out twice, and every one kept its data.
+   // A thread stack taken from the heap may lie among them.
+   end = sbrk(0);
+   assert(end >= start + num_threads * loops * PGSIZE);
+   for (i = 0; i < num_threads; i++)
+      for (j = 0; j < loops; j++) {
+         assert(pages[i][j] >= start && pages[i][j] + PGSIZE <= end);
+         assert(pages[i][j][0] == i && pages[i][j][PGSIZE-1] == j);
+         for (k = i; k < num_threads; k++)
+            for (l = k == i ? j + 1 : 0; l < loops; l++)
+               assert(pages[k][l] != pages[i][j]);
+      }
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   int i, id;
+   char *p;
+
+   id = *(int*)arg_ptr;
+   for (i = 0; i < loops; i++) {
+      p = sbrk(PGSIZE);
+      assert(p != (char*)-1);
+      p[0] = id;
+      p[PGSIZE-1] = i;
+      pages[id][i] = p;
+      // The kernel takes any of it, whichever thread grew it.
+      assert(write(fds[1], sbrk(0) - 1, 1) == 1);
+   }
+   exit();
+}
+
+void
+idle(void *arg_ptr) {
+   exit();
+}
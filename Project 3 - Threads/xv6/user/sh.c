@@ -53,6 +53,20 @@ int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
 
+// Will cmd's process go straight to exec?
+int
+simple(struct cmd *cmd)
+{
+  while(cmd && cmd->type == REDIR)
+    cmd = ((struct redircmd*)cmd)->cmd;
+  return cmd && cmd->type == EXEC;
+}
+
+// Fork to run cmd, by vfork if it will exec at once, sparing
+// the copy of the shell its child would throw away.  A macro,
+// because a vfork child mustn't return from vfork's caller.
+#define forkcmd(cmd) (simple(cmd) ? vfork() : fork1())
+
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
@@ -91,7 +105,7 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
+    if(forkcmd(lcmd->left) == 0)
       runcmd(lcmd->left);
     wait();
     runcmd(lcmd->right);
@@ -101,14 +115,14 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
+    if(forkcmd(pcmd->left) == 0){
       close(1);
       dup(p[1]);
       close(p[0]);
       close(p[1]);
       runcmd(pcmd->left);
     }
-    if(fork1() == 0){
+    if(forkcmd(pcmd->right) == 0){
       close(0);
       dup(p[0]);
       close(p[0]);
@@ -123,7 +137,7 @@ runcmd(struct cmd *cmd)
     
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
+    if(forkcmd(bcmd->cmd) == 0)
       runcmd(bcmd->cmd);
     break;
   }
@@ -145,6 +159,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct cmd *cmd;
   int fd;
   
   // Assumes three file descriptors open.
@@ -165,8 +180,9 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
+    cmd = parsecmd(buf);
+    if(forkcmd(cmd) == 0)
+      runcmd(cmd);
     wait();
   }
   exit();
@@ -0,0 +1,82 @@
+/* threads share one file table and current directory: an fd
+ * opened, or a chdir made, by one thread is seen by the others,
+ * and an fd closed by one is closed for all */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+int ppid;
+volatile int fd = -1;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+opener(void *arg_ptr)
+{
+   fd = open("sharedfd.tmp", O_CREATE | O_RDWR);
+   assert(fd >= 0);
+   assert(write(fd, "hi", 2) == 2);
+   assert(chdir("sharedfd.dir") == 0);
+   exit();
+}
+
+void
+closer(void *arg_ptr)
+{
+   assert(close(fd) == 0);
+   exit();
+}
+
+void
+quitter(void *arg_ptr)
+{
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int tid, p[2];
+   char buf[2];
+
+   ppid = getpid();
+   assert(mkdir("sharedfd.dir") == 0);
+
+   tid = thread_create(opener, NULL);
+   assert(tid > 0);
+   assert(thread_join(tid) == tid);
+
+   // The thread's open and chdir outlive it.
+   assert(fd >= 0);
+   assert(write(fd, "!", 1) == 1);
+   assert(open("sharedfd.tmp", O_RDONLY) < 0);
+   assert(chdir("..") == 0);
+   assert(open("sharedfd.dir/sharedfd.tmp", O_RDONLY) >= 0);
+
+   tid = thread_create(closer, NULL);
+   assert(tid > 0);
+   assert(thread_join(tid) == tid);
+   assert(write(fd, "!", 1) < 0);
+
+   // A thread's exit doesn't close anything.
+   assert(pipe(p) == 0);
+   tid = thread_create(quitter, NULL);
+   assert(tid > 0);
+   assert(thread_join(tid) == tid);
+   assert(write(p[1], "ok", 2) == 2);
+   assert(read(p[0], buf, 2) == 2 && buf[0] == 'o');
+
+   assert(unlink("sharedfd.dir/sharedfd.tmp") == 0);
+   assert(unlink("sharedfd.dir") == 0);
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,96 @@
+/* sbrk(-n) while other threads write the heap leaves them no stale pages */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define PGSIZE (4096)
+#define NPAGES 100
+
+int ppid;
+int num_threads = 3;
+volatile int done;
+volatile char *top;
+volatile int seen[3];
+volatile uint gen[3];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+void quiesce(void);
+
+int
+main(int argc, char *argv[])
+{
+   int i, j, pids[3], ids[3];
+   char *p;
+   ppid = getpid();
+
+   for (i = 0; i < num_threads; i++) {
+      ids[i] = i;
+      pids[i] = thread_create(worker, &ids[i]);
+      assert(pids[i] > 0);
+   }
+
+   // Each round the new pages come back zeroed, even though the
+   // workers wrote the old ones up to the shrink.
+   for (i = 0; i < 50; i++) {
+      p = sbrk(NPAGES * PGSIZE);
+      assert(p != (char*)-1);
+      for (j = 0; j < NPAGES; j++)
+         assert(p[j * PGSIZE] == 0 && p[j * PGSIZE + 1] == 0);
+      for (j = 0; j < NPAGES; j++)
+         p[j * PGSIZE] = 'a' + i % 26;
+      top = p;
+      sleep(1);
+      top = NULL;
+      quiesce();
+      assert(sbrk(-NPAGES * PGSIZE) != (char*)-1);
+   }
+   assert(sbrk(-(int)(uint)sbrk(0)) == (char*)-1);
+
+   done = 1;
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+   for (i = 0; i < num_threads; i++)
+      assert(seen[i] > 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   volatile char *p;
+   int id;
+
+   id = *(int*)arg_ptr;
+   while (!done) {
+      if ((p = top) != NULL) {
+         p[id * PGSIZE + 1] = 'w';
+         seen[id]++;
+      }
+      gen[id]++;
+   }
+   exit();
+}
+
+// Wait until no worker can still be using the last top.
+void
+quiesce(void) {
+   uint g[3];
+   int i;
+
+   for (i = 0; i < num_threads; i++)
+      g[i] = gen[i];
+   for (i = 0; i < num_threads; i++)
+      while (gen[i] - g[i] < 2)
+         ;
+}
@@ -0,0 +1,103 @@
+/* settickets shares the CPU between processes by their tickets,
+ * however many threads each runs */
+#include "types.h"
+#include "user.h"
+
+#define NTHREAD 8
+#define RUNTICKS 100
+
+int ppid;
+volatile int go, stop;
+volatile uint count[NTHREAD];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+spin(void *arg)
+{
+   int i = (int)arg;
+
+   while (!go)
+      ;
+   while (!stop)
+      count[i]++;
+   exit();
+}
+
+// Fork a process with tickets that spins in nthread threads
+// once a byte comes down start, and writes how far it got to
+// done.
+void
+spinner(int tickets, int nthread, int start, int done)
+{
+   int i, pid[NTHREAD];
+   uint total;
+   char c;
+
+   if (fork() != 0)
+      return;
+   assert(settickets(tickets) == 0);
+   for (i = 0; i < nthread; i++)
+      assert((pid[i] = thread_create(spin, (void*)i)) > 0);
+   assert(read(start, &c, 1) == 1);
+   go = 1;
+   sleep(RUNTICKS);
+   stop = 1;
+   total = 0;
+   for (i = 0; i < nthread; i++) {
+      assert(thread_join(pid[i]) == pid[i]);
+      total += count[i];
+   }
+   assert(write(done, &total, sizeof(total)) == sizeof(total));
+   exit();
+}
+
+// Run two spinners at once; their counts go in a and b.
+void
+race(int ta, int na, int tb, int nb, uint *a, uint *b)
+{
+   int start[2], da[2], db[2];
+
+   assert(pipe(start) == 0 && pipe(da) == 0 && pipe(db) == 0);
+   spinner(ta, na, start[0], da[1]);
+   spinner(tb, nb, start[0], db[1]);
+   assert(write(start[1], "gg", 2) == 2);
+   assert(read(da[0], a, sizeof(*a)) == sizeof(*a));
+   assert(read(db[0], b, sizeof(*b)) == sizeof(*b));
+   assert(wait() > 0 && wait() > 0);
+   close(start[0]); close(start[1]);
+   close(da[0]); close(da[1]);
+   close(db[0]); close(db[1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+   uint a, b;
+   ppid = getpid();
+
+   assert(settickets(0) == -1);
+   assert(settickets(10001) == -1);
+   assert(settickets(100) == 0);
+
+   // Equal tickets: many threads don't buy a bigger share.
+   race(100, NTHREAD, 100, 1, &a, &b);
+   printf(1, "stride: %d threads %d, 1 thread %d\n", NTHREAD, a, b);
+   assert(a > 0 && b > 0);
+   assert(a < 3 * b);
+
+   // Three times the tickets, about three times the CPU.
+   race(100, NTHREAD, 300, NTHREAD, &a, &b);
+   printf(1, "stride: 100 tickets %d, 300 tickets %d\n", a, b);
+   assert(a > 0 && b > 0);
+   assert(2 * b > 3 * a);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
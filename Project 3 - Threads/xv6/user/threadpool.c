@@ -0,0 +1,303 @@
+// Work-stealing thread pool on top of thread_create/thread_join.
+//
+// A pool has a fixed set of worker threads, each owning a
+// Chase-Lev deque of tasks.  A task submitted by a worker goes on
+// the bottom of its own deque, which only it pushes and pops; a
+// worker whose deque is empty steals from the top of the others'.
+// Tasks submitted from outside the pool go on a shared, locked
+// queue.  Workers with nothing to run or steal sleep in cv_wait
+// until work is submitted.
+//
+// Tasks are kept by value, so running one allocates nothing.  When
+// a deque or the shared queue is full, the submitter runs the
+// task itself.
+
+#include "types.h"
+#include "user.h"
+#include "x86.h"
+#include "sysinfo.h"
+
+#define TP_MAXWORKERS 8
+#define DEQSIZE 256  // tasks per deque, a power of two
+#define INJSIZE 256  // tasks on the shared queue
+
+struct task {
+  void (*fcn)(void*);
+  void *arg;
+};
+
+// Chase-Lev deque.  top and bottom only grow; the tasks are the
+// slots [top, bottom) of t[], modulo DEQSIZE.
+struct deque {
+  volatile int top;     // Taken from by thieves, with cmpxchg
+  volatile int bottom;  // Pushed to and popped by the owner
+  struct task t[DEQSIZE];
+};
+
+struct worker {
+  struct deque dq;
+  struct threadpool *pool;
+  char *tls;            // Its thread_tls(), to tell who is calling
+  int pid;
+  int steals;           // Tasks taken from other workers
+};
+
+struct threadpool {
+  struct worker w[TP_MAXWORKERS];
+  int n;
+  volatile int queued;      // Tasks on deques or the shared queue
+  volatile int unfinished;  // Tasks submitted and not yet done
+  volatile int idle;        // Workers asleep or about to be
+  int stop;
+  lock_t lock;              // Guards the shared queue and sleeping
+  cond_t work;              // Idle workers wait here
+  cond_t done;              // threadpool_wait waits here
+  int injhead, injtail;
+  struct task inj[INJSIZE];
+};
+
+// Push t on the bottom of d.  Only d's owner calls this.
+static int
+dqpush(struct deque *d, struct task *t)
+{
+  int b;
+
+  b = d->bottom;
+  if(b - d->top >= DEQSIZE)
+    return -1;
+  d->t[b & (DEQSIZE-1)] = *t;
+  asm volatile("" ::: "memory");  // the task before the new bottom
+  d->bottom = b + 1;
+  return 0;
+}
+
+// Pop the bottom task of d into *t.  Only d's owner calls this.
+// Returns 0 if d is empty.
+static int
+dqpop(struct deque *d, struct task *t)
+{
+  int b, top;
+
+  b = d->bottom - 1;
+  d->bottom = b;
+  // The new bottom must be seen before top is read, or a thief
+  // and the owner could both take the last task.
+  __sync_synchronize();
+  top = d->top;
+  if(top > b){
+    d->bottom = b + 1;
+    return 0;
+  }
+  *t = d->t[b & (DEQSIZE-1)];
+  if(top < b)
+    return 1;
+  // The last task: race the thieves for it.
+  b = cmpxchg((volatile uint*)&d->top, top, top + 1) == top;
+  d->bottom = top + 1;
+  return b;
+}
+
+// Steal the top task of d into *t.  Returns 0 if d is empty,
+// -1 if another thread took it first.
+static int
+dqsteal(struct deque *d, struct task *t)
+{
+  int top;
+
+  top = d->top;
+  asm volatile("" ::: "memory");  // top before bottom
+  if(top >= d->bottom)
+    return 0;
+  *t = d->t[top & (DEQSIZE-1)];
+  if(cmpxchg((volatile uint*)&d->top, top, top + 1) != top)
+    return -1;
+  return 1;
+}
+
+// The calling thread's worker in pool, or 0 if it isn't one.
+static struct worker*
+self(struct threadpool *pool)
+{
+  char *tls;
+  int i;
+
+  tls = thread_tls();
+  for(i = 0; i < pool->n; i++)
+    if(pool->w[i].tls == tls)
+      return &pool->w[i];
+  return 0;
+}
+
+// Find a task for w: its own, a stolen one or a submitted one.
+static int
+findtask(struct worker *w, struct task *t)
+{
+  struct threadpool *pool = w->pool;
+  int i, r, again;
+
+  if(dqpop(&w->dq, t))
+    return 1;
+  do {
+    again = 0;
+    for(i = 1; i < pool->n; i++){
+      r = dqsteal(&pool->w[(w - pool->w + i) % pool->n].dq, t);
+      if(r > 0){
+        w->steals++;
+        return 1;
+      }
+      if(r < 0)
+        again = 1;
+    }
+  } while(again);
+
+  r = 0;
+  lock_acquire(&pool->lock);
+  if(pool->injhead != pool->injtail){
+    *t = pool->inj[pool->injhead++ % INJSIZE];
+    r = 1;
+  }
+  lock_release(&pool->lock);
+  return r;
+}
+
+static void
+run(struct threadpool *pool, struct task *t)
+{
+  t->fcn(t->arg);
+  if(__sync_sub_and_fetch(&pool->unfinished, 1) == 0){
+    lock_acquire(&pool->lock);
+    cv_broadcast(&pool->done);
+    lock_release(&pool->lock);
+  }
+}
+
+static void
+workerloop(void *arg)
+{
+  struct worker *w = arg;
+  struct threadpool *pool = w->pool;
+  struct task t;
+
+  w->tls = thread_tls();
+  for(;;){
+    if(findtask(w, &t)){
+      __sync_sub_and_fetch(&pool->queued, 1);
+      run(pool, &t);
+      continue;
+    }
+    // Say we are idle before looking at queued; submitters bump
+    // queued before looking at idle, so one of us sees the other.
+    lock_acquire(&pool->lock);
+    __sync_add_and_fetch(&pool->idle, 1);
+    while(pool->queued == 0 && !pool->stop)
+      cv_wait(&pool->work, &pool->lock);
+    __sync_sub_and_fetch(&pool->idle, 1);
+    if(pool->stop && pool->queued == 0){
+      lock_release(&pool->lock);
+      exit();
+    }
+    lock_release(&pool->lock);
+  }
+}
+
+// BEGIN: Create a pool of n worker threads, or with n 0, one per online CPU, up to TP_MAXWORKERS.  Returns 0 if n is out of range or the threads can't be made.
+struct threadpool*
+threadpool_create(int n)
+{
+  struct threadpool *pool;
+  struct sysinfo si;
+  int i;
+
+  if(n == 0 && sysinfo(&si) == 0)
+    n = si.nonline < TP_MAXWORKERS ? si.nonline : TP_MAXWORKERS;
+  if(n < 1 || n > TP_MAXWORKERS)
+    return 0;
+  if((pool = malloc(sizeof(*pool))) == 0)
+    return 0;
+  memset(pool, 0, sizeof(*pool));
+  pool->n = n;
+  for(i = 0; i < n; i++){
+    pool->w[i].pool = pool;
+    if((pool->w[i].pid = thread_create(workerloop, &pool->w[i])) < 0){
+      pool->n = i;
+      threadpool_destroy(pool);
+      return 0;
+    }
+  }
+  return pool;
+}
+// END: Create a pool of n worker threads, or with n 0, one per online CPU, up to TP_MAXWORKERS.  Returns 0 if n is out of range or the threads can't be made.
+
+// BEGIN: Run fcn(arg) on the pool.  A worker's own tasks go on its deque; others go on the shared queue.  If there is no room, fcn runs now.
+void
+threadpool_submit(struct threadpool *pool, void (*fcn)(void*), void *arg)
+{
+  struct worker *w;
+  struct task t;
+  int queued;
+
+  t.fcn = fcn;
+  t.arg = arg;
+  __sync_add_and_fetch(&pool->unfinished, 1);
+  // Counted before it can be taken, so queued never dips below 0.
+  __sync_add_and_fetch(&pool->queued, 1);
+  if((w = self(pool)) != 0)
+    queued = dqpush(&w->dq, &t) == 0;
+  else {
+    lock_acquire(&pool->lock);
+    if((queued = pool->injtail - pool->injhead < INJSIZE))
+      pool->inj[pool->injtail++ % INJSIZE] = t;
+    lock_release(&pool->lock);
+  }
+  if(!queued){
+    __sync_sub_and_fetch(&pool->queued, 1);
+    run(pool, &t);
+    return;
+  }
+  if(pool->idle > 0){
+    lock_acquire(&pool->lock);
+    cv_signal(&pool->work);
+    lock_release(&pool->lock);
+  }
+}
+// END: Run fcn(arg) on the pool.  A worker's own tasks go on its deque; others go on the shared queue.  If there is no room, fcn runs now.
+
+// BEGIN: Wait until every task submitted to the pool, and every task those submitted, has finished.  Not for use from within a task.
+void
+threadpool_wait(struct threadpool *pool)
+{
+  lock_acquire(&pool->lock);
+  while(pool->unfinished > 0)
+    cv_wait(&pool->done, &pool->lock);
+  lock_release(&pool->lock);
+}
+// END: Wait until every task submitted to the pool, and every task those submitted, has finished.  Not for use from within a task.
+
+// BEGIN: Returns how many tasks workers of the pool have stolen from each other.
+int
+threadpool_steals(struct threadpool *pool)
+{
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < pool->n; i++)
+    n += pool->w[i].steals;
+  return n;
+}
+// END: Returns how many tasks workers of the pool have stolen from each other.
+
+// BEGIN: Finish the queued tasks, stop the workers and free the pool.
+void
+threadpool_destroy(struct threadpool *pool)
+{
+  int i;
+
+  lock_acquire(&pool->lock);
+  pool->stop = 1;
+  cv_broadcast(&pool->work);
+  lock_release(&pool->lock);
+  for(i = 0; i < pool->n; i++)
+    thread_join(pool->w[i].pid);
+  free(pool);
+}
+// END: Finish the queued tasks, stop the workers and free the pool.
@@ -0,0 +1,84 @@
+/* each thread has its own thread-local storage at %gs */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define PGSIZE (4096)
+
+struct local {
+   int id;
+   int count;
+};
+
+int ppid;
+int num_threads = 8;
+int loops = 1000;
+int counts[8];
+struct local *where[8];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, j, pids[8], ids[8];
+   ppid = getpid();
+
+   assert(sizeof(struct local) <= TLSSIZE - 4);
+   TLS(struct local)->id = -1;
+   TLS(struct local)->count = 0;
+
+   for (i = 0; i < num_threads; i++) {
+      ids[i] = i;
+      pids[i] = thread_create(worker, &ids[i]);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+
+   // Every thread counted only its own, in its own block.
+   for (i = 0; i < num_threads; i++) {
+      assert(counts[i] == loops);
+      for (j = 0; j < i; j++)
+         assert(where[i] != where[j]);
+   }
+   // The main thread's block is untouched.
+   assert(TLS(struct local)->id == -1 && TLS(struct local)->count == 0);
+   for (i = 0; i < num_threads; i++)
+      assert(where[i] != TLS(struct local));
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   struct local *l;
+   int i;
+
+   l = TLS(struct local);
+   // It is the bottom of this thread's stack page.
+   assert((uint)l / PGSIZE == (uint)&l / PGSIZE);
+   l->id = *(int*)arg_ptr;
+   l->count = 0;
+   for (i = 0; i < loops; i++) {
+      TLS(struct local)->count++;
+      if (i % 100 == 0)
+         sleep(1);
+   }
+   assert(TLS(struct local)->id == *(int*)arg_ptr);
+   counts[l->id] = l->count;
+   where[l->id] = l;
+   exit();
+}
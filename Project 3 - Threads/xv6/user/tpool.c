@@ -0,0 +1,81 @@
+/* threadpool runs every task once, and idle workers steal nested tasks */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+int ppid;
+struct threadpool *pool;
+volatile int leaves = 0;
+volatile int sum = 0;
+int ran[1000];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Spread fib(n) over tasks, one per call, counting the leaves.
+void
+fib(void *arg)
+{
+   int n = (int)arg;
+
+   if (n < 2) {
+      __sync_add_and_fetch(&leaves, 1);
+      return;
+   }
+   threadpool_submit(pool, fib, (void*)(n - 1));
+   threadpool_submit(pool, fib, (void*)(n - 2));
+}
+
+void
+add(void *arg)
+{
+   int i = (int)arg;
+
+   ran[i]++;
+   __sync_add_and_fetch(&sum, i);
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i;
+   ppid = getpid();
+
+   assert(threadpool_create(0) == NULL);
+   pool = threadpool_create(4);
+   assert(pool != NULL);
+
+   // Tasks from outside the pool, more than its shared queue holds.
+   for (i = 0; i < 1000; i++)
+      threadpool_submit(pool, add, (void*)i);
+   threadpool_wait(pool);
+   assert(sum == 999 * 1000 / 2);
+   for (i = 0; i < 1000; i++)
+      assert(ran[i] == 1);
+
+   // Tasks from tasks go on the workers' own deques; fib(1..20)
+   // leaves sum to fib(21) = 10946.
+   threadpool_submit(pool, fib, (void*)20);
+   threadpool_wait(pool);
+   assert(leaves == 10946);
+   assert(threadpool_steals(pool) > 0);
+
+   // Idle workers sleep, and wake for new work.
+   sleep(10);
+   sum = 0;
+   threadpool_submit(pool, add, (void*)7);
+   threadpool_wait(pool);
+   assert(sum == 7);
+
+   threadpool_destroy(pool);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
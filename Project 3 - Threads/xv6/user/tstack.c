@@ -0,0 +1,78 @@
+/* thread_create recycles joined threads' stacks, made by clone with a guard page */
+#include "types.h"
+#include "user.h"
+
+#undef NULL
+#define NULL ((void*)0)
+
+#define PGSIZE (4096)
+
+int ppid;
+int num_threads = 4;
+char *stacks[4];
+char *stacks2[4];
+char **where;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void worker(void *arg_ptr);
+
+int
+main(int argc, char *argv[])
+{
+   int i, j, pids[4], ids[4];
+   char *sz;
+   ppid = getpid();
+
+   // clone makes a stack page, above a guard page, when given none.
+   sz = sbrk(0);
+   for (i = 0; i < num_threads; i++) {
+      ids[i] = i;
+      pids[i] = thread_create(worker, &ids[i]);
+      assert(pids[i] > 0);
+   }
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+   assert(sbrk(0) >= sz + num_threads * 2 * PGSIZE);
+   for (i = 0; i < num_threads; i++) {
+      assert((uint)stacks[i] % PGSIZE == 0);
+      assert(stacks[i] > sz && stacks[i] + PGSIZE <= (char*)sbrk(0));
+      for (j = 0; j < i; j++)
+         assert(stacks[i] != stacks[j]);
+   }
+
+   // The next threads reuse them, and memory doesn't grow.
+   sz = sbrk(0);
+   where = stacks2;
+   for (i = 0; i < num_threads; i++)
+      pids[i] = thread_create(worker, &ids[i]);
+   for (i = 0; i < num_threads; i++)
+      assert(thread_join(pids[i]) == pids[i]);
+   assert(sbrk(0) == sz);
+   for (i = 0; i < num_threads; i++) {
+      for (j = 0; j < num_threads && stacks2[i] != stacks[j]; j++)
+         ;
+      assert(j < num_threads);
+   }
+
+   // A stack that isn't all in the address space is refused.
+   sz = sbrk(0);
+   assert(clone(worker, NULL, (void*)(((uint)sz + PGSIZE - 1) & ~(PGSIZE - 1))) == -1);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
+
+void
+worker(void *arg_ptr) {
+   int id = *(int*)arg_ptr;
+   char **w = where ? where : stacks;
+   w[id] = (char*)((uint)&id & ~(PGSIZE - 1));
+   exit();
+}
@@ -2,31 +2,221 @@
 #include "stat.h"
 #include "user.h"
 #include "param.h"
+#include "x86.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Memory allocator, safe to call from any number of threads.
+//
+// Small requests, up to MAXSMALL bytes, are rounded up to one of
+// NCLASS power-of-two size classes.  Each class has a locked
+// central free list, refilled a page at a time from sbrk, and each
+// thread keeps up to CACHEMAX free blocks of each class of its own,
+// so most small mallocs and frees take no lock and no search.  A
+// thread's cache is found from its thread_tls() block, and so
+// belongs to its stack page; a thread that later gets that stack
+// inherits it.
+//
+// Larger requests go to the first-fit free list by Kernighan and
+// Ritchie, The C programming Language, 2nd ed.  Section 8.7,
+// under a lock of its own.  A free chunk of more than TRIMMIN
+// bytes at the top of the heap is given back with a negative sbrk.
+//
+// Pages fresh from sbrk are zero, so calloc zeroes a large block
+// only if it isn't from the part of the last morecore chunk that
+// has never been handed out, [cleanlo, cleanhi).
 
 typedef long Align;
 
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr;  // Next free block; SMALL for an in-use small one
+    uint size;          // Size in Headers, or a small block's class
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define PGSIZE    4096
+#define NCLASS    8
+#define MINSMALL  16    // bytes in a class 0 block, header included
+#define MAXSMALL  ((MINSMALL << (NCLASS-1)) - sizeof(Header))
+#define CACHEMAX  32    // free blocks of a class in one thread's cache
+#define NTCACHE   16    // thread caches
+#define SMALL     ((Header*)1)
+#define TRIMMIN   (64*1024)  // free bytes at the top worth giving back
+#define TRIMKEEP  PGSIZE     // bytes of them kept
+
+static struct {
+  lock_t lock;
+  Header *free;
+} central[NCLASS];
+
+struct tcache {
+  volatile uint owner;  // thread_tls() of the thread it is for, 0 if none
+  Header *free[NCLASS];
+  int n[NCLASS];
+};
+
+static struct tcache tcaches[NTCACHE];
+
 static Header base;
 static Header *freep;
+static lock_t biglock;
+static Header *cleanlo, *cleanhi;
+static lock_t brklock;  // Held while malloc moves the break
 
+// Keep malloc from moving the break, for a caller that grows
+// it by other means: a heap trim must not free what it adds.
 void
-free(void *ap)
+brk_lock(void)
 {
-  Header *bp, *p;
+  lock_acquire(&brklock);
+}
+
+void
+brk_unlock(void)
+{
+  lock_release(&brklock);
+}
+
+static char*
+grow(int n)
+{
+  char *p;
+
+  lock_acquire(&brklock);
+  p = sbrk(n);
+  lock_release(&brklock);
+  return p;
+}
+
+// The calling thread's cache, or 0 if all the slots it might have
+// are taken.
+static struct tcache*
+mycache(void)
+{
+  struct tcache *c;
+  uint tls;
+  int i;
+
+  tls = (uint)thread_tls();
+  for(i = 0; i < 4; i++){
+    c = &tcaches[(tls / PGSIZE + i) % NTCACHE];
+    if(c->owner == tls || (c->owner == 0 && cmpxchg(&c->owner, 0, tls) == 0))
+      return c;
+  }
+  return 0;
+}
+
+// Move up to n blocks of class k from the central list to *list,
+// carving a new page from sbrk if it is empty.  Returns how many.
+static int
+refill(int k, Header **list, int n)
+{
+  Header *p;
+  char *a, *end;
+  uint sz;
+  int got;
+
+  sz = MINSMALL << k;
+  lock_acquire(&central[k].lock);
+  if(central[k].free == 0){
+    if((a = grow(PGSIZE)) == (char*)-1){
+      lock_release(&central[k].lock);
+      return 0;
+    }
+    for(end = a + PGSIZE; a + sz <= end; a += sz){
+      p = (Header*)a;
+      p->s.size = k;
+      p->s.ptr = central[k].free;
+      central[k].free = p;
+    }
+  }
+  for(got = 0; got < n && (p = central[k].free) != 0; got++){
+    central[k].free = p->s.ptr;
+    p->s.ptr = *list;
+    *list = p;
+  }
+  lock_release(&central[k].lock);
+  return got;
+}
+
+// Give blocks of class k on list back to the central list.
+static void
+drain(int k, Header *list)
+{
+  Header *p;
+
+  lock_acquire(&central[k].lock);
+  while((p = list) != 0){
+    list = p->s.ptr;
+    p->s.ptr = central[k].free;
+    central[k].free = p;
+  }
+  lock_release(&central[k].lock);
+}
+
+static void*
+smallalloc(uint nbytes)
+{
+  struct tcache *c;
+  Header *p, *list;
+  int k;
+
+  for(k = 0; (MINSMALL << k) - sizeof(Header) < nbytes; k++)
+    ;
+  if((c = mycache()) == 0){
+    list = 0;
+    if(refill(k, &list, 1) == 0)
+      return 0;
+    p = list;
+  } else {
+    if(c->free[k] == 0)
+      c->n[k] = refill(k, &c->free[k], CACHEMAX/2);
+    if((p = c->free[k]) == 0)
+      return 0;
+    c->free[k] = p->s.ptr;
+    c->n[k]--;
+  }
+  p->s.ptr = SMALL;
+  return (void*)(p + 1);
+}
+
+static void
+smallfree(Header *bp)
+{
+  struct tcache *c;
+  Header *list, *p;
+  int k, i;
+
+  k = bp->s.size;
+  if((c = mycache()) == 0){
+    bp->s.ptr = 0;
+    drain(k, bp);
+    return;
+  }
+  if(c->n[k] == CACHEMAX){
+    // Keep half, so alternating frees and mallocs don't thrash.
+    list = c->free[k];
+    for(p = list, i = 1; i < CACHEMAX/2; i++)
+      p = p->s.ptr;
+    c->free[k] = p->s.ptr;
+    p->s.ptr = 0;
+    c->n[k] -= CACHEMAX/2;
+    drain(k, list);
+  }
+  bp->s.ptr = c->free[k];
+  c->free[k] = bp;
+  c->n[k]++;
+}
+
+// Put bp on the large free list, and return the free chunk it
+// ended up in.  Caller holds biglock.
+static Header*
+bigfree(Header *bp)
+{
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -38,11 +228,60 @@ free(void *ap)
   if(p + p->s.size == bp){
     p->s.size += bp->s.size;
     p->s.ptr = bp->s.ptr;
+    bp = p;
   } else
     p->s.ptr = bp;
   freep = p;
+  return bp;
 }
 
+// Give back all but TRIMKEEP bytes of free chunk bp if it is big
+// and ends at the break.  Caller holds biglock.
+static void
+trim(Header *bp)
+{
+  uint n;
+  char *brk;
+
+  if(bp->s.size * sizeof(Header) < TRIMMIN)
+    return;
+  n = bp->s.size - TRIMKEEP / sizeof(Header);
+  lock_acquire(&brklock);
+  brk = sbrk(0);
+  if((char*)(bp + bp->s.size) == brk && sbrk(-(int)(n * sizeof(Header))) != (char*)-1){
+    bp->s.size -= n;
+    if(cleanhi > bp + bp->s.size)
+      cleanhi = bp + bp->s.size;
+  }
+  lock_release(&brklock);
+}
+
+// Block [p, p+n) is about to hold data.
+static void
+dirty(Header *p, uint n)
+{
+  if(p < cleanhi && p + n > cleanlo)
+    cleanhi = p;
+}
+
+void
+free(void *ap)
+{
+  Header *bp;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.ptr == SMALL){
+    smallfree(bp);
+    return;
+  }
+  lock_acquire(&biglock);
+  trim(bigfree(bp));
+  lock_release(&biglock);
+}
+
+// Caller holds biglock.
 static Header*
 morecore(uint nu)
 {
@@ -51,22 +290,28 @@ morecore(uint nu)
 
   if(nu < 4096)
     nu = 4096;
-  p = sbrk(nu * sizeof(Header));
+  p = grow(nu * sizeof(Header));
   if(p == (char*)-1)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  // The kernel zeroes only whole new pages.
+  cleanlo = (Header*)(((uint)p + PGSIZE - 1) & ~(PGSIZE - 1));
+  if(cleanlo < hp + 1)
+    cleanlo = hp + 1;
+  cleanhi = hp + nu;
+  bigfree(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+// Allocate a large block of nunits Headers, setting *fresh if it
+// is still all zero.
+static void*
+bigalloc(uint nunits, int *fresh)
 {
   Header *p, *prevp;
-  uint nunits;
 
-  nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  lock_acquire(&biglock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +326,119 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      if(fresh)
+        *fresh = p + 1 >= cleanlo && p + nunits <= cleanhi;
+      dirty(p, nunits);
+      lock_release(&biglock);
+      p->s.ptr = 0;
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        lock_release(&biglock);
         return 0;
+      }
   }
 }
+
+void*
+malloc(uint nbytes)
+{
+  if(nbytes <= MAXSMALL)
+    return smallalloc(nbytes);
+  return bigalloc((nbytes + sizeof(Header) - 1)/sizeof(Header) + 1, 0);
+}
+
+void*
+calloc(uint nmemb, uint size)
+{
+  uint n;
+  void *p;
+  int fresh;
+
+  if(size != 0 && nmemb > (uint)-1 / size)
+    return 0;
+  n = nmemb * size;
+  fresh = 0;
+  if(n <= MAXSMALL)
+    p = smallalloc(n);
+  else
+    p = bigalloc((n + sizeof(Header) - 1)/sizeof(Header) + 1, &fresh);
+  if(p != 0 && !fresh)
+    memset(p, 0, n);
+  return p;
+}
+
+// Grow large block bp to nunits in place, if the chunk after it
+// is free and big enough.  Caller holds biglock.
+static int
+biggrow(Header *bp, uint nunits)
+{
+  Header *prevp, *q, *r;
+  uint n;
+
+  if(freep == 0)
+    return 0;
+  for(prevp = freep; (q = prevp->s.ptr) != bp + bp->s.size; prevp = q)
+    if(q == freep)
+      return 0;
+  if(bp->s.size + q->s.size < nunits)
+    return 0;
+  n = bp->s.size + q->s.size - nunits;
+  if(n == 0)
+    prevp->s.ptr = q->s.ptr;
+  else {
+    r = bp + nunits;
+    r->s.size = n;
+    r->s.ptr = q->s.ptr;
+    prevp->s.ptr = r;
+  }
+  freep = prevp;
+  bp->s.size = nunits;
+  dirty(bp, nunits);
+  return 1;
+}
+
+void*
+realloc(void *ap, uint nbytes)
+{
+  Header *bp, *tail;
+  uint have, nunits;
+  void *p;
+
+  if(ap == 0)
+    return malloc(nbytes);
+  if(nbytes == 0){
+    free(ap);
+    return 0;
+  }
+  bp = (Header*)ap - 1;
+  if(bp->s.ptr == SMALL){
+    have = (MINSMALL << bp->s.size) - sizeof(Header);
+    if(nbytes <= have)
+      return ap;
+  } else {
+    have = (bp->s.size - 1) * sizeof(Header);
+    nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+    lock_acquire(&biglock);
+    if(nunits + 1 < bp->s.size){
+      // Shrinking: free the tail.
+      tail = bp + nunits;
+      tail->s.size = bp->s.size - nunits;
+      bp->s.size = nunits;
+      trim(bigfree(tail));
+      lock_release(&biglock);
+      return ap;
+    }
+    if(nunits <= bp->s.size || biggrow(bp, nunits)){
+      lock_release(&biglock);
+      return ap;
+    }
+    lock_release(&biglock);
+  }
+  if((p = malloc(nbytes)) == 0)
+    return 0;
+  memmove(p, ap, have);
+  free(ap);
+  return p;
+}
@@ -2,9 +2,11 @@
 #define _USER_H_
 
 struct stat;
+struct sysinfo;
 
 // system calls
 int fork(void);
+int vfork(void);
 int exit(void) __attribute__((noreturn));
 int wait(void);
 int pipe(int*);
@@ -29,7 +31,17 @@ int clone(void(*fcn)(void*), void* arg, void* stack);
 int join(int pid);
 void cv_wait(cond_t* conditionVariable, lock_t* lock);
 void cv_signal(cond_t* conditionVariable);
-int find_ustack(int pid);
+void cv_broadcast(cond_t* conditionVariable);
+int futex_wait(uint* addr, uint val);
+int futex_wake(uint* addr, int n);
+int settickets(int);
+int setgang(int);
+int yield_to(int);
+int setrtprio(int);
+int futex_wait_pi(uint* addr, uint val, uint owner);
+int join_any(int* tid, int* status);
+void thread_exit(int status);
+int sysinfo(struct sysinfo*);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
@@ -43,15 +55,63 @@ uint strlen(char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
+void* calloc(uint, uint);
+void* realloc(void*, uint);
+void brk_lock(void);
+void brk_unlock(void);
 int atoi(const char*);
 
 // user library functions (uthreadlib.c)
 int thread_create(void (*start_routine)(void*), void* arg);
 int thread_join(int pid);
+int thread_join_any(int* status);
+void* thread_tls(void);
+// The calling thread's own copy of a struct of thread-local
+// variables, which must fit in TLSSIZE-4 bytes.
+#define TLS(type) ((type*)thread_tls())
+
+// threadpool.c
+struct threadpool;
+struct threadpool* threadpool_create(int n);
+void threadpool_submit(struct threadpool* pool, void (*fcn)(void*), void* arg);
+void threadpool_wait(struct threadpool* pool);
+int threadpool_steals(struct threadpool* pool);
+void threadpool_destroy(struct threadpool* pool);
+
+// mpmcq.c
+struct mpmcq;
+struct mpmcq* mpmcq_create(uint n);
+int mpmcq_push(struct mpmcq* q, void* v);
+int mpmcq_pop(struct mpmcq* q, void** v);
+void mpmcq_destroy(struct mpmcq* q);
+
+// green.c
+int gthread_init(int n);
+int gthread_create(void (*fcn)(void*), void* arg);
+void gthread_yield(void);
+void gthread_exit(void);
+void gthread_wait(void);
+void gsem_init(gsem_t* s, int count);
+void gsem_wait(gsem_t* s);
+void gsem_post(gsem_t* s);
 void lock_acquire(lock_t* lock);
 void lock_release(lock_t* lock);
 void lock_init(lock_t* lock);
-// void cv_wait(cond_t* conditionVariable, lock_t* lock);
-// void cv_signal(cond_t* conditionVariable);
+void mutex_init(mutex_t* m);
+void mutex_lock(mutex_t* m);
+void mutex_unlock(mutex_t* m);
+void rwlock_init(rwlock_t* rw);
+void rwlock_rdlock(rwlock_t* rw);
+void rwlock_wrlock(rwlock_t* rw);
+void rwlock_unlock(rwlock_t* rw);
+void sem_init(sem_t* s, uint count);
+void sem_wait(sem_t* s);
+int sem_trywait(sem_t* s);
+void sem_post(sem_t* s);
+void barrier_init(barrier_t* b, uint n);
+int barrier_wait(barrier_t* b);
+void latch_init(latch_t* l, uint count);
+void latch_countdown(latch_t* l);
+void latch_wait(latch_t* l);
 
 #endif // _USER_H_
\ No newline at end of file
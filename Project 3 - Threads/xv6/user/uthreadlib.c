@@ -1,47 +1,358 @@
 #include "types.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
+#include "atomic.h"
 
 #define PGSIZE 4096
+#define MUTEX_SPINS 100  // pauses before sleeping on a held mutex
 
-// BEGIN: Creates a new thread by first allocating a page-aligned user stack, then calling the clone syscall.  Returns the pid of the new thread.
+// A thread stack, with what thread_create and thread_join need to
+// recycle it.  Joined threads' stacks are kept on a free list rather
+// than freed, so after the first few threads, creating and joining
+// one is a single system call each.
+struct ustack {
+  struct ustack *next;  // On the running or the free list
+  int pid;              // Thread using it
+  char *stack;          // The stack page, 0 until its thread starts
+  void (*fcn)(void*);   // What the thread runs, for a new stack
+  void *arg;
+};
+
+static struct ustack *running;      // Threads not yet joined
+static struct ustack *freestacks;   // Stacks ready for reuse
+static lock_t stacklock;            // Guards both lists
+
+// BEGIN: The first code of a thread whose stack clone made.  Records where the stack is (arg sits in its top word) and runs the thread.
+static void
+thread_start(void* arg)
+{
+  struct ustack *s = arg;
+
+  s->stack = (char*)((uint)&arg & ~(PGSIZE - 1));
+  s->fcn(s->arg);
+  exit();
+}
+// END: The first code of a thread whose stack clone made.  Records where the stack is (arg sits in its top word) and runs the thread.
+
+// BEGIN: Creates a new thread on a recycled user stack, or else on one that clone allocates with a guard page below it.  Returns the pid of the new thread.
 int
 thread_create(void (*start_routine)(void*), void* arg)
 {
-  void *stack = malloc(2 * PGSIZE);
-  if ((uint)stack % PGSIZE != 0) stack += PGSIZE - (uint)stack % PGSIZE;
-  return clone(start_routine, arg, stack);
+  struct ustack *s;
+  int pid;
+
+  lock_acquire(&stacklock);
+  if ((s = freestacks) != 0) freestacks = s->next;
+  lock_release(&stacklock);
+
+  if (s != 0) {
+    pid = clone(start_routine, arg, s->stack);
+  } else {
+    if ((s = malloc(sizeof(*s))) == 0) return -1;
+    s->stack = 0;
+    s->fcn = start_routine;
+    s->arg = arg;
+    brk_lock();  // clone grows the heap for the stack
+    pid = clone(thread_start, s, 0);
+    brk_unlock();
+  }
+
+  if (pid < 0 && s->stack == 0) {
+    free(s);
+    return -1;
+  }
+  lock_acquire(&stacklock);
+  if (pid < 0) {
+    s->next = freestacks;
+    freestacks = s;
+  } else {
+    s->pid = pid;
+    s->next = running;
+    running = s;
+  }
+  lock_release(&stacklock);
+  return pid;
+}
+// END: Creates a new thread on a recycled user stack, or else on one that clone allocates with a guard page below it.  Returns the pid of the new thread.
+
+// BEGIN: Keeps the user stack of joined thread pid for the next thread_create.
+static void
+keepstack(int pid)
+{
+  struct ustack *s, **pp;
+
+  lock_acquire(&stacklock);
+  for (pp = &running; (s = *pp) != 0; pp = &s->next) {
+    if (s->pid == pid) {
+      *pp = s->next;
+      // A thread killed before it ran never learned its stack.
+      if (s->stack != 0) {
+        s->next = freestacks;
+        freestacks = s;
+      } else {
+        free(s);
+      }
+      break;
+    }
+  }
+  lock_release(&stacklock);
 }
-// END: Creates a new thread by first allocating a page-aligned user stack, then calling the clone syscall.  Returns the pid of the new thread.
+// END: Keeps the user stack of joined thread pid for the next thread_create.
 
-// BEGIN: Calls join to wait for the thread specified by pid to complete.  Cleans up the completed thread's user stack.
+// BEGIN: Calls join to wait for the thread specified by pid to complete, then keeps its user stack for the next thread_create.
 int
 thread_join(int pid)
 {
-  int ustack;
-  if ((ustack = find_ustack(pid)) < 0) return -1;
-  free((void*)ustack);
-  return join(pid);
+  if ((pid = join(pid)) < 0) return -1;
+  keepstack(pid);
+  return pid;
+}
+// END: Calls join to wait for the thread specified by pid to complete, then keeps its user stack for the next thread_create.
+
+// BEGIN: Calls join_any to wait for whichever thread completes first, then keeps its user stack as thread_join does.  Returns its pid, with what it passed to thread_exit in *status, or -1 if there are no threads to wait for.
+int
+thread_join_any(int* status)
+{
+  int pid;
+
+  if (join_any(&pid, status) < 0) return -1;
+  keepstack(pid);
+  return pid;
 }
-// END: Calls join to wait for the thread specified by pid to complete.  Cleans up the completed thread's user stack.
+// END: Calls join_any to wait for whichever thread completes first, then keeps its user stack as thread_join does.  Returns its pid, with what it passed to thread_exit in *status, or -1 if there are no threads to wait for.
+
+// BEGIN: Returns the calling thread's local storage, the bottom TLSSIZE bytes of its stack page, past the first word.  The kernel sets %gs to the page and that word to its address.
+void*
+thread_tls(void)
+{
+  char *tls;
 
-// BEGIN: Acquires the lock pointed to by lock.  If the lock is already held, spin until it becomes available.
+  asm volatile("movl %%gs:0, %0" : "=r" (tls));
+  return tls + sizeof(uint);
+}
+// END: Returns the calling thread's local storage, the bottom TLSSIZE bytes of its stack page, past the first word.  The kernel sets %gs to the page and that word to its address.
+
+// The calling thread's thread-local storage address, which the kernel keeps in the first word.
+static uint
+tlsaddr(void)
+{
+  uint tls;
+
+  asm volatile("movl %%gs:0, %0" : "=r" (tls));
+  return tls;
+}
+
+// BEGIN: Acquires the lock pointed to by lock.  If the lock is already held, sleep in futex_wait until it becomes available.
+// The lock is 0 when free, 1 when held and 2 when held with possible waiters, so an uncontended lock never enters the kernel.
 void lock_acquire(lock_t* lock)
 {
-  while(xchg(lock, 1) != 0) ;
+  if (xchg(lock, 1) == 0) return;
+  while (xchg(lock, 2) != 0)
+    futex_wait(lock, 2);
 }
-// END: Acquires the lock pointed to by lock.  If the lock is already held, spin until it becomes available.
+// END: Acquires the lock pointed to by lock.  If the lock is already held, sleep in futex_wait until it becomes available.
 
-// BEGIN: Release the lock pointed to by lock.
+// BEGIN: Release the lock pointed to by lock, waking one waiter if there may be any.
 void lock_release(lock_t* lock)
 {
-  xchg(lock, 0);
+  if (xchg(lock, 0) == 2)
+    futex_wake(lock, 1);
 }
-// END: Release the lock pointed to by lock.
+// END: Release the lock pointed to by lock, waking one waiter if there may be any.
 
 // BEGIN: Initialize the lock pointed to by lock.
 void lock_init(lock_t* lock)
 {
   *lock = 0;
 }
-// END: Initialize the lock pointed to by lock.
\ No newline at end of file
+// END: Initialize the lock pointed to by lock.
+
+// BEGIN: Initialize the mutex pointed to by m.
+void mutex_init(mutex_t* m)
+{
+  memset(m, 0, sizeof(*m));
+}
+// END: Initialize the mutex pointed to by m.
+
+// BEGIN: Acquires the mutex pointed to by m.  If it is held, spin for a while in case the holder is about to let go, then sleep in futex_wait.
+// Only the 0 -> 1 step may be taken with cmpxchg; a thread that finds it held sets 2 before it sleeps, so the unlock knows to wake it.
+// The holder's thread-local storage address, %gs:0, names it to futex_wait_pi, which runs a holder that was preempted, or lends it the waiter's priority.
+void mutex_lock(mutex_t* m)
+{
+  int i, parks;
+
+  if (cmpxchg(&m->state, 0, 1) == 0) {
+    m->owner = tlsaddr();
+    m->acquires++;
+    return;
+  }
+  parks = 0;
+  for (i = 0; i < MUTEX_SPINS; i++) {
+    pause();
+    if (atomic_load(&m->state) == 0 && cmpxchg(&m->state, 0, 1) == 0)
+      goto done;
+  }
+  while (xchg(&m->state, 2) != 0) {
+    futex_wait_pi(&m->state, 2, m->owner);
+    parks++;
+  }
+done:
+  m->owner = tlsaddr();
+  // The counts are only changed with m held.
+  m->acquires++;
+  m->contended++;
+  m->parks += parks;
+}
+// END: Acquires the mutex pointed to by m.  If it is held, spin for a while in case the holder is about to let go, then sleep in futex_wait.
+
+// BEGIN: Release the mutex pointed to by m, waking one sleeper if there may be any.
+void mutex_unlock(mutex_t* m)
+{
+  m->owner = 0;
+  if (xchg(&m->state, 0) == 2)
+    futex_wake(&m->state, 1);
+}
+// END: Release the mutex pointed to by m, waking one sleeper if there may be any.
+
+// BEGIN: Initialize the reader-writer lock pointed to by rw.
+void rwlock_init(rwlock_t* rw)
+{
+  memset(rw, 0, sizeof(*rw));
+}
+// END: Initialize the reader-writer lock pointed to by rw.
+
+// BEGIN: Acquires rw for reading, shared with other readers.  Waits while a writer holds it or is waiting for it, so writers don't starve.
+void rwlock_rdlock(rwlock_t* rw)
+{
+  lock_acquire(&rw->lock);
+  while (rw->writer || rw->writerswaiting > 0)
+    cv_wait(&rw->rcond, &rw->lock);
+  rw->readers++;
+  lock_release(&rw->lock);
+}
+// END: Acquires rw for reading, shared with other readers.  Waits while a writer holds it or is waiting for it, so writers don't starve.
+
+// BEGIN: Acquires rw for writing, once no reader or writer holds it.
+void rwlock_wrlock(rwlock_t* rw)
+{
+  lock_acquire(&rw->lock);
+  rw->writerswaiting++;
+  while (rw->writer || rw->readers > 0)
+    cv_wait(&rw->wcond, &rw->lock);
+  rw->writerswaiting--;
+  rw->writer = 1;
+  lock_release(&rw->lock);
+}
+// END: Acquires rw for writing, once no reader or writer holds it.
+
+// BEGIN: Release rw, held either way.  Once it is free, wake one waiting writer, or else all waiting readers.
+void rwlock_unlock(rwlock_t* rw)
+{
+  lock_acquire(&rw->lock);
+  if (rw->writer)
+    rw->writer = 0;
+  else
+    rw->readers--;
+  if (rw->readers == 0) {
+    if (rw->writerswaiting > 0)
+      cv_signal(&rw->wcond);
+    else
+      cv_broadcast(&rw->rcond);
+  }
+  lock_release(&rw->lock);
+}
+// END: Release rw, held either way.  Once it is free, wake one waiting writer, or else all waiting readers.
+
+// BEGIN: Initialize the semaphore pointed to by s with count units.
+void sem_init(sem_t* s, uint count)
+{
+  s->count = count;
+  s->waiters = 0;
+}
+// END: Initialize the semaphore pointed to by s with count units.
+
+// BEGIN: Take a unit of s if one is available without waiting.  Returns 1 if it took one, else 0.
+int sem_trywait(sem_t* s)
+{
+  uint c;
+
+  while ((c = s->count) > 0)
+    if (cmpxchg(&s->count, c, c - 1) == c)
+      return 1;
+  return 0;
+}
+// END: Take a unit of s if one is available without waiting.  Returns 1 if it took one, else 0.
+
+// BEGIN: Take a unit of s, sleeping in futex_wait while there is none.
+// A waiter counts itself in waiters before it checks count in futex_wait, and sem_post adds to count before it checks waiters, so one of them sees the other.
+void sem_wait(sem_t* s)
+{
+  while (!sem_trywait(s)) {
+    atomic_fetch_add(&s->waiters, 1);
+    futex_wait(&s->count, 0);
+    atomic_fetch_add(&s->waiters, -1);
+  }
+}
+// END: Take a unit of s, sleeping in futex_wait while there is none.
+
+// BEGIN: Give back a unit of s, waking one waiter if there may be any.
+void sem_post(sem_t* s)
+{
+  atomic_fetch_add(&s->count, 1);
+  if (s->waiters > 0)
+    futex_wake(&s->count, 1);
+}
+// END: Give back a unit of s, waking one waiter if there may be any.
+
+// BEGIN: Initialize the barrier pointed to by b for n threads.
+void barrier_init(barrier_t* b, uint n)
+{
+  b->n = n;
+  b->left = n;
+  b->sense = 0;
+}
+// END: Initialize the barrier pointed to by b for n threads.
+
+// BEGIN: Wait until all n threads have reached b, then let them all go on.  Returns 1 in the last thread to arrive, 0 in the others.
+// The sense is read before arriving, so it is this phase's; the last to arrive resets left before flipping it, so a thread that races ahead to the next phase counts there.  No thread can sleep through two flips, as the next phase can't end without it.
+int barrier_wait(barrier_t* b)
+{
+  uint sense = b->sense;
+
+  if (atomic_fetch_add(&b->left, -1) == 1) {
+    b->left = b->n;
+    xchg(&b->sense, !sense);
+    futex_wake(&b->sense, b->n);
+    return 1;
+  }
+  while (b->sense == sense)
+    futex_wait(&b->sense, sense);
+  return 0;
+}
+// END: Wait until all n threads have reached b, then let them all go on.  Returns 1 in the last thread to arrive, 0 in the others.
+
+// BEGIN: Initialize the latch pointed to by l to open after count countdowns.
+void latch_init(latch_t* l, uint count)
+{
+  l->count = count;
+}
+// END: Initialize the latch pointed to by l to open after count countdowns.
+
+// BEGIN: Count l down, opening it for all its waiters at 0.
+void latch_countdown(latch_t* l)
+{
+  if (atomic_fetch_add(&l->count, -1) == 1)
+    futex_wake(&l->count, NPROC);
+}
+// END: Count l down, opening it for all its waiters at 0.
+
+// BEGIN: Wait until l is open.
+void latch_wait(latch_t* l)
+{
+  uint c;
+
+  while ((c = l->count) != 0)
+    futex_wait(&l->count, c);
+}
+// END: Wait until l is open.
@@ -0,0 +1,74 @@
+/* vfork's child shares memory until it execs or exits, and the parent waits for that */
+#include "types.h"
+#include "user.h"
+
+int ppid;
+volatile int shared;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+   char *echo[] = { "echo", "vfork child exec ok", 0 };
+   char *nope[] = { "nosuchprogram", 0 };
+   volatile int canary;
+   char *brk;
+   int pid;
+   ppid = getpid();
+
+   // The parent sleeps until the child exits, and sees its writes.
+   shared = 0;
+   pid = vfork();
+   if (pid == 0) {
+      sleep(10);
+      shared = 1;
+      exit();
+   }
+   assert(pid > 0);
+   assert(shared == 1);
+   assert(wait() == pid);
+
+   // So does growing the heap.
+   brk = sbrk(0);
+   pid = vfork();
+   if (pid == 0) {
+      sbrk(4096);
+      exit();
+   }
+   assert(pid > 0);
+   assert(sbrk(0) == brk + 4096);
+   assert(wait() == pid);
+
+   // After exec the child has memory of its own, and the
+   // parent's stack is as it was.
+   canary = 0x1234;
+   pid = vfork();
+   if (pid == 0) {
+      exec("echo", echo);
+      exit();
+   }
+   assert(pid > 0);
+   assert(canary == 0x1234);
+   assert(wait() == pid);
+
+   // A failed exec leaves the child borrowing until it exits.
+   pid = vfork();
+   if (pid == 0) {
+      exec("nosuchprogram", nope);
+      shared = 2;
+      exit();
+   }
+   assert(pid > 0);
+   assert(shared == 2);
+   assert(wait() == pid);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,121 @@
+/* yield_to hands the CPU to another RUNNABLE thread of the same
+ * process only; a producer and consumer passing items through a
+ * one-slot buffer with cv_signal handoff, and threads sharing a
+ * contended mutex, still see every item and every increment */
+#include "types.h"
+#include "user.h"
+
+#define NITEM 2000
+#define NTHREAD 4
+#define NINCR 5000
+
+int ppid;
+lock_t lock;
+cond_t full, empty;
+volatile int slot, have;
+volatile int spun;
+mutex_t m;
+volatile int counter;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+spinner(void *arg)
+{
+   spun = 1;
+   exit();
+}
+
+// Take NITEM items from the slot, checking they come in order.
+void
+consumer(void *arg)
+{
+   int i;
+
+   for (i = 0; i < NITEM; i++) {
+      lock_acquire(&lock);
+      while (!have)
+         cv_wait(&full, &lock);
+      assert(slot == i);
+      have = 0;
+      cv_signal(&empty);
+      lock_release(&lock);
+   }
+   exit();
+}
+
+void
+adder(void *arg)
+{
+   int i;
+
+   for (i = 0; i < NINCR; i++) {
+      mutex_lock(&m);
+      counter++;
+      mutex_unlock(&m);
+   }
+   exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+   int i, pid, tid[NTHREAD];
+   ppid = getpid();
+
+   // Only other RUNNABLE threads of this process.
+   assert(yield_to(getpid()) == -1);
+   assert(yield_to(-1) == -1);
+   pid = fork();
+   assert(pid >= 0);
+   if (pid == 0) {
+      sleep(10);
+      exit();
+   }
+   assert(yield_to(pid) == -1);
+   assert(wait() == pid);
+
+   // Until it has run, a new thread is RUNNABLE or running.
+   tid[0] = thread_create(spinner, 0);
+   assert(tid[0] > 0);
+   while (!spun)
+      yield_to(tid[0]);
+   assert(thread_join(tid[0]) == tid[0]);
+   assert(yield_to(tid[0]) == -1);
+
+   // Producer and consumer.
+   lock_init(&lock);
+   tid[0] = thread_create(consumer, 0);
+   assert(tid[0] > 0);
+   for (i = 0; i < NITEM; i++) {
+      lock_acquire(&lock);
+      while (have)
+         cv_wait(&empty, &lock);
+      slot = i;
+      have = 1;
+      cv_signal(&full);
+      lock_release(&lock);
+   }
+   assert(thread_join(tid[0]) == tid[0]);
+   assert(!have);
+
+   // A contended mutex.
+   mutex_init(&m);
+   for (i = 0; i < NTHREAD; i++) {
+      tid[i] = thread_create(adder, 0);
+      assert(tid[i] > 0);
+   }
+   for (i = 0; i < NTHREAD; i++)
+      assert(thread_join(tid[i]) == tid[i]);
+   assert(counter == NTHREAD*NINCR);
+   assert(m.owner == 0 && m.state == 0);
+
+   printf(1, "TEST PASSED\n");
+   exit();
+}
@@ -0,0 +1,8 @@
+#ifndef _IntrStat_H_
+#define _IntrStat_H_
+// Counters for one IRQ; see intrstat().
+struct IntrStat {
+  uint count[NCPU]; // interrupts taken on each CPU
+  int cpu; // CPU the IO APIC sends it to, or -1 if it isn't routed
+};
+#endif // _IntrStat_H_
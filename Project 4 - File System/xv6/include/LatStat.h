@@ -0,0 +1,12 @@
+#ifndef _LatStat_H_
+#define _LatStat_H_
+// One of the longest stretches the kernel kept interrupts off
+// or held a spinlock while latency tracing was on; see
+// latencyctl().  Times are in CPU cycles, as counted by rdtsc.
+struct LatStat {
+  char name[16]; // lock name, or "cli" for interrupts off
+  uint count; // times seen among the longest from this call stack
+  uint64 max; // longest of them
+  uint pcs[10]; // call stack where it began
+};
+#endif // _LatStat_H_
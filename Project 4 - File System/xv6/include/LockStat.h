@@ -0,0 +1,13 @@
+#ifndef _LockStat_H_
+#define _LockStat_H_
+// Counters for all the spinlocks with one name; see lockstat().
+// Times are in CPU cycles, as counted by rdtsc.
+struct LockStat {
+  char name[16]; // lock name
+  uint nlocks; // locks initialized with this name
+  uint acquires; // times acquired
+  uint contended; // times that had to wait
+  uint64 spin; // cycles spent waiting
+  uint64 maxhold; // longest time held
+};
+#endif // _LockStat_H_
@@ -0,0 +1,17 @@
+#ifndef _ProcStat_H_
+#define _ProcStat_H_
+// A process's running totals; see getprocstat().  Samples taken
+// some ticks apart give its rates from the differences.
+struct ProcStat {
+  int pid; // process id
+  int state; // state
+  char name[16]; // name of process
+  uint uticks; // clock ticks run in user mode
+  uint sticks; // clock ticks run in the kernel
+  uint vcsw; // times it gave up the CPU to wait
+  uint ivcsw; // times it was made to give up the CPU
+  uint syscalls; // system calls made
+  uint bio; // disk blocks read or written for it
+  uint lastrun; // tick it last ran at
+};
+#endif // _ProcStat_H_
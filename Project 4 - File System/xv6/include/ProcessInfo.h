@@ -0,0 +1,20 @@
+#ifndef _ProcessInfo_H_
+#define _ProcessInfo_H_
+struct ProcessInfo {
+  int pid; // process id
+  int ppid; // parent pid, or -1
+  int state; // state
+  uint sz; // end of the heap
+  char name[16]; // name of process
+  uint rss; // resident user pages
+  uint shared; // of those, pages shared with another page table
+  uint ptpages; // page directory and user page tables
+  uint minflt; // page faults served from memory
+  uint majflt; // page faults that read a file
+  uint maxrss; // peak of rss
+  int priority; // scheduler level, 0 highest
+  uint ticks; // clock ticks run
+  int cpu; // CPU it last ran on
+  uint cpumask; // CPUs it may run on (see setaffinity)
+};
+#endif // _ProcessInfo_H_
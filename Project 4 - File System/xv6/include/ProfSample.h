@@ -0,0 +1,16 @@
+#ifndef _ProfSample_H_
+#define _ProfSample_H_
+// Flags for profctl().
+#define PROF_ON    1
+#define PROF_STACK 2 // record kernel call stacks too
+#define PROFDEPTH 10 // callers in a stack, as getcallerpcs records
+#define NPROFSAMPLE 256 // samples each CPU holds; a power of two
+// What one CPU was running at a timer interrupt; see profread().
+struct ProfSample {
+  uint eip; // where it was interrupted
+  uint pcs[PROFDEPTH]; // kernel callers, 0-terminated, with PROF_STACK
+  int pid; // process running, or 0
+  uchar cpu;
+  uchar user; // eip is in pid's user space
+};
+#endif // _ProfSample_H_
@@ -0,0 +1,10 @@
+#ifndef _ShrinkStat_H_
+#define _ShrinkStat_H_
+// Counters for one cache that gives memory back to kalloc under
+// pressure; see shrinkstat().
+struct ShrinkStat {
+  char name[16]; // the cache
+  uint calls; // times asked for pages
+  uint freed; // pages it gave back
+};
+#endif // _ShrinkStat_H_
@@ -0,0 +1,13 @@
+#ifndef _SyscallStat_H_
+#define _SyscallStat_H_
+// Counters for one system call number; see syscallstat().
+// Times are in CPU cycles, as counted by rdtsc.
+#define NSYSHIST 16   // latency histogram buckets
+#define SYSHISTMIN 1024  // cycles under which a call goes in hist[0]
+struct SyscallStat {
+  uint count; // calls made
+  uint64 cycles; // cycles spent in the handler
+  uint hist[NSYSHIST]; // hist[i]: took under SYSHISTMIN<<i cycles, and
+                       // at least half that; the last is all the rest
+};
+#endif // _SyscallStat_H_
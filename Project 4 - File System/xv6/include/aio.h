@@ -0,0 +1,8 @@
+#ifndef _AIO_H_
+#define _AIO_H_
+// A finished aio_read or aio_write, as read from its aio fd.
+struct aioevent {
+  uint tag;  // as passed to aio_read or aio_write
+  int res;   // bytes read or written, or -1
+};
+#endif // _AIO_H_
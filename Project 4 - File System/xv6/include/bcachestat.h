@@ -0,0 +1,12 @@
+#ifndef _BCACHESTAT_H_
+#define _BCACHESTAT_H_
+struct bcachestat {
+  uint nbuf; // number of buffers in the cache
+  uint hits; // lookups found in the cache
+  uint misses; // lookups that had to allocate a buffer
+  uint evictions; // misses that recycled a valid buffer
+  uint writebacks; // dirty buffers written to disk
+  uint ghosthits; // misses on blocks evicted from the in list not long ago
+  uint nhot; // buffers on the hot list
+};
+#endif // _BCACHESTAT_H_
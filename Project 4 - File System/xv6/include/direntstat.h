@@ -0,0 +1,9 @@
+#ifndef _DIRENTSTAT_H_
+#define _DIRENTSTAT_H_
+// A directory entry as getdents_stat returns it, with the stat
+// of the inode it names.  Include stat.h and fs.h first.
+struct direntstat {
+  char name[DIRSIZ+1]; // nul-terminated
+  struct stat st;
+};
+#endif // _DIRENTSTAT_H_
@@ -7,5 +7,10 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+#define O_NONBLOCK 0x800  // reads and writes fail rather than wait
+
+// fcntl commands
+#define F_GETFL   3  // returns the O_ access mode and O_NONBLOCK
+#define F_SETFL   4  // sets O_NONBLOCK from arg
 
 #endif //_FCNTL_H_
@@ -9,18 +9,45 @@
 // Inodes start at block 2.
 
 #define ROOTINO 1  // root i-number
-#define BSIZE 512  // block size
+#define SECTSIZE 512  // disk sector size
+
+// Block size, a multiple of the sector size up to a page.
+// Set with make FSBSIZE=n.
+#ifndef BSIZE
+#define BSIZE 512
+#endif
+#if BSIZE % SECTSIZE != 0 || BSIZE > 4096 || (BSIZE & (BSIZE - 1)) != 0
+#error "BSIZE must be 512, 1024, 2048 or 4096"
+#endif
 
 // File system super block
 struct superblock {
   uint size;         // Size of file system image (blocks)
   uint nblocks;      // Number of data blocks
   uint ninodes;      // Number of inodes.
+  uint tagino;       // Tag index inode, 0 if none
+  uint logstart;     // First block of the log
+  uint nlog;         // Number of log blocks, header included
+  uint bsize;        // Block size in bytes, BSIZE
+  uint flags;        // SB_INLINE
+  uint agblocks;     // Blocks per allocation group, 0 for just one
+  uint aginodes;     // Inodes per allocation group
 };
 
-#define NDIRECT 12
+#define SB_INLINE 0x1  // made with mkfs -I: see F_INLINE and itags
+
+// Allocation groups.  The disk is split into groups of agblocks
+// blocks, the first holding the metadata too, and the inodes into
+// as many groups of aginodes.  The kernel puts a new inode in its
+// directory's group and its blocks in its own group's, so that a
+// directory's files sit together and near their inodes.
+#define NAGMAX 32  // most groups mkfs makes
+
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
+#define NITAGS 64  // bytes of inline tags, making a dinode 128 bytes
 
 // On-disk inode structure
 struct dinode {
@@ -29,9 +56,49 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+2];   // Data block addresses
+  uint tags;            // Tag block address, 0 if untagged
+  uchar itags[NITAGS];  // Inline tags, while tags is 0 (SB_INLINE)
+};
+
+// On a file system with SB_INLINE, a T_FILE of at most NINLINE
+// bytes may keep its contents in addrs rather than in a block;
+// the F_INLINE bit in its major (unused for T_FILE) says so.  It
+// moves out to a block when it grows past NINLINE.  An inode's
+// first tags go in itags, laid out like a tag block NITAGS bytes
+// long.  When an insert doesn't fit there, the entries move to a
+// tag block at dinode.tags and itags is no longer used.
+#define F_INLINE 0x2
+#define NINLINE ((NDIRECT+2) * sizeof(uint))
+
+// Tag blocks.  An inode's tags live in a chain of blocks starting
+// at dinode.tags.  Each block begins with a taghdr and an array of
+// nent entry offsets sorted by key; the entries fill the block
+// downward from the end.  An entry is a key length byte, a value
+// length byte, then the key and value bytes.
+#define TAGKEYMAX 31   // longest key
+#define TAGVALMAX 255  // longest value
+
+struct taghdr {
+  uint next;     // Next tag block, 0 at end of chain
+  ushort nent;   // Number of entries
+  ushort free;   // Offset of the lowest entry byte
 };
 
+// Tag index is a hash file of (inode, hash of key and value)
+// entries, probing forward one block at a time.  A slot with inum
+// 0 is free; a free slot with a nonzero hash is a deleted entry,
+// and probes stop only at a block holding a never-used slot.
+#define NTAGHASH 32  // blocks in the index made by mkfs
+
+struct tagent {
+  uint inum;
+  uint hash;
+};
+
+// Tag entries per block.
+#define TPB           (BSIZE / sizeof(struct tagent))
+
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
@@ -52,4 +119,19 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block.
+#define DPB (BSIZE / sizeof(struct dirent))
+
+// A directory is a plain list of entries until it grows past
+// DIRHASHMIN blocks.  Then it becomes hashed: the D_HASHED bit is
+// set in its dinode's major (unused for T_DIR), and each entry
+// lives in block dirhash(name) % nblocks or, if that block is
+// full, one of the DIRPROBE blocks after it.  A free entry with a
+// name is a deleted one; lookups stop at a block with an entry
+// that was never used.  The table doubles when an insert finds
+// no free entry within DIRPROBE blocks.
+#define D_HASHED 0x1
+#define DIRHASHMIN 4
+#define DIRPROBE 4
+
 #endif // _FS_H_
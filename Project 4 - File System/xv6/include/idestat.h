@@ -0,0 +1,11 @@
+#ifndef _IDESTAT_H_
+#define _IDESTAT_H_
+struct idestat {
+  uint ncmd; // disk commands issued
+  uint nsect; // sectors transferred
+  uint seek; // total distance in sectors between consecutive commands
+  uint depth; // bufs in the disk queue now
+  uint maxdepth; // most bufs ever in the disk queue
+  uint depthsum; // sum of the queue depth seen by each new buf
+};
+#endif // _IDESTAT_H_
@@ -0,0 +1,10 @@
+#ifndef _KSM_H_
+#define _KSM_H_
+// Same-page merging state; see ksm().
+struct ksmstat {
+  int on; // is ksmd scanning?
+  uint passes; // times it has been over every process
+  uint stable; // merged pages now held, one copy each
+  uint merged; // pages replaced by a merged copy
+};
+#endif // _KSM_H_
@@ -0,0 +1,16 @@
+#ifndef _MMAN_H_
+#define _MMAN_H_
+
+// Protection options for use with mmap
+
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2  // not supported: mappings are read-only
+
+// Advice for madvise on how memory will be used
+
+#define MADV_NORMAL     0  // no read-ahead for mappings
+#define MADV_SEQUENTIAL 2  // read a mapping's file ahead of faults
+#define MADV_WILLNEED   3  // start reading the file pages in now
+#define MADV_DONTNEED   4  // free the pages; the next touch starts afresh
+
+#endif //_MMAN_H_
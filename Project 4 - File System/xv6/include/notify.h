@@ -0,0 +1,19 @@
+#ifndef _NOTIFY_H_
+#define _NOTIFY_H_
+// File system changes, as read from a notify_open fd.
+#define NOTE_CREATE    0x01  // name was made in directory dir
+#define NOTE_UNLINK    0x02  // name was removed from directory dir
+#define NOTE_WRITE     0x04  // the file's data was written
+#define NOTE_TAG       0x08  // tag key was set or changed
+#define NOTE_UNTAG     0x10  // tag key was removed
+#define NOTE_OVERFLOW  0x20  // events after the one before were lost
+#define NOTE_ALL       0x1f
+
+struct notifyevent {
+  int type;       // NOTE_*
+  uint inum;      // the file, 0 for NOTE_OVERFLOW
+  uint dir;       // for NOTE_CREATE and NOTE_UNLINK
+  char name[32];  // NUL-terminated: the key for NOTE_TAG and
+                  // NOTE_UNTAG, the name for NOTE_CREATE and NOTE_UNLINK
+};
+#endif // _NOTIFY_H_
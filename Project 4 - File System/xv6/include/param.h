@@ -3,17 +3,61 @@
 
 // System parameters
 
-#define NPROC        64  // maximum number of processes
-#define KSTACKSIZE 4096  // size of per-process kernel stack
+#define NPROC       512  // maximum number of processes
+#define KSTACKSIZE 8192  // size of per-process kernel stack; 2^n pages
 #define NCPU          8  // maximum number of CPUs
-#define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NBUF         10  // size of disk block cache
-#define NINODE       50  // maximum number of active i-nodes
+#ifndef HZ
+#define HZ          100  // timer interrupts per second; make HZ=n sets it
+#endif
+#define NLOCKSTAT    64  // lock names with lockstat counters
+#define NLATENCY     16  // call sites the latency tracer keeps
+#define NSYSCALL    128  // room for SYS_ numbers in syscallstat counters
+#define NOFILE       16  // open files per process before its table grows
+#define NOFILEMAX  1024  // open files per process; a page of pointers
+#define NBUF         10  // minimum size of disk block cache
+#define BCACHEFRAC   64  // disk block cache gets physstop/BCACHEFRAC bytes
+#define KLOWFRAC     64  // caches shrink when under physstop/KLOWFRAC bytes are free
+#define NKSTAT       16  // subsystems with kstat counters
+#define NSHRINKER     8  // caches that give memory back to kalloc
+#define NPMC          4  // performance counters a process may use
+#define FLUSHTICKS  HZ   // clock ticks between buffer cache write-backs
+#define NRAHEAD       8  // blocks of read-ahead for sequential readers
+#define NRAMAX       32  // most blocks one read-ahead starts
+#define NMRAHEAD      8  // pages of read-ahead for MADV_SEQUENTIAL mappings
+#define NAIOD         4  // threads serving aio_read and aio_write
+#define NAIOREQ      64  // aio requests outstanding per aio file
+#define AIOMAX    65536  // bytes per aio request
+#define NNOTIFYEV    64  // events queued per notify file
+#define NINODE       50  // minimum size of the inode cache
+#define ICACHEFRAC  128  // inode cache gets physstop/ICACHEFRAC bytes
 #define NDEV         10  // maximum major device number
-#define ROOTDEV       1  // device number of file system root disk
-#define USERTOP  0xA0000 // end of user address space
-#define PHYSTOP  0x1000000 // use phys mem up to here as free pool
+#ifndef ROOTDEV
+#define ROOTDEV       1  // device number of file system root disk; make STRIPE=1 sets it
+#endif
+#define RAMDEV        2  // device number of the RAM disk (ramdisk.c)
+#define STRIPEDEV     3  // IDE disks 1 and 2 striped block by block (ide.c)
+#define SWAPDEV       4  // IDE disk 3, the swap area (swap.c)
+#ifndef NSWAP
+#define NSWAP     65536  // pages of swap; make SWAPPAGES=n sets it
+#endif
+#define SWAPBATCH    16  // pages swapped out per reclaim
+#define USERBASE 0x40000000 // start of user address space
+#define USERTOP  0xFE000000 // end of user address space (devices above)
+#define USTACKTOP (USERTOP - 2*4096) // user stacks grow down from the vdso...
+#define USTACK   (USTACKTOP - 0x800000) // ...at most to here (see lazyfault)
+#define MMAPTOP  (USTACK - 4096) // mmap and the heap stay below a guard page
+#define KSTACKBASE (USERBASE - 0x800000) // guarded kernel stacks (vm.c)
+#define PHYSMAX  KSTACKBASE  // use at most this much phys mem (see physstop)
+#define MAXORDER    10  // largest kalloc_order block is 2^MAXORDER pages
 #define MAXARG       32  // max exec arguments
+#define MAXPATH     128  // longest path a system call takes
+#define NPRIO         4  // scheduler priority levels; 1 means round robin
+#define BOOSTTICKS  HZ   // clock ticks between priority boosts
+#define NVMA          8  // mmap regions per process
+#define NSEG          4  // loadable ELF segments per program
+#define NPCACHE    1024  // file pages in the page cache
+#define NDSTAT       32  // most entries one getdents_stat returns
+#define MAXOPBLOCKS  16  // max # of blocks any FS op writes
+#define LOGSIZE      (MAXOPBLOCKS*3)  // max data sectors in on-disk log
 
 #endif // _PARAM_H_
@@ -0,0 +1,17 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+// Events for perfctr: the architectural events of Intel's
+// performance monitoring, as umask << 8 | event select.  Any
+// other raw event of the CPU works the same way.
+#define PERF_CYCLES    0x003C  // Core cycles while not halted
+#define PERF_INSTR     0x00C0  // Instructions retired
+#define PERF_REFCYCLES 0x013C  // Reference cycles while not halted
+#define PERF_LLCREF    0x4F2E  // Last-level cache references
+#define PERF_LLCMISS   0x412E  // Last-level cache misses
+#define PERF_BRANCH    0x00C4  // Branches retired
+#define PERF_BRMISS    0x00C5  // Branches mispredicted
+
+// Flags for perfctr: where to count.  Neither means user mode.
+#define PERF_USER      1
+#define PERF_KERNEL    2
+#endif // _PERF_H_
@@ -0,0 +1,22 @@
+#ifndef _POLL_H_
+#define _POLL_H_
+// Events for poll.  A pipe's read end is POLLIN while it holds
+// data and POLLHUP once its writers are gone; its write end is
+// POLLOUT while it has room and POLLERR once its readers are
+// gone.  The console is POLLIN while a line is waiting, and a
+// socket while a datagram is, and an aio file while a finished
+// request is, and a notify file while an event is.  Other files
+// are always ready.  POLLERR, POLLHUP and POLLNVAL are
+// reported whether asked for or not.
+#define POLLIN   0x001  // read won't block
+#define POLLOUT  0x004  // write won't block
+#define POLLERR  0x008  // write end of a pipe with no readers
+#define POLLHUP  0x010  // read end of a pipe with no writers
+#define POLLNVAL 0x020  // fd isn't open
+
+struct pollfd {
+  int fd;         // file descriptor; ignored if negative
+  short events;   // POLLIN and POLLOUT asked about
+  short revents;  // events that happened
+};
+#endif // _POLL_H_
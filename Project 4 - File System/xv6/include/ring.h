@@ -0,0 +1,28 @@
+#ifndef _RING_H_
+#define _RING_H_
+// A ring of system calls for ringenter to make in one trap.
+// The program fills sq[sqtail % RINGSIZE] and bumps sqtail;
+// ringenter runs entries from sqhead up, posting each result
+// at cq[cqtail % RINGSIZE], until sq is empty or cq is full.
+#define RINGSIZE 32
+
+struct ringsqe {
+  int op;         // SYS_* number; not fork, exec, exit, sbrk or ringenter
+  uint data;      // Copied to the completion
+  int arg[5];     // Arguments, as the call's stub would pass them
+};
+
+struct ringcqe {
+  uint data;
+  int res;        // What the call returned
+};
+
+struct ring {
+  uint sqhead;    // Advanced by the kernel
+  uint sqtail;    // Advanced by the program
+  uint cqhead;    // Advanced by the program
+  uint cqtail;    // Advanced by the kernel
+  struct ringsqe sq[RINGSIZE];
+  struct ringcqe cq[RINGSIZE];
+};
+#endif // _RING_H_
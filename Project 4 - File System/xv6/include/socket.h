@@ -0,0 +1,23 @@
+#ifndef _SOCKET_H_
+#define _SOCKET_H_
+// UDP over IPv4; see kernel/net.c.  Addresses and ports are in
+// host byte order.
+#include "uio.h"
+
+#define IPADDR(a, b, c, d) ((uint)(a) << 24 | (b) << 16 | (c) << 8 | (d))
+#define INADDR_ANY       0
+#define INADDR_LOOPBACK  IPADDR(127, 0, 0, 1)
+#define INADDR_BROADCAST 0xffffffff
+
+#define UDP_MAXDATA 1472  // largest datagram, to fit one Ethernet frame
+#define MMSG_MAX    64    // most datagrams one sendmmsg or recvmmsg takes
+
+// One datagram for sendmmsg or recvmmsg.
+struct mmsghdr {
+  struct iovec *msg_iov;  // buffers for the data
+  int msg_iovlen;
+  uint addr;              // peer: where to send, 0 for the connected
+  ushort port;            // one; or where it came from
+  int len;                // bytes sent or received
+};
+#endif // _SOCKET_H_
@@ -0,0 +1,13 @@
+#ifndef _SPAWN_H_
+#define _SPAWN_H_
+// File actions for spawn(), done in order on the child's copy of
+// the caller's open files before the program starts.
+#define SPAWN_CLOSE 1 // close fd
+#define SPAWN_DUP2  2 // make newfd another reference to fd
+#define SPAWN_MAX   8 // most actions one spawn takes
+struct spawnact {
+  int op;
+  int fd;
+  int newfd; // for SPAWN_DUP2
+};
+#endif // _SPAWN_H_
@@ -0,0 +1,9 @@
+#ifndef _SWAPSTAT_H_
+#define _SWAPSTAT_H_
+struct swapstat {
+  uint size; // pages in the swap area; 0 if there is none
+  uint used; // pages held by swapped-out PTEs
+  uint out; // pages written out
+  uint in; // pages read back from disk
+};
+#endif // _SWAPSTAT_H_
@@ -28,5 +28,62 @@
 #define SYS_getFileTag 24
 #define SYS_getAllTags 25
 #define SYS_getFilesByTag 26
+#define SYS_bcachestat 27
+#define SYS_sync 28
+#define SYS_fsync 29
+#define SYS_idestat 30
+#define SYS_tagFileBatch 31
+#define SYS_getFileTags 32
+#define SYS_pread 33
+#define SYS_pwrite 34
+#define SYS_readv 35
+#define SYS_writev 36
+#define SYS_mmap 37
+#define SYS_sendfile 38
+#define SYS_splice 39
+#define SYS_tee 40
+#define SYS_getprocs 41
+#define SYS_setaffinity 42
+#define SYS_lockstat 43
+#define SYS_ringenter 44
+#define SYS_syscallstat 45
+#define SYS_clock_gettime 46
+#define SYS_intrstat 47
+#define SYS_irqaffinity 48
+#define SYS_profctl 49
+#define SYS_profread 50
+#define SYS_tracectl 51
+#define SYS_traceread 52
+#define SYS_spawn 53
+#define SYS_ftruncate 54
+#define SYS_fallocate 55
+#define SYS_poll 56
+#define SYS_fcntl 57
+#define SYS_mount 58
+#define SYS_socket 59
+#define SYS_bind 60
+#define SYS_connect 61
+#define SYS_sendmmsg 62
+#define SYS_recvmmsg 63
+#define SYS_swapstat 64
+#define SYS_shrinkstat 65
+#define SYS_ksm 66
+#define SYS_getdents_stat 67
+#define SYS_getprocstat 68
+#define SYS_perfctr 69
+#define SYS_latencyctl 70
+#define SYS_getlatency 71
+#define SYS_aio_setup 72
+#define SYS_aio_read 73
+#define SYS_aio_write 74
+#define SYS_getFilesByQuery 75
+#define SYS_getFilesByTagPage 76
+#define SYS_notify_open 77
+#define SYS_copy_file_range 78
+#define SYS_mktemplate 79
+#define SYS_spawn_from 80
+#define SYS_madvise 81
+#define SYS_vmsplice 82
+#define SYS_dropcaches 83
 
 #endif // _SYSCALL_H_
\ No newline at end of file
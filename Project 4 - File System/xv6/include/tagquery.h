@@ -0,0 +1,26 @@
+#ifndef _TAGQUERY_H_
+#define _TAGQUERY_H_
+// A getFilesByQuery query: terms in postfix order, so
+// "type=log AND host=a" is {TQ_EQ type log}, {TQ_EQ host a}, {TQ_AND}.
+#define TQ_EQ      1  // key is set to value
+#define TQ_PREFIX  2  // key is set to a value that starts with value
+#define TQ_EXISTS  3  // key is set
+#define TQ_AND     4  // both of the two terms before
+#define TQ_OR      5  // either of the two terms before
+#define TQ_NOT     6  // not the term before
+#define TQMAX      8  // most terms in a query
+
+struct tagterm {
+  int op;               // TQ_*
+  char key[32];         // NUL-terminated, for TQ_EQ, TQ_PREFIX, TQ_EXISTS
+  int valueLength;      // for TQ_EQ and TQ_PREFIX
+  char value[255];
+};
+
+// A getFilesByTagPage result: a file and one of its names.
+struct tagrec {
+  uint inum;
+  char name[16];        // NUL-terminated
+};
+#define TAGCUR_END 0xffffffff  // cursor after the last page
+#endif // _TAGQUERY_H_
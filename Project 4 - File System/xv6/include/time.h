@@ -0,0 +1,10 @@
+#ifndef _TIME_H_
+#define _TIME_H_
+// Clocks for clock_gettime().
+#define CLOCK_MONOTONIC 1  // time since boot, from the TSC
+
+struct timespec {
+  uint tv_sec;
+  uint tv_nsec;  // below 1000000000
+};
+#endif // _TIME_H_
@@ -0,0 +1,39 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+// Tracepoint events, and what a and b of a TraceRec hold for each.
+#define TR_SWITCHIN  0 // a: pid the CPU switches to
+#define TR_SWITCHOUT 1 // a: pid switched away from, b: its state
+#define TR_SYSENTER  2 // a: syscall number
+#define TR_SYSEXIT   3 // a: syscall number, b: return value
+#define TR_BREAD     4 // a: sector, b: 1 if cached
+#define TR_IDEQUEUE  5 // a: sector, b: 1 for a write
+#define TR_IDEDONE   6 // a: sector, b: 1 for a write
+#define TR_KALLOC    7 // a: page, or 0 if out of memory
+#define TR_KFREE     8 // a: page
+#define TR_BIO       9 // a: sector, b: BIOREC of its dev, op and flags
+#define NTRACEEV     10
+#define TR_ALL ((1 << NTRACEEV) - 1)
+#define NTRACEREC 512 // records each CPU holds; a power of two
+// TR_BIO records every use of the buffer cache and every disk
+// transfer, enough to replay against other cache designs (see
+// tools/bioreplay.c).
+#define BIO_GET   0 // bread or breadahead looked the block up
+#define BIO_NEW   1 // bclear or boverwrite did; a miss reads nothing
+#define BIO_DIRTY 2 // bwrite marked it dirty
+#define BIO_READ  3 // the block layer started reading it
+#define BIO_WRITE 4 // ... or writing it
+#define BIO_HIT   1 // flag: the block was cached
+#define BIO_META  2 // flag: file system metadata (see breadmeta)
+#define BIOREC(dev, op, flags) ((dev) << 8 | (op) << 2 | (flags))
+#define BIO_DEV(b)   ((b) >> 8)
+#define BIO_OP(b)    (((b) >> 2) & 7)
+// One tracepoint hit; see traceread().
+struct TraceRec {
+  uint64 tsc; // rdtsc when it happened
+  ushort ev;
+  ushort cpu;
+  int pid; // process running, or 0
+  uint a;
+  uint b;
+};
+#endif // _TRACE_H_
@@ -37,6 +37,8 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      20      // IPI to a halted CPU: work is queued
 #define IRQ_SPURIOUS    31
+#define NIRQ            32      // IRQs counted by intrstat
 
 #endif // _TRAPS_H_
@@ -6,7 +6,9 @@
 typedef unsigned int   uint;
 typedef unsigned short ushort;
 typedef unsigned char  uchar;
+typedef unsigned long long uint64;
 typedef uint pde_t;
+typedef uint pte_t;
 #ifndef NULL
 #define NULL (0)
 #endif
@@ -14,8 +16,16 @@ typedef uint pde_t;
 #ifndef _KEY_H_
 #define _KEY_H_
 struct Key {
-  char key[10];  // at most 10 bytes for key
+  char key[32];  // at most 31 bytes for key, NUL-terminated
 };
 #endif // _KEY_H_
 
+#ifndef _VALUE_H_
+#define _VALUE_H_
+struct Value {
+  char value[255];  // at most 255 bytes for value
+  int length;       // bytes of value in use
+};
+#endif // _VALUE_H_
+
 #endif //_TYPES_H_
@@ -0,0 +1,8 @@
+#ifndef _UIO_H_
+#define _UIO_H_
+#define IOV_MAX 16  // most buffers one readv or writev takes
+struct iovec {
+  void *iov_base; // start of buffer
+  int iov_len;    // bytes in buffer
+};
+#endif // _UIO_H_
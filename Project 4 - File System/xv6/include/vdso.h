@@ -0,0 +1,31 @@
+#ifndef _VDSO_H_
+#define _VDSO_H_
+// Kernel data that user programs read without a system call,
+// mapped read-only at VDSO in every address space (see vdso.c).
+// The first page is shared by every process; the second is the
+// process's own.
+#ifndef PGSIZE
+#define PGSIZE 4096  // as mmu.h has it, for user programs
+#endif
+#define VDSO        (USERTOP - 2*PGSIZE)
+#define VDSOPROC    (VDSO + PGSIZE)
+
+// Updated on each tick of the clock.  seq is odd while it is
+// being updated; a reader that sees it change, or odd, reads
+// again.
+struct vdata {
+  volatile uint seq;
+  volatile uint ticks;         // As uptime() returns
+  volatile uint64 tsc;         // TSC at the start of that tick
+  volatile uint64 tscpertick;  // TSC cycles per tick
+  uint tsckhz;                 // TSC cycles per millisecond
+  uint64 boottsc;              // TSC at time 0 of CLOCK_MONOTONIC
+};
+
+struct vproc {
+  int pid;                     // As getpid() returns
+  volatile int cpu;            // CPU it is running on, from 0
+  volatile uint pmcseq;        // Changes whenever pmc[] does
+  volatile uint64 pmc[NPMC];   // perfctr counts up to its last switch
+};
+#endif // _VDSO_H_
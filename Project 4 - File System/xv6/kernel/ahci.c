@@ -0,0 +1,314 @@
+// AHCI (SATA) driver, for the file system disk under QEMU with
+// make AHCI=1.
+//
+// The HBA's registers are memory mapped through BAR5; each port
+// has a list of 32 command slots in memory.  A buf takes a free
+// slot, whose command table holds the FIS and one PRD for the
+// buf's data, and is issued without waiting for the others, so
+// the elevator and read-ahead can keep up to 32 requests with
+// the disk.  When the HBA supports native command queuing the
+// commands are READ/WRITE FPDMA QUEUED, tagged by slot, and the
+// disk may finish them in any order; a slot is done once its
+// bit has left PxSACT.  Otherwise they are DMA EXT commands, done
+// once they leave PxCI.
+//
+// The interrupt handler only acknowledges the port, as ideintr
+// does; a work item completes every finished slot in one pass.
+// The block layer sends the bufs of dev 1 here when the first
+// port with a disk is found.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "buf.h"
+#include "pci.h"
+#include "fs.h"
+#include "work.h"
+
+#define PCI_SUBCLASS_SATA 0x06
+
+// HBA registers, as uint indexes from ABAR.
+#define HBA_CAP     (0x00/4)
+#define HBA_GHC     (0x04/4)
+#define HBA_IS      (0x08/4)
+#define HBA_PI      (0x0c/4)
+#define CAP_SNCQ    (1<<30)   // supports native command queuing
+#define CAP_NCS(x)  ((((x) >> 8) & 0x1f) + 1)  // command slots
+#define GHC_AE      (1U<<31)  // AHCI enable
+#define GHC_IE      (1<<1)    // interrupt enable
+
+// Port registers, as uint indexes from the port's base.
+#define PORT(i)     (0x100/4 + (i)*0x80/4)
+#define PX_CLB      (0x00/4)
+#define PX_CLBU     (0x04/4)
+#define PX_FB       (0x08/4)
+#define PX_FBU      (0x0c/4)
+#define PX_IS       (0x10/4)
+#define PX_IE       (0x14/4)
+#define PX_CMD      (0x18/4)
+#define PX_TFD      (0x20/4)
+#define PX_SIG      (0x24/4)
+#define PX_SSTS     (0x28/4)
+#define PX_SERR     (0x30/4)
+#define PX_SACT     (0x34/4)
+#define PX_CI       (0x38/4)
+#define CMD_ST      (1<<0)    // start processing the command list
+#define CMD_FRE     (1<<4)    // FIS receive enable
+#define CMD_FR      (1<<14)   // FIS receive running
+#define CMD_CR      (1<<15)   // command list running
+#define IS_DHRS     (1<<0)    // device to host register FIS
+#define IS_SDBS     (1<<3)    // set device bits FIS (NCQ done)
+#define IS_TFES     (1<<30)   // task file error
+#define TFD_BSY     0x80
+#define TFD_DRQ     0x08
+#define TFD_ERR     0x01
+#define SIG_ATA     0x00000101
+
+#define FIS_H2D     0x27
+#define ATA_READ_DMA_EXT   0x25
+#define ATA_WRITE_DMA_EXT  0x35
+#define ATA_READ_FPDMA     0x60
+#define ATA_WRITE_FPDMA    0x61
+
+#define NSLOT       32
+#define SPB         (BSIZE / SECTSIZE)
+
+// Command header: one per slot in the command list.
+struct cmdhdr {
+  ushort flags;   // FIS length in dwords, W (1<<6) if a write
+  ushort prdtl;   // PRD entries
+  uint prdbc;     // bytes transferred
+  uint ctba;      // command table address, 128-byte aligned
+  uint ctbau;
+  uint reserved[4];
+};
+#define HDR_WRITE   (1<<6)
+
+struct prdent {
+  uint dba;
+  uint dbau;
+  uint reserved;
+  uint dbc;       // byte count - 1
+};
+
+// Command table: the FIS to send and where the data goes.
+// Padded to 256 bytes to keep each one 128-byte aligned.
+struct cmdtbl {
+  uchar cfis[64];
+  uchar acmd[16];
+  uchar reserved[48];
+  struct prdent prd;
+  uchar pad[256 - 128 - sizeof(struct prdent)];
+};
+
+int ahciirq;  // IRQ line, 0 if there is no disk
+
+static struct {
+  struct spinlock lock;
+  volatile uint *hba;
+  volatile uint *port;      // the port the disk is on
+  int portno;
+  int nslot;
+  int ncq;                  // use FPDMA QUEUED commands
+  struct cmdhdr *list;      // NSLOT headers
+  struct cmdtbl *tbl;       // NSLOT tables
+  uint busy;                // slots issued and not yet completed
+  struct buf *slot[NSLOT];
+  struct work work;
+} ahci __attribute__((aligned(CACHELINE)));
+
+static void ahcicomplete(void*);
+
+// Stop port p's command list and FIS receive engines.
+static void
+portstop(volatile uint *p)
+{
+  int i;
+
+  p[PX_CMD] &= ~(CMD_ST | CMD_FRE);
+  for(i = 0; i < 1000000 && (p[PX_CMD] & (CMD_CR | CMD_FR)); i++)
+    ;
+}
+
+// Find the HBA and the first port with a disk, and set the port
+// up.  Leaves ahciirq 0 if there is none.
+void
+ahciinit(void)
+{
+  volatile uint *p;
+  uint bar, pi;
+  char *mem;
+  int tag, i;
+
+  if((tag = pcifindclass(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA)) < 0)
+    return;
+  bar = pciread(tag, PCI_BAR(5)) & ~0xf;
+  if(bar < USERTOP)
+    return;  // not where the kernel maps devices
+  pciwrite(tag, PCI_CMD, pciread(tag, PCI_CMD) | PCI_CMD_MEM | PCI_CMD_MASTER);
+  ahci.hba = (volatile uint*)bar;
+  ahci.hba[HBA_GHC] |= GHC_AE;
+
+  pi = ahci.hba[HBA_PI];
+  for(i = 0; i < 32; i++){
+    if(!(pi & (1U << i)))
+      continue;
+    p = ahci.hba + PORT(i);
+    if((p[PX_SSTS] & 0xf) == 3 && p[PX_SIG] == SIG_ATA)
+      break;
+  }
+  if(i == 32)
+    return;
+  ahci.portno = i;
+  ahci.port = p;
+  ahci.nslot = CAP_NCS(ahci.hba[HBA_CAP]);
+  ahci.ncq = (ahci.hba[HBA_CAP] & CAP_SNCQ) != 0;
+
+  // Page 0: command list, then received FISes; pages 1-2: tables.
+  if((mem = kalloc_order(2)) == 0)
+    return;
+  memset(mem, 0, 4*PGSIZE);
+  ahci.list = (struct cmdhdr*)mem;
+  ahci.tbl = (struct cmdtbl*)(mem + PGSIZE);
+  for(i = 0; i < NSLOT; i++){
+    ahci.list[i].ctba = (uint)&ahci.tbl[i];
+    ahci.list[i].prdtl = 1;
+  }
+
+  portstop(p);
+  // Memory is identity mapped, so these are physical addresses.
+  p[PX_CLB] = (uint)ahci.list;
+  p[PX_CLBU] = 0;
+  p[PX_FB] = (uint)mem + 1024;
+  p[PX_FBU] = 0;
+  p[PX_SERR] = ~0;
+  p[PX_IS] = ~0;
+  for(i = 0; i < 1000000 && (p[PX_TFD] & (TFD_BSY|TFD_DRQ)); i++)
+    ;
+  p[PX_CMD] |= CMD_FRE;
+  p[PX_CMD] |= CMD_ST;
+
+  initlock(&ahci.lock, "ahci");
+  work_init(&ahci.work, ahcicomplete, 0);
+  ahciirq = pciread(tag, PCI_INTR) & 0xff;
+  picenable(ahciirq);
+  ioapicenable(ahciirq, ncpu - 1);
+  p[PX_IE] = IS_DHRS | IS_SDBS | IS_TFES;
+  ahci.hba[HBA_IS] = ~0;
+  ahci.hba[HBA_GHC] |= GHC_IE;
+  cprintf("ahci: port %d, %d slots%s, irq %d\n", ahci.portno,
+          ahci.nslot, ahci.ncq ? ", ncq" : "", ahciirq);
+}
+
+// Issue the read or write of b in a free slot, waiting for one
+// if all are busy.  Caller holds ahci.lock.
+static void
+ahcistart(struct buf *b)
+{
+  struct cmdtbl *t;
+  uchar *f;
+  uint lba;
+  int s, w;
+
+  for(;;){
+    for(s = 0; s < ahci.nslot && (ahci.busy & (1U << s)); s++)
+      ;
+    if(s < ahci.nslot)
+      break;
+    sleep(&ahci.busy, &ahci.lock);
+  }
+  w = (b->flags & B_DIRTY) != 0;
+  lba = b->sector * SPB;
+
+  t = &ahci.tbl[s];
+  memset(t->cfis, 0, sizeof(t->cfis));
+  f = t->cfis;
+  f[0] = FIS_H2D;
+  f[1] = 0x80;  // a command, not a control write
+  f[4] = lba;
+  f[5] = lba >> 8;
+  f[6] = lba >> 16;
+  f[7] = 0x40;  // LBA mode
+  f[8] = lba >> 24;
+  if(ahci.ncq){
+    f[2] = w ? ATA_WRITE_FPDMA : ATA_READ_FPDMA;
+    f[3] = SPB;       // count goes in features
+    f[12] = s << 3;   // tag
+  } else {
+    f[2] = w ? ATA_WRITE_DMA_EXT : ATA_READ_DMA_EXT;
+    f[12] = SPB;
+  }
+  t->prd.dba = (uint)b->data;
+  t->prd.dbau = 0;
+  t->prd.dbc = BSIZE - 1;
+  ahci.list[s].flags = 5 | (w ? HDR_WRITE : 0);  // 5 dwords of FIS
+  ahci.list[s].prdbc = 0;
+
+  ahci.slot[s] = b;
+  ahci.busy |= 1U << s;
+  __sync_synchronize();  // table before the HBA sees the slot
+  if(ahci.ncq)
+    ahci.port[PX_SACT] = 1U << s;
+  ahci.port[PX_CI] = 1U << s;
+}
+
+// Issue the bufs of list, chained by qnext, to be read or
+// written.  The block layer waits for them (see blkdone).
+void
+ahcisubmit(struct buf *list)
+{
+  struct buf *b, *next;
+
+  acquire(&ahci.lock);
+  for(b = list; b; b = next){
+    next = b->qnext;
+    ahcistart(b);
+  }
+  release(&ahci.lock);
+}
+
+void
+ahciintr(void)
+{
+  uint is;
+
+  if(!(ahci.hba[HBA_IS] & (1U << ahci.portno)))
+    return;
+  is = ahci.port[PX_IS];
+  ahci.port[PX_IS] = is;  // write 1 to clear
+  ahci.hba[HBA_IS] = 1U << ahci.portno;
+  if(is & IS_TFES)
+    panic("ahciintr: disk error");
+  queue_work(&ahci.work);
+}
+
+// Finish every slot the disk has finished.
+static void
+ahcicomplete(void *arg)
+{
+  struct buf *b, *list;
+  uint done;
+  int s;
+
+  acquire(&ahci.lock);
+  done = ahci.busy & ~ahci.port[ahci.ncq ? PX_SACT : PX_CI];
+  list = 0;
+  for(s = 0; s < ahci.nslot; s++){
+    if(!(done & (1U << s)))
+      continue;
+    b = ahci.slot[s];
+    ahci.slot[s] = 0;
+    b->qnext = list;
+    list = b;
+  }
+  if(done){
+    ahci.busy &= ~done;
+    wakeup(&ahci.busy);
+  }
+  release(&ahci.lock);
+  blkdone(list);
+}
@@ -0,0 +1,288 @@
+// Asynchronous file I/O.
+//
+// aio_setup makes an aio file; aio_read and aio_write queue a
+// read or write at an offset of an inode file and return at
+// once.  Reading the aio file gives a struct aioevent for each
+// request that has finished, in the order they finished, and
+// poll says POLLIN while there is one.  So one process can keep
+// several reads in flight and pick up each as it lands.
+//
+// NAIOD kernel threads serve the requests from one queue, each
+// with filepread or filepwrite, so up to NAIOD are at the disk
+// at once, each with its read-ahead.  A kernel thread can't
+// reach the caller's memory, so data goes through a kernel
+// buffer: a write's is copied in when it is queued, and a
+// read's is copied out to the caller's buffer when its event is
+// read, in the address space of whoever reads it.
+//
+// A request holds a reference to its file and to its aio file's
+// context, so either may be closed while it is in flight.
+// Lock order: ctx->lock, then ptable.lock (pollwake); aio.lock
+// is never held with another.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+#include "aio.h"
+
+struct aioreq {
+  struct aioreq *next;
+  struct aioctx *ctx;
+  struct file *f;
+  int write;
+  char *buf;             // Kernel copy of the data
+  int order;             // buf's size, as a kalloc_order
+  char *ubuf;            // Caller's buffer
+  int n;
+  uint off;
+  uint tag;
+  int res;
+};
+
+struct aioctx {
+  struct spinlock lock;
+  int ref;               // The aio file and each request
+  int nreq;              // Requests not yet read back
+  struct aioreq *done;   // Finished, oldest first
+  struct aioreq **tail;
+  struct pollent *pollq;
+};
+
+static struct {
+  struct spinlock lock;
+  struct aioreq *head;   // Waiting for a thread
+  struct aioreq **tail;
+  struct kmem_cache *ctxcache;
+  struct kmem_cache *reqcache;
+} aio __attribute__((aligned(CACHELINE)));
+
+static void
+reqfree(struct aioreq *r)
+{
+  kfree_order(r->buf, r->order);
+  kmem_cache_free(aio.reqcache, r);
+}
+
+// Drop a reference to ctx, freeing it with the last.
+static void
+ctxput(struct aioctx *ctx)
+{
+  struct aioreq *r;
+  int last;
+
+  acquire(&ctx->lock);
+  last = --ctx->ref == 0;
+  release(&ctx->lock);
+  if(!last)
+    return;
+  while((r = ctx->done) != 0){
+    ctx->done = r->next;
+    reqfree(r);
+  }
+  kmem_cache_free(aio.ctxcache, ctx);
+}
+
+// Serve queued requests, forever.
+static void
+aiod(void *arg)
+{
+  struct aioctx *ctx;
+  struct aioreq *r;
+
+  for(;;){
+    acquire(&aio.lock);
+    while((r = aio.head) == 0)
+      sleep(&aio, &aio.lock);
+    if((aio.head = r->next) == 0)
+      aio.tail = &aio.head;
+    release(&aio.lock);
+
+    if(r->write)
+      r->res = filepwrite(r->f, r->buf, r->n, r->off);
+    else
+      r->res = filepread(r->f, r->buf, r->n, r->off);
+    fileclose(r->f);
+    r->f = 0;
+
+    ctx = r->ctx;
+    acquire(&ctx->lock);
+    r->next = 0;
+    *ctx->tail = r;
+    ctx->tail = &r->next;
+    wakeup(ctx);
+    pollwake(ctx->pollq);
+    release(&ctx->lock);
+    ctxput(ctx);
+  }
+}
+
+void
+aioinit(void)
+{
+  int i;
+
+  initlock(&aio.lock, "aio");
+  aio.tail = &aio.head;
+  aio.ctxcache = kmem_cache_create("aioctx", sizeof(struct aioctx));
+  aio.reqcache = kmem_cache_create("aioreq", sizeof(struct aioreq));
+  for(i = 0; i < NAIOD; i++)
+    kthread_create("aiod", aiod, 0);
+}
+
+// Make an aio file in *f.
+int
+aioalloc(struct file **f)
+{
+  struct aioctx *ctx;
+
+  if((*f = filealloc()) == 0)
+    return -1;
+  if((ctx = kmem_cache_alloc(aio.ctxcache)) == 0){
+    fileclose(*f);
+    return -1;
+  }
+  memset(ctx, 0, sizeof(*ctx));
+  initlock(&ctx->lock, "aioctx");
+  ctx->ref = 1;
+  ctx->tail = &ctx->done;
+  (*f)->type = FD_AIO;
+  (*f)->readable = 1;
+  (*f)->aio = ctx;
+  return 0;
+}
+
+void
+aioclose(struct aioctx *ctx)
+{
+  ctxput(ctx);
+}
+
+// Queue a read (or a write, if write is set) of n bytes of f at
+// off, to or from buf in the caller's memory, to be reported on
+// ctx with tag.  Returns 0, or -1 if f isn't an inode file open
+// for it, n is out of range, or ctx has NAIOREQ requests
+// outstanding.
+int
+aiosubmit(struct aioctx *ctx, struct file *f, int write, char *buf, int n, uint off, uint tag)
+{
+  struct aioreq *r;
+  int order;
+
+  if(f->type != FD_INODE || (write ? !f->writable : !f->readable))
+    return -1;
+  if(n < 0 || n > AIOMAX)
+    return -1;
+  for(order = 0; (PGSIZE << order) < n; order++)
+    ;
+  acquire(&ctx->lock);
+  if(ctx->nreq == NAIOREQ){
+    release(&ctx->lock);
+    return -1;
+  }
+  ctx->nreq++;
+  ctx->ref++;
+  release(&ctx->lock);
+
+  if((r = kmem_cache_alloc(aio.reqcache)) == 0)
+    goto bad;
+  if((r->buf = kalloc_order(order)) == 0){
+    kmem_cache_free(aio.reqcache, r);
+    goto bad;
+  }
+  if(write)
+    memmove(r->buf, buf, n);
+  r->order = order;
+  r->ctx = ctx;
+  r->f = filedup(f);
+  r->write = write;
+  r->ubuf = buf;
+  r->n = n;
+  r->off = off;
+  r->tag = tag;
+  r->next = 0;
+
+  acquire(&aio.lock);
+  *aio.tail = r;
+  aio.tail = &r->next;
+  wakeup(&aio);
+  release(&aio.lock);
+  return 0;
+
+bad:
+  acquire(&ctx->lock);
+  ctx->nreq--;
+  release(&ctx->lock);
+  ctxput(ctx);
+  return -1;
+}
+
+// Read events for finished requests into dst, up to n bytes'
+// worth, copying read data to the buffers they were queued
+// with.  Waits for one unless nonblock is set.  Returns the
+// bytes of events read, or -1.
+int
+aioread(struct aioctx *ctx, char *dst, int n, int nonblock)
+{
+  struct aioevent *ev;
+  struct aioreq *r, *list;
+  int i, max;
+
+  max = n / sizeof(*ev);
+  if(max == 0)
+    return -1;
+  acquire(&ctx->lock);
+  while(ctx->done == 0){
+    if(nonblock || ctx->nreq == 0 || proc->killed){
+      release(&ctx->lock);
+      return -1;
+    }
+    sleep(ctx, &ctx->lock);
+  }
+  // Take up to max off the list, then copy without the lock,
+  // as the caller's pages may fault.
+  list = ctx->done;
+  for(i = 1, r = list; i < max && r->next; i++)
+    r = r->next;
+  if((ctx->done = r->next) == 0)
+    ctx->tail = &ctx->done;
+  r->next = 0;
+  ctx->nreq -= i;
+  release(&ctx->lock);
+
+  ev = (struct aioevent*)dst;
+  for(i = 0; (r = list) != 0; i++){
+    list = r->next;
+    if(!r->write && r->res > 0){
+      if(uvmcheck(proc, (uint)r->ubuf, r->res) < 0)
+        r->res = -1;
+      else
+        memmove(r->ubuf, r->buf, r->res);
+    }
+    ev[i].tag = r->tag;
+    ev[i].res = r->res;
+    reqfree(r);
+  }
+  return i * sizeof(*ev);
+}
+
+int
+aiopoll(struct aioctx *ctx, int events, struct pollent *e)
+{
+  int r;
+
+  r = 0;
+  acquire(&ctx->lock);
+  if(ctx->done)
+    r |= events & POLLIN;
+  if(r == 0 && e)
+    pollwait(&ctx->pollq, &ctx->lock, e);
+  release(&ctx->lock);
+  return r;
+}
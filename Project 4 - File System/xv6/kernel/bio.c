@@ -4,135 +4,689 @@
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
+//
+// Lookups go through a hash table keyed by (dev, sector) so that
+// a cache hit does not have to walk the replacement lists.  Each
+// hash bucket has its own lock, which protects the bucket chain and
+// the flags of the buffers on it.  bcache.lock protects the lists
+// and the ghosts and serializes eviction, the only operation that
+// moves a buffer from one bucket to another.  Never acquire
+// bcache.lock while holding a bucket lock.
+//
+// Replacement is 2Q, so that one pass over a big file doesn't
+// flush the blocks used over and over.  A block read in goes on
+// the in list, a FIFO that further hits don't reorder.  Blocks
+// leaving it are remembered, without their data, as ghosts; one
+// read again while its ghost is remembered has proved itself, and
+// goes on the hot list, which is LRU.  Eviction takes from the in
+// list while it holds more than a quarter of the buffers, so a
+// stream only ever recycles its own.  File system metadata (see
+// breadmeta) goes on the hot list the first time it is released.
+//
+// The buffers themselves are carved out of kalloc() pages at
+// binit() time, and their data from other pages, BSIZE-aligned.
+// The cache gets physstop/BCACHEFRAC bytes, but never fewer than
+// NBUF buffers.
+//
+// The cache is write-back: bwrite only marks a buffer dirty.
+// Dirty buffers stay pinned in the cache, so repeated writes to the
+// same block cost one disk write, until the bflush kernel process
+// writes them back every FLUSHTICKS ticks, bsync or bflush forces
+// them out, or bget runs out of clean buffers to recycle.
 // 
 // Interface:
-// * To get a buffer for a particular disk block, call bread.
-// * After changing buffer data, call bwrite to flush it to disk.
-// * When done with the buffer, call brelse.
+// * To get a buffer for a particular disk block, call bread,
+//   or breadmeta for a block of file system metadata.
+// * To start reading a block that will be needed soon, call breadahead.
+// * After changing buffer data, call bwrite to mark it dirty.
+// * To force dirty buffers to disk, call bsync or bflush.
+// * When done with the buffer, call brelse, or bdrop if the
+//   block won't be wanted again soon.
 // * Do not use the buffer after calling brelse.
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 // 
-// The implementation uses three state flags internally:
-// * B_BUSY: the block has been returned from bread
-//     and has not been passed back to brelse.  
+// A buffer returned from bread and not yet passed back to
+// brelse holds b->lock, a sleeplock guarded by its bucket's
+// lock.  Waiters for a busy buffer queue on it and get it in
+// turn; a locked buffer is never evicted.
+//
+// The implementation uses five state flags internally:
 // * B_VALID: the buffer data has been initialized
 //     with the associated disk block contents.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+// * B_ASYNC: a read-ahead is in flight; the block layer
+//     releases the buffer when it completes (see blkdone).
+// * B_LOGGED: the buffer is dirty in a transaction that has
+//     not committed; only the log may write it (see log.c).
+// * B_META: the buffer holds metadata, and goes on the hot list
+//     when released (see breadmeta).
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
 #include "buf.h"
+#include "bcachestat.h"
+#include "trace.h"
+
+#define NBUCKET 13  // number of hash buckets; prime spreads sectors
+#define NGHASH 61   // ghost hash chains
+#define BPP (PGSIZE / sizeof(struct buf))  // buffers per kalloc() page
+#define DPP (PGSIZE / BSIZE)               // buffer data per kalloc() page
+
+// Which list a buffer is on.
+#define BQ_IN  0
+#define BQ_HOT 1
+
+// A block evicted from the in list, remembered by number.
+struct ghost {
+  uint dev;
+  uint sector;
+  struct ghost *hnext;  // ghost hash chain
+};
+
+struct bucket {
+  struct spinlock lock;
+  struct buf *head;  // chain through hnext
+  uint hits;         // lookups satisfied from this bucket
+} __attribute__((aligned(CACHELINE)));
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  int nbuf;          // number of buffers allocated by binit
+  uint misses;       // lookups that had to allocate a buffer
+  uint evictions;    // misses that recycled a valid buffer
+  uint writebacks;   // dirty buffers written to disk
+  uint ghosthits;    // misses on a remembered block
+
+  // Replacement lists, through prev/next.  in.next is the newest
+  // on the in list, hot.next the most recently used hot buffer.
+  struct buf in;
+  struct buf hot;
+  int nin;           // buffers on the in list
+  int nhot;
+
+  // Ring of nghost ghosts, the next to reuse at ghand, hashed
+  // by (dev, sector) when in use.
+  struct ghost *ghost;
+  int nghost;
+  int ghand;
+  struct ghost *ghash[NGHASH];
+
+  // Hash table of all buffers, keyed by (dev, sector).
+  struct bucket bucket[NBUCKET];
+} bcache __attribute__((aligned(CACHELINE)));
+
+static struct bucket*
+bhash(uint dev, uint sector)
+{
+  return &bcache.bucket[(dev * 31 + sector) % NBUCKET];
+}
+
+// Unlink b from the chain of bucket bk.  Caller must hold bk->lock.
+static void
+bunhash(struct bucket *bk, struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = &bk->head; *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      b->hnext = 0;
+      return;
+    }
+  }
+  panic("bunhash");
+}
+
+// Find the buffer for sector on device dev in bucket bk.
+// Caller must hold bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint sector)
+{
+  struct buf *b;
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
-} bcache;
+  for(b = bk->head; b; b = b->hnext)
+    if(b->dev == dev && b->sector == sector)
+      return b;
+  return 0;
+}
+
+// Put b at the head of list q.  Caller holds bcache.lock.
+static void
+bqput(struct buf *b, int q)
+{
+  struct buf *h;
+
+  h = q == BQ_HOT ? &bcache.hot : &bcache.in;
+  b->q = q;
+  b->next = h->next;
+  b->prev = h;
+  h->next->prev = b;
+  h->next = b;
+  if(q == BQ_HOT)
+    bcache.nhot++;
+  else
+    bcache.nin++;
+}
+
+// Take b off its list.  Caller holds bcache.lock.
+static void
+bqdel(struct buf *b)
+{
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(b->q == BQ_HOT)
+    bcache.nhot--;
+  else
+    bcache.nin--;
+}
+
+static struct ghost**
+ghashp(uint dev, uint sector)
+{
+  return &bcache.ghash[(dev * 31 + sector) % NGHASH];
+}
+
+// Forget the ghost of sector on device dev, if there is one, and
+// return whether there was.  Caller holds bcache.lock.
+static int
+gtake(uint dev, uint sector)
+{
+  struct ghost **pp, *g;
+
+  for(pp = ghashp(dev, sector); (g = *pp) != 0; pp = &g->hnext){
+    if(g->dev == dev && g->sector == sector){
+      *pp = g->hnext;
+      g->dev = -1;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// Remember b's block, which is leaving the in list, in place of
+// the oldest ghost.  Caller holds bcache.lock.
+static void
+gput(struct buf *b)
+{
+  struct ghost *g;
+
+  if(bcache.nghost == 0)
+    return;
+  g = &bcache.ghost[bcache.ghand];
+  bcache.ghand = (bcache.ghand + 1) % bcache.nghost;
+  if(g->dev != -1 && !gtake(g->dev, g->sector))
+    panic("gput");
+  g->dev = b->dev;
+  g->sector = b->sector;
+  g->hnext = *ghashp(b->dev, b->sector);
+  *ghashp(b->dev, b->sector) = g;
+}
+
+// Trace operation op on b, which was cached already if hit.
+static void
+btrace(struct buf *b, int op, int hit)
+{
+  TRACE(TR_BIO, b->sector, BIOREC(b->dev, op,
+        (hit ? BIO_HIT : 0) | (b->flags & B_META ? BIO_META : 0)));
+}
+
+// Is b unlocked, and dirty outside any uncommitted transaction?
+// Caller must hold b's bucket lock.
+static int
+bflushable(struct buf *b)
+{
+  return !b->lock.locked && (b->flags & (B_DIRTY|B_LOGGED)) == B_DIRTY;
+}
+
+static void
+bkstat(struct kstatbuf *b)
+{
+  struct bcachestat st;
+
+  bstat(&st);
+  kstatput(b, "nbuf", 0, st.nbuf);
+  kstatput(b, "hits", 0, st.hits);
+  kstatput(b, "misses", 0, st.misses);
+  kstatput(b, "evictions", 0, st.evictions);
+  kstatput(b, "writebacks", 0, st.writebacks);
+  kstatput(b, "ghosthits", 0, st.ghosthits);
+  kstatput(b, "hot", 0, st.nhot);
+}
+
+// Make room for ghosts of half as many blocks as there are
+// buffers, or as many as memory allows.
+static void
+ghostinit(void)
+{
+  int n, order;
+
+  n = bcache.nbuf / 2;
+  for(order = 0; order < MAXORDER && (PGSIZE << order) < n * sizeof(struct ghost); order++)
+    ;
+  while((bcache.ghost = (struct ghost*)kalloc_order(order)) == 0 && order > 0)
+    order--;
+  if(bcache.ghost == 0)
+    return;
+  bcache.nghost = (PGSIZE << order) / sizeof(struct ghost);
+  if(bcache.nghost > n)
+    bcache.nghost = n;
+  for(n = 0; n < bcache.nghost; n++)
+    bcache.ghost[n].dev = -1;
+}
 
 void
 binit(void)
 {
-  struct buf *b;
+  struct buf *b, *page;
+  uchar *data;
+  struct bucket *bk;
+  int n;
 
   initlock(&bcache.lock, "bcache");
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    initlock(&bk->lock, "bcache.bucket");
+    bk->head = 0;
+  }
 
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
+  // Every buffer starts out empty, on the in list.
+  bcache.in.prev = bcache.in.next = &bcache.in;
+  bcache.hot.prev = bcache.hot.next = &bcache.hot;
+  n = physstop / BCACHEFRAC / (sizeof(struct buf) + BSIZE);
+  if(n < NBUF)
+    n = NBUF;
+  page = 0;
+  data = 0;
+  for(bcache.nbuf = 0; bcache.nbuf < n; bcache.nbuf++){
+    if(bcache.nbuf % BPP == 0 && (page = (struct buf*)kalloc()) == 0)
+      break;
+    if(bcache.nbuf % DPP == 0 && (data = (uchar*)kalloc()) == 0)
+      break;
+    b = page + bcache.nbuf % BPP;
+    b->data = data + (bcache.nbuf % DPP) * BSIZE;
     b->dev = -1;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    initsleeplock(&b->lock);
+    bqput(b, BQ_IN);
+
+    bk = bhash(b->dev, b->sector);
+    b->hnext = bk->head;
+    bk->head = b;
   }
+  if(bcache.nbuf < NBUF)
+    panic("binit: out of memory");
+  ghostinit();
+  kstatreg("bcache", bkstat);
+}
+
+// Write dirty buffer b to disk.  Must be locked.
+static void
+bwriteback(struct buf *b)
+{
+  blkrw(b);
+  acquire(&bcache.lock);
+  bcache.writebacks++;
+  release(&bcache.lock);
 }
 
 // Look through buffer cache for sector on device dev.
 // If not found, allocate fresh block.
 // In either case, return locked buffer.
+// With try, return 0 instead of waiting: if the block is
+// cached, or if no clean idle buffer is free to recycle.
 static struct buf*
-bget(uint dev, uint sector)
+bgettry(uint dev, uint sector, int try)
 {
-  struct buf *b;
+  struct buf *b, *dirty, *list[2];
+  struct bucket *bk, *vk;
+  int i, q;
 
-  acquire(&bcache.lock);
+  bk = bhash(dev, sector);
+  acquire(&bk->lock);
 
  loop:
   // Try for cached block.
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->sector == sector){
-      if(!(b->flags & B_BUSY)){
-        b->flags |= B_BUSY;
+  // A locked buffer can't be evicted, so once found it
+  // is ours when its holders are done with it.
+  if((b = bfind(bk, dev, sector)) != 0){
+    if(try){
+      release(&bk->lock);
+      return 0;
+    }
+    acquiresleep(&b->lock, &bk->lock);
+    bk->hits++;
+    release(&bk->lock);
+    return b;
+  }
+  release(&bk->lock);
+
+  // Miss: serialize with other evictions, then look again
+  // in case another CPU brought the block in meanwhile.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if(bfind(bk, dev, sector) != 0){
+    release(&bcache.lock);
+    goto loop;
+  }
+
+  // Allocate fresh block, recycling the oldest clean buffer of
+  // the in list while it is over its share, else the least
+  // recently used clean hot one.  Dirty buffers are pinned until
+  // written back, logged ones until their transaction commits.
+  list[0] = bcache.nin > bcache.nbuf / 4 ? &bcache.in : &bcache.hot;
+  list[1] = list[0] == &bcache.in ? &bcache.hot : &bcache.in;
+  dirty = 0;
+  for(i = 0; i < 2; i++){
+    for(b = list[i]->prev; b != list[i]; b = b->prev){
+      vk = bhash(b->dev, b->sector);
+      if(vk != bk)
+        acquire(&vk->lock);
+      if(bflushable(b) && dirty == 0)
+        dirty = b;
+      if(!b->lock.locked && (b->flags & B_DIRTY) == 0){
+        bunhash(vk, b);
+        if(vk != bk)
+          release(&vk->lock);
+        bcache.misses++;
+        q = BQ_IN;
+        if(gtake(dev, sector)){
+          q = BQ_HOT;
+          bcache.ghosthits++;
+        }
+        if(b->flags & B_VALID){
+          bcache.evictions++;
+          if(b->q == BQ_IN)
+            gput(b);
+        }
+        bqdel(b);
+        bqput(b, q);
+        b->dev = dev;
+        b->sector = sector;
+        b->flags = 0;
+        acquiresleep(&b->lock, &bk->lock);
+        b->hnext = bk->head;
+        bk->head = b;
+        release(&bk->lock);
         release(&bcache.lock);
         return b;
       }
-      sleep(b, &bcache.lock);
-      goto loop;
+      if(vk != bk)
+        release(&vk->lock);
     }
   }
+  if(try){
+    release(&bk->lock);
+    release(&bcache.lock);
+    return 0;
+  }
+  if(dirty == 0)
+    panic("bget: no buffers");
 
-  // Allocate fresh block.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if((b->flags & B_BUSY) == 0){
-      b->dev = dev;
-      b->sector = sector;
-      b->flags = B_BUSY;
-      release(&bcache.lock);
-      return b;
-    }
+  // Every idle buffer is dirty: write back the least
+  // recently used one and try again.
+  vk = bhash(dirty->dev, dirty->sector);
+  if(vk != bk)
+    acquire(&vk->lock);
+  b = 0;
+  if(bflushable(dirty)){
+    acquiresleep(&dirty->lock, &vk->lock);
+    b = dirty;
+  }
+  if(vk != bk)
+    release(&vk->lock);
+  release(&bk->lock);
+  release(&bcache.lock);
+  if(b){
+    bwriteback(b);
+    brelse(b);
   }
-  panic("bget: no buffers");
+  acquire(&bk->lock);
+  goto loop;
 }
 
-// Return a B_BUSY buf with the contents of the indicated disk sector.
+static struct buf*
+bget(uint dev, uint sector)
+{
+  return bgettry(dev, sector, 0);
+}
+
+// Get a locked buf with the contents of sector on dev, adding
+// flags to it.
+static struct buf*
+breadflags(uint dev, uint sector, int flags)
+{
+  struct buf *b;
+
+  b = bget(dev, sector);
+  b->flags |= flags;
+  TRACE(TR_BREAD, sector, (b->flags & B_VALID) != 0);
+  btrace(b, BIO_GET, b->flags & B_VALID);
+  if(!(b->flags & B_VALID))
+    blkrw(b);
+  return b;
+}
+
+// Return a locked buf with the contents of the indicated disk sector.
 struct buf*
 bread(uint dev, uint sector)
+{
+  return breadflags(dev, sector, 0);
+}
+
+// Read as bread does, for file system metadata: bitmap, inode and
+// directory blocks.  The buffer goes on the hot list when it is
+// released, so streaming file data can't push it out.
+struct buf*
+breadmeta(uint dev, uint sector)
+{
+  return breadflags(dev, sector, B_META);
+}
+
+// Return a locked buf for the indicated disk sector with its
+// contents zeroed, without reading the disk.  For callers that are
+// about to overwrite the whole block, or that need a clean one.
+struct buf*
+bclear(uint dev, uint sector)
 {
   struct buf *b;
 
   b = bget(dev, sector);
-  if(!(b->flags & B_VALID))
-    iderw(b);
+  btrace(b, BIO_NEW, b->flags & B_VALID);
+  memset(b->data, 0, BSIZE);
+  b->flags |= B_VALID;
   return b;
 }
 
-// Write b's contents to disk.  Must be locked.
+// Return a locked buf for the indicated disk sector without
+// reading the disk, or clearing it as bclear does.  For callers
+// that are about to overwrite every byte the disk copy holds that
+// matters; the rest of the data is left as is.
+struct buf*
+boverwrite(uint dev, uint sector)
+{
+  struct buf *b;
+
+  b = bget(dev, sector);
+  TRACE(TR_BREAD, sector, (b->flags & B_VALID) != 0);
+  btrace(b, BIO_NEW, b->flags & B_VALID);
+  b->flags |= B_VALID;
+  return b;
+}
+
+// Start reading the indicated disk sector into the cache
+// without waiting for it, unless it is cached already.
+// Read-ahead is only a hint: it is skipped rather than
+// wait for a buffer or take a dirty one.
+void
+breadahead(uint dev, uint sector)
+{
+  struct buf *b;
+
+  if((b = bgettry(dev, sector, 1)) == 0)
+    return;
+  btrace(b, BIO_GET, 0);
+  blkrwasync(b);
+}
+
+// Mark b's contents as needing to be written to disk.  Must be locked.
 void
 bwrite(struct buf *b)
 {
-  if((b->flags & B_BUSY) == 0)
+  if(!b->lock.locked)
     panic("bwrite");
+  btrace(b, BIO_DIRTY, 1);
   b->flags |= B_DIRTY;
-  iderw(b);
 }
 
 // Release the buffer b.
 void
 brelse(struct buf *b)
 {
-  if((b->flags & B_BUSY) == 0)
+  struct bucket *bk;
+
+  if(!b->lock.locked)
     panic("brelse");
 
+  // b is still locked, so eviction cannot move it while it
+  // is being put at the head of the hot list.  The in list is
+  // a FIFO; only metadata leaves it early.
+  if(b->q == BQ_HOT || (b->flags & B_META)){
+    acquire(&bcache.lock);
+    bqdel(b);
+    bqput(b, BQ_HOT);
+    release(&bcache.lock);
+  }
+
+  bk = bhash(b->dev, b->sector);
+  acquire(&bk->lock);
+  releasesleep(&b->lock);
+  release(&bk->lock);
+}
+
+// Release b as the oldest buffer on the in list, to be reused
+// before any other: the caller has copied out the data, which
+// no one is expected to read from here again.
+void
+bdrop(struct buf *b)
+{
+  struct bucket *bk;
+
+  if(!b->lock.locked)
+    panic("bdrop");
+
   acquire(&bcache.lock);
+  bqdel(b);
+  b->q = BQ_IN;
+  b->prev = bcache.in.prev;
+  b->next = &bcache.in;
+  bcache.in.prev->next = b;
+  bcache.in.prev = b;
+  bcache.nin++;
+  release(&bcache.lock);
 
-  b->next->prev = b->prev;
-  b->prev->next = b->next;
-  b->next = bcache.head.next;
-  b->prev = &bcache.head;
-  bcache.head.next->prev = b;
-  bcache.head.next = b;
+  bk = bhash(b->dev, b->sector);
+  acquire(&bk->lock);
+  releasesleep(&b->lock);
+  release(&bk->lock);
+}
 
-  b->flags &= ~B_BUSY;
-  wakeup(b);
 
+// Write the cached copy of sector on device dev to disk,
+// if there is one and it is dirty.  A logged copy is left
+// for the log to write when its transaction commits.
+void
+bflush(uint dev, uint sector)
+{
+  struct buf *b;
+  struct bucket *bk;
+
+  bk = bhash(dev, sector);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, sector)) == 0 || (b->flags & (B_DIRTY|B_LOGGED)) != B_DIRTY){
+    release(&bk->lock);
+    return;
+  }
+  // Its holder may have written it back meanwhile.
+  acquiresleep(&b->lock, &bk->lock);
+  if((b->flags & (B_DIRTY|B_LOGGED)) != B_DIRTY){
+    releasesleep(&b->lock);
+    release(&bk->lock);
+    return;
+  }
+  release(&bk->lock);
+  bwriteback(b);
+  brelse(b);
+}
+
+// Write every dirty buffer to disk, oldest first on each list.
+// Buffers that are busy are skipped; their holder
+// will leave them dirty for the next sync.  Logged
+// buffers are skipped too; the log writes them.
+void
+bsync(void)
+{
+  struct buf *b, *list[2];
+  struct bucket *bk;
+  int i;
+
+  list[0] = &bcache.in;
+  list[1] = &bcache.hot;
+ loop:
+  acquire(&bcache.lock);
+  for(i = 0; i < 2; i++){
+    for(b = list[i]->prev; b != list[i]; b = b->prev){
+      bk = bhash(b->dev, b->sector);
+      acquire(&bk->lock);
+      if(bflushable(b)){
+        acquiresleep(&b->lock, &bk->lock);
+        release(&bk->lock);
+        release(&bcache.lock);
+        bwriteback(b);
+        brelse(b);
+        goto loop;
+      }
+      release(&bk->lock);
+    }
+  }
   release(&bcache.lock);
 }
 
+// Buffer cache flusher.  Runs as a kernel thread and
+// writes dirty buffers back every FLUSHTICKS clock ticks.
+void
+bflushd(void *arg)
+{
+  for(;;){
+    sleepticks(FLUSHTICKS);
+    iflush();
+    bsync();
+  }
+}
+
+// Report buffer cache size and hit/miss counters.
+void
+bstat(struct bcachestat *st)
+{
+  struct bucket *bk;
+
+  st->hits = 0;
+  for(bk = bcache.bucket; bk < bcache.bucket+NBUCKET; bk++){
+    acquire(&bk->lock);
+    st->hits += bk->hits;
+    release(&bk->lock);
+  }
+
+  acquire(&bcache.lock);
+  st->nbuf = bcache.nbuf;
+  st->misses = bcache.misses;
+  st->evictions = bcache.evictions;
+  st->writebacks = bcache.writebacks;
+  st->ghosthits = bcache.ghosthits;
+  st->nhot = bcache.nhot;
+  release(&bcache.lock);
+}
@@ -0,0 +1,282 @@
+// Block layer, between the buffer cache and the disk drivers.
+//
+// blkrw, blkrwv and blkrwasync pick the driver for a buf's
+// device and hand it the bufs as one batch, so a driver can
+// queue them all before starting the disk and merge adjacent
+// ones into one command.  A driver's submit routine only
+// queues; when bufs finish it passes them to blkdone, and the
+// waiting happens here.
+//
+// A buf is completed on the CPU that submitted it: blkdone,
+// called from the driver's work item on whichever CPU took the
+// interrupt, hands bufs submitted elsewhere to that CPU's queue,
+// whose own work item wakes the waiter, most likely still on its
+// last CPU, and releases the bufs of asynchronous requests there.
+// A buf's waiter sleeps on its CPU's queue lock, which is held
+// while its flags change.
+//
+// A process may plug its requests with blkplug.  Until blkunplug,
+// asynchronous ones collect on proc->plug instead of going to the
+// driver, and blkunplug sorts them by device and block and submits
+// each device's as one batch, so a run of read-aheads reaches the
+// disk as a few large commands.  A plugged buf stays locked, so
+// the plugging process must not wait for one; blkrw and blkrwv
+// submit what is held first, and so does a plug that has grown
+// to BLKPLUGMAX bufs.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "buf.h"
+#include "work.h"
+#include "trace.h"
+
+#define BLKPLUGMAX 32  // most bufs a plug holds back
+
+static struct blkq {
+  struct spinlock lock;
+  struct buf *done;    // finished elsewhere, chained by qnext
+  struct work work;
+} __attribute__((aligned(CACHELINE))) blkq[NCPU];
+
+static void blkcomplete(void*);
+static void blkflush(void);
+
+void
+blkinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    initlock(&blkq[i].lock, "blkq");
+    work_init(&blkq[i].work, blkcomplete, &blkq[i]);
+  }
+}
+
+static int
+blkcpu(void)
+{
+  int c;
+
+  pushcli();
+  c = cpu - cpus;
+  popcli();
+  return c;
+}
+
+// Hand the list of bufs at b, all of one device and chained by
+// qnext, to that device's driver.
+static void
+blksubmit(struct buf *b)
+{
+  struct buf *q;
+
+  if(b->dev == RAMDEV){
+    for(q = b; q; q = q->qnext)
+      ramdiskrw(q);
+    blkdone(b);
+  } else if(b->dev == 1 && vblkirq)
+    vblksubmit(b);
+  else if(b->dev == 1 && ahciirq)
+    ahcisubmit(b);
+  else
+    idesubmit(b);
+}
+
+// Stamp the n bufs of list with this CPU and charge them to
+// the process asking for them.
+static void
+blkstart(struct buf *list, int n)
+{
+  struct buf *b;
+  int c;
+
+  c = blkcpu();
+  for(b = list; b; b = b->qnext){
+    if(!b->lock.locked)
+      panic("blk: buf not busy");
+    b->cpu = c;
+    TRACE(TR_BIO, b->sector, BIOREC(b->dev,
+          b->flags & B_DIRTY ? BIO_WRITE : BIO_READ,
+          b->flags & B_META ? BIO_META : 0));
+  }
+  if(proc)
+    proc->nbio += n;
+}
+
+// Wait for b to finish.
+static void
+blkwait(struct buf *b)
+{
+  struct blkq *q;
+
+  q = &blkq[b->cpu];
+  acquire(&q->lock);
+  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID)
+    sleep(b, &q->lock);
+  release(&q->lock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void
+blkrw(struct buf *b)
+{
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("blkrw: nothing to do");
+  blkflush();
+  b->qnext = 0;
+  blkstart(b, 1);
+  blksubmit(b);
+  blkwait(b);
+}
+
+// Sync the n bufs at b, all of one device, as blkrw does, but
+// submit them as one batch before waiting.
+void
+blkrwv(struct buf *b, int n)
+{
+  int i;
+
+  blkflush();
+  for(i = 0; i < n; i++)
+    b[i].qnext = i + 1 < n ? &b[i+1] : 0;
+  blkstart(b, n);
+  blksubmit(b);
+  for(i = 0; i < n; i++)
+    blkwait(&b[i]);
+}
+
+// Start reading or writing b without waiting for it.  b is
+// released when it finishes, so the caller must not use it
+// after calling blkrwasync.
+void
+blkrwasync(struct buf *b)
+{
+  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
+    panic("blkrwasync: nothing to do");
+  b->flags |= B_ASYNC;
+  b->qnext = 0;
+  blkstart(b, 1);
+  if(proc && proc->plugged){
+    b->qnext = proc->plug;
+    proc->plug = b;
+    if(++proc->nplug >= BLKPLUGMAX)
+      blkflush();
+    return;
+  }
+  blksubmit(b);
+}
+
+// Submit the requests this process has held back, sorted by
+// device and block, one batch per device.
+static void
+blkflush(void)
+{
+  struct buf *b, *list, **pp, *next;
+
+  if(proc == 0 || proc->plug == 0)
+    return;
+  list = 0;
+  for(b = proc->plug; b; b = next){
+    next = b->qnext;
+    for(pp = &list; *pp; pp = &(*pp)->qnext)
+      if((*pp)->dev > b->dev || ((*pp)->dev == b->dev && (*pp)->sector > b->sector))
+        break;
+    b->qnext = *pp;
+    *pp = b;
+  }
+  proc->plug = 0;
+  proc->nplug = 0;
+  while(list){
+    for(pp = &list->qnext; *pp && (*pp)->dev == list->dev; pp = &(*pp)->qnext)
+      ;
+    next = *pp;
+    *pp = 0;
+    blksubmit(list);
+    list = next;
+  }
+}
+
+// Hold back this process's asynchronous requests until the
+// matching blkunplug.  Plugs nest.
+void
+blkplug(void)
+{
+  if(proc)
+    proc->plugged++;
+}
+
+void
+blkunplug(void)
+{
+  if(proc && proc->plugged > 0 && --proc->plugged == 0)
+    blkflush();
+}
+
+// Mark b finished, wake its waiter, and release it if no one
+// waits.  Called on the CPU that submitted it.
+static void
+blkfinish(struct buf *b)
+{
+  struct blkq *q;
+  int async;
+
+  q = &blkq[b->cpu];
+  acquire(&q->lock);
+  async = b->flags & B_ASYNC;
+  b->flags |= B_VALID;
+  b->flags &= ~(B_DIRTY|B_ASYNC);
+  wakeup(b);
+  release(&q->lock);
+  if(async)
+    brelse(b);
+}
+
+// Drivers call this with the bufs they have finished, chained
+// by qnext, holding no locks.
+void
+blkdone(struct buf *list)
+{
+  struct buf *b, *next;
+  struct blkq *q;
+  int c;
+
+  c = blkcpu();
+  for(b = list; b; b = next){
+    next = b->qnext;
+    if(b->cpu == c){
+      blkfinish(b);
+      continue;
+    }
+    q = &blkq[b->cpu];
+    acquire(&q->lock);
+    b->qnext = q->done;
+    q->done = b;
+    release(&q->lock);
+    queue_work_on(&q->work, b->cpu);
+  }
+}
+
+// Finish the bufs other CPUs have handed to queue arg.
+static void
+blkcomplete(void *arg)
+{
+  struct blkq *q;
+  struct buf *b, *next;
+
+  q = arg;
+  acquire(&q->lock);
+  b = q->done;
+  q->done = 0;
+  release(&q->lock);
+  for(; b; b = next){
+    next = b->qnext;
+    blkfinish(b);
+  }
+}
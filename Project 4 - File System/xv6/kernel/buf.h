@@ -3,16 +3,25 @@
 // IO Buffer
 struct buf {
   int flags;
+  struct sleeplock lock; // held between bread and brelse
   uint dev;
   uint sector;
-  struct buf *prev; // LRU cache list
+  struct buf *prev; // replacement list
   struct buf *next;
+  int q;             // which one; see bio.c
+  struct buf *hnext; // hash bucket chain
   struct buf *qnext; // disk queue
-  uchar data[512];
+  uint disk;         // IDE disk holding it, set by idesubmit
+  uint dsector;      // block number on that disk
+  int qpass;         // times passed over in the disk queue
+  int cpu;           // CPU that submitted it; see blk.c
+  uchar *data;       // BSIZE bytes, never crossing a page
 };
 
-#define B_BUSY  0x1  // buffer is locked by some process
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_ASYNC 0x8  // I/O in flight with no waiter; blkdone releases it
+#define B_LOGGED 0x10 // dirty in an uncommitted transaction; the log writes it
+#define B_META 0x20  // file system metadata; kept on the hot list (see breadmeta)
 
 #endif // _BUF_H_
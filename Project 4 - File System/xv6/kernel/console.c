@@ -8,10 +8,12 @@
 #include "traps.h"
 #include "spinlock.h"
 #include "fs.h"
+#include "sleeplock.h"
 #include "file.h"
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
+#include "poll.h"
 
 static void consputc(int);
 
@@ -20,7 +22,7 @@ static int panicked = 0;
 static struct {
   struct spinlock lock;
   int locking;
-} cons;
+} cons __attribute__((aligned(CACHELINE)));
 
 static void
 printint(int xx, int base, int sign)
@@ -105,6 +107,7 @@ panic(char *s)
   
   cli();
   cons.locking = 0;
+  uartsync();
   cprintf("cpu%d: panic: ", cpu->id);
   cprintf(s);
   cprintf("\n");
@@ -167,6 +170,7 @@ consputc(int c)
   cgaputc(c);
 }
 
+#define CONSCHUNK 512  // bytes consolewrite queues at a time
 #define INPUT_BUF 128
 struct {
   struct spinlock lock;
@@ -174,7 +178,8 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
-} input;
+  struct pollent *pollq;  // processes polling the console
+} input __attribute__((aligned(CACHELINE)));
 
 #define C(x)  ((x)-'@')  // Control-x
 
@@ -210,6 +215,7 @@ consoleintr(int (*getc)(void))
         if(c == '\n' || c == C('D') || input.e == input.r+INPUT_BUF){
           input.w = input.e;
           wakeup(&input.r);
+          pollwake(input.pollq);
         }
       }
       break;
@@ -219,7 +225,7 @@ consoleintr(int (*getc)(void))
 }
 
 int
-consoleread(struct inode *ip, char *dst, int n)
+consoleread(struct inode *ip, char *dst, uint off, int n)
 {
   uint target;
   int c;
@@ -256,16 +262,39 @@ consoleread(struct inode *ip, char *dst, int n)
   return target - n;
 }
 
+// Output never waits for long; input is ready once a line is.
+int
+consolepoll(struct inode *ip, int events, struct pollent *e)
+{
+  int r;
+
+  r = events & POLLOUT;
+  acquire(&input.lock);
+  if(input.r != input.w)
+    r |= events & POLLIN;
+  else if(r == 0 && e)
+    pollwait(&input.pollq, &input.lock, e);
+  release(&input.lock);
+  return r;
+}
+
+// Returns once buf is queued for the serial port, sleeping,
+// rather than spinning with cons.lock held, for room to queue it.
 int
 consolewrite(struct inode *ip, char *buf, int n)
 {
-  int i;
+  int i, end;
 
   iunlock(ip);
-  acquire(&cons.lock);
-  for(i = 0; i < n; i++)
-    consputc(buf[i] & 0xff);
-  release(&cons.lock);
+  i = 0;
+  while(i < n){
+    end = n - i > CONSCHUNK ? i + CONSCHUNK : n;
+    uartwait(end - i);
+    acquire(&cons.lock);
+    for(; i < end; i++)
+      consputc(buf[i] & 0xff);
+    release(&cons.lock);
+  }
   ilock(ip);
 
   return n;
@@ -279,6 +308,7 @@ consoleinit(void)
 
   devsw[CONSOLE].write = consolewrite;
   devsw[CONSOLE].read = consoleread;
+  devsw[CONSOLE].poll = consolepoll;
   cons.locking = 1;
 
   picenable(IRQ_KBD);
@@ -1,20 +1,84 @@
 #ifndef _DEFS_H_
 #define _DEFS_H_
 
+struct bcachestat;
+struct idestat;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct iovec;
+struct kmem_cache;
+struct ksmstat;
+struct kstatbuf;
+struct ProcessInfo;
+struct ProcStat;
+struct IntrStat;
+struct ProfSample;
+struct trapframe;
+struct TraceRec;
+struct spawnact;
+struct LockStat;
+struct tagterm;
+struct tagrec;
+struct LatStat;
+struct SyscallStat;
+struct ShrinkStat;
+struct direntstat;
 struct pipe;
+struct pollent;
+struct pollfd;
 struct proc;
+struct rcuhead;
+struct rwlock;
+struct seqlock;
+struct work;
+struct sleeplock;
+struct sock;
+struct aioctx;
+struct notifyctx;
 struct spinlock;
 struct stat;
+struct superblock;
+struct swapstat;
+
+// ahci.c
+extern int      ahciirq;
+void            ahciinit(void);
+void            ahciintr(void);
+void            ahcisubmit(struct buf*);
+
+// aio.c
+void            aioinit(void);
+int             aioalloc(struct file**);
+void            aioclose(struct aioctx*);
+int             aiosubmit(struct aioctx*, struct file*, int, char*, int, uint, uint);
+int             aioread(struct aioctx*, char*, int, int);
+int             aiopoll(struct aioctx*, int, struct pollent*);
+
+// blk.c
+void            blkinit(void);
+void            blkrw(struct buf*);
+void            blkrwv(struct buf*, int);
+void            blkrwasync(struct buf*);
+void            blkplug(void);
+void            blkunplug(void);
+void            blkdone(struct buf*);
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     breadmeta(uint, uint);
+struct buf*     bclear(uint, uint);
+struct buf*     boverwrite(uint, uint);
+void            breadahead(uint, uint);
 void            brelse(struct buf*);
+void            bdrop(struct buf*);
 void            bwrite(struct buf*);
+void            bflush(uint, uint);
+void            bflushd(void*) __attribute__((noreturn));
+void            bsync(void);
+void            bstat(struct bcachestat*);
 
 // console.c
 void            consoleinit(void);
@@ -22,8 +86,18 @@ void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// e1000.c
+extern int      e1000irq;
+extern uchar    e1000mac[6];
+void            e1000init(void);
+void            e1000intr(void);
+int             e1000tx(char*, int);
+
 // exec.c
 int             exec(char*, char**);
+int             execnew(struct proc*, char*, char**);
+int             execfault(struct proc*, uint);
+void            exectrim(struct proc*, uint);
 
 // file.c
 struct file*    filealloc(void);
@@ -32,64 +106,176 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
+int             filereaddir(struct file*, struct direntstat*, int);
 int             filewrite(struct file*, char*, int n);
-int             getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength);
+int             filepread(struct file*, char*, int n, uint);
+int             filepwrite(struct file*, char*, int n, uint);
+int             filetruncate(struct file*, uint);
+int             fileallocate(struct file*, uint, uint);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filesend(struct file*, struct file*, uint*, int);
+int             filecopy(struct file*, struct file*, uint*, int);
+int             filepoll(struct file*, int, struct pollent*);
 
 // fs.c
+void            readsb(int, struct superblock*);
 int             dirlink(struct inode*, char*, uint);
+void            dcset(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+int             dirreadstat(struct inode*, uint*, struct direntstat*, int);
+struct inode*   ialloc(struct inode*, short);
 struct inode*   idup(struct inode*);
 void            iinit(void);
 void            ilock(struct inode*);
+void            ilockshared(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
+int             isync(struct inode*);
+void            iflush(void);
+void            iprune(void);
+int             itruncate(struct inode*, uint);
+int             iallocate(struct inode*, uint, uint);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
+int             mount(char*, int);
 int             readi(struct inode*, char*, uint, uint);
+int             ireadpage(struct inode*, uint, char*);
+int             readifn(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
+void            ireadahead(struct inode*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 int             tagFile(int fileDescriptor, char* key, char* value, int valueLength);
 int             removeFileTag(int fileDescriptor, char* key);
 int             getFileTag(int fileDescriptor, char* key, char* buffer, int length);
 int             getAllTags(int fileDescriptor, struct Key keys[], int maxTags);
-int             readBuf(struct file* f, char* key, char* value, int valueLength, char* results, int resultsLength);
+int             tagFileBatch(int fileDescriptor, struct Key keys[], struct Value values[], int n);
+int             getFileTags(int fileDescriptor, struct Key keys[], struct Value values[], int n);
+int             getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength);
+int             getFilesByQuery(struct tagterm*, int, char*, int);
+int             tqvalid(struct tagterm*, int);
+int             getFilesByTagPage(char*, char*, int, struct tagrec*, int, uint*);
 
 // ide.c
 void            ideinit(void);
-void            ideintr(void);
-void            iderw(struct buf*);
+void            ideintr(int);
+void            idesubmit(struct buf*);
+int             idepresent(uint);
+void            idestat(struct idestat*);
 
 // ioapic.c
+int             ioapiccpu(int);
 void            ioapicenable(int irq, int cpu);
 extern uchar    ioapicid;
 void            ioapicinit(void);
+int             ioapicroute(int, int);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
+void            kshrinker(char*, int(*)(int));
+int             getshrinkstats(struct ShrinkStat*, int);
+char*           kalloc_order(int);
+void            kfree_order(char*, int);
+int             kzerofill(void);
 void            kfree(char*);
+void            kref(char*);
+int             kshared(char*);
 void            kinit(void);
+extern uint     physstop;
+
+// ksm.c
+void            ksminit(void);
+void            ksmd(void*);
+void            ksmpage(pte_t*, int, uint);
+int             ksmctl(int, struct ksmstat*);
+
+// kstat.c
+void            kstatinit(void);
+void            kstatreg(char*, void(*)(struct kstatbuf*));
+void            kstatput(struct kstatbuf*, char*, char*, uint);
+void            kstatputi(struct kstatbuf*, uint, char*, uint);
+void            kstathist(struct kstatbuf*, char*, uint, uint*, int);
+void*           kstattmp(struct kstatbuf*);
 
 // kbd.c
 void            kbdintr(void);
 
 // lapic.c
+uint            cmosread(uint);
 int             cpunum(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(int);
+void            lapiconeshot(uint);
+void            lapictick(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// latency.c
+extern int      latencyon;
+void            latnote(char*, uint64, uint*);
+int             latencyctl(int);
+int             getlatency(struct LatStat*, int);
+
+// log.c
+void            initlog(void);
+void            log_write(struct buf*);
+void            begin_op(void);
+void            end_op(void);
+
+// mmap.c
+int             mmap(struct file*, uint, uint);
+int             mmapfault(struct proc*, uint);
+int             mmapcheck(struct proc*, uint, uint);
+struct vma*     mmapvma(struct proc*, uint, uint);
+int             mmapadvise(struct vma*, uint, uint, int);
+void            mmapfork(struct proc*, struct proc*);
+void            mmapclear(struct proc*);
+
 // mp.c
 extern int      ismp;
 int             mpbcpu(void);
 void            mpinit(void);
 void            mpstartthem(void);
 
+// net.c
+void            netinit(void);
+void            netrx(char*, int);
+int             sockalloc(struct file**);
+void            sockclose(struct sock*);
+int             sockbind(struct sock*, int);
+int             sockconnect(struct sock*, uint, int);
+int             socksend(struct sock*, struct iovec*, int, uint, int);
+int             sockrecv(struct sock*, struct iovec*, int, uint*, ushort*, int);
+int             sockpoll(struct sock*, int, struct pollent*);
+
+// notify.c
+void            notifyinit(void);
+int             notifyalloc(struct file**, int);
+void            notifyclose(struct notifyctx*);
+void            notify(int, uint, uint, char*);
+int             notifyread(struct notifyctx*, char*, int, int);
+int             notifypoll(struct notifyctx*, int, struct pollent*);
+
+// pagecache.c
+void            pcinit(void);
+char*           pcget(struct inode*, uint, int*);
+void            pcwrite(struct inode*, char*, uint, uint);
+void            pcinval(struct inode*, uint);
+void            pcprune(void);
+
+// pci.c
+int             pcifindclass(int, int);
+int             pcifindid(int, int);
+uint            pciread(int, int);
+void            pciwrite(int, int, uint);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
@@ -97,34 +283,136 @@ void            picinit(void);
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
+int             pipepoll(struct pipe*, int, int, struct pollent*);
+int             pipewait(struct pipe*);
+int             pipeput(void*, char*, int);
+int             pipesplice(struct pipe*, struct pipe*, int, int);
+int             pipegift(struct pipe*, uint, int, int);
+
+// poll.c
+int             poll(struct pollfd*, int, int);
+void            pollwait(struct pollent**, struct spinlock*, struct pollent*);
+void            pollwake(struct pollent*);
+
+// virtio_blk.c
+extern int      vblkirq;
+void            vblkinit(void);
+void            vblkintr(void);
+void            vblksubmit(struct buf*);
+
+// rcu.c
+void            rcuinit(void);
+void            rcu_read_lock(void);
+void            rcu_read_unlock(void);
+void            call_rcu(struct rcuhead*, void(*)(void*), void*);
+void            rcuqs(void);
+
+// work.c
+void            work_init(struct work*, void(*)(void*), void*);
+int             queue_work(struct work*);
+int             queue_work_on(struct work*, int);
+void            workinit(void);
+
+// perf.c
+void            perfinit(void);
+int             perfctr(uint, int);
+void            pmcload(struct proc*);
+void            pmcsave(struct proc*);
 
 // proc.c
 struct proc*    copyproc(struct proc*);
 void            exit(void);
+int             fdalloc(struct proc*, struct file*);
+void            fdcloseall(struct proc*);
+int             fdcopy(struct proc*, struct file**, int);
+struct file*    fdget(struct proc*, int);
+int             fdset(struct proc*, int, struct file*);
+void            cond_resched(void);
 int             fork(void);
+int             spawn(char*, char**, struct spawnact*, int);
+int             mktemplate(uint);
+int             spawn_from(int, char**);
+int             getprocs(struct ProcessInfo*);
+int             getprocstat(struct ProcStat*, int, uint);
+int             getsyscounts(int, uint*);
 int             growproc(int);
 int             kill(int);
+struct proc*    kthread_create(char*, void(*)(void*), void*);
 void            pinit(void);
+void            prioboost(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setaffinity(int, uint);
+int             schedtick(int);
 void            sleep(void*, struct spinlock*);
+int             sleepticks(uint);
+void            pollnotify(struct proc*);
+void            pollsleep(uint);
+pde_t*          swappgdir(pde_t*);
+int             swapreclaim(int);
+int             ksmscan(int);
+pte_t*          ksmpte(int, uint);
+void            timertick(void);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
 void            yield(void);
 
+// prof.c
+extern int      profflags;
+void            profinit(void);
+void            profsample(struct trapframe*);
+int             profctl(int);
+int             profread(struct ProfSample*, int);
+
+// swap.c
+void            swapinit(void);
+void            swapstat(struct swapstat*);
+int             swapalloc(char*);
+void            swapwrite(uint, char*);
+void            swapdup(uint);
+void            swapfree(uint);
+char*           swapin(uint, int*);
+
+// sleeplock.c
+void            acquiresleep(struct sleeplock*, struct spinlock*);
+void            acquiresleepshared(struct sleeplock*, struct spinlock*);
+void            initsleeplock(struct sleeplock*);
+void            releasesleep(struct sleeplock*);
+
+// ramdisk.c
+void            ramdiskinit(void);
+void            ramdiskrw(struct buf*);
+
+// slab.c
+void            slabinit(void);
+struct kmem_cache* kmem_cache_create(char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
 // spinlock.c
 void            acquire(struct spinlock*);
+void            acquireread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+void            acquireseq(struct seqlock*);
 void            getcallerpcs(void*, uint*);
+int             getlockstats(struct LockStat*, int);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initrwlock(struct rwlock*, char*);
+void            initseqlock(struct seqlock*, char*);
 void            release(struct spinlock*);
+void            releaseread(struct rwlock*);
+void            releasewrite(struct rwlock*);
+void            releaseseq(struct seqlock*);
+uint            readseqbegin(struct seqlock*);
+int             readseqretry(struct seqlock*, uint);
 void            pushcli(void);
 void            popcli(void);
 
@@ -136,30 +424,58 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
-int             searchKey(uchar* key, uchar* str);
-int             searchEnd(uchar* str);
 
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
-int             argstr(int, char**);
-int             fetchint(struct proc*, uint, int*);
-int             fetchstr(struct proc*, uint, char**);
+int             argstr(int, char*, int);
+int             fetchint(uint, int*);
+int             fetchstr(uint, char**);
+int             getsyscallstats(int, struct SyscallStat*, int);
 void            syscall(void);
 
 // timer.c
+extern uint     tsckhz;
+extern uint     tsctick;
+extern uint64   boottsc;
+uint64          nsuptime(void);
+uint            tsccalibrate(volatile uint*);
+uint            tscticks(void);
 void            timerinit(void);
 
 // trap.c
 void            idtinit(void);
 extern uint     ticks;
+uint            clockread(uint64*);
+void            clockupdate(void);
+int             getintrstats(struct IntrStat*, int);
 void            tvinit(void);
-extern struct spinlock tickslock;
+
+// trace.c
+extern uint     tracemask;
+void            traceinit(void);
+void            trace(int, uint, uint);
+int             tracectl(uint);
+int             traceread(struct TraceRec*, int);
+// Record tracepoint ev, if it is on; see trace.h.
+#define TRACE(ev, a, b) do { if(tracemask & (1 << (ev))) trace((ev), (a), (b)); } while(0)
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
 void            uartputc(int);
+void            uartsync(void);
+void            uartwait(int);
+
+// usercopy.S
+int             ucopy(void*, void*, uint);
+int             ucopystr(char*, char*, uint);
+extern char     ucopyend[], ucopyfault[];
+
+// vdso.c
+void            vdsoinit(void);
+int             mapvdso(pde_t*, struct proc*);
+void            vdsotick(uint, uint64);
 
 // vm.c
 void            seginit(void);
@@ -171,11 +487,30 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
 pde_t*          copyuvm(pde_t*, uint);
+int             cowfault(pde_t*, uint);
+char*           uvmlend(struct proc*, uint);
+int             uvmgift(struct proc*, uint, char*);
+int             lazyfault(struct proc*, uint);
+char*           uvmpage(int);
+pte_t*          uvmnext(pde_t*, uint*, uint);
+pte_t*          uvmpte(pde_t*, uint);
+pte_t*          uvmvictim(pde_t*, uint*, uint);
+int             uvmcheck(struct proc*, uint, uint);
+void            uvmfault(struct proc*, int);
+uint            uvmrss(pde_t*, uint*, uint*);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             copyoutp(struct proc*, uint, void*, uint);
+uint            uvmend(struct proc*, uint);
+int             madvise(uint, uint, int);
+int             copyin(void*, uint, uint);
+int             copyinstr(char*, uint, uint);
+int             mapuvm(pde_t*, uint, char*, int);
+char*           kstackalloc(void);
+void            kstackfree(char*);
+uint            kpgdirpa(void);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -0,0 +1,261 @@
+// Intel 8254x (e1000) network driver, for the NIC QEMU emulates.
+//
+// Both descriptor rings live in one kalloc() page.  Every receive
+// descriptor owns a kalloc() page the NIC writes a frame into;
+// when a frame arrives its page goes to netrx as it is, and the
+// descriptor gets a fresh page, so received data is never copied.
+// Transmit likewise takes the caller's page and frees it once the
+// NIC has sent it.
+//
+// The interrupt handler only acknowledges the NIC; a work item
+// drains the receive ring, as idecomplete does for the disk.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "pci.h"
+#include "work.h"
+
+#define E1000_VENDOR  0x8086
+#define E1000_82540EM 0x100e
+
+// Registers, as uint indexes from BAR0.
+#define E_CTL     (0x0000/4)
+#define E_EERD    (0x0014/4)  // EEPROM read
+#define E_ICR     (0x00c0/4)  // interrupt cause, cleared by reading
+#define E_IMS     (0x00d0/4)  // interrupt mask set
+#define E_IMC     (0x00d8/4)  // interrupt mask clear
+#define E_RCTL    (0x0100/4)
+#define E_TCTL    (0x0400/4)
+#define E_TIPG    (0x0410/4)
+#define E_RDBAL   (0x2800/4)
+#define E_RDBAH   (0x2804/4)
+#define E_RDLEN   (0x2808/4)
+#define E_RDH     (0x2810/4)
+#define E_RDT     (0x2818/4)
+#define E_RDTR    (0x2820/4)  // receive delay timer
+#define E_TDBAL   (0x3800/4)
+#define E_TDBAH   (0x3804/4)
+#define E_TDLEN   (0x3808/4)
+#define E_TDH     (0x3810/4)
+#define E_TDT     (0x3818/4)
+#define E_MTA     (0x5200/4)  // multicast table, 128 words
+#define E_RA      (0x5400/4)  // receive address 0, low and high
+
+#define CTL_SLU     0x00000040  // set link up
+#define CTL_RST     0x04000000
+#define EERD_START  0x1
+#define EERD_DONE   0x10
+#define RCTL_EN     0x00000002
+#define RCTL_BAM    0x00008000  // accept broadcast
+#define RCTL_SECRC  0x04000000  // strip the CRC
+#define TCTL_EN     0x00000002
+#define TCTL_PSP    0x00000008  // pad short packets
+#define ICR_RXT0    0x00000080  // receive timer expired
+#define ICR_RXO     0x00000040  // receiver overrun
+#define ICR_RXDMT0  0x00000010  // few receive descriptors left
+#define ICR_TXDW    0x00000001  // a transmit descriptor was written back
+#define RA_AV       0x80000000  // address valid
+
+#define TXD_EOP     0x01
+#define TXD_RS      0x08        // report status
+#define TXD_DD      0x01        // descriptor done
+#define RXD_DD      0x01
+#define RXD_EOP     0x02
+
+#define NTXD 64
+#define NRXD 128
+
+struct txdesc {
+  uint64 addr;
+  ushort length;
+  uchar cso;
+  uchar cmd;
+  uchar status;
+  uchar css;
+  ushort special;
+};
+
+struct rxdesc {
+  uint64 addr;
+  ushort length;
+  ushort csum;
+  uchar status;
+  uchar errors;
+  ushort special;
+};
+
+int e1000irq;  // IRQ line, 0 if there is no NIC
+uchar e1000mac[6];
+
+static struct {
+  struct spinlock lock;
+  volatile uint *regs;
+  struct txdesc *tx;        // NTXD, then
+  struct rxdesc *rx;        // NRXD, in one page
+  char *txpage[NTXD];       // page being sent, until done
+  char *rxpage[NRXD];       // page each descriptor receives into
+  uint txclean;             // oldest descriptor that may be in use
+  struct work work;
+} nic __attribute__((aligned(CACHELINE)));
+
+static void e1000recv(void*);
+
+// Read word a of the EEPROM.
+static ushort
+eeread(int a)
+{
+  nic.regs[E_EERD] = (a << 8) | EERD_START;
+  while(!(nic.regs[E_EERD] & EERD_DONE))
+    ;
+  return nic.regs[E_EERD] >> 16;
+}
+
+void
+e1000init(void)
+{
+  char *ring;
+  uint bar;
+  ushort w;
+  int tag, i;
+
+  if((tag = pcifindid(E1000_VENDOR, E1000_82540EM)) < 0)
+    return;
+  bar = pciread(tag, PCI_BAR(0)) & ~0xf;
+  if(bar < USERTOP)
+    return;  // not where the kernel maps devices
+  pciwrite(tag, PCI_CMD, pciread(tag, PCI_CMD) | PCI_CMD_MEM | PCI_CMD_MASTER);
+  nic.regs = (volatile uint*)bar;
+
+  nic.regs[E_IMC] = ~0;
+  nic.regs[E_CTL] |= CTL_RST;
+  for(i = 0; i < 100000 && (nic.regs[E_CTL] & CTL_RST); i++)
+    ;
+  nic.regs[E_IMC] = ~0;
+
+  if((ring = kalloc_zeroed()) == 0)
+    return;
+  nic.tx = (struct txdesc*)ring;
+  nic.rx = (struct rxdesc*)(ring + NTXD*sizeof(struct txdesc));
+  for(i = 0; i < NRXD; i++){
+    if((nic.rxpage[i] = kalloc()) == 0)
+      panic("e1000init: out of memory");
+    nic.rx[i].addr = (uint)nic.rxpage[i];
+  }
+
+  // Memory is identity mapped, so these are physical addresses.
+  nic.regs[E_TDBAL] = (uint)nic.tx;
+  nic.regs[E_TDBAH] = 0;
+  nic.regs[E_TDLEN] = NTXD*sizeof(struct txdesc);
+  nic.regs[E_TDH] = nic.regs[E_TDT] = 0;
+  nic.regs[E_TCTL] = TCTL_EN | TCTL_PSP | (0x10 << 4) | (0x40 << 12);
+  nic.regs[E_TIPG] = 10 | (8 << 10) | (6 << 20);
+
+  nic.regs[E_RDBAL] = (uint)nic.rx;
+  nic.regs[E_RDBAH] = 0;
+  nic.regs[E_RDLEN] = NRXD*sizeof(struct rxdesc);
+  nic.regs[E_RDH] = 0;
+  nic.regs[E_RDT] = NRXD - 1;
+  nic.regs[E_RDTR] = 0;
+
+  for(i = 0; i < 3; i++){
+    w = eeread(i);
+    e1000mac[2*i] = w;
+    e1000mac[2*i+1] = w >> 8;
+  }
+  nic.regs[E_RA] = e1000mac[0] | e1000mac[1] << 8 | e1000mac[2] << 16 | e1000mac[3] << 24;
+  nic.regs[E_RA+1] = e1000mac[4] | e1000mac[5] << 8 | RA_AV;
+  for(i = 0; i < 128; i++)
+    nic.regs[E_MTA+i] = 0;
+  nic.regs[E_RCTL] = RCTL_EN | RCTL_BAM | RCTL_SECRC;  // 2048-byte buffers
+  nic.regs[E_CTL] |= CTL_SLU;
+
+  initlock(&nic.lock, "e1000");
+  work_init(&nic.work, e1000recv, 0);
+  e1000irq = pciread(tag, PCI_INTR) & 0xff;
+  picenable(e1000irq);
+  ioapicenable(e1000irq, ncpu - 1);
+  nic.regs[E_IMS] = ICR_RXT0 | ICR_RXO | ICR_RXDMT0;
+  cprintf("e1000: %x:%x:%x:%x:%x:%x, irq %d\n", e1000mac[0], e1000mac[1],
+          e1000mac[2], e1000mac[3], e1000mac[4], e1000mac[5], e1000irq);
+}
+
+// Send the len-byte frame at the start of kalloc() page pg.
+// The driver frees pg once the NIC is done with it.  Returns -1,
+// leaving pg to the caller, if the ring is full.
+int
+e1000tx(char *pg, int len)
+{
+  uint t;
+
+  if(e1000irq == 0 || len > 1518)
+    return -1;
+  acquire(&nic.lock);
+  // Free the pages of descriptors the NIC has finished with.
+  while(nic.txpage[nic.txclean] && (nic.tx[nic.txclean].status & TXD_DD)){
+    kfree(nic.txpage[nic.txclean]);
+    nic.txpage[nic.txclean] = 0;
+    nic.txclean = (nic.txclean + 1) % NTXD;
+  }
+  t = nic.regs[E_TDT];
+  if(nic.txpage[t]){
+    release(&nic.lock);
+    return -1;
+  }
+  nic.tx[t].addr = (uint)pg;
+  nic.tx[t].length = len;
+  nic.tx[t].cmd = TXD_EOP | TXD_RS;
+  nic.tx[t].status = 0;
+  nic.txpage[t] = pg;
+  __sync_synchronize();  // descriptor before the NIC sees it
+  nic.regs[E_TDT] = (t + 1) % NTXD;
+  release(&nic.lock);
+  return 0;
+}
+
+void
+e1000intr(void)
+{
+  // Reading ICR acknowledges the interrupt.
+  if(nic.regs[E_ICR] & (ICR_RXT0 | ICR_RXO | ICR_RXDMT0))
+    queue_work(&nic.work);
+}
+
+// Hand each received frame's page to netrx, giving its
+// descriptor a fresh page, and give the ring back to the NIC.
+static void
+e1000recv(void *arg)
+{
+  struct rxdesc *d;
+  char *pg, *np;
+  uint i;
+  int len;
+
+  for(;;){
+    acquire(&nic.lock);
+    i = (nic.regs[E_RDT] + 1) % NRXD;
+    d = &nic.rx[i];
+    if(!(d->status & RXD_DD)){
+      release(&nic.lock);
+      return;
+    }
+    pg = 0;
+    len = d->length;
+    if((d->status & RXD_EOP) && (np = kalloc()) != 0){
+      pg = nic.rxpage[i];
+      nic.rxpage[i] = np;
+      d->addr = (uint)np;
+    }
+    // Else a frame too big for one buffer, or no memory for a
+    // new one: drop it and reuse the page.
+    d->status = 0;
+    __sync_synchronize();
+    nic.regs[E_RDT] = i;
+    release(&nic.lock);
+    if(pg)
+      netrx(pg, len);
+  }
+}
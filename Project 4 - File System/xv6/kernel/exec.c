@@ -2,25 +2,136 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
+#include "vdso.h"
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
 
+// exec doesn't read the program in.  It records the loadable
+// segments in proc->seg, and execfault reads each page on its
+// first touch.  A page holding only file data, at a file offset
+// the page cache can map, is the page cache's own page, shared
+// by every process running the same program: it is mapped
+// copy-on-write, so a write gets a private copy.  Programs are
+// linked so that their segments' file offsets and addresses
+// agree modulo PGSIZE (see USER_LDFLAGS).
+
+// Read in the page of p's program holding va, which isn't
+// present.  Returns 1 if no segment covers va, 0 if the page
+// is now mapped, and -1 on error.
 int
-exec(char *path, char **argv)
+execfault(struct proc *p, uint va)
 {
-  char *s, *last;
-  int i, off;
+  struct seg *s;
+  char *mem;
+  uint a, start, end;
+  int major;
+
+  a = (uint)PGROUNDDOWN(va);
+  major = 0;
+  for(s = p->seg; s < p->seg + NSEG; s++){
+    if(s->memsz && a >= s->va && a + PGSIZE <= s->va + s->filesz &&
+       (s->off - s->va) % PGSIZE == 0){
+      // All file data: share it.
+      ilockshared(p->exe);
+      mem = pcget(p->exe, (s->off + (a - s->va)) / PGSIZE, &major);
+      iunlock(p->exe);
+      if(mem == 0)
+        return -1;
+      if(mapuvm(p->pgdir, a, mem, PTE_COW) < 0){
+        kfree(mem);
+        return -1;
+      }
+      uvmfault(p, major);
+      return 0;
+    }
+  }
+
+  // A private page of zeroes and whatever file data falls in it.
+  mem = 0;
+  for(s = p->seg; s < p->seg + NSEG; s++){
+    if(s->memsz == 0 || a >= s->va + s->memsz || s->va >= a + PGSIZE)
+      continue;
+    if(mem == 0 && (mem = uvmpage(1)) == 0)
+      return -1;
+    start = s->va > a ? s->va : a;
+    end = s->va + s->filesz < a + PGSIZE ? s->va + s->filesz : a + PGSIZE;
+    if(start >= end)
+      continue;
+    major = 1;
+    ilockshared(p->exe);
+    if(readi(p->exe, mem + (start - a), s->off + (start - s->va), end - start)
+       != end - start){
+      iunlock(p->exe);
+      kfree(mem);
+      return -1;
+    }
+    iunlock(p->exe);
+  }
+  if(mem == 0)
+    return 1;
+  if(mapuvm(p->pgdir, a, mem, PTE_W) < 0){
+    kfree(mem);
+    return -1;
+  }
+  uvmfault(p, major);
+  return 0;
+}
+
+// p has shrunk to sz: its segments mustn't read pages back
+// in above that.
+void
+exectrim(struct proc *p, uint sz)
+{
+  struct seg *s;
+
+  for(s = p->seg; s < p->seg + NSEG; s++){
+    if(s->memsz == 0)
+      continue;
+    if(s->va >= sz)
+      s->memsz = 0;
+    else if(s->va + s->memsz > sz)
+      s->memsz = sz - s->va;
+    if(s->filesz > s->memsz)
+      s->filesz = s->memsz;
+  }
+}
+
+// A user image load has built, not yet given to a process.
+struct image {
+  pde_t *pgdir;
+  uint sz;
+  uint sp;                     // Stack pointer, at argc
+  uint entry;
+  struct inode *exe;
+  struct seg seg[NSEG];
+};
+
+// Build the image of path run with argv, for process p, which
+// the vdso pages are mapped for.  Returns -1 on error.
+static int
+load(char *path, char **argv, struct proc *p, struct image *im)
+{
+  int i, off, nseg;
   uint argc, sz, sp, ustack[3+MAXARG+1];
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *exe;
   struct proghdr ph;
-  pde_t *pgdir, *oldpgdir;
+  struct seg *seg;
+  pde_t *pgdir;
 
-  if((ip = namei(path)) == 0)
+  begin_op();
+  if((ip = namei(path)) == 0){
+    end_op();
     return -1;
+  }
   ilock(ip);
   pgdir = 0;
+  exe = 0;
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) < sizeof(elf))
@@ -28,33 +139,46 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pgdir = setupkvm()) == 0)
+  if((pgdir = setupkvm()) == 0 || mapvdso(pgdir, p) < 0)
     goto bad;
 
-  // Load program into memory.
-  sz = 0;
+  // Record the segments; execfault pages them in.
+  sz = USERBASE;
+  nseg = 0;
+  seg = im->seg;
+  memset(seg, 0, sizeof(im->seg));
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
-    if(ph.type != ELF_PROG_LOAD)
+    if(ph.type != ELF_PROG_LOAD || ph.memsz == 0)
       continue;
-    if(ph.memsz < ph.filesz)
+    if(ph.memsz < ph.filesz || nseg == NSEG)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.va + ph.memsz)) == 0)
+    if(ph.va < USERBASE || ph.va + ph.memsz < ph.va || ph.va + ph.memsz > MMAPTOP)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.va, ip, ph.offset, ph.filesz) < 0)
+    if(ph.offset + ph.filesz < ph.offset || ph.offset + ph.filesz > ip->size)
       goto bad;
+    seg[nseg].va = ph.va;
+    seg[nseg].filesz = ph.filesz;
+    seg[nseg].memsz = ph.memsz;
+    seg[nseg].off = ph.offset;
+    nseg++;
+    if(ph.va + ph.memsz > sz)
+      sz = ph.va + ph.memsz;
   }
+  exe = idup(ip);
   iunlockput(ip);
+  end_op();
   ip = 0;
 
-  // Allocate a one-page stack at the next page boundary
+  // The heap starts at the next page boundary.  Map the top
+  // page of the stack; lazyfault grows it down from there.
   sz = PGROUNDUP(sz);
-  if((sz = allocuvm(pgdir, sz, sz + PGSIZE)) == 0)
+  if(allocuvm(pgdir, USTACKTOP - PGSIZE, USTACKTOP) == 0)
     goto bad;
 
   // Push argument strings, prepare rest of stack in ustack.
-  sp = sz;
+  sp = USTACKTOP;
   for(argc = 0; argv[argc]; argc++) {
     if(argc >= MAXARG)
       goto bad;
@@ -74,27 +198,89 @@ exec(char *path, char **argv)
   if(copyout(pgdir, sp, ustack, (3+argc+1)*4) < 0)
     goto bad;
 
-  // Save program name for debugging.
+  im->pgdir = pgdir;
+  im->sz = sz;
+  im->sp = sp;
+  im->entry = elf.entry;
+  im->exe = exe;
+  return 0;
+
+ bad:
+  if(pgdir)
+    freevm(pgdir);
+  if(ip){
+    iunlockput(ip);
+    end_op();
+  }
+  if(exe){
+    begin_op();
+    iput(exe);
+    end_op();
+  }
+  return -1;
+}
+
+// Save program name for debugging.
+static void
+setname(struct proc *p, char *path)
+{
+  char *s, *last;
+
   for(last=s=path; *s; s++)
     if(*s == '/')
       last = s+1;
-  safestrcpy(proc->name, last, sizeof(proc->name));
+  safestrcpy(p->name, last, sizeof(p->name));
+}
+
+int
+exec(char *path, char **argv)
+{
+  struct image im;
+  struct inode *oldexe;
+  pde_t *oldpgdir;
+
+  if(load(path, argv, proc, &im) < 0)
+    return -1;
+  setname(proc, path);
 
   // Commit to the user image.
-  oldpgdir = proc->pgdir;
-  proc->pgdir = pgdir;
-  proc->sz = sz;
-  proc->tf->eip = elf.entry;  // main
-  proc->tf->esp = sp;
+  oldexe = proc->exe;
+  oldpgdir = swappgdir(im.pgdir);
+  proc->sz = im.sz;
+  proc->rss = 1;  // the stack; the rest is paged in
+  proc->exe = im.exe;
+  memmove(proc->seg, im.seg, sizeof(im.seg));
+  proc->tf->eip = im.entry;  // main
+  proc->tf->esp = im.sp;
   switchuvm(proc);
   freevm(oldpgdir);
+  mmapclear(proc);
+  if(oldexe){
+    begin_op();
+    iput(oldexe);
+    end_op();
+  }
 
   return 0;
+}
 
- bad:
-  if(pgdir)
-    freevm(pgdir);
-  if(ip)
-    iunlockput(ip);
-  return -1;
+// Give p, a new process with no user memory yet, the image of
+// path run with argv, as spawn does instead of fork and exec.
+// Its trap frame must already have the user segments.
+int
+execnew(struct proc *p, char *path, char **argv)
+{
+  struct image im;
+
+  if(load(path, argv, p, &im) < 0)
+    return -1;
+  setname(p, path);
+  p->pgdir = im.pgdir;
+  p->sz = im.sz;
+  p->rss = p->maxrss = 1;
+  p->exe = im.exe;
+  memmove(p->seg, im.seg, sizeof(im.seg));
+  p->tf->eip = im.entry;
+  p->tf->esp = im.sp;
+  return 0;
 }
@@ -1,20 +1,30 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
+#include "mmu.h"
 #include "fs.h"
+#include "sleeplock.h"
 #include "file.h"
 #include "spinlock.h"
+#include "x86.h"
+#include "uio.h"
+#include "poll.h"
+#include "socket.h"
 
 struct devsw devsw[NDEV];
+
+// Open files come from a slab cache, so there is no fixed limit
+// on them.  Reference counts change only by atomic instructions,
+// so no lock is needed: whoever drops the last one frees the file.
 struct {
-  struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache *cache;
 } ftable;
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
+  ftable.cache = kmem_cache_create("file", sizeof(struct file));
 }
 
 // Allocate a file structure.
@@ -23,27 +33,19 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = kmem_cache_alloc(ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(xadd(&f->ref, 1) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -52,23 +54,29 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  uint r;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  r = xadd(&f->ref, -1);
+  if(r < 1)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(r > 1)
     return;
-  }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
-  release(&ftable.lock);
+  kmem_cache_free(ftable.cache, f);
   
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
-  else if(ff.type == FD_INODE)
+  else if(ff.type == FD_SOCK)
+    sockclose(ff.sock);
+  else if(ff.type == FD_AIO)
+    aioclose(ff.aio);
+  else if(ff.type == FD_NOTIFY)
+    notifyclose(ff.notify);
+  else if(ff.type == FD_INODE){
+    begin_op();
     iput(ff.ip);
+    end_op();
+  }
 }
 
 // Get metadata about file f.
@@ -84,58 +92,411 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Read up to n entries of directory f, with their stats, into
+// ents; see dirreadstat.
+int
+filereaddir(struct file *f, struct direntstat *ents, int n)
+{
+  if(f->type != FD_INODE || f->readable == 0)
+    return -1;
+  return dirreadstat(f->ip, &f->off, ents, n);
+}
+
+// Which of events (or POLLERR, POLLHUP) hold for f; see poll.h.
+// If none do and e is nonzero, e is put on the pipe's or device's
+// poll list.  Files and devices without a poll are always ready.
+int
+filepoll(struct file *f, int events, struct pollent *e)
+{
+  short type, major;
+
+  if(!f->readable)
+    events &= ~POLLIN;
+  if(!f->writable)
+    events &= ~POLLOUT;
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable, events, e);
+  if(f->type == FD_SOCK)
+    return sockpoll(f->sock, events, e);
+  if(f->type == FD_AIO)
+    return aiopoll(f->aio, events, e);
+  if(f->type == FD_NOTIFY)
+    return notifypoll(f->notify, events, e);
+  if(f->type == FD_INODE){
+    ilock(f->ip);
+    type = f->ip->type;
+    major = f->ip->major;
+    iunlock(f->ip);
+    if(type == T_DEV && major >= 0 && major < NDEV && devsw[major].poll)
+      return devsw[major].poll(f->ip, events, e);
+  }
+  return events & (POLLIN|POLLOUT);
+}
+
 // Read from file f.  Addr is kernel address.
 int
 fileread(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
+  int r, seq;
 
   if(f->readable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+    return piperead(f->pipe, addr, n, f->nonblock);
+  if(f->type == FD_SOCK){
+    iov.iov_base = addr;
+    iov.iov_len = n;
+    return sockrecv(f->sock, &iov, 1, 0, 0, f->nonblock);
+  }
+  if(f->type == FD_AIO)
+    return aioread(f->aio, addr, n, f->nonblock);
+  if(f->type == FD_NOTIFY)
+    return notifyread(f->notify, addr, n, f->nonblock);
   if(f->type == FD_INODE){
+    if(f->nonblock && n > 0 && filepoll(f, POLLIN, 0) == 0)
+      return -1;
     ilock(f->ip);
+    seq = f->off == f->raoff;
     if((r = readi(f->ip, addr, f->off, n)) > 0)
       f->off += r;
+    f->raoff = f->off;
+
+    // Sequential reader: keep NRAHEAD blocks in flight ahead of it.
+    if(seq && r > 0){
+      if(f->raend < f->off)
+        f->raend = f->off;
+      if(f->raend < f->off + NRAHEAD*BSIZE){
+        ireadahead(f->ip, f->raend, f->off + NRAHEAD*BSIZE - f->raend);
+        f->raend = f->off + NRAHEAD*BSIZE;
+      }
+    }
     iunlock(f->ip);
     return r;
   }
   panic("fileread");
 }
 
+// Write the iovcnt buffers in iov to ip at *off, advancing *off.
+// Data goes a few blocks per transaction to avoid exceeding the
+// maximum log transaction size: the inode, the two levels of
+// indirect block, two partial blocks at the ends, and a data
+// block and its bitmap block for each block in between.  A write
+// that fits takes ip's lock once.
+static int
+iwritev(struct inode *ip, struct iovec *iov, int iovcnt, uint *off)
+{
+  int max = ((MAXOPBLOCKS-1-2-2) / 2) * BSIZE;
+  int i, m, n1, r, tot;
+  uint done;
+
+  i = 0;
+  done = 0;  // bytes of iov[i] already written
+  tot = 0;
+  r = n1 = 0;
+  while(i < iovcnt){
+    begin_op();
+    ilock(ip);
+    for(m = 0; i < iovcnt && m < max; ){
+      n1 = iov[i].iov_len - done;
+      if(n1 > max - m)
+        n1 = max - m;
+      if((r = writei(ip, (char*)iov[i].iov_base + done, *off, n1)) > 0){
+        *off += r;
+        done += r;
+        m += r;
+      }
+      if(r != n1)
+        break;  // error, or the file is at MAXFILE
+      if(done == iov[i].iov_len){
+        i++;
+        done = 0;
+      }
+    }
+    iunlock(ip);
+    end_op();
+    tot += m;
+    if(r != n1)
+      break;
+  }
+  return tot > 0 ? tot : r;
+}
+
 // Write to file f.  Addr is kernel address.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
+  struct iovec iov;
 
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+    return pipewrite(f->pipe, addr, n, f->nonblock);
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  if(f->type == FD_SOCK)
+    return socksend(f->sock, &iov, 1, 0, 0);
+  if(f->type == FD_INODE)
+    return iwritev(f->ip, &iov, 1, &f->off);
+  panic("filewrite");
+}
+
+// Make file f length bytes long; see itruncate.
+int
+filetruncate(struct file *f, uint length)
+{
+  int r;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  begin_op();
+  ilock(f->ip);
+  r = itruncate(f->ip, length);
+  iunlock(f->ip);
+  end_op();
+  return r;
+}
+
+// Allocate zeroed blocks for bytes [off, off+n) of file f, a
+// transaction at a time as in iwritev, so later writes there
+// need no allocation.  Extends the file to off+n if shorter.
+int
+fileallocate(struct file *f, uint off, uint n)
+{
+  uint max = ((MAXOPBLOCKS-1-2-2) / 2) * BSIZE;
+  uint m;
+  int r;
+
+  if(f->writable == 0 || f->type != FD_INODE || off + n < off)
+    return -1;
+  r = 0;
+  while(n > 0 && r == 0){
+    m = n < max ? n : max;
+    begin_op();
+    ilock(f->ip);
+    r = iallocate(f->ip, off, m);
+    iunlock(f->ip);
+    end_op();
+    off += m;
+    n -= m;
+  }
+  return r;
+}
+
+// Read from file f at offset off, leaving f->off alone.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilockshared(f->ip);
+  r = readi(f->ip, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Write to file f at offset off, leaving f->off alone.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  struct iovec iov;
+
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return iwritev(f->ip, &iov, 1, &off);
+}
+
+// Send n bytes of file in, starting at *off, to file out, and
+// advance *off.  A pipe is filled straight from the buffer cache,
+// without taking in's lock while waiting for room; anything else
+// is written from a kernel page.
+int
+filesend(struct file *out, struct file *in, uint *off, int n)
+{
+  struct iovec iov;
+  char *buf;
+  int eof, m, r, tot;
+
+  if(in->readable == 0 || in->type != FD_INODE || out->writable == 0 || n < 0)
+    return -1;
+  tot = 0;
+  r = 0;
+  if(out->type == FD_PIPE){
+    while(tot < n){
+      if((r = pipewait(out->pipe)) < 0)
+        break;
+      ilock(in->ip);
+      r = readifn(in->ip, *off, n - tot, pipeput, out->pipe);
+      if(r > 0){
+        *off += r;
+        tot += r;
+      }
+      eof = *off >= in->ip->size;
+      iunlock(in->ip);
+      if(r < 0 || eof)
+        break;
+      // r == 0: another writer filled the pipe first.
+    }
+    return tot > 0 ? tot : r;
+  }
+  if(out->type == FD_INODE){
+    if((buf = kalloc()) == 0)
+      return -1;
+    while(tot < n){
+      m = n - tot < PGSIZE ? n - tot : PGSIZE;
+      ilock(in->ip);
+      r = readi(in->ip, buf, *off, m);
+      iunlock(in->ip);
+      if(r <= 0)
+        break;
+      iov.iov_base = buf;
+      iov.iov_len = r;
+      m = r;
+      if((r = iwritev(out->ip, &iov, 1, &out->off)) > 0){
+        *off += r;
+        tot += r;
+      }
+      if(r != m)
+        break;
+    }
+    kfree(buf);
+    return tot > 0 ? tot : r;
+  }
+  return -1;
+}
+
+struct copyarg {
+  struct inode *ip;
+  uint off;
+};
+
+static int
+copyput(void *arg, char *src, int n)
+{
+  struct copyarg *a = arg;
+  int r;
+
+  if((r = writei(a->ip, src, a->off, n)) > 0)
+    a->off += r;
+  return r;
+}
+
+// Copy n bytes of file in, starting at *off, to file out at its
+// offset, advancing both.  Between two regular files each block
+// goes from the buffer cache straight to the buffer cache, a
+// transaction's worth at a time under both inodes' locks; a
+// whole block written is never read first, and the new blocks
+// of a run come from balloc one after another.  Anything else
+// goes as filesend does.
+int
+filecopy(struct file *out, struct file *in, uint *off, int n)
+{
+  int max = ((MAXOPBLOCKS-1-2-2) / 2) * BSIZE;
+  struct inode *a, *b;
+  struct copyarg ca;
+  int m, r, tot;
+
+  if(in->readable == 0 || in->type != FD_INODE || out->writable == 0 || n < 0)
+    return -1;
+  // An open inode's type doesn't change.  Two regular files are
+  // never otherwise locked together, so locking them in address
+  // order can't deadlock.
+  if(out->type != FD_INODE || in->ip == out->ip ||
+     in->ip->type != T_FILE || out->ip->type != T_FILE)
+    return filesend(out, in, off, n);
+  a = in->ip < out->ip ? in->ip : out->ip;
+  b = in->ip < out->ip ? out->ip : in->ip;
+  ca.ip = out->ip;
+  tot = 0;
+  r = 0;
+  while(tot < n){
+    m = n - tot < max ? n - tot : max;
+    begin_op();
+    ilock(a);
+    ilock(b);
+    ca.off = out->off;
+    r = readifn(in->ip, *off, m, copyput, &ca);
+    iunlock(b);
+    iunlock(a);
+    end_op();
+    if(r > 0){
+      *off += r;
+      out->off = ca.off;
+      tot += r;
+    }
+    if(r != m)
+      break;  // end of in, an error, or out is at MAXFILE
+  }
+  return tot > 0 ? tot : r;
+}
+
+// Read from file f into the iovcnt buffers in iov, which are
+// kernel addresses.  An inode is read under one lock, stopping
+// at end of file.  A pipe fills only the first nonempty buffer,
+// as one read would, so it never blocks with data in hand.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    for(i = 0; i < iovcnt; i++)
+      if(iov[i].iov_len > 0)
+        return piperead(f->pipe, iov[i].iov_base, iov[i].iov_len, f->nonblock);
+    return 0;
+  }
+  if(f->type == FD_SOCK)
+    return sockrecv(f->sock, iov, iovcnt, 0, 0, f->nonblock);
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = writei(f->ip, addr, f->off, n)) > 0)
+    tot = 0;
+    for(i = 0; i < iovcnt; i++){
+      if((r = readi(f->ip, iov[i].iov_base, f->off, iov[i].iov_len)) < 0){
+        if(tot == 0)
+          tot = r;
+        break;
+      }
       f->off += r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    f->raoff = f->off;
     iunlock(f->ip);
-    return r;
+    return tot;
   }
-  panic("filewrite");
+  panic("filereadv");
 }
 
+// Write the iovcnt buffers in iov, which are kernel addresses,
+// to file f.
 int
-getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength)
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
 {
-  int i = 0;
-  struct file *f;
-  acquire(&ftable.lock);
-  for (f = ftable.file; f < ftable.file + NFILE; f++) {
-    if (f->ip) {
-      i += readBuf(f, key, value, valueLength, results, resultsLength);
-      // cprintf("getFilesByTag: strlen(results) = %d\n", strlen(results));
+  int i, r, tot;
+
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    tot = 0;
+    for(i = 0; i < iovcnt; i++){
+      if((r = pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len, f->nonblock)) < 0)
+        return tot > 0 ? tot : r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
     }
+    return tot;
   }
-  release(&ftable.lock);
-  return i;
-}
\ No newline at end of file
+  if(f->type == FD_SOCK)
+    return socksend(f->sock, iov, iovcnt, 0, 0);
+  if(f->type == FD_INODE)
+    return iwritev(f->ip, iov, iovcnt, &f->off);
+  panic("filewritev");
+}
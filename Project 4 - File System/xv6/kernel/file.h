@@ -1,13 +1,19 @@
 #ifndef _FILE_H_
 #define _FILE_H_
 struct file {
-  enum { FD_NONE, FD_PIPE, FD_INODE } type;
-  int ref; // reference count
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_SOCK, FD_AIO, FD_NOTIFY } type;
+  volatile uint ref; // reference count; changed atomically
   char readable;
   char writable;
+  char nonblock;  // O_NONBLOCK
   struct pipe *pipe;
   struct inode *ip;
+  struct sock *sock;
+  struct aioctx *aio;
+  struct notifyctx *notify;
   uint off;
+  uint raoff;  // offset just past the last read, to detect sequential reads
+  uint raend;  // offset up to which read-ahead has been started
 };
 
 
@@ -16,31 +22,56 @@ struct file {
 struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
-  int ref;            // Reference count
-  int flags;          // I_BUSY, I_VALID
+  volatile uint ref;  // Reference count; changed atomically (see iget)
+  int flags;          // I_VALID, I_TAGS, I_NOLOG, I_DIRTY, I_ITAGS
+  struct sleeplock lock; // held between ilock and iunlock
+  struct inode *hnext; // hash chain
+  struct inode *prev;  // free list, when ref is 0
+  struct inode *next;
 
   short type;         // copy of disk inode
   short major;
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
-  uint tags;
+  uint addrs[NDIRECT+2];
+  uint tags;          // Tag block address, 0 if untagged
+  char *tagbuf;       // Copy of the tag block, if I_TAGS; BSIZE bytes
+  uint indaddr;       // Indirect block copied in ind[], 0 if none
+  uint indbase;       // First file block ind[] maps
+  uint *ind;          // NINDIRECT entries
+  uint mounted;       // Disk mounted on this directory, or 0
+  uint bnext;         // Block balloc tries first for it, or 0
 };
 
-#define I_BUSY 0x1
 #define I_VALID 0x2
+#define I_TAGS 0x4
+#define I_NOLOG 0x8  // writei goes around the log (see dirrehash)
+#define I_DIRTY 0x10 // size or addrs changed since the last iupdate
+#define I_ITAGS 0x20 // tagbuf holds the dinode's inline tags
+
+
+// A process in poll, waiting on a pipe or device.  It is on a
+// list kept by the pipe or device, guarded by lk; see poll.c.
+struct pollent {
+  struct proc *p;
+  struct spinlock *lk;
+  struct pollent *next;
+  struct pollent **prev;  // 0 when on no list
+};
 
 
 // device implementations
 
 struct devsw {
-  int (*read)(struct inode*, char*, int);
+  int (*read)(struct inode*, char*, uint, int);  // at an offset
   int (*write)(struct inode*, char*, int);
+  int (*poll)(struct inode*, int, struct pollent*);  // 0 if always ready
 };
 
 extern struct devsw devsw[];
 
 #define CONSOLE 1
+#define KSTAT   2  // kernel counters (kstat.c)
 
 #endif // _FILE_H_
@@ -1,10 +1,14 @@
-// File system implementation.  Four layers:
+// File system implementation.  Five layers:
 //   + Blocks: allocator for raw disk blocks.
+//   + Log: crash recovery for multi-step updates (log.c).
 //   + Files: inode allocator, reading, writing, metadata.
 //   + Directories: inode with special contents (list of other inodes!)
 //   + Names: paths like /usr/rtm/xv6/fs.c for convenient naming.
 //
-// Disk layout is: superblock, inodes, block in-use bitmap, data blocks.
+// Disk layout is: superblock, inodes, block in-use bitmap, log, data blocks.
+//
+// Code that changes the file system must run inside a transaction
+// (begin_op/end_op) and write blocks with log_write, not bwrite.
 //
 // This file contains the low-level file system manipulation 
 // routines.  The (higher-level) system call implementations
@@ -17,65 +21,238 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "buf.h"
 #include "fs.h"
 #include "file.h"
+#include "x86.h"
+#include "direntstat.h"
+#include "tagquery.h"
+#include "notify.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void tagfree(struct inode*);
+static void dcpurge(uint, uint);
+
+#define NFSDEV 4  // disks that can hold a file system
+
+// The super block never changes once the file system is made,
+// so each disk's copy is read once and kept here, along with,
+// for each allocation group, the block at which balloc starts
+// a new run of blocks and the inode at which ialloc starts
+// looking; the group the next new directory goes in; and the
+// directory the disk is mounted on (see mount).
+struct {
+  struct spinlock lock;
+  struct {
+    int valid;
+    struct superblock sb;
+    uint next[NAGMAX];
+    uint inext[NAGMAX];
+    uint dirgroup;
+    struct inode *covered;
+  } dev[NFSDEV];
+} fsdev __attribute__((aligned(CACHELINE)));
+
+#define BRESERVE 32  // blocks set aside for a file's run; see balloc
 
 // Read the super block.
-static void
+void
 readsb(int dev, struct superblock *sb)
 {
   struct buf *bp;
-  
-  bp = bread(dev, 1);
-  memmove(sb, bp->data, sizeof(*sb));
-  brelse(bp);
+
+  if(dev < 0 || dev >= NFSDEV)
+    panic("readsb");
+  acquire(&fsdev.lock);
+  if(!fsdev.dev[dev].valid){
+    release(&fsdev.lock);
+    bp = bread(dev, 1);
+    acquire(&fsdev.lock);
+    memmove(&fsdev.dev[dev].sb, bp->data, sizeof(*sb));
+    if(fsdev.dev[dev].sb.bsize != BSIZE)
+      panic("readsb: block size");
+    fsdev.dev[dev].valid = 1;
+    brelse(bp);
+  }
+  *sb = fsdev.dev[dev].sb;
+  release(&fsdev.lock);
 }
 
-// Zero a block.
-static void
-bzero(int dev, int bno)
+// Whether dev may keep small files and tags in the inode.
+static int
+fsinline(uint dev)
 {
-  struct buf *bp;
-  
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
-  bwrite(bp);
-  brelse(bp);
+  struct superblock sb;
+
+  readsb(dev, &sb);
+  return sb.flags & SB_INLINE;
+}
+
+// Allocation groups.  A disk made without them is one group.
+// Groups past NAGMAX, which mkfs doesn't make, fold into the last.
+
+static uint
+ngroups(struct superblock *sb)
+{
+  uint n;
+
+  if(sb->agblocks == 0)
+    return 1;
+  n = (sb->size + sb->agblocks - 1) / sb->agblocks;
+  return n < NAGMAX ? n : NAGMAX;
+}
+
+// Group of block b.
+static uint
+bgroup(struct superblock *sb, uint b)
+{
+  uint g;
+
+  if(sb->agblocks == 0)
+    return 0;
+  g = b / sb->agblocks;
+  return g < NAGMAX ? g : NAGMAX - 1;
+}
+
+// Group of inode inum.
+static uint
+igroup(struct superblock *sb, uint inum)
+{
+  uint g;
+
+  if(sb->agblocks == 0 || sb->aginodes == 0)
+    return 0;
+  g = inum / sb->aginodes;
+  return g < ngroups(sb) ? g : ngroups(sb) - 1;
+}
+
+// First data block of group g, and the block past its last.
+static uint
+agstart(struct superblock *sb, uint g)
+{
+  uint b, data;
+
+  data = sb->size - sb->nblocks;
+  b = g * sb->agblocks;
+  return b < data ? data : b;
+}
+
+static uint
+agend(struct superblock *sb, uint g)
+{
+  if(sb->agblocks == 0 || g == NAGMAX - 1 || (g + 1) * sb->agblocks >= sb->size)
+    return sb->size;
+  return (g + 1) * sb->agblocks;
 }
 
 // Blocks. 
 
-// Allocate a disk block.
+// Take block b if it is free.  Returns whether it was.
+static int
+btake(uint dev, struct superblock *sb, uint b)
+{
+  struct buf *bp;
+  int bi, m;
+
+  bp = breadmeta(dev, BBLOCK(b, sb->ninodes));
+  bi = b % BPB;
+  m = 1 << (bi % 8);
+  if(bp->data[bi/8] & m){
+    brelse(bp);
+    return 0;
+  }
+  bp->data[bi/8] |= m;  // Mark block in use on disk.
+  log_write(bp);
+  brelse(bp);
+  return 1;
+}
+
+// Take the first free block from about start on.  The bitmap
+// is scanned a word at a time, wrapping around, so full regions
+// are skipped quickly.
 static uint
-balloc(uint dev)
+bscan(uint dev, struct superblock *sb, uint start)
 {
-  int b, bi, m;
+  int i, b, bi, wi, nmap;
+  uint *map;
   struct buf *bp;
-  struct superblock sb;
 
-  bp = 0;
-  readsb(dev, &sb);
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb.ninodes));
-    for(bi = 0; bi < BPB; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use on disk.
-        bwrite(bp);
-        brelse(bp);
-        return b + bi;
-      }
+  if(start >= sb->size)
+    start = 0;
+  nmap = (sb->size + BPB - 1) / BPB;
+  // The block holding start is visited twice, the second time
+  // from its beginning.
+  for(i = 0; i <= nmap; i++){
+    b = ((start / BPB + i) % nmap) * BPB;
+    wi = (i == 0) ? (start % BPB) / 32 : 0;
+    bp = breadmeta(dev, BBLOCK(b, sb->ninodes));
+    map = (uint*)bp->data;
+    for(; wi < BPB / 32 && b + wi*32 < sb->size; wi++){
+      if(map[wi] == 0xffffffff)
+        continue;
+      for(bi = 0; map[wi] & (1 << bi); bi++)
+        ;
+      if(b + wi*32 + bi >= sb->size)
+        break;
+      map[wi] |= 1 << bi;  // Mark block in use on disk.
+      log_write(bp);
+      brelse(bp);
+      return b + wi*32 + bi;
     }
     brelse(bp);
+    cond_resched();
   }
   panic("balloc: out of blocks");
 }
 
-// Free a disk block.
+// Allocate a disk block for ip.  A file's blocks come in runs:
+// each is taken right after the last, while that one is free.
+// When it isn't, a new run starts at the end of the last run
+// begun in ip's group, and BRESERVE blocks from there are left to
+// it, so that files written at once don't take turns block by
+// block.  That is only a hint; nothing stops another file taking
+// a block in it.  Once the runs reach the end of the group, they
+// start again from its beginning, to fill blocks freed since.
+static uint
+balloc(struct inode *ip)
+{
+  struct superblock sb;
+  uint b, g, start, *next;
+
+  readsb(ip->dev, &sb);
+  b = ip->bnext;
+  if(b == 0 || b >= sb.size || !btake(ip->dev, &sb, b)){
+    g = igroup(&sb, ip->inum);
+    next = fsdev.dev[ip->dev].next;
+    acquire(&fsdev.lock);
+    start = next[g];
+    if(start < agstart(&sb, g) || start >= agend(&sb, g))
+      start = agstart(&sb, g);
+    next[g] = start + BRESERVE;
+    release(&fsdev.lock);
+    b = bscan(ip->dev, &sb, start);
+    g = bgroup(&sb, b);
+    acquire(&fsdev.lock);
+    if(next[g] < b + BRESERVE)
+      next[g] = b + BRESERVE;
+    release(&fsdev.lock);
+  } else {
+    g = bgroup(&sb, b);
+    acquire(&fsdev.lock);
+    if(fsdev.dev[ip->dev].next[g] <= b)
+      fsdev.dev[ip->dev].next[g] = b + 1;
+    release(&fsdev.lock);
+  }
+  ip->bnext = b + 1;
+  return b;
+}
+
+// Free a disk block.  Only the bitmap changes; the block's old
+// contents stay, so anyone allocating a block that must start
+// out zero has to clear it (see bclear).  balloc finds it again
+// when its group's runs wrap around.
 static void
 bfree(int dev, uint b)
 {
@@ -83,16 +260,14 @@ bfree(int dev, uint b)
   struct superblock sb;
   int bi, m;
 
-  bzero(dev, b);
-
   readsb(dev, &sb);
-  bp = bread(dev, BBLOCK(b, sb.ninodes));
+  bp = breadmeta(dev, BBLOCK(b, sb.ninodes));
   bi = b % BPB;
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;  // Mark block free on disk.
-  bwrite(bp);
+  log_write(bp);
   brelse(bp);
 }
 
@@ -110,15 +285,25 @@ bfree(int dev, uint b)
 // 
 // ip->ref counts the number of pointer references to this cached
 // inode; references are typically kept in struct file and in proc->cwd.
-// When ip->ref falls to zero, the inode is no longer cached.
+// When ip->ref falls to zero, the inode goes on a free list in
+// least recently used order.  It keeps its contents until it is
+// recycled for another inode, so a later iget of the same inode
+// need not re-read it.  Lookups go through a hash table on
+// (dev, inum); iget first probes it with no lock, for an inode
+// some reference already holds in the cache.  ip->ref changes
+// only by atomic instructions, so that probe can add to it, and
+// iput takes icache.lock only to drop the last reference.  The
+// cache is carved out of kalloc() pages in iinit:
+// physstop/ICACHEFRAC bytes, but never fewer than NINODE
+// inodes.  Each inode's block-sized tagbuf and ind come from
+// other pages.
 // It is an error to use an inode without holding a reference to it.
 //
 // Processes are only allowed to read and write inode
 // metadata and contents when holding the inode's lock,
-// represented by the I_BUSY flag in the in-memory copy.
-// Because inode locks are held during disk accesses, 
-// they are implemented using a flag rather than with
-// spin locks.  Callers are responsible for locking
+// ip->lock.  Because inode locks are held during disk
+// accesses, they are sleeplocks, guarded by icache.lock,
+// rather than spin locks.  Callers are responsible for locking
 // inodes before passing them to routines in this file; leaving
 // this responsibility with the caller makes it possible for them
 // to create arbitrarily-sized atomic operations.
@@ -129,52 +314,157 @@ bfree(int dev, uint b)
 // responsibility to lock them before using them.  A non-zero
 // ip->ref keeps these unlocked inodes in the cache.
 
+#define NIHASH 31  // inode cache hash buckets
+#define IPP (PGSIZE / sizeof(struct inode))  // inodes per kalloc() page
+#define BPP (PGSIZE / BSIZE)                 // blocks per kalloc() page
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
-} icache;
+  int ninode;                   // inodes allocated by iinit
+  struct inode *hash[NIHASH];   // chains through hnext
+  // Inodes with ref 0, through prev/next.
+  // free.next is most recently released.
+  struct inode free;
+} icache __attribute__((aligned(CACHELINE)));
+
+// Directory name cache.  Maps (dev, directory inum, name) to the
+// inum of that entry, or to 0 if the directory is known not to
+// have it.  An entry only changes while its directory is locked,
+// so it always agrees with the directory's contents.
+
+#define NDCACHE 128  // slots; a new entry replaces whatever hashes there
+
+struct dentry {
+  uint dev;
+  uint dir;          // directory inode number, 0 if slot unused
+  uint inum;         // 0 if name is absent
+  char name[DIRSIZ];
+};
+
+// Lookups far outnumber updates, so lookups share the lock.
+struct {
+  struct rwlock lock;
+  struct dentry ent[NDCACHE];
+} dcache;
+
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &icache.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Carve BSIZE bytes out of a kalloc() page, for iinit.
+static void*
+iblock(void)
+{
+  static char *page;
+  static int n;
+
+  if(n % BPP == 0 && (page = kalloc()) == 0)
+    return 0;
+  return page + (n++ % BPP) * BSIZE;
+}
 
 void
 iinit(void)
 {
+  struct inode *ip, *page;
+  int n;
+
   initlock(&icache.lock, "icache");
+  initlock(&fsdev.lock, "fsdev");
+  initrwlock(&dcache.lock, "dcache");
+
+  icache.free.prev = &icache.free;
+  icache.free.next = &icache.free;
+  n = physstop / ICACHEFRAC / (sizeof(struct inode) + 2*BSIZE);
+  if(n < NINODE)
+    n = NINODE;
+  page = 0;
+  for(icache.ninode = 0; icache.ninode < n; icache.ninode++){
+    if(icache.ninode % IPP == 0 && (page = (struct inode*)kalloc()) == 0)
+      break;
+    ip = page + icache.ninode % IPP;
+    memset(ip, 0, sizeof(*ip));
+    if((ip->tagbuf = iblock()) == 0 || (ip->ind = iblock()) == 0)
+      break;
+    ip->dev = -1;
+    initsleeplock(&ip->lock);
+    ip->next = icache.free.next;
+    ip->prev = &icache.free;
+    icache.free.next->prev = ip;
+    icache.free.next = ip;
+  }
+  if(icache.ninode < NINODE)
+    panic("iinit: out of memory");
 }
 
 static struct inode* iget(uint dev, uint inum);
 
-// Allocate a new inode with the given type on device dev.
+// Allocate a new inode with the given type, to be linked into
+// directory dp, on dp's device.  It goes in dp's allocation
+// group, except that directories made in the root are dealt
+// round the groups in turn, so that separate trees spread over
+// the disk.  The search starts at the inode after the last one
+// handed out in the group, or at the lowest one freed since, and
+// wraps around the whole disk, reading each inode block once.
+// Inodes below the cursor are in use, so a run of creates reads
+// just the block it is filling.
 struct inode*
-ialloc(uint dev, short type)
+ialloc(struct inode *dp, short type)
 {
-  int inum;
+  uint dev, inum, start, n, g;
   struct buf *bp;
   struct dinode *dip;
   struct superblock sb;
 
+  dev = dp->dev;
   readsb(dev, &sb);
-  for(inum = 1; inum < sb.ninodes; inum++){  // loop over inode blocks
-    bp = bread(dev, IBLOCK(inum));
-    dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      bwrite(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
-    }
+  acquire(&fsdev.lock);
+  if(type == T_DIR && dp->inum == ROOTINO)
+    g = fsdev.dev[dev].dirgroup++ % ngroups(&sb);
+  else
+    g = igroup(&sb, dp->inum);
+  start = fsdev.dev[dev].inext[g];
+  if(start < g * sb.aginodes)
+    start = g * sb.aginodes;
+  release(&fsdev.lock);
+  if(start < 1 || start >= sb.ninodes)
+    start = 1;
+
+  inum = start;
+  for(n = 0; n < sb.ninodes; ){
+    bp = breadmeta(dev, IBLOCK(inum));
+    do {
+      dip = (struct dinode*)bp->data + inum%IPB;
+      if(inum != 0 && dip->type == 0){  // a free inode
+        memset(dip, 0, sizeof(*dip));
+        dip->type = type;
+        log_write(bp);   // mark it allocated on the disk
+        brelse(bp);
+        acquire(&fsdev.lock);
+        fsdev.dev[dev].inext[igroup(&sb, inum)] = inum + 1;
+        release(&fsdev.lock);
+        return iget(dev, inum);
+      }
+      inum = (inum + 1) % sb.ninodes;
+      n++;
+    } while(inum % IPB != 0 && n < sb.ninodes);
     brelse(bp);
   }
   panic("ialloc: no inodes");
 }
 
 // Copy inode, which has changed, from memory to disk.
+// Caller holds ip locked, in a transaction.
 void
 iupdate(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
 
-  bp = bread(ip->dev, IBLOCK(ip->inum));
+  ip->flags &= ~I_DIRTY;
+  bp = breadmeta(ip->dev, IBLOCK(ip->inum));
   dip = (struct dinode*)bp->data + ip->inum%IPB;
   dip->type = ip->type;
   dip->major = ip->major;
@@ -182,7 +472,8 @@ iupdate(struct inode *ip)
   dip->nlink = ip->nlink;
   dip->size = ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
-  bwrite(bp);
+  dip->tags = ip->tags;
+  log_write(bp);
   brelse(bp);
 }
 
@@ -191,50 +482,147 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
+  uint r;
+
+  // Try for a cached inode in use, without the lock.  Only an
+  // inode with ref 0 is recycled, so once a reference is added
+  // to one still numbered inum, it is ours.  Inodes are never
+  // freed, so the walk needs no rcu_read_lock; a chain changing
+  // under it can only make it miss.
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev != dev || ip->inum != inum)
+      continue;
+    r = ip->ref;
+    if(r > 0 && cmpxchg(&ip->ref, r, r + 1) == r){
+      if(ip->dev == dev && ip->inum == inum)
+        return ip;
+      iput(ip);  // recycled as another inode meanwhile
+    }
+    break;
+  }
 
   acquire(&icache.lock);
 
   // Try for cached inode.
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(xadd(&ip->ref, 1) == 0){
+        ip->prev->next = ip->next;
+        ip->next->prev = ip->prev;
+      }
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Allocate fresh inode.
-  if(empty == 0)
+  // Recycle the least recently used free inode.
+  ip = icache.free.prev;
+  if(ip == &icache.free)
     panic("iget: no inodes");
+  ip->prev->next = ip->next;
+  ip->next->prev = ip->prev;
+  if(ip->dev != -1){
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->flags = 0;
+  ip->mounted = 0;
+  ip->bnext = 0;
+  __sync_synchronize();  // a probe seeing ref 1 sees the new inum
+  ip->ref = 1;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  rcu_assign(pp, ip);
   release(&icache.lock);
 
   return ip;
 }
 
+// Write back every inode writei left dirty, each in a
+// transaction of its own.  The flusher and sync call this so
+// that growing files reach the disk without an iupdate for
+// every write.
+void
+iflush(void)
+{
+  struct inode *ip;
+  int h;
+
+  acquire(&icache.lock);
+  for(h = 0; h < NIHASH; h++){
+  again:
+    for(ip = icache.hash[h]; ip; ip = ip->hnext){
+      if(ip->ref == 0 || !(ip->flags & I_DIRTY))
+        continue;
+      xadd(&ip->ref, 1);
+      release(&icache.lock);
+      begin_op();
+      ilock(ip);
+      if(ip->flags & I_DIRTY)
+        iupdate(ip);
+      iunlock(ip);
+      iput(ip);
+      end_op();
+      acquire(&icache.lock);
+      goto again;  // the chain may have changed
+    }
+  }
+  release(&icache.lock);
+}
+
+// Forget every inode no one holds, so the next iget of each reads
+// it from the disk.  Run after iflush, as no free inode is dirty.
+void
+iprune(void)
+{
+  struct inode *ip, **pp;
+
+  acquire(&icache.lock);
+  for(ip = icache.free.next; ip != &icache.free; ip = ip->next){
+    if(ip->dev == -1)
+      continue;
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+    ip->dev = -1;
+    ip->flags = 0;
+  }
+  release(&icache.lock);
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  xadd(&ip->ref, 1);
   return ip;
 }
 
-// Lock the given inode.
-void
-ilock(struct inode *ip)
+// Start reading the block holding inode inum, unless the cache
+// has it valid already, so that an ilock soon after need not wait
+// for the disk.  The probe takes no lock, like iget's: it is only
+// a hint.
+static void
+iprefetch(uint dev, uint inum)
+{
+  struct inode *ip;
+
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext)
+    if(ip->dev == dev && ip->inum == inum && (ip->flags & I_VALID))
+      return;
+  breadahead(dev, IBLOCK(inum));
+}
+
+// Lock the given inode, which may be free (type 0).
+// A free inode is not left I_VALID.
+static void
+ilockany(struct inode *ip)
 {
   struct buf *bp;
   struct dinode *dip;
@@ -243,13 +631,11 @@ ilock(struct inode *ip)
     panic("ilock");
 
   acquire(&icache.lock);
-  while(ip->flags & I_BUSY)
-    sleep(ip, &icache.lock);
-  ip->flags |= I_BUSY;
+  acquiresleep(&ip->lock, &icache.lock);
   release(&icache.lock);
 
   if(!(ip->flags & I_VALID)){
-    bp = bread(ip->dev, IBLOCK(ip->inum));
+    bp = breadmeta(ip->dev, IBLOCK(ip->inum));
     dip = (struct dinode*)bp->data + ip->inum%IPB;
     ip->type = dip->type;
     ip->major = dip->major;
@@ -257,23 +643,53 @@ ilock(struct inode *ip)
     ip->nlink = dip->nlink;
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
+    ip->indaddr = 0;
+    ip->tags = dip->tags;
     brelse(bp);
-    ip->flags |= I_VALID;
-    if(ip->type == 0)
-      panic("ilock: no type");
+    if(ip->type)
+      ip->flags |= I_VALID;
+  }
+}
+
+// Lock the given inode.
+void
+ilock(struct inode *ip)
+{
+  ilockany(ip);
+  if(ip->type == 0)
+    panic("ilock: no type");
+}
+
+// Lock the given inode shared with other readers, for callers
+// that only read its contents with readi or readifn and don't
+// change the inode.  An inode not yet read from disk, or a
+// device, whose read routine may drop and retake the lock, is
+// locked exclusively instead; iunlock releases either kind.
+void
+ilockshared(struct inode *ip)
+{
+  if(ip == 0 || ip->ref < 1)
+    panic("ilockshared");
+
+  acquire(&icache.lock);
+  if(!(ip->flags & I_VALID) || ip->type == T_DEV){
+    release(&icache.lock);
+    ilock(ip);
+    return;
   }
+  acquiresleepshared(&ip->lock, &icache.lock);
+  release(&icache.lock);
 }
 
 // Unlock the given inode.
 void
 iunlock(struct inode *ip)
 {
-  if(ip == 0 || !(ip->flags & I_BUSY) || ip->ref < 1)
+  if(ip == 0 || (!ip->lock.locked && ip->lock.readers == 0) || ip->ref < 1)
     panic("iunlock");
 
   acquire(&icache.lock);
-  ip->flags &= ~I_BUSY;
-  wakeup(ip);
+  releasesleep(&ip->lock);
   release(&icache.lock);
 }
 
@@ -281,21 +697,53 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct superblock sb;
+  uint r, *inext;
+
+  // Not the last reference: drop it without the lock.
+  while((r = ip->ref) > 1)
+    if(cmpxchg(&ip->ref, r, r - 1) == r)
+      return;
+
   acquire(&icache.lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
     // inode is no longer used: truncate and free inode.
-    if(ip->flags & I_BUSY)
+    if(ip->lock.locked || ip->lock.readers)
       panic("iput busy");
-    ip->flags |= I_BUSY;
+    acquiresleep(&ip->lock, &icache.lock);
     release(&icache.lock);
+    if(ip->type == T_DIR)
+      dcpurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
+    readsb(ip->dev, &sb);
+    inext = &fsdev.dev[ip->dev].inext[igroup(&sb, ip->inum)];
+    acquire(&fsdev.lock);
+    if(ip->inum < *inext)
+      *inext = ip->inum;
+    release(&fsdev.lock);
     acquire(&icache.lock);
     ip->flags = 0;
-    wakeup(ip);
+    releasesleep(&ip->lock);
+  }
+  if(ip->ref == 1 && (ip->flags & I_DIRTY)){
+    // Last reference to an inode writei left dirty: write it
+    // now, so an unreferenced inode never needs writing and
+    // iget can recycle it.
+    acquiresleep(&ip->lock, &icache.lock);
+    release(&icache.lock);
+    if(ip->flags & I_DIRTY)
+      iupdate(ip);
+    acquire(&icache.lock);
+    releasesleep(&ip->lock);
+  }
+  if(xadd(&ip->ref, -1) == 1){
+    ip->next = icache.free.next;
+    ip->prev = &icache.free;
+    icache.free.next->prev = ip;
+    icache.free.next = ip;
   }
-  ip->ref--;
   release(&icache.lock);
 }
 
@@ -312,145 +760,624 @@ iunlockput(struct inode *ip)
 // The contents (data) associated with each inode is stored
 // in a sequence of blocks on the disk.  The first NDIRECT blocks
 // are listed in ip->addrs[].  The next NINDIRECT blocks are 
-// listed in the block ip->addrs[NDIRECT].
+// listed in the block ip->addrs[NDIRECT].  The NDINDIRECT after
+// that are listed in the blocks listed in ip->addrs[NDIRECT+1].
+// The indirect block used last is kept in ip->ind[], so runs
+// of blocks it maps don't re-read it.
 
-// Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// Allocate a zeroed block.
 static uint
-bmap(struct inode *ip, uint bn)
+bzalloc(struct inode *ip)
 {
-  uint addr, *a;
   struct buf *bp;
+  uint b;
 
-  if(bn < NDIRECT){
-    if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
-    return addr;
-  }
-  bn -= NDIRECT;
-
-  if(bn < NINDIRECT){
-    // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      bwrite(bp);
-    }
-    brelse(bp);
-    return addr;
-  }
-
-  panic("bmap: out of range");
+  b = balloc(ip);
+  bp = bclear(ip->dev, b);
+  log_write(bp);
+  brelse(bp);
+  return b;
 }
 
-// Truncate inode (discard contents).
-// Only called after the last dirent referring
-// to this inode has been erased on disk.
-static void
-itrunc(struct inode *ip)
+// Return the disk block address of the nth block in inode ip,
+// or 0 if it is a hole.  With fresh, fill a hole (and any missing
+// indirect block) with a newly allocated block and set *fresh to
+// say whether it did; without, allocate nothing.  A block put in
+// ip->addrs marks ip dirty, even if its size doesn't change.
+static uint
+bmapx(struct inode *ip, uint bn, int *fresh)
 {
-  int i, j;
+  uint addr, base, *a;
   struct buf *bp;
-  uint *a;
 
-  for(i = 0; i < NDIRECT; i++){
-    if(ip->addrs[i]){
-      bfree(ip->dev, ip->addrs[i]);
-      ip->addrs[i] = 0;
+  if(fresh)
+    *fresh = 0;
+  if(bn < NDIRECT){
+    if((addr = ip->addrs[bn]) == 0 && fresh){
+      ip->addrs[bn] = addr = balloc(ip);
+      ip->flags |= I_DIRTY;
+      *fresh = 1;
     }
+    return addr;
   }
-  
-  if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
+  if(bn >= MAXFILE)
+    panic("bmap: out of range");
+
+  if(bn < NDIRECT + NINDIRECT)
+    base = NDIRECT;
+  else
+    base = bn - (bn - NDIRECT - NINDIRECT) % NINDIRECT;
+
+  if(ip->indaddr == 0 || ip->indbase != base){
+    // Find the indirect block mapping bn, allocating if necessary.
+    if(base == NDIRECT){
+      if((addr = ip->addrs[NDIRECT]) == 0 && fresh){
+        ip->addrs[NDIRECT] = addr = bzalloc(ip);
+        ip->flags |= I_DIRTY;
+      }
+    } else {
+      if((addr = ip->addrs[NDIRECT+1]) == 0 && fresh){
+        ip->addrs[NDIRECT+1] = addr = bzalloc(ip);
+        ip->flags |= I_DIRTY;
+      }
+      if(addr == 0)
+        return 0;
+      bp = bread(ip->dev, addr);
+      a = (uint*)bp->data;
+      if((addr = a[(base - NDIRECT - NINDIRECT) / NINDIRECT]) == 0 && fresh){
+        a[(base - NDIRECT - NINDIRECT) / NINDIRECT] = addr = bzalloc(ip);
+        log_write(bp);
+      }
+      brelse(bp);
     }
+    if(addr == 0)
+      return 0;
+    bp = bread(ip->dev, addr);
+    memmove(ip->ind, bp->data, NINDIRECT * sizeof(uint));
     brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
-    ip->addrs[NDIRECT] = 0;
-  }
-  
-  if (ip->tags) {
-    bfree(ip->dev, ip->tags);
-    ip->tags = 0;
+    ip->indaddr = addr;
+    ip->indbase = base;
   }
 
-  ip->size = 0;
-  iupdate(ip);
+  if((addr = ip->ind[bn - base]) == 0 && fresh){
+    ip->ind[bn - base] = addr = balloc(ip);
+    bp = bread(ip->dev, ip->indaddr);
+    ((uint*)bp->data)[bn - base] = addr;
+    log_write(bp);
+    brelse(bp);
+    *fresh = 1;
+  }
+  return addr;
 }
 
-// Copy stat information from inode.
-void
-stati(struct inode *ip, struct stat *st)
+// Return the disk block address of the nth block in inode ip.
+// If there is no such block, bmap allocates one.
+static uint
+bmap(struct inode *ip, uint bn)
 {
-  st->dev = ip->dev;
-  st->ino = ip->inum;
-  st->type = ip->type;
-  st->nlink = ip->nlink;
-  st->size = ip->size;
+  int fresh;
+
+  return bmapx(ip, bn, &fresh);
 }
 
-// Read data from inode.
-int
-readi(struct inode *ip, char *dst, uint off, uint n)
+// Like bmap, for readers: returns 0 for a hole rather than
+// allocating.  Readers that hold ip only shared must not touch
+// ip->ind[], which is written under the exclusive lock.  They
+// use ind[] if it already maps bn and otherwise read the
+// indirect block through the buffer cache.
+static uint
+bmapr(struct inode *ip, uint bn)
 {
-  uint tot, m;
+  uint addr, base;
   struct buf *bp;
 
-  if(ip->type == T_DEV){
-    if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
-      return -1;
-    return devsw[ip->major].read(ip, dst, n);
-  }
+  if(ip->lock.locked || bn < NDIRECT)
+    return bmapx(ip, bn, 0);
+  if(bn >= MAXFILE)
+    panic("bmapr: out of range");
 
-  if(off > ip->size || off + n < off)
-    return -1;
-  if(off + n > ip->size)
-    n = ip->size - off;
+  if(bn < NDIRECT + NINDIRECT)
+    base = NDIRECT;
+  else
+    base = bn - (bn - NDIRECT - NINDIRECT) % NINDIRECT;
+  if(ip->indaddr != 0 && ip->indbase == base)
+    return ip->ind[bn - base];
 
-  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
-    m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+  if(base == NDIRECT)
+    addr = ip->addrs[NDIRECT];
+  else if((addr = ip->addrs[NDIRECT+1]) != 0){
+    bp = bread(ip->dev, addr);
+    addr = ((uint*)bp->data)[(base - NDIRECT - NINDIRECT) / NINDIRECT];
     brelse(bp);
   }
-  return n;
+  if(addr == 0)
+    return 0;
+  bp = bread(ip->dev, addr);
+  addr = ((uint*)bp->data)[bn - base];
+  brelse(bp);
+  return addr;
 }
 
-// Write data to inode.
-int
-writei(struct inode *ip, char *src, uint off, uint n)
-{
-  uint tot, m;
-  struct buf *bp;
+// Whether ip keeps its contents in ip->addrs.
+#define INLINE(ip) ((ip)->type == T_FILE && ((ip)->major & F_INLINE))
 
-  if(ip->type == T_DEV){
-    if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
-      return -1;
-    return devsw[ip->major].write(ip, src, n);
-  }
+// Whether writes to the first NINLINE bytes of ip can go in
+// ip->addrs: it is inline already, or is an empty file with no
+// blocks on a file system that allows it, which it becomes.
+static int
+iinline(struct inode *ip)
+{
+  int i;
 
-  if(off > ip->size || off + n < off)
-    return -1;
-  if(off + n > MAXFILE*BSIZE)
-    n = MAXFILE*BSIZE - off;
+  if(INLINE(ip))
+    return 1;
+  if(ip->type != T_FILE || ip->size != 0 || !fsinline(ip->dev))
+    return 0;
+  for(i = 0; i < NDIRECT+2; i++)
+    if(ip->addrs[i])
+      return 0;
+  ip->major |= F_INLINE;
+  return 1;
+}
 
-  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+// Move the contents of inline ip out to its first block.
+static void
+iuninline(struct inode *ip)
+{
+  char data[NINLINE];
+  struct buf *bp;
+
+  memmove(data, ip->addrs, NINLINE);
+  memset(ip->addrs, 0, sizeof(ip->addrs));
+  ip->major &= ~F_INLINE;
+  ip->flags |= I_DIRTY;
+  if(ip->size == 0)
+    return;
+  bp = boverwrite(ip->dev, bmap(ip, 0));
+  memset(bp->data, 0, BSIZE);
+  memmove(bp->data, data, ip->size);
+  log_write(bp);
+  brelse(bp);
+}
+
+// Free indirect block addr and the blocks it lists, descending
+// depth more levels of indirection.
+static void
+bfreeind(uint dev, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] && depth > 0)
+      bfreeind(dev, a[j], depth - 1);
+    else if(a[j])
+      bfree(dev, a[j]);
+    cond_resched();
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
+// Free the blocks listed in indirect block addr from entry first
+// on, and addr itself if first is 0.  Returns 1 if it freed addr.
+static int
+bfreeindfrom(uint dev, uint addr, uint first)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  if(first == 0){
+    bfreeind(dev, addr, 0);
+    return 1;
+  }
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = first; j < NINDIRECT; j++){
+    if(a[j]){
+      bfree(dev, a[j]);
+      a[j] = 0;
+    }
+    cond_resched();
+  }
+  log_write(bp);
+  brelse(bp);
+  return 0;
+}
+
+// Free the blocks of ip from the nth on, and the indirect
+// blocks that map only those.
+static void
+ifreefrom(struct inode *ip, uint bn)
+{
+  struct buf *bp;
+  uint *a, first, k;
+  int i;
+
+  for(i = bn; i < NDIRECT; i++){
+    if(ip->addrs[i]){
+      bfree(ip->dev, ip->addrs[i]);
+      ip->addrs[i] = 0;
+    }
+  }
+
+  if(ip->addrs[NDIRECT]){
+    first = bn > NDIRECT ? bn - NDIRECT : 0;
+    if(first < NINDIRECT && bfreeindfrom(ip->dev, ip->addrs[NDIRECT], first))
+      ip->addrs[NDIRECT] = 0;
+  }
+  if(ip->addrs[NDIRECT+1]){
+    if(bn <= NDIRECT + NINDIRECT){
+      bfreeind(ip->dev, ip->addrs[NDIRECT+1], 1);
+      ip->addrs[NDIRECT+1] = 0;
+    } else {
+      first = bn - NDIRECT - NINDIRECT;
+      bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+      a = (uint*)bp->data;
+      for(k = first / NINDIRECT; k < NINDIRECT; k++)
+        if(a[k] && bfreeindfrom(ip->dev, a[k],
+                                k == first / NINDIRECT ? first % NINDIRECT : 0))
+          a[k] = 0;
+      log_write(bp);
+      brelse(bp);
+    }
+  }
+  ip->indaddr = 0;
+}
+
+// Truncate inode (discard contents).
+// Only called after the last dirent referring
+// to this inode has been erased on disk.
+static void
+itrunc(struct inode *ip)
+{
+  pcinval(ip, 0);
+  if(INLINE(ip)){
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->major &= ~F_INLINE;
+  } else
+    ifreefrom(ip, 0);
+
+  tagfree(ip);
+
+  ip->size = 0;
+  ip->bnext = 0;
+  iupdate(ip);
+}
+
+// Make ip size bytes long.  Shrinking frees the blocks past the
+// new end and zeroes the rest of the last one; growing leaves a
+// hole, which reads as zeros and has no blocks until written.
+// Caller holds ip locked, in a transaction.
+int
+itruncate(struct inode *ip, uint size)
+{
+  struct buf *bp;
+  uint addr;
+
+  if(ip->type != T_FILE || size > (uint64)MAXFILE*BSIZE)
+    return -1;
+  if(size < ip->size)
+    pcinval(ip, size);
+  if(INLINE(ip) && size > NINLINE)
+    iuninline(ip);
+  if(size < ip->size && INLINE(ip))
+    memset((char*)ip->addrs + size, 0, NINLINE - size);
+  else if(size < ip->size){
+    ifreefrom(ip, (size + BSIZE - 1) / BSIZE);
+    if(size % BSIZE && (addr = bmapr(ip, size / BSIZE)) != 0){
+      bp = bread(ip->dev, addr);
+      memset(bp->data + size % BSIZE, 0, BSIZE - size % BSIZE);
+      log_write(bp);
+      brelse(bp);
+    }
+  }
+  ip->size = size;
+  iupdate(ip);
+  return 0;
+}
+
+// Give each hole in bytes [off, off+n) of ip a zeroed block, and
+// make ip at least off+n bytes long.  balloc hands out blocks in
+// order, so a range allocated at once is mostly contiguous.
+// Caller holds ip locked, in a transaction with room for the
+// range's blocks, their bitmap blocks and the indirect blocks.
+int
+iallocate(struct inode *ip, uint off, uint n)
+{
+  struct buf *bp;
+  uint bn, addr;
+  int fresh;
+
+  if(ip->type != T_FILE || off + n < off ||
+     (uint64)off + n > (uint64)MAXFILE*BSIZE)
+    return -1;
+  if(n == 0)
+    return 0;
+  if(INLINE(ip) && off + n > NINLINE)
+    iuninline(ip);
+  // An inline file already has room for its bytes.
+  for(bn = off / BSIZE; !INLINE(ip) && bn <= (off + n - 1) / BSIZE; bn++){
+    addr = bmapx(ip, bn, &fresh);
+    if(fresh){
+      bp = bclear(ip->dev, addr);
+      log_write(bp);
+      brelse(bp);
+    }
+  }
+  if(off + n > ip->size){
+    ip->size = off + n;
+    iupdate(ip);
+  }
+  return 0;
+}
+
+// Force the cached blocks of ip to disk: its data blocks,
+// their bitmap blocks, the indirect and tag blocks,
+// and the block holding the on-disk inode.
+// Caller must hold ip locked, in a transaction.
+int
+isync(struct inode *ip)
+{
+  uint bn, addr, next;
+  struct superblock sb;
+  struct buf *bp;
+
+  if(ip->flags & I_DIRTY)
+    iupdate(ip);
+  readsb(ip->dev, &sb);
+  for(bn = 0; !INLINE(ip) && bn*BSIZE < ip->size; bn++){
+    if((addr = bmapr(ip, bn)) == 0)
+      continue;  // a hole
+    bflush(ip->dev, addr);
+    bflush(ip->dev, BBLOCK(addr, sb.ninodes));
+  }
+  if(!INLINE(ip) && ip->addrs[NDIRECT])
+    bflush(ip->dev, ip->addrs[NDIRECT]);
+  if(!INLINE(ip) && ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    for(bn = 0; bn < NINDIRECT; bn++)
+      if(((uint*)bp->data)[bn])
+        bflush(ip->dev, ((uint*)bp->data)[bn]);
+    brelse(bp);
+    bflush(ip->dev, ip->addrs[NDIRECT+1]);
+  }
+  for(addr = ip->tags; addr; addr = next){
+    bp = bread(ip->dev, addr);
+    next = ((struct taghdr*)bp->data)->next;
+    brelse(bp);
+    bflush(ip->dev, addr);
+    bflush(ip->dev, BBLOCK(addr, sb.ninodes));
+  }
+  bflush(ip->dev, IBLOCK(ip->inum));
+  return 0;
+}
+
+// Copy stat information from inode.
+void
+stati(struct inode *ip, struct stat *st)
+{
+  st->dev = ip->dev;
+  st->ino = ip->inum;
+  st->type = ip->type;
+  st->nlink = ip->nlink;
+  st->size = ip->size;
+}
+
+// Start reading the blocks of ip holding bytes [off, off+n)
+// into the buffer cache without waiting for them.  At most
+// NRAMAX blocks are started, since each holds a buffer until
+// its read finishes.  Caller must hold ip locked.
+void
+ireadahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, addr;
+
+  if(ip->type == T_DEV || INLINE(ip) || off >= ip->size || n == 0)
+    return;
+  if(off + n > ip->size || off + n < off)
+    n = ip->size - off;
+  if(n > NRAMAX*BSIZE - off%BSIZE)
+    n = NRAMAX*BSIZE - off%BSIZE;
+  blkplug();
+  for(bn = off/BSIZE; bn <= (off + n - 1)/BSIZE; bn++)
+    if((addr = bmapr(ip, bn)) != 0)
+      breadahead(ip->dev, addr);
+  blkunplug();
+}
+
+// Read the page of ip at page-aligned offset off into pg, for
+// the page cache: holes and the part past the end of the file
+// read as zeros.  The blocks go back to the buffer cache to be
+// reused first, since the page cache now holds their data.
+// Caller holds ip locked.
+int
+ireadpage(struct inode *ip, uint off, char *pg)
+{
+  uint n, bn, addr;
+  struct buf *bp;
+
+  if(off >= ip->size)
+    return -1;
+  n = min(ip->size - off, PGSIZE);
+  memset(pg + n, 0, PGSIZE - n);
+  if(INLINE(ip)){
+    memmove(pg, (char*)ip->addrs + off, n);
+    return 0;
+  }
+  ireadahead(ip, off, n);
+  for(bn = 0; bn*BSIZE < n; bn++){
+    if((addr = bmapr(ip, off/BSIZE + bn)) == 0){
+      memset(pg + bn*BSIZE, 0, BSIZE);  // a hole
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    memmove(pg + bn*BSIZE, bp->data, BSIZE);
+    bdrop(bp);
+  }
+  return 0;
+}
+
+// Read data from inode.  A regular file's data comes from the
+// page cache; a directory's from the buffer cache.
+int
+readi(struct inode *ip, char *dst, uint off, uint n)
+{
+  uint tot, m, addr;
+  struct buf *bp;
+  char *pg;
+
+  if(ip->type == T_DEV){
+    if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
+      return -1;
+    return devsw[ip->major].read(ip, dst, off, n);
+  }
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  if(INLINE(ip)){
+    memmove(dst, (char*)ip->addrs + off, n);
+    return n;
+  }
+
+  if(ip->type == T_FILE){
+    for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      if((pg = pcget(ip, off/PGSIZE, 0)) == 0)
+        return -1;
+      memmove(dst, pg + off%PGSIZE, m);
+      kfree(pg);
+    }
+    return n;
+  }
+
+  // Queue the next blocks of a multi-block read so the disk
+  // streams while earlier blocks are being copied out.
+  if(off%BSIZE + n > BSIZE)
+    ireadahead(ip, off - off%BSIZE + BSIZE, n - (BSIZE - off%BSIZE));
+
+  for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmapr(ip, off/BSIZE)) == 0){
+      memset(dst, 0, m);  // a hole
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    memmove(dst, bp->data + off%BSIZE, m);
+    brelse(bp);
+  }
+  return n;
+}
+
+// Hand the bytes of ip in [off, off+n) to fn a block at a time,
+// straight from the buffer cache, stopping early if fn takes less
+// than it is given.  Returns the number of bytes fn took, or -1.
+// Caller must hold ip locked.
+int
+readifn(struct inode *ip, uint off, uint n, int (*fn)(void*, char*, int), void *arg)
+{
+  static char zeroblock[BSIZE];  // what holes hold
+  uint tot, m, addr;
+  int r;
+  struct buf *bp;
+
+  if(ip->type == T_DEV || off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+  if(INLINE(ip)){
+    r = fn(arg, (char*)ip->addrs + off, n);
+    return r < (int)n ? (r > 0 ? r : 0) : n;
+  }
+
+  for(tot=0; tot<n; tot+=m, off+=m){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if((addr = bmapr(ip, off/BSIZE)) == 0){
+      r = fn(arg, zeroblock + off%BSIZE, m);  // a hole
+      if(r < (int)m)
+        return tot + (r > 0 ? r : 0);
+      continue;
+    }
+    bp = bread(ip->dev, addr);
+    r = fn(arg, (char*)bp->data + off%BSIZE, m);
+    brelse(bp);
+    if(r < (int)m)
+      return tot + (r > 0 ? r : 0);
+  }
+  return n;
+}
+
+// Write data to inode.
+int
+writei(struct inode *ip, char *src, uint off, uint n)
+{
+  uint tot, m, addr;
+  int fresh;
+  struct buf *bp;
+
+  if(ip->type == T_DEV){
+    if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
+      return -1;
+    return devsw[ip->major].write(ip, src, n);
+  }
+
+  // Writing past the end leaves a hole between.
+  if(off + n < off || (uint64)off > (uint64)MAXFILE*BSIZE)
+    return -1;
+  if((uint64)off + n > (uint64)MAXFILE*BSIZE)
+    n = (uint64)MAXFILE*BSIZE - off;
+
+  // A small file is kept in the inode until it outgrows it.
+  if(off + n <= NINLINE && iinline(ip)){
+    memmove((char*)ip->addrs + off, src, n);
+    if(off + n > ip->size)
+      ip->size = off + n;
+    ip->flags |= I_DIRTY;
+    pcwrite(ip, src, off, n);
+    if(n > 0 && ip->type == T_FILE)
+      notify(NOTE_WRITE, ip->inum, 0, 0);
+    return n;
+  }
+  if(INLINE(ip))
+    iuninline(ip);
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     m = min(n - tot, BSIZE - off%BSIZE);
+    addr = bmapx(ip, off/BSIZE, &fresh);
+    if(m == BSIZE){
+      // Every byte is new; don't read the old ones.
+      bp = boverwrite(ip->dev, addr);
+    } else if(fresh){
+      // A new block, past the end of the file or filling a
+      // hole: nothing on disk is worth reading, and the bytes
+      // not written must read as zeros.
+      bp = boverwrite(ip->dev, addr);
+      memset(bp->data, 0, BSIZE);
+    } else
+      bp = bread(ip->dev, addr);
     memmove(bp->data + off%BSIZE, src, m);
-    bwrite(bp);
+    if(ip->flags & I_NOLOG)
+      bwrite(bp);
+    else
+      log_write(bp);
     brelse(bp);
   }
+  if(ip->type == T_FILE)
+    pcwrite(ip, src - n, off - n, n);
+  if(n > 0 && ip->type == T_FILE)
+    notify(NOTE_WRITE, ip->inum, 0, 0);
 
+  // The new size goes to disk later, by iput, fsync, sync or the
+  // flusher, so a run of appends writes the inode once.
   if(n > 0 && off > ip->size){
     ip->size = off;
-    iupdate(ip);
+    ip->flags |= I_DIRTY;
   }
   return n;
 }
@@ -463,489 +1390,1535 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-// Caller must have already locked dp.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+static struct dentry*
+dchash(uint dev, uint dir, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dir;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.ent[h % NDCACHE];
+}
+
+// Look name up in dp in the cache.  Returns 1 and sets *inum
+// on a hit.  Caller must hold dp locked.
+static int
+dcget(struct inode *dp, char *name, uint *inum)
+{
+  struct dentry *d;
+  int hit;
+
+  acquireread(&dcache.lock);
+  d = dchash(dp->dev, dp->inum, name);
+  hit = d->dir == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0;
+  if(hit)
+    *inum = d->inum;
+  releaseread(&dcache.lock);
+  return hit;
+}
+
+// Record that name in dp is inum, or absent if inum is 0.
+// Caller must hold dp locked and must call this whenever
+// it adds or removes an entry.
+void
+dcset(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d;
+
+  acquirewrite(&dcache.lock);
+  d = dchash(dp->dev, dp->inum, name);
+  d->dev = dp->dev;
+  d->dir = dp->inum;
+  d->inum = inum;
+  strncpy(d->name, name, DIRSIZ);
+  releasewrite(&dcache.lock);
+}
+
+// Forget every entry for directory inode inum, which is being freed.
+static void
+dcpurge(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  acquirewrite(&dcache.lock);
+  for(d = dcache.ent; d < dcache.ent + NDCACHE; d++)
+    if(d->dir == inum && d->dev == dev)
+      d->dir = 0;
+  releasewrite(&dcache.lock);
+}
+
+static uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h;
+}
+
+// Return the inum of name in dp and set *poff to its offset,
+// or return 0.  Caller must have locked dp.
+static uint
+dirfind(struct inode *dp, char *name, uint *poff)
+{
+  uint i, bn, nb, off, inum;
+  struct buf *bp;
+  struct dirent *de;
+  int end;
+
+  nb = (dp->size + BSIZE - 1) / BSIZE;
+  bn = (dp->major & D_HASHED) ? dirhash(name) % nb : 0;
+  for(i = 0; i < nb; i++, bn = (bn + 1) % nb){
+    bp = breadmeta(dp->dev, bmap(dp, bn));
+    end = 0;
+    for(de = (struct dirent*)bp->data;
+        de < (struct dirent*)(bp->data + BSIZE) && bn*BSIZE + (uchar*)de - bp->data < dp->size;
+        de++){
+      if(de->inum == 0){
+        if(de->name[0] == 0)
+          end = 1;
+        continue;
+      }
+      if(namecmp(name, de->name) == 0){
+        // entry matches path element
+        off = bn*BSIZE + (uchar*)de - bp->data;
+        inum = de->inum;
+        brelse(bp);
+        *poff = off;
+        return inum;
+      }
+    }
+    brelse(bp);
+    if(end && (dp->major & D_HASHED))
+      break;
+  }
+  return 0;
+}
+
+// Look for a directory entry in a directory.
+// If found, set *poff to byte offset of entry.
+// Caller must have already locked dp.
+struct inode*
+dirlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off, inum;
+
+  if(dp->type != T_DIR)
+    panic("dirlookup not DIR");
+
+  // Callers that need the offset go to the directory itself.
+  if(poff == 0 && dcget(dp, name, &inum))
+    return inum ? iget(dp->dev, inum) : 0;
+
+  inum = dirfind(dp, name, &off);
+  dcset(dp, name, inum);
+  if(inum == 0)
+    return 0;
+  if(poff)
+    *poff = off;
+  return iget(dp->dev, inum);
+}
+
+// Return the offset of a free entry for name in hashed directory
+// dp, or -1 if there is none within DIRPROBE blocks.
+static int
+dirslot(struct inode *dp, char *name)
+{
+  uint i, bn, nb, off;
+  struct dirent de;
+
+  nb = dp->size / BSIZE;
+  bn = dirhash(name) % nb;
+  for(i = 0; i < DIRPROBE && i < nb; i++, bn = (bn + 1) % nb){
+    for(off = bn*BSIZE; off < (bn + 1)*BSIZE; off += sizeof(de)){
+      if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirslot read");
+      if(de.inum == 0)
+        return off;
+    }
+  }
+  return -1;
+}
+
+// Rebuild dp as a hashed directory of nb blocks.  The new table
+// is built in a scratch inode whose blocks are then swapped into
+// dp; putting the scratch inode frees the old ones.  The table
+// can be larger than a transaction, so it is written around the
+// log and forced to disk before the swap is logged.
+static void
+dirrehash(struct inode *dp, uint nb)
+{
+  struct inode *tp;
+  struct dirent de, e;
+  uint off, toff, addrs[NDIRECT+2];
+  int i, n;
+
+  tp = ialloc(dp, T_FILE);
+  ilock(tp);
+  tp->flags |= I_NOLOG;
+  memset(&de, 0, sizeof(de));
+  for(off = 0; off < nb*BSIZE; off += sizeof(de))
+    if(writei(tp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirrehash write");
+
+  for(off = 0; off < dp->size; off += sizeof(de)){
+    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("dirrehash read");
+    if(de.inum == 0)
+      continue;
+    toff = (dirhash(de.name) % nb) * BSIZE;
+    for(i = 0; i < nb*DPB; i++){
+      if(readi(tp, (char*)&e, toff, sizeof(e)) != sizeof(e))
+        panic("dirrehash read");
+      if(e.inum == 0)
+        break;
+      toff = (toff + sizeof(e)) % (nb*BSIZE);
+    }
+    if(i == nb*DPB || writei(tp, (char*)&de, toff, sizeof(de)) != sizeof(de))
+      panic("dirrehash full");
+  }
+  isync(tp);
+  tp->flags &= ~I_NOLOG;
+
+  memmove(addrs, dp->addrs, sizeof(addrs));
+  memmove(dp->addrs, tp->addrs, sizeof(addrs));
+  memmove(tp->addrs, addrs, sizeof(addrs));
+  n = dp->size;
+  dp->size = tp->size;
+  tp->size = n;
+  dp->indaddr = tp->indaddr = 0;
+  dp->major |= D_HASHED;
+  iupdate(dp);
+  iupdate(tp);
+  iunlockput(tp);
+}
+
+// Write a new directory entry (name, inum) into the directory dp.
+int
+dirlink(struct inode *dp, char *name, uint inum)
+{
+  int off;
+  struct dirent de;
+  struct inode *ip;
+
+  // Check that name is not present.
+  if((ip = dirlookup(dp, name, 0)) != 0){
+    iput(ip);
+    return -1;
+  }
+
+  if(dp->major & D_HASHED){
+    if((off = dirslot(dp, name)) < 0){
+      dirrehash(dp, 2 * dp->size / BSIZE);
+      if((off = dirslot(dp, name)) < 0)
+        panic("dirlink slot");
+    }
+  } else {
+    // Look for an empty dirent.
+    for(off = 0; off < dp->size; off += sizeof(de)){
+      if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+        panic("dirlink read");
+      if(de.inum == 0)
+        break;
+    }
+    if(off >= dp->size && dp->size >= DIRHASHMIN*BSIZE){
+      // Too big to keep searching linearly.
+      dirrehash(dp, 2 * ((dp->size + BSIZE - 1) / BSIZE));
+      if((off = dirslot(dp, name)) < 0)
+        panic("dirlink slot");
+    }
+  }
+
+  strncpy(de.name, name, DIRSIZ);
+  de.inum = inum;
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("dirlink");
+  dcset(dp, name, inum);
+  
+  return 0;
+}
+
+// Remove the entry for name, at offset off, from directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  // A hashed directory keeps the name so that lookups for names
+  // placed after this one keep probing past it.
+  memset(&de, 0, sizeof(de));
+  if(dp->major & D_HASHED)
+    strncpy(de.name, name, DIRSIZ);
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+  dcset(dp, name, 0);
+}
+
+// Start reading the inode blocks named by the entries in the
+// block of directory dp holding offset off, which a walk is about
+// to stat one by one.  Caller holds dp locked.
+static void
+direntprefetch(struct inode *dp, uint off)
+{
+  struct buf *bp;
+  struct dirent *de;
+  uint addr, last;
+
+  if(off >= dp->size || (addr = bmapr(dp, off / BSIZE)) == 0)
+    return;
+  bp = breadmeta(dp->dev, addr);
+  last = 0;
+  for(de = (struct dirent*)bp->data; de < (struct dirent*)(bp->data + BSIZE); de++){
+    if(de->inum == 0 || IBLOCK(de->inum) == last)
+      continue;
+    last = IBLOCK(de->inum);
+    iprefetch(dp->dev, de->inum);
+  }
+  brelse(bp);
+}
+
+// The inode that entry de of directory dp names, as namex would
+// find it: across a mount in either direction.  dp is unlocked.
+// Returns 0 if there is none.
+static struct inode*
+direntip(struct inode *dp, struct dirent *de)
+{
+  struct inode *ip, *next;
+
+  if(dp->dev != ROOTDEV && dp->inum == ROOTINO && namecmp(de->name, "..") == 0){
+    // Up out of a mounted disk, from the directory it covers.
+    ip = idup(fsdev.dev[dp->dev].covered);
+    ilock(ip);
+    next = dirlookup(ip, "..", 0);
+    iunlockput(ip);
+    return next;
+  }
+  ip = iget(dp->dev, de->inum);
+  if(ip->mounted){
+    next = iget(ip->mounted, ROOTINO);
+    iput(ip);
+    ip = next;
+  }
+  return ip;
+}
+
+// Read up to n entries of directory dp from byte offset *off on
+// into ents, each with the stat of the inode it names, and move
+// *off past them.  Returns how many, 0 at the end, or -1 if dp
+// is not a directory.  dp is locked only while its entries are
+// read, and each inode is then locked by itself, so ".." can't
+// deadlock against a lookup coming down the tree.
+int
+dirreadstat(struct inode *dp, uint *off, struct direntstat *ents, int n)
+{
+  struct dirent raw[NDSTAT], de[NDSTAT];
+  struct inode *ip;
+  int i, m, r;
+
+  if(n > NDSTAT)
+    n = NDSTAT;
+  ilock(dp);
+  if(dp->type != T_DIR){
+    iunlock(dp);
+    return -1;
+  }
+  m = 0;
+  while(m < n && (r = readi(dp, (char*)raw, *off, sizeof(raw))) >= sizeof(raw[0])){
+    for(i = 0; i < r / sizeof(raw[0]) && m < n; i++){
+      *off += sizeof(raw[0]);
+      if(raw[i].inum != 0)
+        de[m++] = raw[i];
+    }
+  }
+  iunlock(dp);
+
+  // Have the inode blocks on their way before locking the first.
+  for(i = 0; i < m; i++)
+    if(i == 0 || IBLOCK(de[i].inum) != IBLOCK(de[i-1].inum))
+      iprefetch(dp->dev, de[i].inum);
+
+  r = 0;
+  for(i = 0; i < m; i++){
+    if((ip = direntip(dp, &de[i])) == 0)
+      continue;
+    ilockshared(ip);
+    if(ip->type != 0){
+      // Not freed since dp was read.
+      memmove(ents[r].name, de[i].name, DIRSIZ);
+      ents[r].name[DIRSIZ] = 0;
+      stati(ip, &ents[r].st);
+      r++;
+    }
+    iunlockput(ip);
+  }
+  return r;
+}
+
+// Paths
+
+// Copy the next path element from path into name.
+// Return a pointer to the element following the copied one.
+// The returned path has no leading slashes,
+// so the caller can check *path=='\0' to see if the name is the last one.
+// If no name to remove, return 0.
+//
+// Examples:
+//   skipelem("a/bb/c", name) = "bb/c", setting name = "a"
+//   skipelem("///a//bb", name) = "bb", setting name = "a"
+//   skipelem("a", name) = "", setting name = "a"
+//   skipelem("", name) = skipelem("////", name) = 0
+//
+static char*
+skipelem(char *path, char *name)
+{
+  char *s;
+  int len;
+
+  while(*path == '/')
+    path++;
+  if(*path == 0)
+    return 0;
+  s = path;
+  while(*path != '/' && *path != 0)
+    path++;
+  len = path - s;
+  if(len >= DIRSIZ)
+    memmove(name, s, DIRSIZ);
+  else {
+    memmove(name, s, len);
+    name[len] = 0;
+  }
+  while(*path == '/')
+    path++;
+  return path;
+}
+
+// Look up and return the inode for a path name.
+// If parent != 0, return the inode for the parent and copy the final
+// path element into name, which must have room for DIRSIZ bytes.
+static struct inode*
+namex(char *path, int nameiparent, char *name)
+{
+  struct inode *ip, *next;
+
+  if(*path == '/')
+    ip = iget(ROOTDEV, ROOTINO);
+  else
+    ip = idup(proc->cwd);
+
+  while((path = skipelem(path, name)) != 0){
+    ilock(ip);
+    if(ip->type != T_DIR){
+      iunlockput(ip);
+      return 0;
+    }
+    if(nameiparent && *path == '\0'){
+      // Stop one level early.
+      iunlock(ip);
+      return ip;
+    }
+    if(ip->dev != ROOTDEV && ip->inum == ROOTINO && namecmp(name, "..") == 0){
+      // Up out of a mounted disk, from the directory it covers.
+      next = idup(fsdev.dev[ip->dev].covered);
+      iunlockput(ip);
+      ip = next;
+      ilock(ip);
+    }
+    if((next = dirlookup(ip, name, 0)) == 0){
+      iunlockput(ip);
+      return 0;
+    }
+    iunlockput(ip);
+    ip = next;
+    if(ip->mounted){
+      // Down into the disk mounted here.
+      next = iget(ip->mounted, ROOTINO);
+      iput(ip);
+      ip = next;
+    }
+  }
+  if(nameiparent){
+    iput(ip);
+    return 0;
+  }
+  return ip;
+}
+
+// Mount the file system on disk dev over directory path, which
+// then stands for the disk's root until reboot.  The covered
+// directory keeps a reference, so it stays in the cache with
+// its mounted field set.  Caller is in a transaction.
+int
+mount(char *path, int dev)
+{
+  struct inode *ip;
+
+  if(dev <= 0 || dev >= NFSDEV || dev == ROOTDEV)
+    return -1;
+  if((ip = namei(path)) == 0)
+    return -1;
+  ilock(ip);
+  if(ip->type != T_DIR || ip->mounted){
+    iunlockput(ip);
+    return -1;
+  }
+  acquire(&fsdev.lock);
+  if(fsdev.dev[dev].covered){
+    release(&fsdev.lock);
+    iunlockput(ip);
+    return -1;
+  }
+  fsdev.dev[dev].covered = ip;
+  ip->mounted = dev;
+  release(&fsdev.lock);
+  iunlock(ip);
+  return 0;
+}
+
+struct inode*
+namei(char *path)
+{
+  char name[DIRSIZ];
+  return namex(path, 0, name);
+}
+
+struct inode*
+nameiparent(char *path, char *name)
+{
+  return namex(path, 1, name);
+}
+
+// Tag index.  Every (key, value) pair set on any inode has an
+// entry in the index file named by sb.tagino, and so does every
+// key on its own, so getFilesByTag and getFilesByQuery do not
+// have to open or scan every file.  Entries hold only a hash of
+// the pair or key; callers check candidates against the inode.
+
+#define TAGDEPTH 16  // deepest directory getFilesByTag searches
+#define NTAGRES 64   // most files getFilesByTag resolves
+#define TAGDEAD 1    // hash of a deleted index entry
+
+static uint
+taghash(char *key, int keyLength, char *value, int valueLength)
+{
+  uint h;
+  int i;
+
+  h = keyLength;
+  for(i = 0; i < keyLength; i++)
+    h = h*31 + (uchar)key[i];
+  for(i = 0; i < valueLength; i++)
+    h = h*31 + (uchar)value[i];
+  return h;
+}
+
+// Index hash for key being set at all, whatever its value.
+static uint
+tagkhash(char *key, int keyLength)
+{
+  return ~taghash(key, keyLength, 0, 0);
+}
+
+// Return the locked tag index inode of dev, or 0 if it has none.
+static struct inode*
+tagilock(uint dev)
+{
+  struct superblock sb;
+  struct inode *tip;
+
+  readsb(dev, &sb);
+  if(sb.tagino == 0)
+    return 0;
+  tip = iget(dev, sb.tagino);
+  ilock(tip);
+  if(tip->size < BSIZE){
+    iunlockput(tip);
+    return 0;
+  }
+  return tip;
+}
+
+// Add (inum, h) to the index.  Returns -1 if the index is full.
+static int
+tagiadd(uint dev, uint inum, uint h)
+{
+  struct inode *tip;
+  struct buf *bp;
+  struct tagent *te;
+  uint i, n;
+
+  if((tip = tagilock(dev)) == 0)
+    return 0;
+  n = tip->size / BSIZE;
+  for(i = 0; i < n; i++){
+    bp = bread(dev, bmap(tip, (h + i) % n));
+    for(te = (struct tagent*)bp->data; te < (struct tagent*)bp->data + TPB; te++){
+      if(te->inum == 0){
+        te->inum = inum;
+        te->hash = h;
+        log_write(bp);
+        brelse(bp);
+        iunlockput(tip);
+        return 0;
+      }
+    }
+    brelse(bp);
+  }
+  iunlockput(tip);
+  return -1;
+}
+
+// Remove one (inum, h) entry from the index, leaving a deleted
+// mark so later entries in the probe stay reachable.  Removals
+// are not logged, since freeing a file drops all its tags at once;
+// one lost in a crash leaves a stale entry that lookups discard.
+static void
+tagidel(uint dev, uint inum, uint h)
+{
+  struct inode *tip;
+  struct buf *bp;
+  struct tagent *te;
+  uint i, n;
+  int end;
+
+  if((tip = tagilock(dev)) == 0)
+    return;
+  n = tip->size / BSIZE;
+  for(i = 0; i < n; i++){
+    bp = bread(dev, bmap(tip, (h + i) % n));
+    end = 0;
+    for(te = (struct tagent*)bp->data; te < (struct tagent*)bp->data + TPB; te++){
+      if(te->inum == inum && te->hash == h){
+        te->inum = 0;
+        te->hash = TAGDEAD;
+        bwrite(bp);
+        brelse(bp);
+        iunlockput(tip);
+        return;
+      }
+      if(te->inum == 0 && te->hash == 0)
+        end = 1;
+    }
+    brelse(bp);
+    if(end)
+      break;
+  }
+  iunlockput(tip);
+}
+
+// Copy up to max inode numbers with an entry for h into inums.
+// If pos isn't 0, start at entry *pos of h's probe sequence and
+// leave *pos at the entry to go on from, or TAGCUR_END if there
+// are no more.
+static int
+tagifind(uint dev, uint h, uint *pos, uint *inums, int max)
+{
+  struct inode *tip;
+  struct buf *bp;
+  struct tagent *te;
+  uint i, j, n, start, next;
+  int end, found;
+
+  start = pos ? *pos : 0;
+  next = TAGCUR_END;
+  found = 0;
+  if(start == TAGCUR_END || (tip = tagilock(dev)) == 0)
+    goto out;
+  n = tip->size / BSIZE;
+  for(i = start / TPB; i < n && next == TAGCUR_END; i++){
+    bp = bread(dev, bmap(tip, (h + i) % n));
+    te = (struct tagent*)bp->data;
+    end = 0;
+    for(j = 0; j < TPB; j++){
+      if(te[j].inum == 0 && te[j].hash == 0)
+        end = 1;
+      if(i*TPB + j < start || te[j].inum == 0 || te[j].hash != h)
+        continue;
+      if(found == max){
+        next = i*TPB + j;
+        break;
+      }
+      inums[found++] = te[j].inum;
+    }
+    brelse(bp);
+    if(end)
+      break;
+  }
+  iunlockput(tip);
+out:
+  if(pos)
+    *pos = next;
+  return found;
+}
+
+// Tags.  While an inode is in the icache, the first block of its
+// tag chain is kept in ip->tagbuf; the rest go through the buffer
+// cache.  Within a block, entries are found by binary search.
+// An inode whose tags still fit in dinode.itags has a one-block
+// chain, that area, in the first NITAGS bytes of ip->tagbuf.
+
+#define TAGOFF(b)    ((ushort*)((struct taghdr*)(b) + 1))
+#define TAGENT(b, i) ((uchar*)(b) + TAGOFF(b)[i])
+#define TAGSIZE(e)   (2 + (e)[0] + (e)[1])
+
+// Make b an empty tag block of size bytes.
+static void
+tagformat(uchar *b, uint size)
+{
+  struct taghdr *th;
+
+  memset(b, 0, size);
+  th = (struct taghdr*)b;
+  th->free = size;
+}
+
+// Turn b, a tag area NITAGS bytes long at the start of a
+// block-sized buffer, into a tag block by moving its entries
+// to the end of the buffer.
+static void
+tagwiden(uchar *b)
+{
+  struct taghdr *th;
+  uint d;
+  int i;
+
+  th = (struct taghdr*)b;
+  d = BSIZE - NITAGS;
+  memmove(b + th->free + d, b + th->free, NITAGS - th->free);
+  for(i = 0; i < th->nent; i++)
+    TAGOFF(b)[i] += d;
+  th->free += d;
+}
+
+// Load ip's first tag block, or its inline tags, into ip->tagbuf
+// if they aren't there yet.  Caller holds ip's lock.
+static void
+tagload(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  if(ip->flags & I_TAGS)
+    return;
+  if(ip->tags){
+    bp = bread(ip->dev, ip->tags);
+    memmove(ip->tagbuf, bp->data, BSIZE);
+    brelse(bp);
+  } else if(fsinline(ip->dev)){
+    bp = breadmeta(ip->dev, IBLOCK(ip->inum));
+    dip = (struct dinode*)bp->data + ip->inum%IPB;
+    memmove(ip->tagbuf, dip->itags, NITAGS);
+    brelse(bp);
+    if(((struct taghdr*)ip->tagbuf)->free == 0)
+      tagformat((uchar*)ip->tagbuf, NITAGS);  // never used
+    ip->flags |= I_ITAGS;
+  } else
+    tagformat((uchar*)ip->tagbuf, BSIZE);
+  ip->flags |= I_TAGS;
+}
+
+// Write ip->tagbuf back, to the inode if it holds inline tags,
+// allocating the first tag block on first use otherwise.
+// Caller holds ip's lock.
+static void
+tagstore(struct inode *ip)
+{
+  struct buf *bp;
+  struct dinode *dip;
+
+  if(ip->flags & I_ITAGS){
+    bp = breadmeta(ip->dev, IBLOCK(ip->inum));
+    dip = (struct dinode*)bp->data + ip->inum%IPB;
+    memmove(dip->itags, ip->tagbuf, NITAGS);
+    log_write(bp);
+    brelse(bp);
+    return;
+  }
+  if(!ip->tags){
+    ip->tags = balloc(ip);
+    iupdate(ip);
+  }
+  bp = bclear(ip->dev, ip->tags);
+  memmove(bp->data, ip->tagbuf, BSIZE);
+  log_write(bp);
+  brelse(bp);
+}
+
+// Step from tag block b to the next one in ip's chain, releasing
+// *bpp.  The first block is ip->tagbuf and has no buf.
+static uchar*
+tagnext(struct inode *ip, uchar *b, struct buf **bpp)
+{
+  uint next;
+
+  next = ((struct taghdr*)b)->next;
+  if(*bpp)
+    brelse(*bpp);
+  *bpp = 0;
+  if(next == 0)
+    return 0;
+  *bpp = bread(ip->dev, next);
+  return (*bpp)->data;
+}
+
+static int
+tagcmp(uchar *e, char *key, int keyLength)
+{
+  int r;
+
+  if((r = memcmp(e + 2, key, min(e[0], keyLength))) != 0)
+    return r;
+  return e[0] - keyLength;
+}
+
+// Binary search block b for key.  Returns the entry's index, or
+// -(i+1) where i is the index at which key would go.
+static int
+tagsearch(uchar *b, char *key, int keyLength)
+{
+  int lo, hi, mid, r;
+
+  lo = 0;
+  hi = ((struct taghdr*)b)->nent - 1;
+  while(lo <= hi){
+    mid = (lo + hi) / 2;
+    r = tagcmp(TAGENT(b, mid), key, keyLength);
+    if(r == 0)
+      return mid;
+    if(r < 0)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+  return -(lo + 1);
+}
+
+// Delete entry i from block b, packing the other entries up.
+static void
+tagdelete(uchar *b, int i)
+{
+  struct taghdr *th;
+  ushort *off;
+  uint o, n;
+  int j;
+
+  th = (struct taghdr*)b;
+  off = TAGOFF(b);
+  o = off[i];
+  n = TAGSIZE(b + o);
+  memmove(b + th->free + n, b + th->free, o - th->free);
+  th->free += n;
+  for(j = 0; j < th->nent; j++)
+    if(off[j] < o)
+      off[j] += n;
+  memmove(off + i, off + i + 1, (th->nent - i - 1) * sizeof(ushort));
+  th->nent--;
+}
+
+// Insert an entry for key into block b, which doesn't hold key.
+// Returns -1 if it doesn't fit.
+static int
+taginsert(uchar *b, char *key, int keyLength, char *value, int valueLength)
+{
+  struct taghdr *th;
+  ushort *off;
+  uchar *e;
+  int i, n;
+
+  th = (struct taghdr*)b;
+  off = TAGOFF(b);
+  n = 2 + keyLength + valueLength;
+  if(sizeof(*th) + (th->nent + 1) * sizeof(ushort) + n > th->free)
+    return -1;
+  i = -tagsearch(b, key, keyLength) - 1;
+  th->free -= n;
+  e = b + th->free;
+  e[0] = keyLength;
+  e[1] = valueLength;
+  memmove(e + 2, key, keyLength);
+  memmove(e + 2 + keyLength, value, valueLength);
+  memmove(off + i + 1, off + i, (th->nent - i) * sizeof(ushort));
+  off[i] = th->free;
+  th->nent++;
+  return 0;
+}
+
+// Copy the value of key into buffer, at most length bytes.
+// Returns the full value length, or -1 if key isn't set.
+// Caller holds ip's lock.
+static int
+tagget(struct inode *ip, char *key, char *buffer, int length)
+{
+  struct buf *bp;
+  uchar *b, *e;
+  int keyLength, i;
+
+  if (!key || (keyLength = strlen(key)) < 1 || keyLength > TAGKEYMAX) return -1;
+  tagload(ip);
+  bp = 0;
+  for(b = (uchar*)ip->tagbuf; b; b = tagnext(ip, b, &bp)){
+    if((i = tagsearch(b, key, keyLength)) >= 0){
+      e = TAGENT(b, i);
+      memmove(buffer, e + 2 + e[0], min(length, e[1]));
+      i = e[1];
+      if(bp)
+        brelse(bp);
+      return i ? i : -1;
+    }
+  }
+  return -1;
+}
+
+// Remove key from ip's chain, and from the index unless keep is
+// set, as when a new value replaces it.  Returns 0, or -1 if it
+// isn't set.  Changes to the first block are left in ip->tagbuf;
+// caller must tagstore.  Caller holds ip's lock.
+static int
+tagunset(struct inode *ip, char *key, int keyLength, int keep)
 {
-  uint off, inum;
   struct buf *bp;
-  struct dirent *de;
+  uchar *b, *e;
+  int i;
 
-  if(dp->type != T_DIR)
-    panic("dirlookup not DIR");
-
-  for(off = 0; off < dp->size; off += BSIZE){
-    bp = bread(dp->dev, bmap(dp, off / BSIZE));
-    for(de = (struct dirent*)bp->data;
-        de < (struct dirent*)(bp->data + BSIZE);
-        de++){
-      if(de->inum == 0)
-        continue;
-      if(namecmp(name, de->name) == 0){
-        // entry matches path element
-        if(poff)
-          *poff = off + (uchar*)de - bp->data;
-        inum = de->inum;
+  tagload(ip);
+  bp = 0;
+  for(b = (uchar*)ip->tagbuf; b; b = tagnext(ip, b, &bp)){
+    if((i = tagsearch(b, key, keyLength)) >= 0){
+      e = TAGENT(b, i);
+      tagidel(ip->dev, ip->inum, taghash(key, keyLength, (char*)e + 2 + e[0], e[1]));
+      if(!keep)
+        tagidel(ip->dev, ip->inum, tagkhash(key, keyLength));
+      tagdelete(b, i);
+      if(bp){
+        log_write(bp);
         brelse(bp);
-        return iget(dp->dev, inum);
       }
+      return 0;
     }
-    brelse(bp);
   }
-  return 0;
+  return -1;
 }
 
-// Write a new directory entry (name, inum) into the directory dp.
-int
-dirlink(struct inode *dp, char *name, uint inum)
+// Set key to value in ip's chain and in the tag index, adding a
+// tag block to the chain if none has room.  Returns 1 if a tag
+// changed, 0 if it already held the value, -1 on bad arguments or
+// if the index is full.  Changes to the first block are left in
+// ip->tagbuf; caller must tagstore.  Caller holds ip's lock.
+static int
+tagset(struct inode *ip, char *key, char *value, int valueLength)
 {
-  int off;
-  struct dirent de;
-  struct inode *ip;
-
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
+  struct buf *bp, *nbp;
+  uchar *b, *e;
+  uint bn;
+  int keyLength, i, found;
+
+  if (!key || (keyLength = strlen(key)) < 1 || keyLength > TAGKEYMAX) return -1;
+  if (!value || valueLength < 0 || valueLength > TAGVALMAX) return -1;
+  tagload(ip);
+  bp = 0;
+  found = 0;
+  for(b = (uchar*)ip->tagbuf; b; b = tagnext(ip, b, &bp)){
+    if((i = tagsearch(b, key, keyLength)) >= 0){
+      e = TAGENT(b, i);
+      if(e[1] == valueLength && memcmp(e + 2 + e[0], value, valueLength) == 0){
+        if(bp)
+          brelse(bp);
+        return 0;
+      }
+      found = 1;
+      if(bp)
+        brelse(bp);
+      break;
+    }
+  }
+  if(!found && tagiadd(ip->dev, ip->inum, tagkhash(key, keyLength)) < 0)
+    return -1;
+  if(tagiadd(ip->dev, ip->inum, taghash(key, keyLength, value, valueLength)) < 0){
+    if(!found)
+      tagidel(ip->dev, ip->inum, tagkhash(key, keyLength));
     return -1;
   }
+  if(found)
+    tagunset(ip, key, keyLength, 1);
 
-  // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
+  bp = 0;
+  for(b = (uchar*)ip->tagbuf; ; b = tagnext(ip, b, &bp)){
+    if(taginsert(b, key, keyLength, value, valueLength) == 0)
+      break;
+    if(ip->flags & I_ITAGS){
+      // The inline tags are full: make them the first tag block,
+      // which tagstore will allocate.
+      tagwiden(b);
+      ip->flags &= ~I_ITAGS;
+      taginsert(b, key, keyLength, value, valueLength);
+      break;
+    }
+    if(((struct taghdr*)b)->next == 0){
+      // Every block is full: chain a new one after b.
+      bn = balloc(ip);
+      nbp = bclear(ip->dev, bn);
+      tagformat(nbp->data, BSIZE);
+      taginsert(nbp->data, key, keyLength, value, valueLength);
+      log_write(nbp);
+      brelse(nbp);
+      ((struct taghdr*)b)->next = bn;
       break;
+    }
   }
-
-  strncpy(de.name, name, DIRSIZ);
-  de.inum = inum;
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
-  
-  return 0;
+  if(bp){
+    log_write(bp);
+    brelse(bp);
+  }
+  return 1;
 }
 
-// Paths
-
-// Copy the next path element from path into name.
-// Return a pointer to the element following the copied one.
-// The returned path has no leading slashes,
-// so the caller can check *path=='\0' to see if the name is the last one.
-// If no name to remove, return 0.
-//
-// Examples:
-//   skipelem("a/bb/c", name) = "bb/c", setting name = "a"
-//   skipelem("///a//bb", name) = "bb", setting name = "a"
-//   skipelem("a", name) = "", setting name = "a"
-//   skipelem("", name) = skipelem("////", name) = 0
-//
-static char*
-skipelem(char *path, char *name)
+// Drop the tags in tag block b from the index.
+static void
+tagunindex(struct inode *ip, uchar *b)
 {
-  char *s;
-  int len;
+  uchar *e;
+  int i;
 
-  while(*path == '/')
-    path++;
-  if(*path == 0)
-    return 0;
-  s = path;
-  while(*path != '/' && *path != 0)
-    path++;
-  len = path - s;
-  if(len >= DIRSIZ)
-    memmove(name, s, DIRSIZ);
-  else {
-    memmove(name, s, len);
-    name[len] = 0;
+  for(i = 0; i < ((struct taghdr*)b)->nent; i++){
+    e = TAGENT(b, i);
+    tagidel(ip->dev, ip->inum, taghash((char*)e + 2, e[0], (char*)e + 2 + e[0], e[1]));
+    tagidel(ip->dev, ip->inum, tagkhash((char*)e + 2, e[0]));
   }
-  while(*path == '/')
-    path++;
-  return path;
 }
 
-// Look up and return the inode for a path name.
-// If parent != 0, return the inode for the parent and copy the final
-// path element into name, which must have room for DIRSIZ bytes.
-static struct inode*
-namex(char *path, int nameiparent, char *name)
+// Drop ip's tags from the index and free its tag blocks.
+static void
+tagfree(struct inode *ip)
 {
-  struct inode *ip, *next;
-
-  if(*path == '/')
-    ip = iget(ROOTDEV, ROOTINO);
-  else
-    ip = idup(proc->cwd);
-
-  while((path = skipelem(path, name)) != 0){
-    ilock(ip);
-    if(ip->type != T_DIR){
-      iunlockput(ip);
-      return 0;
-    }
-    if(nameiparent && *path == '\0'){
-      // Stop one level early.
-      iunlock(ip);
-      return ip;
-    }
-    if((next = dirlookup(ip, name, 0)) == 0){
-      iunlockput(ip);
-      return 0;
+  struct buf *bp;
+  uint bn, next;
+
+  if(ip->tags == 0){
+    tagload(ip);
+    if(ip->flags & I_ITAGS){
+      tagunindex(ip, (uchar*)ip->tagbuf);
+      tagformat((uchar*)ip->tagbuf, NITAGS);
+      tagstore(ip);
     }
-    iunlockput(ip);
-    ip = next;
   }
-  if(nameiparent){
-    iput(ip);
-    return 0;
+  for(bn = ip->tags; bn; bn = next){
+    bp = bread(ip->dev, bn);
+    tagunindex(ip, bp->data);
+    next = ((struct taghdr*)bp->data)->next;
+    brelse(bp);
+    bfree(ip->dev, bn);
   }
-  return ip;
+  ip->tags = 0;
+  ip->flags &= ~(I_TAGS | I_ITAGS);
 }
 
-struct inode*
-namei(char *path)
+static struct file*
+tagfd(int fileDescriptor)
 {
-  char name[DIRSIZ];
-  return namex(path, 0, name);
-}
+  struct file *f;
 
-struct inode*
-nameiparent(char *path, char *name)
-{
-  return namex(path, 1, name);
+  if ((f = fdget(proc, fileDescriptor)) == 0) return 0;
+  if (f->type != FD_INODE || !f->ip) return 0;
+  return f;
 }
 
 int
 tagFile(int fileDescriptor, char* key, char* value, int valueLength)
 {
   struct file *f;
-  struct buf *bp;
-  uchar *str;
-  int keyLength;
-  if (fileDescriptor < 0 || fileDescriptor >= NOFILE || (f = proc->ofile[fileDescriptor]) == 0) return -1;
-  if (f->type != FD_INODE || !f->writable || !f->ip) return -1;
-  if (!key || (keyLength = strlen(key)) < 1 || keyLength > 9) return -1;
-  if (!value || valueLength < 0 || valueLength > 18) return -1;
+  int r;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->writable) return -1;
   ilock(f->ip);
-  if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-  bp = bread(f->ip->dev, f->ip->tags);
-  str = (uchar*)bp->data;
-  int keyPos = searchKey((uchar*)key, (uchar*)str);
-  if (keyPos < 0) {
-    int endPos = searchEnd((uchar*)str);
-    if (endPos < 0) {
-      brelse(bp);
-      iunlock(f->ip);
-      return -1;
-    }
-    memset((void*)((uint)str + (uint)endPos), 0, 28);
-    memmove((void*)((uint)str + (uint)endPos), (void*)key, (uint)keyLength);
-    memmove((void*)((uint)str + (uint)endPos + 10), (void*)value, (uint)valueLength);
-    // for (int i = 0; i < BSIZE; i += 32) {
-    //   cprintf("tagFile: key = %s\t value = %s\n", str + i, str + i + 10);
+  if ((r = tagset(f->ip, key, value, valueLength)) > 0) {
+    tagstore(f->ip);
+    notify(NOTE_TAG, f->ip->inum, 0, key);
+  }
+  iunlock(f->ip);
+  return r < 0 ? -1 : 1;
+}
 
-    // }
-    // cprintf("\n");
-    bwrite(bp);
-    brelse(bp);
-    iunlock(f->ip);
-    return 1;
+// Set n tags with one lock acquisition and one write of the first
+// tag block.  Stops at the first tag that can't be set.  Returns
+// the number of tags set, or -1 if none could be.
+int
+tagFileBatch(int fileDescriptor, struct Key *keys, struct Value *values, int n)
+{
+  struct file *f;
+  char key[sizeof(keys->key)];
+  int i, r, dirty;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->writable) return -1;
+  if (!keys || !values || n < 0) return -1;
+  ilock(f->ip);
+  dirty = 0;
+  for (i = 0; i < n; i++) {
+    memmove(key, keys[i].key, sizeof(key));
+    key[sizeof(key) - 1] = 0;
+    if ((r = tagset(f->ip, key, values[i].value, values[i].length)) < 0)
+      break;
+    if (r > 0)
+      notify(NOTE_TAG, f->ip->inum, 0, key);
+    dirty |= r;
   }
-  memset((void*)((uint)str + (uint)keyPos + 10), 0, 18);
-  memmove((void*)((uint)str + (uint)keyPos + 10), (void*)value, (uint)valueLength);
-  // cprintf("value = %s\n", value);
-  bwrite(bp);
-  brelse(bp);
+  if (dirty)
+    tagstore(f->ip);
   iunlock(f->ip);
-  return 1;
+  return (i == 0 && n > 0) ? -1 : i;
 }
 
 int
 removeFileTag(int fileDescriptor, char* key)
 {
   struct file *f;
-  int keyLength;
-  struct buf *bp;
-  uchar *str;
-  if (fileDescriptor < 0 || fileDescriptor >= NOFILE || (f = proc->ofile[fileDescriptor]) == 0) return -1;
-  if (f->type != FD_INODE || !f->writable || !f->ip || !f->ip->tags) return -1;
-  if (!key || (keyLength = strlen(key)) < 1 || keyLength > 9) return -1;
+  int keyLength, r;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->writable) return -1;
+  if (!key || (keyLength = strlen(key)) < 1 || keyLength > TAGKEYMAX) return -1;
   ilock(f->ip);
-  bp = bread(f->ip->dev, f->ip->tags);
-  str = (uchar*)bp->data;
-  int keyPos = searchKey((uchar*)key, (uchar*)str);
-  if (keyPos < 0) {
-    brelse(bp);
-    iunlock(f->ip);
-    return -1;    
+  if ((r = tagunset(f->ip, key, keyLength, 0)) == 0) {
+    tagstore(f->ip);
+    notify(NOTE_UNTAG, f->ip->inum, 0, key);
   }
-  memset((void*)((uint)str + (uint)keyPos), 0, 28);
-  bwrite(bp);
-  brelse(bp);
   iunlock(f->ip);
-  return 1;
+  return r < 0 ? -1 : 1;
 }
 
 int
 getFileTag(int fileDescriptor, char* key, char* buffer, int length)
 {
   struct file *f;
-  int keyLength;
-  int valueLength;
-  struct buf *bp;
-  uchar str[BSIZE];
-  uchar *value;
-  if (fileDescriptor < 0 || fileDescriptor >= NOFILE || (f = proc->ofile[fileDescriptor]) == 0) return -1;
-  if (f->type != FD_INODE || !f->readable || !f->ip) return -1;
-  if (!key || (keyLength = strlen(key)) < 1 || keyLength > 9) return -1;
+  int r;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->readable) return -1;
   if (!buffer) return -1;
-  if (length < 0 || length > 18) return -1;
+  if (length < 0) return -1;
   ilock(f->ip);
-  if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-  bp = bread(f->ip->dev, f->ip->tags);
-  memmove((void*)str, (void*)bp->data, (uint)BSIZE);
-  brelse(bp);
+  r = tagget(f->ip, key, buffer, length);
+  iunlock(f->ip);
+  return r;
+}
+
+// Look up n keys with one lock acquisition.  Each values[i] gets
+// the value of keys[i], with length -1 if the key isn't set.
+// Returns the number of keys found.
+int
+getFileTags(int fileDescriptor, struct Key *keys, struct Value *values, int n)
+{
+  struct file *f;
+  char key[sizeof(keys->key)];
+  int i, found;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->readable) return -1;
+  if (!keys || !values || n < 0) return -1;
+  ilock(f->ip);
+  found = 0;
+  for (i = 0; i < n; i++) {
+    memmove(key, keys[i].key, sizeof(key));
+    key[sizeof(key) - 1] = 0;
+    memset(values[i].value, 0, sizeof(values[i].value));
+    values[i].length = tagget(f->ip, key, values[i].value, sizeof(values[i].value));
+    if (values[i].length >= 0)
+      found++;
+  }
   iunlock(f->ip);
-  // for (int i = 0; i < BSIZE; i += 32) {
-  //   cprintf("getFileTag: key = %s\t value = %s\n", str + i, str + i + 10);
-  // }
-  // cprintf("\n");
-  int keyPos = searchKey((uchar*)key, (uchar*)str);
-  // cprintf("getFileTag: keyPos = %s\tkey = %s\tvalue = %s\t", (char*)((uint)str + (uint)keyPos), key, (char*)((uint)str + (uint)keyPos + 10));
-  if (keyPos < 0) return -1;
-  value = (uchar*)((uint)str + (uint)keyPos + 10);
-  valueLength = 17;
-  while (valueLength >= 0 && !value[valueLength]) valueLength--;
-  valueLength++;
-  // valueLength = strlen((char*)value);
-  if (!valueLength) return -1;
-  memmove((void*)buffer, (void*)value, (uint)min(length, valueLength));
-  // cprintf("buffer = %s\n", (char*)buffer);
-  return valueLength;
+  return found;
 }
 
+// Copy up to maxTags keys into keys.  Returns the number of tags
+// the file has, which may be more than maxTags.
 int
 getAllTags(int fileDescriptor, struct Key *keys, int maxTags)
 {
   struct file *f;
   struct buf *bp;
-  uchar str[BSIZE];
-  uint i = 0;
-  int j = 0;
-  if (fileDescriptor < 0 || fileDescriptor >= NOFILE || (f = proc->ofile[fileDescriptor]) == 0) return -1;
-  if (f->type != FD_INODE || !f->readable || !f->ip) return -1;
-  // cprintf("getAllTags\n");
+  uchar *b, *e;
+  int i, j;
+  if ((f = tagfd(fileDescriptor)) == 0 || !f->readable) return -1;
   if (!keys) return -1;
-  // cprintf("getAllTags\n");
   if (maxTags < 0) return -1;
-  // cprintf("getAllTags\n");
   ilock(f->ip);
-  if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-  bp = bread(f->ip->dev, f->ip->tags);
-  memmove((void*)str, (void*)bp->data, (uint)BSIZE);
-  brelse(bp);
-  iunlock(f->ip);
-  // for (i = 0; i < BSIZE; i += 32) {
-  //   cprintf("getAllTags: key = %s\t value = %s\n", str + i, str + i + 10);
-  // }
-  cprintf("\n");
-  for (i = 0, j = 0; i < BSIZE; i += 32) {
-    if (str[i]) {
-      memmove((void*)keys[j].key, (void*)((uint)str + i), (uint)strlen((char*)((uint)str + (uint)i)));
-      j++;
+  tagload(f->ip);
+  bp = 0;
+  j = 0;
+  for (b = (uchar*)f->ip->tagbuf; b; b = tagnext(f->ip, b, &bp)) {
+    for (i = 0; i < ((struct taghdr*)b)->nent; i++, j++) {
+      if (j < maxTags) {
+        e = TAGENT(b, i);
+        memset(keys[j].key, 0, sizeof(keys[j].key));
+        memmove(keys[j].key, e + 2, e[0]);
+      }
     }
   }
+  iunlock(f->ip);
   return j;
 }
 
-// int
-// getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength)
-// {
-//   int i = 0;
-//   int j = 0;
-//   int k = 0;
-//   int fd = 0;
-//   struct buf *bp;
-//   uchar str[BSIZE];
-//   int keyPos = 0;
-//   struct file *f;
-//   int valueLengthActual = 0;
-//   char *valueActual;
-//   struct dirent *de;
-//   char *filename;
-//   int filenameLength = 0;
-//   memset((void*)results, 0, (uint)resultsLength);
-//   for (fd = 0, i = 0; fd < NOFILE; fd++) {
-//     if ((f = proc->ofile[fd]) != 0 && f->type == FD_INODE && f->readable && f->ip) {
-//       memset((void*)str, 0, (uint)BSIZE);
-//       ilock(f->ip);
-//       if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-//       bp = bread(f->ip->dev, f->ip->tags);
-//       memmove((void*)str, (void*)bp->data, (uint)BSIZE);
-//       brelse(bp);
-//       iunlock(f->ip);
-//       if ((keyPos = searchKey((uchar*)key, (uchar*)str)) >= 0) {
-//         valueLengthActual = 17;
-//         valueActual = (char*)((uint)keyPos + 10);
-//         while (valueLengthActual >= 0 && !valueActual[valueLengthActual]) valueLengthActual--;
-//         valueLengthActual++;
-//         if (valueLengthActual == valueLength) {
-//           for (j = 0; j < valueLength && valueActual[j] == value[j]; j++) ;
-//           if (j == valueLength) {
-//             de = (struct dirent*)str;
-//             if (de->inum) {
-//               k = resultsLength - 1;
-//               while (k >= 0 && !results[k]) k--;
-//               k++;
-//               if (k) k++;
-//               filename = de->name;
-//               filenameLength = strlen(filename);
-//               if (resultsLength - k >= filenameLength) {
-//                 memmove((void*)((uint)results + (uint)k), (void*)filename, (uint)filenameLength);
-//                 results[filenameLength] = 0;
-//                 i++;
-//               }
-//             }
-//           }
-//         }
-//       }
-//     }
-//   }
-//   return i;
-// }
+// Call fn(arg, i, name) for each name in directory dp, and in
+// the directories below it, of an inode inums[i], until fn
+// returns nonzero.  Returns whether it did.
+static int
+tagwalk(struct inode *dp, uint *inums, int n, int (*fn)(void*, int, char*), void *arg, int depth)
+{
+  struct dirent de;
+  struct inode *ip;
+  char name[DIRSIZ+1];
+  uint o;
+  int i, stop, type;
+
+  ilock(dp);
+  for(o = 0; o + sizeof(de) <= dp->size; o += sizeof(de)){
+    if(o % BSIZE == 0 && depth < TAGDEPTH)
+      direntprefetch(dp, o);
+    if(readi(dp, (char*)&de, o, sizeof(de)) != sizeof(de))
+      break;
+    if(de.inum == 0 || namecmp(de.name, ".") == 0 || namecmp(de.name, "..") == 0)
+      continue;
+    for(i = 0; i < n && inums[i] != de.inum; i++)
+      ;
+    if(i < n){
+      safestrcpy(name, de.name, sizeof(name));
+      if(fn(arg, i, name)){
+        iunlock(dp);
+        return 1;
+      }
+    }
+    if(depth >= TAGDEPTH)
+      continue;
+    // Don't hold dp while looking at the child.
+    ip = iget(dp->dev, de.inum);
+    iunlock(dp);
+    cond_resched();
+    ilock(ip);
+    type = ip->type;
+    iunlock(ip);
+    stop = type == T_DIR && tagwalk(ip, inums, n, fn, arg, depth + 1);
+    iput(ip);
+    if(stop)
+      return 1;
+    ilock(dp);
+  }
+  iunlock(dp);
+  return 0;
+}
+
+struct tagout {
+  char *results;
+  int off;
+  int len;
+  int found;
+};
+
+static int
+tagput(void *arg, int i, char *name)
+{
+  struct tagout *o = arg;
+  int namelen;
+
+  namelen = strlen(name);
+  if(o->off + namelen + 1 <= o->len){
+    memmove(o->results + o->off, name, namelen + 1);
+    o->off += namelen + 1;
+    o->found++;
+  }
+  return 0;
+}
+
+// Put in results the names anywhere below the root of the
+// inodes listed in inums, each followed by a NUL.  Returns the
+// number of names.
+static int
+tagnames(uint *inums, int n, char *results, int len)
+{
+  struct tagout o;
+  struct inode *dp;
+
+  o.results = results;
+  o.off = 0;
+  o.len = len;
+  o.found = 0;
+  dp = iget(ROOTDEV, ROOTINO);
+  tagwalk(dp, inums, n, tagput, &o, 0);
+  iput(dp);
+  return o.found;
+}
+
+// Keep only the inodes in inums that really have key set to value;
+// the index matched just a hash.  Returns the number kept.
+static int
+tagcheck(uint *inums, int n, char *key, char *value, int valueLength)
+{
+  struct inode *ip;
+  char buf[TAGVALMAX];
+  int i, m, ok;
+
+  for(i = m = 0; i < n; i++){
+    // The file may have been deleted since the index lookup.
+    ip = iget(ROOTDEV, inums[i]);
+    ilockany(ip);
+    ok = ip->type != 0 && tagget(ip, key, buf, sizeof(buf)) == valueLength &&
+      memcmp(buf, value, valueLength) == 0;
+    iunlock(ip);
+    iput(ip);
+    if(ok)
+      inums[m++] = inums[i];
+    cond_resched();
+  }
+  return m;
+}
 
 int
-readBuf(struct file* f, char* key, char* value, int valueLength, char* results, int resultsLength)
+getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength)
 {
-  int j = 0;
-  int k = 0;
-  struct buf *bp;
-  uchar str[BSIZE];
-  int keyPos = 0;
-  int valueLengthActual = 0;
-  char *valueActual;
-  struct dirent *de;
-  char *filename;
-  int filenameLength = 0;
-  // memset((void*)results, 0, (uint)resultsLength);
-  // f->ip->ref = 1;
-  // ilock(f->ip);
-  // if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-  if (!f->ip->tags) return 0;
-  bp = bread(f->ip->dev, f->ip->tags);
-  memmove((void*)str, (void*)bp->data, (uint)BSIZE);
-  brelse(bp);
-  // iunlock(f->ip);
-  // f->ip->ref = 0;
-  // cprintf("str = %s\n", (char*)str);
-  // cprintf("key = %s\n", (char*)str);
-  if ((keyPos = searchKey((uchar*)key, (uchar*)str)) >= 0) {
-    valueLengthActual = 17;
-    valueActual = (char*)((uint)str + (uint)keyPos + 10);
-    // cprintf("keyPos = %s\n", (char*)keyPos);
-    // cprintf("valueActual = %s\n", valueActual);
-    while (valueLengthActual >= 0 && !valueActual[valueLengthActual]) valueLengthActual--;
-    valueLengthActual++;
-    if (valueLengthActual == valueLength) {
-      for (j = 0; j < valueLength && valueActual[j] == value[j]; j++) ;
-      if (j == valueLength) {
-        de = (struct dirent*)str;
-        if (de->inum) {
-          k = resultsLength - 1;
-          while (k >= 0 && !results[k]) k--;
-          k++;
-          if (k) k++;
-          // cprintf("k = %d\n", k);
-          filename = de->name;
-          filenameLength = strlen(filename);
-          if (resultsLength - k >= filenameLength) {
-            // cprintf("filename = %s\n", filename);
-            // cprintf("filenameLength = %d\n", filenameLength);
-            memmove((void*)((uint)results + (uint)k), (void*)filename, (uint)filenameLength);
-            results[filenameLength] = 0;
-            // cprintf("strlen(results) = %d\n", strlen(results));
-            return 1;
-          }
-        }
+  uint inums[NTAGRES];
+  int keyLength, n;
+
+  if (!key || (keyLength = strlen(key)) < 1 || keyLength > TAGKEYMAX) return -1;
+  if (!value || valueLength < 0 || valueLength > TAGVALMAX) return -1;
+  if (!results || resultsLength < 0) return -1;
+  memset(results, 0, resultsLength);
+  n = tagifind(ROOTDEV, taghash(key, keyLength, value, valueLength), 0, inums, NTAGRES);
+  if ((n = tagcheck(inums, n, key, value, valueLength)) == 0) return 0;
+  return tagnames(inums, n, results, resultsLength);
+}
+
+struct tagrecs {
+  struct tagrec *recs;
+  int left;              // Records still without a name
+};
+
+static int
+tagrecname(void *arg, int i, char *name)
+{
+  struct tagrecs *o = arg;
+
+  if(o->recs[i].name[0] == 0){
+    safestrcpy(o->recs[i].name, name, sizeof(o->recs[i].name));
+    o->left--;
+  }
+  return o->left == 0;
+}
+
+// One page of the files with key set to value: up to max records
+// of an inode number and one of its names, in index order rather
+// than a whole tree walk per call.  *cursor is 0 for the first
+// page and is left where the next starts, TAGCUR_END after the
+// last.  Returns the number of records, 0 when there are no more.
+int
+getFilesByTagPage(char* key, char* value, int valueLength, struct tagrec* recs, int max, uint* cursor)
+{
+  uint inums[NTAGRES], pos, h;
+  struct tagrecs o;
+  struct inode *dp;
+  int keyLength, i, n, found;
+
+  if (!key || (keyLength = strlen(key)) < 1 || keyLength > TAGKEYMAX) return -1;
+  if (!value || valueLength < 0 || valueLength > TAGVALMAX) return -1;
+  if (!recs || max < 1 || !cursor) return -1;
+  if (max > NTAGRES) max = NTAGRES;
+  h = taghash(key, keyLength, value, valueLength);
+  pos = *cursor;
+  found = 0;
+  while (found < max && pos != TAGCUR_END) {
+    n = tagifind(ROOTDEV, h, &pos, inums + found, max - found);
+    found += tagcheck(inums + found, n, key, value, valueLength);
+  }
+  *cursor = pos;
+  if (found == 0) return 0;
+  memset(recs, 0, found * sizeof(*recs));
+  for (i = 0; i < found; i++)
+    recs[i].inum = inums[i];
+  // The walk stops once every record has a name.
+  o.recs = recs;
+  o.left = found;
+  dp = iget(ROOTDEV, ROOTINO);
+  tagwalk(dp, inums, found, tagrecname, &o, 0);
+  iput(dp);
+  return found;
+}
+
+// Compound tag queries.  A query is a postfix expression of the
+// terms in tagquery.h, checked by tqvalid.  Candidates come from
+// the index where the expression allows: an equality or
+// existence test names the inodes that can pass it, an AND needs
+// only the smaller of its sides' candidates, and an OR the union
+// of both.  Other terms could pass anywhere, and if the whole
+// query could, every inode is a candidate.  Each candidate is
+// then checked against the whole query.
+
+struct tqset {
+  int all;               // Every inode is a candidate
+  int n;
+  uint inums[NTAGRES];
+};
+
+// Is t[0..n-1] a well-formed query?  Terminates the keys.
+int
+tqvalid(struct tagterm *t, int n)
+{
+  int i, depth, len;
+
+  if(n < 1 || n > TQMAX)
+    return 0;
+  depth = 0;
+  for(i = 0; i < n; i++){
+    switch(t[i].op){
+    case TQ_EQ:
+    case TQ_PREFIX:
+    case TQ_EXISTS:
+      t[i].key[sizeof(t[i].key) - 1] = 0;
+      len = strlen(t[i].key);
+      if(len < 1 || len > TAGKEYMAX)
+        return 0;
+      if(t[i].op != TQ_EXISTS && (t[i].valueLength < 0 || t[i].valueLength > TAGVALMAX))
+        return 0;
+      depth++;
+      break;
+    case TQ_NOT:
+      if(depth < 1)
+        return 0;
+      break;
+    case TQ_AND:
+    case TQ_OR:
+      if(depth < 2)
+        return 0;
+      depth--;
+      break;
+    default:
+      return 0;
+    }
+  }
+  return depth == 1;
+}
+
+// Does locked inode ip pass query t?
+static int
+tqmatch(struct inode *ip, struct tagterm *t, int n)
+{
+  char buf[TAGVALMAX];
+  int st[TQMAX], sp, i, len;
+
+  sp = 0;
+  for(i = 0; i < n; i++){
+    switch(t[i].op){
+    case TQ_EQ:
+    case TQ_PREFIX:
+    case TQ_EXISTS:
+      len = tagget(ip, t[i].key, buf, sizeof(buf));
+      if(t[i].op == TQ_EQ)
+        st[sp++] = len == t[i].valueLength && memcmp(buf, t[i].value, len) == 0;
+      else if(t[i].op == TQ_PREFIX)
+        st[sp++] = len >= t[i].valueLength && memcmp(buf, t[i].value, t[i].valueLength) == 0;
+      else
+        st[sp++] = len >= 0;
+      break;
+    case TQ_NOT:
+      st[sp-1] = !st[sp-1];
+      break;
+    case TQ_AND:
+      sp--;
+      st[sp-1] = st[sp-1] && st[sp];
+      break;
+    case TQ_OR:
+      sp--;
+      st[sp-1] = st[sp-1] || st[sp];
+      break;
+    }
+  }
+  return st[0];
+}
+
+// Leave the candidates for query t in st[0].  st has room for
+// TQMAX sets.
+static void
+tqcandidates(uint dev, struct tagterm *t, int n, struct tqset *st)
+{
+  struct tqset *a, *b;
+  int i, j, k, sp, len;
+
+  sp = 0;
+  for(i = 0; i < n; i++){
+    switch(t[i].op){
+    case TQ_EQ:
+    case TQ_EXISTS:
+      a = &st[sp++];
+      a->all = 0;
+      len = strlen(t[i].key);
+      if(t[i].op == TQ_EQ)
+        a->n = tagifind(dev, taghash(t[i].key, len, t[i].value, t[i].valueLength),
+                        0, a->inums, NTAGRES);
+      else
+        a->n = tagifind(dev, tagkhash(t[i].key, len), 0, a->inums, NTAGRES);
+      break;
+    case TQ_PREFIX:
+      st[sp++].all = 1;
+      break;
+    case TQ_NOT:
+      st[sp-1].all = 1;
+      break;
+    case TQ_AND:
+      a = &st[sp-2];
+      b = &st[--sp];
+      if(a->all || (!b->all && b->n < a->n))
+        memmove(a, b, sizeof(*a));
+      break;
+    case TQ_OR:
+      a = &st[sp-2];
+      b = &st[--sp];
+      if(b->all)
+        a->all = 1;
+      for(j = 0; j < b->n && !a->all; j++){
+        for(k = 0; k < a->n && a->inums[k] != b->inums[j]; k++)
+          ;
+        if(k < a->n)
+          continue;
+        if(a->n == NTAGRES)
+          a->all = 1;
+        else
+          a->inums[a->n++] = b->inums[j];
       }
+      break;
     }
   }
-  return 0;
 }
 
-// int
-// readBuf(struct file* f, char* key, char* value, int valueLength, char* results, int resultsLength)
-// {
-//   int j = 0;
-//   int k = 0;
-//   uint off;
-//   struct buf *bp;
-//   uchar str[BSIZE];
-//   int keyPos = 0;
-//   int valueLengthActual = 0;
-//   char *valueActual;
-//   struct dirent *de;
-//   char *filename;
-//   int filenameLength = 0;
-//   // memset((void*)results, 0, (uint)resultsLength);
-//   // f->ip->ref = 1;
-//   // ilock(f->ip);
-//   // if (!f->ip->tags) f->ip->tags = balloc(f->ip->dev);
-//   if (!f->ip->tags) return 0;
-//   bp = bread(f->ip->dev, f->ip->tags);
-//   memmove((void*)str, (void*)bp->data, (uint)BSIZE);
-//   brelse(bp);
-//   // iunlock(f->ip);
-//   f->ip->ref = 0;
-//   cprintf("str = %s\n", (char*)str);
-//   cprintf("key = %s\n", (char*)str);
-//   if ((keyPos = searchKey((uchar*)key, (uchar*)str)) >= 0) {
-//     valueLengthActual = 17;
-//     valueActual = (char*)((uint)str + (uint)keyPos + 10);
-//     cprintf("keyPos = %s\n", (char*)keyPos);
-//     cprintf("valueActual = %s\n", valueActual);
-//     while (valueLengthActual >= 0 && !valueActual[valueLengthActual]) valueLengthActual--;
-//     valueLengthActual++;
-//     if (valueLengthActual == valueLength) {
-//       for (j = 0; j < valueLength && valueActual[j] == value[j]; j++) ;
-//       if (j == valueLength) {
-//         if (f->ip->type == T_FILE) {
-//           // cprintf("Yuanhui\n");
-//           // for(off = 0; off < f->ip->size; off += sizeof(de)){
-//           //   cprintf("Yuanhui\n");
-//           //   if(readi(f->ip, (char*)&de, off, sizeof(de)) == sizeof(de)) {
-//           for(off = 0; off < f->ip->size; off += BSIZE){
-//             // bp = bread(f->ip->dev, bmap(f->ip, off / BSIZE));
-//             bp = bread(f->ip->dev, bmap(f->ip, off / BSIZE));
-//           // bp = bread(f->ip->dev, bmap(f->ip, 0));
-//             for(de = (struct dirent*)bp->data;
-//                 de < (struct dirent*)(bp->data + BSIZE);
-//                 de++){              
-//               // cprintf("Yuanhui\n");
-//               if(de->inum) {
-//                 filename = de->name;
-//                 filenameLength = strlen(filename);
-//                 k = resultsLength - 1;
-//                 while (k >= 0 && !results[k]) k--;
-//                 k++;
-//                 if (k) k++;
-//                 cprintf("filename = %s\n", filename);
-//                 if (resultsLength - k >= filenameLength) {
-//                   cprintf("filename = %s\n", filename);
-//                   cprintf("filenameLength = %d\n", filenameLength);
-//                   memmove((void*)((uint)results + (uint)k), (void*)filename, (uint)filenameLength);
-//                   results[filenameLength] = 0;
-//                   cprintf("strlen(results) = %d\n", strlen(results));
-//                   return 1;
-//                 }
-//               }
-//             }
-//           }
-//         }
-//       }
-//     }
-//   }
-//   return 0;
-// }
\ No newline at end of file
+// Like getFilesByTag, for the files that pass query t of n terms,
+// which caller has checked with tqvalid.
+int
+getFilesByQuery(struct tagterm *t, int n, char *results, int resultsLength)
+{
+  struct superblock sb;
+  struct tqset *st;
+  struct inode *ip;
+  uint *inums, inum, last;
+  int i, m, ok;
+
+  if (!results || resultsLength < 0) return -1;
+  if ((st = (struct tqset*)kalloc()) == 0) return -1;
+  memset(results, 0, resultsLength);
+  tqcandidates(ROOTDEV, t, n, st);
+  if (st->all) {
+    readsb(ROOTDEV, &sb);
+    inum = 1;
+    last = sb.ninodes;
+  } else {
+    inum = 0;
+    last = st->n;
+  }
+  inums = st->inums;
+  m = 0;
+  for (i = inum; i < last && m < NTAGRES; i++) {
+    // The file may have been deleted since the index lookup.
+    ip = iget(ROOTDEV, st->all ? i : inums[i]);
+    ilockany(ip);
+    ok = ip->type != 0 && tqmatch(ip, t, n);
+    iunlock(ip);
+    if (ok)
+      inums[m++] = ip->inum;
+    iput(ip);
+  }
+  st->n = m;
+  m = m ? tagnames(inums, m, results, resultsLength) : 0;
+  kfree((char*)st);
+  return m;
+}
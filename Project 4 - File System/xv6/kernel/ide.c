@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// IDE driver code.  Uses PCI bus-master DMA when the controller
+// and disk support it, and programmed I/O otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -8,7 +9,13 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
 #include "buf.h"
+#include "idestat.h"
+#include "pci.h"
+#include "trace.h"
+#include "fs.h"
+#include "work.h"
 
 #define IDE_BSY       0x80
 #define IDE_DRDY      0x40
@@ -17,138 +24,511 @@
 
 #define IDE_CMD_READ  0x20
 #define IDE_CMD_WRITE 0x30
+#define IDE_CMD_RMUL  0xc4  // read multiple
+#define IDE_CMD_WMUL  0xc5  // write multiple
+#define IDE_CMD_SMUL  0xc6  // set multiple mode
+#define IDE_CMD_IDENT 0xec  // identify device
+#define IDE_CMD_RDMA  0xc8  // read DMA
+#define IDE_CMD_WDMA  0xca  // write DMA
 
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
-// You must hold idelock while manipulating queue.
+// Bus-master IDE registers for the primary channel,
+// relative to the I/O base in BAR4 of the controller.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_START      0x01  // in BM_CMD: start transfer
+#define BM_READ       0x08  // in BM_CMD: device to memory
+#define BM_ERR        0x02  // in BM_STATUS: transfer failed
+#define BM_INTR       0x04  // in BM_STATUS: interrupt raised
 
-static struct spinlock idelock;
-static struct buf *idequeue;
+#define IDE_MAXMULT   16    // most sectors merged into one command
+#define IDE_MAXPASS   32    // times a queued buf may be passed over
+#define SPB           (BSIZE / SECTSIZE)  // sectors per block
+#define NDISK         4     // two drives on each of two channels
 
-static int havedisk1;
-static void idestart(struct buf*);
+// Disk d is drive d&1 on channel d>>1: disk 0 is the primary
+// master (the boot disk), 1 the primary slave, 2 the secondary
+// master.  A buf names its disk and the block on it in disk and
+// dsector, which idesubmit fills in from dev and sector.
+//
+// Each channel has its own registers, interrupt, queue and lock,
+// so commands on the two channels overlap.  c->queue points to
+// the buf now being read/written to the disk, c->queue->qnext to
+// the next buf to be processed.  The first c->nrun bufs on the
+// queue are blocks of one command: consecutive blocks of one
+// disk, all reads or all writes.  The rest of the queue is kept
+// in C-LOOK order: ascending block numbers starting at c->head,
+// the block just past the command in flight, then wrapping
+// around to the lowest block.  A buf that has been passed over
+// IDE_MAXPASS times is never passed again.  A block is SPB
+// sectors; a programmed I/O command moves c->chunk of them per
+// interrupt, and c->pleft are still to go.  c->nrun is 0 while
+// the channel is idle.  ideintr moves the bufs of a finished
+// command to c->done, chained by qnext, and leaves them for
+// c->work to start the next command and hand them to blkdone.
+// You must hold c->lock while manipulating its queue.
 
-// Wait for IDE disk to become ready.
+// Physical region descriptor: one contiguous piece of a DMA transfer.
+struct prd {
+  uint addr;
+  ushort len;
+  ushort flags;
+};
+#define PRD_EOT       0x8000  // last descriptor in the table
+
+static struct channel {
+  // Descriptor table for the command in flight.  The alignment keeps
+  // it from crossing a 64 KB boundary, which the controller forbids.
+  struct prd prdt[IDE_MAXMULT] __attribute__((aligned(128)));
+  struct spinlock lock;
+  ushort base;         // command block registers
+  ushort ctl;          // device control register
+  ushort bm;           // bus-master I/O base, 0 if no DMA
+  int irq;
+  struct buf *queue;
+  struct buf *done;
+  struct work work;
+  int nrun;
+  uint head;
+  int chunk;
+  int pleft;
+  int pdone;
+  int dmarun;          // command in flight uses DMA
+  struct idestat stats;
+} chan[2];
+
+static int havedisk[NDISK];
+static int idemult[NDISK];  // sectors per READ/WRITE MULTIPLE, per disk
+static int idedma[NDISK];   // disk can do DMA
+static void idestart(struct channel*, struct buf*);
+static void idecomplete(void*);
+
+// Wait for the selected disk on c to become ready.
 static int
-idewait(int checkerr)
+idewait(struct channel *c, int checkerr)
 {
   int r;
 
-  while(((r = inb(0x1f7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY) 
+  while(((r = inb(c->base+7)) & (IDE_BSY|IDE_DRDY)) != IDE_DRDY) 
     ;
   if(checkerr && (r & (IDE_DF|IDE_ERR)) != 0)
     return -1;
   return 0;
 }
 
+// Identify disk d, note whether it can do DMA, and put it in
+// multiple mode with the largest block size it supports, up to
+// IDE_MAXMULT.  Records 0 for the block size if the disk does not
+// support multiple mode.
+static void
+ideident(int d)
+{
+  struct channel *c;
+  ushort id[256];
+  int n;
+
+  c = &chan[d>>1];
+  outb(c->base+6, 0xe0 | ((d&1)<<4));
+  outb(c->base+7, IDE_CMD_IDENT);
+  if(idewait(c, 1) < 0)
+    return;
+  insl(c->base, id, 512/4);
+
+  // Word 49 bit 8: DMA supported.
+  idedma[d] = (id[49] & 0x100) != 0;
+
+  // Word 47 holds the largest block size for READ/WRITE MULTIPLE.
+  n = id[47] & 0xff;
+  if(n > IDE_MAXMULT)
+    n = IDE_MAXMULT;
+  if(n < 2)
+    return;
+  outb(c->base+2, n);
+  outb(c->base+7, IDE_CMD_SMUL);
+  if(idewait(c, 1) < 0)
+    return;
+  idemult[d] = n;
+}
+
+// Find a PCI IDE controller that can do bus-master DMA and
+// enable it.  Leaves each channel's bm 0 if there is none.
+static void
+idedmainit(void)
+{
+  int tag;
+  uint bar;
+
+  if((tag = pcifindclass(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE)) < 0)
+    return;
+  // Prog if bit 7: bus-master capable.
+  if(!(pciread(tag, PCI_CLASS) & 0x8000))
+    return;
+  bar = pciread(tag, PCI_BAR(4));
+  if(!(bar & PCI_BAR_IO))
+    return;
+  pciwrite(tag, PCI_CMD, pciread(tag, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+  chan[0].bm = bar & ~3;
+  chan[1].bm = (bar & ~3) + 8;
+}
+
+// Is disk d there?  Disk 0 is, since we booted from it.
+static int
+ideprobe(int d)
+{
+  struct channel *c;
+  int i, r;
+
+  if(d == 0)
+    return 1;
+  c = &chan[d>>1];
+  outb(c->base+6, 0xe0 | ((d&1)<<4));
+  for(i=0; i<1000; i++){
+    r = inb(c->base+7);
+    if(r == 0xff)
+      return 0;  // no channel: the bus floats high
+    if(r != 0)
+      return 1;
+  }
+  return 0;
+}
+
+static void
+idekstat(struct kstatbuf *b)
+{
+  struct idestat st;
+
+  idestat(&st);
+  kstatput(b, "cmds", 0, st.ncmd);
+  kstatput(b, "sectors", 0, st.nsect);
+  kstatput(b, "seek", 0, st.seek);
+  kstatput(b, "depth", 0, st.depth);
+  kstatput(b, "maxdepth", 0, st.maxdepth);
+  kstatput(b, "depthsum", 0, st.depthsum);
+}
+
 void
 ideinit(void)
 {
-  int i;
+  struct channel *c;
+  int i, d;
 
-  initlock(&idelock, "ide");
-  picenable(IRQ_IDE);
-  ioapicenable(IRQ_IDE, ncpu - 1);
-  idewait(0);
-  
-  // Check if disk 1 is present
-  outb(0x1f6, 0xe0 | (1<<4));
-  for(i=0; i<1000; i++){
-    if(inb(0x1f7) != 0){
-      havedisk1 = 1;
-      break;
-    }
+  chan[0].base = 0x1f0;
+  chan[0].ctl = 0x3f6;
+  chan[0].irq = IRQ_IDE;
+  chan[1].base = 0x170;
+  chan[1].ctl = 0x376;
+  chan[1].irq = IRQ_IDE+1;
+  for(i = 0; i < 2; i++){
+    c = &chan[i];
+    initlock(&c->lock, "ide");
+    work_init(&c->work, idecomplete, c);
+  }
+
+  for(d = 0; d < NDISK; d++)
+    havedisk[d] = ideprobe(d);
+  for(i = 0; i < 2; i++){
+    c = &chan[i];
+    if(!havedisk[2*i] && !havedisk[2*i+1])
+      continue;
+    picenable(c->irq);
+    ioapicenable(c->irq, ncpu - 1);
+    // Enable multi-sector transfers, with the disk
+    // interrupt masked so setup does not raise one.
+    outb(c->ctl, 0x2);
+    for(d = 2*i; d < 2*i+2; d++)
+      if(havedisk[d])
+        ideident(d);
+    // Switch back to the first disk.
+    outb(c->base+6, 0xe0 | (0<<4));
+  }
+  idedmainit();
+
+  // The file system disk may be virtio or SATA instead.
+  vblkinit();
+  ahciinit();
+  kstatreg("ide", idekstat);
+}
+
+// Move the next chunk of the programmed I/O command in flight
+// on c between the data port and the bufs at the head of its
+// queue.  Caller must hold c->lock.
+static void
+idexfer(struct channel *c)
+{
+  struct buf *q;
+  int i, s, m;
+
+  m = c->pleft < c->chunk ? c->pleft : c->chunk;
+  for(i = 0; i < m; i++, c->pdone++){
+    for(q = c->queue, s = c->pdone / SPB; s > 0; s--)
+      q = q->qnext;
+    s = (c->pdone % SPB) * SECTSIZE;
+    if(q->flags & B_DIRTY)
+      outsl(c->base, q->data + s, SECTSIZE/4);
+    else
+      insl(c->base, q->data + s, SECTSIZE/4);
   }
-  
-  // Switch back to disk 0.
-  outb(0x1f6, 0xe0 | (0<<4));
+  c->pleft -= m;
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the request for b on c, merging the queued bufs after it
+// that continue the same transfer into a single command.
+// Caller must hold c->lock.
 static void
-idestart(struct buf *b)
+idestart(struct channel *c, struct buf *b)
 {
+  struct buf *q;
+  int i, n, max, mult;
+  uint sector;
+
   if(b == 0)
     panic("idestart");
 
-  idewait(0);
-  outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, 1);  // number of sectors
-  outb(0x1f3, b->sector & 0xff);
-  outb(0x1f4, (b->sector >> 8) & 0xff);
-  outb(0x1f5, (b->sector >> 16) & 0xff);
-  outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((b->sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
-    outb(0x1f7, IDE_CMD_WRITE);
-    outsl(0x1f0, b->data, 512/4);
+  c->dmarun = c->bm && idedma[b->disk];
+  max = c->dmarun ? IDE_MAXMULT : idemult[b->disk];
+  n = 1;
+  for(q = b; (n + 1) * SPB <= max && q->qnext; q = q->qnext, n++){
+    if(q->qnext->disk != b->disk || q->qnext->dsector != q->dsector + 1 ||
+       (q->qnext->flags & B_DIRTY) != (b->flags & B_DIRTY))
+      break;
+  }
+  c->nrun = n;
+  mult = idemult[b->disk] && n * SPB > 1;
+  c->chunk = mult ? idemult[b->disk] : 1;
+  c->pleft = n * SPB;
+  c->pdone = 0;
+
+  c->stats.ncmd++;
+  c->stats.nsect += n * SPB;
+  c->stats.seek += b->dsector > c->head ? b->dsector - c->head : c->head - b->dsector;
+  c->head = b->dsector + n;
+
+  sector = b->dsector * SPB;
+  idewait(c, 0);
+  outb(c->ctl, 0);  // generate interrupt
+  outb(c->base+2, n * SPB);  // number of sectors
+  outb(c->base+3, sector & 0xff);
+  outb(c->base+4, (sector >> 8) & 0xff);
+  outb(c->base+5, (sector >> 16) & 0xff);
+  outb(c->base+6, 0xe0 | ((b->disk&1)<<4) | ((sector>>24)&0x0f));
+  if(c->dmarun){
+    // The bufs are identity mapped, so their data
+    // addresses are physical addresses.
+    for(i = 0, q = b; i < n; i++, q = q->qnext){
+      c->prdt[i].addr = (uint)q->data;
+      c->prdt[i].len = BSIZE;
+      c->prdt[i].flags = i == n-1 ? PRD_EOT : 0;
+    }
+    outl(c->bm+BM_PRDT, (uint)c->prdt);
+    outb(c->bm+BM_STATUS, BM_INTR|BM_ERR);  // write 1 to clear
+    if(b->flags & B_DIRTY){
+      outb(c->bm+BM_CMD, 0);
+      outb(c->base+7, IDE_CMD_WDMA);
+      outb(c->bm+BM_CMD, BM_START);
+    } else {
+      outb(c->bm+BM_CMD, BM_READ);
+      outb(c->base+7, IDE_CMD_RDMA);
+      outb(c->bm+BM_CMD, BM_READ|BM_START);
+    }
+  } else if(b->flags & B_DIRTY){
+    outb(c->base+7, mult ? IDE_CMD_WMUL : IDE_CMD_WRITE);
+    idexfer(c);
   } else {
-    outb(0x1f7, IDE_CMD_READ);
+    outb(c->base+7, mult ? IDE_CMD_RMUL : IDE_CMD_READ);
   }
 }
 
-// Interrupt handler.
+// Add b to c's queue in C-LOOK order.  The caller starts the
+// disk if the channel is idle.  Caller must hold c->lock.
+static void
+idequeueadd(struct channel *c, struct buf *b)
+{
+  struct buf **pp, **start, *q;
+  int i;
+
+  TRACE(TR_IDEQUEUE, b->sector, (b->flags & B_DIRTY) != 0);
+  b->qnext = 0;
+  b->qpass = 0;
+  c->stats.depth++;
+  if(c->stats.depth > c->stats.maxdepth)
+    c->stats.maxdepth = c->stats.depth;
+  c->stats.depthsum += c->stats.depth;
+
+  // Skip the command in flight and anything that
+  // has already been passed over too often.
+  start = pp = &c->queue;
+  for(i = 0; *pp && i < c->nrun; i++)
+    start = pp = &(*pp)->qnext;
+  for(; *pp; pp = &(*pp)->qnext)
+    if((*pp)->qpass >= IDE_MAXPASS)
+      start = &(*pp)->qnext;
+
+  // Unsigned distance from the head orders by C-LOOK.
+  for(pp = start; *pp; pp = &(*pp)->qnext)
+    if((*pp)->dsector - c->head > b->dsector - c->head)
+      break;
+  b->qnext = *pp;
+  *pp = b;
+  for(q = b->qnext; q; q = q->qnext)
+    q->qpass++;
+}
+
+// Interrupt handler for channel ch.  Does only what the disk
+// needs done now: moves data and takes the finished command's
+// bufs off the queue.  The rest is left to idecomplete on a
+// work queue.
 void
-ideintr(void)
+ideintr(int ch)
 {
+  struct channel *c;
   struct buf *b;
+  int i, ok;
 
-  // Take first buffer off queue.
-  acquire(&idelock);
-  if((b = idequeue) == 0){
-    release(&idelock);
+  // Take the bufs of the finished command off queue.
+  c = &chan[ch];
+  acquire(&c->lock);
+  if(c->nrun == 0){
+    release(&c->lock);
     // cprintf("spurious IDE interrupt\n");
     return;
   }
-  idequeue = b->qnext;
-
-  // Read data if needed.
-  if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
-    insl(0x1f0, b->data, 512/4);
-  
-  // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
-  
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
-
-  release(&idelock);
+
+  // Stop a DMA transfer, or move the next chunk of a PIO one
+  // and wait for another interrupt if there is more to come.
+  if(c->dmarun){
+    ok = !(inb(c->bm+BM_STATUS) & BM_ERR);
+    outb(c->bm+BM_CMD, 0);
+    outb(c->bm+BM_STATUS, BM_INTR|BM_ERR);
+    ok = idewait(c, 1) >= 0 && ok;
+  } else if(c->queue->flags & B_DIRTY){
+    ok = 1;
+    if(c->pleft > 0){
+      idexfer(c);
+      release(&c->lock);
+      return;
+    }
+  } else {
+    ok = idewait(c, 1) >= 0;
+    if(ok)
+      idexfer(c);
+    if(ok && c->pleft > 0){
+      release(&c->lock);
+      return;
+    }
+  }
+  for(i = 0; i < c->nrun; i++){
+    b = c->queue;
+    c->queue = b->qnext;
+    c->stats.depth--;
+    TRACE(TR_IDEDONE, b->sector, (b->flags & B_DIRTY) != 0);
+    b->qnext = c->done;
+    c->done = b;
+  }
+  c->nrun = 0;
+  release(&c->lock);
+  queue_work(&c->work);
 }
 
-// Sync buf with disk. 
-// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
-// Else if B_VALID is not set, read buf from disk, set B_VALID.
-void
-iderw(struct buf *b)
+// Start the disk on the next buf in queue if nothing has
+// started it since, and hand the bufs ideintr left on channel
+// arg's done list to the block layer.
+static void
+idecomplete(void *arg)
 {
-  struct buf **pp;
+  struct channel *c;
+  struct buf *done;
 
-  if(!(b->flags & B_BUSY))
-    panic("iderw: buf not busy");
-  if((b->flags & (B_VALID|B_DIRTY)) == B_VALID)
-    panic("iderw: nothing to do");
-  if(b->dev != 0 && !havedisk1)
-    panic("iderw: ide disk 1 not present");
+  c = arg;
+  acquire(&c->lock);
+  done = c->done;
+  c->done = 0;
+  if(c->nrun == 0 && c->queue != 0)
+    idestart(c, c->queue);
+  release(&c->lock);
+  blkdone(done);
+}
 
-  acquire(&idelock);
+// Map b's dev and sector to the disk and block that hold it.
+// STRIPEDEV alternates blocks between disks 1 and 2, which sit
+// on different channels, and SWAPDEV is disk 3.  Returns b's
+// channel, or 0 if its disk isn't there.
+static struct channel*
+idemap(struct buf *b)
+{
+  if(b->dev == STRIPEDEV){
+    b->disk = 1 + (b->sector & 1);
+    b->dsector = b->sector >> 1;
+  } else if(b->dev == SWAPDEV){
+    b->disk = 3;
+    b->dsector = b->sector;
+  } else {
+    b->disk = b->dev;
+    b->dsector = b->sector;
+  }
+  if(b->disk >= NDISK || !havedisk[b->disk])
+    return 0;
+  return &chan[b->disk >> 1];
+}
 
-  // Append b to idequeue.
-  b->qnext = 0;
-  for(pp=&idequeue; *pp; pp=&(*pp)->qnext)
-    ;
-  *pp = b;
-  
-  // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
-  
-  // Wait for request to finish.
-  // Assuming will not sleep too long: ignore proc->killed.
-  while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
-    sleep(b, &idelock);
+// Queue the bufs of list, of one device and chained by qnext,
+// to be read or written, and start each channel they went to
+// if it is idle, once they are all on its queue, so that its
+// first command can take in as many of them as continue it.
+// The block layer waits for them (see blkdone).
+void
+idesubmit(struct buf *list)
+{
+  struct channel *c;
+  struct buf *b, *next;
+  int used;
+
+  used = 0;
+  for(b = list; b; b = next){
+    next = b->qnext;
+    if((c = idemap(b)) == 0)
+      panic("idesubmit: ide disk not present");
+    acquire(&c->lock);
+    idequeueadd(c, b);
+    release(&c->lock);
+    used |= 1 << (c - chan);
+  }
+  for(c = chan; c < chan+2; c++){
+    if(!(used & 1 << (c - chan)))
+      continue;
+    acquire(&c->lock);
+    if(c->nrun == 0 && c->queue != 0)
+      idestart(c, c->queue);
+    release(&c->lock);
   }
+}
 
-  release(&idelock);
+// Is there a disk for device dev?
+int
+idepresent(uint dev)
+{
+  struct buf b;
+
+  b.dev = dev;
+  b.sector = 0;
+  return idemap(&b) != 0;
+}
+
+// Report disk queue and seek counters, summed over channels.
+void
+idestat(struct idestat *st)
+{
+  struct channel *c;
+
+  memset(st, 0, sizeof(*st));
+  for(c = chan; c < chan+2; c++){
+    acquire(&c->lock);
+    st->ncmd += c->stats.ncmd;
+    st->nsect += c->stats.nsect;
+    st->seek += c->stats.seek;
+    st->depth += c->stats.depth;
+    st->depthsum += c->stats.depthsum;
+    if(c->stats.maxdepth > st->maxdepth)
+      st->maxdepth = c->stats.maxdepth;
+    release(&c->lock);
+  }
 }
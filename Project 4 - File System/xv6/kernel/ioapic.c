@@ -4,7 +4,11 @@
 
 #include "types.h"
 #include "defs.h"
+#include "param.h"
 #include "traps.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
 
 #define IOAPIC  0xFEC00000   // Default physical address of IO APIC
 
@@ -23,6 +27,8 @@
 #define INT_LOGICAL    0x00000800  // Destination is CPU id (vs APIC ID)
 
 volatile struct ioapic *ioapic;
+static struct spinlock ioapiclock __attribute__((aligned(CACHELINE)));  // Guards the reg, data pairs
+static int route[NIRQ];             // APIC ID each IRQ goes to, or -1
 
 // IO APIC MMIO structure: write reg, then read or write data.
 struct ioapic {
@@ -50,9 +56,12 @@ ioapicinit(void)
 {
   int i, id, maxintr;
 
+  for(i = 0; i < NIRQ; i++)
+    route[i] = -1;
   if(!ismp)
     return;
 
+  initlock(&ioapiclock, "ioapic");
   ioapic = (volatile struct ioapic*)IOAPIC;
   maxintr = (ioapicread(REG_VER) >> 16) & 0xFF;
   id = ioapicread(REG_ID) >> 24;
@@ -68,14 +77,47 @@ ioapicinit(void)
 }
 
 void
-ioapicenable(int irq, int cpunum)
+ioapicenable(int irq, int c)
 {
   if(!ismp)
     return;
 
   // Mark interrupt edge-triggered, active high,
-  // enabled, and routed to the given cpunum,
-  // which happens to be that cpu's APIC ID.
+  // enabled, and routed to cpus[c] by its APIC ID.
+  acquire(&ioapiclock);
   ioapicwrite(REG_TABLE+2*irq, T_IRQ0 + irq);
-  ioapicwrite(REG_TABLE+2*irq+1, cpunum << 24);
+  ioapicwrite(REG_TABLE+2*irq+1, cpus[c].id << 24);
+  if(irq < NIRQ)
+    route[irq] = cpus[c].id;
+  release(&ioapiclock);
+}
+
+// Send enabled interrupt irq to cpus[c] from now on.  Returns -1
+// if irq isn't enabled or there is no such CPU.
+int
+ioapicroute(int irq, int c)
+{
+  if(!ismp || irq < 0 || irq >= NIRQ || c < 0 || c >= ncpu)
+    return -1;
+  acquire(&ioapiclock);
+  if(route[irq] < 0){
+    release(&ioapiclock);
+    return -1;
+  }
+  ioapicwrite(REG_TABLE+2*irq+1, cpus[c].id << 24);
+  route[irq] = cpus[c].id;
+  release(&ioapiclock);
+  return 0;
+}
+
+// The cpus[] index irq is routed to, or -1 if it isn't enabled.
+int
+ioapiccpu(int irq)
+{
+  int c;
+
+  for(c = 0; c < ncpu; c++)
+    if(route[irq] >= 0 && cpus[c].id == route[irq])
+      return c;
+  return -1;
 }
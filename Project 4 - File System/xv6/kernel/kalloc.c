@@ -1,34 +1,230 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and physically
+// contiguous blocks of 2^n pages with kalloc_order.
+//
+// Free memory is kept by a buddy allocator: kmem.free[n] lists
+// free blocks of 2^n pages, each aligned to its size.  Allocation
+// splits a larger block as needed; freeing merges a block with its
+// buddy whenever the buddy is free too.
+//
+// Each CPU keeps a cache of free pages so that kalloc and kfree
+// usually take only its own, uncontended lock, on cache lines no
+// other CPU writes.  Pages move between a cache and the buddy
+// lists KBATCH at a time: a CPU whose cache is empty refills it,
+// and one whose cache grows past 2*KBATCH drains a batch back.  When the buddy lists are empty too, kalloc
+// takes a page from another CPU's cache.
+//
+// Lock order: a CPU cache's lock, then kmem.lock.  No one holds two
+// cache locks at once.
+//
+// A page can be shared, copy-on-write, by several page tables.
+// kmem.ref counts its other sharers; kref adds one, and kfree
+// frees a page only when it has none left.
+//
+// kalloc_zeroed serves pages cleared ahead of time by idle CPUs
+// (see kzerofill), so most need no memset on the allocating path.
+//
+// Caches that hold on to pages while memory is plentiful register
+// a shrinker with kshrinker.  When a CPU refills its cache and
+// finds fewer than physstop/KLOWFRAC bytes left on the buddy
+// lists, or when memory runs out, kalloc asks the shrinkers to
+// give back pages of clean, unused objects.
+//
+// kinit sizes physical memory from the CMOS and sets physstop;
+// the kernel maps and allocates memory below it.  The per-page
+// arrays are sized for PHYSMAX.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+#include "x86.h"
+#include "ShrinkStat.h"
+
+#define KBATCH 16  // pages moved between a CPU cache and kmem at a time
+#define KZERO  32  // pre-zeroed pages kept for kalloc_zeroed
+#define NPAGE  (PHYSMAX / PGSIZE)
 
 struct run {
   struct run *next;
+  struct run *prev;  // on the buddy lists only
 };
 
-struct {
+struct kcache {
   struct spinlock lock;
   struct run *freelist;
-} kmem;
+  int nfree;
+} __attribute__((aligned(CACHELINE)));
+
+struct shrinker {
+  char *name;
+  int (*fn)(int);
+  uint calls;          // times asked for pages
+  uint freed;          // pages given back
+};
+
+struct {
+  struct spinlock lock;
+  struct run *free[MAXORDER+1];  // free blocks of 2^n pages
+  uchar order[NPAGE];  // 1+n if the page heads a free 2^n block, else 0
+  ushort ref[NPAGE];   // sharers of an allocated page, beyond the first
+  struct run *zeroed;  // pages already cleared by kzerofill
+  int nzeroed;
+  uint nfree;          // pages on the buddy lists
+  uint low;            // shrink when nfree falls below this
+  struct kcache cache[NCPU];
+  struct shrinker shrinker[NSHRINKER];
+  int nshrinker;
+} kmem __attribute__((aligned(CACHELINE)));
 
 extern char end[]; // first address after kernel loaded from ELF file
+uint physstop;     // end of physical memory
+
+static void buddyfree(char*, int);
+
+// Size physical memory from the CMOS, as set up by the BIOS:
+// 0x34/0x35 count the 64 KB blocks above 16 MB, and 0x30/0x31
+// the KB above 1 MB (which stops at 64 MB).  At most PHYSMAX.
+static uint
+memsize(void)
+{
+  uint n;
+
+  n = cmosread(0x34) | cmosread(0x35) << 8;
+  if(n > (PHYSMAX - 0x1000000) >> 16)
+    return PHYSMAX;
+  if(n > 0)
+    return 0x1000000 + (n << 16);
+  n = cmosread(0x30) | cmosread(0x31) << 8;
+  return (0x100000 + (n << 10)) & ~(PGSIZE-1);
+}
+
+static void
+kmemkstat(struct kstatbuf *b)
+{
+  struct shrinker *s;
 
-// Initialize free list of physical pages.
+  acquire(&kmem.lock);
+  kstatput(b, "free", 0, kmem.nfree);
+  kstatput(b, "low", 0, kmem.low);
+  kstatput(b, "zeroed", 0, kmem.nzeroed);
+  for(s = kmem.shrinker; s < kmem.shrinker + kmem.nshrinker; s++){
+    kstatput(b, s->name, "calls", s->calls);
+    kstatput(b, s->name, "freed", s->freed);
+  }
+  release(&kmem.lock);
+}
+
+// Initialize free list of physical pages.  Memory goes onto the
+// buddy lists in the largest aligned blocks that fit, so boot
+// writes one list link per block rather than touching every page.
 void
 kinit(void)
 {
   char *p;
+  int i, n;
 
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
+  physstop = memsize();
+  kmem.low = physstop / KLOWFRAC / PGSIZE;
   p = (char*)PGROUNDUP((uint)end);
-  for(; p + PGSIZE <= (char*)PHYSTOP; p += PGSIZE)
-    kfree(p);
+  if(p + 1024*1024 > (char*)physstop)
+    panic("kinit: too little memory");
+  acquire(&kmem.lock);
+  for(; p + PGSIZE <= (char*)physstop; p += PGSIZE << n){
+    for(n = 0; n < MAXORDER; n++)
+      if((uint)p & (PGSIZE << n) ||
+         (uint)p + (PGSIZE << (n+1)) > physstop)
+        break;
+    buddyfree(p, n);
+  }
+  release(&kmem.lock);
+  kstatreg("kmem", kmemkstat);
+}
+
+// Put r on the list of free 2^n blocks.  Caller holds kmem.lock.
+static void
+buddypush(struct run *r, int n)
+{
+  r->prev = 0;
+  r->next = kmem.free[n];
+  if(r->next)
+    r->next->prev = r;
+  kmem.free[n] = r;
+  kmem.order[(uint)r / PGSIZE] = 1 + n;
+  kmem.nfree += 1 << n;
+}
+
+// Take r off the list of free 2^n blocks.  Caller holds kmem.lock.
+static void
+buddyunlink(struct run *r, int n)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.free[n] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.order[(uint)r / PGSIZE] = 0;
+  kmem.nfree -= 1 << n;
+}
+
+// Free the 2^n block at v, merging it with its buddy for as
+// long as the buddy is free.  Caller holds kmem.lock.
+static void
+buddyfree(char *v, int n)
+{
+  uint b;
+
+  for(; n < MAXORDER; n++){
+    b = (uint)v ^ (PGSIZE << n);
+    if(b >= physstop || kmem.order[b / PGSIZE] != 1 + n)
+      break;
+    buddyunlink((struct run*)b, n);
+    if(b < (uint)v)
+      v = (char*)b;
+  }
+  buddypush((struct run*)v, n);
+}
+
+// Allocate a 2^n block, splitting a larger one if needed.
+// Returns 0 if there is none.  Caller holds kmem.lock.
+static char*
+buddyalloc(int n)
+{
+  struct run *r;
+  int m;
+
+  for(m = n; m <= MAXORDER && kmem.free[m] == 0; m++)
+    ;
+  if(m > MAXORDER)
+    return 0;
+  r = kmem.free[m];
+  buddyunlink(r, m);
+  while(m > n){
+    m--;
+    buddypush((struct run*)((char*)r + (PGSIZE << m)), m);
+  }
+  return (char*)r;
+}
+
+// This CPU's cache.  The caller may move to another CPU
+// afterwards; the cache's lock keeps that safe.
+static struct kcache*
+mycache(void)
+{
+  struct kcache *c;
+
+  pushcli();
+  c = &kmem.cache[cpu - cpus];
+  popcli();
+  return c;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -38,21 +234,197 @@ kinit(void)
 void
 kfree(char *v)
 {
+  struct kcache *c;
   struct run *r;
+  int i;
 
-  if((uint)v % PGSIZE || v < end || (uint)v >= PHYSTOP) 
+  if((uint)v % PGSIZE || v < end || (uint)v >= physstop) 
     panic("kfree");
 
+  // Still shared?  Only a page's own sharers raise its count,
+  // so a count of zero can't change under us.
+  if(kmem.ref[(uint)v / PGSIZE]){
+    acquire(&kmem.lock);
+    if(kmem.ref[(uint)v / PGSIZE]){
+      kmem.ref[(uint)v / PGSIZE]--;
+      release(&kmem.lock);
+      return;
+    }
+    release(&kmem.lock);
+  }
+
+  TRACE(TR_KFREE, (uint)v, 0);
+#ifdef KFREEJUNK
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  acquire(&kmem.lock);
+  c = mycache();
+  acquire(&c->lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->nfree > 2*KBATCH){
+    // Drain a batch to the buddy lists.
+    acquire(&kmem.lock);
+    for(i = 0; i < KBATCH; i++){
+      r = c->freelist;
+      c->freelist = r->next;
+      buddyfree((char*)r, 0);
+    }
+    release(&kmem.lock);
+    c->nfree -= KBATCH;
+  }
+  release(&c->lock);
+}
+
+// Add a sharer to the allocated page v.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || (uint)v >= physstop)
+    panic("kref");
+  acquire(&kmem.lock);
+  kmem.ref[(uint)v / PGSIZE]++;
+  release(&kmem.lock);
+}
+
+// Is the allocated page v shared with anyone?
+int
+kshared(char *v)
+{
+  return kmem.ref[(uint)v / PGSIZE] != 0;
+}
+
+// Take a page from the pre-zeroed pool, or 0 if it is empty.
+static char*
+kzeroedget(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  if((r = kmem.zeroed) != 0){
+    kmem.zeroed = r->next;
+    kmem.nzeroed--;
+  }
+  release(&kmem.lock);
+  if(r)
+    r->next = 0;  // the rest of the page is zero already
+  return (char*)r;
+}
+
+// Register a shrinker for a cache: fn(n) frees up to n pages
+// of the cache's clean, unreferenced objects, least recently
+// used first, and returns how many it freed.  It is called with
+// no spinlocks held and must not allocate.
+void
+kshrinker(char *name, int (*fn)(int))
+{
+  struct shrinker *s;
+
+  acquire(&kmem.lock);
+  if(kmem.nshrinker == NSHRINKER)
+    panic("kshrinker: too many");
+  s = &kmem.shrinker[kmem.nshrinker];
+  s->name = name;
+  s->fn = fn;
+  kmem.nshrinker++;
   release(&kmem.lock);
 }
 
+// Ask the shrinkers in turn for n pages in all.  They take
+// locks of their own, so do nothing if the caller holds a
+// spinlock or has interrupts off.  Returns the pages freed.
+static int
+kshrink(int n)
+{
+  struct shrinker *s;
+  int i, m, got;
+
+  if(!(readeflags() & FL_IF) || cpu->ncli > 0)
+    return 0;
+  got = 0;
+  for(i = 0; i < kmem.nshrinker && got < n; i++){
+    s = &kmem.shrinker[i];
+    m = s->fn(n - got);
+    acquire(&kmem.lock);
+    s->calls++;
+    s->freed += m;
+    release(&kmem.lock);
+    got += m;
+  }
+  return got;
+}
+
+// Fill in up to n shrinker counters; returns how many.
+int
+getshrinkstats(struct ShrinkStat *table, int n)
+{
+  struct shrinker *s;
+  int i;
+
+  acquire(&kmem.lock);
+  if(n > kmem.nshrinker)
+    n = kmem.nshrinker;
+  for(i = 0; i < n; i++){
+    s = &kmem.shrinker[i];
+    memset(&table[i], 0, sizeof(table[i]));
+    safestrcpy(table[i].name, s->name, sizeof(table[i].name));
+    table[i].calls = s->calls;
+    table[i].freed = s->freed;
+  }
+  release(&kmem.lock);
+  return n;
+}
+
+// Take a page from this CPU's cache, refilling it from the
+// buddy lists or else another CPU's cache.  Sets *low if the
+// buddy lists are running low.
+static struct run*
+kget(int *low)
+{
+  struct kcache *c, *o;
+  struct run *r;
+
+  c = mycache();
+  acquire(&c->lock);
+  if(c->freelist == 0){
+    // Refill a batch from the buddy lists.
+    acquire(&kmem.lock);
+    while(c->nfree < KBATCH && (r = (struct run*)buddyalloc(0)) != 0){
+      r->next = c->freelist;
+      c->freelist = r;
+      c->nfree++;
+    }
+    *low = kmem.nfree < kmem.low;
+    release(&kmem.lock);
+  }
+  if((r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->nfree--;
+  }
+  release(&c->lock);
+  if(r)
+    return r;
+
+  // Out of memory but for other CPUs' caches.
+  for(o = kmem.cache; o < kmem.cache + NCPU; o++){
+    if(o == c)
+      continue;
+    acquire(&o->lock);
+    if((r = o->freelist) != 0){
+      o->freelist = r->next;
+      o->nfree--;
+    }
+    release(&o->lock);
+    if(r)
+      break;
+  }
+  if(r == 0)
+    r = (struct run*)kzeroedget();
+  return r;
+}
+
 // Allocate one 4096-byte page of physical memory.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
@@ -60,12 +432,91 @@ char*
 kalloc(void)
 {
   struct run *r;
+  int low;
+
+  low = 0;
+  r = kget(&low);
+  if((r == 0 || low) && kshrink(KBATCH) > 0 && r == 0)
+    r = kget(&low);
+  TRACE(TR_KALLOC, (uint)r, 0);
+  return (char*)r;
+}
+
+// Allocate 2^n physically contiguous pages, aligned to their
+// size.  kalloc_order(0) is kalloc().  Returns 0 if there is no
+// free block that large.
+char*
+kalloc_order(int n)
+{
+  char *v;
 
+  if(n == 0)
+    return kalloc();
+  if(n < 0 || n > MAXORDER)
+    return 0;
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  v = buddyalloc(n);
   release(&kmem.lock);
-  return (char*)r;
+  if(v == 0 && kshrink(1 << n) > 0){
+    acquire(&kmem.lock);
+    v = buddyalloc(n);
+    release(&kmem.lock);
+  }
+  return v;
 }
 
+// Free a block returned by kalloc_order(n).
+void
+kfree_order(char *v, int n)
+{
+  if(n == 0){
+    kfree(v);
+    return;
+  }
+  if(n < 0 || n > MAXORDER || (uint)v % (PGSIZE << n) ||
+     v < end || (uint)v + (PGSIZE << n) > physstop)
+    panic("kfree_order");
+#ifdef KFREEJUNK
+  memset(v, 1, PGSIZE << n);
+#endif
+  acquire(&kmem.lock);
+  buddyfree(v, n);
+  release(&kmem.lock);
+}
+
+// Allocate a page of zeroes.  Returns 0 if the memory cannot
+// be allocated.
+char*
+kalloc_zeroed(void)
+{
+  char *v;
+
+  if((v = kzeroedget()) != 0){
+    TRACE(TR_KALLOC, (uint)v, 0);
+    return v;
+  }
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Clear one free page into the pre-zeroed pool, if it isn't
+// full.  Called by idle CPUs from the scheduler.  Returns 1 if
+// it cleared a page.
+int
+kzerofill(void)
+{
+  struct run *r;
+
+  if(kmem.nzeroed >= KZERO)
+    return 0;
+  if((r = (struct run*)kalloc()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  acquire(&kmem.lock);
+  r->next = kmem.zeroed;
+  kmem.zeroed = r;
+  kmem.nzeroed++;
+  release(&kmem.lock);
+  return 1;
+}
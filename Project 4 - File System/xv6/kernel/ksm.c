@@ -0,0 +1,209 @@
+// Same-page merging.
+//
+// Processes forked from one parent, or running one program,
+// often hold private pages with the same contents.  When turned
+// on with the ksm system call, the ksmd kernel thread looks for
+// such pages and maps a single copy of each in place of all,
+// copy-on-write, to free the rest.
+//
+// Every KSMTICKS ticks ksmd hashes the next KSMBATCH private
+// pages, which ksmscan (proc.c) hands it from processes that are
+// not running, holding ptable.lock so that they stay that way.
+// A page matching a merged ("stable") page is remapped to it.
+// One matching a page seen earlier in this pass becomes stable
+// itself, shared by both.  ksm holds a reference to each stable
+// page, so cowfault always copies it on a write and its
+// contents never change.  After each pass over all processes
+// ksmd forgets the pages it saw, and frees stable pages that
+// nobody maps any more.
+//
+// The tables are ksmd's own; ksm.lock guards on and the counters.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "ksm.h"
+
+#define KSMTICKS (HZ/10)  // ticks between batches
+#define KSMBATCH 256      // pages hashed per batch
+#define NSTABLE  512      // most merged pages kept
+#define NSEEN    521      // pages seen this pass, hashed
+
+struct stable {
+  uint hash;
+  char *pa;
+};
+
+struct seen {
+  uint hash;
+  int pid;               // 0 if unused
+  uint va;
+};
+
+struct {
+  struct spinlock lock;
+  int on;
+  struct stable stable[NSTABLE];
+  int nstable;
+  struct seen seen[NSEEN];
+  uint passes;
+  uint merged;
+} ksm __attribute__((aligned(CACHELINE)));
+
+// FNV-1a over the words of page pa.
+static uint
+pghash(char *pa)
+{
+  uint *w, h;
+
+  h = 2166136261U;
+  for(w = (uint*)pa; w < (uint*)(pa + PGSIZE); w++)
+    h = (h ^ *w) * 16777619U;
+  return h;
+}
+
+// A stable page with the same contents as pa, whose hash is h,
+// or 0.
+static char*
+stablefind(uint h, char *pa)
+{
+  struct stable *s;
+
+  for(s = ksm.stable; s < ksm.stable + ksm.nstable; s++)
+    if(s->hash == h && memcmp(s->pa, pa, PGSIZE) == 0)
+      return s->pa;
+  return 0;
+}
+
+// Map stable page spa at pte, in place of its page if another,
+// read-only and copy-on-write if it was writable.
+static void
+ksmmap(pte_t *pte, char *spa)
+{
+  char *pa;
+
+  pa = (char*)PTE_ADDR(*pte);
+  if(pa != spa)
+    kref(spa);
+  *pte = PADDR(spa) | (*pte & (PTE_P|PTE_U|PTE_COW)) |
+         (*pte & PTE_W ? PTE_COW : 0);
+  if(pa != spa){
+    kfree(pa);
+    acquire(&ksm.lock);
+    ksm.merged++;
+    release(&ksm.lock);
+  }
+}
+
+// Look at the private page at pte, va of process pid, and merge
+// it if it can be.  Called by ksmscan with ptable.lock held.
+void
+ksmpage(pte_t *pte, int pid, uint va)
+{
+  struct seen *s;
+  pte_t *opte;
+  char *pa, *spa;
+  uint h;
+
+  pa = (char*)PTE_ADDR(*pte);
+  h = pghash(pa);
+  if((spa = stablefind(h, pa)) != 0){
+    ksmmap(pte, spa);
+    return;
+  }
+
+  // The same as the last page seen with this hash, if that
+  // is still there?  Then it becomes stable for both.
+  s = &ksm.seen[h % NSEEN];
+  if(s->pid && s->hash == h && (s->pid != pid || s->va != va) &&
+     ksm.nstable < NSTABLE &&
+     (opte = ksmpte(s->pid, s->va)) != 0 &&
+     (spa = (char*)PTE_ADDR(*opte)) != pa && !kshared(spa) &&
+     memcmp(spa, pa, PGSIZE) == 0){
+    kref(spa);  // ksm's own
+    ksm.stable[ksm.nstable].hash = h;
+    ksm.stable[ksm.nstable].pa = spa;
+    ksm.nstable++;
+    ksmmap(opte, spa);
+    ksmmap(pte, spa);
+    s->pid = 0;
+    return;
+  }
+  s->hash = h;
+  s->pid = pid;
+  s->va = va;
+}
+
+// End of a pass: forget the pages seen, and free the stable
+// pages that only ksm holds.
+static void
+ksmpass(void)
+{
+  struct stable *s;
+
+  memset(ksm.seen, 0, sizeof(ksm.seen));
+  for(s = ksm.stable; s < ksm.stable + ksm.nstable; ){
+    if(kshared(s->pa)){
+      s++;
+      continue;
+    }
+    kfree(s->pa);
+    *s = ksm.stable[--ksm.nstable];
+  }
+  acquire(&ksm.lock);
+  ksm.passes++;
+  release(&ksm.lock);
+}
+
+// The merging thread.
+void
+ksmd(void *arg)
+{
+  for(;;){
+    sleepticks(KSMTICKS);
+    if(ksm.on && ksmscan(KSMBATCH))
+      ksmpass();
+  }
+}
+
+static void
+ksmkstat(struct kstatbuf *b)
+{
+  struct ksmstat st;
+
+  ksmctl(-1, &st);
+  kstatput(b, "on", 0, st.on);
+  kstatput(b, "passes", 0, st.passes);
+  kstatput(b, "stable", 0, st.stable);
+  kstatput(b, "merged", 0, st.merged);
+}
+
+void
+ksminit(void)
+{
+  initlock(&ksm.lock, "ksm");
+  kstatreg("ksm", ksmkstat);
+}
+
+// Turn merging on or off, unless on is -1, and fill in *st if
+// st isn't 0.  Returns whether it was on.
+int
+ksmctl(int on, struct ksmstat *st)
+{
+  int was;
+
+  acquire(&ksm.lock);
+  was = ksm.on;
+  if(on >= 0)
+    ksm.on = on != 0;
+  if(st){
+    st->on = ksm.on;
+    st->passes = ksm.passes;
+    st->stable = ksm.nstable;
+    st->merged = ksm.merged;
+  }
+  release(&ksm.lock);
+  return was;
+}
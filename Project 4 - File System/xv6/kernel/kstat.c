@@ -0,0 +1,205 @@
+// kstat device: every kernel counter in one read.
+//
+// Subsystems register a function with kstatreg as they start;
+// reading the device calls each in turn to print its counters,
+// one "name value" line apiece, with kstatput.  A name is the
+// subsystem's, then parts naming the counter, joined with dots:
+// "bcache.hits", "lock.ptable.contended", "syscall.5.calls".
+// Values are decimal.  A monitor reads the whole device with one
+// read, from offset 0, into a buffer of KSTATSIZE bytes; smaller
+// reads see it a piece at a time, though a fresh copy of the
+// counters each time.  Adding a counter changes no interface.
+//
+// Registering happens only while booting, before the other CPUs
+// start, so the table needs no lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "LockStat.h"
+#include "SyscallStat.h"
+
+#define KSTATORDER 2  // pages in the text and scratch buffers, as a kalloc_order
+#define KSTATSIZE (PGSIZE << KSTATORDER)
+
+struct kstatbuf {
+  char *buf;
+  int n;
+  char *prefix;  // Name of the subsystem printing
+  char *tmp;     // KSTATSIZE bytes of scratch for it
+};
+
+static struct {
+  char *name;
+  void (*fn)(struct kstatbuf*);
+} kstats[NKSTAT];
+static int nkstat;
+
+// Register fn to print subsystem name's counters.
+void
+kstatreg(char *name, void (*fn)(struct kstatbuf*))
+{
+  if(nkstat == NKSTAT)
+    panic("kstatreg: too many");
+  kstats[nkstat].name = name;
+  kstats[nkstat].fn = fn;
+  nkstat++;
+}
+
+static void
+putc(struct kstatbuf *b, char c)
+{
+  if(b->n < KSTATSIZE)
+    b->buf[b->n++] = c;
+}
+
+// Put part of a name, with any spaces made underscores so that
+// the name stays one word.
+static void
+putname(struct kstatbuf *b, char *s)
+{
+  for(; *s; s++)
+    putc(b, *s == ' ' ? '_' : *s);
+}
+
+// Format v in decimal into d, which has room for 11 bytes.
+static char*
+utoa(char *d, uint v)
+{
+  char *p;
+
+  p = d + 10;
+  *p = 0;
+  do
+    *--p = '0' + v % 10;
+  while((v /= 10) != 0);
+  return p;
+}
+
+// Print counter a.c of the current subsystem, or just a if c
+// is 0, with value v.  A line that doesn't fit is left out.
+void
+kstatput(struct kstatbuf *b, char *a, char *c, uint v)
+{
+  char d[11];
+  int n;
+
+  n = b->n;
+  putname(b, b->prefix);
+  putc(b, '.');
+  putname(b, a);
+  if(c){
+    putc(b, '.');
+    putname(b, c);
+  }
+  putc(b, ' ');
+  putname(b, utoa(d, v));
+  putc(b, '\n');
+  if(b->buf[b->n-1] != '\n')
+    b->n = n;
+}
+
+// Print counter i.c of the current subsystem, the ith of a set
+// of things, with value v.
+void
+kstatputi(struct kstatbuf *b, uint i, char *c, uint v)
+{
+  char d[11];
+
+  kstatput(b, utoa(d, i), c, v);
+}
+
+// Print histogram h of n buckets as counters a.i.k of the
+// current subsystem, for each bucket k that isn't empty.
+void
+kstathist(struct kstatbuf *b, char *a, uint i, uint *h, int n)
+{
+  char name[32], d[11];
+  int k;
+
+  safestrcpy(name, a, sizeof(name) - 12);
+  k = strlen(name);
+  name[k++] = '.';
+  safestrcpy(name + k, utoa(d, i), 11);
+  for(k = 0; k < n; k++)
+    if(h[k])
+      kstatput(b, name, utoa(d, k), h[k]);
+}
+
+// Scratch space for the current subsystem.
+void*
+kstattmp(struct kstatbuf *b)
+{
+  return b->tmp;
+}
+
+static int
+kstatread(struct inode *ip, char *dst, uint off, int n)
+{
+  struct kstatbuf b;
+  int i;
+
+  if((b.buf = kalloc_order(KSTATORDER)) == 0)
+    return -1;
+  if((b.tmp = kalloc_order(KSTATORDER)) == 0){
+    kfree_order(b.buf, KSTATORDER);
+    return -1;
+  }
+  b.n = 0;
+  for(i = 0; i < nkstat; i++){
+    b.prefix = kstats[i].name;
+    kstats[i].fn(&b);
+  }
+  if(off >= b.n)
+    n = 0;
+  else if(n > b.n - off)
+    n = b.n - off;
+  memmove(dst, b.buf + off, n);
+  kfree_order(b.tmp, KSTATORDER);
+  kfree_order(b.buf, KSTATORDER);
+  return n;
+}
+
+static void
+lockkstat(struct kstatbuf *b)
+{
+  struct LockStat *t;
+  int i, n;
+
+  t = kstattmp(b);
+  n = getlockstats(t, KSTATSIZE / sizeof(*t));
+  for(i = 0; i < n; i++){
+    kstatput(b, t[i].name, "acquires", t[i].acquires);
+    kstatput(b, t[i].name, "contended", t[i].contended);
+    kstatput(b, t[i].name, "kspin", t[i].spin >> 10);
+  }
+}
+
+static void
+syscallkstat(struct kstatbuf *b)
+{
+  struct SyscallStat *t;
+  int i, n;
+
+  t = kstattmp(b);
+  n = getsyscallstats(0, t, KSTATSIZE / sizeof(*t));
+  for(i = 0; i < n; i++){
+    if(t[i].count == 0)
+      continue;
+    kstatputi(b, i, "calls", t[i].count);
+    kstatputi(b, i, "kcycles", t[i].cycles >> 10);
+  }
+}
+
+void
+kstatinit(void)
+{
+  devsw[KSTAT].read = kstatread;
+  kstatreg("syscall", syscallkstat);
+  kstatreg("lock", lockkstat);
+}
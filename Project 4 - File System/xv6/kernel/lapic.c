@@ -3,6 +3,7 @@
 
 #include "types.h"
 #include "defs.h"
+#include "param.h"
 #include "traps.h"
 #include "mmu.h"
 #include "x86.h"
@@ -39,6 +40,7 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+static uint lapichz;   // Timer counts per second
 
 static void
 lapicw(int index, int value)
@@ -51,19 +53,26 @@ void
 lapicinit(int c)
 {
   cprintf("lapicinit: %d 0x%x\n", c, lapic);
-  if(!lapic) 
+  if(!lapic){
+    tsccalibrate(0);
     return;
+  }
 
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
   // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.  
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // from lapic[TICR] and then issues an interrupt.
+  // The first CPU up times the bus, and the TSC, against
+  // the PIT; the others share its bus.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000); 
+  if(lapichz == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 0xFFFFFFFF);
+    lapichz = tsccalibrate(&lapic[TCCR]);
+    cprintf("lapic timer %d kHz, tsc %d kHz\n", lapichz / 1000, tsckhz);
+  }
+  lapictick();
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -94,6 +103,30 @@ lapicinit(int c)
   lapicw(TPR, 0);
 }
 
+// Start this CPU's periodic clock tick.
+void
+lapictick(void)
+{
+  if(!lapic)
+    return;
+  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
+  lapicw(TICR, lapichz / HZ);
+}
+
+// Stop this CPU's tick while it idles: interrupt just once, n
+// ticks from now (as far off as the timer counts if that is too
+// far), or never if n is 0.  lapictick starts the tick again.
+void
+lapiconeshot(uint n)
+{
+  if(!lapic)
+    return;
+  if(n > 0xFFFFFFFF / (lapichz / HZ))
+    n = 0xFFFFFFFF / (lapichz / HZ);
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, n * (lapichz / HZ));
+}
+
 int
 cpunum(void)
 {
@@ -131,6 +164,27 @@ microdelay(int us)
 
 #define IO_RTC  0x70
 
+// Send the CPU with APIC id apicid an interrupt at vector.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Read CMOS register reg.
+uint
+cmosread(uint reg)
+{
+  outb(IO_RTC, reg);
+  microdelay(200);
+  return inb(IO_RTC+1);
+}
+
 // Start additional processor running bootstrap code at addr.
 // See Appendix B of MultiProcessor Specification.
 void
@@ -0,0 +1,135 @@
+// Latency tracer: the longest stretches with interrupts off and
+// with spinlocks held, and the call stacks that began them.
+//
+// While latencyon is set, the outermost pushcli that turns
+// interrupts off notes the time and its call stack in the cpu,
+// and the popcli that turns them back on hands the duration to
+// latnote; acquire and release do the same for each lock, with
+// the stack acquire already keeps in the lock.  latnote keeps
+// the NLATENCY longest, one entry per name and call site, so
+// one busy path doesn't crowd out the rest.  A duration no
+// longer than the shortest kept costs one compare.
+//
+// latnote runs with interrupts off, inside pushcli and acquire
+// themselves, so its table is guarded by busy, a bare xchg
+// lock, as lockstats is.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "LatStat.h"
+
+#define NLATKEY 3  // pcs that tell call sites apart
+
+static struct {
+  uint busy;
+  int n;
+  uint64 min;            // Shortest kept, once the table is full
+  struct LatStat stat[NLATENCY];
+} lat;
+
+int latencyon;
+
+// Stretch of cycles long, called name, that began at pcs.
+// Caller has interrupts off.
+void
+latnote(char *name, uint64 cycles, uint *pcs)
+{
+  struct LatStat *s, *e;
+  int i;
+
+  if(cycles <= lat.min)
+    return;
+  while(xchg(&lat.busy, 1) != 0)
+    pause();
+  e = 0;
+  for(s = lat.stat; s < lat.stat + lat.n; s++){
+    if(strncmp(s->name, name, sizeof(s->name) - 1) != 0)
+      continue;
+    for(i = 0; i < NLATKEY && s->pcs[i] == pcs[i]; i++)
+      ;
+    if(i == NLATKEY){
+      e = s;
+      break;
+    }
+  }
+  if(e == 0){
+    if(lat.n < NLATENCY)
+      e = &lat.stat[lat.n++];
+    else {
+      // Replace the shortest.
+      for(e = s = lat.stat; s < lat.stat + lat.n; s++)
+        if(s->max < e->max)
+          e = s;
+    }
+    safestrcpy(e->name, name, sizeof(e->name));
+    e->count = 0;
+    e->max = 0;
+    memmove(e->pcs, pcs, sizeof(e->pcs));
+  }
+  e->count++;
+  if(cycles > e->max){
+    e->max = cycles;
+    memmove(e->pcs, pcs, sizeof(e->pcs));
+  }
+  if(lat.n == NLATENCY){
+    lat.min = lat.stat[0].max;
+    for(s = lat.stat; s < lat.stat + lat.n; s++)
+      if(s->max < lat.min)
+        lat.min = s->max;
+  }
+  xchg(&lat.busy, 0);
+}
+
+// Turn tracing on, starting afresh, or off.
+// Returns whether it was on.
+int
+latencyctl(int on)
+{
+  int was;
+
+  pushcli();
+  while(xchg(&lat.busy, 1) != 0)
+    pause();
+  was = latencyon;
+  if(on && !was){
+    lat.n = 0;
+    lat.min = 0;
+  }
+  latencyon = on != 0;
+  xchg(&lat.busy, 0);
+  popcli();
+  return was;
+}
+
+// Copy up to n of the longest into table, longest first;
+// returns how many.
+int
+getlatency(struct LatStat *table, int n)
+{
+  struct LatStat all[NLATENCY], t;
+  int i, j, m;
+
+  pushcli();
+  while(xchg(&lat.busy, 1) != 0)
+    pause();
+  m = lat.n;
+  memmove(all, lat.stat, m * sizeof(all[0]));
+  xchg(&lat.busy, 0);
+  popcli();
+
+  for(i = 1; i < m; i++){
+    t = all[i];
+    for(j = i; j > 0 && all[j-1].max < t.max; j--)
+      all[j] = all[j-1];
+    all[j] = t;
+  }
+  if(n > m)
+    n = m;
+  memmove(table, all, n * sizeof(table[0]));
+  return n;
+}
@@ -10,6 +10,7 @@ static void mpmain(void);
 void jmpkstack(void)  __attribute__((noreturn));
 void mainc(void);
 static void cinit(void);
+static void sysenterinit(void);
 
 // Bootstrap processor starts running C code here.
 // Allocate a real stack and switch to it, first
@@ -21,6 +22,7 @@ main(void)
   lapicinit(mpbcpu());
   seginit();       // set up segments
   kinit();         // initialize memory allocator
+  slabinit();      // small object caches
   jmpkstack();       // call mainc() on a properly-allocated stack 
 }
 
@@ -46,14 +48,26 @@ mainc(void)
   picinit();       // interrupt controller
   ioapicinit();    // another interrupt controller
   consoleinit();   // I/O devices & their interrupts
+  kstatinit();     // kernel counters device
   uartinit();      // serial port
   kvmalloc();      // initialize the kernel page table
+  vdsoinit();      // kernel data pages for user space
   pinit();         // process table
+  rcuinit();       // lock-free lookups
   tvinit();        // trap vectors
+  profinit();      // sampling profiler
+  traceinit();     // tracepoints
   binit();         // buffer cache
   fileinit();      // file table
+  pcinit();        // page cache
   iinit();         // inode cache
+  blkinit();       // block layer
   ideinit();       // disk
+  swapinit();      // swap area
+  ksminit();       // same-page merging
+  ramdiskinit();   // RAM disk
+  netinit();       // network protocols
+  e1000init();     // network card
   if(!ismp)
     timerinit();   // uniprocessor timer
   bootothers();    // start other processors
@@ -62,6 +76,11 @@ mainc(void)
   cinit();
   sti();           // enable inturrupts
   userinit();      // first user process
+  workinit();      // per-CPU work queues
+  aioinit();       // asynchronous I/O threads
+  notifyinit();    // change notification
+  kthread_create("bflush", bflushd, 0); // buffer cache flusher
+  kthread_create("ksmd", ksmd, 0);      // same-page merging
   scheduler();     // start running processes
 }
 
@@ -75,6 +94,8 @@ cinit(void) {
   vmenable();        // turn on paging
   cprintf("cpu%d: starting\n", cpu->id);
   idtinit();       // load idt register
+  sysenterinit();  // fast system call entry
+  perfinit();      // performance counters
   xchg(&cpu->booted, 1); // tell bootothers() we're up
 }
 
@@ -88,14 +109,16 @@ mpmain(void)
    scheduler();     // start running processes
 }
 
-// Start the non-boot processors.
+// Start the non-boot processors, all at once, and wait
+// for them to come up.
 static void
 bootothers(void)
 {
   extern uchar _binary_bootother_start[], _binary_bootother_size[];
+  static char *stacks[NCPU];
   uchar *code;
   struct cpu *c;
-  char *stack;
+  int n;
 
   // Write bootstrap code to unused memory at 0x7000.
   // The linker has placed the image of bootother.S in
@@ -103,24 +126,48 @@ bootothers(void)
   code = (uchar*)0x7000;
   memmove(code, _binary_bootother_start, (uint)_binary_bootother_size);
 
+  // Give each CPU a stack.  bootother.S expects the stacks, the
+  // address of mpmain and a count of stacks taken stored just
+  // before its first instruction.
+  n = 0;
   for(c = cpus; c < cpus+ncpu; c++){
     if(c == cpus+cpunum())  // We've started already.
       continue;
+    if((stacks[n] = kalloc()) == 0)
+      panic("bootothers");
+    stacks[n++] += PGSIZE;
+  }
+  *(void**)(code-4) = stacks;
+  *(void**)(code-8) = mpmain;
+  *(uint*)(code-12) = 0;
 
-    // Tell bootother.S what stack to use and the address of mpmain;
-    // it expects to find these two addresses stored just before
-    // its first instruction.
-    stack = kalloc();
-    *(void**)(code-4) = stack + KSTACKSIZE;
-    *(void**)(code-8) = mpmain;
-
-    lapicstartap(c->id, (uint)code);
+  // Start them without waiting for each in turn, so their
+  // start-up delays and cinit()s overlap.
+  for(c = cpus; c < cpus+ncpu; c++)
+    if(c != cpus+cpunum())
+      lapicstartap(c->id, (uint)code);
 
-    // Wait for cpu to finish mpmain()
-    while(c->booted == 0)
+  // Wait for each cpu to finish cinit()
+  for(c = cpus; c < cpus+ncpu; c++)
+    while(c != cpus+cpunum() && c->booted == 0)
       ;
-  }
 }
 
 // Blank page.
 
+
+// Send sysenter to sysentry in trapasm.S.  switchuvm sets the
+// stack to each process's kernel stack.
+static void
+sysenterinit(void)
+{
+  extern char sysentry[];
+  uint edx;
+
+  cpuid(1, 0, 0, 0, &edx);
+  if(!(edx & CPUID_SEP))
+    panic("no sysenter");
+  wrmsr(MSR_SYSENTER_CS, SEG_KCODE << 3);
+  wrmsr(MSR_SYSENTER_EIP, (uint)sysentry);
+  wrmsr(MSR_SYSENTER_ESP, 0);
+}
@@ -1,8 +1,12 @@
 
 # Kernel objects
 KERNEL_OBJECTS := \
+	ahci.o\
+	aio.o\
 	bio.o\
+	blk.o\
 	console.o\
+	e1000.o\
 	exec.o\
 	file.o\
 	fs.o\
@@ -10,24 +14,46 @@ KERNEL_OBJECTS := \
 	ioapic.o\
 	kalloc.o\
 	kbd.o\
+	ksm.o\
+	kstat.o\
 	lapic.o\
+	latency.o\
+	log.o\
+	mmap.o\
 	main.o\
 	mp.o\
+	net.o\
+	notify.o\
+	pagecache.o\
+	pci.o\
+	perf.o\
 	picirq.o\
 	pipe.o\
+	poll.o\
 	proc.o\
+	prof.o\
+	ramdisk.o\
+	rcu.o\
+	slab.o\
+	sleeplock.o\
 	spinlock.o\
 	string.o\
+	swap.o\
 	swtch.o\
 	syscall.o\
 	sysfile.o\
 	sysproc.o\
 	timer.o\
+	trace.o\
 	trapasm.o\
 	trap.o\
 	uart.o\
+	usercopy.o\
+	vdso.o\
 	vectors.o\
+	virtio_blk.o\
 	vm.o\
+	work.o\
 
 KERNEL_OBJECTS := $(addprefix kernel/, $(KERNEL_OBJECTS))
 
@@ -60,10 +86,15 @@ KERNEL_CLEAN := \
 	kernel/kernel\
 	bootother\
 	initcode\
-	xv6.img
+	xv6.img\
+	xv6-release.img\
+	xv6-instrumented.img
 
 # add include dir to search path for headers
 KERNEL_CPPFLAGS += -I include
+# uncomment to fill freed pages with junk, to catch uses after kfree
+# (make PROFILE=instrumented does this)
+#KERNEL_CPPFLAGS += -DKFREEJUNK
 # do not search standard system paths for headers
 KERNEL_CPPFLAGS += -nostdinc
 # disable PIC (position independent code)
@@ -88,17 +119,18 @@ KERNEL_LDFLAGS += -nostdlib
 KERNEL_LDFLAGS += --omagic
 
 # bootable disk image
-xv6.img: kernel/bootblock kernel/kernel
-	dd if=/dev/zero of=xv6.img count=10000
-	dd if=kernel/bootblock of=xv6.img conv=notrunc
-	dd if=kernel/kernel of=xv6.img seek=1 conv=notrunc
+$(XV6IMG): kernel/bootblock kernel/kernel
+	dd if=/dev/zero of=$@ count=10000
+	dd if=kernel/bootblock of=$@ conv=notrunc
+	dd if=kernel/kernel of=$@ seek=1 conv=notrunc
 
 kernel/kernel:	\
-		$(KERNEL_OBJECTS) kernel/multiboot.o kernel/data.o bootother initcode
+		$(KERNEL_OBJECTS) kernel/multiboot.o kernel/data.o bootother initcode \
+		ramfs
 	$(LD) $(LDFLAGS) $(KERNEL_LDFLAGS) \
 		--section-start=.text=0x100000 --entry=main --output=kernel/kernel \
 		kernel/multiboot.o kernel/data.o $(KERNEL_OBJECTS) \
-		-b binary initcode bootother
+		-b binary initcode bootother ramfs
 
 # bootblock is optimized for space
 kernel/bootmain.o: kernel/bootmain.c
@@ -120,7 +152,7 @@ bootother: kernel/bootother.o
 
 initcode: kernel/initcode.o
 	$(LD) $(LDFLAGS) $(KERNEL_LDFLAGS) \
-		--entry=start --section-start=.text=0x0 \
+		--entry=start --section-start=.text=0x40000000 \
 		--output=kernel/initcode.out kernel/initcode.o
 	$(OBJCOPY) -S -O binary kernel/initcode.out $@
 
@@ -0,0 +1,191 @@
+// Memory-mapped files.
+//
+// mmap reserves a range of user addresses below the stack's
+// guard page (and below any earlier mapping) for a file region, without reading
+// anything.  The first touch of a page traps, and mmapfault maps
+// the page cache's page for it read-only, reading it in if need
+// be; past the end of the file a page is zeros.  A page shows
+// the file as of its first touch: a write to the file after that
+// goes to a new copy in the page cache (see pcwrite).
+//
+// Mappings last until exit or exec; there is no munmap, so the
+// address space they use is only freed up then.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "proc.h"
+#include "vdso.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "mman.h"
+
+// Return the mapping of p that holds address va, or 0.
+static struct vma*
+vmafind(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < p->vma + NVMA; v++)
+    if(v->f && va >= v->addr && va - v->addr < v->len)
+      return v;
+  return 0;
+}
+
+// Map len bytes of f starting at page-aligned offset off into
+// the current process.  Returns the address, or -1.
+int
+mmap(struct file *f, uint off, uint len)
+{
+  struct vma *v;
+  uint addr;
+
+  if(f->type != FD_INODE || !f->readable || f->ip->type == T_DEV)
+    return -1;
+  if(len == 0 || off % PGSIZE != 0 || len > USERTOP)
+    return -1;
+  addr = proc->mmapbase - PGROUNDUP(len);
+  if(addr > proc->mmapbase || addr < PGROUNDUP(proc->sz))
+    return -1;
+  for(v = proc->vma; v < proc->vma + NVMA; v++){
+    if(v->f == 0){
+      v->addr = addr;
+      v->len = len;
+      v->off = off;
+      v->seq = 0;
+      v->raend = 0;
+      v->f = filedup(f);
+      proc->mmapbase = addr;
+      return addr;
+    }
+  }
+  return -1;
+}
+
+// Read in the page of a mapping holding va, if p has one there.
+// Returns -1 if va isn't mapped by mmap or the page is already
+// present (a write to a read-only page), or out of memory.
+int
+mmapfault(struct proc *p, uint va)
+{
+  struct vma *v;
+  char *mem;
+  uint a, off;
+  int major;
+
+  if((v = vmafind(p, va)) == 0)
+    return -1;
+  a = (uint)PGROUNDDOWN(va);
+  if(uva2ka(p->pgdir, (char*)a) != 0)
+    return -1;
+  off = v->off + (a - v->addr);
+  major = 0;
+  ilockshared(v->f->ip);
+  if(off >= v->f->ip->size)
+    mem = uvmpage(1);
+  else
+    mem = pcget(v->f->ip, off / PGSIZE, &major);
+
+  // Sequential: keep NMRAHEAD pages in flight ahead of the faults.
+  if(v->seq){
+    if(v->raend < off + PGSIZE)
+      v->raend = off + PGSIZE;
+    if(v->raend < off + NMRAHEAD*PGSIZE){
+      ireadahead(v->f->ip, v->raend, off + NMRAHEAD*PGSIZE - v->raend);
+      v->raend = off + NMRAHEAD*PGSIZE;
+    }
+  }
+  iunlock(v->f->ip);
+  if(mem == 0)
+    return -1;
+  if(mapuvm(p->pgdir, a, mem, 0) < 0){
+    kfree(mem);
+    return -1;
+  }
+  uvmfault(p, major);
+  return 0;
+}
+
+// The mapping of p that holds all of [va, va+n), or 0.
+struct vma*
+mmapvma(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  if((v = vmafind(p, va)) == 0 || n > v->len - (va - v->addr))
+    return 0;
+  return v;
+}
+
+// Take advice for [va, va+n) of mapping v, except MADV_DONTNEED,
+// which madvise does.  Returns -1 if advice is unknown.
+int
+mmapadvise(struct vma *v, uint va, uint n, int advice)
+{
+  switch(advice){
+  case MADV_NORMAL:
+  case MADV_SEQUENTIAL:
+    v->seq = advice == MADV_SEQUENTIAL;
+    v->raend = 0;
+    return 0;
+  case MADV_WILLNEED:
+    // Only a window of it: each block read ahead holds a buffer.
+    if(n > NRAMAX*BSIZE)
+      n = NRAMAX*BSIZE;
+    ilockshared(v->f->ip);
+    ireadahead(v->f->ip, v->off + (va - v->addr), n);
+    iunlock(v->f->ip);
+    return 0;
+  }
+  return -1;
+}
+
+// Check that [va, va+n) lies in one mapping of p and read in
+// its pages, so the kernel can use it as a system call buffer
+// without faulting.
+int
+mmapcheck(struct proc *p, uint va, uint n)
+{
+  uint a;
+
+  if(mmapvma(p, va, n) == 0)
+    return -1;
+  for(a = (uint)PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+    if(uva2ka(p->pgdir, (char*)a) == 0 && mmapfault(p, a) < 0)
+      return -1;
+  return 0;
+}
+
+// Give child np the mappings of p.  Its pages are read in
+// again on first touch.
+void
+mmapfork(struct proc *np, struct proc *p)
+{
+  int i;
+
+  np->mmapbase = p->mmapbase;
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(np->vma[i].f)
+      filedup(np->vma[i].f);
+  }
+}
+
+// Drop all of p's mappings.  Their pages belong to p's page
+// table, so freevm frees them.
+void
+mmapclear(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < p->vma + NVMA; v++){
+    if(v->f){
+      fileclose(v->f);
+      v->f = 0;
+    }
+  }
+  p->mmapbase = MMAPTOP;
+}
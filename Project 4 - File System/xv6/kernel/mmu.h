@@ -39,6 +39,16 @@
 #define CR0_CD		0x40000000	// Cache Disable
 #define CR0_PG		0x80000000	// Paging
 
+#define CR4_PSE		0x00000010	// Page Size Extensions (4 MB pages)
+#define CR4_PCE		0x00000100	// rdpmc allowed in user mode
+
+// Model-specific registers for sysenter
+#define MSR_SYSENTER_CS		0x174
+#define MSR_SYSENTER_ESP	0x175
+#define MSR_SYSENTER_EIP	0x176
+
+#define CPUID_SEP	0x00000800	// sysenter/sysexit, in cpuid 1 %edx
+
 // Segment Descriptor
 struct segdesc {
   uint lim_15_0 : 16;  // Low bits of segment limit
@@ -117,7 +127,10 @@ struct segdesc {
 #define NPTENTRIES	1024		// page table entries per page table
 
 #define PGSIZE		4096		// bytes mapped by a page
+#define LPGSIZE		(NPTENTRIES*PGSIZE) // bytes mapped by a PTE_PS page directory entry
+#define LPGORDER	10		// log2(LPGSIZE/PGSIZE), for kalloc_order
 #define PGSHIFT		12		// log2(PGSIZE)
+#define CACHELINE	64		// bytes in a cache line
 
 #define PTXSHIFT	12		// offset of PTX in a linear address
 #define PDXSHIFT	22		// offset of PDX in a linear address
@@ -135,11 +148,23 @@ struct segdesc {
 #define PTE_D		0x040	// Dirty
 #define PTE_PS		0x080	// Page Size
 #define PTE_MBZ		0x180	// Bits must be zero
+#define PTE_COW		0x200	// Copy-on-write (software, available bit)
+#define PTE_SWAP	0x400	// Not present: swapped out (software; see swap.c)
+
+// A swapped-out user page's PTE: its swap slot where the
+// address was, and the permissions it had.
+#define SWAPPTE(slot, pte) \
+  ((uint)(slot) << PTXSHIFT | PTE_SWAP | ((pte) & (PTE_W|PTE_U|PTE_COW)))
+#define PTE_SLOT(pte)	((uint)(pte) >> PTXSHIFT)
+
+// Page fault error code bits
+#define FEC_PR		0x1	// Page fault caused by protection violation
+#define FEC_WR		0x2	// Page fault caused by a write
+#define FEC_U		0x4	// Page fault occured while in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)	((uint)(pte) & ~0xFFF)
 
-typedef uint pte_t;
 
 // Task state segment format
 struct taskstate {
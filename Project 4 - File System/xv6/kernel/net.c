@@ -0,0 +1,596 @@
+// Network protocols: UDP over IPv4 over Ethernet, with ARP.
+//
+// Frames come up from the driver in whole kalloc() pages, one
+// frame at the start of each, and belong to netrx from then on.
+// A UDP datagram stays in its page on the socket's queue until a
+// reader copies it out, and a datagram being sent is built in a
+// page the driver frees once it is on the wire, so the payload
+// is copied once on each side, to or from the user's buffer.
+//
+// The address is QEMU's user network default.  Datagrams to it
+// or to 127.0.0.0/8 loop back without reaching the NIC.
+// Fragmented IP packets are dropped.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "spinlock.h"
+#include "poll.h"
+#include "socket.h"
+
+#define NETADDR  IPADDR(10, 0, 2, 15)
+#define NETMASK  IPADDR(255, 255, 255, 0)
+#define GATEWAY  IPADDR(10, 0, 2, 2)
+
+#define ETH_IP   0x0800
+#define ETH_ARP  0x0806
+#define IP_UDP   17
+#define IP_DF    0x4000
+#define ARP_REQ  1
+#define ARP_REP  2
+
+#define NARP     16     // ARP cache entries
+#define NSOCKQ   32     // datagrams a socket holds unread
+#define EPHEMERAL 49152 // first port given to unbound sockets
+
+struct eth {
+  uchar dst[6];
+  uchar src[6];
+  ushort type;
+} __attribute__((packed));
+
+struct ip {
+  uchar vhl;      // version << 4 | header length in words
+  uchar tos;
+  ushort len;
+  ushort id;
+  ushort off;     // flags and fragment offset
+  uchar ttl;
+  uchar proto;
+  ushort sum;
+  uint src;
+  uint dst;
+} __attribute__((packed));
+
+struct udp {
+  ushort sport;
+  ushort dport;
+  ushort len;
+  ushort sum;
+} __attribute__((packed));
+
+struct arp {
+  ushort hrd;
+  ushort pro;
+  uchar hln;
+  uchar pln;
+  ushort op;
+  uchar sha[6];
+  uint sip;
+  uchar tha[6];
+  uint tip;
+} __attribute__((packed));
+
+#define UDPHDR (sizeof(struct eth) + sizeof(struct ip) + sizeof(struct udp))
+
+// A received datagram: its page, where in it the data is, and
+// who sent it.
+struct dgram {
+  char *pg;
+  ushort off;
+  ushort len;
+  uint addr;
+  ushort port;
+};
+
+struct sock {
+  struct sock *next;   // on net.socks
+  ushort lport;        // bound port, 0 if none yet
+  uint raddr;          // connected peer, 0 if none
+  ushort rport;
+  struct dgram q[NSOCKQ];  // received, oldest at qhead
+  uint qhead;
+  uint qn;
+  struct pollent *pollq;
+};
+
+// What an IP address resolves to, and one packet waiting on
+// the answer.
+struct arpent {
+  uint ip;
+  uchar mac[6];
+  char valid;
+  char *pending;
+  int plen;
+};
+
+static struct {
+  struct spinlock lock;  // everything below, and every sock
+  struct kmem_cache *cache;
+  struct sock *socks;
+  ushort nextport;
+  ushort ipid;
+  struct arpent arp[NARP];
+  uint arpnext;          // entry to replace next
+  uint rx;               // frames received
+  uint tx;               // frames sent
+  uint dropped;          // frames received that nothing wanted
+} net __attribute__((aligned(CACHELINE)));
+
+static uchar bcastmac[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+static ushort
+htons(ushort x)
+{
+  return x << 8 | x >> 8;
+}
+
+static uint
+htonl(uint x)
+{
+  return x << 24 | (x & 0xff00) << 8 | (x >> 8 & 0xff00) | x >> 24;
+}
+
+#define ntohs htons
+#define ntohl htonl
+
+static ushort
+cksum(void *p, int n)
+{
+  ushort *w;
+  uint sum;
+
+  sum = 0;
+  for(w = p; n > 1; n -= 2)
+    sum += *w++;
+  if(n)
+    sum += *(uchar*)w;
+  while(sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
+
+static int
+isloop(uint addr)
+{
+  return (addr >> 24) == 127 || addr == NETADDR;
+}
+
+void
+netinit(void)
+{
+  initlock(&net.lock, "net");
+  net.cache = kmem_cache_create("sock", sizeof(struct sock));
+  net.nextport = EPHEMERAL;
+}
+
+// Send the len-byte frame in pg, whose IP header is filled in,
+// towards IP address dst.  Takes pg.
+static int
+ethout(char *pg, int len, uint dst)
+{
+  struct eth *eth;
+  struct arp *a;
+  struct arpent *e;
+  char *req;
+  uint hop;
+  int i;
+
+  eth = (struct eth*)pg;
+  memmove(eth->src, e1000mac, 6);
+  eth->type = htons(ETH_IP);
+  if(isloop(dst)){
+    memmove(eth->dst, e1000mac, 6);
+    netrx(pg, len);
+    return 0;
+  }
+  if(dst == INADDR_BROADCAST){
+    memmove(eth->dst, bcastmac, 6);
+    goto send;
+  }
+
+  hop = (dst & NETMASK) == (NETADDR & NETMASK) ? dst : GATEWAY;
+  acquire(&net.lock);
+  for(i = 0; i < NARP; i++)
+    if(net.arp[i].ip == hop)
+      break;
+  if(i < NARP && net.arp[i].valid){
+    memmove(eth->dst, net.arp[i].mac, 6);
+    release(&net.lock);
+    goto send;
+  }
+  // Hold the packet, replacing any already held, and ask.
+  if(i == NARP){
+    i = net.arpnext++ % NARP;
+    net.arp[i].ip = hop;
+    net.arp[i].valid = 0;
+  }
+  e = &net.arp[i];
+  if(e->pending)
+    kfree(e->pending);
+  e->pending = pg;
+  e->plen = len;
+  release(&net.lock);
+
+  if((req = kalloc()) == 0)
+    return 0;
+  eth = (struct eth*)req;
+  memmove(eth->dst, bcastmac, 6);
+  memmove(eth->src, e1000mac, 6);
+  eth->type = htons(ETH_ARP);
+  a = (struct arp*)(eth + 1);
+  a->hrd = htons(1);
+  a->pro = htons(ETH_IP);
+  a->hln = 6;
+  a->pln = 4;
+  a->op = htons(ARP_REQ);
+  memmove(a->sha, e1000mac, 6);
+  a->sip = htonl(NETADDR);
+  memset(a->tha, 0, 6);
+  a->tip = htonl(hop);
+  if(e1000tx(req, sizeof(*eth) + sizeof(*a)) < 0)
+    kfree(req);
+  return 0;
+
+send:
+  if(e1000tx(pg, len) < 0){
+    kfree(pg);
+    return -1;
+  }
+  acquire(&net.lock);
+  net.tx++;
+  release(&net.lock);
+  return 0;
+}
+
+// Learn that ip is at mac, and send what was waiting on it.
+static void
+arpset(uint ip, uchar *mac)
+{
+  char *pg;
+  int i, len;
+
+  pg = 0;
+  len = 0;
+  acquire(&net.lock);
+  for(i = 0; i < NARP; i++){
+    if(net.arp[i].ip == ip){
+      memmove(net.arp[i].mac, mac, 6);
+      net.arp[i].valid = 1;
+      pg = net.arp[i].pending;
+      len = net.arp[i].plen;
+      net.arp[i].pending = 0;
+      break;
+    }
+  }
+  release(&net.lock);
+  if(pg){
+    memmove(((struct eth*)pg)->dst, mac, 6);
+    if(e1000tx(pg, len) < 0)
+      kfree(pg);
+  }
+}
+
+// Handle an ARP frame in pg: answer a request for our address,
+// sending the answer in pg itself.
+static void
+arpin(char *pg, int len)
+{
+  struct eth *eth;
+  struct arp *a;
+
+  eth = (struct eth*)pg;
+  a = (struct arp*)(eth + 1);
+  if(len < sizeof(*eth) + sizeof(*a) || ntohs(a->pro) != ETH_IP){
+    kfree(pg);
+    return;
+  }
+  arpset(ntohl(a->sip), a->sha);
+  if(ntohs(a->op) != ARP_REQ || ntohl(a->tip) != NETADDR){
+    kfree(pg);
+    return;
+  }
+  a->op = htons(ARP_REP);
+  memmove(a->tha, a->sha, 6);
+  a->tip = a->sip;
+  memmove(a->sha, e1000mac, 6);
+  a->sip = htonl(NETADDR);
+  memmove(eth->dst, a->tha, 6);
+  memmove(eth->src, e1000mac, 6);
+  if(e1000tx(pg, sizeof(*eth) + sizeof(*a)) < 0)
+    kfree(pg);
+}
+
+// The socket bound to port.  Caller holds net.lock.
+static struct sock*
+socklookup(ushort port)
+{
+  struct sock *s;
+
+  for(s = net.socks; s; s = s->next)
+    if(s->lport == port)
+      return s;
+  return 0;
+}
+
+// Queue the UDP datagram in pg on the socket it is for.
+static void
+udpin(char *pg, int len)
+{
+  struct ip *ip;
+  struct udp *u;
+  struct sock *s;
+  struct dgram *d;
+  int n;
+
+  ip = (struct ip*)(pg + sizeof(struct eth));
+  u = (struct udp*)(ip + 1);
+  n = ntohs(u->len);
+  if(len < UDPHDR || n < sizeof(*u) || UDPHDR + n - sizeof(*u) > len)
+    goto drop;
+  acquire(&net.lock);
+  if((s = socklookup(ntohs(u->dport))) == 0 || s->qn == NSOCKQ){
+    release(&net.lock);
+    goto drop;
+  }
+  d = &s->q[(s->qhead + s->qn++) % NSOCKQ];
+  d->pg = pg;
+  d->off = UDPHDR;
+  d->len = n - sizeof(*u);
+  d->addr = ntohl(ip->src);
+  d->port = ntohs(u->sport);
+  wakeup(s);
+  pollwake(s->pollq);
+  release(&net.lock);
+  return;
+
+drop:
+  acquire(&net.lock);
+  net.dropped++;
+  release(&net.lock);
+  kfree(pg);
+}
+
+// Take the len-byte frame at the start of page pg.
+void
+netrx(char *pg, int len)
+{
+  struct eth *eth;
+  struct ip *ip;
+  uint dst;
+
+  acquire(&net.lock);
+  net.rx++;
+  release(&net.lock);
+
+  eth = (struct eth*)pg;
+  if(len >= sizeof(*eth) && ntohs(eth->type) == ETH_ARP){
+    arpin(pg, len);
+    return;
+  }
+  ip = (struct ip*)(eth + 1);
+  if(len < sizeof(*eth) + sizeof(*ip) || ntohs(eth->type) != ETH_IP ||
+     ip->vhl != 0x45 || (ntohs(ip->off) & ~IP_DF) != 0 ||
+     ip->proto != IP_UDP || sizeof(*eth) + ntohs(ip->len) > len)
+    goto drop;
+  dst = ntohl(ip->dst);
+  if(!isloop(dst) && dst != INADDR_BROADCAST)
+    goto drop;
+  udpin(pg, sizeof(*eth) + ntohs(ip->len));
+  return;
+
+drop:
+  acquire(&net.lock);
+  net.dropped++;
+  release(&net.lock);
+  kfree(pg);
+}
+
+// Give s a port no other socket has, if it has none.
+// Caller holds net.lock.
+static int
+autobind(struct sock *s)
+{
+  int i;
+
+  for(i = 0; s->lport == 0 && i < 65536 - EPHEMERAL; i++){
+    if(socklookup(net.nextport) == 0)
+      s->lport = net.nextport;
+    if(++net.nextport == 0)
+      net.nextport = EPHEMERAL;
+  }
+  return s->lport ? 0 : -1;
+}
+
+// Allocate a socket and a file for it.
+int
+sockalloc(struct file **f)
+{
+  struct sock *s;
+
+  if((*f = filealloc()) == 0)
+    return -1;
+  if((s = kmem_cache_alloc(net.cache)) == 0){
+    fileclose(*f);
+    return -1;
+  }
+  memset(s, 0, sizeof(*s));
+  acquire(&net.lock);
+  s->next = net.socks;
+  net.socks = s;
+  release(&net.lock);
+  (*f)->type = FD_SOCK;
+  (*f)->readable = 1;
+  (*f)->writable = 1;
+  (*f)->sock = s;
+  return 0;
+}
+
+// Free s and whatever it still holds.
+void
+sockclose(struct sock *s)
+{
+  struct sock **sp;
+
+  acquire(&net.lock);
+  for(sp = &net.socks; *sp != s; sp = &(*sp)->next)
+    ;
+  *sp = s->next;
+  release(&net.lock);
+  for(; s->qn > 0; s->qn--)
+    kfree(s->q[s->qhead++ % NSOCKQ].pg);
+  kmem_cache_free(net.cache, s);
+}
+
+// Receive datagrams sent to port, or to a free port if 0.
+int
+sockbind(struct sock *s, int port)
+{
+  int r;
+
+  if(port < 0 || port > 0xffff)
+    return -1;
+  acquire(&net.lock);
+  if(s->lport != 0 || (port != 0 && socklookup(port) != 0))
+    r = -1;
+  else if(port == 0)
+    r = autobind(s);
+  else {
+    s->lport = port;
+    r = 0;
+  }
+  release(&net.lock);
+  return r;
+}
+
+// Send datagrams with no address given to addr:port.
+int
+sockconnect(struct sock *s, uint addr, int port)
+{
+  int r;
+
+  if(addr == INADDR_ANY || port <= 0 || port > 0xffff)
+    return -1;
+  acquire(&net.lock);
+  s->raddr = addr;
+  s->rport = port;
+  r = autobind(s);
+  release(&net.lock);
+  return r;
+}
+
+// Send the iovcnt buffers in iov, which are user addresses, as
+// one datagram to addr:port, or to the connected peer if addr
+// is 0.  Returns its length.
+int
+socksend(struct sock *s, struct iovec *iov, int iovcnt, uint addr, int port)
+{
+  struct ip *ip;
+  struct udp *u;
+  char *pg;
+  int i, n;
+
+  for(n = i = 0; i < iovcnt; i++)
+    n += iov[i].iov_len;
+  if(n > UDP_MAXDATA)
+    return -1;
+  acquire(&net.lock);
+  if(addr == INADDR_ANY){
+    addr = s->raddr;
+    port = s->rport;
+  }
+  if(addr == INADDR_ANY || port <= 0 || port > 0xffff || autobind(s) < 0){
+    release(&net.lock);
+    return -1;
+  }
+  ip = 0;
+  u = 0;
+  if((pg = kalloc()) != 0){
+    ip = (struct ip*)(pg + sizeof(struct eth));
+    u = (struct udp*)(ip + 1);
+    u->sport = htons(s->lport);
+    ip->id = htons(net.ipid++);
+  }
+  release(&net.lock);
+  if(pg == 0)
+    return -1;
+
+  for(n = i = 0; i < iovcnt; i++){
+    memmove(pg + UDPHDR + n, iov[i].iov_base, iov[i].iov_len);
+    n += iov[i].iov_len;
+  }
+  u->dport = htons(port);
+  u->len = htons(sizeof(*u) + n);
+  u->sum = 0;  // optional over IPv4
+  ip->vhl = 0x45;
+  ip->tos = 0;
+  ip->len = htons(sizeof(*ip) + sizeof(*u) + n);
+  ip->off = htons(IP_DF);
+  ip->ttl = 64;
+  ip->proto = IP_UDP;
+  ip->src = htonl(isloop(addr) ? addr : NETADDR);
+  ip->dst = htonl(addr);
+  ip->sum = 0;
+  ip->sum = cksum(ip, sizeof(*ip));
+  if(ethout(pg, UDPHDR + n, addr) < 0)
+    return -1;
+  return n;
+}
+
+// Receive one datagram into the iovcnt buffers in iov, which
+// are user addresses, waiting for one unless nonblock.  Whatever
+// doesn't fit is dropped.  Sets *addr and *port to the sender;
+// returns the bytes received.
+int
+sockrecv(struct sock *s, struct iovec *iov, int iovcnt, uint *addr,
+         ushort *port, int nonblock)
+{
+  struct dgram d;
+  int i, m, n;
+
+  acquire(&net.lock);
+  while(s->qn == 0){
+    if(nonblock || proc->killed){
+      release(&net.lock);
+      return -1;
+    }
+    sleep(s, &net.lock);
+  }
+  d = s->q[s->qhead++ % NSOCKQ];
+  s->qn--;
+  release(&net.lock);
+
+  for(n = i = 0; i < iovcnt && n < d.len; i++){
+    m = d.len - n < iov[i].iov_len ? d.len - n : iov[i].iov_len;
+    memmove(iov[i].iov_base, d.pg + d.off + n, m);
+    n += m;
+  }
+  kfree(d.pg);
+  if(addr)
+    *addr = d.addr;
+  if(port)
+    *port = d.port;
+  return n;
+}
+
+// Whether s has a datagram to read; a socket can always send.
+// See filepoll.
+int
+sockpoll(struct sock *s, int events, struct pollent *e)
+{
+  int r;
+
+  r = events & POLLOUT;
+  acquire(&net.lock);
+  if(s->qn > 0)
+    r |= events & POLLIN;
+  if(r == 0 && e)
+    pollwait(&s->pollq, &net.lock, e);
+  release(&net.lock);
+  return r;
+}
@@ -0,0 +1,192 @@
+// Change notification.
+//
+// notify_open makes a notify file that reports the file system
+// changes in its mask: names made and removed, file data
+// written, and tags set and removed.  Reading it gives a struct
+// notifyevent for each, oldest first, and poll says POLLIN while
+// there is one.  So a program keeping an index of tagged files
+// can follow the changes instead of rescanning every file.
+//
+// Each notify file has a ring of NNOTIFYEV events.  When only
+// one slot is left, a NOTE_OVERFLOW event takes it and later
+// events are dropped until the reader has taken that one; the
+// reader then knows to rescan.  A write to a file whose write
+// is already the newest event isn't queued again, so a run of
+// writes costs one slot.
+//
+// notify() is called with inodes locked, so it takes only
+// spinlocks.  Lock order: notifies.lock, then ptable.lock
+// (pollwake).
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "poll.h"
+#include "notify.h"
+
+struct notifyctx {
+  struct notifyctx *next;  // On notifies.list
+  int mask;                // NOTE_* to report
+  int overflow;            // NOTE_OVERFLOW is queued
+  uint head;               // Next event to read
+  uint n;                  // Events queued
+  struct pollent *pollq;
+  struct notifyevent ev[NNOTIFYEV];
+};
+
+static struct {
+  struct spinlock lock;
+  struct notifyctx *list;
+} notifies __attribute__((aligned(CACHELINE)));
+
+void
+notifyinit(void)
+{
+  initlock(&notifies.lock, "notify");
+}
+
+// Make a notify file in *f reporting the events in mask.
+int
+notifyalloc(struct file **f, int mask)
+{
+  struct notifyctx *ctx;
+
+  if((mask & ~NOTE_ALL) || mask == 0)
+    return -1;
+  if((*f = filealloc()) == 0)
+    return -1;
+  if((ctx = (struct notifyctx*)kalloc()) == 0){
+    fileclose(*f);
+    return -1;
+  }
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->mask = mask;
+  (*f)->type = FD_NOTIFY;
+  (*f)->readable = 1;
+  (*f)->notify = ctx;
+  acquire(&notifies.lock);
+  ctx->next = notifies.list;
+  notifies.list = ctx;
+  release(&notifies.lock);
+  return 0;
+}
+
+void
+notifyclose(struct notifyctx *ctx)
+{
+  struct notifyctx **pp;
+
+  acquire(&notifies.lock);
+  for(pp = &notifies.list; *pp != ctx; pp = &(*pp)->next)
+    ;
+  *pp = ctx->next;
+  release(&notifies.lock);
+  kfree((char*)ctx);
+}
+
+// Queue e on ctx.  Caller holds notifies.lock.
+static void
+notifyput(struct notifyctx *ctx, struct notifyevent *e)
+{
+  struct notifyevent *last;
+
+  if(ctx->overflow)
+    return;
+  last = &ctx->ev[(ctx->head + ctx->n - 1) % NNOTIFYEV];
+  if(e->type == NOTE_WRITE && ctx->n > 0 &&
+     last->type == NOTE_WRITE && last->inum == e->inum)
+    return;
+  if(ctx->n == NNOTIFYEV - 1){
+    e = &ctx->ev[(ctx->head + ctx->n) % NNOTIFYEV];
+    memset(e, 0, sizeof(*e));
+    e->type = NOTE_OVERFLOW;
+    ctx->overflow = 1;
+  } else
+    ctx->ev[(ctx->head + ctx->n) % NNOTIFYEV] = *e;
+  ctx->n++;
+  wakeup(ctx);
+  pollwake(ctx->pollq);
+}
+
+// Report a change of type to inode inum to the notify files
+// watching for it.  name is a tag key or, with directory dir, a
+// name in it; it may be 0.
+void
+notify(int type, uint inum, uint dir, char *name)
+{
+  struct notifyctx *ctx;
+  struct notifyevent e;
+
+  if(notifies.list == 0)
+    return;
+  memset(&e, 0, sizeof(e));
+  e.type = type;
+  e.inum = inum;
+  e.dir = dir;
+  if(name)  // a name in a directory may fill all DIRSIZ bytes
+    strncpy(e.name, name, dir ? DIRSIZ : sizeof(e.name) - 1);
+  acquire(&notifies.lock);
+  for(ctx = notifies.list; ctx; ctx = ctx->next)
+    if(ctx->mask & type)
+      notifyput(ctx, &e);
+  release(&notifies.lock);
+}
+
+// Read events into dst, up to n bytes' worth.  Waits for one
+// unless nonblock is set.  Returns the bytes of events read, or
+// -1.
+int
+notifyread(struct notifyctx *ctx, char *dst, int n, int nonblock)
+{
+  struct notifyevent ev[8];
+  int m, max, tot;
+
+  max = n / sizeof(ev[0]);
+  if(max == 0)
+    return -1;
+  acquire(&notifies.lock);
+  while(ctx->n == 0){
+    if(nonblock || proc->killed){
+      release(&notifies.lock);
+      return -1;
+    }
+    sleep(ctx, &notifies.lock);
+  }
+  // Take a few at a time, and copy them out without the lock, as
+  // the caller's pages may fault.
+  for(tot = 0; tot < max && ctx->n > 0; tot += m){
+    for(m = 0; m < NELEM(ev) && tot + m < max && ctx->n > 0; m++){
+      ev[m] = ctx->ev[ctx->head];
+      if(ev[m].type == NOTE_OVERFLOW)
+        ctx->overflow = 0;
+      ctx->head = (ctx->head + 1) % NNOTIFYEV;
+      ctx->n--;
+    }
+    release(&notifies.lock);
+    memmove(dst + tot*sizeof(ev[0]), ev, m*sizeof(ev[0]));
+    acquire(&notifies.lock);
+  }
+  release(&notifies.lock);
+  return tot * sizeof(ev[0]);
+}
+
+int
+notifypoll(struct notifyctx *ctx, int events, struct pollent *e)
+{
+  int r;
+
+  r = 0;
+  acquire(&notifies.lock);
+  if(ctx->n > 0)
+    r |= events & POLLIN;
+  if(r == 0 && e)
+    pollwait(&ctx->pollq, &notifies.lock, e);
+  release(&notifies.lock);
+  return r;
+}
@@ -0,0 +1,289 @@
+// Page cache: the data of regular files in whole pages.
+//
+// readi copies file data out of these pages, and mmap and exec
+// map them into user space as they are, so a program's text is
+// one set of pages shared by every process running it and by
+// the page cache.  The buffer cache still holds the file's
+// blocks while a page is read in or written, but hands them
+// back for reuse first.
+//
+// Pages are found by (dev, inum, page index) through a hash
+// table.  The cache holds one reference to each of its pages
+// (see kref); a page nobody else references can be replaced,
+// least recently used first.  Writes go to the blocks through
+// the log as before and then to the cached page: in place if
+// only the cache has it, else to a copy that replaces it, so a
+// mapping keeps the file as of its first touch.  Truncating a
+// file drops its pages past the new end.
+//
+// Under memory pressure kalloc calls pcshrink, which drops the
+// least recently used pages only the cache holds.
+//
+// Callers hold the inode locked, shared for pcget, exclusively
+// to change the file; pcache.lock guards the table.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+
+#define NPCBUCKET 61
+#define min(a, b) ((a) < (b) ? (a) : (b))
+
+struct cpage {
+  uint dev;
+  uint inum;
+  uint idx;              // File offset / PGSIZE
+  char *pa;              // 0 if unused
+  struct cpage *hnext;   // Hash chain
+  struct cpage *prev;    // LRU list, most recent first
+  struct cpage *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct cpage page[NPCACHE];
+  struct cpage *bucket[NPCBUCKET];
+  struct cpage lru;      // Head of the LRU list
+  int n;                 // Pages in use
+  uint hits;
+  uint misses;
+} pcache __attribute__((aligned(CACHELINE)));
+
+static struct cpage**
+pchash(uint dev, uint inum, uint idx)
+{
+  return &pcache.bucket[(dev*31 + inum*17 + idx) % NPCBUCKET];
+}
+
+// The cached page of (dev, inum) at idx, or 0.
+// Caller holds pcache.lock.
+static struct cpage*
+pcfind(uint dev, uint inum, uint idx)
+{
+  struct cpage *c;
+
+  for(c = *pchash(dev, inum, idx); c; c = c->hnext)
+    if(c->dev == dev && c->inum == inum && c->idx == idx)
+      return c;
+  return 0;
+}
+
+static void
+lruunlink(struct cpage *c)
+{
+  c->next->prev = c->prev;
+  c->prev->next = c->next;
+}
+
+static void
+lrufront(struct cpage *c)
+{
+  c->next = pcache.lru.next;
+  c->prev = &pcache.lru;
+  pcache.lru.next->prev = c;
+  pcache.lru.next = c;
+}
+
+// Take c out of the cache, giving up its reference to its page.
+// Caller holds pcache.lock.
+static void
+pcdrop(struct cpage *c)
+{
+  struct cpage **pp;
+
+  for(pp = pchash(c->dev, c->inum, c->idx); *pp != c; pp = &(*pp)->hnext)
+    ;
+  *pp = c->hnext;
+  lruunlink(c);
+  kfree(c->pa);
+  c->pa = 0;
+  pcache.n--;
+}
+
+// Shrinker: drop up to n pages that only the cache holds, least
+// recently used first.  Returns how many it dropped.
+static int
+pcshrink(int n)
+{
+  struct cpage *c, *prev;
+  int freed;
+
+  freed = 0;
+  acquire(&pcache.lock);
+  for(c = pcache.lru.prev; c != &pcache.lru && freed < n; c = prev){
+    prev = c->prev;
+    if(!kshared(c->pa)){
+      pcdrop(c);
+      freed++;
+    }
+  }
+  release(&pcache.lock);
+  return freed;
+}
+
+// Drop every page only the cache holds.
+void
+pcprune(void)
+{
+  pcshrink(NPCACHE);
+}
+
+static void
+pckstat(struct kstatbuf *b)
+{
+  acquire(&pcache.lock);
+  kstatput(b, "pages", 0, pcache.n);
+  kstatput(b, "hits", 0, pcache.hits);
+  kstatput(b, "misses", 0, pcache.misses);
+  release(&pcache.lock);
+}
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.lru.prev = pcache.lru.next = &pcache.lru;
+  kshrinker("pcache", pcshrink);
+  kstatreg("pcache", pckstat);
+}
+
+// Return the page of ip holding file offset idx*PGSIZE, with a
+// reference for the caller, who drops it with kfree.  Reads the
+// page in if it isn't cached, and then sets *major if major
+// isn't 0.  Bytes past the end of the file read as zeros.
+// Returns 0 if the page is past the end, or on error.
+// Caller holds ip locked, shared or not.
+char*
+pcget(struct inode *ip, uint idx, int *major)
+{
+  struct cpage *c;
+  char *mem;
+  int i;
+
+  if(ip->type != T_FILE || idx >= (ip->size + PGSIZE - 1) / PGSIZE)
+    return 0;
+  acquire(&pcache.lock);
+  if((c = pcfind(ip->dev, ip->inum, idx)) != 0){
+    pcache.hits++;
+    kref(c->pa);
+    lruunlink(c);
+    lrufront(c);
+    release(&pcache.lock);
+    return c->pa;
+  }
+  pcache.misses++;
+  release(&pcache.lock);
+
+  if(major)
+    *major = 1;
+  if((mem = kalloc()) == 0)
+    return 0;
+  if(ireadpage(ip, idx*PGSIZE, mem) < 0){
+    kfree(mem);
+    return 0;
+  }
+
+  // Another shared holder of ip may have read the same page
+  // meanwhile.  Otherwise take a free slot, or the least
+  // recently used page only the cache has.
+  acquire(&pcache.lock);
+  if((c = pcfind(ip->dev, ip->inum, idx)) != 0){
+    kref(c->pa);
+    release(&pcache.lock);
+    kfree(mem);
+    return c->pa;
+  }
+  c = 0;
+  if(pcache.n < NPCACHE){
+    for(i = 0; i < NPCACHE && pcache.page[i].pa; i++)
+      ;
+    c = &pcache.page[i];
+  } else {
+    for(c = pcache.lru.prev; c != &pcache.lru && kshared(c->pa); c = c->prev)
+      ;
+    if(c == &pcache.lru)
+      c = 0;
+    else
+      pcdrop(c);
+  }
+  if(c){
+    c->dev = ip->dev;
+    c->inum = ip->inum;
+    c->idx = idx;
+    c->pa = mem;
+    kref(mem);  // the cache's reference
+    c->hnext = *pchash(c->dev, c->inum, idx);
+    *pchash(c->dev, c->inum, idx) = c;
+    lrufront(c);
+    pcache.n++;
+  }
+  release(&pcache.lock);
+  return mem;
+}
+
+// Bring the cached pages of ip up to date with the n bytes at
+// src just written at off.  Caller holds ip locked.
+void
+pcwrite(struct inode *ip, char *src, uint off, uint n)
+{
+  struct cpage *c;
+  char *mem;
+  uint idx, m;
+
+  if(pcache.n == 0)
+    return;
+  for(; n > 0; n -= m, off += m, src += m){
+    idx = off / PGSIZE;
+    m = min(n, PGSIZE - off%PGSIZE);
+    acquire(&pcache.lock);
+    if((c = pcfind(ip->dev, ip->inum, idx)) == 0){
+      release(&pcache.lock);
+      continue;
+    }
+    if(!kshared(c->pa)){
+      memmove(c->pa + off%PGSIZE, src, m);
+      release(&pcache.lock);
+      continue;
+    }
+    // Mapped somewhere: the mappings keep the old page.
+    release(&pcache.lock);
+    mem = kalloc();
+    acquire(&pcache.lock);
+    if((c = pcfind(ip->dev, ip->inum, idx)) != 0){
+      if(mem){
+        memmove(mem, c->pa, PGSIZE);
+        memmove(mem + off%PGSIZE, src, m);
+        kfree(c->pa);
+        c->pa = mem;
+        mem = 0;
+      } else
+        pcdrop(c);
+    }
+    release(&pcache.lock);
+    if(mem)
+      kfree(mem);
+  }
+}
+
+// Drop the cached pages of ip from the one holding off on; the
+// file is being cut short there.  Caller holds ip locked.
+void
+pcinval(struct inode *ip, uint off)
+{
+  struct cpage *c;
+  uint idx;
+
+  if(pcache.n == 0)
+    return;
+  acquire(&pcache.lock);
+  for(idx = off / PGSIZE; idx < (ip->size + PGSIZE - 1) / PGSIZE; idx++)
+    if((c = pcfind(ip->dev, ip->inum, idx)) != 0)
+      pcdrop(c);
+  release(&pcache.lock);
+}
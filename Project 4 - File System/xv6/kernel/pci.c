@@ -0,0 +1,79 @@
+// PCI configuration space access, using
+// configuration mechanism #1 (ports 0xCF8 and 0xCFC).
+
+#include "types.h"
+#include "defs.h"
+#include "x86.h"
+#include "pci.h"
+
+#define PCI_CONFADDR  0xcf8
+#define PCI_CONFDATA  0xcfc
+#define PCI_NBUS      8         // buses to scan
+
+// Read the 32-bit configuration register reg of function tag.
+uint
+pciread(int tag, int reg)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (reg & 0xfc));
+  return inl(PCI_CONFDATA);
+}
+
+// Write the 32-bit configuration register reg of function tag.
+void
+pciwrite(int tag, int reg, uint v)
+{
+  outl(PCI_CONFADDR, 0x80000000 | tag | (reg & 0xfc));
+  outl(PCI_CONFDATA, v);
+}
+
+// Find the first function for which match(tag, arg) is true.
+// Returns its tag, or -1 if there is none.
+static int
+pcifind(int (*match)(int, uint), uint arg)
+{
+  int bus, dev, fn, nfn, tag;
+
+  for(bus = 0; bus < PCI_NBUS; bus++){
+    for(dev = 0; dev < 32; dev++){
+      nfn = 1;
+      for(fn = 0; fn < nfn; fn++){
+        tag = PCI_TAG(bus, dev, fn);
+        if((pciread(tag, PCI_ID) & 0xffff) == 0xffff)
+          continue;
+        if(fn == 0 && (pciread(tag, PCI_HDRTYPE) & 0x800000))
+          nfn = 8;  // multi-function device
+        if(match(tag, arg))
+          return tag;
+      }
+    }
+  }
+  return -1;
+}
+
+static int
+matchclass(int tag, uint class)
+{
+  return (pciread(tag, PCI_CLASS) >> 16) == class;
+}
+
+static int
+matchid(int tag, uint id)
+{
+  return pciread(tag, PCI_ID) == id;
+}
+
+// Find the first function of the given class and subclass.
+// Returns its tag, or -1 if there is none.
+int
+pcifindclass(int class, int subclass)
+{
+  return pcifind(matchclass, (class<<8) | subclass);
+}
+
+// Find the first function with the given vendor and device id.
+// Returns its tag, or -1 if there is none.
+int
+pcifindid(int vendor, int device)
+{
+  return pcifind(matchid, (device<<16) | vendor);
+}
@@ -0,0 +1,26 @@
+#ifndef _PCI_H_
+#define _PCI_H_
+// PCI configuration space layout and constants
+
+#define PCI_ID          0x00    // vendor id (low 16), device id (high 16)
+#define PCI_CMD         0x04    // command (low 16), status (high 16)
+#define PCI_CLASS       0x08    // revision, prog if, subclass, class
+#define PCI_HDRTYPE     0x0c    // header type in bits 16-23
+#define PCI_BAR0        0x10    // base address registers 0-5
+#define PCI_BAR(n)      (PCI_BAR0 + 4*(n))
+#define PCI_INTR        0x3c    // interrupt line in bits 0-7
+
+#define PCI_CMD_IO      0x1     // respond to I/O space accesses
+#define PCI_CMD_MEM     0x2     // respond to memory space accesses
+#define PCI_CMD_MASTER  0x4     // allow bus mastering (DMA)
+
+#define PCI_BAR_IO      0x1     // BAR maps I/O space
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE  0x01
+
+// A PCI function is named by its tag: bus, device and function
+// numbers packed the way the configuration address register wants.
+#define PCI_TAG(bus, dev, fn) (((bus)<<16) | ((dev)<<11) | ((fn)<<8))
+
+#endif // _PCI_H_
@@ -0,0 +1,133 @@
+// Hardware performance counters, counted per process.
+//
+// perfctr programs one of the CPU's general-purpose counters
+// (IA32_PMCn, selected by IA32_PERFEVTSELn) for the calling
+// process.  The counters belong to whichever process is on the
+// CPU, so the scheduler moves them: pmcload zeroes and starts
+// the process's counters as it switches to the process, and
+// pmcsave stops them as it comes back and adds what they
+// counted to the totals in the process's vproc page.
+//
+// CR4.PCE lets user code run rdpmc, so a process reads counter
+// i as its vproc total plus rdpmc(i) without a system call (see
+// perfread in ulib.c).  vproc->pmcseq changes on every save, so
+// a reader that sees it change retries.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "vdso.h"
+#include "perf.h"
+
+#define MSR_PMC0      0xC1
+#define MSR_EVTSEL0   0x186
+#define EVTSEL_USR    (1 << 16)
+#define EVTSEL_OS     (1 << 17)
+#define EVTSEL_EN     (1 << 22)
+
+static int npmc;  // Counters the CPU has, up to NPMC; 0 if none
+
+// Set up this CPU; called on each from cinit.
+void
+perfinit(void)
+{
+  uint max, eax;
+  int n;
+
+  cpuid(0, &max, 0, 0, 0);
+  if(max < 0xA)
+    return;
+  cpuid(0xA, &eax, 0, 0, 0);
+  if((eax & 0xFF) == 0)  // no architectural performance monitoring
+    return;
+  n = (eax >> 8) & 0xFF;
+  if(n > NPMC)
+    n = NPMC;
+  lcr4(rcr4() | CR4_PCE);
+  if(cpunum() == mpbcpu()){
+    npmc = n;
+    if(n)
+      cprintf("perf: %d counters\n", n);
+  }
+}
+
+// Start p's counters on this CPU; it is about to run p.
+// Caller holds ptable.lock.
+void
+pmcload(struct proc *p)
+{
+  int i;
+
+  for(i = 0; i < npmc; i++){
+    if(p->pmcsel[i]){
+      wrmsr(MSR_PMC0 + i, 0);
+      wrmsr(MSR_EVTSEL0 + i, p->pmcsel[i]);
+      cpu->pmcon |= 1 << i;
+    }
+  }
+}
+
+// Stop p's counters and add up what they counted; p has just
+// given up this CPU.  Caller holds ptable.lock.
+void
+pmcsave(struct proc *p)
+{
+  int i;
+
+  if(cpu->pmcon == 0)
+    return;
+  p->vproc->pmcseq++;
+  for(i = 0; i < npmc; i++){
+    if(cpu->pmcon & (1 << i)){
+      wrmsr(MSR_EVTSEL0 + i, 0);
+      p->vproc->pmc[i] += rdpmc(i);
+    }
+  }
+  p->vproc->pmcseq++;
+  cpu->pmcon = 0;
+}
+
+// Count event (see perf.h) for the current process from now on,
+// in the modes flags asks for.  Returns the counter to pass to
+// perfread, or -1 if the CPU has no counters or none is free.
+// Event 0 stops and frees all of the process's counters.
+int
+perfctr(uint event, int flags)
+{
+  uint sel;
+  int i;
+
+  if(npmc == 0 || (flags & ~(PERF_USER|PERF_KERNEL)) || event > 0xFFFF)
+    return -1;
+  pushcli();
+  if(event == 0){
+    for(i = 0; i < npmc; i++){
+      wrmsr(MSR_EVTSEL0 + i, 0);
+      proc->pmcsel[i] = 0;
+    }
+    cpu->pmcon = 0;
+    popcli();
+    return 0;
+  }
+  for(i = 0; i < npmc && proc->pmcsel[i]; i++)
+    ;
+  if(i == npmc){
+    popcli();
+    return -1;
+  }
+  sel = event | EVTSEL_EN;
+  if(flags & PERF_KERNEL)
+    sel |= EVTSEL_OS;
+  if((flags & PERF_USER) || !(flags & PERF_KERNEL))
+    sel |= EVTSEL_USR;
+  proc->pmcsel[i] = sel;
+  proc->vproc->pmc[i] = 0;
+  wrmsr(MSR_PMC0 + i, 0);
+  wrmsr(MSR_EVTSEL0 + i, sel);
+  cpu->pmcon |= 1 << i;
+  popcli();
+  return i;
+}
@@ -4,20 +4,55 @@
 #include "mmu.h"
 #include "proc.h"
 #include "fs.h"
+#include "sleeplock.h"
 #include "file.h"
 #include "spinlock.h"
+#include "poll.h"
 
-#define PIPESIZE 512
+// The pipe struct and its ring fill one page.  nread and nwrite
+// are pulled back by PIPESIZE whenever nread passes it, so they
+// never wrap and PIPESIZE needn't divide 2^32.
+//
+// vmsplice gifts whole pages to a pipe instead of copying into
+// the ring: the pipe holds a reference to each, queued on gift,
+// and the writer's mapping of it turns copy-on-write.  A reader
+// with a page-aligned buffer takes a page by remapping it, and
+// copies otherwise.  Gifts follow the ring's bytes in the stream,
+// so pages are only queued while the ring is empty, and writes
+// to the ring wait until the gifts are gone.  Nobody writes a
+// page while the pipe holds it.
+#define PIPEGIFTS 8  // pages queued at once; a power of 2
+#define PIPESIZE (PGSIZE - sizeof(struct spinlock) - 7*sizeof(uint) - sizeof(void*) - \
+                  PIPEGIFTS*sizeof(char*))
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  struct pollent *pollq;  // processes polling either end
+  uint gread;     // gifts taken
+  uint gwrite;    // gifts queued
+  uint goff;      // bytes read of the first gift
+  char *gift[PIPEGIFTS];
+  char data[PIPESIZE];
 };
 
+// No data waiting to be read.
+static int
+pipeempty(struct pipe *p)
+{
+  return p->nread == p->nwrite && p->gread == p->gwrite;
+}
+
+// No room for bytes: the ring is full, or gifts must go first.
+static int
+pipefull(struct pipe *p)
+{
+  return p->nwrite == p->nread + PIPESIZE || p->gread != p->gwrite;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -33,6 +68,10 @@ pipealloc(struct file **f0, struct file **f1)
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->pollq = 0;
+  p->gread = 0;
+  p->gwrite = 0;
+  p->goff = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -65,54 +104,389 @@ pipeclose(struct pipe *p, int writable)
     p->readopen = 0;
     wakeup(&p->nwrite);
   }
+  pollwake(p->pollq);
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
+    for(; p->gread != p->gwrite; p->gread++)
+      kfree(p->gift[p->gread % PIPEGIFTS]);
     kfree((char*)p);
   } else
     release(&p->lock);
 }
 
+// Copy up to n bytes from addr into p's ring, in at most two
+// spans.  Readers only sleep on an empty pipe, so they are woken
+// only when this makes it nonempty.  Caller holds p->lock.
+static int
+pipein(struct pipe *p, char *addr, int n)
+{
+  uint w, m;
+
+  if(p->gread != p->gwrite)
+    return 0;
+  m = PIPESIZE - (p->nwrite - p->nread);
+  if(n > m)
+    n = m;
+  if(n <= 0)
+    return 0;
+  if(p->nwrite == p->nread){
+    wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+    pollwake(p->pollq);
+  }
+  w = p->nwrite % PIPESIZE;
+  m = PIPESIZE - w;
+  if(m > n)
+    m = n;
+  memmove(p->data + w, addr, m);
+  memmove(p->data, addr + m, n - m);
+  p->nwrite += n;
+  return n;
+}
+
+// Discard the first n bytes in p's ring.  Writers only sleep
+// on a full pipe, so they are woken only when this makes room
+// in it.  Caller holds p->lock.
+static void
+pipedrop(struct pipe *p, int n)
+{
+  if(p->nwrite == p->nread + PIPESIZE){
+    wakeup(&p->nwrite);  //DOC: piperead-wakeup
+    pollwake(p->pollq);
+  }
+  p->nread += n;
+  if(p->nread >= PIPESIZE){
+    p->nread -= PIPESIZE;
+    p->nwrite -= PIPESIZE;
+  }
+}
+
+// Copy up to n bytes out of p's ring into addr, in at most two
+// spans.  Caller holds p->lock.
+static int
+pipeout(struct pipe *p, char *addr, int n)
+{
+  uint r, m;
+
+  m = p->nwrite - p->nread;
+  if(n > m)
+    n = m;
+  if(n <= 0)
+    return 0;
+  r = p->nread % PIPESIZE;
+  m = PIPESIZE - r;
+  if(m > n)
+    m = n;
+  memmove(addr, p->data + r, m);
+  memmove(addr + m, p->data, n - m);
+  pipedrop(p, n);
+  return n;
+}
+
+// Queue the page pa, whose reference the caller hands over, on
+// p.  Caller holds p->lock and has checked that the ring is
+// empty and there is a free slot.
+static void
+giftin(struct pipe *p, char *pa)
+{
+  if(pipeempty(p)){
+    wakeup(&p->nread);
+    pollwake(p->pollq);
+  }
+  p->gift[p->gwrite++ % PIPEGIFTS] = pa;
+}
+
+// Discard the first n bytes of p's gifts, dropping the pipe's
+// reference to each page that is used up.  Writers wait for a
+// free slot or for the gifts to go, so they are woken each time
+// a page does.  Caller holds p->lock.
+static void
+giftdrop(struct pipe *p, int n)
+{
+  int m;
+
+  for(; n > 0; n -= m){
+    m = PGSIZE - p->goff;
+    if(m > n)
+      m = n;
+    p->goff += m;
+    if(p->goff == PGSIZE){
+      kfree(p->gift[p->gread++ % PIPEGIFTS]);
+      p->goff = 0;
+      wakeup(&p->nwrite);
+      pollwake(p->pollq);
+    }
+  }
+}
+
+// Read up to n bytes of p's gifts into addr: whole pages by
+// mapping them at addr if it is a page-aligned buffer of this
+// process, the rest by copying.  Caller holds p->lock.
+static int
+giftout(struct pipe *p, char *addr, int n)
+{
+  char *pa;
+  int i, m;
+
+  for(i = 0; i < n && p->gread != p->gwrite; i += m){
+    pa = p->gift[p->gread % PIPEGIFTS];
+    m = PGSIZE - p->goff;
+    if(m > n - i)
+      m = n - i;
+    if(m < PGSIZE || (uint)(addr + i) % PGSIZE ||
+       uvmgift(proc, (uint)(addr + i), pa) < 0)
+      memmove(addr + i, pa + p->goff, m);
+    giftdrop(p, m);
+  }
+  return i;
+}
+
+// Write n bytes from addr to p.  Unless nonblock, waits for
+// room as needed; with it, writes what fits and returns that
+// count, or -1 if there is no room at all.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int nonblock)
 {
   int i;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
-    while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
-      if(p->readopen == 0 || proc->killed){
+  for(i = 0; i < n; i += pipein(p, addr + i, n - i)){
+    while(pipefull(p)){  //DOC: pipewrite-full
+      if(p->readopen == 0 || proc->killed || nonblock){
         release(&p->lock);
-        return -1;
+        return nonblock && p->readopen && i > 0 ? i : -1;
       }
-      wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Read up to n bytes from p into addr.  Waits for data unless
+// nonblock, in which case an empty pipe with writers gives -1.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int nonblock)
 {
   int i;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
-    if(proc->killed){
+  while(pipeempty(p) && p->writeopen){  //DOC: pipe-empty
+    if(proc->killed || nonblock){
       release(&p->lock);
       return -1;
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
+  if(p->gread != p->gwrite)
+    i = giftout(p, addr, n);
+  else
+    i = pipeout(p, addr, n);  //DOC: piperead-copy
+  release(&p->lock);
+  return i;
+}
+
+// Gift the n bytes of whole pages at the current process's
+// page-aligned address va to p, waiting for the ring to empty
+// and for free slots as needed.  Pages that can't be lent, such
+// as those of 4 MB pages or mappings, are copied into new pages
+// instead.  Returns n, or -1 as pipewrite does.
+int
+pipegift(struct pipe *p, uint va, int n, int nonblock)
+{
+  char *pa;
+  int i;
+
+  if(va % PGSIZE || n % PGSIZE || n < 0)
+    return -1;
+  acquire(&p->lock);
+  for(i = 0; i < n; i += PGSIZE){
+    while(p->nread != p->nwrite || p->gwrite - p->gread == PIPEGIFTS){
+      if(p->readopen == 0 || proc->killed || nonblock){
+        release(&p->lock);
+        return nonblock && p->readopen && i > 0 ? i : -1;
+      }
+      sleep(&p->nwrite, &p->lock);
+    }
+    if(p->readopen == 0)
       break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+    if((pa = uvmlend(proc, va + i)) == 0){
+      if((pa = kalloc()) == 0)
+        break;
+      memmove(pa, (char*)(va + i), PGSIZE);
+    }
+    giftin(p, pa);
+  }
+  release(&p->lock);
+  return i == n ? n : -1;
+}
+
+// Which of events (or POLLERR, POLLHUP) hold for the read or
+// writable end of p.  If none do and e is nonzero, put e on p's
+// poll list to be told when that may change.
+int
+pipepoll(struct pipe *p, int writable, int events, struct pollent *e)
+{
+  int r;
+
+  r = 0;
+  acquire(&p->lock);
+  if(writable){
+    if(p->readopen == 0)
+      r |= POLLERR;
+    else if(!pipefull(p))
+      r |= events & POLLOUT;
+  } else {
+    if(!pipeempty(p))
+      r |= events & POLLIN;
+    else if(p->writeopen == 0)
+      r |= POLLHUP;
+  }
+  if(r == 0 && e)
+    pollwait(&p->pollq, &p->lock, e);
+  release(&p->lock);
+  return r;
+}
+
+// Wait until p has room for more data, as pipewrite does.
+// Returns the free space, or -1 if no one will read it.
+int
+pipewait(struct pipe *p)
+{
+  int n;
+
+  acquire(&p->lock);
+  while(pipefull(p)){
+    if(p->readopen == 0 || proc->killed){
+      release(&p->lock);
+      return -1;
+    }
+    sleep(&p->nwrite, &p->lock);
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  n = p->nread + PIPESIZE - p->nwrite;
+  release(&p->lock);
+  return n;
+}
+
+// Copy as much of addr[0..n-1] into pipe arg as fits, without
+// waiting for room.  Returns the number of bytes copied.  Used
+// by sendfile to fill the pipe straight from the buffer cache.
+int
+pipeput(void *arg, char *addr, int n)
+{
+  struct pipe *p;
+  int i;
+
+  p = arg;
+  acquire(&p->lock);
+  i = pipein(p, addr, n);
   release(&p->lock);
   return i;
 }
+
+// Move up to n bytes of in's gifts to out: whole pages by
+// reference while out's ring is empty, the rest into its ring.
+// Caller holds both locks.
+static int
+giftsplice(struct pipe *in, struct pipe *out, int n)
+{
+  uint g, off;
+  int m, k, moved;
+  char *pa;
+
+  moved = 0;
+  g = in->gread;
+  off = in->goff;
+  while(moved < n && g != in->gwrite){
+    pa = in->gift[g % PIPEGIFTS];
+    m = PGSIZE - off;
+    if(m > n - moved)
+      m = n - moved;
+    if(m == PGSIZE && out->nread == out->nwrite &&
+       out->gwrite - out->gread < PIPEGIFTS){
+      kref(pa);
+      giftin(out, pa);
+      k = m;
+    } else
+      k = pipein(out, pa + off, m);
+    moved += k;
+    off += k;
+    if(k < m)
+      break;  // out is full
+    if(off == PGSIZE){
+      g++;
+      off = 0;
+    }
+  }
+  return moved;
+}
+
+// Move up to n bytes from pipe in to pipe out, ring to ring,
+// waiting for data in in as piperead does and for room in out
+// as pipewrite does.  Gifted pages go across by reference where
+// they can.  Unless consume is set (splice rather than tee) the
+// bytes are left in in as well.  Returns the number of bytes
+// moved, 0 if in is empty and has no writers, or -1.
+int
+pipesplice(struct pipe *in, struct pipe *out, int n, int consume)
+{
+  struct pipe *a, *b;
+  uint r;
+  int m, k, moved;
+
+  if(in == out || n < 0)
+    return -1;
+  if(n == 0)
+    return 0;
+  for(;;){
+    acquire(&in->lock);
+    while(pipeempty(in) && in->writeopen){
+      if(proc->killed){
+        release(&in->lock);
+        return -1;
+      }
+      sleep(&in->nread, &in->lock);
+    }
+    m = !pipeempty(in);
+    release(&in->lock);
+    if(m == 0)
+      return 0;
+    if(pipewait(out) < 0)
+      return -1;
+
+    // Lock both rings, lower address first.
+    a = in < out ? in : out;
+    b = in < out ? out : in;
+    acquire(&a->lock);
+    acquire(&b->lock);
+    if(in->gread != in->gwrite){
+      if((moved = giftsplice(in, out, n)) > 0 && consume)
+        giftdrop(in, moved);
+      release(&b->lock);
+      release(&a->lock);
+      if(moved > 0)
+        return moved;
+      continue;
+    }
+    moved = 0;
+    r = in->nread;
+    while(moved < n && r != in->nwrite){
+      m = PIPESIZE - r % PIPESIZE;
+      if(m > in->nwrite - r)
+        m = in->nwrite - r;
+      if(m > n - moved)
+        m = n - moved;
+      k = pipein(out, in->data + r % PIPESIZE, m);
+      moved += k;
+      r += k;
+      if(k < m)
+        break;  // out is full
+    }
+    if(consume && moved > 0)
+      pipedrop(in, moved);
+    release(&b->lock);
+    release(&a->lock);
+    if(moved > 0)
+      return moved;
+    // Someone else got in first; wait again.
+  }
+}
@@ -0,0 +1,110 @@
+// poll: wait for any of several files to be ready.
+//
+// A pipe or device that can make a poller wait keeps a list of
+// pollents, one per polling process, under its own lock.  poll
+// asks each file whether it is ready, putting one of its
+// pollents on the list of each that isn't; when one of those
+// changes, pollwake tells the process with pollnotify, and poll
+// looks at all of them again.  A process in poll sleeps on its
+// own wakeat, so the same sleep covers its timeout.
+//
+// Lock order: the pipe or device lock, then ptable.lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+#include "spinlock.h"
+#include "poll.h"
+
+// Put e for the current process on list *head, guarded by lk,
+// which the caller holds.
+void
+pollwait(struct pollent **head, struct spinlock *lk, struct pollent *e)
+{
+  e->p = proc;
+  e->lk = lk;
+  e->prev = head;
+  if((e->next = *head) != 0)
+    e->next->prev = &e->next;
+  *head = e;
+}
+
+// Tell every process on list e that it may have something
+// ready.  Caller holds the list's lock.
+void
+pollwake(struct pollent *e)
+{
+  for(; e; e = e->next)
+    pollnotify(e->p);
+}
+
+// Take e off whatever list it is on.
+static void
+polldone(struct pollent *e)
+{
+  if(e->prev == 0)
+    return;
+  acquire(e->lk);
+  if((*e->prev = e->next) != 0)
+    e->next->prev = e->prev;
+  e->prev = 0;
+  release(e->lk);
+}
+
+// Fill in revents for the n entries of fds, waiting up to
+// timeout milliseconds (forever if negative) for one to be
+// nonzero.  Returns the number that are, or -1.
+int
+poll(struct pollfd *fds, int n, int timeout)
+{
+  struct pollent *ents;
+  struct file *f;
+  uint deadline;
+  int i, order, ready;
+
+  if(n < 0 || n > NOFILEMAX)
+    return -1;
+  for(order = 0; (PGSIZE << order) < n*sizeof(struct pollent); order++)
+    ;
+  if((ents = (struct pollent*)kalloc_order(order)) == 0)
+    return -1;
+  for(i = 0; i < n; i++)
+    ents[i].prev = 0;
+  deadline = 0;
+  if(timeout > 0)
+    deadline = ticks + (timeout*HZ + 999) / 1000;
+
+  for(;;){
+    proc->pollwoken = 0;
+    ready = 0;
+    for(i = 0; i < n; i++){
+      fds[i].revents = 0;
+      if(fds[i].fd < 0)
+        continue;
+      if((f = fdget(proc, fds[i].fd)) == 0)
+        fds[i].revents = POLLNVAL;
+      else
+        fds[i].revents = filepoll(f, fds[i].events,
+                                  ents[i].prev ? 0 : &ents[i]);
+      if(fds[i].revents)
+        ready++;
+    }
+    if(ready || timeout == 0 || proc->killed)
+      break;
+    if(timeout > 0 && (int)(deadline - ticks) <= 0)
+      break;
+    pollsleep(deadline);
+  }
+
+  for(i = 0; i < n; i++)
+    polldone(&ents[i]);
+  kfree_order((char*)ents, order);
+  if(ready == 0 && proc->killed)
+    return -1;
+  return ready;
+}
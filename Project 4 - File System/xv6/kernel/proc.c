@@ -4,12 +4,87 @@
 #include "mmu.h"
 #include "x86.h"
 #include "proc.h"
+#include "vdso.h"
+#include "ProcessInfo.h"
+#include "ProcStat.h"
 #include "spinlock.h"
+#include "traps.h"
+#include "trace.h"
+#include "spawn.h"
 
+// Processes come from a slab cache as they are needed, up to
+// NPROC of them, and are kept on ptable.list.  ptable.lock guards
+// the list and the pid hash, but lookups that only read may walk
+// them under rcu_read_lock instead: freeproc unlinks a process at
+// once and frees it with call_rcu.
 struct {
   struct spinlock lock;
-  struct proc proc[NPROC];
-} ptable;
+  struct kmem_cache *cache;
+  struct proc *list;           // All processes, oldest first
+  struct proc **tail;          // Last allnext in list
+  int n;                       // How many
+} ptable __attribute__((aligned(CACHELINE)));
+
+// Per-CPU queues of RUNNABLE processes.  A process goes on the
+// queue of the CPU that makes it RUNNABLE (see runnable), with
+// ptable.lock held.  Each queue has its own lock, and cache lines,
+// so a CPU looks for work without ptable.lock; one whose queue is
+// empty steals from the others.  Lock order: ptable.lock, then a queue lock.
+//
+// Scheduling is a multi-level feedback queue: each queue has one
+// list per priority level, and the highest level with a process
+// on any CPU runs first.  A process at level l may run 2^l ticks
+// before it drops a level (see schedtick), and every BOOSTTICKS
+// ticks all processes go back to level 0 (see prioboost).
+//
+// A process may run only on the CPUs in its cpumask.  It is
+// queued on the CPU it last ran on, to keep its cache warm;
+// other CPUs take it only when they have nothing of their own.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NPRIO];
+  struct proc *tail[NPRIO];
+  volatile int n;              // Length, for unlocked peeks
+} __attribute__((aligned(CACHELINE))) runq[NCPU];
+
+// Per-CPU log2 histograms of how long processes waited on a
+// run queue, from runnable to the scheduler switching to them,
+// and of how long they then ran before switching back.  Bucket
+// k counts times of 2^k to 2^(k+1) microseconds; bucket 0 also
+// counts shorter ones, and the last, longer ones.  Each CPU
+// adds only to its own, in scheduler; see schedkstat.
+#define NSCHEDHIST 24
+static struct {
+  uint rqdelay[NSCHEDHIST];
+  uint slice[NSCHEDHIST];
+} __attribute__((aligned(CACHELINE))) schedhist[NCPU];
+
+// SLEEPING processes, hashed by chan, so wakeup looks only at
+// processes that might be sleeping on its chan.  Protected by
+// ptable.lock.
+#define NSLEEPQ 64
+#define SLEEPQ(chan) (&sleepq[((uint)(chan) >> 3) % NSLEEPQ])
+static struct proc *sleepq[NSLEEPQ];
+
+// Timer wheel of processes in sleepticks, by deadline.  Level l
+// has TWSLOTS slots of TWSLOTS^l ticks each.  A process waits in
+// the lowest level whose span covers its deadline, and moves down
+// a level when its slot comes round, so a tick looks only at the
+// processes due then.  Protected by ptable.lock.
+#define TWBITS   6
+#define TWSLOTS  (1 << TWBITS)
+#define TWLEVELS 4
+#define TWSPAN   (1U << TWBITS*TWLEVELS)  // ticks the wheel covers
+static struct {
+  uint now;                    // Last tick done by timertick
+  struct proc *slot[TWLEVELS][TWSLOTS];
+} twheel;
+
+// Processes hashed by pid, for findproc.  Protected by ptable.lock,
+// or for reading by rcu_read_lock.
+#define NPIDHASH 64
+#define PIDHASH(pid) (&pidhash[(uint)(pid) % NPIDHASH])
+static struct proc *pidhash[NPIDHASH];
 
 static struct proc *initproc;
 
@@ -18,40 +93,332 @@ extern void forkret(void);
 extern void trapret(void);
 
 static void wakeup1(void *chan);
+static void unsleep(struct proc *p);
+
+static void
+schedkstat(struct kstatbuf *b)
+{
+  int i;
+
+  for(i = 0; i < ncpu; i++){
+    kstathist(b, "rqdelay", i, schedhist[i].rqdelay, NSCHEDHIST);
+    kstathist(b, "slice", i, schedhist[i].slice, NSCHEDHIST);
+  }
+}
 
 void
 pinit(void)
 {
+  int i;
+
   initlock(&ptable.lock, "ptable");
+  ptable.tail = &ptable.list;
+  ptable.cache = kmem_cache_create("proc", sizeof(struct proc));
+  for(i = 0; i < NCPU; i++)
+    initlock(&runq[i].lock, "runq");
+  kstatreg("sched", schedkstat);
+}
+
+// Try to wake c if it is halted; returns 1 if it was.
+static int
+wakecpu(struct cpu *c)
+{
+  if(c == cpu || !c->idle || !xchg(&c->idle, 0))
+    return 0;
+  lapicipi(c->id, T_IRQ0 + IRQ_WAKEUP);
+  return 1;
+}
+
+// Wake a halted CPU, if there is one, to run p, just queued on
+// cpus[i]'s run queue: cpus[i] itself, or another that may run
+// p and can steal it.  The xchg in release() orders the enqueue
+// before the reads of c->idle; see idle.
+static void
+wakeidle(struct proc *p, int i)
+{
+  struct cpu *c;
+
+  if(wakecpu(&cpus[i]))
+    return;
+  for(c = cpus; c < cpus + ncpu; c++)
+    if((p->cpumask & 1 << (c - cpus)) && wakecpu(c))
+      return;
+}
+
+// Ticks until the timer wheel next has work: a deadline in
+// level 0, or else the next time the higher levels move down,
+// if they have any processes.  0 if the wheel is empty.
+static uint
+twnext(void)
+{
+  uint d;
+  int i, l;
+
+  d = 0;
+  acquire(&ptable.lock);
+  for(i = 1; i < TWSLOTS && d == 0; i++)
+    if(twheel.slot[0][(twheel.now + i) & (TWSLOTS-1)])
+      d = twheel.now + i;
+  for(l = 1; l < TWLEVELS && d == 0; l++)
+    for(i = 0; i < TWSLOTS; i++)
+      if(twheel.slot[l][i]){
+        d = (twheel.now | (TWSLOTS-1)) + 1;
+        break;
+      }
+  release(&ptable.lock);
+  if(d == 0)
+    return 0;
+  return (int)(d - ticks) > 0 ? d - ticks : 1;
+}
+
+// Halt until an interrupt, unless some run queue has work.
+// cpu->idle is set, by an ordering xchg, before looking at the
+// queues, so a runnable() that comes after the look sees it and
+// sends an IPI, which ends the hlt (or is taken right at it).
+// The CPU's tick stops while it is halted, but for one at the
+// next timer wheel deadline; ticks catches up when it wakes.
+static void
+idle(void)
+{
+  int i;
+
+  cli();
+  xchg(&cpu->idle, 1);
+  for(i = 0; i < NCPU; i++)
+    if(runq[i].n)
+      break;
+  if(i == NCPU){
+    lapiconeshot(twnext());
+    stihlt();
+    cli();
+    lapictick();
+    clockupdate();
+  }
+  cpu->idle = 0;
+  sti();
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
-// state required to run in the kernel.
-// Otherwise return 0.
+// Make p RUNNABLE and put it at the tail of a run queue: its
+// last CPU's if it may still run there, else this CPU's if it
+// may run here, else that of the first CPU it may use.  Wakes a
+// halted CPU, or asks a busy one running a lower level process
+// to reschedule.  Caller holds ptable.lock.
+static void
+runnable(struct proc *p)
+{
+  struct runq *q;
+  struct proc *cur;
+  int i;
+
+  p->state = RUNNABLE;
+  p->rqnext = 0;
+  p->tqueued = rdtsc();
+  i = p->cpu;
+  if(!(p->cpumask & 1 << i))
+    i = cpu - cpus;
+  if(!(p->cpumask & 1 << i))
+    for(i = 0; i < NCPU - 1 && !(p->cpumask & 1 << i); i++)
+      ;
+  q = &runq[i];
+  acquire(&q->lock);
+  if(q->tail[p->prio])
+    q->tail[p->prio]->rqnext = p;
+  else
+    q->head[p->prio] = p;
+  q->tail[p->prio] = p;
+  q->n++;
+  release(&q->lock);
+  cur = cpus[i].proc;  // unlocked peek; only a hint
+  if(cur && p->prio < cur->prio)
+    cpus[i].resched = 1;
+  wakeidle(p, i);
+}
+
+// Take the first process this CPU may run from the highest
+// level that has one, looking at this CPU's run queue before
+// the others at each level.  Returns 0 if there is nothing to run.
 static struct proc*
-allocproc(void)
+runqget(void)
+{
+  struct runq *q;
+  struct proc *p, *prev;
+  int i, l, me;
+
+  pushcli();
+  me = cpu - cpus;
+  popcli();
+  for(l = 0; l < NPRIO; l++){
+    for(i = 0; i < NCPU; i++){
+      q = &runq[(me + i) % NCPU];
+      if(q->n == 0 || q->head[l] == 0)  // unlocked peek
+        continue;
+      acquire(&q->lock);
+      prev = 0;
+      for(p = q->head[l]; p && !(p->cpumask & 1 << me); p = p->rqnext)
+        prev = p;
+      if(p){
+        if(prev)
+          prev->rqnext = p->rqnext;
+        else
+          q->head[l] = p->rqnext;
+        if(q->tail[l] == p)
+          q->tail[l] = prev;
+        q->n--;
+      }
+      release(&q->lock);
+      if(p)
+        return p;
+    }
+  }
+  return 0;
+}
+
+// Charge the running process for a clock tick, which found it
+// in user mode if user is set.  Returns 1 if it should yield: it
+// has used up its time at its level, and drops a level, or a
+// process of a higher level is waiting.
+int
+schedtick(int user)
+{
+  struct runq *q;
+  int l;
+
+  proc->ticks++;
+  proc->uticks += user;
+  proc->lastrun = ticks;
+  if(++proc->slice >= 1 << proc->prio){
+    proc->slice = 0;
+    if(proc->prio < NPRIO-1 && !proc->kthread)
+      proc->prio++;
+    return 1;
+  }
+  for(l = 0; l < proc->prio; l++)
+    for(q = runq; q < runq + NCPU; q++)
+      if(q->head[l])  // unlocked peek
+        return 1;
+  return 0;
+}
+
+// Put every process back at level 0, so that none starves
+// behind higher levels.  Called every BOOSTTICKS ticks.
+void
+prioboost(void)
 {
   struct proc *p;
-  char *sp;
+  struct runq *q;
+  int l;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
+  for(p = ptable.list; p; p = p->allnext){
+    p->prio = 0;
+    p->slice = 0;
+  }
+  for(q = runq; q < runq + NCPU; q++){
+    acquire(&q->lock);
+    for(l = 1; l < NPRIO; l++){
+      if(q->head[l] == 0)
+        continue;
+      if(q->tail[0])
+        q->tail[0]->rqnext = q->head[l];
+      else
+        q->head[0] = q->head[l];
+      q->tail[0] = q->tail[l];
+      q->head[l] = q->tail[l] = 0;
+    }
+    release(&q->lock);
+  }
   release(&ptable.lock);
+}
+
+// The process with the given pid, or 0.
+// Caller holds ptable.lock or is in rcu_read_lock; in the latter
+// case the process may be UNUSED, and is valid until rcu_read_unlock.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = *PIDHASH(pid); p; p = p->pidnext)
+    if(p->pid == pid)
+      return p;
   return 0;
+}
 
-found:
+static void
+procfree(void *p)
+{
+  kmem_cache_free(ptable.cache, p);
+}
+
+// Take p out of the table and free it with its kernel stack,
+// the proc itself once lock-free readers are done with it.
+// Its page table, if any, is the caller's to free.  Caller holds
+// ptable.lock.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = PIDHASH(p->pid); *pp != p; pp = &(*pp)->pidnext)
+    ;
+  *pp = p->pidnext;
+  if((*p->allprev = p->allnext) != 0)
+    p->allnext->allprev = p->allprev;
+  else
+    ptable.tail = p->allprev;
+  ptable.n--;
+  if(p->kstack)
+    kstackfree(p->kstack);
+  if(p->vproc)
+    kfree((char*)p->vproc);
+  if(p->ofile != p->ofile0)
+    kfree((char*)p->ofile);
+  p->state = UNUSED;
+  call_rcu(&p->rcu, procfree, p);
+}
+
+// Allocate a proc and add it to the table in state EMBRYO,
+// with the state required to run in the kernel.
+// Returns 0 if there are NPROC processes or no memory.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+  char *sp;
+
+  if((p = kmem_cache_alloc(ptable.cache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  p->ofile = p->ofile0;
+  p->nofile = NOFILE;
+  p->mmapbase = MMAPTOP;
+  p->cpumask = ~0;
+
+  acquire(&ptable.lock);
+  if(ptable.n == NPROC){
+    release(&ptable.lock);
+    kmem_cache_free(ptable.cache, p);
+    return 0;
+  }
+  ptable.n++;
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->allprev = ptable.tail;
+  rcu_assign(ptable.tail, p);
+  ptable.tail = &p->allnext;
+  p->pidnext = *PIDHASH(p->pid);
+  rcu_assign(PIDHASH(p->pid), p);
   release(&ptable.lock);
 
   // Allocate kernel stack if possible.
-  if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+  if((p->kstack = kstackalloc()) == 0 ||
+     (p->vproc = (struct vproc*)kalloc_zeroed()) == 0){
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
+  p->vproc->pid = p->pid;
   sp = p->kstack + KSTACKSIZE;
   
   // Leave room for trap frame.
@@ -81,26 +448,59 @@ userinit(void)
   p = allocproc();
   acquire(&ptable.lock);
   initproc = p;
-  if((p->pgdir = setupkvm()) == 0)
+  if((p->pgdir = setupkvm()) == 0 || mapvdso(p->pgdir, p) < 0)
     panic("userinit: out of memory?");
   inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
-  p->sz = PGSIZE;
+  p->sz = USERBASE + PGSIZE;
+  p->rss = p->maxrss = 1;
   memset(p->tf, 0, sizeof(*p->tf));
   p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
   p->tf->ds = (SEG_UDATA << 3) | DPL_USER;
   p->tf->es = p->tf->ds;
   p->tf->ss = p->tf->ds;
   p->tf->eflags = FL_IF;
-  p->tf->esp = PGSIZE;
-  p->tf->eip = 0;  // beginning of initcode.S
+  p->tf->esp = USERBASE + PGSIZE;
+  p->tf->eip = USERBASE;  // beginning of initcode.S
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  runnable(p);
   release(&ptable.lock);
 }
 
+// Create a kernel thread: a process with no user memory that
+// runs fn(arg).  fn runs with interrupts enabled and must never
+// return.  Kernel threads stay at the top scheduling level, so
+// background work isn't starved by the processes it serves.
+struct proc*
+kthread_create(char *name, void (*fn)(void*), void *arg)
+{
+  struct proc *p;
+  uint *sp;
+
+  if((p = allocproc()) == 0)
+    panic("kthread_create: no proc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kthread_create: out of memory?");
+  p->sz = USERBASE;
+  p->cwd = namei("/");
+  p->kthread = 1;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  // forkret returns into fn instead of trapret, and fn finds
+  // a return address and arg above that in the unused trap frame.
+  sp = (uint*)(p->context + 1);
+  sp[0] = (uint)fn;
+  sp[1] = 0;
+  sp[2] = (uint)arg;
+
+  acquire(&ptable.lock);
+  runnable(p);
+  release(&ptable.lock);
+  return p;
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -110,24 +510,136 @@ growproc(int n)
   
   sz = proc->sz;
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
+    // Pages are allocated on first touch; see lazyfault.
+    if(sz + n > proc->mmapbase || sz + n < sz)
       return -1;
+    sz += n;
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if(sz + n < USERBASE || sz + n > sz)
       return -1;
+    sz = deallocuvm(proc->pgdir, sz, sz + n);
+    exectrim(proc, sz);
+    proc->rss = uvmrss(proc->pgdir, 0, 0);
   }
   proc->sz = sz;
   switchuvm(proc);
   return 0;
 }
 
+// File descriptors.  A process's table starts as the NOFILE
+// slots in its proc and moves to a page of NOFILEMAX slots the
+// first time an fd past them is needed.  fdmap has a bit set for
+// each fd in use, so the lowest free fd is found a word at a time.
+// Only the process itself changes its table.
+
+// The file open as fd in p, or 0.
+struct file*
+fdget(struct proc *p, int fd)
+{
+  if(fd < 0 || fd >= p->nofile)
+    return 0;
+  return p->ofile[fd];
+}
+
+// Move p's table to a page.
+static int
+fdgrow(struct proc *p)
+{
+  struct file **t;
+
+  if(p->nofile == NOFILEMAX || (t = (struct file**)kalloc_zeroed()) == 0)
+    return -1;
+  memmove(t, p->ofile, p->nofile * sizeof(*t));
+  p->ofile = t;
+  p->nofile = NOFILEMAX;
+  return 0;
+}
+
+// Make fd in p refer to f, or to nothing if f is 0, taking over
+// the caller's reference to f.  Whatever fd referred to before is
+// not closed.  Returns -1 if fd is out of range or the table
+// can't grow to hold it.
+int
+fdset(struct proc *p, int fd, struct file *f)
+{
+  if(fd < 0 || fd >= NOFILEMAX)
+    return -1;
+  if(fd >= p->nofile){
+    if(f == 0)
+      return 0;
+    if(fdgrow(p) < 0)
+      return -1;
+  }
+  p->ofile[fd] = f;
+  if(f)
+    p->fdmap[fd/32] |= 1U << (fd%32);
+  else
+    p->fdmap[fd/32] &= ~(1U << (fd%32));
+  return 0;
+}
+
+// Give f the lowest free fd in p, taking over the caller's
+// reference to f.  Returns the fd, or -1 if there is none.
+int
+fdalloc(struct proc *p, struct file *f)
+{
+  uint w;
+  int fd;
+
+  for(w = 0; w < NOFILEMAX/32 && p->fdmap[w] == ~0; w++)
+    ;
+  if(w == NOFILEMAX/32)
+    return -1;
+  for(fd = w*32; p->fdmap[w] & (1U << (fd%32)); fd++)
+    ;
+  if(fdset(p, fd, f) < 0)
+    return -1;
+  return fd;
+}
+
+// Close every open fd of p.
+void
+fdcloseall(struct proc *p)
+{
+  uint w;
+  int fd;
+
+  for(w = 0; w < NOFILEMAX/32; w++){
+    for(fd = w*32; p->fdmap[w]; fd++){
+      if(p->fdmap[w] & (1U << (fd%32))){
+        fileclose(p->ofile[fd]);
+        fdset(p, fd, 0);
+      }
+    }
+  }
+}
+
+// Give np a reference to each of the n files in of, at the
+// same fds.  Returns -1, having closed np's files, if np's
+// table can't grow to hold them.
+int
+fdcopy(struct proc *np, struct file **of, int n)
+{
+  int fd;
+
+  for(fd = 0; fd < n; fd++){
+    if(of[fd] && fdset(np, fd, of[fd]) < 0){
+      fdcloseall(np);
+      return -1;
+    }
+    if(of[fd])
+      filedup(of[fd]);
+  }
+  return 0;
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
 
   // Allocate process.
@@ -135,30 +647,221 @@ fork(void)
     return -1;
 
   // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0 ||
+     mapvdso(np->pgdir, np) < 0){
+    if(np->pgdir)
+      freevm(np->pgdir);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = proc->sz;
+  np->rss = np->maxrss = proc->rss;
+  np->cpu = proc->cpu;  // start near the parent's cache
+  np->cpumask = proc->cpumask;
   np->parent = proc;
   *np->tf = *proc->tf;
 
   // Clear %eax so that fork returns 0 in the child.
   np->tf->eax = 0;
 
-  for(i = 0; i < NOFILE; i++)
-    if(proc->ofile[i])
-      np->ofile[i] = filedup(proc->ofile[i]);
+  if(fdcopy(np, proc->ofile, proc->nofile) < 0){
+    freevm(np->pgdir);
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
+    return -1;
+  }
   np->cwd = idup(proc->cwd);
+  np->exe = proc->exe ? idup(proc->exe) : 0;
+  memmove(np->seg, proc->seg, sizeof(np->seg));
+  mmapfork(np, proc);
  
   pid = np->pid;
-  np->state = RUNNABLE;
   safestrcpy(np->name, proc->name, sizeof(proc->name));
+  acquire(&ptable.lock);
+  np->sibling = proc->child;
+  proc->child = np;
+  runnable(np);
+  release(&ptable.lock);
   return pid;
 }
 
+// Start path with argv in a new child process, much as fork and
+// exec would, but without copying the caller's memory: the child
+// gets the new image straight away.  It has the caller's open
+// files, with acts applied to them.  Returns the child's pid, or
+// -1 if acts is bad or path can't be run.
+int
+spawn(char *path, char **argv, struct spawnact *acts, int nact)
+{
+  struct spawnact *a;
+  struct proc *np;
+  struct file *f, *old;
+  int pid;
+
+  if((np = allocproc()) == 0)
+    return -1;
+  *np->tf = *proc->tf;  // the user segments; execnew sets the rest
+
+  // Do the actions on the child's copy of the file table.
+  if(fdcopy(np, proc->ofile, proc->nofile) < 0)
+    goto bad;
+  for(a = acts; a < acts + nact; a++){
+    if((f = fdget(np, a->fd)) == 0)
+      goto bad;
+    if(a->op == SPAWN_CLOSE){
+      fdset(np, a->fd, 0);
+      fileclose(f);
+    } else if(a->op == SPAWN_DUP2){
+      if(a->newfd == a->fd)
+        continue;
+      old = fdget(np, a->newfd);
+      if(fdset(np, a->newfd, f) < 0)
+        goto bad;
+      filedup(f);
+      if(old)
+        fileclose(old);
+    } else
+      goto bad;
+  }
+
+  if(execnew(np, path, argv) < 0)
+    goto bad;
+  np->cpu = proc->cpu;
+  np->cpumask = proc->cpumask;
+  np->parent = proc;
+  np->cwd = idup(proc->cwd);
+
+  pid = np->pid;
+  acquire(&ptable.lock);
+  np->sibling = proc->child;
+  proc->child = np;
+  runnable(np);
+  release(&ptable.lock);
+  return pid;
+
+bad:
+  fdcloseall(np);
+  acquire(&ptable.lock);
+  freeproc(np);
+  release(&ptable.lock);
+  return -1;
+}
+
+// Park the caller as a template: spawn_from starts copy-on-write
+// clones of it as it is now, each returning from this call with
+// argc, and argv stored at user address argvp if that isn't 0.
+// The template itself returns, -1, only once killed and no
+// spawn_from is still copying it.
+int
+mktemplate(uint argvp)
+{
+  acquire(&ptable.lock);
+  proc->tmpl = 1;
+  proc->tmplargv = argvp;
+  while(!proc->killed || proc->tmplbusy)
+    sleep(&proc->tmpl, &ptable.lock);
+  proc->tmpl = 0;
+  release(&ptable.lock);
+  return -1;
+}
+
+// Let template t go, if it was killed, once no spawn_from is
+// copying it.
+static void
+tmplput(struct proc *t)
+{
+  acquire(&ptable.lock);
+  if(--t->tmplbusy == 0)
+    wakeup1(&t->tmpl);
+  release(&ptable.lock);
+}
+
+// Start a child of the caller that is a clone of the template
+// pid, with argv pushed on the template's stack, which they must
+// fit in the page of.  The child skips exec and whatever the
+// template did to start up; it has the caller's open files and
+// current directory.  Returns its pid, or -1 if pid isn't a
+// template.
+int
+spawn_from(int pid, char **argv)
+{
+  struct proc *t, *np;
+  uint argc, sp, lim, uargv[MAXARG+1];
+
+  acquire(&ptable.lock);
+  if((t = findproc(pid)) == 0 || !t->tmpl || t->killed){
+    release(&ptable.lock);
+    return -1;
+  }
+  t->tmplbusy++;  // t stays as it is until we're done
+  release(&ptable.lock);
+
+  if((np = allocproc()) == 0){
+    tmplput(t);
+    return -1;
+  }
+  if((np->pgdir = copyuvm(t->pgdir, t->sz)) == 0 ||
+     mapvdso(np->pgdir, np) < 0)
+    goto bad;
+  np->sz = t->sz;
+  np->rss = np->maxrss = t->rss;
+  *np->tf = *t->tf;
+
+  // The arguments, as exec lays them out but for the fake return
+  // PC, argc and argv: mktemplate returns those.
+  sp = np->tf->esp;
+  lim = (uint)PGROUNDDOWN(sp);
+  for(argc = 0; argv[argc]; argc++){
+    if(argc >= MAXARG)
+      goto bad;
+    sp -= strlen(argv[argc]) + 1;
+    sp &= ~3;
+    if(sp < lim || copyoutp(np, sp, argv[argc], strlen(argv[argc]) + 1) < 0)
+      goto bad;
+    uargv[argc] = sp;
+  }
+  uargv[argc] = 0;
+  sp -= (argc+1) * 4;
+  if(sp < lim || copyoutp(np, sp, uargv, (argc+1) * 4) < 0)
+    goto bad;
+  if(t->tmplargv && copyoutp(np, t->tmplargv, &sp, 4) < 0)
+    goto bad;
+  np->tf->esp = sp;
+  np->tf->eax = argc;
+
+  if(fdcopy(np, proc->ofile, proc->nofile) < 0)
+    goto bad;
+  np->cwd = idup(proc->cwd);
+  np->exe = t->exe ? idup(t->exe) : 0;
+  memmove(np->seg, t->seg, sizeof(np->seg));
+  mmapfork(np, t);
+  np->cpu = proc->cpu;
+  np->cpumask = t->cpumask;
+  np->parent = proc;
+  safestrcpy(np->name, t->name, sizeof(t->name));
+
+  pid = np->pid;
+  acquire(&ptable.lock);
+  np->sibling = proc->child;
+  proc->child = np;
+  runnable(np);
+  release(&ptable.lock);
+  tmplput(t);
+  return pid;
+
+bad:
+  if(np->pgdir)
+    freevm(np->pgdir);
+  acquire(&ptable.lock);
+  freeproc(np);
+  release(&ptable.lock);
+  tmplput(t);
+  return -1;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -166,21 +869,23 @@ void
 exit(void)
 {
   struct proc *p;
-  int fd;
 
   if(proc == initproc)
     panic("init exiting");
 
   // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd]){
-      fileclose(proc->ofile[fd]);
-      proc->ofile[fd] = 0;
-    }
-  }
+  fdcloseall(proc);
 
+  mmapclear(proc);
+
+  begin_op();
   iput(proc->cwd);
+  if(proc->exe)
+    iput(proc->exe);
+  end_op();
   proc->cwd = 0;
+  proc->exe = 0;
+  memset(proc->seg, 0, sizeof(proc->seg));
 
   acquire(&ptable.lock);
 
@@ -188,11 +893,15 @@ exit(void)
   wakeup1(proc->parent);
 
   // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == proc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+  for(p = proc->child; p; p = p->sibling){
+    p->parent = initproc;
+    if(p->state == ZOMBIE)
+      wakeup1(initproc);
+    if(p->sibling == 0){
+      p->sibling = initproc->child;
+      initproc->child = proc->child;
+      proc->child = 0;
+      break;
     }
   }
 
@@ -207,28 +916,20 @@ exit(void)
 int
 wait(void)
 {
-  struct proc *p;
+  struct proc *p, **pp;
   int havekids, pid;
 
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for zombie children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
-        continue;
-      havekids = 1;
+    // Scan through our children looking for zombies.
+    havekids = proc->child != 0;
+    for(pp = &proc->child; (p = *pp) != 0; pp = &p->sibling){
       if(p->state == ZOMBIE){
         // Found one.
+        *pp = p->sibling;
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
         freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
+        freeproc(p);
         release(&ptable.lock);
         return pid;
       }
@@ -245,6 +946,21 @@ wait(void)
   }
 }
 
+// Count the cycles since t0, in microseconds, in histogram h.
+static void
+schedhistadd(uint *h, uint64 t0)
+{
+  uint64 us;
+  int k;
+
+  if(tsckhz == 0)
+    return;
+  us = div64((rdtsc() - t0) * 1000, tsckhz, 0);
+  for(k = 0; k < NSCHEDHIST-1 && (us >>= 1) != 0; k++)
+    ;
+  h[k]++;
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
@@ -256,32 +972,47 @@ void
 scheduler(void)
 {
   struct proc *p;
+  uint64 t;
 
   for(;;){
     // Enable interrupts on this processor.
     sti();
+    rcuqs();
 
-    // Loop over process table looking for process to run.
+    if((p = runqget()) == 0){
+      // Nothing to run: clear a page for kalloc_zeroed, or
+      // halt until something happens.
+      if(!kzerofill())
+        idle();
+      continue;
+    }
+
+    // Switch to chosen process.  It is the process's job
+    // to release ptable.lock and then reacquire it
+    // before jumping back to us.  Taking ptable.lock also
+    // waits for p's last CPU to finish switching away from it.
     acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
+    if(p->state != RUNNABLE)
+      panic("scheduler: not runnable");
+    proc = p;
+    p->cpu = cpu - cpus;
+    cpu->resched = 0;
+    switchuvm(p);
+    p->state = RUNNING;
+    TRACE(TR_SWITCHIN, p->pid, 0);
+    schedhistadd(schedhist[cpu - cpus].rqdelay, p->tqueued);
+    pmcload(p);
+    t = rdtsc();
+    swtch(&cpu->scheduler, proc->context);
+    schedhistadd(schedhist[cpu - cpus].slice, t);
+    pmcsave(p);
+    TRACE(TR_SWITCHOUT, p->pid, p->state);
+    switchkvm();
 
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-      swtch(&cpu->scheduler, proc->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      proc = 0;
-    }
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    proc = 0;
     release(&ptable.lock);
-
   }
 }
 
@@ -300,6 +1031,11 @@ sched(void)
     panic("sched running");
   if(readeflags()&FL_IF)
     panic("sched interruptible");
+  if(proc->state == RUNNABLE)
+    proc->ivcsw++;
+  else
+    proc->vcsw++;
+  proc->lastrun = ticks;
   intena = cpu->intena;
   swtch(&proc->context, cpu->scheduler);
   cpu->intena = intena;
@@ -310,11 +1046,25 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  proc->state = RUNNABLE;
+  runnable(proc);
   sched();
   release(&ptable.lock);
 }
 
+// A preemption point: yield if this CPU has been asked to
+// reschedule, by the timer or by a wakeup of a higher level
+// process.  Interrupts return through trap, which checks too,
+// but a wakeup from another CPU only sets the flag, so long
+// loops in the kernel (freeing a big file, scanning the bitmap,
+// sharing an address space in fork) call this between steps.
+// The caller must hold no spinlock.
+void
+cond_resched(void)
+{
+  if(proc && cpu->ncli == 0 && cpu->resched)
+    yield();
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -322,6 +1072,13 @@ forkret(void)
 {
   // Still holding ptable.lock from scheduler.
   release(&ptable.lock);
+
+  if(proc == initproc){
+    // Recovery reads the disk, which needs a process
+    // to sleep, so it cannot be run from main.  Only
+    // init gets here before any file system call.
+    initlog();
+  }
   
   // Return to "caller", actually trapret (see allocproc).
 }
@@ -351,6 +1108,10 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   proc->chan = chan;
   proc->state = SLEEPING;
+  proc->sqprev = SLEEPQ(chan);
+  if((proc->sqnext = *proc->sqprev) != 0)
+    proc->sqnext->sqprev = &proc->sqnext;
+  *proc->sqprev = proc;
   sched();
 
   // Tidy up.
@@ -363,16 +1124,149 @@ sleep(void *chan, struct spinlock *lk)
   }
 }
 
+// Put p on the timer wheel for p->wakeat.  A deadline beyond
+// the wheel's span is filed at the far end and put back then.
+// Caller holds ptable.lock.
+static void
+twadd(struct proc *p)
+{
+  uint key;
+  int l;
+
+  key = p->wakeat;
+  if(key - twheel.now >= TWSPAN)
+    key = twheel.now + TWSPAN - 1;
+  for(l = 0; l < TWLEVELS-1 && key - twheel.now >= 1U << TWBITS*(l+1); l++)
+    ;
+  p->twprev = &twheel.slot[l][(key >> TWBITS*l) & (TWSLOTS-1)];
+  if((p->twnext = *p->twprev) != 0)
+    p->twnext->twprev = &p->twnext;
+  *p->twprev = p;
+}
+
+// Take p off the timer wheel.  Caller holds ptable.lock.
+static void
+twdel(struct proc *p)
+{
+  if((*p->twprev = p->twnext) != 0)
+    p->twnext->twprev = p->twprev;
+  p->twprev = 0;
+}
+
+// Sleep until n ticks from now.  Returns -1 if killed first.
+int
+sleepticks(uint n)
+{
+  int r;
+
+  if(n == 0)
+    return 0;
+  acquire(&ptable.lock);
+  proc->wakeat = ticks + n;
+  twadd(proc);
+  while(proc->twprev && !proc->killed)
+    sleep(&proc->wakeat, &ptable.lock);
+  r = 0;
+  if(proc->twprev){
+    twdel(proc);
+    r = -1;
+  }
+  release(&ptable.lock);
+  return r;
+}
+
+// Tell p, in poll, that something it waits on may be ready.
+void
+pollnotify(struct proc *p)
+{
+  acquire(&ptable.lock);
+  p->pollwoken = 1;
+  if(p->state == SLEEPING && p->chan == &p->wakeat)
+    unsleep(p);
+  release(&ptable.lock);
+}
+
+// Sleep until pollnotify, a kill, or tick deadline if nonzero.
+// Caller clears proc->pollwoken before looking at its files,
+// so a notify that comes in between isn't lost.
+void
+pollsleep(uint deadline)
+{
+  acquire(&ptable.lock);
+  if(deadline){
+    if((int)(deadline - ticks) <= 0){
+      release(&ptable.lock);
+      return;
+    }
+    proc->wakeat = deadline;
+    twadd(proc);
+  }
+  while(!proc->pollwoken && !proc->killed && (deadline == 0 || proc->twprev))
+    sleep(&proc->wakeat, &ptable.lock);
+  if(proc->twprev)
+    twdel(proc);
+  release(&ptable.lock);
+}
+
+// Called on each clock tick: wake the processes whose
+// deadlines have come.
+void
+timertick(void)
+{
+  struct proc *p, *next, **slot;
+  uint t;
+  int l;
+
+  acquire(&ptable.lock);
+  while(twheel.now != ticks){
+    t = ++twheel.now;
+    // Move slots whose span starts now down a level, top first.
+    for(l = TWLEVELS-1; l > 0; l--){
+      if(t & ((1U << TWBITS*l) - 1))
+        continue;
+      slot = &twheel.slot[l][(t >> TWBITS*l) & (TWSLOTS-1)];
+      p = *slot;
+      *slot = 0;
+      for(; p; p = next){
+        next = p->twnext;
+        twadd(p);
+      }
+    }
+    slot = &twheel.slot[0][t & (TWSLOTS-1)];
+    p = *slot;
+    *slot = 0;
+    for(; p; p = next){
+      next = p->twnext;
+      p->twprev = 0;
+      if(p->state == SLEEPING && p->chan == &p->wakeat)
+        unsleep(p);
+    }
+  }
+  release(&ptable.lock);
+}
+
+// Take SLEEPING p off its sleep queue and make it RUNNABLE.
+// The ptable lock must be held.
+static void
+unsleep(struct proc *p)
+{
+  if((*p->sqprev = p->sqnext) != 0)
+    p->sqnext->sqprev = p->sqprev;
+  runnable(p);
+}
+
 // Wake up all processes sleeping on chan.
 // The ptable lock must be held.
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
+  struct proc *p, *next;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(p = *SLEEPQ(chan); p; p = next){
+    next = p->sqnext;
+    if(p->chan == chan)
+      unsleep(p);
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -384,6 +1278,26 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Let process pid run only on the CPUs in mask, bit i standing
+// for cpus[i].  A running process moves when it next yields or
+// sleeps.  Returns -1 if there is no such process or mask has no
+// CPU in it.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+
+  if(ncpu < 32)
+    mask &= (1 << (ncpu > 0 ? ncpu : 1)) - 1;
+  if(mask == 0)
+    return -1;
+  acquire(&ptable.lock);
+  if((p = findproc(pid)) != 0)
+    p->cpumask = mask;
+  release(&ptable.lock);
+  return p ? 0 : -1;
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
@@ -392,24 +1306,26 @@ kill(int pid)
 {
   struct proc *p;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
+  rcu_read_lock();
+  if((p = findproc(pid)) != 0){
+    acquire(&ptable.lock);
+    if(p->state != UNUSED){
       p->killed = 1;
       // Wake process from sleep if necessary.
       if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+        unsleep(p);
+    } else
+      p = 0;
+    release(&ptable.lock);
   }
-  release(&ptable.lock);
-  return -1;
+  rcu_read_unlock();
+  return p ? 0 : -1;
 }
 
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// No lock to avoid wedging a stuck machine further; the
+// processes stay valid under rcu_read_lock.
 void
 procdump(void)
 {
@@ -426,7 +1342,8 @@ procdump(void)
   char *state;
   uint pc[10];
   
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+  rcu_read_lock();
+  for(p = ptable.list; p; p = p->allnext){
     if(p->state == UNUSED)
       continue;
     if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
@@ -441,6 +1358,254 @@ procdump(void)
     }
     cprintf("\n");
   }
+  rcu_read_unlock();
+}
+
+// Give the current process the page table pgdir, and return
+// its old one for the caller to free.  getprocs walks other
+// processes' page tables under ptable.lock, so take it here.
+pde_t*
+swappgdir(pde_t *pgdir)
+{
+  pde_t *old;
+
+  acquire(&ptable.lock);
+  old = proc->pgdir;
+  proc->pgdir = pgdir;
+  release(&ptable.lock);
+  return old;
+}
+
+// A clock hand over user memory: a process, by pid, and an
+// address in it.  Guarded by ptable.lock.
+struct hand {
+  int pid;
+  uint va;
+};
+
+static struct hand swaphand;  // swapreclaim's
+static struct hand ksmhand;   // ksmscan's
+
+// May swapreclaim take p's pages?  Not while it is in a system
+// call or fault, whose kernel code may be using them, nor while
+// it runs, unless it is the caller faulting from user space.
+// Caller holds ptable.lock, so that p can't start running.
+static int
+swappable(struct proc *p)
+{
+  if(p->pgdir == 0 || p->kthread)
+    return 0;
+  if(p == proc)
+    return p->ufault && p->pinned == 1;
+  return (p->state == RUNNABLE || p->state == SLEEPING) && p->pinned == 0;
+}
+
+// May ksmscan merge p's pages?  Merging only makes a page
+// read-only, with the same contents, so kernel code using it
+// in a system call at worst takes a copy-on-write fault; p
+// just mustn't be running.  Caller holds ptable.lock.
+static int
+mergeable(struct proc *p)
+{
+  if(p->pgdir == 0 || p->kthread || p->tmpl)
+    return 0;
+  return p->state == RUNNABLE || p->state == SLEEPING;
+}
+
+// The process at h that ok allows, or the next one by pid,
+// wrapping around to the first (and then setting *wrapped if
+// wrapped isn't 0).  Moves h to its start if h was elsewhere.
+// Returns 0 if there is none.  Caller holds ptable.lock.
+static struct proc*
+handproc(struct hand *h, int (*ok)(struct proc*), int *wrapped)
+{
+  struct proc *p, *q;
+
+  p = 0;
+  for(q = ptable.list; q; q = q->allnext)
+    if(q->pid >= h->pid && ok(q) && (p == 0 || q->pid < p->pid))
+      p = q;
+  if(p == 0){
+    for(q = ptable.list; q; q = q->allnext)
+      if(ok(q) && (p == 0 || q->pid < p->pid))
+        p = q;
+    if(p && wrapped)
+      *wrapped = 1;
+  }
+  if(p && p->pid != h->pid){
+    h->pid = p->pid;
+    h->va = USERBASE;
+  }
+  return p;
+}
+
+// Swap out up to n user pages to free memory, choosing them
+// with a clock over the processes in pid order, and return how
+// many.  Each is written out after ptable.lock is released;
+// a fault meanwhile takes it back (see swap.c).
+int
+swapreclaim(int n)
+{
+  struct proc *p;
+  pte_t *pte;
+  char *pa;
+  int got, moves, slot;
+
+  got = 0;
+  for(moves = 0; got < n && moves <= 2*ptable.n; ){
+    acquire(&ptable.lock);
+    if((p = handproc(&swaphand, swappable, 0)) == 0){
+      release(&ptable.lock);
+      break;
+    }
+    if((pte = uvmvictim(p->pgdir, &swaphand.va, p->sz)) == 0){
+      swaphand.pid = p->pid + 1;
+      moves++;
+      release(&ptable.lock);
+      continue;
+    }
+    pa = (char*)PTE_ADDR(*pte);
+    if((slot = swapalloc(pa)) < 0){
+      release(&ptable.lock);
+      break;
+    }
+    *pte = SWAPPTE(slot, *pte);
+    if(p->rss > 0)
+      p->rss--;
+    if(p == proc)
+      lcr3(PADDR(p->pgdir));
+    release(&ptable.lock);
+    swapwrite(slot, pa);
+    got++;
+  }
+  return got;
+}
+
+// Offer ksmpage up to n private user pages of processes whose
+// pages can be merged, going on from where the last call stopped.
+// Returns 1 if it came round to the first process again.
+int
+ksmscan(int n)
+{
+  struct proc *p;
+  pte_t *pte;
+  int wrapped, moves;
+
+  wrapped = 0;
+  acquire(&ptable.lock);
+  for(moves = 0; n > 0 && moves <= ptable.n; ){
+    if((p = handproc(&ksmhand, mergeable, &wrapped)) == 0)
+      break;
+    if((pte = uvmnext(p->pgdir, &ksmhand.va, p->sz)) == 0){
+      ksmhand.pid = p->pid + 1;
+      moves++;
+      continue;
+    }
+    ksmpage(pte, p->pid, ksmhand.va - PGSIZE);
+    n--;
+  }
+  release(&ptable.lock);
+  return wrapped;
 }
 
+// The PTE of the present user page at va of process pid, if
+// its pages can be merged now, else 0.  Caller holds ptable.lock.
+pte_t*
+ksmpte(int pid, uint va)
+{
+  struct proc *p;
+
+  if((p = findproc(pid)) == 0 || !mergeable(p) || va >= p->sz)
+    return 0;
+  return uvmpte(p->pgdir, va);
+}
+
+// Copy process pid's per-call counts, NSYSCALL of them, into
+// counts.  Returns -1 if there is no such process.
+int
+getsyscounts(int pid, uint *counts)
+{
+  struct proc *p;
 
+  acquire(&ptable.lock);
+  if((p = findproc(pid)) != 0)
+    memmove(counts, p->syscount, sizeof(p->syscount));
+  release(&ptable.lock);
+  return p ? 0 : -1;
+}
+
+// Fill in table, kernel memory with room for NPROC entries, with
+// the processes in use.  Returns how many there are.  The walk
+// takes no lock; only reading a page table does, since exec and
+// wait free them under ptable.lock.
+int
+getprocs(struct ProcessInfo *table)
+{
+  struct proc *p;
+  struct ProcessInfo *pi;
+
+  pi = table;
+  rcu_read_lock();
+  for(p = ptable.list; p; p = p->allnext){
+    if(p->state == UNUSED || p->state == EMBRYO)
+      continue;
+    pi->pid = p->pid;
+    pi->ppid = p->parent ? p->parent->pid : -1;
+    pi->state = p->state;
+    pi->sz = p->sz;
+    safestrcpy(pi->name, p->name, sizeof(pi->name));
+    acquire(&ptable.lock);
+    if(p->state == UNUSED){
+      release(&ptable.lock);
+      continue;
+    }
+    pi->rss = uvmrss(p->pgdir, &pi->shared, &pi->ptpages);
+    release(&ptable.lock);
+    if(pi->rss > p->maxrss)
+      p->maxrss = pi->rss;
+    pi->maxrss = p->maxrss;
+    pi->minflt = p->minflt;
+    pi->majflt = p->majflt;
+    pi->priority = p->prio;
+    pi->ticks = p->ticks;
+    pi->cpu = p->cpu;
+    pi->cpumask = p->cpumask;
+    pi++;
+  }
+  rcu_read_unlock();
+  return pi - table;
+}
+
+// Fill in up to n entries of table with the running totals of
+// the processes in use that have run since tick since, or of all
+// of them if since is 0.  Sampling with since set to the last
+// sample's tick copies only what can have changed.  Returns how
+// many it filled in.
+int
+getprocstat(struct ProcStat *table, int n, uint since)
+{
+  struct proc *p;
+  struct ProcStat *ps;
+
+  ps = table;
+  rcu_read_lock();
+  for(p = ptable.list; p && ps < table + n; p = p->allnext){
+    if(p->state == UNUSED || p->state == EMBRYO)
+      continue;
+    if(since && p->state != RUNNING && (int)(p->lastrun - since) < 0)
+      continue;
+    ps->pid = p->pid;
+    ps->state = p->state;
+    safestrcpy(ps->name, p->name, sizeof(ps->name));
+    ps->uticks = p->uticks;
+    ps->sticks = p->ticks - p->uticks;
+    ps->vcsw = p->vcsw;
+    ps->ivcsw = p->ivcsw;
+    ps->syscalls = p->nsyscall;
+    ps->bio = p->nbio;
+    ps->lastrun = p->lastrun;
+    ps++;
+  }
+  rcu_read_unlock();
+  return ps - table;
+}
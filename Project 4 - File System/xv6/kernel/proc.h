@@ -1,29 +1,43 @@
 #ifndef _PROC_H_
 #define _PROC_H_
+#include "rcu.h"
+
 // Segments in proc->gdt.
 // Also known to bootasm.S and trapasm.S
 #define SEG_KCODE 1  // kernel code
 #define SEG_KDATA 2  // kernel data+stack
-#define SEG_KCPU  3  // kernel per-cpu data
-#define SEG_UCODE 4  // user code
-#define SEG_UDATA 5  // user data+stack
+// sysexit wants the user segments right after the kernel's.
+#define SEG_UCODE 3  // user code
+#define SEG_UDATA 4  // user data+stack
+#define SEG_KCPU  5  // kernel per-cpu data
 #define SEG_TSS   6  // this process's task state
-#define NSEGS     7
+#define SEG_DFTSS 7  // double fault task state
+#define NSEGS     8
 
-// Per-CPU state
+// Per-CPU state.  Each CPU's is padded to whole cache lines, so
+// its pushcli and scheduler stores don't steal another's line.
 struct cpu {
   uchar id;                    // Local APIC ID; index into cpus[] below
   struct context *scheduler;   // swtch() here to enter scheduler
   struct taskstate ts;         // Used by x86 to find stack for interrupt
+  struct taskstate dfts;       // Double fault task; see idtinit
   struct segdesc gdt[NSEGS];   // x86 global descriptor table
   volatile uint booted;        // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  volatile uint idle;          // Halted in scheduler(); see wakeidle
+  uint pmcon;                  // Counters running for proc; see perf.c
+  uint ticks;                  // Timer interrupts taken; see clockkstat
+  uint uticks;                 // ... of them in user mode
+  uint64 clitsc;               // When pushcli turned interrupts off; see latency.c
+  uint clipcs[10];             // ... and from where
+  volatile uint rcugp;         // Grace period it was last in scheduler in; see rcu.c
+  volatile uint resched;       // A process should run in place of proc; see cond_resched
 
   // Cpu-local storage variables; see below
   struct cpu *cpu;
   struct proc *proc;           // The currently-running process.
-};
+} __attribute__((aligned(CACHELINE)));
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
@@ -59,21 +73,96 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// A file region mapped by mmap.  Its pages are read in from
+// the file on first touch (see mmapfault).
+struct vma {
+  uint addr;                   // First address, page-aligned; 0 if unused
+  uint len;                    // Bytes mapped
+  uint off;                    // File offset mapped at addr
+  struct file *f;              // File the pages come from
+  int seq;                     // MADV_SEQUENTIAL: read ahead on faults
+  uint raend;                  // File offset read ahead to, if seq
+};
+
+// A loadable segment of the running program.  Its pages are
+// read in from proc->exe on first touch (see execfault).
+struct seg {
+  uint va;                     // First address
+  uint filesz;                 // Bytes read from the file
+  uint memsz;                  // Bytes in memory, the rest zero; 0 if unused
+  uint off;                    // File offset of va
+};
+
+// Per-process state.  The fields scheduler, runnable, sleep and
+// wakeup use come first and fill one cache line; the proc cache
+// aligns procs to lines (see kmem_cache_create), so the run and
+// sleep queue walks touch that line of each proc and no other.
 struct proc {
+  enum procstate state;        // Process state
+  volatile int pid;            // Process ID
+  void *chan;                  // If non-zero, sleeping on chan
+  int killed;                  // If non-zero, have been killed
+  int cpu;                     // CPU it last ran on (index into cpus)
+  uint cpumask;                // CPUs it may run on
+  int prio;                    // Scheduler level, 0 highest
+  int kthread;                 // Kernel thread; never drops a level
+  uint slice;                  // Ticks run at this level
+  struct proc *rqnext;         // Next on its run queue, if RUNNABLE
+  struct context *context;     // swtch() here to run process
+  struct proc *sqnext;         // Next on its sleep queue, if SLEEPING
+  struct proc **sqprev;        // What points to it there
+  uint64 tqueued;              // rdtsc when it went on the run queue
+  uint wakeat;                 // Tick to wake at, in sleepticks
+
   uint sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
-  enum procstate state;        // Process state
-  volatile int pid;            // Process ID
   struct proc *parent;         // Parent process
+  struct proc *child;          // First of its children
+  struct proc *sibling;        // Next child of its parent
+  struct proc *pidnext;        // Next in its pid hash chain
+  struct proc *allnext;        // Next in ptable.list
+  struct proc **allprev;       // What points to it there
   struct trapframe *tf;        // Trap frame for current syscall
-  struct context *context;     // swtch() here to run process
-  void *chan;                  // If non-zero, sleeping on chan
-  int killed;                  // If non-zero, have been killed
-  struct file *ofile[NOFILE];  // Open files
+  struct proc *slnext;         // Next waiting for its sleeplock
+  int slwait;                  // Waiting for a sleeplock to be handed over
+  int slshared;                // ... to share with other readers
+  struct proc *twnext;         // Next in its timer wheel slot
+  struct proc **twprev;        // What points to it there; 0 if off
+  int pollwoken;               // Something it polls became ready
+  uint ticks;                  // Ticks run in all
+  uint uticks;                 // Of those, ticks in user mode
+  uint lastrun;                // Tick it last ran at
+  uint vcsw;                   // Times it gave up the CPU to wait
+  uint ivcsw;                  // Times it was made to give up the CPU
+  uint nsyscall;               // System calls made
+  uint nbio;                   // Disk blocks read or written for it
+  int plugged;                 // blkplug depth
+  struct buf *plug;            // Requests held back by blkplug
+  int nplug;                   // ... how many
+  struct file **ofile;         // Open files, nofile slots
+  int nofile;                  // NOFILE, or NOFILEMAX once grown
+  uint fdmap[NOFILEMAX/32];    // Bit fd set if ofile[fd] is in use
+  struct file *ofile0[NOFILE]; // ofile until the table grows
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  uint mmapbase;               // Lowest mmap address; the heap stops here
+  struct vma vma[NVMA];        // mmap regions
+  struct inode *exe;           // Program file, or 0
+  struct seg seg[NSEG];        // Its segments
+  uint rss;                    // Resident user pages, roughly (see uvmfault)
+  uint maxrss;                 // Peak of rss
+  uint minflt;                 // Page faults served from memory
+  uint majflt;                 // Page faults that read a file or swap
+  int pinned;                  // In a system call or fault; don't swap its pages
+  int ufault;                  // In a fault from user space
+  uint syscount[NSYSCALL];     // Calls made of each system call
+  uint pmcsel[NPMC];           // perfctr events it counts; 0 if unused
+  struct vproc *vproc;         // Its vdso page (see vdso.c)
+  int tmpl;                    // Parked in mktemplate for spawn_from
+  uint tmplargv;               // Where its clones find argv, or 0
+  int tmplbusy;                // spawn_froms copying it now
+  struct rcuhead rcu;          // Frees it once lock-free readers are done
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -81,5 +170,7 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   ...
+//   mmap regions, allocated downward from USERTOP
 
 #endif // _PROC_H_
@@ -0,0 +1,108 @@
+// Sampling profiler.
+//
+// While it is on, each timer interrupt records where its CPU was
+// in that CPU's ring, with the kernel call stack if PROF_STACK is
+// set.  Only the CPU itself adds to its ring, with interrupts
+// off, so taking a sample needs no lock; readers take proflock
+// among themselves.  A full ring drops samples until profread
+// drains it.  Code that runs with interrupts off is never seen,
+// and an idle CPU, having stopped its tick, takes no samples.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "ProfSample.h"
+
+static struct {
+  volatile uint head;    // Next to read
+  volatile uint tail;    // Next to write
+  struct ProfSample s[NPROFSAMPLE];
+} __attribute__((aligned(CACHELINE))) rings[NCPU];
+
+static struct spinlock proflock __attribute__((aligned(CACHELINE)));
+int profflags;
+static uint profdropped;
+
+void
+profinit(void)
+{
+  initlock(&proflock, "prof");
+}
+
+// Record a sample of this CPU from the timer interrupt's tf.
+void
+profsample(struct trapframe *tf)
+{
+  struct ProfSample *s;
+  int c;
+
+  c = cpu - cpus;
+  if(rings[c].tail - rings[c].head == NPROFSAMPLE){
+    profdropped++;
+    return;
+  }
+  s = &rings[c].s[rings[c].tail % NPROFSAMPLE];
+  s->eip = tf->eip;
+  s->pid = proc ? proc->pid : 0;
+  s->cpu = c;
+  s->user = (tf->cs&3) == DPL_USER;
+  if((profflags & PROF_STACK) && !s->user)
+    getcallerpcs((uint*)tf->ebp + 2, s->pcs);
+  else
+    s->pcs[0] = 0;
+  __sync_synchronize();  // the sample before the tail that shows it
+  rings[c].tail++;
+}
+
+// Start the profiler with flags, emptying the rings, or stop it
+// if flags is 0.  Returns how many samples were dropped for a
+// full ring since it last started.
+int
+profctl(int flags)
+{
+  uint dropped;
+  int c;
+
+  acquire(&proflock);
+  dropped = profdropped;
+  if(flags){
+    profflags = 0;
+    for(c = 0; c < ncpu; c++)
+      rings[c].head = rings[c].tail;
+    profdropped = 0;
+  }
+  profflags = flags ? flags | PROF_ON : 0;
+  release(&proflock);
+  return dropped;
+}
+
+// Move up to n samples, oldest first on each CPU, to buf, which
+// caller has checked is n samples of user memory.  Returns how
+// many, or -1 if the profiler is off and there are none left.
+int
+profread(struct ProfSample *buf, int n)
+{
+  struct ProfSample s;
+  int c, got;
+
+  acquire(&proflock);
+  got = 0;
+  for(c = 0; c < ncpu && got < n; c++){
+    while(got < n && rings[c].head != rings[c].tail){
+      s = rings[c].s[rings[c].head % NPROFSAMPLE];
+      __sync_synchronize();  // copy the sample before freeing its slot
+      rings[c].head++;
+      release(&proflock);  // buf may fault
+      buf[got++] = s;
+      acquire(&proflock);
+    }
+  }
+  if(got == 0 && profflags == 0)
+    got = -1;
+  release(&proflock);
+  return got;
+}
@@ -0,0 +1,92 @@
+// Memory-backed disk, device RAMDEV, for scratch files.
+//
+// Its file system starts as the image ramfs, made by mkfs and
+// linked into the kernel the way initcode is, with its trailing
+// zero blocks cut off.  The image is never written: a block's
+// page is copied into a kalloc() page the first time a block in
+// it is written, and reads look there first.  Nothing is kept
+// across a reboot.
+//
+// The block layer sends the bufs of RAMDEV here, and log_write
+// writes them at once rather than through the log, so a
+// transaction on this disk costs only memory copies.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "buf.h"
+#include "fs.h"
+
+#define BPP (PGSIZE / BSIZE)  // blocks per page
+#define NRAMPAGE (PGSIZE / sizeof(char*))  // one page of page pointers
+
+extern uchar _binary_ramfs_start[], _binary_ramfs_size[];
+
+static struct {
+  struct spinlock lock;
+  uint nblocks;
+  uint seedsize;   // bytes of the image
+  char **page;     // page i holds blocks i*BPP up, or 0 if unwritten
+} ram __attribute__((aligned(CACHELINE)));
+
+void
+ramdiskinit(void)
+{
+  struct superblock *sb;
+
+  initlock(&ram.lock, "ramdisk");
+  ram.seedsize = (uint)_binary_ramfs_size;
+  if(ram.seedsize < 2*BSIZE)
+    panic("ramdiskinit: no image");
+  sb = (struct superblock*)(_binary_ramfs_start + BSIZE);
+  ram.nblocks = sb->size;
+  if(ram.nblocks > NRAMPAGE * BPP)
+    panic("ramdiskinit: image too large");
+  if((ram.page = (char**)kalloc_zeroed()) == 0)
+    panic("ramdiskinit: out of memory");
+}
+
+// Copy n bytes of the image from offset off into dst, with
+// zeros past its end.
+static void
+ramseed(char *dst, uint off, uint n)
+{
+  uint m;
+
+  m = 0;
+  if(off < ram.seedsize)
+    m = ram.seedsize - off < n ? ram.seedsize - off : n;
+  memmove(dst, _binary_ramfs_start + off, m);
+  memset(dst + m, 0, n - m);
+}
+
+// Read or write b at once; the block layer marks it done.
+void
+ramdiskrw(struct buf *b)
+{
+  char *pg;
+  uint i, off;
+
+  if(b->sector >= ram.nblocks)
+    panic("ramdiskrw: block past end of disk");
+  i = b->sector / BPP;
+  off = (b->sector % BPP) * BSIZE;
+  acquire(&ram.lock);
+  pg = ram.page[i];
+  if(b->flags & B_DIRTY){
+    if(pg == 0){
+      if((pg = kalloc()) == 0)
+        panic("ramdiskrw: out of memory");
+      ramseed(pg, i * PGSIZE, PGSIZE);
+      ram.page[i] = pg;
+    }
+    memmove(pg + off, b->data, BSIZE);
+  } else if(pg)
+    memmove(b->data, pg + off, BSIZE);
+  else
+    ramseed((char*)b->data, b->sector * BSIZE, BSIZE);
+  release(&ram.lock);
+}
@@ -0,0 +1,109 @@
+// Read-copy update: lookups that take no lock.
+//
+// A reader brackets its walk of a list with rcu_read_lock and
+// rcu_read_unlock, which turn interrupts off, so it can't be
+// switched away from its CPU mid-walk.  Writers still take the
+// list's lock.  They publish new entries with rcu_assign, unlink
+// old ones without clearing their next pointers, so a reader
+// standing on one walks on, and free them with call_rcu, which
+// waits for a grace period: a time in which every CPU has gone
+// through scheduler(), or sat halted in idle, and so is done
+// with any walk begun before it.
+//
+// scheduler calls rcuqs each time round its loop.  Callbacks
+// wait on rcu.next for a grace period to start, then on rcu.cur
+// for it to end, and run in the scheduler of the CPU that sees
+// it end.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "rcu.h"
+
+static struct {
+  struct spinlock lock;
+  volatile uint gp;            // Current grace period
+  volatile int busy;           // ... and it hasn't ended
+  struct rcuhead *next;        // Callbacks for the next one
+  struct rcuhead *cur;         // Callbacks for the current one
+} rcu __attribute__((aligned(CACHELINE)));
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+}
+
+// Start a lock-free walk.  The reader may not sleep until
+// rcu_read_unlock.  A halted CPU counts as outside any walk,
+// so an interrupt handler that walks on one ends that first;
+// the xchg orders it before the walk's loads.
+void
+rcu_read_lock(void)
+{
+  pushcli();
+  if(cpu->idle)
+    xchg(&cpu->idle, 0);
+}
+
+void
+rcu_read_unlock(void)
+{
+  popcli();
+}
+
+// Run fn(arg) after a grace period, once readers can no longer
+// see what the caller has unlinked.  Safe with any locks held;
+// fn runs with none.
+void
+call_rcu(struct rcuhead *h, void (*fn)(void*), void *arg)
+{
+  h->fn = fn;
+  h->arg = arg;
+  acquire(&rcu.lock);
+  h->next = rcu.next;
+  rcu.next = h;
+  release(&rcu.lock);
+}
+
+// This CPU is in scheduler, outside any walk: note it for the
+// current grace period, end that if every CPU has done the same
+// or is halted, start the next if callbacks wait for it, and run
+// the callbacks of the one that ended.
+void
+rcuqs(void)
+{
+  struct rcuhead *done, *h;
+  struct cpu *c;
+
+  cpu->rcugp = rcu.gp;
+  if(!rcu.busy && rcu.next == 0)
+    return;
+  done = 0;
+  acquire(&rcu.lock);
+  if(rcu.busy){
+    for(c = cpus; c < cpus + ncpu; c++)
+      if(c->rcugp != rcu.gp && !c->idle)
+        break;
+    if(c == cpus + ncpu){
+      done = rcu.cur;
+      rcu.cur = 0;
+      rcu.busy = 0;
+    }
+  }
+  if(!rcu.busy && rcu.next){
+    rcu.cur = rcu.next;
+    rcu.next = 0;
+    rcu.busy = 1;
+    cpu->rcugp = ++rcu.gp;
+  }
+  release(&rcu.lock);
+  while((h = done) != 0){
+    done = h->next;
+    h->fn(h->arg);
+  }
+}
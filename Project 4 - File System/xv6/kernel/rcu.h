@@ -0,0 +1,14 @@
+#ifndef _RCU_H_
+#define _RCU_H_
+// Deferred free for lock-free readers: fn(arg), run by call_rcu
+// once no reader can still see what it frees.  See rcu.c.
+struct rcuhead {
+  void (*fn)(void*);
+  void *arg;
+  struct rcuhead *next;  // waiting for a grace period
+};
+
+// Store p in *pp, where readers may find it, after the stores
+// that filled in *p.
+#define rcu_assign(pp, p) do { __sync_synchronize(); *(pp) = (p); } while(0)
+#endif // _RCU_H_
@@ -0,0 +1,243 @@
+// Slab allocator for small kernel objects.
+//
+// A cache hands out objects of one size, cut from kalloc() pages
+// ("slabs").  Each slab starts with a struct slab header followed
+// by as many objects as fit; free objects in a slab are chained
+// through their first word.  Objects of a cache line or more are
+// rounded up to whole lines and start on a line boundary, so no
+// two share a line.  Slabs with free objects are on the cache's
+// partial list; a slab whose objects are all free again goes
+// back to kalloc, unless it is the only partial one.
+//
+// In front of the slabs each CPU has a magazine of up to MAGSIZE
+// free objects, so most allocations and frees take only that
+// CPU's lock.  Each magazine has cache lines of its own.  An
+// empty magazine is refilled, and a full one drained, MAGSIZE/2
+// objects at a time.
+//
+// Under memory pressure kalloc calls slabshrink, which empties
+// the magazines so that slabs with no objects in use go back.
+//
+// Lock order: a magazine's lock, then the cache's lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+
+#define NKCACHE  8   // kmem caches in the system
+#define MAGSIZE 16   // objects per CPU magazine
+
+struct slab {
+  struct slab *next;   // on the partial list
+  struct kmem_cache *cache;
+  void *free;          // chain of free objects
+  int inuse;           // objects handed out
+};
+
+struct magazine {
+  struct spinlock lock;
+  int n;
+  void *obj[MAGSIZE];
+} __attribute__((aligned(CACHELINE)));
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;           // object size, rounded up to a word or line
+  uint off;            // where the first object starts in a slab
+  struct slab *partial;
+  struct magazine mag[NCPU];
+};
+
+static struct {
+  struct spinlock lock;
+  struct kmem_cache cache[NKCACHE];
+  int n;
+} kcaches __attribute__((aligned(CACHELINE)));
+
+static int slabshrink(int);
+
+void
+slabinit(void)
+{
+  initlock(&kcaches.lock, "kcaches");
+  kshrinker("slab", slabshrink);
+}
+
+// Create a cache of objects of size bytes.  Panics if there are
+// too many caches or the objects don't fit in a slab.
+struct kmem_cache*
+kmem_cache_create(char *name, uint size)
+{
+  struct kmem_cache *c;
+  uint off;
+  int i;
+
+  if(size < CACHELINE){
+    size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    off = sizeof(struct slab);
+  } else {
+    size = (size + CACHELINE - 1) & ~(CACHELINE - 1);
+    off = (sizeof(struct slab) + CACHELINE - 1) & ~(CACHELINE - 1);
+  }
+  if(size > PGSIZE - off)
+    panic("kmem_cache_create: too big");
+  acquire(&kcaches.lock);
+  if(kcaches.n == NKCACHE)
+    panic("kmem_cache_create: too many");
+  c = &kcaches.cache[kcaches.n++];
+  release(&kcaches.lock);
+
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->off = off;
+  c->partial = 0;
+  for(i = 0; i < NCPU; i++)
+    initlock(&c->mag[i].lock, name);
+  return c;
+}
+
+// Take a free object from c's slabs, making a new slab if needed.
+// Caller holds c->lock.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *p;
+  void *obj;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    for(p = (char*)s + c->off; p + c->size <= (char*)s + PGSIZE; p += c->size){
+      *(void**)p = s->free;
+      s->free = p;
+    }
+    s->next = 0;
+    c->partial = s;
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  if(s->free == 0)
+    c->partial = s->next;  // full: off the partial list
+  return obj;
+}
+
+// Return obj to its slab.  Returns 1 if that freed the slab.
+// Caller holds c->lock.
+static int
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s, **pp;
+
+  s = (struct slab*)PGROUNDDOWN(obj);
+  if(s->cache != c)
+    panic("kmem_cache_free: wrong cache");
+  if(s->free == 0){
+    // Was full: back on the partial list.
+    s->next = c->partial;
+    c->partial = s;
+  }
+  *(void**)obj = s->free;
+  s->free = obj;
+  if(--s->inuse == 0 && !(c->partial == s && s->next == 0)){
+    for(pp = &c->partial; *pp != s; pp = &(*pp)->next)
+      ;
+    *pp = s->next;
+    kfree((char*)s);
+    return 1;
+  }
+  return 0;
+}
+
+// Shrinker: put the objects in every magazine back in their
+// slabs, freeing the slabs left empty, the last one included.
+// Returns the pages freed, stopping once that is n.
+static int
+slabshrink(int n)
+{
+  struct kmem_cache *c;
+  struct magazine *m;
+  struct slab *s;
+  int freed;
+
+  freed = 0;
+  for(c = kcaches.cache; c < kcaches.cache + kcaches.n && freed < n; c++){
+    for(m = c->mag; m < c->mag + NCPU; m++){
+      acquire(&m->lock);
+      acquire(&c->lock);
+      while(m->n > 0)
+        freed += slabfree(c, m->obj[--m->n]);
+      release(&c->lock);
+      release(&m->lock);
+    }
+    acquire(&c->lock);
+    if((s = c->partial) != 0 && s->inuse == 0 && s->next == 0){
+      c->partial = 0;
+      kfree((char*)s);
+      freed++;
+    }
+    release(&c->lock);
+  }
+  return freed;
+}
+
+// This CPU's magazine in c.  The caller may move to another
+// CPU afterwards; the magazine's lock keeps that safe.
+static struct magazine*
+mymag(struct kmem_cache *c)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpu - cpus];
+  popcli();
+  return m;
+}
+
+// Allocate an object from c.  Its contents are undefined.
+// Returns 0 if memory is exhausted.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  m = mymag(c);
+  acquire(&m->lock);
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slaballoc(c)) != 0)
+      m->obj[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  release(&m->lock);
+  return obj;
+}
+
+// Free an object allocated from c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  m = mymag(c);
+  acquire(&m->lock);
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabfree(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  release(&m->lock);
+}
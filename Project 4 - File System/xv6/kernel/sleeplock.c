@@ -0,0 +1,97 @@
+// Sleeping locks.  See sleeplock.h.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+
+void
+initsleeplock(struct sleeplock *sl)
+{
+  sl->locked = 0;
+  sl->readers = 0;
+  sl->head = sl->tail = 0;
+}
+
+// Queue the current process on sl, shared or not, and sleep
+// until releasesleep hands sl over.  Caller holds lk.
+static void
+waitsleep(struct sleeplock *sl, struct spinlock *lk, int shared)
+{
+  proc->slnext = 0;
+  proc->slwait = 1;
+  proc->slshared = shared;
+  if(sl->tail)
+    sl->tail->slnext = proc;
+  else
+    sl->head = proc;
+  sl->tail = proc;
+  // Not interruptible: only releasesleep ends the wait.
+  while(proc->slwait)
+    sleep(&proc->slwait, lk);
+}
+
+// Acquire sl, sleeping until it is handed over if it is held.
+// Caller holds lk, the spinlock guarding sl; it is released
+// while sleeping and held again on return.
+void
+acquiresleep(struct sleeplock *sl, struct spinlock *lk)
+{
+  if(!sl->locked && sl->readers == 0){
+    sl->locked = 1;
+    return;
+  }
+  waitsleep(sl, lk, 0);
+}
+
+// Acquire sl shared with other readers.  A reader does not go
+// ahead of processes already waiting, so writers don't starve.
+void
+acquiresleepshared(struct sleeplock *sl, struct spinlock *lk)
+{
+  if(!sl->locked && sl->head == 0){
+    sl->readers++;
+    return;
+  }
+  waitsleep(sl, lk, 1);
+}
+
+// Take p, the first waiter, off sl's queue and wake it.
+static void
+handoff(struct sleeplock *sl, struct proc *p)
+{
+  if((sl->head = p->slnext) == 0)
+    sl->tail = 0;
+  p->slwait = 0;
+  wakeup(&p->slwait);
+}
+
+// Release sl, held either way.  Once it is free it goes to the
+// longest waiter, or to all the readers at the head of the queue.
+// Caller holds the spinlock guarding sl.
+void
+releasesleep(struct sleeplock *sl)
+{
+  struct proc *p;
+
+  if(sl->locked)
+    sl->locked = 0;
+  else if(sl->readers > 0)
+    sl->readers--;
+  else
+    panic("releasesleep");
+  if(sl->readers > 0 || (p = sl->head) == 0)
+    return;
+  if(!p->slshared){
+    sl->locked = 1;
+    handoff(sl, p);
+    return;
+  }
+  for(; p && p->slshared; p = sl->head){
+    sl->readers++;
+    handoff(sl, p);
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef _SLEEPLOCK_H_
+#define _SLEEPLOCK_H_
+
+// Long-term lock for processes, which may be held across disk
+// I/O, either exclusively or shared by readers.  Its fields are
+// guarded by a spinlock that the caller chooses and holds around
+// acquiresleep, acquiresleepshared and releasesleep.  A process
+// that can't have it joins a queue and sleeps, and releasesleep
+// hands the lock straight to the longest waiter, waking only
+// that one (or the run of readers at the head of the queue).
+struct sleeplock {
+  uint locked;         // Is the lock held exclusively?
+  uint readers;        // Processes holding it shared
+  struct proc *head;   // Waiting processes, oldest first
+  struct proc *tail;
+};
+
+#endif // _SLEEPLOCK_H_
@@ -7,13 +7,69 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "LockStat.h"
+
+// Profiling counters, one entry per lock name, so that locks
+// which come and go (pipes, say) add up in one place.  Locks of
+// one name on different CPUs may race on their entry's
+// counters; they are for ranking locks, not exact.  Entries are
+// added under busy, a bare xchg lock, as a spinlock can't be
+// used to guard its own bookkeeping.
+static struct {
+  uint busy;
+  int n;
+  struct LockStat stat[NLOCKSTAT];
+} lockstats;
+
+// The counters for locks called name, made if need be;
+// 0 if the table is full or the kernel is built without
+// lock statistics (NOLOCKSTAT).
+static struct LockStat*
+lockstatof(char *name)
+{
+  struct LockStat *s;
+
+#ifdef NOLOCKSTAT
+  return 0;
+#endif
+  while(xchg(&lockstats.busy, 1) != 0)
+    pause();
+  for(s = lockstats.stat; s < lockstats.stat + lockstats.n; s++)
+    if(strncmp(s->name, name, sizeof(s->name) - 1) == 0)
+      break;
+  if(s == lockstats.stat + lockstats.n){
+    if(lockstats.n < NLOCKSTAT){
+      lockstats.n++;
+      safestrcpy(s->name, name, sizeof(s->name));
+    } else
+      s = 0;
+  }
+  if(s)
+    s->nlocks++;
+  xchg(&lockstats.busy, 0);
+  return s;
+}
+
+// Copy up to n lock counters into table; returns how many.
+int
+getlockstats(struct LockStat *table, int n)
+{
+  while(xchg(&lockstats.busy, 1) != 0)
+    pause();
+  if(n > lockstats.n)
+    n = lockstats.n;
+  memmove(table, lockstats.stat, n * sizeof(table[0]));
+  xchg(&lockstats.busy, 0);
+  return n;
+}
 
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = lk->owner = 0;
   lk->cpu = 0;
+  lk->stat = lockstatof(name);
 }
 
 // Acquire the lock.
@@ -23,45 +79,183 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 spin;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  // It also serializes, so that reads after acquire are not
-  // reordered before it. 
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // Take a ticket and wait for it to be served.  The
+  // xadd serializes, and so does the __sync_synchronize,
+  // so that reads after acquire are not reordered before it.
+  ticket = xadd(&lk->next, 1);
+  spin = 0;
+  if(lk->owner != ticket){
+    spin = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+    spin = rdtsc() - spin;
+  }
+  __sync_synchronize();
 
   // Record info about lock acquisition for debugging.
   lk->cpu = cpu;
   getcallerpcs(&lk, lk->pcs);
+
+  if(lk->stat){
+    lk->stat->acquires++;
+    if(spin){
+      lk->stat->contended++;
+      lk->stat->spin += spin;
+    }
+  }
+  lk->tacquire = lk->stat || latencyon ? rdtsc() : 0;
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  if(lk->tacquire){
+    hold = rdtsc() - lk->tacquire;
+    if(lk->stat && hold > lk->stat->maxhold)
+      lk->stat->maxhold = hold;
+    if(latencyon)
+      latnote(lk->name, hold, lk->pcs);
+  }
+
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
+  // Serve the next ticket.  Only the holder writes owner.
   // The xchg serializes, so that reads before release are 
   // not reordered after it.  The 1996 PentiumPro manual (Volume 3,
   // 7.2) says reads can be carried out speculatively and in
   // any order, which implies we need to serialize here.
   // But the 2007 Intel 64 Architecture Memory Ordering White
   // Paper says that Intel 64 and IA-32 will not move a load
-  // after a store. So lock->locked = 0 would work here.
+  // after a store. So lock->owner++ would work here.
   // The xchg being asm volatile ensures gcc emits it after
   // the above assignments (and after the critical section).
-  xchg(&lk->locked, 0);
+  xchg(&lk->owner, lk->owner + 1);
+
+  popcli();
+}
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  rw->name = name;
+  rw->n = 0;
+}
+
+// Acquire rw for reading, sharing it with other readers.
+// Like acquire, keeps interrupts off until released.
+void
+acquireread(struct rwlock *rw)
+{
+  uint n;
+
+  pushcli();
+  for(;;){
+    n = rw->n;
+    if(!(n & (RW_WRITER|RW_WAITING)) && cmpxchg(&rw->n, n, n+1) == n)
+      break;
+    pause();
+  }
+}
+
+void
+releaseread(struct rwlock *rw)
+{
+  if((rw->n & ~(RW_WRITER|RW_WAITING)) == 0)
+    panic("releaseread");
+  xadd(&rw->n, -1);
+  popcli();
+}
 
+// Acquire rw for writing, once the readers have gone.
+void
+acquirewrite(struct rwlock *rw)
+{
+  uint n;
+
+  pushcli();
+  for(;;){
+    n = rw->n;
+    if((n & ~RW_WAITING) == 0 && cmpxchg(&rw->n, n, RW_WRITER) == n)
+      break;
+    if(!(n & RW_WAITING))
+      cmpxchg(&rw->n, n, n | RW_WAITING);
+    pause();
+  }
+}
+
+// Release rw from writing.  This clears RW_WAITING too;
+// other waiting writers set it again.
+void
+releasewrite(struct rwlock *rw)
+{
+  if(!(rw->n & RW_WRITER))
+    panic("releasewrite");
+  xchg(&rw->n, 0);
   popcli();
 }
 
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lock, name);
+  sl->seq = 0;
+}
+
+// Acquire sl for writing.  Like acquire, keeps interrupts off
+// until released.
+void
+acquireseq(struct seqlock *sl)
+{
+  acquire(&sl->lock);
+  sl->seq++;
+  asm volatile("" : : : "memory");  // seq odd before the writes
+}
+
+void
+releaseseq(struct seqlock *sl)
+{
+  asm volatile("" : : : "memory");  // the writes before seq even
+  sl->seq++;
+  release(&sl->lock);
+}
+
+// Start reading what sl guards: returns the seq to hand to
+// readseqretry once done, waiting out a writer in progress.
+// x86 keeps loads in order, so only the compiler needs fencing.
+uint
+readseqbegin(struct seqlock *sl)
+{
+  uint s;
+
+  while((s = sl->seq) & 1)
+    pause();
+  asm volatile("" : : : "memory");
+  return s;
+}
+
+// Whether a writer came while reading since readseqbegin
+// returned s, so the reader must read again.
+int
+readseqretry(struct seqlock *sl, uint s)
+{
+  asm volatile("" : : : "memory");
+  return sl->seq != s;
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void
 getcallerpcs(void *v, uint pcs[])
@@ -84,13 +278,15 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == cpu;
+  return lock->owner != lock->next && lock->cpu == cpu;
 }
 
 
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
-// are off, then pushcli, popcli leaves them off.
+// are off, then pushcli, popcli leaves them off.  With latency
+// tracing on they time each stretch with interrupts off; see
+// latency.c.
 
 void
 pushcli(void)
@@ -99,8 +295,13 @@ pushcli(void)
   
   eflags = readeflags();
   cli();
-  if(cpu->ncli++ == 0)
+  if(cpu->ncli++ == 0){
     cpu->intena = eflags & FL_IF;
+    if(latencyon && cpu->intena){
+      getcallerpcs((uint*)__builtin_frame_address(0) + 2, cpu->clipcs);
+      cpu->clitsc = rdtsc();
+    }
+  }
 }
 
 void
@@ -110,7 +311,13 @@ popcli(void)
     panic("popcli - interruptible");
   if(--cpu->ncli < 0)
     panic("popcli");
-  if(cpu->ncli == 0 && cpu->intena)
+  if(cpu->ncli == 0 && cpu->intena){
+    if(cpu->clitsc){
+      if(latencyon)
+        latnote("cli", rdtsc() - cpu->clitsc, cpu->clipcs);
+      cpu->clitsc = 0;
+    }
     sti();
+  }
 }
 
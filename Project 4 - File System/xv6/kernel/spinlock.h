@@ -1,15 +1,47 @@
 #ifndef _SPINLOCK_H_
 #define _SPINLOCK_H_
 
-// Mutual exclusion lock.
+// Mutual exclusion lock.  A ticket lock: CPUs get the lock in
+// the order they asked for it, and wait by reading owner, which
+// changes only once per handoff.
+//
+// A global table keeps its lock first and starts on a cache line
+// (aligned(CACHELINE)), so the lock shares lines only with what it
+// protects, never with another table's lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;   // Next ticket to hand out
+  volatile uint owner;  // Ticket now holding the lock
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
+
+  // For profiling (see lockstat):
+  struct LockStat *stat;  // Counters for locks of this name, or 0
+  uint64 tacquire;        // rdtsc when acquired
+};
+
+// Reader-writer spin lock: any number of readers, or one writer.
+// A writer that is waiting holds off new readers, so a stream
+// of readers cannot starve it.
+struct rwlock {
+  volatile uint n;   // RW_WRITER, RW_WAITING, and readers holding it
+  char *name;        // Name of lock.
+};
+
+#define RW_WRITER  0x80000000
+#define RW_WAITING 0x40000000
+
+// Sequence lock, for a little data read far more often than it
+// changes.  A writer takes lock and makes seq odd while it writes;
+// readers take nothing and just read again if seq was odd or has
+// changed (see readseqbegin), so they never wait on a writer's
+// lock or write to its cache line.
+struct seqlock {
+  volatile uint seq;
+  struct spinlock lock;  // Serializes writers
 };
 
 #endif // _SPINLOCK_H_
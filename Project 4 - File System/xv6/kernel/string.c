@@ -1,11 +1,24 @@
 #include "types.h"
 #include "x86.h"
-#include "fs.h"
 
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  uint m;
+  char *d;
+
+  d = dst;
+  if(n >= 16){
+    c &= 0xFF;
+    m = -(uint)d & 3;
+    stosb(d, c, m);
+    d += m;
+    n -= m;
+    stosl(d, (c<<24)|(c<<16)|(c<<8)|c, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
@@ -25,23 +38,36 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// Copies a long at a time when dst and src are equally aligned.
 void*
 memmove(void *dst, const void *src, uint n)
 {
   const char *s;
   char *d;
+  uint m;
 
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
-
+  if(n < 16 || (((uint)s ^ (uint)d) & 3) != 0){
+    if(s < d && s + n > d)
+      rmovsb(d + n - 1, s + n - 1, n);
+    else
+      movsb(d, s, n);
+  } else if(s < d && s + n > d){
+    m = (uint)(d + n) & 3;
+    rmovsb(d + n - 1, s + n - 1, m);
+    n -= m;
+    rmovsl(d + n - 4, s + n - 4, n/4);
+    rmovsb(d + (n & 3) - 1, s + (n & 3) - 1, n & 3);
+  } else {
+    m = -(uint)d & 3;
+    movsb(d, s, m);
+    d += m;
+    s += m;
+    n -= m;
+    movsl(d, s, n/4);
+    movsb(d + (n & ~3), s + (n & ~3), n & 3);
+  }
   return dst;
 }
 
@@ -90,34 +116,20 @@ safestrcpy(char *s, const char *t, int n)
   return os;
 }
 
+// Looks at a long at a time once s is aligned; an aligned long
+// never crosses into the next page.
 int
 strlen(const char *s)
 {
-  int n;
+  const char *p;
+  const uint *w;
 
-  for(n = 0; s[n]; n++)
+  for(p = s; (uint)p & 3; p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (const uint*)p; ((*w - 0x01010101) & ~*w & 0x80808080) == 0; w++)
     ;
-  return n;
-}
-
-int
-searchKey(uchar* key, uchar* str)
-{
-  int i = 0, j = 0;
-  int keyLength = strlen((char*)key);
-  for (i = 0; i < BSIZE; i += 32) {
-    j = 0;
-    for ( ; j < 10 && i + j < BSIZE && key[j] && str[i + j] && key[j] == str[i + j]; j++) ;
-    if (j == keyLength && !key[j] && !str[i + j]) return i + j - keyLength;
-  }
-  return -1;
+  for(p = (const char*)w; *p; p++)
+    ;
+  return p - s;
 }
-
-int
-searchEnd(uchar* str)
-{
-  int i = 0;
-  for (i = 0; i < BSIZE && str[i]; i += 32) ;
-  if (i == BSIZE) return -1;
-  return i;
-}
\ No newline at end of file
@@ -0,0 +1,201 @@
+// Swap area: room on disk for user pages when memory runs short.
+//
+// SWAPDEV is a whole disk of NSWAP page slots.  When kalloc
+// fails for a user page, swapreclaim (proc.c) picks pages with
+// a clock over the processes' page tables and writes each to a
+// slot, leaving a PTE that is not present but holds the slot
+// number and PTE_SWAP (see SWAPPTE in mmu.h).  A fault on such
+// a PTE reads the page back in with swapin.
+//
+// Each slot counts the PTEs that hold it, as fork copies them.
+// While a page is being written out the slot keeps it in
+// cache[], so a fault meanwhile takes it back without waiting
+// for the disk; the writer frees it only if nobody has.  A slot
+// is free again once no PTE holds it and its write is done.
+//
+// Page I/O uses private bufs pointing into the page, so it
+// bypasses the buffer cache.  swap.lock guards the tables.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "buf.h"
+#include "swapstat.h"
+
+#define BPP (PGSIZE / BSIZE)  // blocks per page
+
+struct {
+  struct spinlock lock;
+  int present;           // Is there a swap disk?
+  uchar ref[NSWAP];      // PTEs holding each slot
+  uchar busy[NSWAP];     // Write in flight
+  char *cache[NSWAP];    // Page being written, until someone takes it
+  int next;              // Where to look for a free slot
+  uint nused;            // Slots held
+  uint nout;             // Pages written out
+  uint nin;              // Pages read back from disk
+} swap __attribute__((aligned(CACHELINE)));
+
+static void
+swapkstat(struct kstatbuf *b)
+{
+  struct swapstat st;
+
+  swapstat(&st);
+  kstatput(b, "size", 0, st.size);
+  kstatput(b, "used", 0, st.used);
+  kstatput(b, "out", 0, st.out);
+  kstatput(b, "in", 0, st.in);
+}
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  kstatreg("swap", swapkstat);
+  swap.present = idepresent(SWAPDEV);
+  if(swap.present)
+    cprintf("swap: %d pages\n", NSWAP);
+}
+
+void
+swapstat(struct swapstat *st)
+{
+  acquire(&swap.lock);
+  st->size = swap.present ? NSWAP : 0;
+  st->used = swap.nused;
+  st->out = swap.nout;
+  st->in = swap.nin;
+  release(&swap.lock);
+}
+
+// Copy page pa to or from the disk at slot.
+static void
+swaprw(uint slot, char *pa, int write)
+{
+  struct buf b[BPP];
+  int i;
+
+  memset(b, 0, sizeof(b));
+  for(i = 0; i < BPP; i++){
+    b[i].lock.locked = 1;  // private; nobody else sees them
+    b[i].dev = SWAPDEV;
+    b[i].sector = slot*BPP + i;
+    b[i].data = (uchar*)pa + i*BSIZE;
+    b[i].flags = write ? B_DIRTY : 0;
+  }
+  blkrwv(b, BPP);
+}
+
+// Take a free slot for page pa, about to be written out.
+// Returns the slot, or -1 if there is none.
+int
+swapalloc(char *pa)
+{
+  int i, slot;
+
+  if(!swap.present)
+    return -1;
+  acquire(&swap.lock);
+  for(i = 0; i < NSWAP; i++){
+    slot = (swap.next + i) % NSWAP;
+    if(swap.ref[slot] == 0 && !swap.busy[slot]){
+      swap.ref[slot] = 1;
+      swap.busy[slot] = 1;
+      swap.cache[slot] = pa;
+      swap.next = slot + 1;
+      swap.nused++;
+      release(&swap.lock);
+      return slot;
+    }
+  }
+  release(&swap.lock);
+  return -1;
+}
+
+// Write pa out to slot from swapalloc, which the caller has
+// already put in place of pa's PTE, and free pa unless a fault
+// has taken it back meanwhile.
+void
+swapwrite(uint slot, char *pa)
+{
+  int mine;
+
+  swaprw(slot, pa, 1);
+  acquire(&swap.lock);
+  swap.busy[slot] = 0;
+  swap.nout++;
+  mine = swap.cache[slot] == pa;
+  if(mine)
+    swap.cache[slot] = 0;
+  release(&swap.lock);
+  if(mine)
+    kfree(pa);
+}
+
+// Another PTE now holds slot; fork copied it.
+void
+swapdup(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= NSWAP || swap.ref[slot] == 0 || swap.ref[slot] == 0xff)
+    panic("swapdup");
+  swap.ref[slot]++;
+  release(&swap.lock);
+}
+
+// A PTE holding slot is gone.
+void
+swapfree(uint slot)
+{
+  acquire(&swap.lock);
+  if(slot >= NSWAP || swap.ref[slot] == 0)
+    panic("swapfree");
+  if(--swap.ref[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+}
+
+// Return a page holding the contents of slot for a PTE that
+// held it, dropping that PTE's hold.  Sets *major if it read
+// the disk.  Returns 0 if out of memory; the PTE keeps slot.
+char*
+swapin(uint slot, int *major)
+{
+  char *mem;
+
+  acquire(&swap.lock);
+  if(slot >= NSWAP || swap.ref[slot] == 0)
+    panic("swapin");
+  if((mem = swap.cache[slot]) != 0 && swap.ref[slot] == 1){
+    // Still being written and ours alone: take it back.
+    swap.cache[slot] = 0;
+    swap.ref[slot] = 0;
+    swap.nused--;
+    release(&swap.lock);
+    return mem;
+  }
+  release(&swap.lock);
+
+  if((mem = uvmpage(0)) == 0)
+    return 0;
+  acquire(&swap.lock);
+  if(swap.cache[slot]){
+    memmove(mem, swap.cache[slot], PGSIZE);
+  } else {
+    // The slot is held, so it can't be reused under us.
+    release(&swap.lock);
+    swaprw(slot, mem, 0);
+    *major = 1;
+    acquire(&swap.lock);
+    swap.nin++;
+  }
+  if(--swap.ref[slot] == 0)
+    swap.nused--;
+  release(&swap.lock);
+  return mem;
+}
@@ -6,6 +6,9 @@
 #include "x86.h"
 #include "syscall.h"
 #include "sysfunc.h"
+#include "ring.h"
+#include "SyscallStat.h"
+#include "trace.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %eax.
@@ -13,28 +16,25 @@
 // library system call function. The saved user %esp points
 // to a saved program counter, and then the first argument.
 
-// Fetch the int at addr from process p.
+// Fetch the int at addr from the current process.
 int
-fetchint(struct proc *p, uint addr, int *ip)
+fetchint(uint addr, int *ip)
 {
-  if(addr >= p->sz || addr+4 > p->sz)
-    return -1;
-  *ip = *(int*)(addr);
-  return 0;
+  return copyin(ip, addr, sizeof(*ip));
 }
 
-// Fetch the nul-terminated string at addr from process p.
-// Doesn't actually copy the string - just sets *pp to point at it.
-// Returns length of string, not including nul.
+// Check the nul-terminated string at addr in the current process.
+// Doesn't copy the string - just sets *pp to point at it, so
+// only for callers, like exec, that copy it before anything
+// else can change it.  Returns length of string, not including nul.
 int
-fetchstr(struct proc *p, uint addr, char **pp)
+fetchstr(uint addr, char **pp)
 {
   char *s, *ep;
 
-  if(addr >= p->sz)
+  if((ep = (char*)uvmend(proc, addr)) == 0)
     return -1;
   *pp = (char*)addr;
-  ep = (char*)p->sz;
   for(s = *pp; s < ep; s++)
     if(*s == 0)
       return s - *pp;
@@ -45,12 +45,13 @@ fetchstr(struct proc *p, uint addr, char **pp)
 int
 argint(int n, int *ip)
 {
-  return fetchint(proc, proc->tf->esp + 4 + 4*n, ip);
+  return fetchint(proc->tf->esp + 4 + 4*n, ip);
 }
 
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size n bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space, and fault its pages
+// in (see uvmcheck).
 int
 argptr(int n, char **pp, int size)
 {
@@ -58,23 +59,23 @@ argptr(int n, char **pp, int size)
   
   if(argint(n, &i) < 0)
     return -1;
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  if(size < 0 || uvmcheck(proc, i, size) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
 }
 
-// Fetch the nth word-sized system call argument as a string pointer.
-// Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// Copy the string the nth word-sized system call argument points
+// to into buf, which holds max bytes.  A copy can't change under
+// the kernel the way shared memory could.  Returns its length, or
+// -1 if it isn't valid or doesn't fit.
 int
-argstr(int n, char **pp)
+argstr(int n, char *buf, int max)
 {
   int addr;
   if(argint(n, &addr) < 0)
     return -1;
-  return fetchstr(proc, addr, pp);
+  return copyinstr(buf, addr, max);
 }
 
 // syscall function declarations moved to sysfunc.h so compiler
@@ -108,8 +109,136 @@ static int (*syscalls[])(void) = {
 [SYS_getFileTag] sys_getFileTag,
 [SYS_getAllTags] sys_getAllTags,
 [SYS_getFilesByTag] sys_getFilesByTag,
+[SYS_bcachestat] sys_bcachestat,
+[SYS_sync]    sys_sync,
+[SYS_fsync]   sys_fsync,
+[SYS_idestat] sys_idestat,
+[SYS_tagFileBatch] sys_tagFileBatch,
+[SYS_getFileTags] sys_getFileTags,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_mmap]    sys_mmap,
+[SYS_sendfile] sys_sendfile,
+[SYS_splice]  sys_splice,
+[SYS_tee]     sys_tee,
+[SYS_getprocs] sys_getprocs,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_lockstat] sys_lockstat,
+[SYS_ringenter] sys_ringenter,
+[SYS_syscallstat] sys_syscallstat,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_intrstat] sys_intrstat,
+[SYS_irqaffinity] sys_irqaffinity,
+[SYS_profctl] sys_profctl,
+[SYS_profread] sys_profread,
+[SYS_tracectl] sys_tracectl,
+[SYS_traceread] sys_traceread,
+[SYS_spawn] sys_spawn,
+[SYS_ftruncate] sys_ftruncate,
+[SYS_fallocate] sys_fallocate,
+[SYS_poll] sys_poll,
+[SYS_fcntl] sys_fcntl,
+[SYS_mount] sys_mount,
+[SYS_socket] sys_socket,
+[SYS_bind] sys_bind,
+[SYS_connect] sys_connect,
+[SYS_sendmmsg] sys_sendmmsg,
+[SYS_recvmmsg] sys_recvmmsg,
+[SYS_swapstat] sys_swapstat,
+[SYS_shrinkstat] sys_shrinkstat,
+[SYS_ksm] sys_ksm,
+[SYS_getdents_stat] sys_getdents_stat,
+[SYS_getprocstat] sys_getprocstat,
+[SYS_perfctr] sys_perfctr,
+[SYS_latencyctl] sys_latencyctl,
+[SYS_getlatency] sys_getlatency,
+[SYS_aio_setup] sys_aio_setup,
+[SYS_aio_read] sys_aio_read,
+[SYS_aio_write] sys_aio_write,
+[SYS_getFilesByQuery] sys_getFilesByQuery,
+[SYS_getFilesByTagPage] sys_getFilesByTagPage,
+[SYS_notify_open] sys_notify_open,
+[SYS_copy_file_range] sys_copy_file_range,
+[SYS_mktemplate] sys_mktemplate,
+[SYS_spawn_from] sys_spawn_from,
+[SYS_madvise] sys_madvise,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_dropcaches] sys_dropcaches,
 };
 
+// syscallstat counters.  Each CPU has its own, so counting takes
+// no lock; getsyscallstats adds them up.  A call is counted when
+// it starts and timed when it returns, so exit is counted but
+// never timed.  The rows are whole cache lines; the array starts
+// on one.
+static struct SyscallStat sysstats[NCPU][NSYSCALL] __attribute__((aligned(CACHELINE)));
+
+// Make system call num, counting and timing it.
+static int
+callsys(int num)
+{
+  struct SyscallStat *s;
+  uint64 start, t;
+  int r, b;
+
+  if(num >= NSYSCALL)
+    return syscalls[num]();
+  proc->syscount[num]++;
+  proc->nsyscall++;
+  pushcli();
+  sysstats[cpu - cpus][num].count++;
+  popcli();
+  TRACE(TR_SYSENTER, num, 0);
+  start = rdtsc();
+  r = syscalls[num]();
+  t = rdtsc() - start;
+  TRACE(TR_SYSEXIT, num, r);
+  for(b = 0; b < NSYSHIST-1 && t >= ((uint64)SYSHISTMIN << b); b++)
+    ;
+  // The call may have moved to another CPU; count it on this one.
+  pushcli();
+  s = &sysstats[cpu - cpus][num];
+  s->cycles += t;
+  s->hist[b]++;
+  popcli();
+  return r;
+}
+
+// Fill in up to n counters, one per system call number, for all
+// processes if pid is 0 or just process pid's, which has only
+// counts.  Returns how many, or -1 if there is no such process.
+int
+getsyscallstats(int pid, struct SyscallStat *table, int n)
+{
+  struct SyscallStat s, *c;
+  uint counts[NSYSCALL];
+  int i, num, j;
+
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+  if(pid != 0 && getsyscounts(pid, counts) < 0)
+    return -1;
+  for(num = 0; num < n; num++){
+    memset(&s, 0, sizeof(s));
+    if(pid != 0){
+      s.count = counts[num];
+      table[num] = s;
+      continue;
+    }
+    for(i = 0; i < ncpu; i++){
+      c = &sysstats[i][num];
+      s.count += c->count;
+      s.cycles += c->cycles;
+      for(j = 0; j < NSYSHIST; j++)
+        s.hist[j] += c->hist[j];
+    }
+    table[num] = s;
+  }
+  return n;
+}
+
 // Called on a syscall trap. Checks that the syscall number (passed via eax)
 // is valid and then calls the appropriate handler for the syscall.
 void
@@ -119,10 +248,51 @@ syscall(void)
   
   num = proc->tf->eax;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num] != NULL) {
-    proc->tf->eax = syscalls[num]();
+    proc->tf->eax = callsys(num);
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             proc->pid, proc->name, num);
     proc->tf->eax = -1;
   }
 }
+
+// Make the system calls queued on the ring argument, in one
+// trap.  Each handler fetches its arguments as usual: tf->esp is
+// pointed just below the entry's arg[], where a stub's return
+// address would be.  Calls that would leave with another stack
+// or another image, or could free the ring, fail.  Returns how
+// many calls were made.
+int
+sys_ringenter(void)
+{
+  struct ring *r;
+  struct ringsqe *e;
+  struct ringcqe *c;
+  uint esp;
+  int n, op, res;
+
+  if(argptr(0, (char**)&r, sizeof(*r)) < 0)
+    return -1;
+  esp = proc->tf->esp;
+  for(n = 0; r->sqhead != r->sqtail && r->cqtail - r->cqhead < RINGSIZE; n++){
+    if(proc->killed)
+      break;
+    e = &r->sq[r->sqhead % RINGSIZE];
+    op = e->op;
+    if(op <= 0 || op >= NELEM(syscalls) || syscalls[op] == NULL ||
+       op == SYS_fork || op == SYS_exec || op == SYS_exit || op == SYS_sbrk ||
+       op == SYS_ringenter)
+      res = -1;
+    else {
+      proc->tf->esp = (uint)e->arg - 4;
+      res = callsys(op);
+      proc->tf->esp = esp;
+    }
+    c = &r->cq[r->cqtail % RINGSIZE];
+    c->data = e->data;
+    c->res = res;
+    r->cqtail++;
+    r->sqhead++;
+  }
+  return n;
+}
@@ -5,9 +5,22 @@
 #include "mmu.h"
 #include "proc.h"
 #include "fs.h"
+#include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
 #include "sysfunc.h"
+#include "bcachestat.h"
+#include "idestat.h"
+#include "uio.h"
+#include "mman.h"
+#include "spawn.h"
+#include "poll.h"
+#include "socket.h"
+#include "direntstat.h"
+#include "tagquery.h"
+#include "notify.h"
+
+#define TAGSPEROP 2  // tags set per transaction by sys_tagFileBatch
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -19,7 +32,7 @@ argfd(int n, int *pfd, struct file **pf)
 
   if(argint(n, &fd) < 0)
     return -1;
-  if(fd < 0 || fd >= NOFILE || (f=proc->ofile[fd]) == 0)
+  if((f=fdget(proc, fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -28,22 +41,6 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
-{
-  int fd;
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd] == 0){
-      proc->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 int
 sys_dup(void)
 {
@@ -52,7 +49,7 @@ sys_dup(void)
   
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(proc, f)) < 0)
     return -1;
   filedup(f);
   return fd;
@@ -82,6 +79,172 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+// Copy n bytes from in_fd to out_fd inside the kernel.  A
+// negative off means in_fd's own offset, which is advanced;
+// otherwise reading starts at off and in_fd's offset is left.
+int
+sys_sendfile(void)
+{
+  struct file *out, *in;
+  int off, n;
+  uint o;
+
+  if(argfd(0, 0, &out) < 0 || argfd(1, 0, &in) < 0 || argint(2, &off) < 0 ||
+     argint(3, &n) < 0)
+    return -1;
+  if(off < 0)
+    return filesend(out, in, &in->off, n);
+  o = off;
+  return filesend(out, in, &o, n);
+}
+
+// Copy n bytes from in_fd to out_fd at its offset, inode to inode
+// through the buffer cache; off is as for sendfile.
+int
+sys_copy_file_range(void)
+{
+  struct file *out, *in;
+  int off, n;
+  uint o;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &off) < 0 ||
+     argint(3, &n) < 0)
+    return -1;
+  if(off < 0)
+    return filecopy(out, in, &in->off, n);
+  o = off;
+  return filecopy(out, in, &o, n);
+}
+
+// Move up to n bytes from pipe in_fd to pipe out_fd.
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->type != FD_PIPE || !in->readable || out->type != FD_PIPE || !out->writable)
+    return -1;
+  return pipesplice(in->pipe, out->pipe, n, 1);
+}
+
+// Copy up to n bytes from pipe in_fd to pipe out_fd, leaving
+// them in in_fd for its next reader.
+int
+sys_tee(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0)
+    return -1;
+  if(in->type != FD_PIPE || !in->readable || out->type != FD_PIPE || !out->writable)
+    return -1;
+  return pipesplice(in->pipe, out->pipe, n, 0);
+}
+
+// Gift n bytes of whole pages at page-aligned addr to pipe fd,
+// by reference rather than by copying.  The pages stay the
+// caller's, copy-on-write.
+int
+sys_vmsplice(void)
+{
+  struct file *f;
+  int n;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    return -1;
+  if(f->type != FD_PIPE || !f->writable)
+    return -1;
+  return pipegift(f->pipe, (uint)p, n, f->nonblock);
+}
+
+// Copy the iovcnt-entry iovec array at user address uiov into
+// iov, checking that every buffer lies within the process
+// address space.
+static int
+fetchiov(struct iovec *uiov, int iovcnt, struct iovec *iov)
+{
+  int i;
+
+  if(iovcnt < 0 || iovcnt > IOV_MAX)
+    return -1;
+  if(uvmcheck(proc, (uint)uiov, iovcnt * sizeof(*uiov)) < 0)
+    return -1;
+  for(i = 0; i < iovcnt; i++){
+    iov[i] = uiov[i];
+    if(iov[i].iov_len < 0)
+      return -1;
+    if(uvmcheck(proc, (uint)iov[i].iov_base, iov[i].iov_len) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Fetch the iovec array of readv or writev into iov.
+static int
+argiov(struct iovec *iov, int *iovcnt)
+{
+  struct iovec *uiov;
+
+  if(argint(2, iovcnt) < 0 || argint(1, (int*)&uiov) < 0)
+    return -1;
+  return fetchiov(uiov, *iovcnt, iov);
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &iovcnt) < 0)
+    return -1;
+  return filereadv(f, iov, iovcnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOV_MAX];
+  int iovcnt;
+
+  if(argfd(0, 0, &f) < 0 || argiov(iov, &iovcnt) < 0)
+    return -1;
+  return filewritev(f, iov, iovcnt);
+}
+
 int
 sys_close(void)
 {
@@ -90,7 +253,7 @@ sys_close(void)
   
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  proc->ofile[fd] = 0;
+  fdset(proc, fd, 0);
   fileclose(f);
   return 0;
 }
@@ -106,20 +269,44 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+// Read up to n entries of directory fd from its offset on, each
+// with the stat of the inode it names, so that listing a
+// directory needn't stat every entry by path.
+int
+sys_getdents_stat(void)
+{
+  struct file *f;
+  struct direntstat *ents;
+  int n;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  if(n > NDSTAT)
+    n = NDSTAT;
+  if(argptr(1, (void*)&ents, n*sizeof(*ents)) < 0)
+    return -1;
+  return filereaddir(f, ents, n);
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
 {
-  char name[DIRSIZ], *new, *old;
+  char name[DIRSIZ], new[MAXPATH], old[MAXPATH];
   struct inode *dp, *ip;
 
-  if(argstr(0, &old) < 0 || argstr(1, &new) < 0)
+  if(argstr(0, old, sizeof(old)) < 0 || argstr(1, new, sizeof(new)) < 0)
     return -1;
-  if((ip = namei(old)) == 0)
+
+  begin_op();
+  if((ip = namei(old)) == 0){
+    end_op();
     return -1;
+  }
   ilock(ip);
   if(ip->type == T_DIR){
     iunlockput(ip);
+    end_op();
     return -1;
   }
   ip->nlink++;
@@ -133,8 +320,10 @@ sys_link(void)
     iunlockput(dp);
     goto bad;
   }
+  notify(NOTE_CREATE, ip->inum, dp->inum, name);
   iunlockput(dp);
   iput(ip);
+  end_op();
   return 0;
 
 bad:
@@ -142,6 +331,7 @@ bad:
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
+  end_op();
   return -1;
 }
 
@@ -152,10 +342,11 @@ isdirempty(struct inode *dp)
   int off;
   struct dirent de;
 
-  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+  for(off=0; off<dp->size; off+=sizeof(de)){
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
       panic("isdirempty: readi");
-    if(de.inum != 0)
+    // "." and ".." are not first in a hashed directory.
+    if(de.inum != 0 && namecmp(de.name, ".") != 0 && namecmp(de.name, "..") != 0)
       return 0;
   }
   return 1;
@@ -165,39 +356,36 @@ int
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ], *path;
+  char name[DIRSIZ], path[MAXPATH];
   uint off;
 
-  if(argstr(0, &path) < 0)
+  if(argstr(0, path, sizeof(path)) < 0)
     return -1;
-  if((dp = nameiparent(path, name)) == 0)
+
+  begin_op();
+  if((dp = nameiparent(path, name)) == 0){
+    end_op();
     return -1;
+  }
   ilock(dp);
 
   // Cannot unlink "." or "..".
-  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0){
-    iunlockput(dp);
-    return -1;
-  }
+  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
+    goto bad;
 
-  if((ip = dirlookup(dp, name, &off)) == 0){
-    iunlockput(dp);
-    return -1;
-  }
+  if((ip = dirlookup(dp, name, &off)) == 0)
+    goto bad;
   ilock(ip);
 
   if(ip->nlink < 1)
     panic("unlink: nlink < 1");
-  if(ip->type == T_DIR && !isdirempty(ip)){
+  if(ip->type == T_DIR && (!isdirempty(ip) || ip->mounted)){
     iunlockput(ip);
-    iunlockput(dp);
-    return -1;
+    goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
+  notify(NOTE_UNLINK, ip->inum, dp->inum, name);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -207,7 +395,13 @@ sys_unlink(void)
   ip->nlink--;
   iupdate(ip);
   iunlockput(ip);
+  end_op();
   return 0;
+
+bad:
+  iunlockput(dp);
+  end_op();
+  return -1;
 }
 
 static struct inode*
@@ -230,7 +424,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp, type)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
@@ -249,6 +443,7 @@ create(char *path, short type, short major, short minor)
 
   if(dirlink(dp, name, ip->inum) < 0)
     panic("create: dirlink");
+  notify(NOTE_CREATE, ip->inum, dp->inum, name);
 
   iunlockput(dp);
   return ip;
@@ -257,51 +452,67 @@ create(char *path, short type, short major, short minor)
 int
 sys_open(void)
 {
-  char *path;
+  char path[MAXPATH];
   int fd, omode;
   struct file *f;
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, &omode) < 0)
     return -1;
+
+  begin_op();
   if(omode & O_CREATE){
-    if((ip = create(path, T_FILE, 0, 0)) == 0)
+    if((ip = create(path, T_FILE, 0, 0)) == 0){
+      end_op();
       return -1;
+    }
   } else {
-    if((ip = namei(path)) == 0)
+    if((ip = namei(path)) == 0){
+      end_op();
       return -1;
+    }
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
       iunlockput(ip);
+      end_op();
       return -1;
     }
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+  if((f = filealloc()) == 0 || (fd = fdalloc(proc, f)) < 0){
     if(f)
       fileclose(f);
     iunlockput(ip);
+    end_op();
     return -1;
   }
   iunlock(ip);
+  end_op();
 
   f->type = FD_INODE;
   f->ip = ip;
   f->off = 0;
+  f->raoff = 0;
+  f->raend = 0;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
   return fd;
 }
 
 int
 sys_mkdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0)
+  begin_op();
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+    end_op();
     return -1;
+  }
   iunlockput(ip);
+  end_op();
   return 0;
 }
 
@@ -309,64 +520,130 @@ int
 sys_mknod(void)
 {
   struct inode *ip;
-  char *path;
+  char path[MAXPATH];
   int len;
   int major, minor;
   
-  if((len=argstr(0, &path)) < 0 ||
+  begin_op();
+  if((len=argstr(0, path, sizeof(path))) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEV, major, minor)) == 0)
+     (ip = create(path, T_DEV, major, minor)) == 0){
+    end_op();
     return -1;
+  }
   iunlockput(ip);
+  end_op();
   return 0;
 }
 
 int
 sys_chdir(void)
 {
-  char *path;
+  char path[MAXPATH];
   struct inode *ip;
 
-  if(argstr(0, &path) < 0 || (ip = namei(path)) == 0)
+  begin_op();
+  if(argstr(0, path, sizeof(path)) < 0 || (ip = namei(path)) == 0){
+    end_op();
     return -1;
+  }
   ilock(ip);
   if(ip->type != T_DIR){
     iunlockput(ip);
+    end_op();
     return -1;
   }
   iunlock(ip);
   iput(proc->cwd);
+  end_op();
   proc->cwd = ip;
   return 0;
 }
 
-int
-sys_exec(void)
+// Fetch the nth system call argument as a null-terminated array
+// of at most MAXARG strings into argv.
+static int
+argargv(int n, char **argv)
 {
-  char *path, *argv[MAXARG];
   int i;
   uint uargv, uarg;
 
-  if(argstr(0, &path) < 0 || argint(1, (int*)&uargv) < 0){
+  if(argint(n, (int*)&uargv) < 0)
     return -1;
-  }
-  memset(argv, 0, sizeof(argv));
+  memset(argv, 0, MAXARG * sizeof(argv[0]));
   for(i=0;; i++){
-    if(i >= NELEM(argv))
+    if(i >= MAXARG)
       return -1;
-    if(fetchint(proc, uargv+4*i, (int*)&uarg) < 0)
+    if(fetchint(uargv+4*i, (int*)&uarg) < 0)
       return -1;
     if(uarg == 0){
       argv[i] = 0;
       break;
     }
-    if(fetchstr(proc, uarg, &argv[i]) < 0)
+    if(fetchstr(uarg, &argv[i]) < 0)
       return -1;
   }
+  return 0;
+}
+
+// Fetch the nth system call argument as a path and the n+1th as
+// an argv for exec.
+static int
+argexec(int n, char *path, char **argv)
+{
+  if(argstr(n, path, MAXPATH) < 0)
+    return -1;
+  return argargv(n+1, argv);
+}
+
+int
+sys_exec(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+
+  if(argexec(0, path, argv) < 0)
+    return -1;
   return exec(path, argv);
 }
 
+int
+sys_spawn(void)
+{
+  char path[MAXPATH], *argv[MAXARG];
+  struct spawnact acts[SPAWN_MAX], *uacts;
+  int nact;
+
+  if(argexec(0, path, argv) < 0 || argint(3, &nact) < 0)
+    return -1;
+  if(nact < 0 || nact > SPAWN_MAX ||
+     argptr(2, (char**)&uacts, nact * sizeof(acts[0])) < 0)
+    return -1;
+  memmove(acts, uacts, nact * sizeof(acts[0]));
+  return spawn(path, argv, acts, nact);
+}
+
+int
+sys_mktemplate(void)
+{
+  int argvp;
+
+  if(argint(0, &argvp) < 0)
+    return -1;
+  return mktemplate(argvp);
+}
+
+int
+sys_spawn_from(void)
+{
+  char *argv[MAXARG];
+  int pid;
+
+  if(argint(0, &pid) < 0 || argargv(1, argv) < 0)
+    return -1;
+  return spawn_from(pid, argv);
+}
+
 int
 sys_pipe(void)
 {
@@ -379,9 +656,9 @@ sys_pipe(void)
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
+  if((fd0 = fdalloc(proc, rf)) < 0 || (fd1 = fdalloc(proc, wf)) < 0){
     if(fd0 >= 0)
-      proc->ofile[fd0] = 0;
+      fdset(proc, fd0, 0);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -391,19 +668,132 @@ sys_pipe(void)
   return 0;
 }
 
+// Open a UDP socket.
+int
+sys_socket(void)
+{
+  struct file *f;
+  int fd;
+
+  if(sockalloc(&f) < 0)
+    return -1;
+  if((fd = fdalloc(proc, f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+int
+sys_bind(void)
+{
+  struct file *f;
+  int port;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &port) < 0 || f->type != FD_SOCK)
+    return -1;
+  return sockbind(f->sock, port);
+}
+
+int
+sys_connect(void)
+{
+  struct file *f;
+  int addr, port;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &addr) < 0 || argint(2, &port) < 0 ||
+     f->type != FD_SOCK)
+    return -1;
+  return sockconnect(f->sock, addr, port);
+}
+
+// Fetch the socket and the n-entry mmsghdr array of sendmmsg
+// or recvmmsg.
+static int
+argmmsg(struct file **f, struct mmsghdr **m, int *n)
+{
+  if(argfd(0, 0, f) < 0 || (*f)->type != FD_SOCK)
+    return -1;
+  if(argint(2, n) < 0 || *n < 0 || *n > MMSG_MAX)
+    return -1;
+  return argptr(1, (char**)m, *n * sizeof(**m));
+}
+
+// Send up to n datagrams; returns how many were sent.
+int
+sys_sendmmsg(void)
+{
+  struct file *f;
+  struct mmsghdr *m;
+  struct iovec iov[IOV_MAX];
+  int i, n, r;
+
+  if(argmmsg(&f, &m, &n) < 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    if(fetchiov(m[i].msg_iov, m[i].msg_iovlen, iov) < 0)
+      break;
+    if((r = socksend(f->sock, iov, m[i].msg_iovlen, m[i].addr, m[i].port)) < 0)
+      break;
+    m[i].len = r;
+  }
+  return i > 0 || n == 0 ? i : -1;
+}
+
+// Receive up to n datagrams, waiting only for the first; returns
+// how many were received.
+int
+sys_recvmmsg(void)
+{
+  struct file *f;
+  struct mmsghdr *m;
+  struct iovec iov[IOV_MAX];
+  int i, n, r;
+
+  if(argmmsg(&f, &m, &n) < 0)
+    return -1;
+  for(i = 0; i < n; i++){
+    if(fetchiov(m[i].msg_iov, m[i].msg_iovlen, iov) < 0)
+      break;
+    r = sockrecv(f->sock, iov, m[i].msg_iovlen, &m[i].addr, &m[i].port,
+                 f->nonblock || i > 0);
+    if(r < 0)
+      break;
+    m[i].len = r;
+  }
+  return i > 0 || n == 0 ? i : -1;
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int off, len, prot;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &len) < 0 ||
+     argint(3, &prot) < 0)
+    return -1;
+  if(prot != PROT_READ)
+    return -1;  // only read-only mappings for now
+  return mmap(f, off, len);
+}
+
 int
 sys_tagFile(void)
 {
   // int tagFile(int fileDescriptor, char* key, char* value, int valueLength);
   int fileDescriptor;
-  char* key;
-  char* value;
-  int valueLength;
+  char key[sizeof(struct Key)];
+  char value[sizeof(((struct Value*)0)->value)];
+  int uvalue, valueLength, r;
   if (argint(0, &fileDescriptor) < 0) return -1;
-  if (argstr(1, &key) < 0) return -1;
-  if (argstr(2, &value) < 0) return -1;
-  if (argint(3, &valueLength) < 0) return -1;
-  return tagFile(fileDescriptor, key, value, valueLength);
+  if (argstr(1, key, sizeof(key)) < 0) return -1;
+  if (argint(3, &valueLength) < 0 || valueLength < 0 || valueLength > sizeof(value)) return -1;
+  if (argint(2, &uvalue) < 0 || copyin(value, uvalue, valueLength) < 0) return -1;
+  begin_op();
+  r = tagFile(fileDescriptor, key, value, valueLength);
+  end_op();
+  return r;
 }
 
 int
@@ -411,10 +801,14 @@ sys_removeFileTag(void)
 {
   // int removeFileTag(int fileDescriptor, char* key);
   int fileDescriptor;
-  char* key;
+  char key[sizeof(struct Key)];
+  int r;
   if (argint(0, &fileDescriptor) < 0) return -1;
-  if (argstr(1, &key) < 0) return -1;
-  return removeFileTag(fileDescriptor, key);
+  if (argstr(1, key, sizeof(key)) < 0) return -1;
+  begin_op();
+  r = removeFileTag(fileDescriptor, key);
+  end_op();
+  return r;
 }
 
 int
@@ -422,13 +816,13 @@ sys_getFileTag(void)
 {
   // int getFileTag(int fileDescriptor, char* key, char* buffer, int length);
   int fileDescriptor;
-  char* key;
+  char key[sizeof(struct Key)];
   char* buffer;
   int length;
   if (argint(0, &fileDescriptor) < 0) return -1;
-  if (argstr(1, &key) < 0) return -1;
-  if (argstr(2, &buffer) < 0) return -1;
+  if (argstr(1, key, sizeof(key)) < 0) return -1;
   if (argint(3, &length) < 0) return -1;
+  if (argptr(2, &buffer, length) < 0) return -1;
   return getFileTag(fileDescriptor, key, buffer, length);
 }
 
@@ -440,8 +834,8 @@ sys_getAllTags(void)
   struct Key *keys;
   int maxTags;
   if (argint(0, &fileDescriptor) < 0) return -1;
+  if (argint(2, &maxTags) < 0 || maxTags < 0 || maxTags > USERTOP / sizeof(struct Key)) return -1;  // keeps maxTags * size from overflowing
   if (argptr(1, (char**)&keys, sizeof(struct Key) * maxTags) < 0) return -1;
-  if (argint(2, &maxTags) < 0) return -1;
   return getAllTags(fileDescriptor, keys, maxTags);
 }
 
@@ -449,15 +843,286 @@ int
 sys_getFilesByTag(void)
 {
   // int getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength);
-  char* key;
-  char* value;
-  int valueLength;
+  char key[sizeof(struct Key)];
+  char value[sizeof(((struct Value*)0)->value)];
+  int uvalue, valueLength;
+  char* results;
+  int resultsLength, r;
+  if (argstr(0, key, sizeof(key)) < 0) return -1;
+  if (argint(2, &valueLength) < 0 || valueLength < 0 || valueLength > sizeof(value)) return -1;
+  if (argint(1, &uvalue) < 0 || copyin(value, uvalue, valueLength) < 0) return -1;
+  if (argint(4, &resultsLength) < 0) return -1;
+  if (argptr(3, &results, resultsLength) < 0) return -1;
+  begin_op();  // dropping an inode reference may free it
+  r = getFilesByTag(key, value, valueLength, results, resultsLength);
+  end_op();
+  return r;
+}
+
+int
+sys_getFilesByQuery(void)
+{
+  // int getFilesByQuery(struct tagterm* terms, int n, char* results, int resultsLength);
+  struct tagterm *t;
   char* results;
-  int resultsLength;
-  if (argstr(0, &key) < 0) return -1;
-  if (argstr(1, &value) < 0) return -1;
-  if (argint(2, &valueLength) < 0) return -1;
-  if (argstr(3, &results) < 0) return -1;
-  if (argint(4, &resultsLength)) return -1;
-  return getFilesByTag(key, value, valueLength, results, resultsLength);
-}
\ No newline at end of file
+  int uterms, n, resultsLength, r;
+  if (argint(1, &n) < 0 || n < 1 || n > TQMAX) return -1;
+  if (argint(0, &uterms) < 0) return -1;
+  if (argint(3, &resultsLength) < 0) return -1;
+  if (argptr(2, &results, resultsLength) < 0) return -1;
+  if ((t = (struct tagterm*)kalloc()) == 0) return -1;
+  r = -1;
+  if (copyin(t, uterms, n * sizeof(*t)) == 0 && tqvalid(t, n)) {
+    begin_op();  // dropping an inode reference may free it
+    r = getFilesByQuery(t, n, results, resultsLength);
+    end_op();
+  }
+  kfree((char*)t);
+  return r;
+}
+
+int
+sys_getFilesByTagPage(void)
+{
+  // int getFilesByTagPage(char* key, char* value, int valueLength, struct tagrec* recs, int max, uint* cursor);
+  char key[sizeof(struct Key)];
+  char value[sizeof(((struct Value*)0)->value)];
+  int uvalue, valueLength;
+  struct tagrec* recs;
+  uint* cursor;
+  int max, r;
+  if (argstr(0, key, sizeof(key)) < 0) return -1;
+  if (argint(2, &valueLength) < 0 || valueLength < 0 || valueLength > sizeof(value)) return -1;
+  if (argint(1, &uvalue) < 0 || copyin(value, uvalue, valueLength) < 0) return -1;
+  if (argint(4, &max) < 0 || max < 1) return -1;
+  if (argptr(3, (char**)&recs, max * sizeof(*recs)) < 0) return -1;
+  if (argptr(5, (char**)&cursor, sizeof(*cursor)) < 0) return -1;
+  begin_op();  // dropping an inode reference may free it
+  r = getFilesByTagPage(key, value, valueLength, recs, max, cursor);
+  end_op();
+  return r;
+}
+
+int
+sys_tagFileBatch(void)
+{
+  // int tagFileBatch(int fileDescriptor, struct Key keys[], struct Value values[], int n);
+  int fileDescriptor;
+  struct Key *keys;
+  struct Value *values;
+  int n, m, r, done;
+  if (argint(0, &fileDescriptor) < 0) return -1;
+  if (argint(3, &n) < 0 || n < 0 || n > USERTOP / (sizeof(struct Key) + sizeof(struct Value))) return -1;  // keeps n * size from overflowing
+  if (argptr(1, (char**)&keys, sizeof(struct Key) * n) < 0) return -1;
+  if (argptr(2, (char**)&values, sizeof(struct Value) * n) < 0) return -1;
+  // A few tags per transaction, so a big batch can't overflow the log.
+  done = 0;
+  do {
+    m = n - done < TAGSPEROP ? n - done : TAGSPEROP;
+    begin_op();
+    r = tagFileBatch(fileDescriptor, keys + done, values + done, m);
+    end_op();
+    if (r > 0) done += r;
+  } while (r == m && done < n);
+  return done > 0 ? done : r;
+}
+
+int
+sys_getFileTags(void)
+{
+  // int getFileTags(int fileDescriptor, struct Key keys[], struct Value values[], int n);
+  int fileDescriptor;
+  struct Key *keys;
+  struct Value *values;
+  int n;
+  if (argint(0, &fileDescriptor) < 0) return -1;
+  if (argint(3, &n) < 0 || n < 0 || n > USERTOP / (sizeof(struct Key) + sizeof(struct Value))) return -1;  // keeps n * size from overflowing
+  if (argptr(1, (char**)&keys, sizeof(struct Key) * n) < 0) return -1;
+  if (argptr(2, (char**)&values, sizeof(struct Value) * n) < 0) return -1;
+  return getFileTags(fileDescriptor, keys, values, n);
+}
+int
+sys_sync(void)
+{
+  iflush();
+  bsync();
+  return 0;
+}
+
+// Write everything back, then forget the inodes and file pages
+// no one holds, so what is read next comes from the disk.
+int
+sys_dropcaches(void)
+{
+  iflush();
+  bsync();
+  iprune();
+  pcprune();
+  return 0;
+}
+
+int
+sys_fsync(void)
+{
+  struct file *f;
+  int r;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+    return -1;
+  begin_op();
+  ilock(f->ip);
+  r = isync(f->ip);
+  iunlock(f->ip);
+  end_op();
+  return r;
+}
+
+int
+sys_ftruncate(void)
+{
+  struct file *f;
+  int length;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &length) < 0 || length < 0)
+    return -1;
+  return filetruncate(f, length);
+}
+
+int
+sys_fallocate(void)
+{
+  struct file *f;
+  int off, len;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &len) < 0 ||
+     off < 0 || len < 0)
+    return -1;
+  return fileallocate(f, off, len);
+}
+
+int
+sys_bcachestat(void)
+{
+  struct bcachestat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  bstat(st);
+  return 0;
+}
+
+int
+sys_idestat(void)
+{
+  struct idestat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  idestat(st);
+  return 0;
+}
+
+int
+sys_poll(void)
+{
+  struct pollfd *fds;
+  int n, timeout;
+
+  if(argint(1, &n) < 0 || argint(2, &timeout) < 0 || n < 0 || n > NOFILEMAX)
+    return -1;
+  if(argptr(0, (void*)&fds, n*sizeof(*fds)) < 0)
+    return -1;
+  return poll(fds, n, timeout);
+}
+
+int
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg, fl;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &cmd) < 0 || argint(2, &arg) < 0)
+    return -1;
+  switch(cmd){
+  case F_GETFL:
+    fl = !f->writable ? O_RDONLY : f->readable ? O_RDWR : O_WRONLY;
+    return fl | (f->nonblock ? O_NONBLOCK : 0);
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+int
+sys_mount(void)
+{
+  char path[MAXPATH];
+  int dev, r;
+
+  if(argstr(0, path, sizeof(path)) < 0 || argint(1, &dev) < 0)
+    return -1;
+  begin_op();
+  r = mount(path, dev);
+  end_op();
+  return r;
+}
+
+// Make an aio file for aio_read and aio_write to report to.
+int
+sys_aio_setup(void)
+{
+  struct file *f;
+  int fd;
+
+  if(aioalloc(&f) < 0)
+    return -1;
+  if((fd = fdalloc(proc, f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+static int
+aiosys(int write)
+{
+  struct file *af, *f;
+  int n, off, tag;
+  char *p;
+
+  if(argfd(0, 0, &af) < 0 || argfd(1, 0, &f) < 0 || argint(3, &n) < 0 ||
+     argptr(2, &p, n) < 0 || argint(4, &off) < 0 || argint(5, &tag) < 0)
+    return -1;
+  if(af->type != FD_AIO)
+    return -1;
+  return aiosubmit(af->aio, f, write, p, n, off, tag);
+}
+
+int
+sys_aio_read(void)
+{
+  return aiosys(0);
+}
+
+int
+sys_aio_write(void)
+{
+  return aiosys(1);
+}
+
+// Make a notify file reporting the changes in mask; see notify.h.
+int
+sys_notify_open(void)
+{
+  struct file *f;
+  int fd, mask;
+
+  if(argint(0, &mask) < 0 || notifyalloc(&f, mask) < 0)
+    return -1;
+  if((fd = fdalloc(proc, f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
@@ -28,4 +28,61 @@ int sys_removeFileTag(void);
 int sys_getFileTag(void);
 int sys_getAllTags(void);
 int sys_getFilesByTag(void);
+int sys_bcachestat(void);
+int sys_sync(void);
+int sys_fsync(void);
+int sys_idestat(void);
+int sys_tagFileBatch(void);
+int sys_getFileTags(void);
+int sys_pread(void);
+int sys_pwrite(void);
+int sys_readv(void);
+int sys_writev(void);
+int sys_mmap(void);
+int sys_sendfile(void);
+int sys_splice(void);
+int sys_tee(void);
+int sys_getprocs(void);
+int sys_setaffinity(void);
+int sys_lockstat(void);
+int sys_ringenter(void);
+int sys_syscallstat(void);
+int sys_clock_gettime(void);
+int sys_intrstat(void);
+int sys_irqaffinity(void);
+int sys_profctl(void);
+int sys_profread(void);
+int sys_tracectl(void);
+int sys_traceread(void);
+int sys_spawn(void);
+int sys_ftruncate(void);
+int sys_fallocate(void);
+int sys_poll(void);
+int sys_fcntl(void);
+int sys_mount(void);
+int sys_socket(void);
+int sys_bind(void);
+int sys_connect(void);
+int sys_sendmmsg(void);
+int sys_recvmmsg(void);
+int sys_swapstat(void);
+int sys_shrinkstat(void);
+int sys_ksm(void);
+int sys_getdents_stat(void);
+int sys_getprocstat(void);
+int sys_perfctr(void);
+int sys_latencyctl(void);
+int sys_getlatency(void);
+int sys_aio_setup(void);
+int sys_aio_read(void);
+int sys_aio_write(void);
+int sys_getFilesByQuery(void);
+int sys_getFilesByTagPage(void);
+int sys_notify_open(void);
+int sys_copy_file_range(void);
+int sys_mktemplate(void);
+int sys_spawn_from(void);
+int sys_madvise(void);
+int sys_vmsplice(void);
+int sys_dropcaches(void);
 #endif // _SYSFUNC_H_
\ No newline at end of file
@@ -4,6 +4,19 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
+#include "ProcessInfo.h"
+#include "ProcStat.h"
+#include "LockStat.h"
+#include "LatStat.h"
+#include "SyscallStat.h"
+#include "IntrStat.h"
+#include "ProfSample.h"
+#include "swapstat.h"
+#include "ShrinkStat.h"
+#include "ksm.h"
+#include "trace.h"
+#include "traps.h"
+#include "time.h"
 #include "sysfunc.h"
 
 int
@@ -35,6 +48,139 @@ sys_kill(void)
   return kill(pid);
 }
 
+int
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int
+sys_lockstat(void)
+{
+  struct LockStat *t;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getlockstats(t, n);
+}
+
+int
+sys_syscallstat(void)
+{
+  struct SyscallStat *t;
+  int pid, n;
+
+  if(argint(0, &pid) < 0 || argint(2, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSYSCALL)
+    n = NSYSCALL;
+  if(argptr(1, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getsyscallstats(pid, t, n);
+}
+
+int
+sys_intrstat(void)
+{
+  struct IntrStat *t;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NIRQ)
+    n = NIRQ;
+  if(argptr(0, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getintrstats(t, n);
+}
+
+int
+sys_irqaffinity(void)
+{
+  int irq, c;
+
+  if(argint(0, &irq) < 0 || argint(1, &c) < 0)
+    return -1;
+  return ioapicroute(irq, c);
+}
+
+int
+sys_profctl(void)
+{
+  int flags;
+
+  if(argint(0, &flags) < 0)
+    return -1;
+  return profctl(flags);
+}
+
+int
+sys_profread(void)
+{
+  struct ProfSample *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU * NPROFSAMPLE)
+    n = NCPU * NPROFSAMPLE;
+  if(argptr(0, (char**)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+  return profread(buf, n);
+}
+
+int
+sys_tracectl(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  return tracectl(mask);
+}
+
+int
+sys_traceread(void)
+{
+  struct TraceRec *buf;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NCPU * NTRACEREC)
+    n = NCPU * NTRACEREC;
+  if(argptr(0, (char**)&buf, n * sizeof(*buf)) < 0)
+    return -1;
+  return traceread(buf, n);
+}
+
+int
+sys_clock_gettime(void)
+{
+  struct timespec *ts;
+  uint64 ns;
+  uint r;
+  int clk;
+
+  if(argint(0, &clk) < 0 || argptr(1, (char**)&ts, sizeof(*ts)) < 0)
+    return -1;
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  ns = nsuptime();
+  ts->tv_sec = div64(ns, 1000000000, &r);
+  ts->tv_nsec = r;
+  return 0;
+}
+
 int
 sys_getpid(void)
 {
@@ -55,25 +201,24 @@ sys_sbrk(void)
   return addr;
 }
 
+int
+sys_madvise(void)
+{
+  int va, n, advice;
+
+  if(argint(0, &va) < 0 || argint(1, &n) < 0 || argint(2, &advice) < 0)
+    return -1;
+  return madvise(va, n, advice);
+}
+
 int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
   
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(proc->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  return sleepticks(n);
 }
 
 // return how many clock tick interrupts have occurred
@@ -81,10 +226,115 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
-  
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return clockread(0);
+}
+
+// getprocs fills in a kernel copy of the table, since storing
+// to user memory may fault, and that is copied out after.
+int
+sys_getprocs(void)
+{
+  struct ProcessInfo *p, *t;
+  int n, order;
+
+  if(argptr(0, (char**)&p, sizeof(struct ProcessInfo) * NPROC) < 0)
+    return -1;
+  for(order = 0; (PGSIZE << order) < sizeof(struct ProcessInfo) * NPROC; order++)
+    ;
+  if((t = (struct ProcessInfo*)kalloc_order(order)) == 0)
+    return -1;
+  n = getprocs(t);
+  if(copyoutp(proc, (uint)p, t, sizeof(struct ProcessInfo) * n) < 0)
+    n = -1;
+  kfree_order((char*)t, order);
+  return n;
+}
+
+int
+sys_getprocstat(void)
+{
+  struct ProcStat *t;
+  int n, since;
+
+  if(argint(1, &n) < 0 || n < 0 || argint(2, &since) < 0)
+    return -1;
+  if(n > NPROC)
+    n = NPROC;
+  if(argptr(0, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getprocstat(t, n, since);
+}
+
+int
+sys_swapstat(void)
+{
+  struct swapstat *st;
+
+  if(argptr(0, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  swapstat(st);
+  return 0;
+}
+
+int
+sys_shrinkstat(void)
+{
+  struct ShrinkStat *t;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NSHRINKER)
+    n = NSHRINKER;
+  if(argptr(0, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getshrinkstats(t, n);
+}
+
+int
+sys_ksm(void)
+{
+  struct ksmstat *st;
+  int on;
+
+  if(argint(0, &on) < 0 || argint(1, (int*)&st) < 0)
+    return -1;
+  if(st && argptr(1, (char**)&st, sizeof(*st)) < 0)
+    return -1;
+  return ksmctl(on, st);
+}
+
+int
+sys_perfctr(void)
+{
+  int event, flags;
+
+  if(argint(0, &event) < 0 || argint(1, &flags) < 0)
+    return -1;
+  return perfctr(event, flags);
+}
+
+int
+sys_latencyctl(void)
+{
+  int on;
+
+  if(argint(0, &on) < 0)
+    return -1;
+  return latencyctl(on);
+}
+
+int
+sys_getlatency(void)
+{
+  struct LatStat *t;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  if(n > NLATENCY)
+    n = NLATENCY;
+  if(argptr(0, (char**)&t, n * sizeof(*t)) < 0)
+    return -1;
+  return getlatency(t, n);
 }
@@ -1,13 +1,21 @@
 // Intel 8253/8254/82C54 Programmable Interval Timer (PIT).
-// Only used on uniprocessors;
+// Only used for interrupts on uniprocessors;
 // SMP machines use the local APIC timer.
+// Every machine times the TSC, and the local APIC timer if
+// it has one, against it at boot.
 
 #include "types.h"
 #include "defs.h"
+#include "param.h"
 #include "traps.h"
 #include "x86.h"
 
 #define IO_TIMER1       0x040           // 8253 Timer #1
+#define IO_TIMER2       0x042           // Counter 2, gated by IO_PORTB
+#define IO_PORTB        0x061
+  #define PORTB_GATE2   0x01            // Counter 2 counts
+  #define PORTB_SPEAKER 0x02            // Counter 2 drives the speaker
+  #define PORTB_OUT2    0x20            // Counter 2's output
 
 // Frequency of all three count-down timers;
 // (TIMER_FREQ/freq) is the appropriate count
@@ -18,15 +26,67 @@
 
 #define TIMER_MODE      (IO_TIMER1 + 3) // timer mode port
 #define TIMER_SEL0      0x00    // select counter 0
+#define TIMER_SEL2      0x80    // select counter 2
+#define TIMER_INTTC     0x00    // mode 0, interrupt on terminal count
 #define TIMER_RATEGEN   0x04    // mode 2, rate generator
 #define TIMER_16BIT     0x30    // r/w counter 16 bits, LSB first
 
+#define CALHZ           20      // calibrate over 1/CALHZ seconds
+
+uint tsckhz;     // TSC cycles per millisecond
+uint tsctick;    // TSC cycles per clock tick
+uint64 boottsc;  // TSC when it was calibrated
+
 void
 timerinit(void)
 {
-  // Interrupt 100 times/sec.
+  // Interrupt HZ times/sec.
   outb(TIMER_MODE, TIMER_SEL0 | TIMER_RATEGEN | TIMER_16BIT);
-  outb(IO_TIMER1, TIMER_DIV(100) % 256);
-  outb(IO_TIMER1, TIMER_DIV(100) / 256);
+  outb(IO_TIMER1, TIMER_DIV(HZ) % 256);
+  outb(IO_TIMER1, TIMER_DIV(HZ) / 256);
   picenable(IRQ_TIMER);
 }
+
+// Count the TSC over 1/CALHZ seconds of counter 2, which only
+// counts while its gate is up and interrupts nothing, and set
+// tsckhz.  If tccr isn't 0 it is the local APIC timer's current
+// count, counting down; return its counts per second.
+uint
+tsccalibrate(volatile uint *tccr)
+{
+  uint64 t;
+  uint c;
+
+  outb(IO_PORTB, (inb(IO_PORTB) & ~PORTB_SPEAKER) | PORTB_GATE2);
+  outb(TIMER_MODE, TIMER_SEL2 | TIMER_INTTC | TIMER_16BIT);
+  outb(IO_TIMER2, TIMER_DIV(CALHZ) % 256);
+  outb(IO_TIMER2, TIMER_DIV(CALHZ) / 256);
+  c = tccr ? *tccr : 0;
+  t = rdtsc();
+  while(!(inb(IO_PORTB) & PORTB_OUT2))
+    ;
+  boottsc = rdtsc();
+  if(tccr)
+    c -= *tccr;
+  tsckhz = div64(boottsc - t, 1000 / CALHZ, 0);
+  tsctick = div64((uint64)tsckhz * 1000, HZ, 0);
+  return c * CALHZ;
+}
+
+// Clock ticks since the TSC was calibrated.
+uint
+tscticks(void)
+{
+  return div64(rdtsc() - boottsc, tsctick, 0);
+}
+
+// Nanoseconds since the TSC was calibrated.
+uint64
+nsuptime(void)
+{
+  uint64 ms;
+  uint r;
+
+  ms = div64(rdtsc() - boottsc, tsckhz, &r);
+  return ms * 1000000 + div64((uint64)r * 1000000, tsckhz, 0);
+}
@@ -0,0 +1,112 @@
+// Static tracepoints.
+//
+// TRACE(ev, a, b) at a tracepoint costs one test of tracemask
+// unless event ev is on; then it appends a timestamped record to
+// the CPU's ring.  Only the CPU itself adds to its ring, with
+// interrupts off, so tracing takes no lock and can be done with
+// any lock held or from an interrupt.  Readers take tracelock
+// among themselves.  A full ring drops records until traceread
+// drains it.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "trace.h"
+
+static struct {
+  volatile uint head;    // Next to read
+  volatile uint tail;    // Next to write
+  struct TraceRec r[NTRACEREC];
+} __attribute__((aligned(CACHELINE))) rings[NCPU];
+
+static struct spinlock tracelock __attribute__((aligned(CACHELINE)));
+uint tracemask;
+static uint tracedropped;
+
+void
+traceinit(void)
+{
+  initlock(&tracelock, "trace");
+#ifdef TRACEBOOT
+  tracemask = TR_ALL;
+#endif
+}
+
+// Record event ev on this CPU.  Use TRACE instead.
+void
+trace(int ev, uint a, uint b)
+{
+  struct TraceRec *r;
+  int c;
+
+  pushcli();
+  c = cpu - cpus;
+  if(rings[c].tail - rings[c].head == NTRACEREC){
+    tracedropped++;
+    popcli();
+    return;
+  }
+  r = &rings[c].r[rings[c].tail % NTRACEREC];
+  r->tsc = rdtsc();
+  r->ev = ev;
+  r->cpu = c;
+  r->pid = proc ? proc->pid : 0;
+  r->a = a;
+  r->b = b;
+  __sync_synchronize();  // the record before the tail that shows it
+  rings[c].tail++;
+  popcli();
+}
+
+// Trace the events in mask, a bit per TR_ event, emptying the
+// rings, or stop if mask is 0.  Returns how many records were
+// dropped for a full ring since tracing last started.
+int
+tracectl(uint mask)
+{
+  uint dropped;
+  int c;
+
+  acquire(&tracelock);
+  dropped = tracedropped;
+  if(mask){
+    tracemask = 0;
+    for(c = 0; c < ncpu; c++)
+      rings[c].head = rings[c].tail;
+    tracedropped = 0;
+  }
+  tracemask = mask & TR_ALL;
+  release(&tracelock);
+  return dropped;
+}
+
+// Move up to n records, oldest first on each CPU, to buf, which
+// caller has checked is n records of user memory.  Returns how
+// many, or -1 if tracing is off and there are none left.
+int
+traceread(struct TraceRec *buf, int n)
+{
+  struct TraceRec r;
+  int c, got;
+
+  acquire(&tracelock);
+  got = 0;
+  for(c = 0; c < ncpu && got < n; c++){
+    while(got < n && rings[c].head != rings[c].tail){
+      r = rings[c].r[rings[c].head % NTRACEREC];
+      __sync_synchronize();  // copy the record before freeing its slot
+      rings[c].head++;
+      release(&tracelock);  // buf may fault
+      buf[got++] = r;
+      acquire(&tracelock);
+    }
+  }
+  if(got == 0 && tracemask == 0)
+    got = -1;
+  release(&tracelock);
+  return got;
+}
@@ -6,12 +6,51 @@
 #include "x86.h"
 #include "traps.h"
 #include "spinlock.h"
+#include "IntrStat.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 struct gatedesc idt[256];
 extern uint vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
+// The clock: ticks, and the TSC when tick ticks began.  Only
+// clockupdate changes them, holding clock.lock; readers of both
+// use clockread, and of ticks alone just read it.
+static struct {
+  struct seqlock lock;
+  uint64 tsc;
+} clock __attribute__((aligned(CACHELINE)));
 uint ticks;
+static uint nintr[NCPU][NIRQ] __attribute__((aligned(CACHELINE)));  // Interrupts taken, by CPU and IRQ
+static char dfstack[NCPU][PGSIZE];  // Stacks for double faults
+
+static void
+intrkstat(struct kstatbuf *b)
+{
+  uint n;
+  int irq, i;
+
+  for(irq = 0; irq < NIRQ; irq++){
+    n = 0;
+    for(i = 0; i < ncpu; i++)
+      n += nintr[i][irq];
+    if(n)
+      kstatputi(b, irq, 0, n);
+  }
+}
+
+// Per-CPU timer interrupts, and those that came in user mode.
+// With idle CPUs' ticks stopped, ticks less a CPU's is about
+// the time it spent halted.
+static void
+clockkstat(struct kstatbuf *b)
+{
+  int i;
+
+  kstatput(b, "ticks", 0, ticks);
+  for(i = 0; i < ncpu; i++){
+    kstatputi(b, i, "ticks", cpus[i].ticks);
+    kstatputi(b, i, "uticks", cpus[i].uticks);
+  }
+}
 
 void
 tvinit(void)
@@ -21,16 +60,171 @@ tvinit(void)
   for(i = 0; i < 256; i++)
     SETGATE(idt[i], 0, SEG_KCODE<<3, vectors[i], 0);
   SETGATE(idt[T_SYSCALL], 1, SEG_KCODE<<3, vectors[T_SYSCALL], DPL_USER);
+
+  // Double faults switch to the task in SEG_DFTSS.
+  memset(&idt[T_DBLFLT], 0, sizeof(idt[T_DBLFLT]));
+  idt[T_DBLFLT].cs = SEG_DFTSS << 3;
+  idt[T_DBLFLT].type = STS_TG;
+  idt[T_DBLFLT].p = 1;
   
-  initlock(&tickslock, "time");
+  initseqlock(&clock.lock, "clock");
+  kstatreg("intr", intrkstat);
+  kstatreg("clock", clockkstat);
 }
 
+// A double fault comes here as a task of its own, on its own
+// stack.  Running off the bottom of a kernel stack into its guard
+// page causes one: the page fault can't push its frame there.
+// The task switch left the faulting state in cpu->ts.
+static void
+dblfault(void)
+{
+  uint esp;
+
+  esp = (uint)cpu->ts.esp;
+  cprintf("double fault on cpu %d: eip %x esp %x\n",
+          cpu->id, cpu->ts.eip, esp);
+  if(esp >= KSTACKBASE && esp < USERBASE)
+    panic("kernel stack overflow");
+  panic("double fault");
+}
+
+// Load the IDT and set up this CPU's double fault task.
+// Paging must be on.
 void
 idtinit(void)
 {
+  struct taskstate *t;
+
+  t = &cpu->dfts;
+  memset(t, 0, sizeof(*t));
+  t->cr3 = (void*)kpgdirpa();
+  t->eip = (uint*)dblfault;
+  t->esp = (uint*)(dfstack[cpu - cpus] + PGSIZE);
+  t->cs = SEG_KCODE << 3;
+  t->ds = t->es = t->fs = t->ss = SEG_KDATA << 3;
+  t->gs = SEG_KCPU << 3;
+  t->iomb = sizeof(*t);
+  cpu->gdt[SEG_DFTSS] = SEG16(STS_T32A, t, sizeof(*t)-1, 0);
+  cpu->gdt[SEG_DFTSS].s = 0;
   lidt(idt, sizeof(idt));
 }
 
+// The tick count, and if tsc isn't 0 the TSC when that tick
+// began, the two read together without a lock.
+uint
+clockread(uint64 *tsc)
+{
+  uint s, t;
+
+  do {
+    s = readseqbegin(&clock.lock);
+    t = ticks;
+    if(tsc)
+      *tsc = clock.tsc;
+  } while(readseqretry(&clock.lock, s));
+  return t;
+}
+
+// Bring ticks up to the time the TSC gives, and do what each
+// new tick is due.  Any CPU's timer interrupt may do it, and
+// so may a CPU leaving idle, so ticks keep up while CPUs
+// without work, CPU 0 among them, have stopped their ticks.
+void
+clockupdate(void)
+{
+  uint t, old;
+
+  t = tscticks();
+  if((int)(t - ticks) <= 0)  // unlocked peek
+    return;
+  acquireseq(&clock.lock);
+  old = ticks;
+  if((int)(t - old) > 0){
+    ticks = t;
+    clock.tsc = boottsc + (uint64)t * tsctick;
+    vdsotick(t, clock.tsc);
+  }
+  releaseseq(&clock.lock);
+  if((int)(t - old) <= 0)
+    return;
+  timertick();
+  if(t / BOOSTTICKS != old / BOOSTTICKS)
+    prioboost();
+}
+
+// Fill in up to n interrupt counters, one per IRQ; returns
+// how many.
+int
+getintrstats(struct IntrStat *table, int n)
+{
+  struct IntrStat s;
+  int irq, i;
+
+  if(n > NIRQ)
+    n = NIRQ;
+  for(irq = 0; irq < n; irq++){
+    memset(&s, 0, sizeof(s));
+    for(i = 0; i < ncpu; i++)
+      s.count[i] = nintr[i][irq];
+    s.cpu = ioapiccpu(irq);
+    table[irq] = s;
+  }
+  return n;
+}
+
+// Run the handlers of the PCI devices on line irq, which
+// they may share; returns whether any device uses it.
+static int
+pciintr(int irq)
+{
+  int n;
+
+  n = 0;
+  if(vblkirq && irq == vblkirq){
+    vblkintr();
+    n++;
+  }
+  if(ahciirq && irq == ahciirq){
+    ahciintr();
+    n++;
+  }
+  if(e1000irq && irq == e1000irq){
+    e1000intr();
+    n++;
+  }
+  return n;
+}
+
+// Handle a page fault on a page the process is owed: one to
+// copy on write, or to bring in from its program, the heap,
+// swap or an mmap'd file.  Its other pages stay put meanwhile
+// (see swapreclaim), except that one faulting from user space
+// may swap out its own to make room.  Returns -1 if the fault
+// isn't one of these.
+static int
+pgfault(struct trapframe *tf)
+{
+  uint va;
+  int r, ufault;
+
+  va = rcr2();  // before anything can sleep and fault again
+  proc->pinned++;
+  ufault = proc->ufault;
+  proc->ufault = (tf->cs&3) == DPL_USER;
+  r = -1;
+  if((tf->err & FEC_WR) && cowfault(proc->pgdir, va) == 0){
+    proc->minflt++;
+    r = 0;
+  } else if(!(tf->err & FEC_PR) && lazyfault(proc, va) == 0)
+    r = 0;
+  else if(proc->ufault && mmapfault(proc, va) == 0)
+    r = 0;
+  proc->ufault = ufault;
+  proc->pinned--;
+  return r;
+}
+
 void
 trap(struct trapframe *tf)
 {
@@ -38,28 +232,36 @@ trap(struct trapframe *tf)
     if(proc->killed)
       exit();
     proc->tf = tf;
+    proc->pinned++;
     syscall();
+    proc->pinned--;
     if(proc->killed)
       exit();
     return;
   }
 
+  if(tf->trapno >= T_IRQ0 && tf->trapno < T_IRQ0 + NIRQ)
+    nintr[cpu - cpus][tf->trapno - T_IRQ0]++;
+
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpu->id == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    cpu->ticks++;
+    if((tf->cs&3) == DPL_USER)
+      cpu->uticks++;
+    if(profflags)
+      profsample(tf);
+    clockupdate();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
-    ideintr();
+    ideintr(0);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE+1:
-    // Bochs generates spurious IDE1 interrupts.
+    // Bochs generates spurious IDE1 interrupts, which
+    // ideintr ignores.
+    ideintr(1);
+    lapiceoi();
     break;
   case T_IRQ0 + IRQ_KBD:
     kbdintr();
@@ -69,16 +271,36 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Just to end a hlt; scheduler() looks at the run queues.
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
             cpu->id, tf->cs, tf->eip);
     lapiceoi();
     break;
-   
+
+  case T_PGFLT:
+    if(proc && pgfault(tf) == 0)
+      break;
+    // Bad user address in copyin or copyinstr?  Fail the copy.
+    if(proc && (tf->cs&3) == 0 && tf->eip >= (uint)ucopy && tf->eip < (uint)ucopyend){
+      tf->eip = (uint)ucopyfault;
+      break;
+    }
+    // fall through
   default:
+    if(tf->trapno >= T_IRQ0 && tf->trapno < T_IRQ0 + NIRQ &&
+       pciintr(tf->trapno - T_IRQ0)){
+      lapiceoi();
+      break;
+    }
     if(proc == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
+      if(tf->trapno == T_PGFLT && rcr2() >= KSTACKBASE && rcr2() < USERBASE)
+        panic("kernel stack overflow");
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
               tf->trapno, cpu->id, tf->eip, rcr2());
       panic("trap");
@@ -97,9 +319,14 @@ trap(struct trapframe *tf)
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU when its time slice is up, or
+  // when a wakeup has asked for it (see runnable), unless the
+  // trap came from kernel code running with interrupts off.
   // If interrupts were on while locks held, would need to check nlock.
-  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER &&
+     schedtick((tf->cs&3) == DPL_USER))
+    cpu->resched = 1;
+  if(proc && proc->state == RUNNING && cpu->resched && (tf->eflags & FL_IF))
     yield();
 
   // Check if the process has been killed since we yielded
@@ -6,22 +6,44 @@
 #include "traps.h"
 #include "spinlock.h"
 #include "fs.h"
+#include "sleeplock.h"
 #include "file.h"
 #include "mmu.h"
 #include "proc.h"
 #include "x86.h"
 
 #define COM1    0x3f8
+#define LSR_THRE 0x20   // Transmit holding register empty
+#define IER_RX   0x01   // Receive interrupt
+#define IER_TX   0x02   // Transmit holding register empty interrupt
+#define FIFOSIZE 16     // 16550 transmit FIFO
+#define UARTBUF  4096   // Output ring; a power of two
+
+// Output goes into a ring, and the transmit interrupt moves it
+// to the UART's FIFO, so a writer doesn't wait for the line
+// unless the ring is full.  After a panic, uartsync makes output
+// go out at once, without the lock.
 
 static int uart;    // is there a uart?
 
+static struct {
+  struct spinlock lock;
+  char buf[UARTBUF];
+  uint r;        // Next to send
+  uint w;        // Next free
+  int waiting;   // Someone sleeps in uartwait
+  int sync;      // Panicked: send directly
+} tx __attribute__((aligned(CACHELINE)));
+
 void
 uartinit(void)
 {
   char *p;
 
-  // Turn off the FIFO
-  outb(COM1+2, 0);
+  initlock(&tx.lock, "uart");
+
+  // Turn on the FIFO, cleared, interrupting at each byte in.
+  outb(COM1+2, 0x07);
   
   // 9600 baud, 8 data bits, 1 stop bit, parity off.
   outb(COM1+3, 0x80);    // Unlock divisor
@@ -29,7 +51,7 @@ uartinit(void)
   outb(COM1+1, 0);
   outb(COM1+3, 0x03);    // Lock divisor, 8 data bits.
   outb(COM1+4, 0);
-  outb(COM1+1, 0x01);    // Enable receive interrupts.
+  outb(COM1+1, IER_RX);  // Enable receive interrupts.
 
   // If status is 0xFF, no serial port.
   if(inb(COM1+5) == 0xFF)
@@ -48,6 +70,31 @@ uartinit(void)
     uartputc(*p);
 }
 
+// Move what the FIFO has room for from the ring to it, and
+// interrupt when it empties if there is more.  Returns 1 if
+// uartwait has a sleeper to wake.  Caller holds tx.lock.
+static int
+uartstart(void)
+{
+  int i;
+
+  if(!(inb(COM1+5) & LSR_THRE)){
+    // Still sending: its TX interrupt will call back.
+    if(tx.r != tx.w)
+      outb(COM1+1, IER_RX|IER_TX);
+    return 0;
+  }
+  for(i = 0; i < FIFOSIZE && tx.r != tx.w; i++)
+    outb(COM1+0, tx.buf[tx.r++ % UARTBUF]);
+  outb(COM1+1, tx.r != tx.w ? IER_RX|IER_TX : IER_RX);
+  if(tx.waiting && tx.w - tx.r <= UARTBUF/2){
+    tx.waiting = 0;
+    return 1;
+  }
+  return 0;
+}
+
+// Queue c to be sent.  Waits for the line only if the ring is full.
 void
 uartputc(int c)
 {
@@ -55,9 +102,56 @@ uartputc(int c)
 
   if(!uart)
     return;
-  for(i = 0; i < 128 && !(inb(COM1+5) & 0x20); i++)
-    microdelay(10);
-  outb(COM1+0, c);
+  if(tx.sync){
+    for(i = 0; i < 128 && !(inb(COM1+5) & LSR_THRE); i++)
+      microdelay(10);
+    outb(COM1+0, c);
+    return;
+  }
+  acquire(&tx.lock);
+  while(tx.w - tx.r == UARTBUF){
+    uartstart();
+    pause();
+  }
+  tx.buf[tx.w++ % UARTBUF] = c;
+  uartstart();
+  release(&tx.lock);
+}
+
+// Sleep until the ring has room for n more bytes, or half of it
+// if n is more, so that writing them won't wait for the line.
+void
+uartwait(int n)
+{
+  if(!uart || tx.sync)
+    return;
+  if(n > UARTBUF/2)
+    n = UARTBUF/2;
+  acquire(&tx.lock);
+  while(UARTBUF - (tx.w - tx.r) < n){
+    tx.waiting = 1;
+    sleep(&tx.r, &tx.lock);
+  }
+  release(&tx.lock);
+}
+
+// Send what is queued, and from now on send at once, taking no
+// lock.  For panic, when interrupts are off for good and another
+// CPU may hold tx.lock.
+void
+uartsync(void)
+{
+  int i;
+
+  if(!uart)
+    return;
+  tx.sync = 1;
+  outb(COM1+1, IER_RX);
+  while(tx.r != tx.w){
+    for(i = 0; i < 128 && !(inb(COM1+5) & LSR_THRE); i++)
+      microdelay(10);
+    outb(COM1+0, tx.buf[tx.r++ % UARTBUF]);
+  }
 }
 
 static int
@@ -73,5 +167,15 @@ uartgetc(void)
 void
 uartintr(void)
 {
+  int wake;
+
   consoleintr(uartgetc);
+  if(!uart || tx.sync)
+    return;
+  acquire(&tx.lock);
+  wake = uartstart();
+  release(&tx.lock);
+  // Not under tx.lock: procdump prints holding ptable.lock.
+  if(wake)
+    wakeup(&tx.r);
 }
@@ -0,0 +1,52 @@
+// Pages of kernel data mapped read-only into user space, so
+// that reading the time or the pid takes a load, not a trap.
+//
+// Every page table maps the one shared vdata page at VDSO and
+// its process's own vproc page at VDSOPROC.  The mappings count
+// as sharers of the pages, so freevm drops them like any other
+// user page; the kernel keeps a reference of its own to each.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "vdso.h"
+
+static struct vdata *vdata;
+
+void
+vdsoinit(void)
+{
+  if((vdata = (struct vdata*)kalloc_zeroed()) == 0)
+    panic("vdsoinit");
+  vdata->tsckhz = tsckhz;
+  vdata->boottsc = boottsc;
+}
+
+// Map the vdso pages, vdata and p's vproc, into pgdir.
+// Returns -1 if out of memory.
+int
+mapvdso(pde_t *pgdir, struct proc *p)
+{
+  if(mapuvm(pgdir, VDSO, (char*)vdata, PTE_U) < 0)
+    return -1;
+  kref((char*)vdata);
+  if(mapuvm(pgdir, VDSOPROC, (char*)p->vproc, PTE_U) < 0)
+    return -1;
+  kref((char*)p->vproc);
+  return 0;
+}
+
+// Called with the new tick count and the TSC it began at,
+// holding the clock's seqlock for writing.
+void
+vdsotick(uint t, uint64 tsc)
+{
+  vdata->seq++;
+  vdata->tsc = tsc;
+  vdata->tscpertick = tsctick;
+  vdata->ticks = t;
+  vdata->seq++;
+}
@@ -0,0 +1,304 @@
+// virtio-blk driver, for the file system disk under QEMU with
+// make VIRTIO=1.  Uses the legacy PCI interface: one request
+// queue in I/O space, no MSI-X.
+//
+// Each request is a chain of three descriptors: a header naming
+// the sector, the buf's data, and a status byte the device
+// fills in.  Requests are queued without waiting for earlier
+// ones, up to a third of the queue size, and the device is only
+// notified once a batch is queued, and when it hasn't said it is
+// already looking at the queue.  The interrupt handler, like
+// ideintr, leaves completing the bufs to a work item, which
+// takes every request the device has finished in one pass.
+//
+// The block layer sends the bufs of dev 1 here when the device
+// is present, so the rest of the kernel sees no change.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "buf.h"
+#include "pci.h"
+#include "fs.h"
+#include "work.h"
+
+#define VIRTIO_VENDOR     0x1af4
+#define VIRTIO_BLK_LEGACY 0x1001
+
+// Legacy virtio PCI registers, relative to the I/O base in BAR0.
+#define VIO_GUESTFEAT 0x04  // features the driver takes
+#define VIO_QADDR     0x08  // queue's page frame number
+#define VIO_QSIZE     0x0c  // queue's descriptor count
+#define VIO_QSEL      0x0e  // queue the above refer to
+#define VIO_QNOTIFY   0x10  // write a queue number to kick it
+#define VIO_STATUS    0x12
+#define VIO_ISR       0x13  // read to acknowledge the interrupt
+#define VIO_CONFIG    0x14  // device config: capacity in sectors
+
+#define VIO_ACK       0x01  // in VIO_STATUS: driver found device
+#define VIO_DRIVER    0x02  //   driver knows how to drive it
+#define VIO_DRIVEROK  0x04  //   driver is ready
+#define VIO_FAILED    0x80  //   driver gave up
+
+#define VRING_NEXT    1     // descriptor continues via next
+#define VRING_WRITE   2     // device writes the buffer
+#define VRING_NONOTIFY 1    // in used flags: don't kick us
+#define VRING_ALIGN   4096
+
+#define VBLK_IN       0     // request types
+#define VBLK_OUT      1
+
+#define VBLK_MAXQ     1024  // largest queue we'll drive
+#define SPB           (BSIZE / SECTSIZE)
+
+struct vrdesc {
+  uint64 addr;
+  uint len;
+  ushort flags;
+  ushort next;
+};
+
+struct vravail {
+  ushort flags;
+  ushort idx;
+  ushort ring[];
+};
+
+struct vrusedelem {
+  uint id;   // head of the finished chain
+  uint len;
+};
+
+struct vrused {
+  ushort flags;
+  ushort idx;
+  struct vrusedelem ring[];
+};
+
+struct vblkhdr {
+  uint type;
+  uint reserved;
+  uint64 sector;
+};
+
+int vblkirq;  // IRQ line, 0 if there is no device
+
+static struct {
+  struct spinlock lock;
+  ushort iobase;
+  int qsize;
+  uint64 capacity;          // in sectors
+  struct vrdesc *desc;
+  struct vravail *avail;
+  struct vrused *used;
+  int order;                // the ring is 2^order pages
+  ushort freehead;          // free descriptors, chained by next
+  int nfree;
+  ushort usedidx;           // next used entry to look at
+  struct work work;
+  // Indexed by the head descriptor of a request.
+  struct {
+    struct vblkhdr hdr;
+    uchar status;
+    struct buf *b;
+  } req[VBLK_MAXQ];
+} vblk __attribute__((aligned(CACHELINE)));
+
+static void vblkcomplete(void*);
+
+// Find and set up the device.  Leaves vblkirq 0 if there is
+// none, or it can't be driven.
+void
+vblkinit(void)
+{
+  int tag, i, n, ringsz;
+  uint bar;
+  char *ring;
+
+  if((tag = pcifindid(VIRTIO_VENDOR, VIRTIO_BLK_LEGACY)) < 0)
+    return;
+  bar = pciread(tag, PCI_BAR(0));
+  if(!(bar & PCI_BAR_IO))
+    return;
+  pciwrite(tag, PCI_CMD, pciread(tag, PCI_CMD) | PCI_CMD_IO | PCI_CMD_MASTER);
+  vblk.iobase = bar & ~3;
+
+  outb(vblk.iobase+VIO_STATUS, 0);  // reset
+  outb(vblk.iobase+VIO_STATUS, VIO_ACK);
+  outb(vblk.iobase+VIO_STATUS, VIO_ACK|VIO_DRIVER);
+  outl(vblk.iobase+VIO_GUESTFEAT, 0);
+
+  outw(vblk.iobase+VIO_QSEL, 0);
+  n = inw(vblk.iobase+VIO_QSIZE);
+  if(n < 3 || n > VBLK_MAXQ){
+    outb(vblk.iobase+VIO_STATUS, VIO_FAILED);
+    return;
+  }
+  ringsz = PGROUNDUP(n*sizeof(struct vrdesc) + (3+n)*sizeof(ushort)) +
+    PGROUNDUP(3*sizeof(ushort) + n*sizeof(struct vrusedelem));
+  for(vblk.order = 0; (PGSIZE << vblk.order) < ringsz; vblk.order++)
+    ;
+  if((ring = kalloc_order(vblk.order)) == 0){
+    outb(vblk.iobase+VIO_STATUS, VIO_FAILED);
+    return;
+  }
+  memset(ring, 0, PGSIZE << vblk.order);
+  vblk.qsize = n;
+  vblk.desc = (struct vrdesc*)ring;
+  vblk.avail = (struct vravail*)(ring + n*sizeof(struct vrdesc));
+  vblk.used = (struct vrused*)(ring +
+    PGROUNDUP(n*sizeof(struct vrdesc) + (3+n)*sizeof(ushort)));
+  for(i = 0; i < n; i++)
+    vblk.desc[i].next = i + 1;
+  vblk.freehead = 0;
+  vblk.nfree = n;
+  // The ring is identity mapped, so this is its physical address.
+  outl(vblk.iobase+VIO_QADDR, (uint)ring / VRING_ALIGN);
+
+  vblk.capacity = inl(vblk.iobase+VIO_CONFIG) |
+    (uint64)inl(vblk.iobase+VIO_CONFIG+4) << 32;
+  initlock(&vblk.lock, "vblk");
+  work_init(&vblk.work, vblkcomplete, 0);
+  vblkirq = pciread(tag, PCI_INTR) & 0xff;
+  picenable(vblkirq);
+  ioapicenable(vblkirq, ncpu - 1);
+  outb(vblk.iobase+VIO_STATUS, VIO_ACK|VIO_DRIVER|VIO_DRIVEROK);
+  cprintf("virtio-blk: %d sectors, queue %d, irq %d\n",
+          (uint)vblk.capacity, n, vblkirq);
+}
+
+// Take a descriptor off the free chain.  Caller holds vblk.lock
+// and has checked there is one.
+static int
+vblkalloc(void)
+{
+  int d;
+
+  d = vblk.freehead;
+  vblk.freehead = vblk.desc[d].next;
+  vblk.nfree--;
+  return d;
+}
+
+// Return the chain starting at d to the free chain.
+static void
+vblkfree(int d)
+{
+  int next, more;
+
+  do {
+    more = vblk.desc[d].flags & VRING_NEXT;
+    next = vblk.desc[d].next;
+    vblk.desc[d].next = vblk.freehead;
+    vblk.freehead = d;
+    vblk.nfree++;
+    d = next;
+  } while(more);
+  wakeup(&vblk.freehead);
+}
+
+// Kick the device if it isn't already looking at the queue.
+// Caller holds vblk.lock.
+static void
+vblknotify(void)
+{
+  __sync_synchronize();  // index before looking at used flags
+  if(!(vblk.used->flags & VRING_NONOTIFY))
+    outw(vblk.iobase+VIO_QNOTIFY, 0);
+}
+
+// Queue the read or write of b.  The caller notifies the device
+// once it has queued what it has.  Caller holds vblk.lock.
+static void
+vblkstart(struct buf *b)
+{
+  int h, d, s;
+
+  if((uint64)(b->sector + 1) * SPB > vblk.capacity)
+    panic("vblkstart: sector past end of disk");
+  if(vblk.nfree < 3){
+    vblknotify();  // let the device free some
+    while(vblk.nfree < 3)
+      sleep(&vblk.freehead, &vblk.lock);
+  }
+  h = vblkalloc();
+  d = vblkalloc();
+  s = vblkalloc();
+
+  vblk.req[h].hdr.type = (b->flags & B_DIRTY) ? VBLK_OUT : VBLK_IN;
+  vblk.req[h].hdr.reserved = 0;
+  vblk.req[h].hdr.sector = (uint64)b->sector * SPB;
+  vblk.req[h].status = 0xff;
+  vblk.req[h].b = b;
+
+  vblk.desc[h].addr = (uint)&vblk.req[h].hdr;
+  vblk.desc[h].len = sizeof(struct vblkhdr);
+  vblk.desc[h].flags = VRING_NEXT;
+  vblk.desc[h].next = d;
+  vblk.desc[d].addr = (uint)b->data;
+  vblk.desc[d].len = BSIZE;
+  vblk.desc[d].flags = VRING_NEXT | ((b->flags & B_DIRTY) ? 0 : VRING_WRITE);
+  vblk.desc[d].next = s;
+  vblk.desc[s].addr = (uint)&vblk.req[h].status;
+  vblk.desc[s].len = 1;
+  vblk.desc[s].flags = VRING_WRITE;
+
+  vblk.avail->ring[vblk.avail->idx % vblk.qsize] = h;
+  __sync_synchronize();  // ring entry before index
+  vblk.avail->idx++;
+}
+
+// Queue the bufs of list, chained by qnext, to be read or
+// written, and notify the device once.  The block layer waits
+// for them (see blkdone).
+void
+vblksubmit(struct buf *list)
+{
+  struct buf *b, *next;
+
+  acquire(&vblk.lock);
+  for(b = list; b; b = next){
+    next = b->qnext;
+    vblkstart(b);
+  }
+  vblknotify();
+  release(&vblk.lock);
+}
+
+void
+vblkintr(void)
+{
+  // Reading the ISR acknowledges the interrupt.
+  if(inb(vblk.iobase+VIO_ISR) & 1)
+    queue_work(&vblk.work);
+}
+
+// Finish every request the device has finished.
+static void
+vblkcomplete(void *arg)
+{
+  struct buf *b, *done;
+  int h;
+
+  acquire(&vblk.lock);
+  done = 0;
+  while(vblk.usedidx != vblk.used->idx){
+    __sync_synchronize();  // index before ring entry
+    h = vblk.used->ring[vblk.usedidx % vblk.qsize].id;
+    vblk.usedidx++;
+    b = vblk.req[h].b;
+    if(vblk.req[h].status != 0)
+      panic("vblkcomplete: disk error");
+    vblk.req[h].b = 0;
+    vblkfree(h);
+    b->qnext = done;
+    done = b;
+  }
+  release(&vblk.lock);
+  blkdone(done);
+}
@@ -4,18 +4,44 @@
 #include "x86.h"
 #include "mmu.h"
 #include "proc.h"
+#include "vdso.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "mman.h"
+#include "fs.h"
 
 extern char data[];  // defined in data.S
 
+// Kernel stacks live in slots of KSTACKBASE..USERBASE, each a
+// KSTACKSIZE stack above an unmapped guard page, so overflowing
+// one faults instead of running into the memory below.  The
+// slots' page tables are made with kpgdir and so are shared by
+// every process.  A freed stack stays mapped in its slot for the
+// next kstackalloc, so no mapping ever goes away and no CPU can
+// hold a stale TLB entry for one.
+#define KSLOTSIZE (KSTACKSIZE + PGSIZE)
+#define NKSLOT    ((USERBASE - KSTACKBASE) / KSLOTSIZE)
+#if NKSLOT < NPROC
+#error "no room for NPROC kernel stacks below USERBASE"
+#endif
+
+static struct {
+  struct spinlock lock;
+  int nslot;           // slots ever used; 0..nslot-1 have stacks mapped
+  int nfree;
+  char *free[NKSLOT];  // stacks of freed slots
+} kstacks __attribute__((aligned(CACHELINE)));
+
 static pde_t *kpgdir;  // for use in scheduler()
+static pde_t *kvmbuild(void);
 
-// Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// Build the kernel page table, once.  The scheduler runs on it,
+// and setupkvm() shares its entries with every process.
 void
 kvmalloc(void)
 {
-  kpgdir = setupkvm();
+  if((kpgdir = kvmbuild()) == 0)
+    panic("kvmalloc");
 }
 
 // Set up CPU's kernel segment descriptors.
@@ -56,13 +82,14 @@ walkpgdir(pde_t *pgdir, const void *va, int create)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;  // a 4 MB page; there is no page table
   if(*pde & PTE_P){
     pgtab = (pte_t*)PTE_ADDR(*pde);
   } else {
-    if(!create || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!create || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table 
     // entries, if necessary.
@@ -97,6 +124,32 @@ mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
   return 0;
 }
 
+// Like mappages, but map each whole, aligned 4 MB of the range
+// with one PTE_PS page directory entry instead of a page table.
+static int
+mapkpages(pde_t *pgdir, uint la, uint size, uint pa, int perm)
+{
+  uint n;
+
+  while(size > 0){
+    if(la % LPGSIZE == 0 && pa % LPGSIZE == 0 && size >= LPGSIZE &&
+       !(pgdir[PDX(la)] & PTE_P)){
+      pgdir[PDX(la)] = pa | perm | PTE_PS | PTE_P;
+      n = LPGSIZE;
+    } else {
+      n = LPGSIZE - la % LPGSIZE;
+      if(n > size)
+        n = size;
+      if(mappages(pgdir, (void*)la, n, pa, perm) < 0)
+        return -1;
+    }
+    la += n;
+    pa += n;
+    size -= n;
+  }
+  return 0;
+}
+
 // The mappings from logical to linear are one to one (i.e.,
 // segmentation doesn't do anything).
 // There is one page table per process, plus one that's used
@@ -106,45 +159,118 @@ mappages(pde_t *pgdir, void *la, uint size, uint pa, int perm)
 // than its memory.
 // 
 // setupkvm() and exec() set up every page table like this:
-//   0..640K          : user memory (text, data, stack, heap)
-//   640K..1M         : mapped direct (for IO space)
+//   0..1M            : mapped direct (low memory and IO space)
 //   1M..end          : mapped direct (for the kernel's text and data)
-//   end..PHYSTOP     : mapped direct (kernel heap and user pages)
+//   end..physstop    : mapped direct (kernel heap and user pages)
+//   KSTACKBASE..USERBASE : kernel stacks with guard pages
+//   USERBASE..MMAPTOP : user memory (text, data, heap, mmap)
+//   USTACK..VDSO     : user stack, grown on faults, above a guard page
+//   VDSO..USERTOP    : kernel data user space may read (see vdso.c)
 //   0xfe000000..0    : mapped direct (devices such as ioapic)
 //
+// Whole, aligned 4 MB stretches of the kernel mappings (all of
+// them above the first 4 MB) use PSE pages.
+//
 // The kernel allocates memory for its heap and for user memory
-// between kernend and the end of physical memory (PHYSTOP).
-// The virtual address space of each user program includes the kernel
-// (which is inaccessible in user mode).  The user program addresses
-// range from 0 till 640KB (USERTOP), which where the I/O hole starts
-// (both in physical memory and in the kernel's virtual address
-// space).
+// between kernend and the end of physical memory (physstop, at
+// most PHYSMAX = KSTACKBASE).  The virtual address space of each
+// user program includes the kernel (which is inaccessible in user
+// mode).  The user program addresses range from USERBASE, above
+// all of physical memory, to USERTOP, where the devices start.
 static struct kmap {
   void *p;
   void *e;
   int perm;
 } kmap[] = {
-  {(void*)USERTOP,    (void*)0x100000, PTE_W},  // I/O space
+  {(void*)0,          (void*)0x100000, PTE_W},  // low memory, I/O space
   {(void*)0x100000,   data,            0    },  // kernel text, rodata
-  {data,              (void*)PHYSTOP,  PTE_W},  // kernel data, memory
+  {data,              0,               PTE_W},  // kernel data, memory
   {(void*)0xFE000000, 0,               PTE_W},  // device mappings
 };
 
-// Set up kernel part of a page table.
-pde_t*
-setupkvm(void)
+// Map kmap[] into a fresh page directory.
+static pde_t*
+kvmbuild(void)
 {
   pde_t *pgdir;
   struct kmap *k;
+  uint a;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
-  k = kmap;
+  kmap[2].e = (void*)physstop;  // known only at boot
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
-    if(mappages(pgdir, k->p, k->e - k->p, (uint)k->p, k->perm) < 0)
+    if(mapkpages(pgdir, (uint)k->p, k->e - k->p, (uint)k->p, k->perm) < 0)
       return 0;
+  // Page tables, without pages yet, for the kernel stacks.
+  for(a = KSTACKBASE; a < USERBASE; a += LPGSIZE)
+    if(walkpgdir(pgdir, (void*)a, 1) == 0)
+      return 0;
+  initlock(&kstacks.lock, "kstacks");
+
+  return pgdir;
+}
+
+// Physical address of kpgdir, for the double fault task.
+uint
+kpgdirpa(void)
+{
+  return PADDR(kpgdir);
+}
+
+// Allocate a kernel stack of KSTACKSIZE bytes with a guard page
+// below it.  Returns its lowest address, or 0 if out of memory.
+char*
+kstackalloc(void)
+{
+  char *s, *mem;
+  int n;
+
+  acquire(&kstacks.lock);
+  if(kstacks.nfree > 0){
+    s = kstacks.free[--kstacks.nfree];
+    release(&kstacks.lock);
+    return s;
+  }
+  if(kstacks.nslot == NKSLOT){
+    release(&kstacks.lock);
+    return 0;
+  }
+  s = (char*)KSTACKBASE + kstacks.nslot * KSLOTSIZE + PGSIZE;
+  for(n = 0; (PGSIZE << n) < KSTACKSIZE; n++)
+    ;
+  if((mem = kalloc_order(n)) == 0){
+    release(&kstacks.lock);
+    return 0;
+  }
+  if(mappages(kpgdir, s, KSTACKSIZE, PADDR(mem), PTE_W) < 0)
+    panic("kstackalloc");
+  kstacks.nslot++;
+  release(&kstacks.lock);
+  return s;
+}
+
+// Free a stack from kstackalloc.  It stays mapped for reuse.
+void
+kstackfree(char *s)
+{
+  acquire(&kstacks.lock);
+  kstacks.free[kstacks.nfree++] = s;
+  release(&kstacks.lock);
+}
 
+// Set up kernel part of a page table by copying kpgdir's entries,
+// so the kernel's page tables are shared, not rebuilt.  No kernel
+// page table covers user addresses (USERBASE..USERTOP), so user
+// mappings always get page tables of their own.
+pde_t*
+setupkvm(void)
+{
+  pde_t *pgdir;
+
+  if((pgdir = (pde_t*)kalloc()) == 0)
+    return 0;
+  memmove(pgdir, kpgdir, PGSIZE);
   return pgdir;
 }
 
@@ -154,9 +280,10 @@ vmenable(void)
 {
   uint cr0;
 
+  lcr4(rcr4() | CR4_PSE);  // for the 4 MB kernel pages
   switchkvm(); // load kpgdir into cr3
   cr0 = rcr0();
-  cr0 |= CR0_PG;
+  cr0 |= CR0_PG|CR0_WP;  // WP: kernel writes fault on COW pages too
   lcr0(cr0);
 }
 
@@ -178,13 +305,15 @@ switchuvm(struct proc *p)
   cpu->ts.ss0 = SEG_KDATA << 3;
   cpu->ts.esp0 = (uint)proc->kstack + KSTACKSIZE;
   ltr(SEG_TSS << 3);
+  wrmsr(MSR_SYSENTER_ESP, cpu->ts.esp0);
   if(p->pgdir == 0)
     panic("switchuvm: no pgdir");
   lcr3(PADDR(p->pgdir));  // switch to new address space
+  p->vproc->cpu = cpu - cpus;
   popcli();
 }
 
-// Load the initcode into address 0 of pgdir.
+// Load the initcode into address USERBASE of pgdir.
 // sz must be less than a page.
 void
 inituvm(pde_t *pgdir, char *init, uint sz)
@@ -193,36 +322,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
-  mappages(pgdir, 0, PGSIZE, PADDR(mem), PTE_W|PTE_U);
+  mem = kalloc_zeroed();
+  mappages(pgdir, (char*)USERBASE, PGSIZE, PADDR(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint)addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, (char*)pa, offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -231,54 +335,74 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   char *mem;
   uint a;
 
-  if(newsz > USERTOP)
+  if(newsz > VDSO)
     return 0;
   if(newsz < oldsz)
     return oldsz;
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = uvmpage(1);
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     mappages(pgdir, (char*)a, PGSIZE, PADDR(mem), PTE_W|PTE_U);
   }
   return newsz;
 }
 
-// Deallocate user pages to bring the process size from oldsz to
-// newsz.  oldsz and newsz need not be page-aligned, nor does newsz
-// need to be less than oldsz.  oldsz can be larger than the actual
-// process size.  Returns the new process size.
-int
-deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
+// Free the user pages of pgdir in [a, end), a page-aligned, and
+// release the swap slots of those swapped out.  A 4 MB page goes
+// only if all of it is in [a, lpgend).
+static void
+uvmunmap(pde_t *pgdir, uint a, uint end, uint lpgend)
 {
   pte_t *pte;
-  uint a, pa;
-
-  if(newsz >= oldsz)
-    return oldsz;
-
-  a = PGROUNDUP(newsz);
-  for(; a  < oldsz; a += PGSIZE){
+  uint pa;
+
+  for(; a < end; a += PGSIZE){
+    if(pgdir[PDX(a)] & PTE_PS){
+      if(a % LPGSIZE == 0 && a + LPGSIZE <= lpgend){
+        kfree_order((char*)PTE_ADDR(pgdir[PDX(a)]), LPGORDER);
+        pgdir[PDX(a)] = 0;
+      }
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     pte = walkpgdir(pgdir, (char*)a, 0);
-    if(pte && (*pte & PTE_P) != 0){
+    if(pte == 0)
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;  // no page table: skip it
+    else if(pte && (*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
         panic("kfree");
       kfree((char*)pa);
       *pte = 0;
+    } else if(*pte & PTE_SWAP){
+      swapfree(PTE_SLOT(*pte));
+      *pte = 0;
     }
   }
+}
+
+// Deallocate user pages to bring the process size from oldsz to
+// newsz.  oldsz and newsz need not be page-aligned, nor does newsz
+// need to be less than oldsz.  oldsz can be larger than the actual
+// process size.  Returns the new process size.  A 4 MB heap page
+// goes only once all of it is past newsz.
+int
+deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
+{
+  if(newsz >= oldsz)
+    return oldsz;
+  uvmunmap(pgdir, PGROUNDUP(newsz), oldsz, USERTOP);
   return newsz;
 }
 
 // Free a page table and all the physical memory pages
-// in the user part.
+// in the user part.  Page tables shared with kpgdir are kept.
 void
 freevm(pde_t *pgdir)
 {
@@ -286,53 +410,477 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, USERTOP, 0);
+  deallocuvm(pgdir, USERTOP, USERBASE);
   for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P)
+    if((pgdir[i] & (PTE_P|PTE_PS)) == PTE_P && pgdir[i] != kpgdir[i])
       kfree((char*)PTE_ADDR(pgdir[i]));
   }
   kfree((char*)pgdir);
 }
 
+// Give page table d a copy of the 4 MB heap page pde maps at
+// va: in a 4 MB page too if there is a free block, else in 4 KB
+// pages.
+static int
+lpgcopy(pde_t *d, uint va, pde_t pde)
+{
+  char *pa, *mem;
+  uint off;
+
+  pa = (char*)PTE_ADDR(pde);
+  if((mem = kalloc_order(LPGORDER)) != 0){
+    memmove(mem, pa, LPGSIZE);
+    d[PDX(va)] = PADDR(mem) | (pde & 0xFFF);
+    return 0;
+  }
+  for(off = 0; off < LPGSIZE; off += PGSIZE){
+    if((mem = uvmpage(0)) == 0)
+      return -1;
+    memmove(mem, pa + off, PGSIZE);
+    if(mapuvm(d, va + off, mem, PTE_W) < 0){
+      kfree(mem);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Share the user pages of pgdir in [i, end) with d, as copyuvm
+// does.  Returns -1 if out of memory.
+static int
+uvmshare(pde_t *d, pde_t *pgdir, uint i, uint end)
+{
+  pte_t *pte, *dpte;
+  uint pa, flags;
+
+  for(; i < end; i += PGSIZE){
+    cond_resched();
+    if(pgdir[PDX(i)] & PTE_PS){
+      if(lpgcopy(d, i, pgdir[PDX(i)]) < 0)
+        return -1;
+      i += LPGSIZE - PGSIZE;
+      continue;
+    }
+    // Heap pages not touched yet stay lazy in the child too.
+    if((pte = walkpgdir(pgdir, (void*)i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
+    // A swapped-out page: both hold its slot, and
+    // each reads in a copy of its own.
+    if(*pte & PTE_SWAP){
+      if((dpte = walkpgdir(d, (void*)i, 1)) == 0)
+        return -1;
+      swapdup(PTE_SLOT(*pte));
+      *dpte = *pte;
+      continue;
+    }
+    if(!(*pte & PTE_P))
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
+    pa = PTE_ADDR(*pte);
+    flags = *pte & (PTE_U|PTE_COW);
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
+      return -1;
+    kref((char*)pa);
+  }
+  return 0;
+}
+
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child: its memory below sz and its stack.
+// The pages themselves are shared: writable ones become
+// read-only PTE_COW pages in both, and cowfault copies
+// them on the first write.  4 MB heap pages are copied
+// straight away instead.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
-  pte_t *pte;
-  uint pa, i;
-  char *mem;
+  int r;
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void*)i, 0)) == 0)
-      panic("copyuvm: pte should exist");
-    if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
-    pa = PTE_ADDR(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, PADDR(mem), PTE_W|PTE_U) < 0)
-      goto bad;
+  r = uvmshare(d, pgdir, USERBASE, sz);
+  if(r == 0)
+    r = uvmshare(d, pgdir, USTACK, USTACKTOP);
+  if(proc && pgdir == proc->pgdir)
+    lcr3(PADDR(pgdir));  // flush the parent's stale writable TLB entries
+  if(r < 0){
+    freevm(d);
+    return 0;
   }
   return d;
+}
+
+// Handle a write fault at va on a PTE_COW page of pgdir: copy
+// the page, unless no one else shares it any more, and make it
+// writable.  pgdir needn't be the current page table (see
+// copyoutp).  Returns -1 if va isn't a COW page or out of memory.
+int
+cowfault(pde_t *pgdir, uint va)
+{
+  pte_t *pte, old;
+  char *pa, *mem;
+
+  if(va < USERBASE || va >= USERTOP ||
+     (pte = walkpgdir(pgdir, (char*)va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  old = *pte;
+  pa = (char*)PTE_ADDR(old);
+  if(kshared(pa)){
+    if((mem = uvmpage(0)) == 0)
+      return -1;
+    if(*pte != old){
+      // Swapped out while we made room; fault again.
+      kfree(mem);
+      return 0;
+    }
+    memmove(mem, pa, PGSIZE);
+    *pte = PADDR(mem) | (*pte & 0xFFF);
+    kfree(pa);  // drops our share
+  }
+  *pte = (*pte & ~PTE_COW) | PTE_W;
+  if(proc && pgdir == proc->pgdir)
+    lcr3(PADDR(pgdir));
+  return 0;
+}
+
+// Lend the page at va of p, for vmsplice: make it copy-on-write
+// if it is writable, and return it with a reference taken for the
+// borrower.  Returns 0 if va isn't a present, private page of p's
+// program, heap or stack, the ones copyuvm shares.
+char*
+uvmlend(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *pa;
+
+  if(uvmend(p, va) == 0 || (pte = uvmpte(p->pgdir, va)) == 0 ||
+     !(*pte & (PTE_W|PTE_COW)))
+    return 0;
+  if(*pte & PTE_W){
+    *pte = (*pte & ~PTE_W) | PTE_COW;
+    if(p == proc)
+      lcr3(PADDR(p->pgdir));
+  }
+  pa = (char*)PTE_ADDR(*pte);
+  kref(pa);
+  return pa;
+}
+
+// Map the lent page pa at va of p, copy-on-write, in place of
+// the page there, which must be one uvmlend could lend.  The
+// caller keeps its own reference to pa.  Returns -1 if va isn't
+// such a page.
+int
+uvmgift(struct proc *p, uint va, char *pa)
+{
+  pte_t *pte;
+  char *old;
+
+  if(uvmend(p, va) == 0 || (pte = uvmpte(p->pgdir, va)) == 0 ||
+     !(*pte & (PTE_W|PTE_COW)))
+    return -1;
+  old = (char*)PTE_ADDR(*pte);
+  kref(pa);
+  *pte = PADDR(pa) | PTE_COW | PTE_U | PTE_P;
+  kfree(old);  // drops p's share
+  if(p == proc)
+    lcr3(PADDR(p->pgdir));
+  return 0;
+}
+
+// Allocate a page for user memory, zeroed if zero isn't 0.
+// If memory is short, swap pages out to make room, unless the
+// caller holds a spinlock and so can't wait for the disk.
+// Returns 0 if there is still none.
+char*
+uvmpage(int zero)
+{
+  char *mem;
+  int i;
+
+  for(i = 0; ; i++){
+    if((mem = zero ? kalloc_zeroed() : kalloc()) != 0)
+      return mem;
+    if(i == 4 || cpu->ncli > 0 || swapreclaim(SWAPBATCH) == 0)
+      return 0;
+  }
+}
+
+// Read the page at va of p back in if it is swapped out.
+// Returns 1 if it isn't, else 0, or -1 if out of memory.
+static int
+swapfault(struct proc *p, uint va)
+{
+  pte_t *pte;
+  char *mem;
+  int major;
+
+  if((pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0 || !(*pte & PTE_SWAP))
+    return 1;
+  if(cpu->ncli > 0)
+    return -1;
+  major = 0;
+  if((mem = swapin(PTE_SLOT(*pte), &major)) == 0)
+    return -1;
+  *pte = PADDR(mem) | (*pte & (PTE_W|PTE_U|PTE_COW)) | PTE_P;
+  uvmfault(p, major);
+  return 0;
+}
+
+// Advance the clock hand *va over the user pages of pgdir in
+// [*va, sz) to just past the next present one that no one else
+// shares.  Returns its PTE, or 0 if the hand reached sz.
+pte_t*
+uvmnext(pde_t *pgdir, uint *va, uint sz)
+{
+  pte_t *pte;
+
+  for(; *va < sz; *va += PGSIZE){
+    if((pte = walkpgdir(pgdir, (char*)*va, 0)) == 0){
+      *va = PGADDR(PDX(*va) + 1, 0, 0) - PGSIZE;  // no page table
+      continue;
+    }
+    if((*pte & (PTE_P|PTE_U)) == (PTE_P|PTE_U) &&
+       !kshared((char*)PTE_ADDR(*pte))){
+      *va += PGSIZE;
+      return pte;
+    }
+  }
+  return 0;
+}
+
+// Advance the clock hand *va as uvmnext does, clearing the
+// accessed bit of each page used since the hand last passed,
+// and stop past the first that wasn't.  Returns that page's
+// PTE, or 0 if the hand reached sz.  No other CPU may be
+// running on pgdir.
+pte_t*
+uvmvictim(pde_t *pgdir, uint *va, uint sz)
+{
+  pte_t *pte;
+
+  while((pte = uvmnext(pgdir, va, sz)) != 0){
+    if(!(*pte & PTE_A))
+      return pte;
+    *pte &= ~PTE_A;
+  }
+  return 0;
+}
+
+// Map a zeroed 4 MB page for p over the aligned 4 MB that holds
+// va, if it is all heap that hasn't been touched: below p->sz,
+// with no page table yet, and no program segment in it.  Such
+// pages are never shared, swapped or merged.  Returns -1 if it
+// isn't, or if there is no free 4 MB block.
+static int
+lpgfault(struct proc *p, uint va)
+{
+  struct seg *s;
+  uint a;
+  char *mem;
+
+  a = va & ~(LPGSIZE - 1);
+  if(a < USERBASE || a + LPGSIZE > p->sz || (p->pgdir[PDX(a)] & PTE_P))
+    return -1;
+  for(s = p->seg; s < p->seg + NSEG; s++)
+    if(s->memsz && s->va < a + LPGSIZE && s->va + s->memsz > a)
+      return -1;
+  if((mem = kalloc_order(LPGORDER)) == 0)
+    return -1;
+  memset(mem, 0, LPGSIZE);
+  p->pgdir[PDX(a)] = PADDR(mem) | PTE_PS | PTE_W | PTE_U | PTE_P;
+  p->minflt++;
+  p->rss += NPTENTRIES;
+  if(p->rss > p->maxrss)
+    p->maxrss = p->rss;
+  return 0;
+}
 
-bad:
-  freevm(d);
+// The end of the part of p's memory that holds va: p->sz for
+// its program and heap, USTACKTOP for its stack, or 0 if va is
+// in neither.
+uint
+uvmend(struct proc *p, uint va)
+{
+  if(va >= USERBASE && va < p->sz)
+    return p->sz;
+  if(va >= USTACK && va < USTACKTOP)
+    return USTACKTOP;
   return 0;
 }
 
+// Handle a fault at va on a page of p below p->sz, or in its
+// stack, that isn't present.  Swapped-out pages are read back
+// in, and program pages by execfault; growproc only moves the
+// size, so heap pages are allocated, zeroed, on first touch, a
+// whole 4 MB page at a time where lpgfault can.  The stack grows
+// the same way, down to USTACK; the guard page below that is
+// never mapped, so running off the stack kills the process
+// rather than writing over a mapping.  Returns -1 if va isn't
+// such a page or on error.
+int
+lazyfault(struct proc *p, uint va)
+{
+  char *mem;
+  int r;
+
+  if(uvmend(p, va) == 0 || uva2ka(p->pgdir, (char*)va) != 0)
+    return -1;
+  if((r = swapfault(p, va)) <= 0)
+    return r;
+  if((r = execfault(p, va)) <= 0)
+    return r;
+  if(lpgfault(p, va) == 0)
+    return 0;
+  if((mem = uvmpage(1)) == 0)
+    return -1;
+  if(mapuvm(p->pgdir, (uint)PGROUNDDOWN(va), mem, PTE_W) < 0){
+    kfree(mem);
+    return -1;
+  }
+  uvmfault(p, 0);
+  return 0;
+}
+
+// Count a fault that mapped a new page into p; major if it
+// read the page from a file.  p->rss only grows here: exec,
+// fork and growproc reset it.
+void
+uvmfault(struct proc *p, int major)
+{
+  if(major)
+    p->majflt++;
+  else
+    p->minflt++;
+  if(++p->rss > p->maxrss)
+    p->maxrss = p->rss;
+}
+
+// Return the number of resident user pages in pgdir.  If
+// shared isn't 0, set *shared to how many of them are shared
+// with another page table, and *ptpages to the number of
+// page-table pages, the directory included.
+uint
+uvmrss(pde_t *pgdir, uint *shared, uint *ptpages)
+{
+  pte_t *pgtab;
+  uint i, j, n;
+
+  n = 0;
+  if(shared){
+    *shared = 0;
+    *ptpages = 1;
+  }
+  for(i = PDX(USERBASE); i < PDX(USERTOP); i++){
+    if(!(pgdir[i] & PTE_P))
+      continue;
+    if(pgdir[i] & PTE_PS){
+      n += NPTENTRIES;  // a 4 MB page, never shared
+      continue;
+    }
+    pgtab = (pte_t*)PTE_ADDR(pgdir[i]);
+    for(j = 0; j < NPTENTRIES; j++){
+      if(!(pgtab[j] & PTE_P))
+        continue;
+      n++;
+      if(shared && kshared((char*)PTE_ADDR(pgtab[j])))
+        (*shared)++;
+    }
+    if(shared)
+      (*ptpages)++;
+  }
+  return n;
+}
+
+// Check that [va, va+n) is memory of p the kernel can use as a
+// system call buffer: in USERBASE..p->sz or the stack, with any
+// missing pages faulted in now, or in one mmap region.  Kernel
+// code may hold locks while it copies, so it mustn't take a fault
+// that reads the disk.
+int
+uvmcheck(struct proc *p, uint va, uint n)
+{
+  uint a, end;
+
+  end = uvmend(p, va);
+  if(end == 0 || va + n > end || va + n < va)
+    return mmapcheck(p, va, n);
+  for(a = (uint)PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+    if(uva2ka(p->pgdir, (char*)a) == 0 && lazyfault(p, a) < 0)
+      return -1;
+  return 0;
+}
+
+// Copy n bytes from user address va of the current process to
+// dst, in one go.  Returns -1 if [va, va+n) isn't its memory.
+int
+copyin(void *dst, uint va, uint n)
+{
+  if(uvmcheck(proc, va, n) < 0)
+    return -1;
+  return ucopy(dst, (void*)va, n);
+}
+
+// Copy the nul-terminated string at user address va of the
+// current process into dst, which holds max bytes.  Returns its
+// length, or -1 if it runs past p->sz or the stack top, or
+// doesn't fit.
+int
+copyinstr(char *dst, uint va, uint max)
+{
+  uint end;
+
+  if((end = uvmend(proc, va)) == 0)
+    return -1;
+  if(max > end - va)
+    max = end - va;
+  return ucopystr(dst, (char*)va, max);
+}
+
+// Map the page mem at page-aligned user address va in pgdir
+// with permissions perm.  Returns -1 if va is mapped already
+// or a page table can't be allocated.
+int
+mapuvm(pde_t *pgdir, uint va, char *mem, int perm)
+{
+  pte_t *pte;
+
+  if((pte = walkpgdir(pgdir, (char*)va, 1)) == 0 || (*pte & PTE_P))
+    return -1;
+  *pte = PADDR(mem) | perm | PTE_U | PTE_P;
+  return 0;
+}
+
+// The PTE of the present user page at va in pgdir, or 0.
+pte_t*
+uvmpte(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+
+  pte = walkpgdir(pgdir, (char*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U)) != (PTE_P|PTE_U))
+    return 0;
+  return pte;
+}
+
 // Map user virtual address to kernel physical address.
 char*
 uva2ka(pde_t *pgdir, char *uva)
 {
   pte_t *pte;
+  pde_t pde;
 
+  pde = pgdir[PDX(uva)];
+  if((pde & (PTE_PS|PTE_P|PTE_U)) == (PTE_PS|PTE_P|PTE_U))
+    return (char*)(PTE_ADDR(pde) + ((uint)uva & (LPGSIZE - PGSIZE)));
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -364,3 +912,86 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
   }
   return 0;
 }
+
+// Copy len bytes from p to user address va of process np, which
+// isn't running.  Unlike copyout, pages np hasn't got yet are
+// faulted in first, and ones it shares copy-on-write are copied,
+// so that the write is np's alone.  Returns -1 if any of
+// [va, va+len) isn't writable memory of np.
+int
+copyoutp(struct proc *np, uint va, void *p, uint len)
+{
+  pte_t *pte;
+  uint a;
+
+  if(va + len < va)
+    return -1;
+  for(a = (uint)PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    for(;;){
+      if((pte = uvmpte(np->pgdir, a)) == 0){
+        if(uva2ka(np->pgdir, (char*)a) != 0)
+          break;  // a 4 MB page, np's alone
+        if(lazyfault(np, a) < 0)
+          return -1;
+      } else if(*pte & PTE_COW){
+        if(cowfault(np->pgdir, a) < 0)
+          return -1;
+      } else if(*pte & PTE_W)
+        break;
+      else
+        return -1;
+    }
+  }
+  return copyout(np->pgdir, va, p, len);
+}
+
+// Take advice on how the current process will use [va, va+n):
+// heap, program and stack pages, or pages of one mapping.  WILLNEED
+// starts reading their file data into the buffer cache, and
+// DONTNEED frees them, so the next touch faults in zeroes or the
+// file's data afresh.  Returns -1 if va isn't page-aligned, the
+// range isn't such memory, or advice is unknown.
+int
+madvise(uint va, uint n, int advice)
+{
+  struct vma *v;
+  struct seg *s;
+  uint end, e, start, stop;
+
+  if(va % PGSIZE || n == 0 || va + n < va)
+    return -1;
+  end = (uint)PGROUNDUP(va + n);
+  v = 0;
+  if((e = uvmend(proc, va)) == 0 || end > (uint)PGROUNDUP(e))
+    if((v = mmapvma(proc, va, n)) == 0)
+      return -1;
+
+  if(advice == MADV_DONTNEED){
+    uvmunmap(proc->pgdir, va, end, end);
+    proc->rss = uvmrss(proc->pgdir, 0, 0);
+    lcr3(PADDR(proc->pgdir));
+    return 0;
+  }
+  if(v)
+    return mmapadvise(v, va, n, advice);
+  switch(advice){
+  case MADV_NORMAL:
+  case MADV_SEQUENTIAL:
+    return 0;  // read-ahead is only for mappings
+  case MADV_WILLNEED:
+    // Only a window of it: each block read ahead holds a buffer.
+    if(end - va > NRAMAX*BSIZE)
+      end = va + NRAMAX*BSIZE;
+    for(s = proc->seg; proc->exe && s < proc->seg + NSEG; s++){
+      start = s->va > va ? s->va : va;
+      stop = s->va + s->filesz < end ? s->va + s->filesz : end;
+      if(start >= stop)
+        continue;
+      ilockshared(proc->exe);
+      ireadahead(proc->exe, s->off + (start - s->va), stop - start);
+      iunlock(proc->exe);
+    }
+    return 0;
+  }
+  return -1;
+}
@@ -0,0 +1,111 @@
+// Per-CPU work queues.
+//
+// Interrupt handlers and system calls hand off work that can
+// wait, or that must sleep, with queue_work.  Each CPU has a
+// queue and a kernel thread, bound to that CPU, that runs the
+// queue's work in order, so the work stays on the CPU that
+// queued it and runs with interrupts on.  Like every kernel
+// thread it stays at the top scheduling level.
+//
+// A work item is queued at most once at a time: queueing it
+// again before it starts does nothing, and its fn sees every
+// change made before either queueing.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "work.h"
+
+static struct workq {
+  struct spinlock lock;
+  struct work *head;
+  struct work **tail;
+  int cpu;
+} __attribute__((aligned(CACHELINE))) workq[NCPU];
+
+void
+work_init(struct work *w, void (*fn)(void*), void *arg)
+{
+  w->fn = fn;
+  w->arg = arg;
+  w->next = 0;
+  w->pending = 0;
+}
+
+// Queue w on this CPU.  Returns 0 if it was already queued.
+// Safe to call from an interrupt handler.
+int
+queue_work(struct work *w)
+{
+  int r;
+
+  pushcli();
+  r = queue_work_on(w, cpu - cpus);
+  popcli();
+  return r;
+}
+
+// Queue w on CPU c, as queue_work does on this one.
+int
+queue_work_on(struct work *w, int c)
+{
+  struct workq *q;
+  int r;
+
+  q = &workq[c];
+  acquire(&q->lock);
+  r = !w->pending;
+  if(r){
+    w->pending = 1;
+    w->next = 0;
+    *q->tail = w;
+    q->tail = &w->next;
+    if(q->head == w)
+      wakeup(q);
+  }
+  release(&q->lock);
+  return r;
+}
+
+// Body of a CPU's worker thread.
+static void
+worker(void *arg)
+{
+  struct workq *q;
+  struct work *w;
+
+  q = arg;
+  setaffinity(proc->pid, 1 << q->cpu);
+  yield();
+  acquire(&q->lock);
+  for(;;){
+    while(q->head == 0)
+      sleep(q, &q->lock);
+    w = q->head;
+    if((q->head = w->next) == 0)
+      q->tail = &q->head;
+    w->pending = 0;
+    release(&q->lock);
+    w->fn(w->arg);
+    acquire(&q->lock);
+  }
+}
+
+// Start a worker for each CPU.
+void
+workinit(void)
+{
+  struct workq *q;
+  int i;
+
+  for(i = 0; i < ncpu; i++){
+    q = &workq[i];
+    initlock(&q->lock, "workq");
+    q->tail = &q->head;
+    q->cpu = i;
+    kthread_create("kworker", worker, q);
+  }
+}
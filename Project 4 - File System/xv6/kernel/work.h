@@ -0,0 +1,11 @@
+#ifndef _WORK_H_
+#define _WORK_H_
+// Deferred work: fn(arg), run by a kernel thread in process
+// context rather than by whoever queued it.  See work.c.
+struct work {
+  void (*fn)(void*);
+  void *arg;
+  struct work *next;  // on its queue
+  int pending;        // queued and not yet started
+};
+#endif // _WORK_H_
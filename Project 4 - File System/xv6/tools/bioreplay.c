@@ -0,0 +1,467 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Replay a buffer cache trace against other cache designs.
+//
+// The input is what "trace bio cmd" prints, sorted with "sort -n"
+// to merge the CPUs; lines other than bio records are skipped.
+// Each get and new record is a reference to a block, each dirty
+// record marks it dirty, and the read and write records are the
+// disk transfers the kernel actually made.  Every policy in
+// policies[] is run at every cache size given with -n (nbufs,
+// comma-separated; a sweep of powers of two by default), and the
+// hit ratio, the reads its misses would cost and the writes its
+// dirty evictions would cost, counting the blocks still dirty at
+// the end, are printed next to the trace's own.
+//
+// lru is one list.  2q is the kernel's (kernel/bio.c): new blocks
+// go on a FIFO in list, kept to a quarter of the cache while the
+// hot list has blocks, and remembered by a ghost list half the
+// cache long when they leave it; a block missed while a ghost, or
+// file system metadata, goes straight to the LRU hot list.  arc is
+// Megiddo and Modha's, which adapts the split between blocks seen
+// once and blocks seen twice to the hits on either's ghosts.
+//
+// The model sees the references in the order the kernel made them,
+// so a block another process evicts between a get and its dirty
+// simply comes back dirty, reading nothing.  Timing, read-ahead
+// and write clustering are left out: the projected numbers count
+// blocks, not commands.
+
+#define GET   0
+#define NEW   1
+#define DIRTY 2
+#define READ  3
+#define WRITE 4
+
+#define NLIST 4
+
+struct blk {
+  unsigned dev, sector;
+  int q;             // List it is on
+  int dirty;
+  struct blk *prev, *next;  // On its list; the head is LRU
+  struct blk *hnext;        // In its hash chain
+};
+
+struct list {
+  struct blk head;
+  int n;
+};
+
+struct cache {
+  int size;          // Blocks it may hold; ghosts are extra
+  int p;             // arc: target size of the once-seen list
+  struct blk *pool, *free;
+  struct blk **hash;
+  unsigned hmask;
+  struct list l[NLIST];
+  long hits, misses, reads, writes;
+};
+
+struct ref {
+  unsigned dev, sector;
+  char op, meta;
+};
+
+struct ref *refs;
+int nref;
+
+// Lists 0 and 1 hold resident blocks in every policy; the rest
+// hold ghosts, blocks remembered after eviction.
+#define RESIDENT(b) ((b)->q < 2)
+
+static unsigned
+hashof(struct cache *c, unsigned dev, unsigned sector)
+{
+  return (sector * 2654435761u ^ dev) & c->hmask;
+}
+
+static struct blk*
+lookup(struct cache *c, unsigned dev, unsigned sector)
+{
+  struct blk *b;
+
+  for(b = c->hash[hashof(c, dev, sector)]; b; b = b->hnext)
+    if(b->dev == dev && b->sector == sector)
+      return b;
+  return 0;
+}
+
+static void
+ldel(struct cache *c, struct blk *b)
+{
+  b->prev->next = b->next;
+  b->next->prev = b->prev;
+  c->l[b->q].n--;
+}
+
+// Put b at the MRU end of list q.
+static void
+ladd(struct cache *c, struct blk *b, int q)
+{
+  struct list *l;
+
+  l = &c->l[q];
+  b->q = q;
+  b->prev = l->head.prev;
+  b->next = &l->head;
+  l->head.prev->next = b;
+  l->head.prev = b;
+  l->n++;
+}
+
+static void
+lmove(struct cache *c, struct blk *b, int q)
+{
+  ldel(c, b);
+  ladd(c, b, q);
+}
+
+static struct blk*
+lru(struct cache *c, int q)
+{
+  return c->l[q].n ? c->l[q].head.next : 0;
+}
+
+static struct blk*
+balloc(struct cache *c, unsigned dev, unsigned sector, int q)
+{
+  struct blk *b;
+  unsigned h;
+
+  if((b = c->free) == 0){
+    fprintf(stderr, "bioreplay: pool exhausted\n");
+    exit(2);
+  }
+  c->free = b->next;
+  b->dev = dev;
+  b->sector = sector;
+  b->dirty = 0;
+  h = hashof(c, dev, sector);
+  b->hnext = c->hash[h];
+  c->hash[h] = b;
+  ladd(c, b, q);
+  return b;
+}
+
+static void
+bfree(struct cache *c, struct blk *b)
+{
+  struct blk **pp;
+
+  if(b->dirty)
+    c->writes++;
+  ldel(c, b);
+  for(pp = &c->hash[hashof(c, b->dev, b->sector)]; *pp != b; pp = &(*pp)->hnext)
+    ;
+  *pp = b->hnext;
+  b->next = c->free;
+  c->free = b;
+}
+
+// Evict resident b to ghost list q, writing it back if dirty.
+static void
+bghost(struct cache *c, struct blk *b, int q)
+{
+  if(b->dirty)
+    c->writes++;
+  b->dirty = 0;
+  lmove(c, b, q);
+}
+
+// Each policy's ref looks up a block, counting nothing; it
+// returns the resident block, with 1 in *hit if it was already
+// cached.
+
+static struct blk*
+lruref(struct cache *c, unsigned dev, unsigned sector, int meta, int *hit)
+{
+  struct blk *b;
+
+  if((b = lookup(c, dev, sector)) != 0){
+    lmove(c, b, 0);
+    *hit = 1;
+    return b;
+  }
+  if(c->l[0].n >= c->size)
+    bfree(c, lru(c, 0));
+  *hit = 0;
+  return balloc(c, dev, sector, 0);
+}
+
+#define Q_IN    0
+#define Q_HOT   1
+#define Q_GHOST 2
+
+static struct blk*
+twoqref(struct cache *c, unsigned dev, unsigned sector, int meta, int *hit)
+{
+  struct blk *b;
+  int hot;
+
+  b = lookup(c, dev, sector);
+  if(b && RESIDENT(b)){
+    if(b->q == Q_HOT)
+      lmove(c, b, Q_HOT);
+    *hit = 1;
+    return b;
+  }
+  hot = meta;
+  if(b){
+    bfree(c, b);
+    hot = 1;
+  }
+  if(c->l[Q_IN].n + c->l[Q_HOT].n >= c->size){
+    if(c->l[Q_IN].n > c->size/4 || c->l[Q_HOT].n == 0){
+      bghost(c, lru(c, Q_IN), Q_GHOST);
+      if(c->l[Q_GHOST].n > c->size/2)
+        bfree(c, lru(c, Q_GHOST));
+    } else
+      bfree(c, lru(c, Q_HOT));
+  }
+  *hit = 0;
+  return balloc(c, dev, sector, hot ? Q_HOT : Q_IN);
+}
+
+#define T1 0
+#define T2 1
+#define B1 2
+#define B2 3
+
+static int
+max(int a, int b)
+{
+  return a > b ? a : b;
+}
+
+static int
+min(int a, int b)
+{
+  return a < b ? a : b;
+}
+
+// Make room in the cache, if it is full, moving the LRU block of
+// T1 or T2 to its ghost list.
+static void
+arcreplace(struct cache *c, int inb2)
+{
+  int t1;
+
+  t1 = c->l[T1].n;
+  if(t1 + c->l[T2].n < c->size)
+    return;
+  if(t1 > 0 && (t1 > c->p || (inb2 && t1 == c->p) || c->l[T2].n == 0))
+    bghost(c, lru(c, T1), B1);
+  else
+    bghost(c, lru(c, T2), B2);
+}
+
+static struct blk*
+arcref(struct cache *c, unsigned dev, unsigned sector, int meta, int *hit)
+{
+  struct blk *b;
+  int n;
+
+  b = lookup(c, dev, sector);
+  *hit = b && RESIDENT(b);
+  if(*hit){
+    lmove(c, b, T2);
+    return b;
+  }
+  if(b && b->q == B1){
+    c->p = min(c->size, c->p + max(c->l[B2].n / c->l[B1].n, 1));
+    arcreplace(c, 0);
+    lmove(c, b, T2);
+    return b;
+  }
+  if(b && b->q == B2){
+    c->p = max(0, c->p - max(c->l[B1].n / c->l[B2].n, 1));
+    arcreplace(c, 1);
+    lmove(c, b, T2);
+    return b;
+  }
+  n = c->l[T1].n + c->l[T2].n + c->l[B1].n + c->l[B2].n;
+  if(c->l[T1].n + c->l[B1].n == c->size){
+    if(c->l[T1].n < c->size){
+      bfree(c, lru(c, B1));
+      arcreplace(c, 0);
+    } else
+      bfree(c, lru(c, T1));
+  } else if(n >= c->size){
+    if(n == 2 * c->size)
+      bfree(c, lru(c, B2));
+    arcreplace(c, 0);
+  }
+  return balloc(c, dev, sector, T1);
+}
+
+struct policy {
+  char *name;
+  struct blk *(*ref)(struct cache*, unsigned, unsigned, int, int*);
+} policies[] = {
+  { "lru", lruref },
+  { "2q",  twoqref },
+  { "arc", arcref },
+};
+
+#define NPOLICY (sizeof(policies) / sizeof(policies[0]))
+
+static void
+replay(struct policy *pol, int size)
+{
+  struct cache c;
+  struct blk *b;
+  struct ref *r;
+  unsigned npool, nhash;
+  int i, hit;
+
+  memset(&c, 0, sizeof(c));
+  c.size = size;
+  npool = 2 * size + 2;
+  for(nhash = 1; nhash < 2 * npool; nhash <<= 1)
+    ;
+  c.hmask = nhash - 1;
+  c.pool = calloc(npool, sizeof(struct blk));
+  c.hash = calloc(nhash, sizeof(struct blk*));
+  if(c.pool == 0 || c.hash == 0){
+    fprintf(stderr, "bioreplay: out of memory\n");
+    exit(2);
+  }
+  for(i = 0; i < npool; i++){
+    c.pool[i].next = c.free;
+    c.free = &c.pool[i];
+  }
+  for(i = 0; i < NLIST; i++)
+    c.l[i].head.prev = c.l[i].head.next = &c.l[i].head;
+
+  for(r = refs; r < refs + nref; r++){
+    switch(r->op){
+    case GET:
+    case NEW:
+      pol->ref(&c, r->dev, r->sector, r->meta, &hit);
+      if(hit)
+        c.hits++;
+      else {
+        c.misses++;
+        if(r->op == GET)
+          c.reads++;
+      }
+      break;
+    case DIRTY:
+      b = lookup(&c, r->dev, r->sector);
+      if(b == 0 || !RESIDENT(b))
+        b = pol->ref(&c, r->dev, r->sector, r->meta, &hit);
+      b->dirty = 1;
+      break;
+    }
+  }
+  for(i = 0; i < npool; i++)
+    if(c.pool[i].dirty && RESIDENT(&c.pool[i]))
+      c.writes++;
+
+  printf("%-4s %6d %6.1f %8ld %8ld\n", pol->name, size,
+         c.hits + c.misses ? 100.0 * c.hits / (c.hits + c.misses) : 0.0,
+         c.reads, c.writes);
+  free(c.pool);
+  free(c.hash);
+}
+
+static int
+opnum(char *s)
+{
+  static char *ops[] = { "get", "new", "dirty", "read", "write" };
+  int i;
+
+  for(i = 0; i < 5; i++)
+    if(strcmp(s, ops[i]) == 0)
+      return i;
+  return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int defsizes[] = { 16, 32, 64, 128, 256, 512, 1024, 2048 };
+  char line[256], ev[16], op[16], *s, *end;
+  int *sizes, nsize, maxref, c, i, o, hit, meta;
+  long refd, hits, reads, writes;
+  unsigned dev, sector;
+  FILE *in;
+
+  sizes = defsizes;
+  nsize = sizeof(defsizes) / sizeof(defsizes[0]);
+  while((c = getopt(argc, argv, "n:")) != -1){
+    switch(c){
+    case 'n':
+      sizes = malloc(strlen(optarg) * sizeof(int));
+      nsize = 0;
+      for(s = optarg; *s; s = end + (*end == ',')){
+        sizes[nsize] = strtol(s, &end, 10);
+        if(end == s || sizes[nsize] < 1)
+          goto usage;
+        nsize++;
+      }
+      break;
+    default:
+      goto usage;
+    }
+  }
+  if(optind < argc - 1){
+usage:
+    fprintf(stderr, "Usage: bioreplay [-n nbuf,...] [trace]\n");
+    exit(2);
+  }
+  in = stdin;
+  if(optind < argc && (in = fopen(argv[optind], "r")) == 0){
+    perror(argv[optind]);
+    exit(2);
+  }
+
+  maxref = 0;
+  refd = hits = reads = writes = 0;
+  while(fgets(line, sizeof(line), in)){
+    if(sscanf(line, "%*s %*d %*d %15s %u %u %15s %d %d",
+              ev, &dev, &sector, op, &hit, &meta) != 6 || strcmp(ev, "bio") != 0)
+      continue;
+    if((o = opnum(op)) < 0)
+      continue;
+    if(o == READ){
+      reads++;
+      continue;
+    }
+    if(o == WRITE){
+      writes++;
+      continue;
+    }
+    if(nref == maxref){
+      maxref = maxref ? 2 * maxref : 4096;
+      if((refs = realloc(refs, maxref * sizeof(struct ref))) == 0){
+        fprintf(stderr, "bioreplay: out of memory\n");
+        exit(2);
+      }
+    }
+    refs[nref].dev = dev;
+    refs[nref].sector = sector;
+    refs[nref].op = o;
+    refs[nref].meta = meta;
+    nref++;
+    if(o != DIRTY){
+      refd++;
+      hits += hit;
+    }
+  }
+  if(refd == 0){
+    fprintf(stderr, "bioreplay: no bio records\n");
+    exit(1);
+  }
+
+  printf("%-4s %6s %6s %8s %8s\n", "", "nbuf", "hit%", "reads", "writes");
+  printf("%-4s %6s %6.1f %8ld %8ld\n", "kern", "-", 100.0 * hits / refd, reads, writes);
+  for(i = 0; i < NPOLICY; i++)
+    for(c = 0; c < nsize; c++)
+      replay(&policies[i], sizes[c]);
+  exit(0);
+}
@@ -0,0 +1,583 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define stat xv6_stat  // avoid clash with host struct stat
+#define dirent xv6_dirent  // avoid clash with host struct dirent
+#include "types.h"
+#include "param.h"
+#include "fs.h"
+#include "stat.h"
+#undef stat
+#undef dirent
+
+// Offline check of a file system image, without booting xv6.
+//
+// The image is mapped, not read, and the inodes are checked a
+// run of inode blocks at a time by -j threads: each inode's block
+// pointers and tag block chain, claiming every block reached for
+// the inode, and each directory's entries, counting the names of
+// every inode.  Then one thread checks the link counts, the
+// inodes no directory names, the bitmap against the blocks
+// claimed, and the tag index against the inodes' tags.  All of
+// it is a few passes over the metadata, so a large image takes
+// about as long as reading its inode and bitmap blocks.
+//
+// With -r, fsck repairs what it can without guessing: leaked
+// blocks (such as the tag blocks of an inode freed before its
+// chain was) go back to the bitmap, inodes no directory names
+// are freed, directory entries naming free inodes are removed,
+// link counts of files are set to their names, and stale tag
+// index entries are deleted and missing ones added.  Blocks in
+// two inodes and bad block pointers are only reported.
+//
+// The host is taken to be little-endian, like the image.
+//
+// Exit status: 0 if the image is clean, 1 if problems were found
+// (with -r, repaired as far as possible), 2 if it couldn't be
+// checked.
+
+#define TAGDEAD 1   // hash of a deleted index entry, as in kernel/fs.c
+#define CHUNK 64    // inode blocks a thread takes at a time
+
+#define TAGOFF(b)    ((ushort*)((struct taghdr*)(b) + 1))
+#define TAGENT(b, i) ((uchar*)(b) + TAGOFF(b)[i])
+#define TAGSIZE(e)   (2 + (e)[0] + (e)[1])
+
+uchar *img;
+size_t imgsize;
+struct superblock sb;
+uint datastart;      // First block after the log
+uint *owner;         // Inode each block was claimed for, or 0
+uint *names;         // Directory entries naming each inode
+int repair;          // -r
+int verbose;         // -v
+uint nextchunk;      // Next run of inode blocks to check
+int nproblems;
+pthread_mutex_t outlock = PTHREAD_MUTEX_INITIALIZER;
+
+void
+problem(const char *fmt, ...)
+{
+  va_list ap;
+
+  pthread_mutex_lock(&outlock);
+  nproblems++;
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf("\n");
+  pthread_mutex_unlock(&outlock);
+}
+
+uchar*
+blk(uint b)
+{
+  return img + (size_t)b * BSIZE;
+}
+
+struct dinode*
+dinode(uint inum)
+{
+  return (struct dinode*)blk(IBLOCK(inum)) + inum % IPB;
+}
+
+int
+isinline(struct dinode *dip)
+{
+  return (sb.flags & SB_INLINE) && dip->type == T_FILE && (dip->major & F_INLINE);
+}
+
+// Block bn of inode dip, or 0 if it is a hole or a pointer on the
+// way is out of range.
+uint
+bmap(struct dinode *dip, uint bn)
+{
+  uint addr;
+
+  if(isinline(dip))
+    return 0;
+  if(bn < NDIRECT)
+    return dip->addrs[bn];
+  bn -= NDIRECT;
+  if(bn < NINDIRECT){
+    addr = dip->addrs[NDIRECT];
+  } else {
+    bn -= NINDIRECT;
+    if(bn >= NDINDIRECT)
+      return 0;
+    addr = dip->addrs[NDIRECT+1];
+    if(addr == 0 || addr >= sb.size)
+      return 0;
+    addr = ((uint*)blk(addr))[bn / NINDIRECT];
+    bn %= NINDIRECT;
+  }
+  if(addr == 0 || addr >= sb.size)
+    return 0;
+  addr = ((uint*)blk(addr))[bn];
+  return addr < sb.size ? addr : 0;
+}
+
+// Claim block b for inode inum.  Returns 0 if b is out of range
+// or already claimed.
+int
+claim(uint inum, uint b, const char *what)
+{
+  uint prev;
+
+  if(b < datastart || b >= sb.size){
+    problem("inode %u: %s block %u out of range", inum, what, b);
+    return 0;
+  }
+  if((prev = __sync_val_compare_and_swap(&owner[b], 0, inum)) != 0){
+    if(prev == inum)
+      problem("inode %u: %s block %u used twice", inum, what, b);
+    else
+      problem("inode %u: %s block %u also in inode %u", inum, what, b, prev);
+    return 0;
+  }
+  return 1;
+}
+
+// Claim the pointers of indirect block b, down depth more levels.
+void
+claimind(uint inum, uint b, int depth)
+{
+  uint *a;
+  int i;
+
+  a = (uint*)blk(b);
+  for(i = 0; i < NINDIRECT; i++)
+    if(a[i] && claim(inum, a[i], depth ? "indirect" : "data") && depth)
+      claimind(inum, a[i], depth - 1);
+}
+
+// Is b, a tag area size bytes long, well formed?
+int
+tagsok(uchar *b, uint size)
+{
+  struct taghdr *th;
+  uchar *e;
+  int i;
+
+  th = (struct taghdr*)b;
+  if(th->free > size || th->free < sizeof(*th) + th->nent * sizeof(ushort))
+    return 0;
+  for(i = 0; i < th->nent; i++){
+    if(TAGOFF(b)[i] < th->free || TAGOFF(b)[i] + 2 > size)
+      return 0;
+    e = TAGENT(b, i);
+    if(e[0] < 1 || e[0] > TAGKEYMAX || TAGOFF(b)[i] + TAGSIZE(e) > size)
+      return 0;
+  }
+  return 1;
+}
+
+// The tag areas of inode inum in turn: its inline tags or each
+// block of its chain.  Start with *b = 0; returns 0 at the end.
+// Chain blocks must have been claimed, so a chain can't loop.
+int
+nexttags(uint inum, uchar **b, uint *size, uint *bn)
+{
+  struct dinode *dip;
+
+  dip = dinode(inum);
+  if(*b == 0){
+    if(dip->tags == 0){
+      if(!(sb.flags & SB_INLINE) || ((struct taghdr*)dip->itags)->free == 0)
+        return 0;
+      *b = dip->itags;
+      *size = NITAGS;
+      *bn = 0;
+      return 1;
+    }
+    *bn = dip->tags;
+  } else if(*bn == 0)
+    return 0;
+  else
+    *bn = ((struct taghdr*)*b)->next;
+  if(*bn == 0 || *bn >= sb.size || owner[*bn] != inum)
+    return 0;
+  *b = blk(*bn);
+  *size = BSIZE;
+  return 1;
+}
+
+// Check directory inum's entries, counting the names of each
+// inode they name.
+void
+checkdir(uint inum, struct dinode *dip)
+{
+  struct xv6_dirent *de;
+  uint bn, addr, target;
+  int i;
+
+  for(bn = 0; bn * BSIZE < dip->size; bn++){
+    if((addr = bmap(dip, bn)) == 0)
+      continue;
+    de = (struct xv6_dirent*)blk(addr);
+    for(i = 0; i < BSIZE / sizeof(*de); i++, de++){
+      if(de->inum == 0)
+        continue;
+      target = de->inum;
+      if(strncmp(de->name, ".", DIRSIZ) == 0){
+        if(target != inum)
+          problem("directory %u: \".\" is inode %u", inum, target);
+        continue;
+      }
+      if(target >= sb.ninodes || dinode(target)->type == 0){
+        problem("directory %u: %.*s names free inode %u", inum, DIRSIZ, de->name, target);
+        if(repair)
+          de->inum = 0;  // a deleted entry, in a hashed directory too
+        continue;
+      }
+      if(strncmp(de->name, "..", DIRSIZ) != 0)
+        __sync_fetch_and_add(&names[target], 1);
+    }
+  }
+}
+
+void
+checkinode(uint inum)
+{
+  struct dinode *dip;
+  uchar *b;
+  uint bn, size, i;
+
+  dip = dinode(inum);
+  if(dip->type == 0)
+    return;
+  if(dip->type != T_DIR && dip->type != T_FILE && dip->type != T_DEV){
+    problem("inode %u: bad type %d", inum, dip->type);
+    return;
+  }
+  if(dip->size > (uint64)MAXFILE * BSIZE)
+    problem("inode %u: size %u too big", inum, dip->size);
+  if(isinline(dip)){
+    if(dip->size > NINLINE)
+      problem("inode %u: inline file of %u bytes", inum, dip->size);
+  } else {
+    for(i = 0; i < NDIRECT; i++)
+      if(dip->addrs[i])
+        claim(inum, dip->addrs[i], "data");
+    if(dip->addrs[NDIRECT] && claim(inum, dip->addrs[NDIRECT], "indirect"))
+      claimind(inum, dip->addrs[NDIRECT], 0);
+    if(dip->addrs[NDIRECT+1] && claim(inum, dip->addrs[NDIRECT+1], "indirect"))
+      claimind(inum, dip->addrs[NDIRECT+1], 1);
+  }
+  for(bn = dip->tags; bn; bn = ((struct taghdr*)blk(bn))->next)
+    if(!claim(inum, bn, "tag"))
+      break;
+  for(b = 0; nexttags(inum, &b, &size, &bn); )
+    if(!tagsok(b, size))
+      problem("inode %u: bad tag %s %u", inum, bn ? "block" : "area", bn);
+  if(dip->type == T_DIR)
+    checkdir(inum, dip);
+}
+
+void*
+worker(void *arg)
+{
+  uint c, i, first, last;
+
+  for(;;){
+    c = __sync_fetch_and_add(&nextchunk, 1);
+    first = c * CHUNK * IPB;
+    if(first >= sb.ninodes)
+      return 0;
+    last = first + CHUNK * IPB;
+    if(last > sb.ninodes)
+      last = sb.ninodes;
+    for(i = first ? first : 1; i < last; i++)
+      checkinode(i);
+  }
+}
+
+// Free inode inum, which no directory names.
+void
+freeinode(uint inum)
+{
+  memset(dinode(inum), 0, sizeof(struct dinode));
+}
+
+void
+checklinks(void)
+{
+  struct dinode *dip;
+  uint inum, b;
+  uchar *freed;
+  int nfreed;
+
+  freed = calloc(sb.ninodes, 1);
+  nfreed = 0;
+  for(inum = 1; inum < sb.ninodes; inum++){
+    dip = dinode(inum);
+    if(dip->type == 0 || inum == ROOTINO || inum == sb.tagino)
+      continue;
+    if(names[inum] == 0){
+      problem("inode %u: type %d, %u bytes, in no directory", inum, dip->type, dip->size);
+      if(repair){
+        freeinode(inum);
+        freed[inum] = 1;
+        nfreed++;
+      }
+    } else if(dip->type == T_DIR){
+      // mkfs leaves every directory's nlink 1 while the kernel
+      // counts subdirectories, so only the names are checked.
+      if(names[inum] != 1)
+        problem("directory %u: in %u directories", inum, names[inum]);
+    } else if(dip->nlink != names[inum]){
+      problem("inode %u: nlink %d, but %u names", inum, dip->nlink, names[inum]);
+      if(repair)
+        dip->nlink = names[inum];
+    }
+  }
+  // The freed inodes' blocks are no longer in use.
+  if(nfreed)
+    for(b = datastart; b < sb.size; b++)
+      if(owner[b] && freed[owner[b]])
+        owner[b] = 0;
+  free(freed);
+}
+
+void
+checkbitmap(void)
+{
+  uchar *m;
+  uint b, nleak;
+  int used, marked;
+
+  nleak = 0;
+  for(b = 0; b < sb.size; b++){
+    m = blk(BBLOCK(b, sb.ninodes)) + (b % BPB) / 8;
+    used = b < datastart || owner[b] != 0;
+    marked = (*m >> (b % 8)) & 1;
+    if(used == marked)
+      continue;
+    if(used)
+      problem("block %u: in inode %u but free in the bitmap", b, owner[b]);
+    else if(nleak++ < 10 || verbose)
+      printf("block %u: leaked\n", b);
+    if(repair)
+      *m ^= 1 << (b % 8);
+  }
+  if(nleak)
+    problem("%u blocks marked in use but in no inode", nleak);
+}
+
+uint
+taghash(uchar *key, int keyLength, uchar *value, int valueLength)
+{
+  uint h;
+  int i;
+
+  h = keyLength;
+  for(i = 0; i < keyLength; i++)
+    h = h*31 + key[i];
+  for(i = 0; i < valueLength; i++)
+    h = h*31 + value[i];
+  return h;
+}
+
+// Does inode inum have a tag with index hash h?
+int
+taggedwith(uint inum, uint h)
+{
+  uchar *b, *e;
+  uint size, bn;
+  int i;
+
+  for(b = 0; nexttags(inum, &b, &size, &bn); ){
+    if(!tagsok(b, size))
+      continue;
+    for(i = 0; i < ((struct taghdr*)b)->nent; i++){
+      e = TAGENT(b, i);
+      if(taghash(e + 2, e[0], e + 2 + e[0], e[1]) == h || ~taghash(e + 2, e[0], 0, 0) == h)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+// The index entry for (inum, h), or, if add is set and there is
+// none, a free one made into it.  0 if none.
+struct tagent*
+tagslot(struct dinode *tip, uint n, uint inum, uint h, int add)
+{
+  struct tagent *te, *fre;
+  uint i, j, addr;
+  int end;
+
+  fre = 0;
+  for(i = 0; i < n; i++){
+    if((addr = bmap(tip, (h + i) % n)) == 0)
+      break;
+    te = (struct tagent*)blk(addr);
+    end = 0;
+    for(j = 0; j < TPB; j++){
+      if(te[j].inum == inum && te[j].hash == h)
+        return &te[j];
+      if(te[j].inum == 0 && fre == 0)
+        fre = &te[j];
+      if(te[j].inum == 0 && te[j].hash == 0)
+        end = 1;
+    }
+    if(end)
+      break;
+  }
+  if(!add || fre == 0)
+    return 0;
+  fre->inum = inum;
+  fre->hash = h;
+  return fre;
+}
+
+void
+checkindex(void)
+{
+  struct dinode *tip, *dip;
+  struct tagent *te;
+  uchar *b, *e;
+  uint n, bn, addr, size, inum, h[2];
+  int i, j, k;
+
+  if(sb.tagino == 0)
+    return;
+  tip = dinode(sb.tagino);
+  n = tip->size / BSIZE;
+  // Each entry names a live inode with such a tag.
+  for(bn = 0; bn < n; bn++){
+    if((addr = bmap(tip, bn)) == 0)
+      continue;
+    te = (struct tagent*)blk(addr);
+    for(j = 0; j < TPB; j++){
+      inum = te[j].inum;
+      if(inum == 0)
+        continue;
+      if(inum < sb.ninodes && dinode(inum)->type != 0 && taggedwith(inum, te[j].hash))
+        continue;
+      problem("tag index: stale entry for inode %u", inum);
+      if(repair){
+        te[j].inum = 0;
+        te[j].hash = TAGDEAD;
+      }
+    }
+  }
+  // Each tag has its two entries.
+  for(inum = 1; inum < sb.ninodes; inum++){
+    dip = dinode(inum);
+    if(dip->type == 0 || (dip->tags == 0 && !(sb.flags & SB_INLINE)))
+      continue;
+    for(b = 0; nexttags(inum, &b, &size, &bn); ){
+      if(!tagsok(b, size))
+        continue;
+      for(i = 0; i < ((struct taghdr*)b)->nent; i++){
+        e = TAGENT(b, i);
+        h[0] = taghash(e + 2, e[0], e + 2 + e[0], e[1]);
+        h[1] = ~taghash(e + 2, e[0], 0, 0);
+        for(k = 0; k < 2; k++){
+          if(tagslot(tip, n, inum, h[k], 0))
+            continue;
+          problem("tag index: no %s entry for inode %u key %.*s",
+                  k ? "key" : "value", inum, e[0], (char*)e + 2);
+          if(repair && tagslot(tip, n, inum, h[k], 1) == 0)
+            problem("tag index: full");
+        }
+      }
+    }
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct stat st;
+  pthread_t *th;
+  int c, fd, i, nthread, loghead;
+
+  nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  while((c = getopt(argc, argv, "rvj:")) != -1){
+    switch(c){
+    case 'r':
+      repair = 1;
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'j':
+      nthread = atoi(optarg);
+      break;
+    default:
+      goto usage;
+    }
+  }
+  if(optind != argc - 1 || nthread < 1){
+usage:
+    fprintf(stderr, "Usage: fsck [-r] [-v] [-j threads] fs.img\n");
+    exit(2);
+  }
+
+  if((fd = open(argv[optind], repair ? O_RDWR : O_RDONLY)) < 0 || fstat(fd, &st) < 0){
+    perror(argv[optind]);
+    exit(2);
+  }
+  imgsize = st.st_size;
+  if(imgsize < 2 * BSIZE){
+    fprintf(stderr, "fsck: %s is too small\n", argv[optind]);
+    exit(2);
+  }
+  img = mmap(0, imgsize, PROT_READ | (repair ? PROT_WRITE : 0), MAP_SHARED, fd, 0);
+  if(img == MAP_FAILED){
+    perror("mmap");
+    exit(2);
+  }
+  memmove(&sb, blk(1), sizeof(sb));
+  datastart = sb.logstart + sb.nlog;
+  if(sb.bsize != BSIZE || (size_t)sb.size * BSIZE > imgsize || sb.ninodes > 65536 ||
+     sb.logstart != sb.ninodes / IPB + 3 + (sb.size / BPB + 1) ||
+     datastart > sb.size || sb.tagino >= sb.ninodes ||
+     (sb.agblocks && ((sb.size + sb.agblocks - 1) / sb.agblocks > NAGMAX || sb.aginodes == 0))){
+    fprintf(stderr, "fsck: bad super block\n");
+    exit(2);
+  }
+  loghead = *(int*)blk(sb.logstart);
+  if(loghead != 0){
+    fprintf(stderr, "fsck: the log holds %d blocks; boot xv6 to install them first\n", loghead);
+    exit(2);
+  }
+  owner = calloc(sb.size, sizeof(*owner));
+  names = calloc(sb.ninodes, sizeof(*names));
+  th = calloc(nthread, sizeof(*th));
+  if(owner == 0 || names == 0 || th == 0){
+    perror("calloc");
+    exit(2);
+  }
+
+  for(i = 0; i < nthread; i++)
+    if(pthread_create(&th[i], 0, worker, 0) != 0){
+      perror("pthread_create");
+      exit(2);
+    }
+  for(i = 0; i < nthread; i++)
+    pthread_join(th[i], 0);
+  if(dinode(ROOTINO)->type != T_DIR)
+    problem("root inode is not a directory");
+  checklinks();
+  checkbitmap();
+  checkindex();
+
+  if(repair && msync(img, imgsize, MS_SYNC) < 0){
+    perror("msync");
+    exit(2);
+  }
+  printf("%s: %u blocks, %u inodes, %d problem%s%s\n", argv[optind], sb.size,
+         sb.ninodes, nproblems, nproblems == 1 ? "" : "s",
+         nproblems && repair ? ", repaired" : "");
+  exit(nproblems ? 1 : 0);
+}
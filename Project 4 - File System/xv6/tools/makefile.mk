@@ -1,9 +1,10 @@
 
 # dependency files
-TOOLS_DEPS := tools/mkfs.d
+TOOLS_DEPS := tools/mkfs.d tools/fsck.d tools/bioreplay.d
 
 # all generated files
-TOOLS_CLEAN := tools/mkfs tools/mkfs.o $(TOOLS_DEPS)
+TOOLS_CLEAN := tools/mkfs tools/mkfs.o tools/fsck tools/fsck.o tools/bioreplay \
+	tools/bioreplay.o $(TOOLS_DEPS)
 
 # flags
 TOOLS_CPPFLAGS := -iquote include
@@ -12,6 +13,14 @@ TOOLS_CPPFLAGS := -iquote include
 tools/mkfs: tools/mkfs.o
 	$(CC) $(LDFLAGS) $< -o $@
 
+# fsck
+tools/fsck: tools/fsck.o
+	$(CC) $(LDFLAGS) $< -o $@ -lpthread
+
+# bioreplay
+tools/bioreplay: tools/bioreplay.o
+	$(CC) $(LDFLAGS) $< -o $@
+
 # build object files from c files
 tools/%.o: tools/%.c
 	$(CC) -c $(CPPFLAGS) $(TOOLS_CPPFLAGS) $(CFLAGS) $(TOOLS_CLFAGS) -o $@ $<
@@ -12,20 +12,59 @@
 #define stat xv6_stat  // avoid clash with host struct stat
 #define dirent xv6_dirent  // avoid clash with host struct stat
 #include "types.h"
+#include "param.h"
 #include "fs.h"
 #include "stat.h"
 #undef stat
 #undef dirent
 
-#define BLOCK_SIZE (512)
+#define BLOCK_SIZE (BSIZE)
 
-int nblocks = 995;
+// The image is built in memory and written out in one go at the
+// end, so wsect and rsect are copies.  Each file's size is known
+// before it is written, and ireserve gives it all its blocks at
+// once: data blocks in file order, then its indirect blocks.  A
+// directory's entries come first, then its files, then its
+// subdirectories, so the files of a directory sit together.
+//
+// A manifest (-m) adds to the tree copied from dir, a line each:
+//
+//   dir  path              a directory, and any above it
+//   file path hostfile     a file with hostfile's contents
+//   tag  path key value    a tag on path; value is the rest of the line
+//
+// Paths are in the image, from its root.  Tags go straight into
+// the inodes' tag areas, and the tag index is built once every
+// tag is known, big enough to stay at most half full.
+struct mentry {
+  char type;     // 'd', 'f' or 't'
+  char *path;    // without the leading /
+  char *host;    // 'f': absolute host path
+  char *key;     // 't'
+  char *value;   // 't'
+  uint inum;     // 't': found at the end
+};
+struct mentry *man;
+int nman;
+
+struct ipath {   // every path made, to find tagged inodes by
+  char *path;
+  uint inum;
+};
+struct ipath *paths;
+int npaths, maxpaths;
+
+int nblocks;
 int ninodes = 200;
-int size = 1024;
+int size = 20480;
+bool inlined;  // -I: small files in the inode, SB_INLINE
+char *stripe;  // -S: second half of a striped image goes here
 
 int fsfd;
+int stripefd;
+uchar *img;
 struct superblock sb;
-char zeroes[512];
+char zeroes[BSIZE];
 uint freeblock;
 uint usedblocks;
 uint bitblocks;
@@ -39,6 +78,11 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void ireserve(uint inum, uint n);
+void maketags(void);
+void wimage(void);
+void readmanifest(char*);
+void writetags(void);
 
 // convert to intel byte order
 ushort
@@ -65,26 +109,46 @@ xint(uint x)
 
 
 int 
-mkfs(int nblocks, int ninodes, int size) {
+mkfs(int ninodes, int size) {
 
-  int i;
   char buf[BLOCK_SIZE];
+  uint agblocks, aginodes, ngroups;
+
+  bitblocks = size/BPB + 1;
+  usedblocks = ninodes / IPB + 3 + bitblocks + LOGSIZE + 1;
+  freeblock = usedblocks;
+  if(size <= usedblocks){
+    fprintf(stderr, "mkfs: %d blocks is too small for %d inodes\n", size, ninodes);
+    exit(1);
+  }
+  nblocks = size - usedblocks;
 
   sb.size = xint(size);
   sb.nblocks = xint(nblocks); // so whole disk is size sectors
   sb.ninodes = xint(ninodes);
+  sb.logstart = xint(ninodes / IPB + 3 + bitblocks);
+  sb.nlog = xint(LOGSIZE + 1);
+  sb.bsize = xint(BSIZE);
+  sb.flags = xint(inlined ? SB_INLINE : 0);
 
-  bitblocks = size/(512*8) + 1;
-  usedblocks = ninodes / IPB + 3 + bitblocks;
-  freeblock = usedblocks;
-
-  printf("used %d (bit %d ninode %zu) free %u total %d\n", usedblocks,
-         bitblocks, ninodes/IPB + 1, freeblock, nblocks+usedblocks);
+  // Allocation groups of one bitmap block's worth, or as many as
+  // it takes to make at most NAGMAX, and inodes split to match.
+  for(agblocks = BPB; (size + agblocks - 1) / agblocks > NAGMAX; agblocks += BPB)
+    ;
+  ngroups = (size + agblocks - 1) / agblocks;
+  sb.agblocks = xint(agblocks);
+  aginodes = ((ninodes + ngroups - 1) / ngroups + IPB - 1) / IPB * IPB;
+  sb.aginodes = xint(aginodes);
 
-  assert(nblocks + usedblocks == size);
+  printf("used %d (bit %d ninode %zu log %d) free %u total %d\n", usedblocks,
+         bitblocks, ninodes/IPB + 1, LOGSIZE + 1, freeblock, nblocks+usedblocks);
+  printf("%u groups of %u blocks and %u inodes\n", ngroups, agblocks, aginodes);
 
-  for(i = 0; i < nblocks + usedblocks; i++)
-    wsect(i, zeroes);
+  img = calloc(size, BSIZE);
+  if(img == NULL){
+    perror("calloc");
+    exit(1);
+  }
 
   memset(buf, 0, sizeof(buf));
   memmove(buf, &sb, sizeof(sb));
@@ -94,33 +158,135 @@ mkfs(int nblocks, int ninodes, int size) {
   return 0;
 }
 
+// Same as dirhash in kernel/fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return h;
+}
+
+// Write the n entries in de as the contents of directory inum:
+// as a plain list if they fit in DIRHASHMIN blocks, else as a
+// hashed directory with room to spare.
+void
+write_dir(uint inum, struct xv6_dirent *de, int n)
+{
+  struct xv6_dirent *tab;
+  struct dinode din;
+  int dpb, nb, i, j, off;
+
+  dpb = BSIZE / sizeof(*de);
+  if(n <= DIRHASHMIN * dpb){
+    iappend(inum, de, n * sizeof(*de));
+    // fix size of inode cur_dir
+    rinode(inum, &din);
+    off = xint(din.size);
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(inum, &din);
+    return;
+  }
+
+  nb = 2 * ((n + dpb - 1) / dpb);
+  tab = calloc(nb * dpb, sizeof(*tab));
+  assert(tab);
+  for(i = 0; i < n; i++){
+    j = (dirhash(de[i].name) % nb) * dpb;
+    while(tab[j].inum != 0)
+      j = (j + 1) % (nb * dpb);
+    tab[j] = de[i];
+  }
+  iappend(inum, tab, nb * BSIZE);
+  free(tab);
+  rinode(inum, &din);
+  din.major = xshort(D_HASHED);
+  winode(inum, &din);
+}
+
+// Remember that path is inode inum, for the manifest's tags.
+void
+addpath(char *path, uint inum)
+{
+  if(npaths == maxpaths){
+    maxpaths = maxpaths ? 2 * maxpaths : 256;
+    paths = realloc(paths, maxpaths * sizeof(*paths));
+    assert(paths);
+  }
+  paths[npaths].path = strdup(path);
+  paths[npaths++].inum = inum;
+}
+
+// path with name appended, in a new string.
+char*
+pathcat(char *path, char *name)
+{
+  char *p;
+
+  p = malloc(strlen(path) + strlen(name) + 2);
+  assert(p);
+  sprintf(p, "%s%s%s", path, *path ? "/" : "", name);
+  return p;
+}
+
+// Is p, a manifest path, a child of directory path?  Sets *name
+// to its last element.
+bool
+childof(char *p, char *path, char **name)
+{
+  size_t n;
+
+  n = strlen(path);
+  if(n > 0 && (strncmp(p, path, n) != 0 || p[n] != '/'))
+    return false;
+  *name = p + (n > 0 ? n + 1 : 0);
+  return **name != 0 && strchr(*name, '/') == NULL;
+}
+
+// Copy host directory cur_dir (NULL if there is none), with the
+// manifest's entries for directory path, into directory inode
+// cur_inode.
 int
-add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
-	int r;
+add_dir(DIR *cur_dir, char *path, int cur_inode, int parent_inode) {
+	int r, i;
 	int child_inode;
 	int cur_fd, child_fd;
 	struct xv6_dirent de;
-	struct dinode din;
 	struct dirent dir_buf;
 	struct dirent *entry;
 	struct stat st;
-	int bytes_read;
-	char buf[BLOCK_SIZE];
-	int off;
-
-	bzero(&de, sizeof(de));
-	de.inum = xshort(cur_inode);
-	strcpy(de.name, ".");
-	iappend(cur_inode, &de, sizeof(de));
-
-	bzero(&de, sizeof(de));
-	de.inum = xshort(parent_inode);
-	strcpy(de.name, "..");
-	iappend(cur_inode, &de, sizeof(de));
-
-	if (cur_dir == NULL) {
-		return 0;
-	}
+	struct dinode din;
+	DIR *child_dir;
+	char *data;
+	struct xv6_dirent *ents;
+	char **names;  // Host names, ents[i] is names[i]
+	bool *isdir;
+	int nents, maxents;
+	char *name, *child;
+	int j, k;
+
+	maxents = 16;
+	ents = malloc(maxents * sizeof(*ents));
+	names = malloc(maxents * sizeof(*names));
+	isdir = malloc(maxents * sizeof(*isdir));
+	assert(ents && names && isdir);
+	nents = 0;
+
+	bzero(&ents[nents], sizeof(de));
+	ents[nents].inum = xshort(cur_inode);
+	strcpy(ents[nents++].name, ".");
+
+	bzero(&ents[nents], sizeof(de));
+	ents[nents].inum = xshort(parent_inode);
+	strcpy(ents[nents++].name, "..");
+
+	if (cur_dir == NULL)
+		goto manifest;
 
 	cur_fd = dirfd(cur_dir);
 	if (cur_fd == -1){
@@ -147,50 +313,130 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
 			continue;
 
-		printf("%s\n", entry->d_name);
-
-		child_fd = open(entry->d_name, O_RDONLY);
-		if (child_fd == -1) {
-			perror("open");
-			return -1;
-		}
-
-		r = fstat(child_fd, &st);
+		r = stat(entry->d_name, &st);
 		if (r != 0) {
 			perror("stat");
 			return -1;
 		}
 
-		if (S_ISDIR(st.st_mode)) {
-      child_inode = ialloc(T_DIR);
-			r = add_dir(fdopendir(child_fd), child_inode, cur_inode);
-			if (r != 0) return r;
-			if (fchdir(cur_fd) != 0) {
-				perror("chdir");
-				return -1;
+		child_inode = ialloc(S_ISDIR(st.st_mode) ? T_DIR : T_FILE);
+		bzero(&de, sizeof(de));
+		de.inum = xshort(child_inode);
+		strncpy(de.name, entry->d_name, DIRSIZ);
+		if (nents == maxents) {
+			maxents *= 2;
+			ents = realloc(ents, maxents * sizeof(*ents));
+			names = realloc(names, maxents * sizeof(*names));
+			isdir = realloc(isdir, maxents * sizeof(*isdir));
+			assert(ents && names && isdir);
+		}
+		names[nents] = strdup(entry->d_name);
+		isdir[nents] = S_ISDIR(st.st_mode);
+		ents[nents++] = de;
+	}
+
+manifest:
+	// A manifest file replaces a host file of the same name; a
+	// manifest directory adds to a host one.
+	for (j = 0; j < nman; j++) {
+		if (man[j].type == 't' || !childof(man[j].path, path, &name))
+			continue;
+		for (k = 2; k < nents && strncmp(ents[k].name, name, DIRSIZ) != 0; k++)
+			;
+		if (k < nents) {
+			if (man[j].type == 'f' && !isdir[k]) {
+				free(names[k]);
+				names[k] = strdup(man[j].host);
 			}
+			continue;
+		}
+		child_inode = ialloc(man[j].type == 'd' ? T_DIR : T_FILE);
+		bzero(&de, sizeof(de));
+		de.inum = xshort(child_inode);
+		strncpy(de.name, name, DIRSIZ);
+		if (nents == maxents) {
+			maxents *= 2;
+			ents = realloc(ents, maxents * sizeof(*ents));
+			names = realloc(names, maxents * sizeof(*names));
+			isdir = realloc(isdir, maxents * sizeof(*isdir));
+			assert(ents && names && isdir);
+		}
+		// A directory only in the manifest has no host name.
+		names[nents] = man[j].type == 'f' ? strdup(man[j].host) : NULL;
+		isdir[nents] = man[j].type == 'd';
+		ents[nents++] = de;
+	}
+
+	write_dir(cur_inode, ents, nents);
+	for (i = 2; i < nents; i++) {
+		child = pathcat(path, ents[i].name);
+		addpath(child, xshort(ents[i].inum));
+		free(child);
+	}
+
+	// Each file is read whole into its reserved run of blocks.
+	for (i = 2; i < nents; i++) {
+		if (isdir[i])
+			continue;
+		printf("%s\n", names[i]);
+		child_fd = open(names[i], O_RDONLY);
+		if (child_fd == -1 || fstat(child_fd, &st) != 0) {
+			perror(names[i]);
+			return -1;
+		}
+		child_inode = xshort(ents[i].inum);
+		data = malloc(st.st_size + 1);
+		assert(data);
+		if (read(child_fd, data, st.st_size) != st.st_size) {
+			perror("read");
+			return -1;
+		}
+		if (inlined && st.st_size > 0 && st.st_size <= NINLINE) {
+			rinode(child_inode, &din);
+			memmove(din.addrs, data, st.st_size);
+			din.size = xint(st.st_size);
+			din.major = xshort(F_INLINE);
+			winode(child_inode, &din);
 		} else {
-			bytes_read = 0;
-	  		child_inode = ialloc(T_FILE);
-			bzero(&de, sizeof(de));
-			while((bytes_read = read(child_fd, buf, sizeof(buf))) > 0) {
-				iappend(child_inode, buf, bytes_read);
-			}
+			ireserve(child_inode, st.st_size);
+			iappend(child_inode, data, st.st_size);
 		}
+		free(data);
 		close(child_fd);
+	}
 
-		de.inum = xshort(child_inode);
-		strncpy(de.name, entry->d_name, DIRSIZ);
-		iappend(cur_inode, &de, sizeof(de));
-
+	for (i = 2; i < nents; i++) {
+		if (!isdir[i])
+			continue;
+		child = pathcat(path, ents[i].name);
+		printf("%s\n", child);
+		if (names[i] == NULL) {
+			r = add_dir(NULL, child, xshort(ents[i].inum), cur_inode);
+			free(child);
+			if (r != 0) return r;
+			continue;
+		}
+		child_fd = open(names[i], O_RDONLY);
+		if (child_fd == -1) {
+			perror("open");
+			return -1;
+		}
+		child_dir = fdopendir(child_fd);
+		r = add_dir(child_dir, child, xshort(ents[i].inum), cur_inode);
+		free(child);
+		if (r != 0) return r;
+		closedir(child_dir);
+		if (fchdir(cur_fd) != 0) {
+			perror("chdir");
+			return -1;
+		}
 	}
 
-	// fix size of inode cur_dir
-	rinode(cur_inode, &din);
-	off = xint(din.size);
-	off = ((off/BSIZE) + 1) * BSIZE;
-	din.size = xint(off);
-	winode(cur_inode, &din);
+	for (i = 2; i < nents; i++)
+		free(names[i]);  // NULL for manifest directories
+	free(ents);
+	free(names);
+	free(isdir);
 	return 0;
 }
 
@@ -200,51 +446,134 @@ add_dir(DIR *cur_dir, int cur_inode, int parent_inode) {
 int
 main(int argc, char *argv[])
 {
-  int r;
+  int r, c;
   DIR *root_dir;
 
-  if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+  while((c = getopt(argc, argv, "s:i:IS:m:")) != -1){
+    switch(c){
+    case 's':
+      size = atoi(optarg);
+      break;
+    case 'i':
+      ninodes = atoi(optarg);
+      break;
+    case 'I':
+      inlined = true;
+      break;
+    case 'S':
+      stripe = optarg;
+      break;
+    case 'm':
+      readmanifest(optarg);
+      break;
+    default:
+      goto usage;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  if(argc < 3 || size <= 0 || ninodes <= 0){
+usage:
+    fprintf(stderr, "Usage: mkfs [-s blocks] [-i inodes] [-I] [-S fs1.img] [-m manifest] fs.img dir\n");
     exit(1);
   }
 
-  assert((512 % sizeof(struct dinode)) == 0);
-  assert((512 % sizeof(struct xv6_dirent)) == 0);
+  assert((BSIZE % sizeof(struct dinode)) == 0);
+  assert((BSIZE % sizeof(struct xv6_dirent)) == 0);
+  assert((BSIZE % sizeof(struct tagent)) == 0);
 
   fsfd = open(argv[1], O_RDWR|O_CREAT|O_TRUNC, 0666);
   if(fsfd < 0){
     perror(argv[1]);
     exit(1);
   }
+  if(stripe && (stripefd = open(stripe, O_RDWR|O_CREAT|O_TRUNC, 0666)) < 0){
+    perror(stripe);
+    exit(1);
+  }
 
-  mkfs(995, 200, 1024);
+  mkfs(ninodes, size);
 
   root_dir = opendir(argv[2]);
 
   root_inode = ialloc(T_DIR);
   assert(root_inode == ROOTINO);
 
-  r = add_dir(root_dir, root_inode, root_inode);
+  addpath("", root_inode);
+  r = add_dir(root_dir, "", root_inode, root_inode);
   if (r != 0) {
     exit(EXIT_FAILURE);
   }
 
+  writetags();
+  maketags();
   balloc(usedblocks);
+  wimage();
 
   exit(0);
 }
 
+// Write n bytes at p to fd, and close it.
+static void
+wall(int fd, uchar *p, size_t n)
+{
+  size_t off;
+  ssize_t m;
+
+  for(off = 0; off < n; off += m){
+    if((m = write(fd, p + off, n - off)) <= 0){
+      perror("write");
+      exit(1);
+    }
+  }
+  if(close(fd) != 0){
+    perror("close");
+    exit(1);
+  }
+}
+
+// Write the whole image to the file, or with -S, its even blocks
+// to the file and its odd ones to the -S file, as the kernel's
+// STRIPEDEV lays them out on IDE disks 1 and 2.
 void
-wsect(uint sec, void *buf)
+wimage(void)
 {
-  if(lseek(fsfd, sec * 512L, 0) != sec * 512L){
-    perror("lseek");
+  uchar *half[2];
+  size_t n;
+  uint b;
+
+  if(stripe == 0){
+    wall(fsfd, img, (size_t)size * BSIZE);
+    return;
+  }
+  n = (size_t)(size + 1) / 2 * BSIZE;
+  half[0] = calloc(1, n);
+  half[1] = calloc(1, n);
+  if(half[0] == 0 || half[1] == 0){
+    perror("calloc");
     exit(1);
   }
-  if(write(fsfd, buf, 512) != 512){
-    perror("write");
+  for(b = 0; b < size; b++)
+    memmove(half[b & 1] + (size_t)(b >> 1) * BSIZE, img + (size_t)b * BSIZE, BSIZE);
+  wall(fsfd, half[0], n);
+  wall(stripefd, half[1], n);
+}
+
+// Sector sec of the image.
+uchar*
+sect(uint sec)
+{
+  if(sec >= size){
+    fprintf(stderr, "mkfs: image full at block %u\n", sec);
     exit(1);
   }
+  return img + (size_t)sec * BSIZE;
+}
+
+void
+wsect(uint sec, void *buf)
+{
+  memmove(sect(sec), buf, BSIZE);
 }
 
 uint
@@ -256,7 +585,7 @@ i2b(uint inum)
 void
 winode(uint inum, struct dinode *ip)
 {
-  char buf[512];
+  char buf[BSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -270,7 +599,7 @@ winode(uint inum, struct dinode *ip)
 void
 rinode(uint inum, struct dinode *ip)
 {
-  char buf[512];
+  char buf[BSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -283,14 +612,7 @@ rinode(uint inum, struct dinode *ip)
 void
 rsect(uint sec, void *buf)
 {
-  if(lseek(fsfd, sec * 512L, 0) != sec * 512L){
-    perror("lseek");
-    exit(1);
-  }
-  if(read(fsfd, buf, 512) != 512){
-    perror("read");
-    exit(1);
-  }
+  memmove(buf, sect(sec), BSIZE);
 }
 
 uint
@@ -307,20 +629,90 @@ ialloc(ushort type)
   return inum;
 }
 
+// Same as taghash in kernel/fs.c.
+uint
+taghash(char *key, int keyLength, char *value, int valueLength)
+{
+  uint h;
+  int i;
+
+  h = keyLength;
+  for(i = 0; i < keyLength; i++)
+    h = h*31 + (uchar)key[i];
+  for(i = 0; i < valueLength; i++)
+    h = h*31 + (uchar)value[i];
+  return h;
+}
+
+// Add (inum, h) to the index of n blocks at ix, as tagiadd does.
 void
-balloc(int used)
+tagiadd(struct tagent *ix, uint n, uint inum, uint h)
 {
-  uchar buf[512];
+  struct tagent *te;
+  uint i;
+
+  for(i = 0; i < n; i++)
+    for(te = ix + ((h + i) % n) * TPB; te < ix + ((h + i) % n + 1) * TPB; te++)
+      if(te->inum == 0){
+        te->inum = xint(inum);
+        te->hash = xint(h);
+        return;
+      }
+  assert(0);
+}
+
+// Create the tag index, with entries for the manifest's tags, and
+// record it in the super block.
+void
+maketags(void)
+{
+  char buf[BSIZE];
+  struct tagent *ix;
+  struct mentry *t;
+  uint inum, n, ntags;
   int i;
 
+  ntags = 0;
+  for(i = 0; i < nman; i++)
+    ntags += man[i].type == 't';
+  // Two entries a tag, at most half full.
+  n = (4 * ntags + TPB - 1) / TPB;
+  if(n < NTAGHASH)
+    n = NTAGHASH;
+  ix = calloc(n * TPB, sizeof(*ix));
+  assert(ix);
+  for(t = man; t < man + nman; t++){
+    if(t->type != 't')
+      continue;
+    tagiadd(ix, n, t->inum, taghash(t->key, strlen(t->key), t->value, strlen(t->value)));
+    tagiadd(ix, n, t->inum, ~taghash(t->key, strlen(t->key), 0, 0));
+  }
+  inum = ialloc(T_FILE);
+  ireserve(inum, n * BSIZE);
+  iappend(inum, ix, n * BSIZE);
+  free(ix);
+  sb.tagino = xint(inum);
+  memset(buf, 0, sizeof(buf));
+  memmove(buf, &sb, sizeof(sb));
+  wsect(1, buf);
+}
+
+void
+balloc(int used)
+{
+  uchar buf[BSIZE];
+  int i, b;
+
   printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < 512*8);
-  bzero(buf, 512);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  assert(used <= size);
+  for(b = 0; b * BPB < used; b++){
+    bzero(buf, BSIZE);
+    for(i = 0; i < BPB && b * BPB + i < used; i++){
+      buf[i/8] = buf[i/8] | (0x1 << (i%8));
+    }
+    printf("balloc: write bitmap block at sector %zu\n", ninodes/IPB + 3 + b);
+    wsect(ninodes / IPB + 3 + b, buf);
   }
-  printf("balloc: write bitmap block at sector %zu\n", ninodes/IPB + 3);
-  wsect(ninodes / IPB + 3, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
@@ -331,15 +723,15 @@ iappend(uint inum, void *xp, int n)
   char *p = (char*)xp;
   uint fbn, off, n1;
   struct dinode din;
-  char buf[512];
+  char buf[BSIZE];
   uint indirect[NINDIRECT];
-  uint x;
+  uint x, i;
 
   rinode(inum, &din);
 
   off = xint(din.size);
   while(n > 0){
-    fbn = off / 512;
+    fbn = off / BSIZE;
     assert(fbn < MAXFILE);
     if(fbn < NDIRECT){
       if(xint(din.addrs[fbn]) == 0){
@@ -347,7 +739,7 @@ iappend(uint inum, void *xp, int n)
         usedblocks++;
       }
       x = xint(din.addrs[fbn]);
-    } else {
+    } else if(fbn < NDIRECT + NINDIRECT){
       if(xint(din.addrs[NDIRECT]) == 0){
         // printf("allocate indirect block\n");
         din.addrs[NDIRECT] = xint(freeblock++);
@@ -361,10 +753,31 @@ iappend(uint inum, void *xp, int n)
         wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
       }
       x = xint(indirect[fbn-NDIRECT]);
+    } else {
+      if(xint(din.addrs[NDIRECT+1]) == 0){
+        din.addrs[NDIRECT+1] = xint(freeblock++);
+        usedblocks++;
+      }
+      rsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      i = (fbn - NDIRECT - NINDIRECT) / NINDIRECT;
+      if(indirect[i] == 0){
+        indirect[i] = xint(freeblock++);
+        usedblocks++;
+        wsect(xint(din.addrs[NDIRECT+1]), (char*)indirect);
+      }
+      x = xint(indirect[i]);
+      rsect(x, (char*)indirect);
+      i = (fbn - NDIRECT - NINDIRECT) % NINDIRECT;
+      if(indirect[i] == 0){
+        indirect[i] = xint(freeblock++);
+        usedblocks++;
+        wsect(x, (char*)indirect);
+      }
+      x = xint(indirect[i]);
     }
-    n1 = min(n, (fbn + 1) * 512 - off);
+    n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
-    bcopy(p, buf + off - (fbn * 512), n1);
+    bcopy(p, buf + off - (fbn * BSIZE), n1);
     wsect(x, buf);
     n -= n1;
     off += n1;
@@ -373,3 +786,244 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Give empty file inum its blocks for n bytes in one run: the data
+// blocks in file order, then the indirect blocks that map them, so
+// the kernel can read the file with few long transfers.  iappend
+// then finds every block it needs already there.
+void
+ireserve(uint inum, uint n)
+{
+  struct dinode din;
+  uint indirect[NINDIRECT], dindirect[NINDIRECT];
+  uint nb, b, fbn, i;
+
+  nb = (n + BSIZE - 1) / BSIZE;
+  assert(nb <= MAXFILE);
+  rinode(inum, &din);
+  assert(xint(din.size) == 0);
+  b = freeblock;
+  freeblock += nb;
+  usedblocks += nb;
+  for(fbn = 0; fbn < nb && fbn < NDIRECT; fbn++)
+    din.addrs[fbn] = xint(b++);
+  if(nb > NDIRECT){
+    din.addrs[NDIRECT] = xint(freeblock++);
+    usedblocks++;
+    bzero(indirect, sizeof(indirect));
+    for(i = 0; i < NINDIRECT && fbn < nb; i++, fbn++)
+      indirect[i] = xint(b++);
+    wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
+  }
+  if(nb > NDIRECT + NINDIRECT){
+    din.addrs[NDIRECT+1] = xint(freeblock++);
+    usedblocks++;
+    bzero(dindirect, sizeof(dindirect));
+    for(i = 0; fbn < nb; i++){
+      dindirect[i] = xint(freeblock++);
+      usedblocks++;
+      bzero(indirect, sizeof(indirect));
+      for(; fbn < nb && (fbn - NDIRECT - NINDIRECT) / NINDIRECT == i; fbn++)
+        indirect[(fbn - NDIRECT - NINDIRECT) % NINDIRECT] = xint(b++);
+      wsect(xint(dindirect[i]), (char*)indirect);
+    }
+    wsect(xint(din.addrs[NDIRECT+1]), (char*)dindirect);
+  }
+  winode(inum, &din);
+}
+
+// Append an entry to the manifest, after the directories above it
+// that it doesn't have yet.
+void
+addman(char type, char *path, char *host, char *key, char *value)
+{
+  static int maxman;
+  char *s;
+  int i;
+
+  if(type != 't'){
+    for(s = strchr(path, '/'); s; s = strchr(s + 1, '/')){
+      *s = 0;
+      for(i = 0; i < nman && (man[i].type != 'd' || strcmp(man[i].path, path) != 0); i++)
+        ;
+      if(i == nman)
+        addman('d', path, NULL, NULL, NULL);
+      *s = '/';
+    }
+  }
+  if(nman == maxman){
+    maxman = maxman ? 2 * maxman : 64;
+    man = realloc(man, maxman * sizeof(*man));
+    assert(man);
+  }
+  memset(&man[nman], 0, sizeof(man[nman]));
+  man[nman].type = type;
+  man[nman].path = strdup(path);
+  man[nman].host = host;
+  man[nman].key = key ? strdup(key) : NULL;
+  man[nman].value = value ? strdup(value) : NULL;
+  nman++;
+}
+
+// Read manifest file name into man.
+void
+readmanifest(char *name)
+{
+  FILE *fp;
+  char line[1024], type[8], path[512], host[512], key[TAGKEYMAX+2];
+  char *p, *rest, *h;
+  int lineno, n;
+
+  if((fp = fopen(name, "r")) == NULL){
+    perror(name);
+    exit(1);
+  }
+  for(lineno = 1; fgets(line, sizeof(line), fp); lineno++){
+    line[strcspn(line, "\n")] = 0;
+    n = 0;
+    if(sscanf(line, "%7s %511s %n", type, path, &n) < 2 || type[0] == '#')
+      continue;
+    rest = line + n;
+    for(p = path; *p == '/'; p++)
+      ;
+    if(strcmp(type, "tag") == 0 && sscanf(rest, "%32s %n", key, &n) == 1){
+      if(strlen(key) > TAGKEYMAX || strlen(rest + n) > TAGVALMAX){
+        fprintf(stderr, "%s:%d: tag too long\n", name, lineno);
+        exit(1);
+      }
+      addman('t', p, NULL, key, rest + n);
+      continue;
+    }
+    if(*p == 0 || strlen(strrchr(path, '/') ? strrchr(path, '/') + 1 : path) > DIRSIZ){
+      fprintf(stderr, "%s:%d: bad name\n", name, lineno);
+      exit(1);
+    }
+    if(strcmp(type, "dir") == 0)
+      addman('d', p, NULL, NULL, NULL);
+    else if(strcmp(type, "file") == 0 && sscanf(rest, "%511s", host) == 1){
+      if((h = realpath(host, NULL)) == NULL){
+        perror(host);
+        exit(1);
+      }
+      addman('f', p, h, NULL, NULL);
+    } else {
+      fprintf(stderr, "%s:%d: bad line\n", name, lineno);
+      exit(1);
+    }
+  }
+  fclose(fp);
+}
+
+int
+pathcmp(const void *a, const void *b)
+{
+  return strcmp(((struct ipath*)a)->path, ((struct ipath*)b)->path);
+}
+
+// Order tags by inode, then by key as tag blocks keep them.
+int
+tagorder(const void *a, const void *b)
+{
+  struct mentry *x = *(struct mentry**)a, *y = *(struct mentry**)b;
+  size_t kx, ky;
+  int r;
+
+  if(x->inum != y->inum)
+    return x->inum < y->inum ? -1 : 1;
+  kx = strlen(x->key);
+  ky = strlen(y->key);
+  if((r = memcmp(x->key, y->key, min(kx, ky))) != 0)
+    return r;
+  return (int)kx - (int)ky;
+}
+
+// Lay out the n tags at t, in key order, as a tag area size bytes
+// long at b.  Returns how many fit.
+int
+tagfill(uchar *b, uint size, struct mentry **t, int n)
+{
+  struct taghdr *th;
+  ushort *off;
+  uint free, kl, vl;
+  int i;
+
+  memset(b, 0, size);
+  th = (struct taghdr*)b;
+  off = (ushort*)(th + 1);
+  free = size;
+  for(i = 0; i < n; i++){
+    kl = strlen(t[i]->key);
+    vl = strlen(t[i]->value);
+    if(sizeof(*th) + (i + 1) * sizeof(ushort) + 2 + kl + vl > free)
+      break;
+    free -= 2 + kl + vl;
+    b[free] = kl;
+    b[free + 1] = vl;
+    memmove(b + free + 2, t[i]->key, kl);
+    memmove(b + free + 2 + kl, t[i]->value, vl);
+    off[i] = xshort(free);
+  }
+  th->nent = xshort(i);
+  th->free = xshort(free);
+  return i;
+}
+
+// Give the manifest's tags to their inodes: in the inode if they
+// all fit there (-I), else in a chain of tag blocks.
+void
+writetags(void)
+{
+  struct mentry **t;
+  struct ipath k, *p;
+  struct dinode din;
+  uchar buf[BSIZE];
+  uint bn, prev;
+  int i, j, m, n, fit;
+
+  t = malloc(nman * sizeof(*t) + 1);
+  assert(t);
+  for(i = n = 0; i < nman; i++)
+    if(man[i].type == 't')
+      t[n++] = &man[i];
+  qsort(paths, npaths, sizeof(*paths), pathcmp);
+  for(i = 0; i < n; i++){
+    k.path = t[i]->path;
+    if((p = bsearch(&k, paths, npaths, sizeof(*paths), pathcmp)) == NULL){
+      fprintf(stderr, "mkfs: tag on /%s, which isn't in the image\n", t[i]->path);
+      exit(1);
+    }
+    t[i]->inum = p->inum;
+  }
+  qsort(t, n, sizeof(*t), tagorder);
+  for(i = 0; i < n; i = j){
+    for(j = i + 1; j < n && t[j]->inum == t[i]->inum; j++)
+      if(strcmp(t[j]->key, t[j-1]->key) == 0){
+        fprintf(stderr, "mkfs: /%s tagged %s twice\n", t[j]->path, t[j]->key);
+        exit(1);
+      }
+    rinode(t[i]->inum, &din);
+    if(inlined && tagfill(din.itags, NITAGS, t + i, j - i) == j - i){
+      winode(t[i]->inum, &din);
+      continue;
+    }
+    memset(din.itags, 0, NITAGS);
+    prev = 0;
+    for(m = i; m < j; m += fit){
+      bn = freeblock++;
+      usedblocks++;
+      if(prev == 0)
+        din.tags = xint(bn);
+      else {
+        rsect(prev, buf);
+        ((struct taghdr*)buf)->next = xint(bn);
+        wsect(prev, buf);
+      }
+      fit = tagfill(buf, BSIZE, t + m, j - m);
+      assert(fit > 0);
+      wsect(bn, buf);
+      prev = bn;
+    }
+    winode(t[i]->inum, &din);
+  }
+  free(t);
+}
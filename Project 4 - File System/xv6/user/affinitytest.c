@@ -0,0 +1,70 @@
+/* setaffinity keeps a process, and its children, on the CPUs it names. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+int ppid;
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// The entry for pid.
+struct ProcessInfo*
+find(int pid)
+{
+    int i, n;
+
+    n = getprocs(table);
+    assert(n > 0 && n <= NPROC);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return &table[i];
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct ProcessInfo *p;
+    int pid, i;
+
+    assert(setaffinity(ppid, 0) == -1);
+    assert(setaffinity(-1, 1) == -1);
+    assert(find(ppid)->cpumask == ~0);
+
+    // Pinned to CPU 0, we run there once we have slept.
+    assert(setaffinity(ppid, 1) == 0);
+    assert(find(ppid)->cpumask == 1);
+    for (i = 0; i < 10; i++) {
+        sleep(1);
+        assert(find(ppid)->cpu == 0);
+    }
+
+    // A child starts with our mask and stays on CPU 0 too.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        for (;;)
+            ;
+    }
+    for (i = 0; i < 10; i++) {
+        sleep(1);
+        p = find(pid);
+        assert(p->cpumask == 1);
+        assert(p->cpu == 0);
+    }
+
+    kill(pid);
+    wait();
+    printf(1, "TEST PASSED\n");
+    exit();
+}
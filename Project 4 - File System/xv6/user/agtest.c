@@ -0,0 +1,103 @@
+/* Blocks are handed out by allocation group, in runs per file:
+ * files written at once in different directories, and in the
+ * same one, all read back intact, and so do files made after
+ * those are deleted, which reuse their blocks */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NWRITER 4
+#define NBLK 80
+#define BLK 512
+
+int ppid;
+char buf[BLK];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+char*
+path(int i)
+{
+    static char p[] = "agdir0/f0";
+
+    p[5] = '0' + i % 2;
+    p[8] = '0' + i;
+    return p;
+}
+
+// Write file i a block at a time, each block filled with its number.
+void
+writer(int i)
+{
+    int fd, b;
+
+    fd = open(path(i), O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (b = 0; b < NBLK; b++) {
+        memset(buf, 'a' + (i * NBLK + b) % 26, BLK);
+        assert(write(fd, buf, BLK) == BLK);
+    }
+    close(fd);
+    exit();
+}
+
+void
+check(int i)
+{
+    int fd, b, j;
+
+    fd = open(path(i), O_RDONLY);
+    assert(fd >= 0);
+    for (b = 0; b < NBLK; b++) {
+        assert(read(fd, buf, BLK) == BLK);
+        for (j = 0; j < BLK; j++)
+            assert(buf[j] == 'a' + (i * NBLK + b) % 26);
+    }
+    assert(read(fd, buf, 1) == 0);
+    close(fd);
+}
+
+// Write every file at once, then check them all.
+void
+writeall(void)
+{
+    int i, pid;
+
+    for (i = 0; i < NWRITER; i++) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+            writer(i);
+    }
+    for (i = 0; i < NWRITER; i++)
+        assert(wait() > 0);
+    for (i = 0; i < NWRITER; i++)
+        check(i);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i;
+    ppid = getpid();
+
+    assert(mkdir("agdir0") == 0);
+    assert(mkdir("agdir1") == 0);
+    writeall();
+    for (i = 0; i < NWRITER; i++)
+        assert(unlink(path(i)) == 0);
+    writeall();
+    for (i = 0; i < NWRITER; i++)
+        assert(unlink(path(i)) == 0);
+    assert(unlink("agdir0") == 0);
+    assert(unlink("agdir1") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,97 @@
+/* aio_read and aio_write return at once; the aio fd turns
+ * readable as they finish and reading it gives one event per
+ * request, with the data in place. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "aio.h"
+
+#define NCHUNK 8
+#define CHUNK  8192
+
+char data[NCHUNK][CHUNK];
+char buf[CHUNK];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Is chunk i of the file, as read into p, what was written?
+int
+check(char *p, int i)
+{
+    int j;
+
+    for (j = 0; j < CHUNK; j += 97)
+        if (p[j] != (char)(i*31 + j))
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct aioevent ev[4];
+    struct pollfd pfd;
+    int afd, fd, i, j, n, got, seen;
+
+    unlink("aio.tmp");
+    fd = open("aio.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < NCHUNK; i++) {
+        for (j = 0; j < CHUNK; j++)
+            buf[j] = i*31 + j;
+        assert(write(fd, buf, CHUNK) == CHUNK);
+    }
+
+    afd = aio_setup();
+    assert(afd >= 0);
+    assert(aio_read(afd, afd, buf, CHUNK, 0, 0) == -1);
+    assert(aio_read(fd, fd, buf, CHUNK, 0, 0) == -1);
+    assert(aio_read(afd, fd, buf, 65536 + 1, 0, 0) == -1);
+    assert(read(afd, ev, sizeof(ev)) == -1);  // nothing outstanding
+
+    // Queue every chunk, last first, then collect them.
+    for (i = NCHUNK - 1; i >= 0; i--)
+        assert(aio_read(afd, fd, data[i], CHUNK, i*CHUNK, 100 + i) == 0);
+    seen = 0;
+    for (got = 0; got < NCHUNK; ) {
+        pfd.fd = afd;
+        pfd.events = POLLIN;
+        assert(poll(&pfd, 1, -1) == 1 && (pfd.revents & POLLIN));
+        n = read(afd, ev, sizeof(ev));
+        assert(n > 0 && n % sizeof(ev[0]) == 0);
+        for (i = 0; i < n / sizeof(ev[0]); i++) {
+            j = ev[i].tag - 100;
+            assert(j >= 0 && j < NCHUNK && !(seen & (1 << j)));
+            assert(ev[i].res == CHUNK);
+            assert(check(data[j], j));
+            seen |= 1 << j;
+            got++;
+        }
+    }
+
+    // Writes land in the file; past the end reads short.
+    memset(buf, 'w', CHUNK);
+    assert(aio_write(afd, fd, buf, CHUNK, NCHUNK*CHUNK, 7) == 0);
+    assert(read(afd, ev, sizeof(ev)) == sizeof(ev[0]));
+    assert(ev[0].tag == 7 && ev[0].res == CHUNK);
+    assert(aio_read(afd, fd, data[0], CHUNK, NCHUNK*CHUNK + CHUNK/2, 8) == 0);
+    assert(read(afd, ev, sizeof(ev)) == sizeof(ev[0]));
+    assert(ev[0].tag == 8 && ev[0].res == CHUNK/2);
+    assert(data[0][0] == 'w' && data[0][CHUNK/2 - 1] == 'w');
+
+    // Closing with requests in flight is fine.
+    for (i = 0; i < NCHUNK; i++)
+        assert(aio_read(afd, fd, data[i], CHUNK, i*CHUNK, i) == 0);
+    close(afd);
+    close(fd);
+    assert(unlink("aio.tmp") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,19 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "bcachestat.h"
+
+int
+main(void)
+{
+  struct bcachestat st;
+
+  if(bcachestat(&st) < 0){
+    printf(2, "bcachestat: failed\n");
+    exit();
+  }
+  printf(1, "buffers %d hits %d misses %d evictions %d writebacks %d\n",
+         st.nbuf, st.hits, st.misses, st.evictions, st.writebacks);
+  printf(1, "hot %d ghost hits %d\n", st.nhot, st.ghosthits);
+  exit();
+}
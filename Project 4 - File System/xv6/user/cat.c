@@ -2,15 +2,34 @@
 #include "stat.h"
 #include "user.h"
 
-char buf[512];
+#define BUFSZ (32*1024)
+
+char buf[BUFSZ];
 
 void
 cat(int fd)
 {
   int n;
 
-  while((n = read(fd, buf, sizeof(buf))) > 0)
-    write(1, buf, n);
+  // A file goes to the output without passing through buf.
+  while((n = sendfile(1, fd, -1, 2*BUFSZ)) > 0)
+    ;
+  if(n == 0)
+    return;
+
+  // So does a pipe into a pipe.
+  while((n = splice(fd, 1, BUFSZ)) > 0)
+    ;
+  if(n == 0)
+    return;
+
+  // Console input, or output elsewhere: copy it.
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    if(write(1, buf, n) != n){
+      printf(2, "cat: write error\n");
+      exit();
+    }
+  }
   if(n < 0){
     printf(1, "cat: read error\n");
     exit();
@@ -0,0 +1,85 @@
+/* clock_gettime and vnsuptime count nanoseconds since boot,
+ * in step with the timer ticks. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "time.h"
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Milliseconds in ts.
+uint
+ms(struct timespec *ts)
+{
+    return ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct timespec a, b;
+    uint64 n0, n1, t0;
+    int i, t;
+
+    assert(clock_gettime(0, &a) == -1);
+    assert(clock_gettime(CLOCK_MONOTONIC, (struct timespec*)0) == -1);
+
+    // It never goes back.
+    assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+    for (i = 0; i < 1000; i++) {
+        assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0);
+        assert(b.tv_nsec < 1000000000);
+        assert(b.tv_sec > a.tv_sec ||
+               (b.tv_sec == a.tv_sec && b.tv_nsec >= a.tv_nsec));
+        a = b;
+    }
+    n0 = vnsuptime();
+    for (i = 0; i < 1000; i++) {
+        n1 = vnsuptime();
+        assert(n1 >= n0);
+        n0 = n1;
+    }
+    t0 = rdtsc();
+    assert(rdtsc() > t0);
+
+    // Twenty ticks are about 1000/HZ ms each; allow for a slow
+    // emulator missing some of them.
+    t = uptime();
+    while (uptime() == t)
+        ;
+    assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+    n0 = vnsuptime();
+    sleep(20);
+    assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0);
+    n1 = vnsuptime();
+    assert(ms(&b) - ms(&a) >= 19 * 1000 / HZ);
+    assert(ms(&b) - ms(&a) <= 200 * 1000 / HZ);
+    assert(n1 - n0 >= (uint64)19 * 1000000000 / HZ);
+
+    // Ticks come from the same clock, even across a sleep with
+    // every CPU idle and its tick stopped.
+    assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+    t = uptime();
+    sleep(50);
+    assert(clock_gettime(CLOCK_MONOTONIC, &b) == 0);
+    i = (ms(&b) - ms(&a)) * HZ / 1000;
+    assert(uptime() - t >= i - 1 && uptime() - t <= i + 1);
+
+    // The two clocks agree.
+    assert(clock_gettime(CLOCK_MONOTONIC, &a) == 0);
+    t = div64(vnsuptime(), 1000000, 0);
+    assert(t >= ms(&a) && t <= ms(&a) + 10);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,56 @@
+/* System calls copy their string and buffer arguments in, and
+ * bad ones make the call fail rather than the kernel panic. */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define PGSIZE 4096
+
+int ppid;
+char path[200];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd;
+    char *top, buf[8];
+
+    assert(open((char*)0, O_RDONLY) < 0);
+    assert(open((char*)0x7fffffff, O_RDONLY) < 0);
+    assert(open((char*)0xF0000000, O_RDONLY) < 0);
+
+    // A string that runs into the end of memory.
+    top = sbrk(PGSIZE) + PGSIZE;
+    memset(top - 4, 'x', 4);
+    assert(open(top - 4, O_RDONLY) < 0);
+    assert(open(top, O_RDONLY) < 0);
+
+    // Paths longer than the kernel takes.
+    memset(path, 'a', sizeof(path) - 1);
+    assert(open(path, O_CREATE | O_RDWR) < 0);
+    assert(mkdir(path) < 0);
+
+    // One that just fits, in the last bytes of memory.
+    strcpy(top - 8, "ls");
+    fd = open(top - 8, O_RDONLY);
+    assert(fd >= 0);
+    assert(read(fd, buf, 4) == 4);
+    assert(tagFile(fd, "k", (char*)0xF0000000, 3) < 0);
+    assert(tagFile(fd, "k", top - 2, 3) < 0);
+    close(fd);
+
+    // Argument words themselves come from memory too.
+    assert(pipe((int*)0xF0000000) < 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,127 @@
+/* copy_file_range copies file to file inside the kernel, from
+ * either offset, across holes and block boundaries, and cp uses
+ * it. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define N (20*512 + 100)
+
+int ppid;
+char buf[N];
+char got[N + 512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Does file name hold n bytes, the same as p?
+int
+holds(char *name, char *p, int n)
+{
+    struct stat st;
+    int fd, i;
+
+    fd = open(name, O_RDONLY);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0);
+    if (st.size != n || read(fd, got, n) != n) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+    for (i = 0; i < n; i++)
+        if (got[i] != p[i])
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *args[4];
+    int in, out, n, i, pid;
+    ppid = getpid();
+
+    for (i = 0; i < N; i++)
+        buf[i] = i * 7 + i / 512;
+    in = open("copy.a", O_CREATE | O_RDWR);
+    assert(in >= 0);
+    assert(write(in, buf, N) == N);
+    close(in);
+
+    // All of it, with in's offset.
+    in = open("copy.a", O_RDONLY);
+    out = open("copy.b", O_CREATE | O_RDWR);
+    assert(in >= 0 && out >= 0);
+    assert(copy_file_range(in, out, -1, N + 1000) == N);
+    assert(copy_file_range(in, out, -1, 10) == 0);
+    close(out);
+    assert(holds("copy.b", buf, N));
+
+    // From an offset off a block boundary to one on another, in
+    // pieces; in's offset is left alone.
+    out = open("copy.c", O_CREATE | O_RDWR);
+    assert(out >= 0);
+    assert(write(out, buf, 7) == 7);
+    for (i = 3; i < N; i += n) {
+        n = copy_file_range(in, out, i, 1000);
+        assert(n == (N - i < 1000 ? N - i : 1000));
+    }
+    assert(copy_file_range(in, out, N, 10) == 0);
+    assert(copy_file_range(in, out, N + 1, 10) < 0);
+    close(out);
+    out = open("copy.c", O_RDONLY);
+    assert(read(out, got, N + 4) == N + 4);
+    close(out);
+    for (i = 0; i < 7; i++)
+        assert(got[i] == buf[i]);
+    for (i = 3; i < N; i++)
+        assert(got[i + 4] == buf[i]);
+
+    // A hole reads as zeros in the copy.
+    out = open("copy.d", O_CREATE | O_RDWR);
+    assert(out >= 0);
+    assert(pwrite(out, "x", 1, 3*512) == 1);
+    close(out);
+    out = open("copy.d", O_RDONLY);
+    i = open("copy.e", O_CREATE | O_RDWR);
+    assert(copy_file_range(out, i, -1, 4*512) == 3*512 + 1);
+    close(i);
+    close(out);
+    memset(buf, 0, 3*512);
+    buf[3*512] = 'x';
+    assert(holds("copy.e", buf, 3*512 + 1));
+
+    // Bad arguments.
+    assert(copy_file_range(in, 99, -1, 10) < 0);
+    assert(copy_file_range(in, in, -1, 10) < 0);  // in isn't writable
+    close(in);
+
+    // cp, over a longer file.
+    args[0] = "cp";
+    args[1] = "copy.d";
+    args[2] = "copy.b";
+    args[3] = 0;
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        exec("cp", args);
+        exit();
+    }
+    assert(wait() == pid);
+    assert(holds("copy.b", buf, 3*512 + 1));
+
+    unlink("copy.a");
+    unlink("copy.b");
+    unlink("copy.c");
+    unlink("copy.d");
+    unlink("copy.e");
+    printf(1, "TEST PASSED\n");
+    exit();
+}
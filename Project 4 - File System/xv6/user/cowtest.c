@@ -0,0 +1,56 @@
+/* fork shares pages copy-on-write. */
+#include "types.h"
+#include "user.h"
+
+#define N (3*4096)
+
+int ppid;
+char buf[N];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd[2], i;
+
+    for (i = 0; i < N; i++) {
+        buf[i] = 'a';
+    }
+    assert(pipe(fd) == 0);
+    if (fork() == 0) {
+        // Our writes must not show in the parent, nor its in ours.
+        for (i = 0; i < N; i += 2) {
+            buf[i] = 'b';
+        }
+        assert(buf[0] == 'b' && buf[1] == 'a');
+        // The kernel writing a shared page copies it too.
+        assert(read(fd[0], buf + 4096, 5) == 5);
+        assert(buf[4096] == 'h' && buf[4100] == 'o');
+        if (fork() == 0) {
+            assert(buf[0] == 'b' && buf[4096] == 'h');
+            buf[0] = 'c';
+            exit();
+        }
+        wait();
+        assert(buf[0] == 'b');
+        exit();
+    }
+    for (i = 1; i < N; i += 2) {
+        buf[i] = 'z';
+    }
+    assert(write(fd[1], "hello", 5) == 5);
+    wait();
+    for (i = 0; i < N; i++) {
+        assert(buf[i] == (i % 2 ? 'z' : 'a'));
+    }
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,69 @@
+/* exec pages programs in on demand and shares their text. */
+#include "types.h"
+#include "user.h"
+
+int ppid;
+int counter = 42;     // initialized data
+char zeroes[3*4096];  // bss spanning several pages
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Run in each exec'd copy: the image must look freshly loaded.
+void
+child(void)
+{
+    int i;
+
+    assert(counter == 42);
+    for (i = 0; i < sizeof(zeroes); i += 512) {
+        assert(zeroes[i] == 0);
+    }
+    counter++;
+    zeroes[4096] = 1;
+    exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+    char pid[16], *args[4];
+    int i, n;
+
+    if (argc == 3) {
+        ppid = atoi(argv[2]);
+        child();
+    }
+    ppid = getpid();
+    n = ppid;
+    i = sizeof(pid) - 1;
+    pid[i] = 0;
+    do {
+        pid[--i] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    args[0] = "exectest";
+    args[1] = "child";
+    args[2] = pid + i;
+    args[3] = 0;
+
+    counter = 7;  // a write here must not reach the children
+    for (n = 0; n < 4; n++) {
+        if (fork() == 0) {
+            exec("exectest", args);
+            assert(0);
+        }
+    }
+    for (n = 0; n < 4; n++) {
+        wait();
+    }
+    assert(counter == 7);
+    assert(exec("nonexistent", args) < 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,59 @@
+/* The fd table grows past NOFILE up to NOFILEMAX, always hands
+ * out the lowest free fd, and is copied by fork. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    int fd, i, n, pid;
+    char c;
+
+    fd = open("fdtest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(write(fd, "x", 1) == 1);
+
+    // Fill the table; each dup gets the next fd.
+    for (n = fd + 1; ; n++) {
+        if ((i = dup(fd)) < 0)
+            break;
+        assert(i == n);
+    }
+    assert(n == NOFILEMAX);
+
+    // Freed fds are reused lowest first.
+    assert(close(700) == 0);
+    assert(close(20) == 0);
+    assert(close(5) == 0);
+    assert(dup(fd) == 5);
+    assert(dup(fd) == 20);
+    assert(dup(fd) == 700);
+    assert(dup(fd) < 0);
+
+    // A child has the same table.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(pread(NOFILEMAX - 1, &c, 1, 0) == 1 && c == 'x');
+        exit();
+    }
+    assert(wait() == pid);
+
+    for (i = NOFILEMAX - 1; i > fd; i--)
+        assert(close(i) == 0);
+    assert(dup(fd) == fd + 1);
+    close(fd + 1);
+    close(fd);
+    assert(unlink("fdtest.tmp") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
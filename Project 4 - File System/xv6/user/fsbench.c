@@ -0,0 +1,434 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+
+// File system throughput benchmarks.
+//
+//   fsbench [-p nproc] [-s kb] [test ...]
+//
+// Each test runs in nproc processes at once, each in a directory
+// of its own, fsb0, fsb1 and so on.  A test's setup is done before
+// the clock starts, and all processes start together once every
+// one has finished it.  The time is until the last one is done.
+// With no tests named all are run:
+//
+//   seqwrite   write a kb KB file in 4 KB writes, then fsync
+//   seqread    read it back in 4 KB reads
+//   randwrite  512 byte pwrites at random offsets, then fsync
+//   randread   512 byte preads at random offsets
+//   create     create and unlink empty files, NBATCH at a time
+//   deepopen   open and close a file DEPTH directories down
+//   bigdir     link NBIG names in one directory, open each in
+//              random order, then unlink them all
+//
+// Times come from vnsuptime.
+
+#define NPROCMAX 8
+#define IOSIZE   4096
+#define NRAND    1000   // operations per random I/O test
+#define NBATCH   25     // files created before they are unlinked
+#define NROUND   8
+#define DEPTH    16
+#define NOPEN    1000
+#define NBIG     400
+
+struct result {
+  int ops;     // -1 if the test failed
+  uint bytes;
+};
+
+struct test {
+  char *name;
+  void (*setup)(void);
+  int (*run)(struct result*);
+  void (*cleanup)(void);
+};
+
+static int nproc = 1;
+static int kb = 1024;
+static uint seed;
+static char buf[IOSIZE];
+static char deep[DEPTH*2 + 2];
+
+static uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Set s to prefix followed by n in decimal.
+static char*
+numname(char *s, char *prefix, int n)
+{
+  char tmp[12];
+  int i, j;
+
+  strcpy(s, prefix);
+  j = strlen(s);
+  i = 0;
+  do{
+    tmp[i++] = '0' + n % 10;
+  }while((n /= 10) != 0);
+  while(i > 0)
+    s[j++] = tmp[--i];
+  s[j] = 0;
+  return s;
+}
+
+// Write the kb KB file "big" and fsync it.
+static int
+writebig(struct result *r)
+{
+  int fd, n;
+
+  unlink("big");
+  if((fd = open("big", O_CREATE | O_RDWR)) < 0)
+    return -1;
+  for(n = 0; n < kb * 1024; n += IOSIZE){
+    if(write(fd, buf, IOSIZE) != IOSIZE){
+      close(fd);
+      return -1;
+    }
+    r->ops++;
+    r->bytes += IOSIZE;
+  }
+  fsync(fd);
+  close(fd);
+  return 0;
+}
+
+static void
+mkbig(void)
+{
+  struct result r;
+
+  r.ops = 0;
+  r.bytes = 0;
+  writebig(&r);
+}
+
+static void
+rmbig(void)
+{
+  unlink("big");
+}
+
+static int
+seqwrite(struct result *r)
+{
+  return writebig(r);
+}
+
+static int
+seqread(struct result *r)
+{
+  int fd, n;
+
+  if((fd = open("big", O_RDONLY)) < 0)
+    return -1;
+  while((n = read(fd, buf, IOSIZE)) > 0){
+    r->ops++;
+    r->bytes += n;
+  }
+  close(fd);
+  return n;
+}
+
+static int
+randio(struct result *r, int wr)
+{
+  int fd, i, n;
+  uint off;
+
+  if((fd = open("big", O_RDWR)) < 0)
+    return -1;
+  for(i = 0; i < NRAND; i++){
+    off = rnd() % (kb * 2) * 512;
+    n = wr ? pwrite(fd, buf, 512, off) : pread(fd, buf, 512, off);
+    if(n != 512){
+      close(fd);
+      return -1;
+    }
+    r->ops++;
+    r->bytes += 512;
+  }
+  if(wr)
+    fsync(fd);
+  close(fd);
+  return 0;
+}
+
+static int
+randwrite(struct result *r)
+{
+  return randio(r, 1);
+}
+
+static int
+randread(struct result *r)
+{
+  return randio(r, 0);
+}
+
+static int
+create(struct result *r)
+{
+  char name[16];
+  int i, j, fd;
+
+  for(i = 0; i < NROUND; i++){
+    for(j = 0; j < NBATCH; j++){
+      if((fd = open(numname(name, "f", j), O_CREATE | O_RDWR)) < 0)
+        return -1;
+      close(fd);
+      r->ops++;
+    }
+    for(j = 0; j < NBATCH; j++){
+      if(unlink(numname(name, "f", j)) < 0)
+        return -1;
+      r->ops++;
+    }
+  }
+  return 0;
+}
+
+// Make d/d/.../d, DEPTH deep, with a file f at the bottom, and
+// leave its path in deep.
+static void
+mkdeep(void)
+{
+  int i, fd;
+
+  deep[0] = 0;
+  for(i = 0; i < DEPTH; i++){
+    strcpy(deep + 2*i, "d");
+    mkdir(deep);
+    strcpy(deep + 2*i + 1, "/");
+  }
+  strcpy(deep + 2*DEPTH, "f");
+  if((fd = open(deep, O_CREATE | O_RDWR)) >= 0)
+    close(fd);
+}
+
+static void
+rmdeep(void)
+{
+  int i;
+
+  for(i = DEPTH; i >= 0; i--){
+    deep[2*i + 1] = 0;
+    unlink(deep);
+  }
+}
+
+static int
+deepopen(struct result *r)
+{
+  int i, fd;
+
+  for(i = 0; i < NOPEN; i++){
+    if((fd = open(deep, O_RDONLY)) < 0)
+      return -1;
+    close(fd);
+    r->ops++;
+  }
+  return 0;
+}
+
+static void
+mkbigdir(void)
+{
+  int fd;
+
+  mkdir("bigdir");
+  if((fd = open("bigdir/t", O_CREATE | O_RDWR)) >= 0)
+    close(fd);
+}
+
+static void
+rmbigdir(void)
+{
+  unlink("bigdir/t");
+  unlink("bigdir");
+}
+
+static int
+bigdir(struct result *r)
+{
+  char name[24];
+  int i, fd;
+
+  for(i = 0; i < NBIG; i++){
+    if(link("bigdir/t", numname(name, "bigdir/n", i)) < 0)
+      return -1;
+    r->ops++;
+  }
+  for(i = 0; i < NBIG; i++){
+    if((fd = open(numname(name, "bigdir/n", rnd() % NBIG), O_RDONLY)) < 0)
+      return -1;
+    close(fd);
+    r->ops++;
+  }
+  for(i = 0; i < NBIG; i++){
+    if(unlink(numname(name, "bigdir/n", i)) < 0)
+      return -1;
+    r->ops++;
+  }
+  return 0;
+}
+
+static struct test tests[] = {
+  { "seqwrite",  0,        seqwrite,  rmbig },
+  { "seqread",   mkbig,    seqread,   rmbig },
+  { "randwrite", mkbig,    randwrite, rmbig },
+  { "randread",  mkbig,    randread,  rmbig },
+  { "create",    0,        create,    0 },
+  { "deepopen",  mkdeep,   deepopen,  rmdeep },
+  { "bigdir",    mkbigdir, bigdir,    rmbigdir },
+};
+#define NTEST (sizeof(tests)/sizeof(tests[0]))
+
+// Run t in process i, reporting on res: once when ready to start,
+// once when done.  The start and stop pipes read end of file when
+// the parent says go.
+static void
+child(struct test *t, int i, int start, int stop, int res)
+{
+  struct result r;
+  char dir[8];
+
+  seed = i + 1;
+  chdir(numname(dir, "fsb", i));
+  if(t->setup)
+    t->setup();
+  r.ops = 0;
+  r.bytes = 0;
+  write(res, &r, sizeof(r));
+  read(start, buf, 1);
+  if(t->run(&r) < 0)
+    r.ops = -1;
+  write(res, &r, sizeof(r));
+  read(stop, buf, 1);
+  if(t->cleanup)
+    t->cleanup();
+  exit();
+}
+
+static void
+bench(struct test *t)
+{
+  int start[2], stop[2], res[2], i, n, ok;
+  struct result r, sum;
+  uint64 t0, t1;
+  uint us, kbs;
+
+  if(pipe(start) < 0 || pipe(stop) < 0 || pipe(res) < 0){
+    printf(2, "fsbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < nproc; i++){
+    if((n = fork()) < 0){
+      printf(2, "fsbench: fork failed\n");
+      break;
+    }
+    if(n == 0){
+      close(start[1]);
+      close(stop[1]);
+      close(res[0]);
+      child(t, i, start[0], stop[0], res[1]);
+    }
+  }
+  close(start[0]);
+  close(stop[0]);
+  close(res[1]);
+
+  ok = i == nproc;
+  for(n = 0; n < i; n++)
+    if(read(res[0], &r, sizeof(r)) != sizeof(r))
+      ok = 0;
+  t0 = vnsuptime();
+  close(start[1]);
+  sum.ops = 0;
+  sum.bytes = 0;
+  for(n = 0; n < i; n++){
+    if(read(res[0], &r, sizeof(r)) != sizeof(r) || r.ops < 0){
+      ok = 0;
+      continue;
+    }
+    sum.ops += r.ops;
+    sum.bytes += r.bytes;
+  }
+  t1 = vnsuptime();
+  close(stop[1]);
+  close(res[0]);
+  for(n = 0; n < i; n++)
+    wait();
+
+  if(!ok){
+    printf(1, "%s failed\n", t->name);
+    return;
+  }
+  us = div64(t1 - t0, 1000, 0);
+  if(us == 0)
+    us = 1;
+  kbs = div64(((uint64)sum.bytes * 1000000) >> 10, us, 0);
+  printf(1, "%s %d %d %d %d.%d\n", t->name, sum.ops, us / 1000,
+         (uint)div64((uint64)sum.ops * 1000000, us, 0), kbs / 1024, kbs % 1024 * 10 / 1024);
+}
+
+static void
+usage(void)
+{
+  int i;
+
+  printf(2, "usage: fsbench [-p nproc] [-s kb] [test ...]\ntests:");
+  for(i = 0; i < NTEST; i++)
+    printf(2, " %s", tests[i].name);
+  printf(2, "\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  char dir[8];
+  int i, j, ran;
+
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-p") == 0)
+      nproc = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-s") == 0)
+      kb = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(nproc < 1 || nproc > NPROCMAX || kb < 4)
+    usage();
+  for(j = i; j < argc; j++){
+    for(ran = 0; ran < NTEST; ran++)
+      if(strcmp(argv[j], tests[ran].name) == 0)
+        break;
+    if(ran == NTEST)
+      usage();
+  }
+
+  for(j = 0; j < nproc; j++)
+    mkdir(numname(dir, "fsb", j));
+  printf(1, "TEST OPS MS OPS/S MB/S (%d procs, %d KB files)\n", nproc, kb);
+  for(ran = 0; ran < NTEST; ran++){
+    if(i < argc){
+      for(j = i; j < argc; j++)
+        if(strcmp(argv[j], tests[ran].name) == 0)
+          break;
+      if(j == argc)
+        continue;
+    }
+    bench(&tests[ran]);
+  }
+  for(j = 0; j < nproc; j++)
+    unlink(numname(dir, "fsb", j));
+  exit();
+}
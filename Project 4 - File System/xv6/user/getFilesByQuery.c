@@ -0,0 +1,148 @@
+/* getFilesByQuery matches files against and/or/not expressions
+ * of tag equality, prefix and existence tests, and turns away
+ * malformed queries. */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+#include "tagquery.h"
+
+int ppid;
+char results[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+struct tagterm t[TQMAX];
+int nt;
+
+void
+leaf(int op, char *key, char *value)
+{
+    memset(&t[nt], 0, sizeof(t[nt]));
+    t[nt].op = op;
+    strcpy(t[nt].key, key);
+    if (value) {
+        t[nt].valueLength = strlen(value);
+        memmove(t[nt].value, value, t[nt].valueLength);
+    }
+    nt++;
+}
+
+void
+op(int o)
+{
+    memset(&t[nt], 0, sizeof(t[nt]));
+    t[nt++].op = o;
+}
+
+// Is name among the n results?
+int
+has(int n, char *name)
+{
+    char *p = results;
+    int i;
+
+    for (i = 0; i < n; i++, p += strlen(p) + 1)
+        if (strcmp(p, name) == 0)
+            return 1;
+    return 0;
+}
+
+int
+run(void)
+{
+    int n = getFilesByQuery(t, nt, results, sizeof(results));
+    nt = 0;
+    return n;
+}
+
+void
+mk(char *name, char *type, char *host)
+{
+    int fd = open(name, O_CREATE | O_RDWR);
+
+    assert(fd >= 0);
+    assert(tagFile(fd, "qtype", type, strlen(type)) == 1);
+    assert(tagFile(fd, "qhost", host, strlen(host)) == 1);
+    close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+    int n, fd;
+    ppid = getpid();
+
+    mk("q1", "log", "alpha");
+    mk("q2", "log", "beta");
+    mk("q3", "txt", "alps");
+
+    leaf(TQ_EQ, "qtype", "log");
+    leaf(TQ_EQ, "qhost", "alpha");
+    op(TQ_AND);
+    n = run();
+    assert(n == 1 && has(n, "q1"));
+
+    leaf(TQ_EQ, "qtype", "log");
+    leaf(TQ_EQ, "qhost", "alps");
+    op(TQ_OR);
+    n = run();
+    assert(n == 3 && has(n, "q1") && has(n, "q2") && has(n, "q3"));
+
+    leaf(TQ_EXISTS, "qhost", 0);
+    leaf(TQ_EQ, "qtype", "log");
+    op(TQ_NOT);
+    op(TQ_AND);
+    n = run();
+    assert(n == 1 && has(n, "q3"));
+
+    leaf(TQ_PREFIX, "qhost", "al");
+    n = run();
+    assert(n == 2 && has(n, "q1") && has(n, "q3"));
+
+    // A removed tag no longer matches, even by existence.
+    fd = open("q3", O_RDWR);
+    assert(fd >= 0);
+    assert(removeFileTag(fd, "qhost") == 1);
+    close(fd);
+    leaf(TQ_EXISTS, "qhost", 0);
+    n = run();
+    assert(n == 2 && has(n, "q1") && has(n, "q2"));
+    // A changed value still exists.
+    fd = open("q2", O_RDWR);
+    assert(tagFile(fd, "qhost", "gamma", 5) == 1);
+    close(fd);
+    leaf(TQ_EXISTS, "qhost", 0);
+    n = run();
+    assert(n == 2 && has(n, "q2"));
+
+    // Malformed.
+    leaf(TQ_EQ, "qtype", "log");
+    op(TQ_AND);
+    assert(run() == -1);
+    op(TQ_NOT);
+    assert(run() == -1);
+    leaf(TQ_EQ, "qtype", "log");
+    leaf(TQ_EQ, "qtype", "log");
+    assert(run() == -1);
+    leaf(TQ_EQ, "", "log");
+    assert(run() == -1);
+    leaf(TQ_EQ, "qtype", "log");
+    t[0].op = 99;
+    assert(run() == -1);
+    assert(getFilesByQuery(t, 0, results, sizeof(results)) == -1);
+    assert(getFilesByQuery(t, TQMAX + 1, results, sizeof(results)) == -1);
+
+    unlink("q1");
+    unlink("q2");
+    unlink("q3");
+    leaf(TQ_EXISTS, "qtype", 0);
+    assert(run() == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,107 @@
+/* getFilesByTagPage hands out the files with a tag in pages of
+ * (inode number, name) records, each file exactly once, until the
+ * cursor reaches the end. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "tagquery.h"
+
+#define NFILES 20
+#define PAGE 6
+
+int ppid;
+struct tagrec recs[PAGE];
+uint inums[NFILES];
+int seen[NFILES];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+name(char *buf, int i)
+{
+    strcpy(buf, "pg");
+    buf[2] = '0' + i / 10;
+    buf[3] = '0' + i % 10;
+    buf[4] = 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char buf[8];
+    struct stat st;
+    uint cursor;
+    int i, j, n, fd, pages, total;
+    ppid = getpid();
+
+    for (i = 0; i < NFILES; i++) {
+        name(buf, i);
+        fd = open(buf, O_CREATE | O_RDWR);
+        assert(fd >= 0);
+        assert(fstat(fd, &st) == 0);
+        inums[i] = st.ino;
+        assert(tagFile(fd, "pgkey", i % 2 ? "odd" : "even", i % 2 ? 3 : 4) == 1);
+        close(fd);
+    }
+
+    // Page through the even files.
+    cursor = 0;
+    pages = total = 0;
+    while ((n = getFilesByTagPage("pgkey", "even", 4, recs, PAGE, &cursor)) > 0) {
+        assert(n <= PAGE);
+        pages++;
+        for (j = 0; j < n; j++) {
+            for (i = 0; i < NFILES && inums[i] != recs[j].inum; i++)
+                ;
+            assert(i < NFILES && i % 2 == 0);
+            name(buf, i);
+            assert(strcmp(recs[j].name, buf) == 0);
+            assert(seen[i]++ == 0);
+            total++;
+        }
+    }
+    assert(n == 0 && cursor == TAGCUR_END);
+    assert(total == NFILES / 2);
+    assert(pages == (NFILES / 2 + PAGE - 1) / PAGE);
+    assert(getFilesByTagPage("pgkey", "even", 4, recs, PAGE, &cursor) == 0);
+
+    // A file untagged between pages isn't handed out.
+    cursor = 0;
+    assert(getFilesByTagPage("pgkey", "odd", 3, recs, 1, &cursor) == 1);
+    assert(cursor != TAGCUR_END);
+    for (i = 0; i < NFILES && inums[i] != recs[0].inum; i++)
+        ;
+    assert(i < NFILES && i % 2 == 1);
+    seen[i]++;
+    for (i = 1; i < NFILES; i += 2)
+        if (!seen[i]) {
+            name(buf, i);
+            fd = open(buf, O_RDWR);
+            assert(removeFileTag(fd, "pgkey") == 1);
+            close(fd);
+            break;
+        }
+    total = 1;
+    while ((n = getFilesByTagPage("pgkey", "odd", 3, recs, PAGE, &cursor)) > 0)
+        total += n;
+    assert(total == NFILES / 2 - 1);
+
+    assert(getFilesByTagPage("pgkey", "even", 4, recs, 0, &cursor) == -1);
+    assert(getFilesByTagPage("", "even", 4, recs, PAGE, &cursor) == -1);
+
+    for (i = 0; i < NFILES; i++) {
+        name(buf, i);
+        assert(unlink(buf) == 0);
+    }
+    cursor = 0;
+    assert(getFilesByTagPage("pgkey", "even", 4, recs, PAGE, &cursor) == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,101 @@
+/* getdents_stat lists a directory in batches, with the same
+ * stat for each entry as stat() by path gives. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "param.h"
+#include "direntstat.h"
+
+#define NFILE 50
+#define BATCH 7  // not a divisor of the entry count
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+char seen[NFILE];
+
+// The name of file i.
+void
+name(char *buf, int i)
+{
+    strcpy(buf, "f00");
+    buf[1] = '0' + i / 10;
+    buf[2] = '0' + i % 10;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct direntstat ents[BATCH];
+    struct stat st;
+    char path[32];
+    int fd, i, j, n, total, dot, dotdot, sub;
+
+    assert(mkdir("gdtest") == 0);
+    assert(chdir("gdtest") == 0);
+    for (i = 0; i < NFILE; i++) {
+        name(path, i);
+        fd = open(path, O_CREATE | O_RDWR);
+        assert(fd >= 0);
+        assert(write(fd, "xxxxxxxxxxxxxxxxxxxx", i % 20) == i % 20);
+        close(fd);
+    }
+    assert(mkdir("sub") == 0);
+    // A hole where a deleted entry was.
+    assert(unlink("f07") == 0);
+
+    fd = open(".", O_RDONLY);
+    assert(fd >= 0);
+    total = dot = dotdot = sub = 0;
+    while ((n = getdents_stat(fd, ents, BATCH)) > 0) {
+        assert(n <= BATCH);
+        for (j = 0; j < n; j++) {
+            total++;
+            assert(stat(ents[j].name, &st) == 0);
+            assert(st.type == ents[j].st.type && st.ino == ents[j].st.ino &&
+                   st.dev == ents[j].st.dev && st.size == ents[j].st.size &&
+                   st.nlink == ents[j].st.nlink);
+            if (strcmp(ents[j].name, ".") == 0)
+                dot++;
+            else if (strcmp(ents[j].name, "..") == 0)
+                dotdot++;
+            else if (strcmp(ents[j].name, "sub") == 0) {
+                assert(ents[j].st.type == T_DIR);
+                sub++;
+            } else {
+                i = (ents[j].name[1] - '0') * 10 + ents[j].name[2] - '0';
+                assert(i >= 0 && i < NFILE && i != 7 && !seen[i]);
+                assert(ents[j].st.type == T_FILE && ents[j].st.size == i % 20);
+                seen[i] = 1;
+            }
+        }
+    }
+    assert(n == 0);
+    assert(dot == 1 && dotdot == 1 && sub == 1);
+    assert(total == NFILE - 1 + 3);
+    close(fd);
+
+    // Not a directory.
+    fd = open("f00", O_RDONLY);
+    assert(fd >= 0);
+    assert(getdents_stat(fd, ents, BATCH) < 0);
+    close(fd);
+
+    for (i = 0; i < NFILE; i++) {
+        name(path, i);
+        if (i != 7) {
+            assert(unlink(path) == 0);
+        }
+    }
+    assert(unlink("sub") == 0);
+    assert(chdir("..") == 0);
+    assert(unlink("gdtest") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -1,64 +1,166 @@
 // Simple grep.  Only supports ^ . * $ operators.
+//
+// Input is read READSZ bytes at a time and searched a buffer at
+// a time, not a line at a time.  The pattern's literal part, the
+// longest run of plain characters it starts with (after any ^),
+// is found with Boyer-Moore-Horspool, and only the lines holding
+// it go to the regexp matcher; a pattern that is all literal
+// needs no matcher at all.  A pattern with no literal part, like
+// a*b, is matched against every line.
 
 #include "types.h"
 #include "stat.h"
 #include "user.h"
 
-char buf[1024];
+#define READSZ (32*1024)  // bytes per read
+#define BUFSZ  (64*1024)  // room for a read and a partial line
+
+char buf[BUFSZ+1];
+FILE *out;
+
+char *re;         // the pattern
+char *lit;        // its literal part, nlit bytes at lit
+int nlit;
+int exact;        // the pattern is just lit
+uint skip[256];   // Horspool shift for each byte
+
 int match(char*, char*);
 
 void
-grep(char *pattern, int fd)
+compile(char *pattern)
+{
+  int i;
+
+  re = pattern;
+  lit = re + (re[0] == '^');
+  for(nlit = 0; lit[nlit] && lit[nlit] != '.' && lit[nlit] != '*' &&
+      lit[nlit+1] != '*' && !(lit[nlit] == '$' && lit[nlit+1] == 0); nlit++)
+    ;
+  exact = re[0] != '^' && lit[nlit] == 0;
+  for(i = 0; i < 256; i++)
+    skip[i] = nlit;
+  for(i = 0; i < nlit - 1; i++)
+    skip[(uchar)lit[i]] = nlit - 1 - i;
+}
+
+// The first occurrence of lit in [p, e), or 0.
+char*
+search(char *p, char *e)
+{
+  int i;
+
+  while(e - p >= nlit){
+    for(i = nlit - 1; i >= 0 && p[i] == lit[i]; i--)
+      ;
+    if(i < 0)
+      return p;
+    p += skip[(uchar)p[nlit-1]];
+  }
+  return 0;
+}
+
+// Print line [l, e), which ends in a newline unless it is the
+// last of the input, if the pattern matches it.
+void
+try(char *l, char *e)
+{
+  char c;
+  int m;
+
+  if(!exact){
+    c = e[-1];
+    e[c == '\n' ? -1 : 0] = 0;
+    m = match(re, l);
+    if(c == '\n')
+      e[-1] = c;
+    if(!m)
+      return;
+  }
+  fwrite(l, 1, e - l, out);
+}
+
+// Print the matching lines in [p, e), which is whole lines.
+void
+scan(char *p, char *e)
+{
+  char *q, *l, *nl;
+
+  if(nlit == 0){
+    for(; p < e; p = nl){
+      nl = memchr(p, '\n', e - p);
+      nl = nl ? nl + 1 : e;
+      try(p, nl);
+    }
+    return;
+  }
+  while(p < e && (q = search(p, e)) != 0){
+    for(l = q; l > p && l[-1] != '\n'; l--)
+      ;
+    nl = memchr(q, '\n', e - q);
+    nl = nl ? nl + 1 : e;
+    try(l, nl);
+    p = nl;
+  }
+}
+
+void
+grep(int fd)
 {
   int n, m;
-  char *p, *q;
-  
+  char *nl;
+
   m = 0;
-  while((n = read(fd, buf+m, sizeof(buf)-m)) > 0){
-    m += n;
-    p = buf;
-    while((q = strchr(p, '\n')) != 0){
-      *q = 0;
-      if(match(pattern, p)){
-        *q = '\n';
-        write(1, p, q+1 - p);
-      }
-      p = q+1;
-    }
-    if(p == buf)
+  for(;;){
+    if(m > BUFSZ - READSZ){
+      // A line longer than the buffer: take what we have of it.
+      scan(buf, buf + m);
       m = 0;
-    if(m > 0){
-      m -= p - buf;
-      memmove(buf, p, m);
     }
+    if((n = read(fd, buf + m, READSZ)) <= 0)
+      break;
+    m += n;
+    for(nl = buf + m; nl > buf && nl[-1] != '\n'; nl--)
+      ;
+    if(nl == buf)
+      continue;
+    scan(buf, nl);
+    m -= nl - buf;
+    memmove(buf, nl, m);
   }
+  if(m > 0)
+    scan(buf, buf + m);
 }
 
 int
 main(int argc, char *argv[])
 {
   int fd, i;
-  char *pattern;
   
   if(argc <= 1){
     printf(2, "usage: grep pattern [file ...]\n");
     exit();
   }
-  pattern = argv[1];
+  compile(argv[1]);
+  if((out = fdopen(1, "w")) == 0){
+    printf(2, "grep: no stream for output\n");
+    exit();
+  }
   
   if(argc <= 2){
-    grep(pattern, 0);
+    grep(0);
+    fclose(out);
     exit();
   }
 
   for(i = 2; i < argc; i++){
     if((fd = open(argv[i], 0)) < 0){
       printf(1, "grep: cannot open %s\n", argv[i]);
-      exit();
+      break;
     }
-    grep(pattern, fd);
+    grep(fd);
     close(fd);
   }
+  fclose(out);
   exit();
 }
 
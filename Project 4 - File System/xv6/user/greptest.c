@@ -0,0 +1,114 @@
+/* grep finds the same lines with a literal pattern, a regexp with
+ * a literal part and one without, across read boundaries, and
+ * with a last line that has no newline. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NLINE 6000  // about 100K of input: several reads
+
+char buf[128];
+char out[8192];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Run grep pattern grep.in into grep.out; return what it wrote,
+// nul-terminated, in out.
+int
+grep(char *pattern)
+{
+    char *argv[] = { "grep", pattern, "grep.in", 0 };
+    int fd, n, pid;
+
+    unlink("grep.out");
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(1);
+        assert(open("grep.out", O_CREATE | O_RDWR) == 1);
+        exec("grep", argv);
+        printf(2, "greptest: exec grep failed\n");
+        exit();
+    }
+    assert(wait() == pid);
+    fd = open("grep.out", O_RDONLY);
+    assert(fd >= 0);
+    n = read(fd, out, sizeof(out) - 1);
+    assert(n >= 0 && n < sizeof(out) - 1);
+    out[n] = 0;
+    close(fd);
+    return n;
+}
+
+// Lines in out.
+int
+lines(void)
+{
+    char *p;
+    int n;
+
+    n = 0;
+    for (p = out; (p = strchr(p, '\n')) != 0; p++)
+        n++;
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int fd, i, n;
+
+    unlink("grep.in");
+    fd = open("grep.in", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < NLINE; i++) {
+        strcpy(buf, "row ....... filler text\n");
+        buf[4] = 'a' + i % 26;
+        if (i % 500 == 7)
+            memmove(buf + 5, "needle", 6);
+        if (i % 1000 == 3)
+            memmove(buf + 5, "zzzzz", 5);
+        n = strlen(buf);
+        assert(write(fd, buf, n) == n);
+    }
+    assert(write(fd, "last needle", 11) == 11);
+    close(fd);
+
+    // All literal.
+    grep("needle");
+    assert(lines() == NLINE / 500);
+    assert(strcmp(out + strlen(out) - 11, "last needle") == 0);
+    out[25] = 0;
+    assert(strcmp(out, "row hneedle. filler text\n") == 0);
+
+    // A literal part, then the matcher.
+    grep("ow .needle");
+    assert(lines() == NLINE / 500);
+    grep("^row .need.*text$");
+    assert(lines() == NLINE / 500);
+    grep("^last");
+    assert(strcmp(out, "last needle") == 0);
+    grep("needle$");
+    assert(strcmp(out, "last needle") == 0);
+
+    // No literal part.
+    grep("z*zzzz");
+    assert(lines() == NLINE / 1000);
+    grep(".*dle ");
+    assert(lines() == 0);
+
+    // Many lines.
+    grep("^row a");
+    assert(lines() == (NLINE + 25) / 26);
+
+    unlink("grep.in");
+    unlink("grep.out");
+    printf(1, "TEST PASSED\n");
+    exit();
+}
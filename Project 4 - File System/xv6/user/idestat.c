@@ -0,0 +1,23 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "idestat.h"
+
+int
+main(void)
+{
+  struct idestat st;
+
+  if(idestat(&st) < 0){
+    printf(2, "idestat: failed\n");
+    exit();
+  }
+  printf(1, "commands %d sectors %d queued %d max queued %d\n",
+         st.ncmd, st.nsect, st.depth, st.maxdepth);
+  if(st.ncmd > 0)
+    printf(1, "avg seek %d sectors avg sectors/command %d\n",
+           st.seek / st.ncmd, st.nsect / st.ncmd);
+  if(st.nsect > 0)
+    printf(1, "avg queue depth %d\n", st.depthsum / st.nsect);
+  exit();
+}
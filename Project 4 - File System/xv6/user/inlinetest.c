@@ -0,0 +1,98 @@
+/* Small files live in the inode and read without the buffer
+ * cache, and move out to a block when they grow; the first few
+ * tags live in the inode and move out to a tag block when an
+ * insert doesn't fit. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "bcachestat.h"
+
+char buf[512];
+char big[200];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Are the n bytes at p those at q?
+int
+same(char *p, char *q, int n)
+{
+    while (n-- > 0)
+        if (*p++ != *q++)
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct bcachestat s0, s1;
+    struct stat st;
+    struct Key keys[8];
+    char results[64];
+    int fd, i;
+
+    fd = open("inlinetest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+
+    // A tiny file, with a gap that reads as zeros.
+    assert(write(fd, "hello", 5) == 5);
+    assert(pwrite(fd, "xyz", 3, 40) == 3);
+    assert(fstat(fd, &st) == 0 && st.size == 43);
+    assert(bcachestat(&s0) == 0);
+    memset(buf, 'q', sizeof(buf));
+    assert(pread(fd, buf, sizeof(buf), 0) == 43);
+    assert(bcachestat(&s1) == 0);
+    assert(s1.hits == s0.hits && s1.misses == s0.misses);
+    assert(same(buf, "hello", 5) && buf[5] == 0 && buf[39] == 0);
+    assert(same(buf + 40, "xyz", 3));
+
+    // Shrinking zeroes the tail; growing back reads zeros.
+    assert(ftruncate(fd, 3) == 0);
+    assert(ftruncate(fd, 10) == 0);
+    assert(pread(fd, buf, sizeof(buf), 0) == 10);
+    assert(same(buf, "hel", 3) && buf[3] == 0 && buf[9] == 0);
+
+    // Growing past the inode moves it to a block.
+    memset(buf, 'b', sizeof(buf));
+    assert(pwrite(fd, buf, 100, 20) == 100);
+    assert(pread(fd, buf, sizeof(buf), 0) == 120);
+    assert(same(buf, "hel", 3) && buf[3] == 0 && buf[19] == 0);
+    assert(buf[20] == 'b' && buf[119] == 'b');
+
+    // A few small tags fit in the inode.
+    assert(tagFile(fd, "a", "1", 1) == 1);
+    assert(tagFile(fd, "bb", "22", 2) == 1);
+    assert(tagFile(fd, "ccc", "333", 3) == 1);
+    assert(getFileTag(fd, "bb", buf, sizeof(buf)) == 2 && same(buf, "22", 2));
+    assert(getFilesByTag("ccc", "333", 3, results, sizeof(results)) == 1);
+
+    // One that doesn't moves them all to a tag block.
+    memset(big, 'v', sizeof(big));
+    assert(tagFile(fd, "big", big, sizeof(big)) == 1);
+    assert(getAllTags(fd, keys, 8) == 4);
+    assert(getFileTag(fd, "a", buf, sizeof(buf)) == 1 && buf[0] == '1');
+    assert(getFileTag(fd, "ccc", buf, sizeof(buf)) == 3 && same(buf, "333", 3));
+    assert(getFileTag(fd, "big", buf, sizeof(buf)) == sizeof(big));
+    for (i = 0; i < sizeof(big); i++)
+        assert(buf[i] == 'v');
+    assert(removeFileTag(fd, "bb") == 1);
+    assert(getAllTags(fd, keys, 8) == 3);
+    close(fd);
+
+    // Tags on a file survive it being closed and reopened.
+    fd = open("inlinetest.tmp", O_RDONLY);
+    assert(fd >= 0);
+    assert(getFileTag(fd, "a", buf, sizeof(buf)) == 1 && buf[0] == '1');
+    close(fd);
+
+    assert(unlink("inlinetest.tmp") == 0);
+    assert(getFilesByTag("ccc", "333", 3, results, sizeof(results)) == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,50 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "traps.h"
+#include "IntrStat.h"
+
+// Print how many of each IRQ each CPU has taken, and the CPU
+// the IO APIC sends it to.  "intrstat irq cpu" first sends irq
+// to cpu instead.
+int
+main(int argc, char *argv[])
+{
+  static struct IntrStat table[NIRQ];
+  int i, j, n, ncpu;
+
+  if(argc == 3 && irqaffinity(atoi(argv[1]), atoi(argv[2])) < 0){
+    printf(2, "intrstat: can't send irq %s to cpu %s\n", argv[1], argv[2]);
+    exit();
+  }
+  if(argc != 1 && argc != 3){
+    printf(2, "usage: intrstat [irq cpu]\n");
+    exit();
+  }
+  if((n = intrstat(table, NIRQ)) < 0){
+    printf(2, "intrstat: intrstat failed\n");
+    exit();
+  }
+  // CPUs that have taken any interrupt; every CPU has ticked.
+  for(ncpu = NCPU; ncpu > 0 && table[IRQ_TIMER].count[ncpu-1] == 0; ncpu--)
+    ;
+  printf(1, "IRQ CPU");
+  for(j = 0; j < ncpu; j++)
+    printf(1, " CPU%d", j);
+  printf(1, "\n");
+  for(i = 0; i < n; i++){
+    for(j = 0; j < ncpu && table[i].count[j] == 0; j++)
+      ;
+    if(j == ncpu && table[i].cpu < 0)
+      continue;
+    if(table[i].cpu < 0)
+      printf(1, "%d -", i);
+    else
+      printf(1, "%d %d", i, table[i].cpu);
+    for(j = 0; j < ncpu; j++)
+      printf(1, " %d", table[i].count[j]);
+    printf(1, "\n");
+  }
+  exit();
+}
@@ -0,0 +1,92 @@
+/* intrstat counts interrupts by CPU, and irqaffinity moves
+ * the disk's to another CPU. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+#include "traps.h"
+#include "IntrStat.h"
+
+int ppid;
+struct IntrStat table[NIRQ];
+char buf[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Disk interrupts so far on CPU c.
+uint
+ide(int c)
+{
+    assert(intrstat(table, NIRQ) == NIRQ);
+    return table[IRQ_IDE].count[c];
+}
+
+// Write a file and sync it, to take some disk interrupts.
+void
+disk(void)
+{
+    int fd, i;
+
+    fd = open("intrtest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < 20; i++)
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    assert(fsync(fd) == 0);
+    close(fd);
+    unlink("intrtest.tmp");
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    uint before, t;
+    int i, n;
+
+    assert(intrstat(table, -1) == -1);
+    assert(intrstat(table, 0) == 0);
+    assert(intrstat(table, NIRQ + 5) == NIRQ);
+
+    // Some CPU keeps time.
+    t = 0;
+    for (i = 0; i < NCPU; i++)
+        t += table[IRQ_TIMER].count[i];
+    sleep(2);
+    assert(intrstat(table, NIRQ) == NIRQ);
+    for (i = 0; i < NCPU; i++)
+        t -= table[IRQ_TIMER].count[i];
+    assert(t != 0);
+
+    assert(irqaffinity(-1, 0) == -1);
+    assert(irqaffinity(NIRQ, 0) == -1);
+    assert(irqaffinity(IRQ_IDE, -1) == -1);
+    assert(irqaffinity(IRQ_IDE, NCPU) == -1);
+    assert(intrstat(table, NIRQ) == NIRQ);
+    if (table[IRQ_IDE].cpu < 0) {
+        // A uniprocessor has no IO APIC to route with.
+        assert(irqaffinity(IRQ_IDE, 0) == -1);
+        printf(1, "TEST PASSED\n");
+        exit();
+    }
+    assert(irqaffinity(IRQ_TIMER, 0) == -1);
+
+    // Disk interrupts follow the route, to each CPU in turn.
+    for (n = 0; n < NCPU && irqaffinity(IRQ_IDE, n) == 0; n++) {
+        assert(intrstat(table, NIRQ) == NIRQ);
+        assert(table[IRQ_IDE].cpu == n);
+        before = ide(n);
+        disk();
+        assert(ide(n) > before);
+    }
+    // That leaves it on the last CPU, where ideinit put it.
+    assert(n > 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,92 @@
+/* Children that fill their heaps with the same contents end up
+ * sharing one copy of each page once ksm is on, and still see
+ * their own data, and can write it, afterwards. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ksm.h"
+
+#define PGSIZE 4096
+#define NCHILD 4
+#define NPG    32
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Word j of page i.
+uint
+word(int i, int j)
+{
+    return i*1000003 + j*7 + 1;
+}
+
+void
+child(int ready, int go)
+{
+    uint *p;
+    char c;
+    int i, j;
+
+    p = (uint*)sbrk(NPG*PGSIZE);
+    assert(p != (uint*)-1);
+    for (i = 0; i < NPG; i++)
+        for (j = 0; j < PGSIZE/4; j++)
+            p[i*PGSIZE/4 + j] = word(i, j);
+    assert(write(ready, "r", 1) == 1);
+    assert(read(go, &c, 1) == 1);
+
+    for (i = 0; i < NPG; i++)
+        for (j = 0; j < PGSIZE/4; j += 61)
+            assert(p[i*PGSIZE/4 + j] == word(i, j));
+    // Writes copy the shared page; the others keep theirs.
+    for (i = 0; i < NPG; i++)
+        p[i*PGSIZE/4] = getpid();
+    for (i = 0; i < NPG; i++)
+        assert(p[i*PGSIZE/4] == getpid() && p[i*PGSIZE/4 + 1] == word(i, 1));
+    exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct ksmstat s0, s1;
+    int ready[2], go[2];
+    int i, t, was;
+    char c;
+
+    assert(pipe(ready) == 0 && pipe(go) == 0);
+    for (i = 0; i < NCHILD; i++) {
+        int pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+            child(ready[1], go[0]);
+    }
+    for (i = 0; i < NCHILD; i++)
+        assert(read(ready[0], &c, 1) == 1);
+
+    // Wait for ksmd to merge the copies.
+    was = ksm(1, &s0);
+    assert(was >= 0);
+    for (t = 0; t < 100; t++) {
+        assert(ksm(-1, &s1) == 1);
+        if (s1.merged - s0.merged >= (NCHILD-1)*NPG)
+            break;
+        sleep(10);
+    }
+    printf(1, "ksmtest: %d pages merged, %d stable\n",
+           s1.merged - s0.merged, s1.stable);
+    assert(s1.on);
+    assert(s1.merged - s0.merged >= (NCHILD-1)*NPG);
+
+    for (i = 0; i < NCHILD; i++)
+        assert(write(go[1], "g", 1) == 1);
+    for (i = 0; i < NCHILD; i++)
+        assert(wait() > 0);
+    ksm(was, 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,97 @@
+/* One read of the kstat device gives every kernel counter as a
+ * "name value" line, the counters move between reads, and small
+ * reads come to an end. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "syscall.h"
+
+#define KSTATSIZE 16384
+
+char buf[KSTATSIZE + 1];
+char piece[100];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Read all of kstat into buf in one read; returns its length.
+int
+snapshot(void)
+{
+    int fd, n;
+
+    fd = open("/kstat", O_RDONLY);
+    assert(fd >= 0);
+    n = read(fd, buf, KSTATSIZE);
+    assert(n > 0 && n < KSTATSIZE);
+    buf[n] = 0;
+    assert(read(fd, buf + n, KSTATSIZE - n) == 0);
+    close(fd);
+    return n;
+}
+
+// The value of counter name in buf, or -1 if it isn't there.
+int
+value(char *name)
+{
+    char *p;
+    int i;
+
+    for (p = buf; *p; p = strchr(p, '\n') + 1) {
+        for (i = 0; name[i] && p[i] == name[i]; i++)
+            ;
+        if (name[i] == 0 && p[i] == ' ')
+            return atoi(p + i + 1);
+    }
+    return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct stat st;
+    char *p, *q;
+    int fd, n, total, before;
+
+    assert(stat("/kstat", &st) == 0 && st.type == T_DEV);
+
+    // Every line is one name and a number.
+    n = snapshot();
+    printf(1, "kstattest: %d bytes\n", n);
+    assert(buf[n-1] == '\n');
+    for (p = buf; *p; p = q + 1) {
+        q = strchr(p, '\n');
+        assert(q != 0);
+        p = strchr(p, ' ');
+        assert(p != 0 && p < q && p[1] >= '0' && p[1] <= '9');
+    }
+    assert(value("kmem.free") > 0);
+    assert(value("bcache.nbuf") > 0);
+    assert(value("lock.ptable.acquires") > 0);
+    assert(value("kmem.pcache.calls") >= 0);
+    assert(value("no.such") == -1);
+
+    // System calls are counted between reads.
+    assert(SYS_read == 6);
+    before = value("syscall.6.calls");
+    assert(before > 0);
+    snapshot();
+    assert(value("syscall.6.calls") > before);
+
+    // Small reads see all of it, then the end.
+    fd = open("/kstat", O_RDONLY);
+    assert(fd >= 0);
+    total = 0;
+    while ((n = read(fd, piece, sizeof(piece))) > 0)
+        total += n;
+    assert(n == 0 && total > 0);
+    close(fd);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
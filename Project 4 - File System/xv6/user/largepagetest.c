@@ -0,0 +1,98 @@
+/* heap touched a whole aligned 4 MB at a time gets one 4 MB page,
+ * with no page table: one fault maps all of it, system calls and
+ * fork see it, and shrinking frees it. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+#define LPG (4*1024*1024)
+
+int ppid;
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// This process's entry.
+struct ProcessInfo*
+me(void)
+{
+    int i, n, pid;
+
+    pid = getpid();
+    n = getprocs(table);
+    assert(n > 0 && n <= NPROC);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return &table[i];
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct ProcessInfo before, *p;
+    char *a;
+    uint cur;
+    int i, fd[2];
+    ppid = getpid();
+
+    // Two aligned 4 MB stretches of heap.
+    cur = (uint)sbrk(0);
+    a = sbrk(LPG - cur % LPG + 2*LPG);
+    assert(a != (char*)-1);
+    a += LPG - cur % LPG;
+
+    // One touch maps all of the first.
+    before = *me();
+    a[0] = 1;
+    p = me();
+    assert(p->rss >= before.rss + 1024);
+    assert(p->ptpages == before.ptpages);
+    for (i = 4096; i < LPG; i += 4096)
+        a[i] = i / 4096;
+    assert(me()->minflt < before.minflt + 10);
+
+    // A system call writes across into the second.
+    assert(pipe(fd) == 0);
+    assert(write(fd[1], "large", 6) == 6);
+    assert(read(fd[0], a + LPG - 3, 6) == 6);
+    assert(strcmp(a + LPG - 3, "large") == 0);
+    assert(me()->ptpages == before.ptpages);
+    close(fd[0]);
+    close(fd[1]);
+
+    // A child has its own copy.
+    if (fork() == 0) {
+        for (i = 4096; i < LPG; i += 4096)
+            assert(a[i] == (char)(i / 4096));
+        a[4096] = 99;
+        exit();
+    }
+    assert(wait() > 0);
+    assert(a[4096] == 1);
+
+    // Shrinking to the first frees the second.
+    before = *me();
+    assert(sbrk(-LPG) != (char*)-1);
+    p = me();
+    assert(p->rss + 1024 <= before.rss);
+    assert(a[LPG - 4096] == (char)(LPG/4096 - 1));
+
+    // Shrinking into the first keeps it until all of it goes.
+    assert(sbrk(-LPG/2) != (char*)-1);
+    assert(a[0] == 1);
+    before = *me();
+    assert(sbrk(-LPG/2) != (char*)-1);
+    assert(me()->rss + 1024 <= before.rss);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,51 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "vdso.h"
+#include "LatStat.h"
+
+// "latency cmd [arg ...]" runs cmd with the kernel's latency
+// tracer on and then prints the longest stretches the kernel
+// spent with interrupts off ("cli") or holding a lock, longest
+// first, as
+//   usecs count name pc pc ...
+// where count is how often that call stack made the list and
+// the pcs are the stack where it began, for addr2line on the
+// host.  With no cmd it prints what the tracer has so far.
+
+static struct LatStat table[NLATENCY];
+
+int
+main(int argc, char *argv[])
+{
+  struct vdata *v = (struct vdata*)VDSO;
+  struct LatStat *s;
+  int i, j, n, pid;
+
+  if(argc > 1){
+    latencyctl(1);
+    if((pid = fork()) == 0){
+      exec(argv[1], argv + 1);
+      printf(2, "latency: exec %s failed\n", argv[1]);
+      exit();
+    }
+    while(pid > 0 && wait() != pid)
+      ;
+    latencyctl(0);
+  }
+  if((n = getlatency(table, NLATENCY)) < 0){
+    printf(2, "latency: getlatency failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    s = &table[i];
+    printf(1, "%d %d %s", (uint)div64(s->max * 1000, v->tsckhz, 0),
+           s->count, s->name);
+    for(j = 0; j < 10 && s->pcs[j]; j++)
+      printf(1, " %x", s->pcs[j]);
+    printf(1, "\n");
+  }
+  exit();
+}
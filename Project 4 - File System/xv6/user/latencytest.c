@@ -0,0 +1,68 @@
+/* The latency tracer reports the longest stretches with
+ * interrupts off and with locks held, longest first, each with
+ * the kernel call stack that began it. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "LatStat.h"
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+struct LatStat table[NLATENCY];
+char buf[512];
+
+int
+main(int argc, char *argv[])
+{
+    int i, fd, n, cli, pid;
+
+    assert(getlatency(table, -1) == -1);
+    latencyctl(0);
+    assert(latencyctl(1) == 0);
+    assert(getlatency(table, NLATENCY) == 0);
+
+    // Work that takes locks and turns interrupts off.
+    fd = open("latency.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < 64; i++)
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    close(fd);
+    assert(unlink("latency.tmp") == 0);
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0)
+        exit();
+    assert(wait() == pid);
+
+    assert(latencyctl(0) == 1);
+    n = getlatency(table, NLATENCY);
+    assert(n > 0 && n <= NLATENCY);
+    cli = 0;
+    for (i = 0; i < n; i++) {
+        assert(table[i].count > 0);
+        assert(table[i].max > 0);
+        assert(table[i].pcs[0] != 0);
+        if (i > 0) {
+            assert(table[i].max <= table[i-1].max);
+        }
+        if (strcmp(table[i].name, "cli") == 0)
+            cli = 1;
+    }
+    assert(cli);
+    printf(1, "latencytest: longest %s, %d cycles\n", table[0].name, (uint)table[0].max);
+
+    // Off, the table stays as it was.
+    assert(getlatency(table, 1) == 1);
+    sleep(2);
+    assert(getlatency(table + 1, 1) == 1);
+    assert(table[1].max == table[0].max);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,54 @@
+/* sbrk'd pages are allocated, zeroed, on first touch. */
+#include "types.h"
+#include "user.h"
+
+#define N (64*4096)
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd[2], i;
+    char *a;
+
+    a = sbrk(N);
+    assert(a != (char*)-1);
+    // Touch every fourth page; the rest stay unallocated.
+    for (i = 0; i < N; i += 4*4096) {
+        assert(a[i] == 0);
+        a[i] = 'x';
+    }
+    // The kernel faulting in a page for a system call.
+    assert(pipe(fd) == 0);
+    assert(write(fd[1], "hello", 5) == 5);
+    assert(read(fd[0], a + 4096 + 100, 5) == 5);
+    assert(a[4096 + 100] == 'h');
+    assert(write(fd[1], a + 2*4096, 3) == 3);  // untouched: zeroes
+    assert(read(fd[0], a + 3*4096 + 10, 3) == 3);
+    assert(a[3*4096 + 10] == 0);
+    // A child sees both the touched and the lazy pages.
+    if (fork() == 0) {
+        assert(a[0] == 'x' && a[4*4096] == 'x' && a[4096 + 104] == 'o');
+        assert(a[5*4096] == 0);
+        a[5*4096] = 'y';
+        exit();
+    }
+    wait();
+    assert(a[5*4096] == 0);
+    // Shrinking drops touched pages; growing again gives zeroes.
+    assert(sbrk(-N) == a + N);
+    assert(sbrk(N) == a);
+    assert(a[0] == 0 && a[4*4096] == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,32 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "LockStat.h"
+
+// Print the lock counters, the locks that waited longest first.
+// Cycle counts are in units of 1024 cycles.
+int
+main(void)
+{
+  static struct LockStat table[NLOCKSTAT];
+  struct LockStat t;
+  int i, j, n;
+
+  if((n = lockstat(table, NLOCKSTAT)) < 0){
+    printf(2, "lockstat: lockstat failed\n");
+    exit();
+  }
+  for(i = 1; i < n; i++){
+    t = table[i];
+    for(j = i; j > 0 && table[j-1].spin < t.spin; j--)
+      table[j] = table[j-1];
+    table[j] = t;
+  }
+  printf(1, "NAME LOCKS ACQUIRES CONTENDED SPIN MAXHOLD\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%s %d %d %d %d %d\n", table[i].name, table[i].nlocks,
+           table[i].acquires, table[i].contended,
+           (uint)(table[i].spin >> 10), (uint)(table[i].maxhold >> 10));
+  exit();
+}
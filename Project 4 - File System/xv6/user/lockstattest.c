@@ -0,0 +1,68 @@
+/* lockstat reports counters for the kernel's spinlocks. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "LockStat.h"
+
+int ppid;
+struct LockStat table[NLOCKSTAT];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// The counters for locks called name.
+struct LockStat*
+find(char *name)
+{
+    int i, n;
+
+    n = lockstat(table, NLOCKSTAT);
+    assert(n > 0 && n <= NLOCKSTAT);
+    for (i = 0; i < n; i++)
+        if (strcmp(table[i].name, name) == 0)
+            return &table[i];
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct LockStat *s;
+    uint before;
+    int i, fd[2];
+
+    assert(lockstat(table, -1) == -1);
+    assert(lockstat(table, 0) == 0);
+
+    s = find("ptable");
+    assert(s->nlocks == 1);
+    assert(s->acquires > 0);
+    assert(s->contended <= s->acquires);
+    assert(s->maxhold > 0);
+
+    // Every pipe's lock adds to the "pipe" entry.
+    before = 0;
+    for (i = 0; i < 3; i++) {
+        assert(pipe(fd) == 0);
+        close(fd[0]);
+        close(fd[1]);
+        s = find("pipe");
+        assert(s->nlocks > before);
+        before = s->nlocks;
+    }
+
+    s = find("ptable");
+    before = s->acquires;
+    sleep(1);
+    assert(find("ptable")->acquires > before);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -2,6 +2,8 @@
 #include "stat.h"
 #include "user.h"
 #include "fs.h"
+#include "param.h"
+#include "direntstat.h"
 
 char*
 fmtname(char *path)
@@ -25,9 +27,9 @@ fmtname(char *path)
 void
 ls(char *path)
 {
+  static struct direntstat ents[NDSTAT];
   char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n;
   struct stat st;
   
   if((fd = open(path, 0)) < 0){
@@ -54,16 +56,11 @@ ls(char *path)
     strcpy(buf, path);
     p = buf+strlen(buf);
     *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
-      if(stat(buf, &st) < 0){
-        printf(1, "ls: cannot stat %s\n", buf);
-        continue;
+    while((n = getdents_stat(fd, ents, NDSTAT)) > 0){
+      for(i = 0; i < n; i++){
+        strcpy(p, ents[i].name);
+        printf(1, "%s %d %d %d\n", fmtname(buf), ents[i].st.type, ents[i].st.ino, ents[i].st.size);
       }
-      printf(1, "%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
     break;
   }
@@ -0,0 +1,97 @@
+/* madvise: DONTNEED frees heap and mapped pages, which come back
+ * as zeroes and as the file's data; WILLNEED and SEQUENTIAL leave
+ * the data as it was; bad ranges and advice are refused. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "mman.h"
+#include "ProcessInfo.h"
+
+#define O_RDWR    0x002
+#define O_CREATE  0x200
+
+#define N 16
+#define FSZ (20*4096 + 100)
+
+int ppid;
+struct ProcessInfo table[NPROC];
+char buf[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// This process's resident pages.
+uint
+rss(void)
+{
+    int i, n, pid;
+
+    pid = getpid();
+    n = getprocs(table);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return table[i].rss;
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *a, *p;
+    uint before;
+    int fd, i;
+    ppid = getpid();
+
+    // Heap: freed now, zeroes on the next touch.
+    a = sbrk(0);
+    a = sbrk(4096 - (uint)a % 4096 + N*4096);
+    assert(a != (char*)-1);
+    a += 4096 - (uint)a % 4096;
+    for (i = 0; i < N*4096; i += 4096)
+        a[i] = 1;
+    before = rss();
+    assert(madvise(a, N*4096, MADV_DONTNEED) == 0);
+    assert(rss() + N <= before);
+    for (i = 0; i < N*4096; i += 4096)
+        assert(a[i] == 0);
+    assert(madvise(a, N*4096, MADV_WILLNEED) == 0);
+
+    // A mapped file.
+    fd = open("madvise.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < FSZ; i += sizeof(buf)) {
+        memset(buf, 'a' + i / 4096, sizeof(buf));
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    }
+    p = mmap(fd, 0, FSZ, PROT_READ);
+    assert(p != (char*)-1);
+    close(fd);
+    assert(madvise(p, FSZ, MADV_WILLNEED) == 0);
+    assert(madvise(p, FSZ, MADV_SEQUENTIAL) == 0);
+    for (i = 0; i < FSZ; i += 512)
+        assert(p[i] == 'a' + i / 4096);
+    before = rss();
+    assert(madvise(p + 4096, 8*4096, MADV_DONTNEED) == 0);
+    assert(rss() + 8 <= before);
+    assert(madvise(p, FSZ, MADV_NORMAL) == 0);
+    for (i = 0; i < FSZ; i += 512)
+        assert(p[i] == 'a' + i / 4096);
+
+    // Bad ones.
+    assert(madvise(a + 1, 4096, MADV_DONTNEED) == -1);
+    assert(madvise(a, 0, MADV_DONTNEED) == -1);
+    assert(madvise(a, 4096, 99) == -1);
+    assert(madvise(p, FSZ, 99) == -1);
+    assert(madvise(p, FSZ + 8192, MADV_WILLNEED) == -1);
+    assert(madvise(sbrk(0) + 8192, 4096, MADV_DONTNEED) == -1);
+
+    unlink("madvise.tmp");
+    printf(1, "TEST PASSED\n");
+    exit();
+}
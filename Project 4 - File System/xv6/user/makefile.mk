@@ -2,6 +2,7 @@
 # user programs
 USER_PROGS := \
 	cat\
+	cp\
 	echo\
 	forktest\
 	grep\
@@ -29,6 +30,80 @@ USER_PROGS := \
 	getAllTags1\
 	getFileTag\
 	getFilesByTag\
+	getFilesByQuery\
+	getFilesByTagPage\
+	tagFileBatch\
+	preadv\
+	mmaptest\
+	madvisetest\
+	sendfiletest\
+	copytest\
+	splicetest\
+	vmsplicetest\
+	cowtest\
+	largepagetest\
+	stacktest\
+	lazytest\
+	exectest\
+	bcachestat\
+	idestat\
+	ps\
+	top\
+	pstest\
+	mlfqtest\
+	affinitytest\
+	sleeptest\
+	proctest\
+	rcutest\
+	reftest\
+	lockstat\
+	lockstattest\
+	preadtest\
+	stdiotest\
+	stringtest\
+	syscalltest\
+	copyintest\
+	ringtest\
+	sysstat\
+	sysstattest\
+	vdsotest\
+	clocktest\
+	uptimetest\
+	intrstat\
+	intrtest\
+	prof\
+	proftest\
+	trace\
+	latency\
+	tracetest\
+	spawntest\
+	templatetest\
+	fsbench\
+	membench\
+	tagbench\
+	sparsetest\
+	inlinetest\
+	scantest\
+	agtest\
+	fdtest\
+	polltest\
+	ramfstest\
+	udptest\
+	pcachetest\
+	swaptest\
+	shrinktest\
+	ksmtest\
+	getdentstest\
+	readlinetest\
+	greptest\
+	wctest\
+	toptest\
+	kstattest\
+	perftest\
+	latencytest\
+	schedhisttest\
+	aiotest\
+	notifytest\
 
 USER_PROGS := $(addprefix user/, $(USER_PROGS))
 
@@ -78,14 +153,15 @@ USER_LDFLAGS += -m $(shell $(LD) -V | grep elf_i386 2>/dev/null)
 # do not link with the host standard library files
 USER_LDFLAGS += -nostdlib
 
-# use simple contiguous section layout and do not use dynamic linking
-USER_LDFLAGS += --omagic
+# lay segments out so that each one's file offset and address
+# agree modulo the page size, so exec can map page cache pages
+USER_LDFLAGS += -z max-page-size=4096 -z noseparate-code
 
 # where program execution should begin
 USER_LDFLAGS += --entry=main
 
-# location in memory where the program will be loaded
-USER_LDFLAGS += --section-start=.text=0x0
+# location in memory where the program will be loaded (USERBASE)
+USER_LDFLAGS += -Ttext-segment=0x40000000
 
 user/bin:
 	mkdir -p user/bin
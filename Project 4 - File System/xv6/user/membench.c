@@ -0,0 +1,169 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "vdso.h"
+
+// Memory subsystem benchmarks.  Prints the cost of each operation
+// in nanoseconds, from rdtsc and the vdso's TSC rate:
+//
+//   sbrk      growing the heap a page at a time, the pages lazy
+//   touch     the fault on the first write to such a page
+//   malloc N  a malloc and a free of N bytes, NALLOC at a time
+//   fork M    fork, exit and wait with M MB of the parent touched,
+//             median of NFORK
+//   kalloc P  P processes at once each growing, touching and
+//             shrinking NKPAGE pages NKROUND times; the cost is per
+//             page over all of them, so it falls as CPUs are added
+//             until kalloc's lock is the limit
+
+#define PGSIZE  4096
+#define NPAGE   1024
+#define NALLOC  256
+#define NFORK   51
+#define NKPAGE  64
+#define NKROUND 50
+#define NPROCMAX 8
+
+static uint samples[NFORK];
+static char *ptrs[NALLOC];
+
+static uint
+ns(uint64 cycles)
+{
+  struct vdata *v = (struct vdata*)VDSO;
+
+  return div64(cycles * 1000000, v->tsckhz, 0);
+}
+
+static void
+fail(char *msg)
+{
+  printf(2, "membench: %s failed\n", msg);
+  exit();
+}
+
+static void
+sbrkbench(void)
+{
+  uint64 t0, t1, t2;
+  char *a;
+  int i;
+
+  a = sbrk(0);
+  t0 = rdtsc();
+  for(i = 0; i < NPAGE; i++)
+    if(sbrk(PGSIZE) == (char*)-1)
+      fail("sbrk");
+  t1 = rdtsc();
+  for(i = 0; i < NPAGE; i++)
+    a[i * PGSIZE] = 1;
+  t2 = rdtsc();
+  if(sbrk(-NPAGE * PGSIZE) == (char*)-1)
+    fail("sbrk shrink");
+  printf(1, "sbrk %d\n", ns(t1 - t0) / NPAGE);
+  printf(1, "touch %d\n", ns(t2 - t1) / NPAGE);
+}
+
+static void
+mallocbench(uint size)
+{
+  uint64 t0;
+  int i, round;
+
+  t0 = rdtsc();
+  for(round = 0; round < 16; round++){
+    for(i = 0; i < NALLOC; i++)
+      if((ptrs[i] = malloc(size)) == 0)
+        fail("malloc");
+    for(i = 0; i < NALLOC; i++)
+      free(ptrs[i]);
+  }
+  printf(1, "malloc %d %d\n", size, ns(rdtsc() - t0) / (16 * NALLOC));
+}
+
+static void
+forkbench(int mb)
+{
+  uint64 t0;
+  uint x;
+  char *a;
+  int i, j, pid;
+
+  if((a = sbrk(mb << 20)) == (char*)-1)
+    fail("sbrk");
+  for(i = 0; i < mb << 20; i += PGSIZE)
+    a[i] = 1;
+  for(i = 0; i < NFORK; i++){
+    t0 = rdtsc();
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      exit();
+    wait();
+    x = rdtsc() - t0;
+    for(j = i; j > 0 && samples[j-1] > x; j--)
+      samples[j] = samples[j-1];
+    samples[j] = x;
+  }
+  sbrk(-(mb << 20));
+  printf(1, "fork %d %d\n", mb, ns(samples[NFORK/2]));
+}
+
+static void
+kallocbench(int nproc)
+{
+  int go[2], i, j, k;
+  uint64 t0;
+  char *a, c;
+
+  if(pipe(go) < 0)
+    fail("pipe");
+  for(i = 0; i < nproc; i++){
+    if((k = fork()) < 0)
+      fail("fork");
+    if(k == 0){
+      close(go[1]);
+      read(go[0], &c, 1);
+      for(j = 0; j < NKROUND; j++){
+        if((a = sbrk(NKPAGE * PGSIZE)) == (char*)-1)
+          fail("sbrk");
+        for(k = 0; k < NKPAGE; k++)
+          a[k * PGSIZE] = 1;
+        sbrk(-NKPAGE * PGSIZE);
+      }
+      exit();
+    }
+  }
+  close(go[0]);
+  sleep(1);
+  t0 = rdtsc();
+  close(go[1]);
+  for(i = 0; i < nproc; i++)
+    wait();
+  printf(1, "kalloc %d %d\n", nproc, ns(rdtsc() - t0) / (nproc * NKROUND * NKPAGE));
+}
+
+int
+main(int argc, char *argv[])
+{
+  static uint sizes[] = { 16, 64, 256, 1024, 4096, 16384 };
+  static int mbs[] = { 0, 1, 4, 16 };
+  int i, max;
+
+  max = argc > 1 ? atoi(argv[1]) : 4;
+  if(max < 1 || max > NPROCMAX){
+    printf(2, "usage: membench [maxprocs]\n");
+    exit();
+  }
+  printf(1, "TEST [SIZE] NS\n");
+  sbrkbench();
+  for(i = 0; i < sizeof(sizes)/sizeof(sizes[0]); i++)
+    mallocbench(sizes[i]);
+  for(i = 0; i < sizeof(mbs)/sizeof(mbs[0]); i++)
+    forkbench(mbs[i]);
+  for(i = 1; i <= max; i *= 2)
+    kallocbench(i);
+  exit();
+}
@@ -0,0 +1,66 @@
+/* A CPU-bound process sinks to the lowest priority level. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+int ppid;
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// The entry for pid.
+struct ProcessInfo*
+find(int pid)
+{
+    int i, n;
+
+    n = getprocs(table);
+    assert(n > 0 && n <= NPROC);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return &table[i];
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct ProcessInfo *p;
+    int pid, i, bottom;
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        for (;;)
+            ;
+    }
+
+    // Sample the spinner; a boost may briefly lift it again.
+    bottom = 0;
+    for (i = 0; i < 10*BOOSTTICKS && !bottom; i++) {
+        sleep(1);
+        p = find(pid);
+        assert(p->priority >= 0 && p->priority < NPRIO);
+        bottom = p->priority == NPRIO-1;
+    }
+    assert(bottom);
+    assert(p->ticks >= (1 << (NPRIO-1)) - 1);
+
+    // Sleeping most of the time, we use little CPU.
+    i = find(getpid())->ticks;
+    assert(i < find(pid)->ticks);
+
+    kill(pid);
+    wait();
+    printf(1, "TEST PASSED\n");
+    exit();
+}
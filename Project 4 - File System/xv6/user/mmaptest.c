@@ -0,0 +1,86 @@
+/* mmap a file, read it through the mapping, and pass mapped memory to write. */
+#include "types.h"
+#include "user.h"
+#include "mman.h"
+
+#define O_RDONLY  0x000
+#define O_WRONLY  0x001
+#define O_RDWR    0x002
+#define O_CREATE  0x200
+
+#define N 9000  // a bit over two pages
+
+int ppid;
+char buf[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    char *p, *q;
+    int fd, fd2, i, pid;
+
+    fd = open("mmap.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < N; i++) {
+        buf[i % sizeof(buf)] = 'a' + i % 23;
+        if (i % sizeof(buf) == sizeof(buf) - 1 || i == N - 1) {
+            assert(write(fd, buf, i % sizeof(buf) + 1) == i % sizeof(buf) + 1);
+        }
+    }
+
+    assert(mmap(fd, 0, N, PROT_READ | PROT_WRITE) == (void*)-1);
+    assert(mmap(fd, 100, N, PROT_READ) == (void*)-1);  // unaligned offset
+    p = mmap(fd, 0, N, PROT_READ);
+    assert(p != (void*)-1);
+    q = mmap(fd, 4096, 10, PROT_READ);
+    assert(q != (void*)-1 && q < p);
+    close(fd);  // the mappings keep the file
+
+    for (i = N - 1; i >= 0; i -= 7) {
+        assert(p[i] == 'a' + i % 23);
+    }
+    assert(q[0] == 'a' + 4096 % 23);
+
+    // The child sees the same data.
+    pid = fork();
+    if (pid == 0) {
+        for (i = 0; i < N; i += 100) {
+            assert(p[i] == 'a' + i % 23);
+        }
+        exit();
+    }
+    assert(pid > 0);
+    wait();
+
+    // Mapped memory works as a system call buffer, even
+    // on a page not touched yet.
+    fd2 = open("mmap2.tmp", O_CREATE | O_RDWR);
+    assert(fd2 >= 0);
+    assert(write(fd2, q + 5, 5) == 5);
+    close(fd2);
+    fd2 = open("mmap2.tmp", O_RDONLY);
+    assert(read(fd2, buf, 5) == 5);
+    for (i = 0; i < 5; i++) {
+        assert(buf[i] == 'a' + (4096 + 5 + i) % 23);
+    }
+    close(fd2);
+
+    // The heap can't grow into the mappings.
+    while ((uint)q - (uint)sbrk(0) > 0x40000000)
+        assert(sbrk(0x40000000) != (char*)-1);
+    assert(sbrk((uint)q - (uint)sbrk(0) + 1) == (char*)-1);
+
+    unlink("mmap.tmp");
+    unlink("mmap2.tmp");
+    printf(1, "TEST PASSED\n");
+    exit();
+}
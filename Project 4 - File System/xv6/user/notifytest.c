@@ -0,0 +1,112 @@
+/* a notify fd reports creates, writes, tag changes and unlinks as
+ * they happen, only those in its mask, a run of writes once, and
+ * an overflow when its ring fills. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "param.h"
+#include "notify.h"
+
+int ppid;
+struct notifyevent ev[NNOTIFYEV];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Read what is queued on fd, without waiting.  Returns the number
+// of events.
+int
+drain(int fd)
+{
+    int n, tot;
+
+    tot = 0;
+    while (tot < NNOTIFYEV &&
+           (n = read(fd, ev + tot, (NNOTIFYEV - tot) * sizeof(ev[0]))) > 0) {
+        assert(n % sizeof(ev[0]) == 0);
+        tot += n / sizeof(ev[0]);
+    }
+    return tot;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct pollfd pfd;
+    struct stat st;
+    uint dir, inum;
+    int nfd, tfd, fd, n, i;
+    ppid = getpid();
+
+    assert(notify_open(0) < 0);
+    assert(notify_open(0x100) < 0);
+    nfd = notify_open(NOTE_ALL);
+    assert(nfd >= 0);
+    tfd = notify_open(NOTE_TAG | NOTE_UNTAG);
+    assert(tfd >= 0);
+    assert(fcntl(nfd, F_SETFL, O_NONBLOCK) == 0);
+    assert(fcntl(tfd, F_SETFL, O_NONBLOCK) == 0);
+    assert(read(nfd, ev, sizeof(ev)) < 0);
+    pfd.fd = nfd;
+    pfd.events = POLLIN;
+    assert(poll(&pfd, 1, 0) == 0);
+
+    fd = open(".", O_RDONLY);
+    assert(fd >= 0 && fstat(fd, &st) == 0);
+    dir = st.ino;
+    close(fd);
+
+    fd = open("nt1", O_CREATE | O_RDWR);
+    assert(fd >= 0 && fstat(fd, &st) == 0);
+    inum = st.ino;
+    assert(poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN));
+    for (i = 0; i < 5; i++)
+        assert(write(fd, "hello", 5) == 5);
+    assert(tagFile(fd, "ntkey", "v", 1) == 1);
+    assert(tagFile(fd, "ntkey", "v", 1) == 1);  // unchanged
+    assert(removeFileTag(fd, "ntkey") == 1);
+    close(fd);
+    assert(unlink("nt1") == 0);
+
+    n = drain(nfd);
+    assert(n == 5);
+    assert(ev[0].type == NOTE_CREATE && ev[0].inum == inum && ev[0].dir == dir &&
+           strcmp(ev[0].name, "nt1") == 0);
+    assert(ev[1].type == NOTE_WRITE && ev[1].inum == inum);
+    assert(ev[2].type == NOTE_TAG && ev[2].inum == inum && strcmp(ev[2].name, "ntkey") == 0);
+    assert(ev[3].type == NOTE_UNTAG && ev[3].inum == inum && strcmp(ev[3].name, "ntkey") == 0);
+    assert(ev[4].type == NOTE_UNLINK && ev[4].inum == inum && ev[4].dir == dir &&
+           strcmp(ev[4].name, "nt1") == 0);
+
+    n = drain(tfd);
+    assert(n == 2 && ev[0].type == NOTE_TAG && ev[1].type == NOTE_UNTAG);
+
+    // Overflow: the last slot says events were lost, and events
+    // queue again once it is read.
+    fd = open("nt2", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < NNOTIFYEV; i++)
+        assert(tagFile(fd, "ntkey", i % 2 ? "a" : "b", 1) == 1);
+    n = drain(tfd);
+    assert(n == NNOTIFYEV);
+    for (i = 0; i < NNOTIFYEV - 1; i++)
+        assert(ev[i].type == NOTE_TAG);
+    assert(ev[NNOTIFYEV - 1].type == NOTE_OVERFLOW);
+    assert(removeFileTag(fd, "ntkey") == 1);
+    n = drain(tfd);
+    assert(n == 1 && ev[0].type == NOTE_UNTAG);
+    close(fd);
+    assert(unlink("nt2") == 0);
+
+    close(nfd);
+    close(tfd);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,114 @@
+/* File data is read through the page cache: a second read of
+ * the same data doesn't touch the buffer cache, writes and
+ * truncation show up in later reads, a mapping keeps the file
+ * as of its first touch while the file changes, and writes to a
+ * page once mapped don't leak pages after the mapping is gone. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "mman.h"
+#include "bcachestat.h"
+
+#define N 10000  // two pages and a bit
+#define NWRITE 400
+#define KSTATSIZE 16384
+
+char buf[N];
+char kbuf[KSTATSIZE + 1];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Pages on kalloc's free lists, from the kstat device.
+int
+nfree(void)
+{
+    char *p, *name = "kmem.free ";
+    int fd, n, i;
+
+    fd = open("/kstat", O_RDONLY);
+    assert(fd >= 0);
+    n = read(fd, kbuf, KSTATSIZE);
+    assert(n > 0 && n < KSTATSIZE);
+    kbuf[n] = 0;
+    close(fd);
+    for (p = kbuf; *p; p = strchr(p, '\n') + 1) {
+        for (i = 0; name[i] && p[i] == name[i]; i++)
+            ;
+        if (name[i] == 0)
+            return atoi(p + i);
+    }
+    assert(0);
+    return -1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct bcachestat s0, s1;
+    char *p;
+    int fd, i, before;
+
+    fd = open("pcache.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < N; i++)
+        buf[i] = 'a' + i % 23;
+    assert(write(fd, buf, N) == N);
+
+    // The first read fills the pages; the second is all hits.
+    assert(pread(fd, buf, N, 0) == N);
+    assert(bcachestat(&s0) == 0);
+    memset(buf, 0, N);
+    assert(pread(fd, buf, N, 0) == N);
+    assert(bcachestat(&s1) == 0);
+    assert(s1.hits == s0.hits && s1.misses == s0.misses);
+    for (i = 0; i < N; i++)
+        assert(buf[i] == 'a' + i % 23);
+
+    // A mapping shares the cached page, as of its first touch.
+    p = mmap(fd, 4096, 4096, PROT_READ);
+    assert(p != (void*)-1);
+    assert(p[0] == 'a' + 4096 % 23 && p[100] == 'a' + 4196 % 23);
+    assert(pwrite(fd, "XYZ", 3, 4096) == 3);
+    assert(p[0] == 'a' + 4096 % 23);
+    assert(pread(fd, buf, 3, 4096) == 3 && buf[0] == 'X' && buf[2] == 'Z');
+
+    // A write to a page nobody maps updates it in place.
+    assert(pwrite(fd, "hi", 2, 10) == 2);
+    assert(pread(fd, buf, 4, 9) == 4);
+    assert(buf[0] == 'a' + 9 % 23 && buf[1] == 'h' && buf[2] == 'i');
+
+    // Cutting the file short and growing it back reads zeros.
+    assert(ftruncate(fd, 5000) == 0);
+    assert(ftruncate(fd, N) == 0);
+    assert(pread(fd, buf, N, 0) == N);
+    assert(buf[4999] == 'a' + 4999 % 23 && buf[5000] == 0 && buf[N-1] == 0);
+    assert(p[N - 4096 - 1 - 4096] != 0);  // the mapping's copy is kept
+
+    // A child maps page 0 and writes it while mapped, so the cache
+    // takes a fresh copy; once the child is gone, writes to that
+    // page cost no memory.
+    if (fork() == 0) {
+        p = mmap(fd, 0, 4096, PROT_READ);
+        assert(p != (void*)-1 && p[0] == 'a');
+        assert(pwrite(fd, "b", 1, 0) == 1);
+        exit();
+    }
+    assert(wait() > 0);
+    assert(pwrite(fd, "c", 1, 0) == 1);
+    before = nfree();
+    for (i = 0; i < NWRITE; i++)
+        assert(pwrite(fd, "d", 1, 0) == 1);
+    assert(nfree() > before - NWRITE/2);
+    assert(pread(fd, buf, 2, 0) == 2 && buf[0] == 'd' && buf[1] == 'a' + 1);
+    close(fd);
+
+    assert(unlink("pcache.tmp") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
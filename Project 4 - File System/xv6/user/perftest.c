@@ -0,0 +1,81 @@
+/* perfctr counts the process's own instructions, read from user
+ * space with rdpmc: a loop counts at least one per iteration,
+ * and time asleep while another process spins counts next to
+ * nothing.  Passes with a note if the CPU has no counters. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "perf.h"
+
+#define N 1000000
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+volatile int sink;
+
+void
+spin(int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        sink = i;
+}
+
+int
+main(int argc, char *argv[])
+{
+    uint64 a, b;
+    int c, pid, p[2];
+    char x;
+
+    c = perfctr(PERF_INSTR, PERF_USER);
+    if (c < 0) {
+        printf(1, "perftest: no performance counters\n");
+        printf(1, "TEST PASSED\n");
+        exit();
+    }
+    assert(c >= 0 && c < 4);
+    assert(perfctr(PERF_INSTR, 0x80) < 0);
+
+    // Counts only go up, and by at least the loop's length.
+    a = perfread(c);
+    spin(N);
+    b = perfread(c);
+    printf(1, "perftest: %d instructions for %d iterations\n", (uint)(b - a), N);
+    assert(b - a >= N);
+    assert(b - a < 100 * (uint64)N);
+
+    // A child's spinning is not ours, though it runs while we wait.
+    assert(pipe(p) == 0);
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        spin(20 * N);
+        write(p[1], "x", 1);
+        exit();
+    }
+    a = perfread(c);
+    assert(read(p[0], &x, 1) == 1);
+    b = perfread(c);
+    printf(1, "perftest: %d instructions while waiting\n", (uint)(b - a));
+    assert(b - a < N);
+    assert(wait() == pid);
+
+    // Yielding the CPU keeps the count going across switches.
+    a = perfread(c);
+    spin(N);
+    sleep(1);
+    spin(N);
+    b = perfread(c);
+    assert(b - a >= 2 * N);
+
+    assert(perfctr(0, 0) == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
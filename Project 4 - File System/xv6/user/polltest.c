@@ -0,0 +1,89 @@
+/* poll waits on several pipes at once, with or without a
+ * timeout, and reports hangups and bad fds; O_NONBLOCK makes
+ * reads and writes on a pipe fail rather than wait. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "poll.h"
+
+char buf[8192];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct pollfd fds[3];
+    int a[2], b[2], t0, n, tot;
+
+    assert(pipe(a) == 0 && pipe(b) == 0);
+    fds[0].fd = a[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = b[0];
+    fds[1].events = POLLIN;
+    fds[2].fd = -1;
+
+    // Nothing ready, no waiting.
+    assert(poll(fds, 3, 0) == 0);
+    assert(fds[0].revents == 0 && fds[1].revents == 0);
+
+    // Only the pipe written to is ready.
+    assert(write(b[1], "x", 1) == 1);
+    assert(poll(fds, 3, -1) == 1);
+    assert(fds[0].revents == 0 && fds[1].revents == POLLIN);
+    assert(read(b[0], buf, 1) == 1);
+
+    // A writer that comes later wakes a poll with no timeout.
+    if (fork() == 0) {
+        sleep(5);
+        write(a[1], "y", 1);
+        exit();
+    }
+    assert(poll(fds, 2, -1) == 1);
+    assert(fds[0].revents == POLLIN && fds[1].revents == 0);
+    assert(read(a[0], buf, 1) == 1 && buf[0] == 'y');
+    wait();
+
+    // A timeout runs out.
+    t0 = uptime();
+    assert(poll(fds, 2, 100) == 0);
+    assert(uptime() - t0 >= 5);
+
+    // Write ends are ready while they have room.
+    fds[2].fd = a[1];
+    fds[2].events = POLLOUT;
+    assert(poll(fds, 3, 0) == 1 && fds[2].revents == POLLOUT);
+
+    // Hangups and closed fds are reported unasked.
+    close(b[1]);
+    assert(poll(fds, 2, -1) == 1 && fds[1].revents == POLLHUP);
+    close(b[0]);
+    assert(poll(fds, 2, 0) == 1 && fds[1].revents == POLLNVAL);
+
+    // Nonblocking reads and writes.
+    assert(fcntl(a[0], F_GETFL, 0) == O_RDONLY);
+    assert(fcntl(a[0], F_SETFL, O_NONBLOCK) == 0);
+    assert(fcntl(a[0], F_GETFL, 0) == (O_RDONLY | O_NONBLOCK));
+    assert(read(a[0], buf, 1) == -1);
+    assert(fcntl(a[1], F_SETFL, O_NONBLOCK) == 0);
+    tot = 0;
+    while ((n = write(a[1], buf, sizeof(buf))) > 0)
+        tot += n;
+    assert(n == -1 && tot > 0 && tot % sizeof(buf) != 0);
+    fds[2].fd = a[1];
+    assert(poll(fds + 2, 1, 0) == 0);
+    assert(read(a[0], buf, 1) == 1);
+    assert(poll(fds + 2, 1, 0) == 1 && fds[2].revents == POLLOUT);
+
+    close(a[0]);
+    assert(poll(fds + 2, 1, 0) == 1 && fds[2].revents == POLLERR);
+    close(a[1]);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
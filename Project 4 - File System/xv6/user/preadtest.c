@@ -0,0 +1,60 @@
+/* Processes reading one file with pread at once see the right data,
+ * in direct and indirect blocks alike. */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NBLK 200  // past NDIRECT, into the indirect block
+#define NKID 4
+#define ROUNDS 20
+
+int ppid;
+uint buf[512/sizeof(uint)];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd, i, j, k, r, b;
+
+    fd = open("preadtest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (b = 0; b < NBLK; b++) {
+        for (j = 0; j < sizeof(buf)/sizeof(uint); j++)
+            buf[j] = b * 1000 + j;
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    }
+
+    for (k = 0; k < NKID; k++) {
+        r = fork();
+        assert(r >= 0);
+        if (r == 0) {
+            for (i = 0; i < ROUNDS * NBLK; i++) {
+                b = (i * 7 + k * 13) % NBLK;
+                assert(pread(fd, buf, sizeof(buf), b * sizeof(buf)) == sizeof(buf));
+                for (j = 0; j < sizeof(buf)/sizeof(uint); j++)
+                    assert(buf[j] == b * 1000 + j);
+            }
+            exit();
+        }
+    }
+    for (k = 0; k < NKID; k++)
+        assert(wait() > 0);
+
+    // Reads past the end still stop short.
+    assert(pread(fd, buf, sizeof(buf), NBLK * sizeof(buf) - 4) == 4);
+    assert(pread(fd, buf, sizeof(buf), NBLK * sizeof(buf)) == 0);
+    close(fd);
+    assert(unlink("preadtest.tmp") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
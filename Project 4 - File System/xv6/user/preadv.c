@@ -0,0 +1,81 @@
+/* pwrite and pread at explicit offsets, then writev and readv through the file offset. */
+#include "types.h"
+#include "user.h"
+#include "uio.h"
+
+#define O_RDONLY  0x000
+#define O_WRONLY  0x001
+#define O_RDWR    0x002
+#define O_CREATE  0x200
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct iovec iov[3];
+    char a[8], b[8], c[8];
+    int fd, res;
+
+    fd = open("preadv.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+
+    // pwrite leaves the file offset where it was.
+    assert(pwrite(fd, "hello", 5, 0) == 5);
+    assert(pwrite(fd, "world", 5, 5) == 5);
+    assert(pwrite(fd, "!", 1, 20) == -1);  // past end of file
+    memset(a, 0, sizeof(a));
+    assert(pread(fd, a, 5, 5) == 5);
+    assert(strcmp(a, "world") == 0);
+    assert(read(fd, a, 5) == 5);
+    assert(a[0] == 'h');
+
+    // writev continues from the file offset.
+    iov[0].iov_base = "abc";
+    iov[0].iov_len = 3;
+    iov[1].iov_base = "";
+    iov[1].iov_len = 0;
+    iov[2].iov_base = "defg";
+    iov[2].iov_len = 4;
+    res = writev(fd, iov, 3);
+    assert(res == 7);
+
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    memset(c, 0, sizeof(c));
+    assert(pread(fd, a, 7, 5) == 7);
+    assert(strcmp(a, "abcdefg") == 0);
+
+    // readv stops at end of file.
+    close(fd);
+    fd = open("preadv.tmp", O_RDONLY);
+    assert(fd >= 0);
+    memset(a, 0, sizeof(a));
+    iov[0].iov_base = a;
+    iov[0].iov_len = 5;
+    iov[1].iov_base = b;
+    iov[1].iov_len = 4;
+    iov[2].iov_base = c;
+    iov[2].iov_len = 7;
+    res = readv(fd, iov, 3);
+    assert(res == 12);
+    assert(strcmp(a, "hello") == 0);
+    assert(strcmp(b, "abcd") == 0);
+    assert(strcmp(c, "efg") == 0);
+    assert(readv(fd, iov, 3) == 0);
+    assert(readv(fd, iov, IOV_MAX + 1) == -1);
+    close(fd);
+    unlink("preadv.tmp");
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
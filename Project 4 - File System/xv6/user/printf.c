@@ -2,14 +2,127 @@
 #include "stat.h"
 #include "user.h"
 
+// Buffered output streams.
+//
+// A stream made by fdopen collects output in a buffer and writes
+// it with one system call when the buffer fills, at each newline
+// if the fd is the console, and at fflush or fclose.  Output left
+// in a stream when the program exits is lost, so flush first.
+//
+// printf(fd, ...) goes into fd's stream if it has one.  Otherwise
+// it is collected in a small buffer on the stack and written once
+// the whole format is done, so each printf is about one write.
+
+#define NSTREAM 8
+#define BUFSIZ 512
+
+struct iobuf {
+  int used;
+  int fd;
+  int line;   // Flush at each newline
+  int n;      // Bytes in buf
+  int size;
+  char *buf;
+};
+
+static FILE streams[NSTREAM];
+static char bufs[NSTREAM][BUFSIZ];
+
+// Make a buffered output stream for fd, which must be open for
+// writing.  Returns 0 if mode isn't "w" or "a" or all streams are
+// in use.
+FILE*
+fdopen(int fd, char *mode)
+{
+  struct stat st;
+  FILE *f;
+
+  if(fd < 0 || (mode[0] != 'w' && mode[0] != 'a'))
+    return 0;
+  for(f = streams; f < streams + NSTREAM; f++){
+    if(!f->used){
+      f->used = 1;
+      f->fd = fd;
+      f->line = fstat(fd, &st) == 0 && st.type == T_DEV;
+      f->n = 0;
+      f->size = BUFSIZ;
+      f->buf = bufs[f - streams];
+      return f;
+    }
+  }
+  return 0;
+}
+
+// Write out f's buffer, or every stream's if f is 0.
+// Returns -1 if a write failed; its output is dropped.
+int
+fflush(FILE *f)
+{
+  int i, n, r;
+
+  if(f == 0){
+    r = 0;
+    for(f = streams; f < streams + NSTREAM; f++)
+      if(f->used && fflush(f) < 0)
+        r = -1;
+    return r;
+  }
+  for(i = 0; i < f->n; i += n){
+    if((n = write(f->fd, f->buf + i, f->n - i)) <= 0){
+      f->n = 0;
+      return -1;
+    }
+  }
+  f->n = 0;
+  return 0;
+}
+
+// Flush f, close its fd and free it.
+int
+fclose(FILE *f)
+{
+  int r;
+
+  r = fflush(f);
+  if(close(f->fd) < 0)
+    r = -1;
+  f->used = 0;
+  return r;
+}
+
 static void
-putc(int fd, char c)
+putc(FILE *f, char c)
 {
-  write(fd, &c, 1);
+  f->buf[f->n++] = c;
+  if(f->n == f->size || (f->line && c == '\n'))
+    fflush(f);
+}
+
+// Write n items of size bytes each from p to f.  Returns the
+// number of items, fewer only if a write failed.
+int
+fwrite(void *p, uint size, uint n, FILE *f)
+{
+  char *s;
+  uint i;
+  int m;
+
+  s = p;
+  for(i = 0; i < size * n; i += m){
+    if(f->n == 0 && size * n - i >= f->size && !f->line){
+      // A big write skips the buffer.
+      if((m = write(f->fd, s + i, size * n - i)) <= 0)
+        break;
+      continue;
+    }
+    m = 1;
+    putc(f, s[i]);
+  }
+  return size ? i / size : 0;
 }
 
 static void
-printint(int fd, int xx, int base, int sgn)
+printint(FILE *f, int xx, int base, int sgn)
 {
   static char digits[] = "0123456789ABCDEF";
   char buf[16];
@@ -32,33 +145,31 @@ printint(int fd, int xx, int base, int sgn)
     buf[i++] = '-';
 
   while(--i >= 0)
-    putc(fd, buf[i]);
+    putc(f, buf[i]);
 }
 
-// Print to the given fd. Only understands %d, %x, %p, %s.
-void
-printf(int fd, char *fmt, ...)
+// Only understands %d, %x, %p, %s, %c.
+static void
+vprintf(FILE *f, char *fmt, uint *ap)
 {
   char *s;
   int c, i, state;
-  uint *ap;
 
   state = 0;
-  ap = (uint*)(void*)&fmt + 1;
   for(i = 0; fmt[i]; i++){
     c = fmt[i] & 0xff;
     if(state == 0){
       if(c == '%'){
         state = '%';
       } else {
-        putc(fd, c);
+        putc(f, c);
       }
     } else if(state == '%'){
       if(c == 'd'){
-        printint(fd, *ap, 10, 1);
+        printint(f, *ap, 10, 1);
         ap++;
       } else if(c == 'x' || c == 'p'){
-        printint(fd, *ap, 16, 0);
+        printint(f, *ap, 16, 0);
         ap++;
       } else if(c == 's'){
         s = (char*)*ap;
@@ -66,20 +177,49 @@ printf(int fd, char *fmt, ...)
         if(s == 0)
           s = "(null)";
         while(*s != 0){
-          putc(fd, *s);
+          putc(f, *s);
           s++;
         }
       } else if(c == 'c'){
-        putc(fd, *ap);
+        putc(f, *ap);
         ap++;
       } else if(c == '%'){
-        putc(fd, c);
+        putc(f, c);
       } else {
         // Unknown % sequence.  Print it to draw attention.
-        putc(fd, '%');
-        putc(fd, c);
+        putc(f, '%');
+        putc(f, c);
       }
       state = 0;
     }
   }
 }
+
+void
+fprintf(FILE *f, char *fmt, ...)
+{
+  vprintf(f, fmt, (uint*)(void*)&fmt + 1);
+}
+
+// Print to the given fd.
+void
+printf(int fd, char *fmt, ...)
+{
+  FILE tmp, *f;
+  char buf[128];
+
+  for(f = streams; f < streams + NSTREAM; f++)
+    if(f->used && f->fd == fd)
+      break;
+  if(f == streams + NSTREAM){
+    f = &tmp;
+    f->fd = fd;
+    f->line = 0;
+    f->n = 0;
+    f->size = sizeof(buf);
+    f->buf = buf;
+  }
+  vprintf(f, fmt, (uint*)(void*)&fmt + 1);
+  if(f == &tmp)
+    fflush(f);
+}
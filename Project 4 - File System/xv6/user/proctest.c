@@ -0,0 +1,57 @@
+/* Far more than 64 processes can exist at once. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+#define N 200
+
+int ppid;
+int pids[N];
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int i, j, n, kids;
+
+    for (i = 0; i < N; i++) {
+        pids[i] = fork();
+        assert(pids[i] >= 0);
+        if (pids[i] == 0) {
+            for (;;)
+                sleep(1000);
+        }
+    }
+
+    // getprocs sees every child, with us as parent.
+    n = getprocs(table);
+    assert(n > N && n <= NPROC);
+    kids = 0;
+    for (j = 0; j < n; j++)
+        if (table[j].ppid == ppid)
+            kids++;
+    assert(kids == N);
+
+    for (i = 0; i < N; i++)
+        assert(kill(pids[i]) == 0);
+    for (i = 0; i < N; i++)
+        assert(wait() > 0);
+    assert(wait() == -1);
+
+    // Their slots and pids are gone.
+    assert(kill(pids[0]) == -1);
+    assert(getprocs(table) <= n - N);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,75 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "ProfSample.h"
+
+// "prof [-s] cmd [arg ...]" runs cmd with the kernel's sampling
+// profiler on, and prints each sample as
+//   prof cpu pid k|u eip [caller ...]
+// for tools/profsym to name.  -s records kernel call stacks.
+// A child drains the rings while cmd runs.
+
+static struct ProfSample buf[64];
+
+static void
+drain(void)
+{
+  FILE *out;
+  int i, j, n;
+
+  if((out = fdopen(1, "w")) == 0)
+    exit();
+  while((n = profread(buf, sizeof(buf)/sizeof(buf[0]))) >= 0){
+    if(n == 0){
+      fflush(out);
+      sleep(HZ/10);
+    }
+    for(i = 0; i < n; i++){
+      fprintf(out, "prof %d %d %c %x", buf[i].cpu, buf[i].pid,
+              buf[i].user ? 'u' : 'k', buf[i].eip);
+      for(j = 0; j < PROFDEPTH && buf[i].pcs[j]; j++)
+        fprintf(out, " %x", buf[i].pcs[j]);
+      fprintf(out, "\n");
+    }
+  }
+  fclose(out);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int flags, i, pid, dpid, dropped;
+
+  flags = PROF_ON;
+  i = 1;
+  if(argc > 1 && strcmp(argv[1], "-s") == 0){
+    flags |= PROF_STACK;
+    i++;
+  }
+  if(i >= argc){
+    printf(2, "usage: prof [-s] cmd [arg ...]\n");
+    exit();
+  }
+  if(profctl(flags) < 0){
+    printf(2, "prof: profctl failed\n");
+    exit();
+  }
+  if((dpid = fork()) == 0){
+    drain();
+    exit();
+  }
+  if((pid = fork()) == 0){
+    exec(argv[i], argv + i);
+    printf(2, "prof: exec %s failed\n", argv[i]);
+    exit();
+  }
+  while(pid > 0 && wait() != pid)
+    ;
+  dropped = profctl(0);
+  if(dpid > 0)
+    wait();
+  if(dropped > 0)
+    printf(2, "prof: %d samples dropped\n", dropped);
+  exit();
+}
@@ -0,0 +1,91 @@
+/* the sampling profiler sees user and kernel time, with kernel
+ * stacks, and stops when told. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+#include "ProfSample.h"
+
+int ppid;
+struct ProfSample buf[NCPU * NPROFSAMPLE];
+char data[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Spend n ticks half in user space and half writing a file.
+void
+spin(int n)
+{
+    int fd, i, t;
+    volatile int x;
+
+    t = uptime();
+    while(uptime() - t < n){
+        for(i = x = 0; i < 100000; i++)
+            x += i;
+        fd = open("proftest.tmp", O_CREATE | O_RDWR);
+        assert(fd >= 0);
+        for(i = 0; i < 8; i++)
+            assert(write(fd, data, sizeof(data)) == sizeof(data));
+        close(fd);
+        unlink("proftest.tmp");
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct ProfSample *s;
+    int i, n, user, kern, stacks;
+    ppid = getpid();
+
+    assert(profctl(PROF_ON | PROF_STACK) >= 0);
+    spin(HZ / 2);
+    assert(profctl(0) >= 0);
+
+    n = profread(buf, NCPU * NPROFSAMPLE);
+    assert(n > 0);
+    user = kern = stacks = 0;
+    for(i = 0; i < n; i++){
+        s = &buf[i];
+        assert(s->cpu < NCPU);
+        if(s->pid != ppid)
+            continue;
+        if(s->user){
+            assert(s->eip >= USERBASE && s->eip < USERTOP);
+            assert(s->pcs[0] == 0);
+            user++;
+        } else {
+            assert(s->eip >= 0x100000 && s->eip < USERBASE);
+            kern++;
+            if(s->pcs[0] != 0)
+                stacks++;
+        }
+    }
+    assert(user > 0);
+    assert(kern == 0 || stacks > 0);
+
+    // Stopped and drained, so nothing more comes.
+    spin(2);
+    assert(profread(buf, NCPU * NPROFSAMPLE) == -1);
+    assert(profread(buf, -1) == -1);
+
+    // Starting again empties the rings.
+    assert(profctl(PROF_ON) >= 0);
+    n = profread(buf, 4);
+    assert(n >= 0 && n <= 4);
+    for(i = 0; i < n; i++)
+        assert(buf[i].pcs[0] == 0);
+    assert(profctl(0) >= 0);
+    while(profread(buf, NCPU * NPROFSAMPLE) >= 0)
+        ;
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
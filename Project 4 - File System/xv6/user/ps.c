@@ -0,0 +1,34 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+// Page counts are in 4096-byte pages.
+int
+main(void)
+{
+  enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+  static char *states[] = {
+  [UNUSED]    "unused",
+  [EMBRYO]    "embryo",
+  [SLEEPING]  "sleep ",
+  [RUNNABLE]  "runble",
+  [RUNNING]   "run   ",
+  [ZOMBIE]    "zombie"
+  };
+  static struct ProcessInfo table[NPROC];
+  struct ProcessInfo *p;
+  int n;
+
+  if((n = getprocs(table)) < 0){
+    printf(2, "ps: getprocs failed\n");
+    exit();
+  }
+  printf(1, "PID PPID STATE PRI TICKS CPU RSS SHR PT MAXRSS MINFLT MAJFLT NAME\n");
+  for(p = table; p < table + n; p++)
+    printf(1, "%d %d %s %d %d %d %d %d %d %d %d %d %s\n", p->pid, p->ppid,
+           states[p->state], p->priority, p->ticks, p->cpu,
+           p->rss, p->shared, p->ptpages, p->maxrss, p->minflt, p->majflt, p->name);
+  exit();
+}
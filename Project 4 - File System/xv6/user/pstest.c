@@ -0,0 +1,77 @@
+/* getprocs reports resident, shared and page-table pages and faults. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "ProcessInfo.h"
+
+#define N 32
+
+int ppid;
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// This process's entry.
+struct ProcessInfo*
+me(void)
+{
+    int i, n, pid;
+
+    pid = getpid();
+    n = getprocs(table);
+    assert(n > 0 && n <= NPROC);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return &table[i];
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct ProcessInfo before, *p;
+    char *a;
+    int i;
+
+    before = *me();
+    assert(before.ppid > 0 && strcmp(before.name, "pstest") == 0);
+    assert(before.rss > 0 && before.ptpages >= 2);
+    assert(before.maxrss >= before.rss);
+
+    // Touching heap pages faults them in, one minor fault each.
+    a = sbrk(N*4096);
+    assert(a != (char*)-1);
+    for (i = 0; i < N; i++)
+        a[i*4096] = i;
+    p = me();
+    assert(p->rss >= before.rss + N);
+    assert(p->minflt >= before.minflt + N);
+    assert(p->maxrss >= p->rss);
+
+    // A child shares them all, copy-on-write.
+    if (fork() == 0) {
+        p = me();
+        assert(p->shared >= N);
+        i = p->minflt;
+        a[0] = 1;  // a minor fault: copy the page
+        assert(me()->minflt > i);
+        exit();
+    }
+    wait();
+
+    // Shrinking lowers rss, not the peak.
+    assert(sbrk(-N*4096) == a + N*4096);
+    p = me();
+    assert(p->rss < before.rss + N);
+    assert(p->rss < p->maxrss);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
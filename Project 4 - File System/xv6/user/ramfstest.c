@@ -0,0 +1,84 @@
+/* The RAM disk mounted on /tmp holds files like any directory,
+ * with ".." leading back out of it, and reading and writing
+ * them issues no disk commands. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "idestat.h"
+
+char buf[2048];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Write, read back and remove a scratch file.
+void
+scratch(void)
+{
+    int fd, i;
+
+    fd = open("/tmp/scratch", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = i;
+    for (i = 0; i < 8; i++)
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    close(fd);
+    fd = open("/tmp/scratch", O_RDONLY);
+    assert(fd >= 0);
+    for (i = 0; i < 8; i++) {
+        memset(buf, 0, sizeof(buf));
+        assert(read(fd, buf, sizeof(buf)) == sizeof(buf));
+        assert(buf[5] == 5 && buf[1000] == (char)1000);
+    }
+    close(fd);
+    assert(unlink("/tmp/scratch") == 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct idestat s0, s1;
+    struct stat st;
+    int fd;
+
+    // Mount it unless an earlier run has.
+    mkdir("/tmp");
+    assert(stat("/tmp", &st) == 0);
+    if (st.dev != RAMDEV) {
+        assert(mount("/tmp", RAMDEV) == 0);
+        assert(stat("/tmp", &st) == 0);
+    }
+    assert(st.dev == RAMDEV && st.type == T_DIR && st.ino == 1);
+    assert(mount("/tmp", RAMDEV) < 0);
+    assert(mount("/README", RAMDEV) < 0);
+
+    // Once warm, scratch files don't touch the disk.
+    scratch();
+    sync();
+    assert(idestat(&s0) == 0);
+    scratch();
+    assert(idestat(&s1) == 0);
+    assert(s1.ncmd == s0.ncmd);
+
+    // Names lead in and back out.
+    assert(mkdir("/tmp/d") == 0);
+    assert(chdir("/tmp/d") == 0);
+    fd = open("../../README", O_RDONLY);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0 && st.dev == ROOTDEV);
+    close(fd);
+    assert(chdir("/") == 0);
+    assert(link("/README", "/tmp/README") < 0);
+    assert(unlink("/tmp") < 0);
+    assert(unlink("/tmp/d") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,121 @@
+/* getprocs, kill and open walk the process table and inode cache
+ * without their locks: while other processes fork, exit and open
+ * one file over and over, every listing is consistent, kill finds
+ * exactly the live pids, and the file is always the same inode */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stat.h"
+#include "fcntl.h"
+#include "ProcessInfo.h"
+
+#define NCHURN 3
+#define NOPEN 2
+#define ROUNDS 200
+
+int ppid;
+struct ProcessInfo table[NPROC];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Fork and reap short-lived children.
+void
+churn(void)
+{
+    int i, pid;
+
+    for (i = 0; i < ROUNDS; i++) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+            exit();
+        assert(wait() == pid);
+        assert(kill(pid) == -1);
+    }
+    exit();
+}
+
+// Open the file over and over; it is always the same inode.
+void
+opener(uint ino)
+{
+    struct stat st;
+    int i, fd;
+
+    for (i = 0; i < ROUNDS*4; i++) {
+        fd = open("rcufile", O_RDONLY);
+        assert(fd >= 0);
+        assert(fstat(fd, &st) == 0 && st.ino == ino);
+        close(fd);
+    }
+    exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct stat st;
+    int i, j, n, fd, self, pids[NCHURN + NOPEN];
+    ppid = getpid();
+
+    unlink("rcufile");
+    fd = open("rcufile", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0);
+
+    for (i = 0; i < NCHURN + NOPEN; i++) {
+        pids[i] = fork();
+        assert(pids[i] >= 0);
+        if (pids[i] == 0) {
+            if (i < NCHURN)
+                churn();
+            opener(st.ino);
+        }
+    }
+
+    // Listings taken meanwhile have distinct pids, this process
+    // among them.
+    for (i = 0; i < ROUNDS; i++) {
+        n = getprocs(table);
+        assert(n > 0 && n <= NPROC);
+        self = 0;
+        for (j = 0; j < n; j++) {
+            assert(table[j].pid > 0);
+            if (table[j].pid == ppid)
+                self++;
+            if (j > 0) {
+                assert(table[j].pid != table[j-1].pid);
+            }
+        }
+        assert(self == 1);
+        assert(kill(ppid + 100000) == -1);
+    }
+
+    for (i = 0; i < NCHURN + NOPEN; i++)
+        assert(wait() > 0);
+    for (i = 0; i < NCHURN + NOPEN; i++)
+        assert(kill(pids[i]) == -1);
+
+    // None is left in the table, and forking still works.
+    n = getprocs(table);
+    for (j = 0; j < n; j++)
+        assert(table[j].ppid != ppid);
+    for (i = 0; i < 50; i++) {
+        j = fork();
+        assert(j >= 0);
+        if (j == 0)
+            exit();
+        assert(wait() == j);
+    }
+
+    close(fd);
+    assert(unlink("rcufile") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,133 @@
+/* readline hands back a file and a pipe a line at a time, with
+ * about one read per buffer of input rather than per byte. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "syscall.h"
+#include "SyscallStat.h"
+
+#define NLINE 300
+#define LONG  700   // bytes in the long line, newline included
+#define MAX   100   // readline's max
+
+char buf[MAX];
+char want[MAX];
+struct SyscallStat table[NSYSCALL];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Reads made so far.
+uint
+reads(void)
+{
+    assert(syscallstat(0, table, NSYSCALL) == NSYSCALL);
+    return table[SYS_read].count;
+}
+
+// Line i: "i" in decimal, then i%40 dots, then a newline.
+int
+line(char *s, int i)
+{
+    int n, d;
+
+    n = 0;
+    for (d = 1; d * 10 <= i; d *= 10)
+        ;
+    for (; d > 0; d /= 10)
+        s[n++] = '0' + i / d % 10;
+    memset(s + n, '.', i % 40);
+    n += i % 40;
+    s[n++] = '\n';
+    s[n] = 0;
+    return n;
+}
+
+// Read NLINE lines from fd and check them.
+void
+check(int fd)
+{
+    int i, n;
+
+    for (i = 0; i < NLINE; i++) {
+        n = line(want, i);
+        assert(readline(fd, buf, MAX) == n);
+        assert(strcmp(buf, want) == 0);
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    int fd, i, n, p[2], pid, total;
+    uint r0, r1;
+
+    fd = open("readline.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    total = 0;
+    for (i = 0; i < NLINE; i++) {
+        n = line(buf, i);
+        assert(write(fd, buf, n) == n);
+        total += n;
+    }
+    memset(buf, 'x', MAX);
+    for (i = 0; i < LONG - 1; i += n) {
+        n = LONG - 1 - i < MAX ? LONG - 1 - i : MAX;
+        assert(write(fd, buf, n) == n);
+    }
+    assert(write(fd, "\nlast", 5) == 5);
+    total += LONG + 4;
+    close(fd);
+
+    // A file.
+    fd = open("readline.tmp", O_RDONLY);
+    assert(fd >= 0);
+    r0 = reads();
+    check(fd);
+    // The long line comes in pieces of MAX-1.
+    for (i = 0; i < LONG; i += n) {
+        n = readline(fd, buf, MAX);
+        assert(n == (LONG - i < MAX - 1 ? LONG - i : MAX - 1));
+        assert(buf[0] == 'x' || buf[0] == '\n');
+    }
+    assert(i == LONG && buf[n-1] == '\n');
+    // The last line has no newline.
+    assert(readline(fd, buf, MAX) == 4 && strcmp(buf, "last") == 0);
+    assert(readline(fd, buf, MAX) == 0);
+    r1 = reads();
+    printf(1, "readlinetest: %d bytes in %d reads\n", total, r1 - r0);
+    assert(r1 - r0 <= total / 512 + 3);
+    close(fd);
+    assert(unlink("readline.tmp") == 0);
+
+    // A pipe, written a line at a time.
+    assert(pipe(p) == 0);
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(p[0]);
+        for (i = 0; i < NLINE; i++) {
+            n = line(buf, i);
+            assert(write(p[1], buf, n) == n);
+        }
+        exit();
+    }
+    close(p[1]);
+    check(p[0]);
+    assert(readline(p[0], buf, MAX) == 0);
+    assert(wait() == pid);
+    close(p[0]);
+
+    // Bad fds and sizes.
+    assert(readline(-1, buf, MAX) == -1);
+    assert(readline(100, buf, MAX) == -1);
+    assert(readline(0, buf, 0) == -1);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
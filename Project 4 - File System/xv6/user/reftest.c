@@ -0,0 +1,81 @@
+/* File and inode reference counts change without a lock: children
+ * on every CPU dup, close and reopen one file at once, and share
+ * one offset; when they are done the counts are back where they
+ * started, so the file still works and can be removed */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "stat.h"
+#include "fcntl.h"
+
+#define NCHILD 4
+#define ROUNDS 300
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Dup and close the shared fd, open and close the file by name,
+// and write one byte through the shared offset each round.
+void
+child(int fd, uint ino)
+{
+    struct stat st;
+    int i, d, f;
+
+    for (i = 0; i < ROUNDS; i++) {
+        d = dup(fd);
+        assert(d >= 0);
+        f = open("reffile", O_RDONLY);
+        assert(f >= 0);
+        assert(fstat(f, &st) == 0 && st.ino == ino);
+        assert(write(d, "x", 1) == 1);
+        assert(close(f) == 0);
+        assert(close(d) == 0);
+    }
+    exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct stat st;
+    int i, fd, pid;
+    ppid = getpid();
+
+    unlink("reffile");
+    fd = open("reffile", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0);
+
+    for (i = 0; i < NCHILD; i++) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0)
+            child(fd, st.ino);
+    }
+    for (i = 0; i < NCHILD; i++)
+        assert(wait() > 0);
+
+    // Every write went through the one shared file.
+    assert(fstat(fd, &st) == 0);
+    assert(st.size == NCHILD * ROUNDS);
+    assert(close(fd) == 0);
+
+    // The inode is free again: it can be removed and recreated.
+    assert(unlink("reffile") == 0);
+    fd = open("reffile", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0 && st.size == 0);
+    close(fd);
+    assert(unlink("reffile") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,104 @@
+/* ringenter makes a batch of system calls in one trap and posts
+ * each result, in order, with its data. */
+#include "types.h"
+#include "user.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "ring.h"
+
+#define N 20
+
+int ppid;
+struct ring r;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+void
+submit(int op, uint data, int a0, int a1, int a2)
+{
+    struct ringsqe *e;
+
+    e = &r.sq[r.sqtail % RINGSIZE];
+    e->op = op;
+    e->data = data;
+    e->arg[0] = a0;
+    e->arg[1] = a1;
+    e->arg[2] = a2;
+    r.sqtail++;
+}
+
+struct ringcqe*
+reap(void)
+{
+    assert(r.cqhead != r.cqtail);
+    return &r.cq[r.cqhead++ % RINGSIZE];
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int i, n, fds[N];
+    struct ringcqe *c;
+    char buf[4];
+
+    // Open N files in one go, then read and close them in another.
+    for (i = 0; i < N; i++)
+        submit(SYS_open, i, (int)"ls", O_RDONLY, 0);
+    assert(ringenter(&r) == N);
+    for (i = 0; i < N; i++) {
+        c = reap();
+        assert(c->data == i && c->res >= 0);
+        fds[i] = c->res;
+    }
+    assert(r.cqhead == r.cqtail && r.sqhead == r.sqtail);
+    for (i = 0; i < N; i++) {
+        submit(SYS_read, 100 + i, fds[i], (int)buf, sizeof(buf));
+        submit(SYS_close, 200 + i, fds[i], 0, 0);
+        if (r.sqtail - r.sqhead < RINGSIZE && i < N - 1)
+            continue;
+        n = ringenter(&r);
+        assert(n > 0 && n == r.cqtail - r.cqhead);
+        while (r.cqhead != r.cqtail) {
+            c = reap();
+            assert(c->res == (c->data < 200 ? sizeof(buf) : 0));
+        }
+    }
+    assert(read(fds[0], buf, 1) < 0);
+
+    // Calls wait while the completions are full.
+    for (i = 0; i < RINGSIZE; i++)
+        submit(SYS_getpid, i, 0, 0, 0);
+    assert(ringenter(&r) == RINGSIZE);
+    submit(SYS_getpid, RINGSIZE, 0, 0, 0);
+    assert(ringenter(&r) == 0);
+    for (i = 0; i < RINGSIZE; i++)
+        assert(reap()->data == i);
+    assert(ringenter(&r) == 1);
+    assert(reap()->data == RINGSIZE);
+
+    // Bad calls fail without stopping the rest.
+    submit(SYS_fork, 1, 0, 0, 0);
+    submit(0, 2, 0, 0, 0);
+    submit(1000, 3, 0, 0, 0);
+    submit(SYS_getpid, 4, 0, 0, 0);
+    submit(SYS_open, 5, 0, O_RDONLY, 0);
+    assert(ringenter(&r) == 5);
+    assert(reap()->res == -1);
+    assert(reap()->res == -1);
+    assert(reap()->res == -1);
+    c = reap();
+    assert(c->data == 4 && c->res == ppid);
+    assert(reap()->res == -1);
+    assert(ringenter(&r) == 0);
+    assert(ringenter((struct ring*)0xF0000000) < 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
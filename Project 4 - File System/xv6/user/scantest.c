@@ -0,0 +1,89 @@
+/* A long stream of blocks doesn't push directory blocks out of
+ * the buffer cache: after writing a file bigger than the cache,
+ * looking up every file of a directory read before still finds
+ * its blocks cached */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "fs.h"
+#include "bcachestat.h"
+
+#define NFILE 64
+
+int ppid;
+char buf[BSIZE];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+char*
+path(int i)
+{
+    static char p[] = "scandir/f00";
+
+    p[9] = '0' + i / 10;
+    p[10] = '0' + i % 10;
+    return p;
+}
+
+// Look up every file of the directory.
+void
+lookall(void)
+{
+    struct stat st;
+    int i;
+
+    for (i = 0; i < NFILE; i++)
+        assert(stat(path(i), &st) == 0 && st.type == T_FILE);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct bcachestat s0, s1;
+    int i, fd, n;
+    ppid = getpid();
+
+    assert(mkdir("scandir") == 0);
+    for (i = 0; i < NFILE; i++) {
+        fd = open(path(i), O_CREATE | O_RDWR);
+        assert(fd >= 0);
+        close(fd);
+    }
+    lookall();
+
+    // Stream more blocks than the cache holds.
+    assert(bcachestat(&s0) == 0);
+    n = s0.nbuf + s0.nbuf / 4;
+    fd = open("scanbig", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < n; i++) {
+        memset(buf, 'a' + i % 26, BSIZE);
+        assert(write(fd, buf, BSIZE) == BSIZE);
+    }
+    close(fd);
+    assert(bcachestat(&s1) == 0);
+    assert(s1.evictions > s0.evictions);
+    assert(s1.nhot > 0 && s1.nhot < s1.nbuf);
+
+    // The directory's blocks were on the hot list all along.
+    assert(bcachestat(&s0) == 0);
+    lookall();
+    assert(bcachestat(&s1) == 0);
+    assert(s1.misses == s0.misses);
+    assert(s1.hits > s0.hits);
+
+    assert(unlink("scanbig") == 0);
+    for (i = 0; i < NFILE; i++)
+        assert(unlink(path(i)) == 0);
+    assert(unlink("scandir") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,88 @@
+/* The kstat device has per-CPU log2 histograms of run queue
+ * delay and of time run per switch, and each wakeup adds to
+ * them. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define KSTATSIZE 16384
+#define NSLEEP 10
+
+char buf[KSTATSIZE + 1];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Read all of kstat into buf.
+void
+snapshot(void)
+{
+    int fd, n;
+
+    fd = open("/kstat", O_RDONLY);
+    assert(fd >= 0);
+    n = read(fd, buf, KSTATSIZE);
+    assert(n > 0 && n < KSTATSIZE);
+    buf[n] = 0;
+    close(fd);
+}
+
+// If s starts with prefix, the rest of s; else 0.
+char*
+skip(char *s, char *prefix)
+{
+    while (*prefix)
+        if (*s++ != *prefix++)
+            return 0;
+    return s;
+}
+
+// Sum of the counters named sched.hist.<cpu>.<bucket>.
+int
+total(char *hist)
+{
+    char *p, *q;
+    int sum, bucket;
+
+    sum = 0;
+    for (p = buf; *p; p = strchr(p, '\n') + 1) {
+        if ((q = skip(p, "sched.")) == 0 || (q = skip(q, hist)) == 0 || *q != '.')
+            continue;
+        q = strchr(q + 1, '.');
+        assert(q != 0);
+        bucket = atoi(q + 1);
+        assert(bucket >= 0 && bucket < 24);
+        q = strchr(q, ' ');
+        assert(q != 0);
+        sum += atoi(q + 1);
+    }
+    return sum;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, rq0, sl0, rq1, sl1;
+
+    snapshot();
+    rq0 = total("rqdelay");
+    sl0 = total("slice");
+    assert(rq0 > 0 && sl0 > 0);
+
+    for (i = 0; i < NSLEEP; i++)
+        sleep(1);
+
+    snapshot();
+    rq1 = total("rqdelay");
+    sl1 = total("slice");
+    printf(1, "schedhisttest: %d switches, %d slices\n", rq1 - rq0, sl1 - sl0);
+    assert(rq1 - rq0 >= NSLEEP);
+    assert(sl1 - sl0 >= NSLEEP);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
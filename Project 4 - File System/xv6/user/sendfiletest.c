@@ -0,0 +1,84 @@
+/* sendfile from a file into a pipe and into another file. */
+#include "types.h"
+#include "user.h"
+
+#define O_RDONLY  0x000
+#define O_WRONLY  0x001
+#define O_RDWR    0x002
+#define O_CREATE  0x200
+
+#define N 10000  // more than a pipe holds
+
+int ppid;
+char buf[N];
+char got[N];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+static int
+same(char *a, char *b, int n)
+{
+    while (n-- > 0)
+        if (*a++ != *b++)
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd, fd2, p[2], i, n, tot;
+
+    for (i = 0; i < N; i++) {
+        buf[i] = 'a' + i % 26;
+    }
+    fd = open("send.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(write(fd, buf, N) == N);
+    close(fd);
+
+    // File to pipe, using and advancing the file offset.
+    assert(pipe(p) == 0);
+    if (fork() == 0) {
+        close(p[0]);
+        fd = open("send.tmp", O_RDONLY);
+        assert(sendfile(p[1], fd, -1, 100) == 100);
+        assert(sendfile(p[1], fd, -1, N) == N - 100);
+        assert(sendfile(p[1], fd, -1, N) == 0);
+        exit();
+    }
+    close(p[1]);
+    tot = 0;
+    while ((n = read(p[0], got + tot, N - tot)) > 0)
+        tot += n;
+    close(p[0]);
+    wait();
+    assert(tot == N);
+    assert(same(got, buf, N));
+
+    // File to file at an explicit offset; fd's offset stays put.
+    fd = open("send.tmp", O_RDONLY);
+    fd2 = open("send2.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0 && fd2 >= 0);
+    assert(sendfile(fd2, fd, 1000, N) == N - 1000);
+    assert(read(fd, got, 10) == 10 && got[0] == 'a');
+    assert(sendfile(fd, fd2, 0, 10) == -1);  // fd isn't writable
+    close(fd2);
+    fd2 = open("send2.tmp", O_RDONLY);
+    assert(read(fd2, got, N) == N - 1000);
+    assert(same(got, buf + 1000, N - 1000));
+    close(fd);
+    close(fd2);
+
+    unlink("send.tmp");
+    unlink("send2.tmp");
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -3,6 +3,7 @@
 #include "types.h"
 #include "user.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Parsed command representation
 #define EXEC  1
@@ -52,12 +53,76 @@ struct backcmd {
 int fork1(void);  // Fork but panics on failure.
 void panic(char*);
 struct cmd *parsecmd(char*);
+void runcmd(struct cmd*);
+
+// Start cmd in a child, with acts done to its files first, and
+// return its pid, or -1 if it couldn't start.  A command with
+// only redirections is spawned, so the shell isn't copied just
+// to be replaced; anything else runs in a forked shell.
+int
+launch(struct cmd *cmd, struct spawnact *acts, int nact)
+{
+  struct execcmd *ecmd;
+  struct redircmd *rcmd;
+  int i, fd, pid;
+
+  if(cmd && cmd->type == EXEC){
+    ecmd = (struct execcmd*)cmd;
+    if(ecmd->argv[0] == 0)
+      return -1;
+    if((pid = spawn(ecmd->argv[0], ecmd->argv, acts, nact)) < 0)
+      printf(2, "exec %s failed\n", ecmd->argv[0]);
+    return pid;
+  }
+  if(cmd && cmd->type == REDIR && nact + 2 <= SPAWN_MAX){
+    rcmd = (struct redircmd*)cmd;
+    if((fd = open(rcmd->file, rcmd->mode)) < 0){
+      printf(2, "open %s failed\n", rcmd->file);
+      return -1;
+    }
+    acts[nact].op = SPAWN_DUP2;
+    acts[nact].fd = fd;
+    acts[nact].newfd = rcmd->fd;
+    acts[nact+1].op = SPAWN_CLOSE;
+    acts[nact+1].fd = fd;
+    pid = launch(rcmd->cmd, acts, nact + 2);
+    close(fd);
+    return pid;
+  }
+
+  if((pid = fork1()) == 0){
+    for(i = 0; i < nact; i++){
+      close(acts[i].op == SPAWN_DUP2 ? acts[i].newfd : acts[i].fd);
+      if(acts[i].op == SPAWN_DUP2)
+        dup(acts[i].fd);
+    }
+    runcmd(cmd);
+  }
+  return pid;
+}
+
+// Start the two sides of a pipe, the left writing p[1].
+int
+launchpipe(struct cmd *cmd, int p[2], int fd)
+{
+  struct spawnact acts[SPAWN_MAX];
+
+  acts[0].op = SPAWN_DUP2;
+  acts[0].fd = p[fd];
+  acts[0].newfd = fd;
+  acts[1].op = SPAWN_CLOSE;
+  acts[1].fd = p[0];
+  acts[2].op = SPAWN_CLOSE;
+  acts[2].fd = p[1];
+  return launch(cmd, acts, 3);
+}
 
 // Execute cmd.  Never returns.
 void
 runcmd(struct cmd *cmd)
 {
-  int p[2];
+  int p[2], n;
+  struct spawnact acts[SPAWN_MAX];
   struct backcmd *bcmd;
   struct execcmd *ecmd;
   struct listcmd *lcmd;
@@ -91,9 +156,8 @@ runcmd(struct cmd *cmd)
 
   case LIST:
     lcmd = (struct listcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(lcmd->left);
-    wait();
+    if(launch(lcmd->left, acts, 0) > 0)
+      wait();
     runcmd(lcmd->right);
     break;
 
@@ -101,30 +165,16 @@ runcmd(struct cmd *cmd)
     pcmd = (struct pipecmd*)cmd;
     if(pipe(p) < 0)
       panic("pipe");
-    if(fork1() == 0){
-      close(1);
-      dup(p[1]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->left);
-    }
-    if(fork1() == 0){
-      close(0);
-      dup(p[0]);
-      close(p[0]);
-      close(p[1]);
-      runcmd(pcmd->right);
-    }
+    n = (launchpipe(pcmd->left, p, 1) > 0) + (launchpipe(pcmd->right, p, 0) > 0);
     close(p[0]);
     close(p[1]);
-    wait();
-    wait();
+    while(n-- > 0)
+      wait();
     break;
     
   case BACK:
     bcmd = (struct backcmd*)cmd;
-    if(fork1() == 0)
-      runcmd(bcmd->cmd);
+    launch(bcmd->cmd, acts, 0);
     break;
   }
   exit();
@@ -134,9 +184,7 @@ int
 getcmd(char *buf, int nbuf)
 {
   printf(2, "$ ");
-  memset(buf, 0, nbuf);
-  gets(buf, nbuf);
-  if(buf[0] == 0) // EOF
+  if(readline(0, buf, nbuf) <= 0) // EOF
     return -1;
   return 0;
 }
@@ -145,6 +193,7 @@ int
 main(void)
 {
   static char buf[100];
+  struct spawnact acts[SPAWN_MAX];
   int fd;
   
   // Assumes three file descriptors open.
@@ -165,9 +214,8 @@ main(void)
         printf(2, "cannot cd %s\n", buf+3);
       continue;
     }
-    if(fork1() == 0)
-      runcmd(parsecmd(buf));
-    wait();
+    if(launch(parsecmd(buf), acts, 0) > 0)
+      wait();
   }
   exit();
 }
@@ -0,0 +1,87 @@
+/* Under memory pressure the page cache gives its pages back to
+ * kalloc, and the file reads the same from disk afterwards. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "swapstat.h"
+#include "ShrinkStat.h"
+
+#define PGSIZE 4096
+#define FILEPG 256   // pages of file to cache
+#define CHUNK  256   // pages per sbrk
+
+char buf[PGSIZE];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Pages the page cache has given back so far.
+uint
+pcfreed(void)
+{
+    struct ShrinkStat t[NSHRINKER];
+    int i, n;
+
+    n = shrinkstat(t, NSHRINKER);
+    assert(n > 0);
+    for (i = 0; i < n; i++)
+        if (strcmp(t[i].name, "pcache") == 0)
+            return t[i].freed;
+    assert(0);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct swapstat s0, s1;
+    uint freed0;
+    char *base;
+    int fd, i, j, npage;
+
+    // Fill the page cache with a file.
+    fd = open("shrink.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < FILEPG; i++) {
+        memset(buf, 'a' + i % 26, PGSIZE);
+        assert(write(fd, buf, PGSIZE) == PGSIZE);
+    }
+    for (i = 0; i < FILEPG; i++)
+        assert(pread(fd, buf, PGSIZE, i*PGSIZE) == PGSIZE);
+    freed0 = pcfreed();
+
+    // Use up memory until the cache gives some back; by the time
+    // pages go to swap, it must have.
+    assert(swapstat(&s0) == 0);
+    base = sbrk(0);
+    for (npage = 0; pcfreed() == freed0; npage += CHUNK) {
+        assert(swapstat(&s1) == 0);
+        if (s1.out - s0.out > CHUNK)
+            break;
+        if (sbrk(CHUNK*PGSIZE) == (char*)-1)
+            break;
+        for (i = npage; i < npage + CHUNK; i++)
+            base[i*PGSIZE] = 1;
+    }
+    printf(1, "shrinktest: %d pages, %d from the page cache\n",
+           npage, pcfreed() - freed0);
+    assert(pcfreed() > freed0);
+    assert(sbrk(-npage*PGSIZE) != (char*)-1);
+
+    // The file is intact.
+    for (i = 0; i < FILEPG; i++) {
+        assert(pread(fd, buf, PGSIZE, i*PGSIZE) == PGSIZE);
+        for (j = 0; j < PGSIZE; j += 512)
+            assert(buf[j] == 'a' + i % 26);
+    }
+    close(fd);
+    assert(unlink("shrink.tmp") == 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
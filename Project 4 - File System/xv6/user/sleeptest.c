@@ -0,0 +1,62 @@
+/* sleep() waits at least its ticks, across timer wheel levels. */
+#include "types.h"
+#include "user.h"
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int n[] = { 1, 2, 5, 63, 64, 65, 127, 130 };
+#define NN (sizeof(n)/sizeof(n[0]))
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int i, pid, t0, t;
+
+    assert(sleep(0) == 0);
+    for (i = 0; i < NN; i++) {
+        t0 = uptime();
+        assert(sleep(n[i]) == 0);
+        t = uptime() - t0;
+        assert(t >= n[i] && t <= n[i] + 10);
+    }
+
+    // Sleepers with different deadlines all wake.
+    for (i = 0; i < NN; i++) {
+        pid = fork();
+        assert(pid >= 0);
+        if (pid == 0) {
+            sleep(n[i]);
+            exit();
+        }
+    }
+    t0 = uptime();
+    for (i = 0; i < NN; i++)
+        assert(wait() >= 0);
+    t = uptime() - t0;
+    assert(t >= n[NN-1] && t <= n[NN-1] + 10);
+
+    // A killed sleeper wakes at once.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        sleep(100000);
+        exit();
+    }
+    sleep(2);
+    t0 = uptime();
+    kill(pid);
+    assert(wait() == pid);
+    assert(uptime() - t0 < 10);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
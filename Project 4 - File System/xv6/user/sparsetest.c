@@ -0,0 +1,114 @@
+/* Holes made by ftruncate and by writing past the end read as
+ * zeros without touching the buffer cache; ftruncate shrinks
+ * and fallocate preallocates; a hole filled inside the file
+ * stays filled once the inode is dropped from the cache. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "bcachestat.h"
+
+#define NBLK 200  // past NDIRECT, into the indirect block
+
+char buf[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Is buf all c for n bytes?
+int
+all(char c, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (buf[i] != c)
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct bcachestat s0, s1;
+    struct stat st;
+    int fd, b;
+
+    fd = open("sparsetest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+
+    // A file that is all hole.
+    assert(ftruncate(fd, NBLK * sizeof(buf)) == 0);
+    assert(fstat(fd, &st) == 0 && st.size == NBLK * sizeof(buf));
+    assert(bcachestat(&s0) == 0);
+    for (b = 0; b < NBLK; b++) {
+        memset(buf, 'x', sizeof(buf));
+        assert(read(fd, buf, sizeof(buf)) == sizeof(buf));
+        assert(all(0, sizeof(buf)));
+    }
+    assert(bcachestat(&s1) == 0);
+    assert(s1.misses == s0.misses);
+
+    // Part of a block written in the middle of a hole.
+    memset(buf, 'a', sizeof(buf));
+    assert(pwrite(fd, buf, 100, 150 * sizeof(buf) + 10) == 100);
+    assert(pread(fd, buf, sizeof(buf), 150 * sizeof(buf)) == sizeof(buf));
+    assert(all(0, 10) && buf[10] == 'a' && buf[109] == 'a' && buf[110] == 0);
+
+    // Shrinking into that block zeroes the rest, so growing
+    // again shows zeros, not the old bytes.
+    assert(ftruncate(fd, 150 * sizeof(buf) + 50) == 0);
+    assert(fstat(fd, &st) == 0 && st.size == 150 * sizeof(buf) + 50);
+    assert(ftruncate(fd, NBLK * sizeof(buf)) == 0);
+    assert(pread(fd, buf, sizeof(buf), 150 * sizeof(buf)) == sizeof(buf));
+    assert(buf[49] == 'a' && buf[50] == 0 && buf[109] == 0);
+
+    // Writing past the end leaves a hole behind it.
+    memset(buf, 'b', sizeof(buf));
+    assert(pwrite(fd, buf, 4, (NBLK + 20) * sizeof(buf)) == 4);
+    assert(fstat(fd, &st) == 0 && st.size == (NBLK + 20) * sizeof(buf) + 4);
+    assert(pread(fd, buf, sizeof(buf), (NBLK + 10) * sizeof(buf)) == sizeof(buf));
+    assert(all(0, sizeof(buf)));
+
+    // fallocate fills holes with zeroed blocks and extends.
+    assert(fallocate(fd, 0, (NBLK + 40) * sizeof(buf)) == 0);
+    assert(fstat(fd, &st) == 0 && st.size == (NBLK + 40) * sizeof(buf));
+    assert(pread(fd, buf, sizeof(buf), 10 * sizeof(buf)) == sizeof(buf));
+    assert(all(0, sizeof(buf)));
+    assert(pread(fd, buf, 4, (NBLK + 20) * sizeof(buf)) == 4);
+    assert(all('b', 4));
+
+    // Down to nothing.
+    assert(ftruncate(fd, 0) == 0);
+    assert(fstat(fd, &st) == 0 && st.size == 0);
+    assert(pread(fd, buf, sizeof(buf), 0) == 0);
+    close(fd);
+    assert(unlink("sparsetest.tmp") == 0);
+
+    // A direct block filling a hole, with the size unchanged,
+    // is still there when the inode is read from disk again.
+    fd = open("sparsetest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(ftruncate(fd, 8 * sizeof(buf)) == 0);
+    close(fd);
+    fd = open("sparsetest.tmp", O_RDWR);
+    assert(fd >= 0);
+    memset(buf, 'c', sizeof(buf));
+    assert(pwrite(fd, buf, 100, 3 * sizeof(buf) + 20) == 100);
+    close(fd);
+    assert(dropcaches() == 0);
+    fd = open("sparsetest.tmp", O_RDONLY);
+    assert(fd >= 0);
+    assert(fstat(fd, &st) == 0 && st.size == 8 * sizeof(buf));
+    assert(pread(fd, buf, sizeof(buf), 3 * sizeof(buf)) == sizeof(buf));
+    assert(all(0, 20) && buf[20] == 'c' && buf[119] == 'c' && buf[120] == 0);
+    close(fd);
+    assert(unlink("sparsetest.tmp") == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
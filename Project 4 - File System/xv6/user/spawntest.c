@@ -0,0 +1,70 @@
+/* spawn starts a program in a child without fork, doing its file
+ * actions first, and rejects bad ones. */
+#include "types.h"
+#include "user.h"
+#include "spawn.h"
+
+int ppid;
+char buf[64];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct spawnact acts[SPAWN_MAX + 1];
+    char *echo[] = { "echo", "spawned", 0 };
+    char *nope[] = { "nosuchprogram", 0 };
+    int p[2], pid, n, i;
+    ppid = getpid();
+
+    // Output through a pipe set up by the actions.
+    assert(pipe(p) == 0);
+    acts[0].op = SPAWN_DUP2;
+    acts[0].fd = p[1];
+    acts[0].newfd = 1;
+    acts[1].op = SPAWN_CLOSE;
+    acts[1].fd = p[0];
+    acts[2].op = SPAWN_CLOSE;
+    acts[2].fd = p[1];
+    pid = spawn("echo", echo, acts, 3);
+    assert(pid > 0);
+    close(p[1]);
+    for(n = 0; (i = read(p[0], buf + n, sizeof(buf) - 1 - n)) > 0; n += i)
+        ;
+    buf[n] = 0;
+    close(p[0]);
+    assert(strcmp(buf, "spawned\n") == 0);
+    assert(wait() == pid);
+
+    // Nothing is started for a bad program or bad actions.
+    assert(spawn("nosuchprogram", nope, 0, 0) == -1);
+    acts[0].op = SPAWN_CLOSE;
+    acts[0].fd = 15;
+    assert(spawn("echo", echo, acts, 1) == -1);
+    acts[0].op = 99;
+    acts[0].fd = 0;
+    assert(spawn("echo", echo, acts, 1) == -1);
+    acts[0].op = SPAWN_DUP2;
+    acts[0].newfd = -1;
+    assert(spawn("echo", echo, acts, 1) == -1);
+    assert(spawn("echo", echo, acts, SPAWN_MAX + 1) == -1);
+    assert(wait() == -1);
+
+    // A closed fd stays closed only in the child.
+    acts[0].op = SPAWN_CLOSE;
+    acts[0].fd = 1;
+    pid = spawn("echo", echo, acts, 1);
+    assert(pid > 0);
+    assert(wait() == pid);
+    assert(write(1, "", 0) == 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
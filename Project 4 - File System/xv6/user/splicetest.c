@@ -0,0 +1,67 @@
+/* tee and splice between pipes. */
+#include "types.h"
+#include "user.h"
+
+#define N 10000  // more than a pipe holds
+
+int ppid;
+char buf[N];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int a[2], b[2], c[2], i, n, tot;
+
+    assert(pipe(a) == 0 && pipe(b) == 0 && pipe(c) == 0);
+    assert(write(a[1], "hello world", 11) == 11);
+    assert(tee(a[0], c[1], 5) == 5);        // a keeps its data
+    assert(splice(a[0], b[1], 100) == 11);  // a is drained
+    assert(read(c[0], buf, sizeof(buf)) == 5);
+    assert(buf[0] == 'h' && buf[4] == 'o');
+    assert(read(b[0], buf, sizeof(buf)) == 11);
+    assert(buf[6] == 'w' && buf[10] == 'd');
+    assert(splice(a[0], a[1], 1) == -1);    // same pipe
+    assert(splice(b[1], a[1], 1) == -1);    // not the read end
+
+    // Forward more than a pipe holds from a writer to a reader.
+    if (fork() == 0) {
+        close(a[0]);
+        for (i = 0; i < N; i++) {
+            buf[i] = 'a' + i % 26;
+        }
+        assert(write(a[1], buf, N) == N);
+        exit();
+    }
+    close(a[1]);
+    if (fork() == 0) {
+        close(b[1]);
+        tot = 0;
+        while ((n = read(b[0], buf + tot, N - tot)) > 0)
+            tot += n;
+        assert(tot == N);
+        for (i = 0; i < N; i++) {
+            assert(buf[i] == 'a' + i % 26);
+        }
+        exit();
+    }
+    close(b[0]);
+    tot = 0;
+    while ((n = splice(a[0], b[1], N)) > 0)
+        tot += n;
+    assert(n == 0 && tot == N);
+    close(b[1]);
+    wait();
+    wait();
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,89 @@
+/* the stack starts at the top of user memory and grows down on
+ * faults: deep recursion and big stack buffers work, in system
+ * calls and across fork too, and running past USTACK hits the
+ * guard page and kills the process. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+
+#define FRAME 4000
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Use n frames of about FRAME bytes each.
+int
+deep(int n)
+{
+    volatile char buf[FRAME];
+    int i;
+
+    for (i = 0; i < FRAME; i += 512)
+        buf[i] = n;
+    if (n == 0)
+        return 0;
+    i = deep(n - 1);
+    return i + (buf[0] == (char)n);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char big[5*4096];
+    int local, pid, fd[2], i;
+    ppid = getpid();
+
+    assert((uint)&local > USTACK && (uint)&local < USTACKTOP);
+    assert((uint)sbrk(0) < USTACK);
+
+    // 2 MB of frames.
+    assert(deep(500) == 500);
+
+    // A system call writes into stack pages not touched yet.
+    assert(pipe(fd) == 0);
+    assert(write(fd[1], "stack", 6) == 6);
+    assert(read(fd[0], big, 6) == 6);
+    assert(strcmp(big, "stack") == 0);
+    close(fd[0]);
+    close(fd[1]);
+
+    // A child has a copy of the stack.
+    local = 1;
+    for (i = 0; i < sizeof(big); i += 4096)
+        big[i] = i / 4096;
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(local == 1);
+        for (i = 0; i < sizeof(big); i += 4096)
+            assert(big[i] == i / 4096);
+        local = 2;
+        big[0] = 9;
+        assert(deep(100) == 100);
+        exit();
+    }
+    assert(wait() == pid);
+    assert(local == 1 && big[0] == 0);
+
+    // Off the end of the stack.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        deep((USTACKTOP - USTACK) / FRAME + 2);
+        printf(1, "stacktest: ran past the guard page\n");
+        printf(1, "TEST FAILED\n");
+        kill(ppid);
+        exit();
+    }
+    assert(wait() == pid);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,76 @@
+/* Streams hold output until they are full, flushed or closed,
+ * and printf to a stream's fd goes through the stream. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+int ppid;
+char buf[2048];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+size(int fd)
+{
+    struct stat st;
+
+    assert(fstat(fd, &st) == 0);
+    return st.size;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int fd, i;
+    FILE *f;
+
+    fd = open("stdiotest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    assert(fdopen(fd, "r") == 0);
+    f = fdopen(fd, "w");
+    assert(f != 0);
+
+    // Files are fully buffered.
+    assert(fwrite("hello\n", 1, 6, f) == 6);
+    fprintf(f, "%d %s\n", 42, "x");
+    printf(fd, "%c%x\n", 'p', 255);
+    assert(size(fd) == 0);
+    assert(fflush(f) == 0);
+    assert(size(fd) == 15);
+
+    // A full buffer goes out by itself; a big write skips it.
+    for (i = 0; i < 600; i++)
+        fwrite("a", 1, 1, f);
+    assert(size(fd) == 15 + 512);
+    assert(fflush(f) == 0);
+    memset(buf, 'b', sizeof(buf));
+    assert(fwrite(buf, 4, 512, f) == 512);
+    assert(size(fd) == 15 + 600 + 2048);
+
+    fprintf(f, "end");
+    assert(fclose(f) == 0);
+    fd = open("stdiotest.tmp", O_RDONLY);
+    assert(fd >= 0);
+    assert(read(fd, buf, 15) == 15);
+    buf[15] = 0;
+    assert(strcmp(buf, "hello\n42 x\npFF\n") == 0);
+    assert(size(fd) == 15 + 600 + 2048 + 3);
+    close(fd);
+    assert(unlink("stdiotest.tmp") == 0);
+
+    // The console is line buffered.
+    f = fdopen(1, "w");
+    assert(f != 0);
+    fprintf(f, "TEST ");
+    fprintf(f, "PASSED\n");
+    fflush(f);
+    exit();
+}
@@ -0,0 +1,114 @@
+/* memmove, memset and strlen work a word at a time once aligned:
+ * against byte-at-a-time copies, they agree for every alignment of
+ * head and tail, for sizes around the word and the 16-byte cutoff,
+ * for zero lengths, and for moves overlapping either way, and leave
+ * the bytes around what they touch alone. */
+#include "types.h"
+#include "user.h"
+
+#define N 256
+#define PAD 16
+
+int ppid;
+char buf[N + 2*PAD], want[N + 2*PAD], tmp[N];
+int sizes[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 19, 20, 23,
+                31, 32, 33, 63, 64, 65, 100, 127, 128, 129, 200 };
+
+#define NSIZE (sizeof(sizes) / sizeof(sizes[0]))
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Fill both buffers with the same bytes, none of them zero.
+void
+fill(void)
+{
+    int i;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = want[i] = 1 + (i * 7) % 251;
+}
+
+void
+same(void)
+{
+    int i;
+
+    for (i = 0; i < sizeof(buf); i++)
+        assert(buf[i] == want[i]);
+}
+
+// Move n bytes from src to dst offsets of buf, and the same in want
+// a byte at a time through tmp.
+void
+move(int dst, int src, int n)
+{
+    int i;
+
+    fill();
+    for (i = 0; i < n; i++)
+        tmp[i] = want[src + i];
+    for (i = 0; i < n; i++)
+        want[dst + i] = tmp[i];
+    assert(memmove(buf + dst, buf + src, n) == buf + dst);
+    same();
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, s, d, off, n, c;
+    ppid = getpid();
+
+    // Apart, every alignment of source and destination.
+    for (i = 0; i < NSIZE; i++)
+        for (s = 0; s < 4; s++)
+            for (d = 0; d < 4; d++) {
+                n = sizes[i];
+                if (n > N/2 - 8)
+                    continue;
+                move(PAD + d, PAD + N/2 + s, n);
+                move(PAD + N/2 + d, PAD + s, n);
+            }
+
+    // Overlapping, forward and backward, by less and more than a word.
+    for (i = 0; i < NSIZE; i++)
+        for (s = 0; s < 4; s++)
+            for (d = -9; d <= 9; d++) {
+                n = sizes[i];
+                if (d == 0 || n + 12 > N)
+                    continue;
+                move(PAD + 10 + s + d, PAD + 10 + s, n);
+            }
+
+    // memset, with c taken as a byte.
+    for (i = 0; i < NSIZE; i++)
+        for (off = 0; off < 4; off++)
+            for (c = 0; c < 2; c++) {
+                n = sizes[i];
+                fill();
+                for (s = 0; s < n; s++)
+                    want[PAD + off + s] = c ? 0xAB : 0;
+                assert(memset(buf + PAD + off, c ? 0x1AB : 0, n) == buf + PAD + off);
+                same();
+            }
+
+    // strlen from every alignment, with the zero at every alignment,
+    // among bytes with the high and low bits set.
+    for (off = 0; off < 8; off++)
+        for (n = 0; n < 70; n++) {
+            fill();
+            for (s = 0; s < n; s++)
+                buf[PAD + off + s] = s & 1 ? 0x80 : 0x01;
+            buf[PAD + off + n] = 0;
+            assert(strlen(buf + PAD + off) == n);
+        }
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
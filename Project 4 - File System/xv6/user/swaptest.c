@@ -0,0 +1,94 @@
+/* Grow the heap past physical memory: pages go out to the swap
+ * disk and come back with their contents, in a forked child
+ * too, and shrinking the heap frees their swap. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "swapstat.h"
+
+#define PGSIZE 4096
+#define CHUNK  256   // pages per sbrk
+#define MINOUT 1024  // pages swapped out before we stop growing
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+char *base;
+int npage;
+
+// Do page i's first and last words hold what fill put there?
+int
+check(int i)
+{
+    int *p = (int*)(base + i*PGSIZE);
+
+    return p[0] == i*7 + 1 && p[PGSIZE/sizeof(int) - 1] == ~i;
+}
+
+void
+fill(int i)
+{
+    int *p = (int*)(base + i*PGSIZE);
+
+    p[0] = i*7 + 1;
+    p[PGSIZE/sizeof(int) - 1] = ~i;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct swapstat s0, s1, s2;
+    int i, pid;
+
+    assert(swapstat(&s0) == 0);
+    if (s0.size == 0) {
+        printf(1, "swaptest: no swap disk\n");
+        printf(1, "TEST PASSED\n");
+        exit();
+    }
+
+    // Grow until enough has gone out, or swap is half full.
+    base = sbrk(0);
+    for (;;) {
+        assert(swapstat(&s1) == 0);
+        if (s1.out - s0.out >= MINOUT || npage + CHUNK > s0.size / 2)
+            break;
+        if (sbrk(CHUNK*PGSIZE) == (char*)-1)
+            break;
+        for (i = npage; i < npage + CHUNK; i++)
+            fill(i);
+        npage += CHUNK;
+    }
+    printf(1, "swaptest: %d pages, %d swapped out\n", npage, s1.out - s0.out);
+    assert(s1.out - s0.out >= MINOUT);
+
+    // Everything reads back, some of it from disk.
+    for (i = 0; i < npage; i++)
+        assert(check(i));
+    assert(swapstat(&s1) == 0);
+    assert(s1.in > s0.in);
+
+    // A child sees the same pages, swapped out or not.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        for (i = 0; i < npage; i += 7)
+            assert(check(i));
+        exit();
+    }
+    assert(wait() == pid);
+    for (i = 0; i < npage; i += 5)
+        assert(check(i));
+
+    // Shrinking gives back the swap.
+    assert(swapstat(&s1) == 0);
+    assert(sbrk(-npage*PGSIZE) != (char*)-1);
+    assert(swapstat(&s2) == 0);
+    assert(s2.used < s1.used);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
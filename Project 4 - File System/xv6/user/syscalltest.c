@@ -0,0 +1,60 @@
+/* System calls by sysenter and by int $T_SYSCALL agree, and fork
+ * and exec return properly from either. */
+#include "types.h"
+#include "user.h"
+#include "syscall.h"
+#include "traps.h"
+
+#define N 20000
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+intgetpid(void)
+{
+    int r;
+
+    asm volatile("int %1" : "=a" (r) : "i" (T_SYSCALL), "a" (SYS_getpid) : "memory");
+    return r;
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    int i, pid, t0, t1, t2;
+    char *args[] = { "echo", "exec", "ok", 0 };
+
+    assert(intgetpid() == ppid);
+
+    // The child of a sysenter fork leaves the kernel by iret.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(getpid() != ppid);
+        assert(intgetpid() == getpid());
+        exec("echo", args);
+        assert(0);
+    }
+    assert(wait() == pid);
+
+    t0 = uptime();
+    for (i = 0; i < N; i++)
+        assert(getpid() == ppid);
+    t1 = uptime();
+    for (i = 0; i < N; i++)
+        assert(intgetpid() == ppid);
+    t2 = uptime();
+    printf(1, "%d getpids: sysenter %d ticks, int %d ticks\n", N, t1 - t0, t2 - t1);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
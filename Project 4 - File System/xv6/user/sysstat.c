@@ -0,0 +1,140 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "syscall.h"
+#include "SyscallStat.h"
+
+static char *names[] = {
+[SYS_fork]    "fork",
+[SYS_exit]    "exit",
+[SYS_wait]    "wait",
+[SYS_pipe]    "pipe",
+[SYS_write]   "write",
+[SYS_read]    "read",
+[SYS_close]   "close",
+[SYS_kill]    "kill",
+[SYS_exec]    "exec",
+[SYS_open]    "open",
+[SYS_mknod]   "mknod",
+[SYS_unlink]  "unlink",
+[SYS_fstat]   "fstat",
+[SYS_link]    "link",
+[SYS_mkdir]   "mkdir",
+[SYS_chdir]   "chdir",
+[SYS_dup]     "dup",
+[SYS_getpid]  "getpid",
+[SYS_sbrk]    "sbrk",
+[SYS_sleep]   "sleep",
+[SYS_uptime]  "uptime",
+[SYS_tagFile] "tagFile",
+[SYS_removeFileTag] "removeFileTag",
+[SYS_getFileTag] "getFileTag",
+[SYS_getAllTags] "getAllTags",
+[SYS_getFilesByTag] "getFilesByTag",
+[SYS_bcachestat] "bcachestat",
+[SYS_sync]    "sync",
+[SYS_fsync]   "fsync",
+[SYS_idestat] "idestat",
+[SYS_tagFileBatch] "tagFileBatch",
+[SYS_getFileTags] "getFileTags",
+[SYS_pread]   "pread",
+[SYS_pwrite]  "pwrite",
+[SYS_readv]   "readv",
+[SYS_writev]  "writev",
+[SYS_mmap]    "mmap",
+[SYS_sendfile] "sendfile",
+[SYS_splice]  "splice",
+[SYS_tee]     "tee",
+[SYS_getprocs] "getprocs",
+[SYS_setaffinity] "setaffinity",
+[SYS_lockstat] "lockstat",
+[SYS_ringenter] "ringenter",
+[SYS_syscallstat] "syscallstat",
+[SYS_clock_gettime] "clock_gettime",
+[SYS_intrstat] "intrstat",
+[SYS_irqaffinity] "irqaffinity",
+[SYS_profctl] "profctl",
+[SYS_profread] "profread",
+[SYS_tracectl] "tracectl",
+[SYS_traceread] "traceread",
+[SYS_spawn] "spawn",
+[SYS_ftruncate] "ftruncate",
+[SYS_fallocate] "fallocate",
+[SYS_poll] "poll",
+[SYS_fcntl] "fcntl",
+[SYS_mount] "mount",
+[SYS_socket] "socket",
+[SYS_bind] "bind",
+[SYS_connect] "connect",
+[SYS_sendmmsg] "sendmmsg",
+[SYS_recvmmsg] "recvmmsg",
+[SYS_swapstat] "swapstat",
+[SYS_shrinkstat] "shrinkstat",
+[SYS_ksm] "ksm",
+[SYS_getdents_stat] "getdents_stat",
+[SYS_getprocstat] "getprocstat",
+[SYS_perfctr] "perfctr",
+[SYS_latencyctl] "latencyctl",
+[SYS_getlatency] "getlatency",
+[SYS_aio_setup] "aio_setup",
+[SYS_aio_read] "aio_read",
+[SYS_aio_write] "aio_write",
+[SYS_getFilesByQuery] "getFilesByQuery",
+[SYS_getFilesByTagPage] "getFilesByTagPage",
+[SYS_notify_open] "notify_open",
+[SYS_copy_file_range] "copy_file_range",
+[SYS_mktemplate] "mktemplate",
+[SYS_spawn_from] "spawn_from",
+[SYS_madvise] "madvise",
+[SYS_vmsplice] "vmsplice",
+[SYS_dropcaches] "dropcaches",
+};
+
+// Print the system call counters, the calls that took longest
+// first.  With a pid, print just that process's call counts.
+// Cycle counts are in units of 1024 cycles.  HIST is the latency
+// histogram: its ith number counts calls taking under 2^(10+i)
+// cycles, the last one all longer.
+int
+main(int argc, char *argv[])
+{
+  static struct SyscallStat table[NSYSCALL];
+  static int order[NSYSCALL];
+  int i, j, k, n, pid, t;
+  char *name;
+
+  pid = argc > 1 ? atoi(argv[1]) : 0;
+  if((n = syscallstat(pid, table, NSYSCALL)) < 0){
+    printf(2, "sysstat: syscallstat failed\n");
+    exit();
+  }
+  for(i = 0; i < n; i++){
+    for(j = i; j > 0; j--){
+      k = order[j-1];
+      if(table[k].cycles > table[i].cycles ||
+         (table[k].cycles == table[i].cycles && table[k].count >= table[i].count))
+        break;
+      order[j] = k;
+    }
+    order[j] = i;
+  }
+  printf(1, pid ? "NAME CALLS\n" : "NAME CALLS CYCLES HIST\n");
+  for(i = 0; i < n; i++){
+    t = order[i];
+    if(table[t].count == 0)
+      continue;
+    name = t < sizeof(names)/sizeof(names[0]) && names[t] ? names[t] : "?";
+    if(pid){
+      printf(1, "%s %d\n", name, table[t].count);
+      continue;
+    }
+    printf(1, "%s %d %d", name, table[t].count, (uint)(table[t].cycles >> 10));
+    for(k = NSYSHIST; k > 0 && table[t].hist[k-1] == 0; k--)
+      ;
+    for(j = 0; j < k; j++)
+      printf(1, "%s%d", j ? "," : " ", table[t].hist[j]);
+    printf(1, "\n");
+  }
+  exit();
+}
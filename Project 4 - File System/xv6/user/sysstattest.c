@@ -0,0 +1,72 @@
+/* syscallstat counts and times each system call, in all and per process. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "syscall.h"
+#include "SyscallStat.h"
+
+int ppid;
+struct SyscallStat table[NSYSCALL];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    uint before, mine, sum;
+    int i, pid;
+
+    assert(syscallstat(0, table, -1) == -1);
+    assert(syscallstat(0, table, 0) == 0);
+    assert(syscallstat(-1, table, NSYSCALL) == -1);
+    assert(syscallstat(0, table, NSYSCALL + 10) == NSYSCALL);
+
+    // Ten getpids show up in the total and in ours.
+    assert(syscallstat(ppid, table, NSYSCALL) == NSYSCALL);
+    mine = table[SYS_getpid].count;
+    assert(mine == 1);
+    assert(table[SYS_getpid].cycles == 0);
+    assert(syscallstat(0, table, NSYSCALL) == NSYSCALL);
+    before = table[SYS_getpid].count;
+    for (i = 0; i < 10; i++)
+        getpid();
+    assert(syscallstat(0, table, NSYSCALL) == NSYSCALL);
+    assert(table[SYS_getpid].count >= before + 10);
+    assert(table[SYS_getpid].cycles > 0);
+    assert(table[SYS_syscallstat].count > 0);
+    assert(syscallstat(ppid, table, NSYSCALL) == NSYSCALL);
+    assert(table[SYS_getpid].count == mine + 10);
+
+    // Each finished call is in one histogram bucket; one on
+    // another CPU may be counted and not yet timed.
+    assert(syscallstat(0, table, NSYSCALL) == NSYSCALL);
+    sum = 0;
+    for (i = 0; i < NSYSHIST; i++)
+        sum += table[SYS_getpid].hist[i];
+    assert(sum >= 10 && sum <= table[SYS_getpid].count);
+
+    // A child starts with no counts, and its are only its own.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(syscallstat(getpid(), table, NSYSCALL) == NSYSCALL);
+        assert(table[SYS_getpid].count == 1);
+        assert(table[SYS_fork].count == 0);
+        assert(table[SYS_syscallstat].count == 1);
+        exit();
+    }
+    assert(wait() == pid);
+    assert(syscallstat(ppid, table, NSYSCALL) == NSYSCALL);
+    assert(table[SYS_fork].count == 1);
+    assert(syscallstat(pid, table, NSYSCALL) == -1);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -60,17 +60,28 @@ main(int argc, char *argv[])
    int res15 = tagFile(fd, "M15", "CS", 2);
    assert(res15 > 0);
    int res16 = tagFile(fd, "M16", "CS", 2);
-   assert(res16 < 0);
+   assert(res16 > 0);
    int res17 = tagFile(fd, "M17", "CS", 2);
-   assert(res17 < 0);
+   assert(res17 > 0);
    int res18 = tagFile(fd, "M18", "CS", 2);
-   assert(res18 < 0);
+   assert(res18 > 0);
    int res19 = tagFile(fd, "M19", "CS", 2);
-   assert(res19 < 0);
+   assert(res19 > 0);
    int res20 = tagFile(fd, "M20", "CS", 2);
-   assert(res20 < 0);
+   assert(res20 > 0);
    int res21 = tagFile(fd, "M21", "CS", 2);
-   assert(res21 < 0);
+   assert(res21 > 0);
+
+   // Tags no longer stop at one block's worth.
+   char *longval = "a value longer than the old eighteen bytes";
+   int resLong = tagFile(fd, "a-long-key-name", longval, strlen(longval));
+   assert(resLong > 0);
+   char longbuf[64];
+   assert(getFileTag(fd, "a-long-key-name", longbuf, 64) == strlen(longval));
+   int k;
+   for(k = 0; k < strlen(longval); k++)
+      assert(longbuf[k] == longval[k]);
+   assert(getFileTag(fd, "M21", longbuf, 64) == 2);
 
    char buf[2];
    int valueLength = getFileTag(fd, "M0", buf, 2);
@@ -0,0 +1,59 @@
+/* call tagFileBatch to set several tags at once.  Read them back with getFileTags. */
+#include "types.h"
+#include "user.h"
+
+#define O_RDONLY  0x000
+#define O_WRONLY  0x001
+#define O_RDWR    0x002
+#define O_CREATE  0x200
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct Key keys[4];
+    struct Value vals[4];
+    int fd, i, res;
+
+    fd = open("ls", O_RDWR);
+    assert(fd >= 0);
+    memset(keys, 0, sizeof(keys));
+    memset(vals, 0, sizeof(vals));
+    for (i = 0; i < 3; i++) {
+        strcpy(keys[i].key, "batchX");
+        keys[i].key[5] = '0' + i;
+        strcpy(vals[i].value, "valueX");
+        vals[i].value[5] = '0' + i;
+        vals[i].length = 6;
+    }
+    res = tagFileBatch(fd, keys, vals, 3);
+    assert(res == 3);
+
+    strcpy(keys[3].key, "missing");
+    memset(vals, 0, sizeof(vals));
+    res = getFileTags(fd, keys, vals, 4);
+    assert(res == 3);
+    for (i = 0; i < 3; i++) {
+        assert(vals[i].length == 6);
+        assert(vals[i].value[5] == '0' + i);
+    }
+    assert(vals[3].length == -1);
+
+    char buf[18];
+    res = getFileTag(fd, "batch1", buf, 18);
+    assert(res == 6);
+    assert(buf[5] == '1');
+    close(fd);
+    printf(1, "tagFileBatch test passed\n");
+    exit();
+}
@@ -0,0 +1,224 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "x86.h"
+#include "bcachestat.h"
+
+// Tag subsystem benchmark.
+//
+//   tagbench [-n files] [-k tags]
+//
+// Creates 25, 50, 100, ... up to files empty files (100 by default)
+// in a directory tb, and for 1, 4, 16, ... up to tags tags a file
+// (16 by default) times, per operation:
+//
+//   open      open and close of each file, which every other test
+//             but getbytag also does once per file
+//   tag       tagFile of each key, with a value unique to the file
+//   get       getFileTag of each key
+//   getbytag  getFilesByTag of NQUERY random key and value pairs,
+//             each of which must find just its one file
+//   remove    removeFileTag of each key
+//
+// The disk writes are the buffer cache writebacks during the test
+// and the sync() after it, which is not in the time.  The default
+// file system has few free inodes; build it with make NINODES=...
+// for thousands of files.  Times come from vnsuptime.
+
+#define NFILEMIN 25
+#define NTAGMAX  16
+#define NQUERY   200
+
+static int nfile = 100;
+static int ntag = 16;
+static uint seed = 1;
+static char res[512];
+
+static uint
+rnd(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+// Set s to prefix followed by n in decimal.
+static char*
+numname(char *s, char *prefix, int n)
+{
+  char tmp[12];
+  int i, j;
+
+  strcpy(s, prefix);
+  j = strlen(s);
+  i = 0;
+  do{
+    tmp[i++] = '0' + n % 10;
+  }while((n /= 10) != 0);
+  while(i > 0)
+    s[j++] = tmp[--i];
+  s[j] = 0;
+  return s;
+}
+
+static void
+fail(char *msg, int i)
+{
+  printf(2, "tagbench: %s failed at %d\n", msg, i);
+  exit();
+}
+
+static uint
+writebacks(void)
+{
+  struct bcachestat st;
+
+  if(bcachestat(&st) < 0)
+    return 0;
+  return st.writebacks;
+}
+
+// Run op on each of nf files with nt tags, or just once per file
+// if op is 0, and print the time and disk writes per operation.
+static void
+pass(char *name, int nf, int nt, void (*op)(int, int, int))
+{
+  char path[16];
+  uint64 t0, t1;
+  uint w, ops, ns;
+  int i, j, fd;
+
+  w = writebacks();
+  t0 = vnsuptime();
+  for(i = 0; i < nf; i++){
+    if((fd = open(numname(path, "tb/f", i), O_RDWR)) < 0)
+      fail("open", i);
+    for(j = 0; op && j < nt; j++)
+      op(fd, i, j);
+    close(fd);
+  }
+  t1 = vnsuptime();
+  sync();
+  w = writebacks() - w;
+  ops = op ? nf * nt : nf;
+  ns = div64(t1 - t0, ops, 0);
+  printf(1, "%s %d %d %d %d.%d\n", name, nf, nt, ns, w / ops,
+         w % ops * 10 / ops);
+}
+
+static void
+tag(int fd, int i, int j)
+{
+  char key[8], val[12];
+
+  numname(key, "k", j);
+  numname(val, "v", i);
+  if(tagFile(fd, key, val, strlen(val)) < 0)
+    fail("tagFile", i);
+}
+
+static void
+get(int fd, int i, int j)
+{
+  char key[8], val[12], buf[12];
+
+  numname(key, "k", j);
+  numname(val, "v", i);
+  if(getFileTag(fd, key, buf, sizeof(buf)) != strlen(val))
+    fail("getFileTag", i);
+}
+
+static void
+untag(int fd, int i, int j)
+{
+  char key[8];
+
+  numname(key, "k", j);
+  if(removeFileTag(fd, key) < 0)
+    fail("removeFileTag", i);
+}
+
+static void
+getbytag(int nf, int nt)
+{
+  char key[8], val[12], path[16];
+  uint64 t0, t1;
+  uint w;
+  int i, f;
+
+  w = writebacks();
+  t0 = vnsuptime();
+  for(i = 0; i < NQUERY; i++){
+    f = rnd() % nf;
+    numname(key, "k", rnd() % nt);
+    numname(val, "v", f);
+    if(getFilesByTag(key, val, strlen(val), res, sizeof(res)) != 1 ||
+       strcmp(res, numname(path, "f", f)) != 0)
+      fail("getFilesByTag", f);
+  }
+  t1 = vnsuptime();
+  sync();
+  w = writebacks() - w;
+  printf(1, "getbytag %d %d %d %d.%d\n", nf, nt,
+         (uint)div64(t1 - t0, NQUERY, 0), w / NQUERY, w % NQUERY * 10 / NQUERY);
+}
+
+static void
+bench(int nf, int nt)
+{
+  char path[16];
+  int i, fd;
+
+  for(i = 0; i < nf; i++){
+    if((fd = open(numname(path, "tb/f", i), O_CREATE | O_RDWR)) < 0)
+      fail("create", i);
+    close(fd);
+  }
+  sync();
+  pass("open", nf, nt, 0);
+  pass("tag", nf, nt, tag);
+  pass("get", nf, nt, get);
+  getbytag(nf, nt);
+  pass("remove", nf, nt, untag);
+  for(i = 0; i < nf; i++)
+    unlink(numname(path, "tb/f", i));
+  sync();
+}
+
+static void
+usage(void)
+{
+  printf(2, "usage: tagbench [-n files] [-k tags]\n");
+  exit();
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, nf, nt;
+
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    if(strcmp(argv[i], "-n") == 0)
+      nfile = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-k") == 0)
+      ntag = atoi(argv[i+1]);
+    else
+      usage();
+  }
+  if(i < argc || nfile < 1 || ntag < 1 || ntag > NTAGMAX)
+    usage();
+  if(mkdir("tb") < 0)
+    fail("mkdir", 0);
+
+  printf(1, "TEST FILES TAGS NS/OP WRITES/OP\n");
+  for(nf = nfile < NFILEMIN ? nfile : NFILEMIN; ; nf *= 2){
+    if(nf > nfile)
+      nf = nfile;
+    for(nt = 1; nt <= ntag; nt *= 4)
+      bench(nf, nt);
+    if(nf == nfile)
+      break;
+  }
+  unlink("tb");
+  exit();
+}
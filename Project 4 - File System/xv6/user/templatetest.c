@@ -0,0 +1,96 @@
+/* spawn_from starts copy-on-write clones of a process parked by
+ * mktemplate: each returns from mktemplate with its own argv and
+ * the caller's files, sees what the template set up, and doesn't
+ * change it for the next. */
+#include "types.h"
+#include "user.h"
+
+int ppid;
+int p[2];
+int warm;
+char big[5000];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Set up, drop the pipe, and park; only clones return.
+void
+template(void)
+{
+    char **av;
+    int n;
+
+    warm = 1234;
+    close(p[0]);
+    close(p[1]);
+    n = mktemplate(&av);
+    assert(n == 2);
+    assert(strcmp(av[0], "worker") == 0 && av[2] == 0);
+    printf(p[1], "%s %d\n", av[1], warm);
+    warm++;
+    exit();
+}
+
+// Read a line from the clones' pipe and check it is want.
+void
+expect(char *want)
+{
+    char buf[32];
+    int n, i;
+
+    for(n = 0; n == 0 || buf[n-1] != '\n'; n += i){
+        i = read(p[0], buf + n, sizeof(buf) - 1 - n);
+        assert(i > 0);
+    }
+    buf[n] = 0;
+    assert(strcmp(buf, want) == 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *one[] = { "worker", "one", 0 };
+    char *two[] = { "worker", "two", 0 };
+    char *toobig[] = { "worker", big, 0 };
+    int t, pid, i;
+    ppid = getpid();
+
+    assert(pipe(p) == 0);
+    assert(spawn_from(getpid(), one) == -1);
+    t = fork();
+    assert(t >= 0);
+    if(t == 0)
+        template();
+
+    // Until it parks, t isn't a template.
+    for(i = 0; (pid = spawn_from(t, one)) < 0; i++){
+        assert(i < 100);
+        sleep(1);
+    }
+    expect("one 1234\n");
+    assert(wait() == pid);
+
+    // The first clone's write was its own.
+    pid = spawn_from(t, two);
+    assert(pid > 0);
+    expect("two 1234\n");
+    assert(wait() == pid);
+
+    // Arguments must fit in the template's stack page.
+    memset(big, 'a', sizeof(big) - 1);
+    assert(spawn_from(t, toobig) == -1);
+
+    // Killed, the template exits and can't be cloned.
+    assert(kill(t) == 0);
+    assert(wait() == t);
+    assert(spawn_from(t, one) == -1);
+    assert(wait() == -1);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,131 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "ProcStat.h"
+
+// Show the processes that ran in each interval, busiest first,
+// with their rates over it: CPU use, in user mode and in the
+// kernel, context switches, system calls and disk blocks.
+//
+// Each sample asks getprocstat only for the processes that ran
+// since the last one.  The totals each process had when last
+// seen are kept in last[], by pid, to take differences from.
+//
+// usage: top [-d ticks] [-n samples] [-m lines]
+
+struct row {
+  struct ProcStat *s;
+  uint cpu;      // Ticks run in the interval
+};
+
+static struct ProcStat cur[NPROC];
+static struct ProcStat last[NPROC];
+static struct row rows[NPROC];
+static int nlast;
+
+// The totals pid had when last seen, or 0.
+struct ProcStat*
+lookup(int pid)
+{
+  int i;
+
+  for(i = 0; i < nlast; i++)
+    if(last[i].pid == pid)
+      return &last[i];
+  return 0;
+}
+
+// Remember s's totals for the next sample.  Once last[] fills
+// up with processes long gone, start again from all live ones.
+void
+remember(struct ProcStat *s)
+{
+  struct ProcStat *l;
+
+  if((l = lookup(s->pid)) == 0){
+    if(nlast == NPROC){
+      nlast = getprocstat(last, NPROC, 0);
+      return;
+    }
+    l = &last[nlast++];
+  }
+  *l = *s;
+}
+
+// d per second over dt ticks.
+uint
+rate(uint d, uint dt)
+{
+  return d * HZ / dt;
+}
+
+void
+sample(uint since, uint dt, int max)
+{
+  static struct ProcStat zero;
+  struct ProcStat *s, *l;
+  struct row r;
+  int i, j, n;
+
+  n = getprocstat(cur, NPROC, since);
+  for(i = 0; i < n; i++){
+    if((l = lookup(cur[i].pid)) == 0)
+      l = &zero;
+    r.s = &cur[i];
+    r.cpu = cur[i].uticks + cur[i].sticks - l->uticks - l->sticks;
+    for(j = i; j > 0 && rows[j-1].cpu < r.cpu; j--)
+      rows[j] = rows[j-1];
+    rows[j] = r;
+  }
+
+  printf(1, "\n%d processes ran in %d ticks\n", n, dt);
+  printf(1, "PID %%CPU USR SYS CSW/s ICSW/s SYSC/s BIO/s NAME\n");
+  for(i = 0; i < n && i < max; i++){
+    s = rows[i].s;
+    if((l = lookup(s->pid)) == 0)
+      l = &zero;
+    printf(1, "%d %d %d %d %d %d %d %d %s\n", s->pid,
+           rows[i].cpu * 100 / dt, s->uticks - l->uticks, s->sticks - l->sticks,
+           rate(s->vcsw - l->vcsw, dt), rate(s->ivcsw - l->ivcsw, dt),
+           rate(s->syscalls - l->syscalls, dt), rate(s->bio - l->bio, dt),
+           s->name);
+  }
+  for(i = 0; i < n; i++)
+    remember(&cur[i]);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, delay, count, max;
+  uint t0, t;
+
+  delay = 2*HZ;
+  count = -1;
+  max = 20;
+  for(i = 1; i + 1 < argc; i += 2){
+    if(strcmp(argv[i], "-d") == 0)
+      delay = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-n") == 0)
+      count = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-m") == 0)
+      max = atoi(argv[i+1]);
+    else
+      break;
+  }
+  if(i < argc || delay <= 0){
+    printf(2, "usage: top [-d ticks] [-n samples] [-m lines]\n");
+    exit();
+  }
+
+  t0 = uptime();
+  nlast = getprocstat(last, NPROC, 0);
+  for(; count != 0; count--){
+    sleep(delay);
+    t = uptime();
+    sample(t0, t - t0, max);
+    t0 = t;
+  }
+  exit();
+}
@@ -0,0 +1,100 @@
+/* getprocstat counts each process's user and kernel ticks,
+ * context switches, system calls and disk blocks, and with a
+ * since tick returns only the processes that ran after it. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "param.h"
+#include "ProcStat.h"
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+struct ProcStat table[NPROC];
+char buf[512];
+
+// pid's entry in a fresh getprocstat(since), or 0 if none.
+struct ProcStat*
+find(int pid, uint since)
+{
+    int i, n;
+
+    n = getprocstat(table, NPROC, since);
+    assert(n > 0);
+    for (i = 0; i < n; i++)
+        if (table[i].pid == pid)
+            return &table[i];
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct ProcStat s0, s1, *s;
+    int fd, i, me, spinner, sleeper;
+    volatile int x;
+    uint t;
+
+    me = getpid();
+    assert(getprocstat(table, 1, 0) == 1);
+    assert(getprocstat(table, -1, 0) == -1);
+
+    // System calls and switches to sleep.
+    s0 = *find(me, 0);
+    for (i = 0; i < 10; i++)
+        getpid();
+    sleep(1);
+    s1 = *find(me, 0);
+    assert(s1.syscalls - s0.syscalls >= 12);
+    assert(s1.vcsw > s0.vcsw);
+    assert(strcmp(s1.name, "toptest") == 0);
+
+    // Disk blocks.
+    fd = open("toptest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < 8; i++)
+        assert(write(fd, buf, sizeof(buf)) == sizeof(buf));
+    assert(fsync(fd) == 0);
+    close(fd);
+    s0 = *find(me, 0);
+    assert(s0.bio > s1.bio);
+    unlink("toptest.tmp");
+
+    // A process that spins shows up, with user ticks; one that
+    // sleeps throughout does not.
+    spinner = fork();
+    assert(spinner >= 0);
+    if (spinner == 0)
+        for (x = 0;; x++)
+            ;
+    sleeper = fork();
+    assert(sleeper >= 0);
+    if (sleeper == 0) {
+        sleep(1000);
+        exit();
+    }
+    sleep(10);
+    assert((s = find(spinner, 0)) != 0);
+    s0 = *s;
+    t = uptime();
+    sleep(50);
+    assert((s = find(spinner, t)) != 0);
+    printf(1, "toptest: spinner ran %d user, %d kernel ticks in 50\n",
+           s->uticks - s0.uticks, s->sticks - s0.sticks);
+    assert(s->uticks > s0.uticks);
+    assert(s->lastrun >= t);
+    assert(find(sleeper, t) == 0);
+    assert(find(sleeper, 0) != 0);
+    assert(find(me, t) != 0);
+
+    kill(spinner);
+    kill(sleeper);
+    assert(wait() > 0 && wait() > 0);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,163 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "param.h"
+#include "x86.h"
+#include "vdso.h"
+#include "trace.h"
+
+// "trace [-e event,...] cmd [arg ...]" runs cmd with the kernel's
+// tracepoints on, and prints each record as
+//   usecs cpu pid event a [b]
+// with usecs counted from boot; trace.h says what a and b are.  Each CPU's records come out in
+// order; "sort -n" on the host merges the CPUs.  The events are
+// sched, syscall, bread, ide, kalloc and bio; the default is all.
+// A child drains the rings while cmd runs.  bio records print as
+//   usecs cpu pid bio dev sector op hit meta
+// for tools/bioreplay to read.
+
+static struct TraceRec buf[64];
+
+static char *evname[] = {
+[TR_SWITCHIN]  "switchin",
+[TR_SWITCHOUT] "switchout",
+[TR_SYSENTER]  "sysenter",
+[TR_SYSEXIT]   "sysexit",
+[TR_BREAD]     "bread",
+[TR_IDEQUEUE]  "idequeue",
+[TR_IDEDONE]   "idedone",
+[TR_KALLOC]    "kalloc",
+[TR_KFREE]     "kfree",
+[TR_BIO]       "bio",
+};
+
+static char *bioop[] = {
+[BIO_GET]   "get",
+[BIO_NEW]   "new",
+[BIO_DIRTY] "dirty",
+[BIO_READ]  "read",
+[BIO_WRITE] "write",
+};
+
+static struct {
+  char *name;
+  uint mask;
+} groups[] = {
+  { "sched", 1 << TR_SWITCHIN | 1 << TR_SWITCHOUT },
+  { "syscall", 1 << TR_SYSENTER | 1 << TR_SYSEXIT },
+  { "bread", 1 << TR_BREAD },
+  { "ide", 1 << TR_IDEQUEUE | 1 << TR_IDEDONE },
+  { "kalloc", 1 << TR_KALLOC | 1 << TR_KFREE },
+  { "bio", 1 << TR_BIO },
+};
+
+// The events named in the comma-separated list s, or 0 if one
+// isn't known.
+static uint
+parsemask(char *s)
+{
+  uint mask;
+  char *e;
+  int i;
+
+  mask = 0;
+  for(; s; s = e){
+    if((e = strchr(s, ',')) != 0)
+      *e++ = 0;
+    for(i = 0; i < sizeof(groups)/sizeof(groups[0]); i++)
+      if(strcmp(groups[i].name, s) == 0)
+        break;
+    if(i == sizeof(groups)/sizeof(groups[0]))
+      return 0;
+    mask |= groups[i].mask;
+  }
+  return mask;
+}
+
+// Format x in decimal in buf, which must hold 21 bytes.
+static char*
+fmt64(char *buf, uint64 x)
+{
+  char *p;
+  uint d;
+
+  p = buf + 20;
+  *p = 0;
+  do{
+    x = div64(x, 10, &d);
+    *--p = '0' + d;
+  }while(x);
+  return p;
+}
+
+static void
+drain(void)
+{
+  struct vdata *v = (struct vdata*)VDSO;
+  struct TraceRec *r;
+  char num[21];
+  FILE *out;
+  int i, n;
+
+  if((out = fdopen(1, "w")) == 0)
+    exit();
+  while((n = traceread(buf, sizeof(buf)/sizeof(buf[0]))) >= 0){
+    if(n == 0){
+      fflush(out);
+      sleep(HZ/10);
+    }
+    for(i = 0; i < n; i++){
+      r = &buf[i];
+      fprintf(out, "%s %d %d %s ",
+              fmt64(num, div64((r->tsc - v->boottsc) * 1000, v->tsckhz, 0)),
+              r->cpu, r->pid, evname[r->ev]);
+      if(r->ev == TR_KALLOC || r->ev == TR_KFREE)
+        fprintf(out, "%x\n", r->a);
+      else if(r->ev == TR_BIO)
+        fprintf(out, "%d %d %s %d %d\n", BIO_DEV(r->b), r->a, bioop[BIO_OP(r->b)],
+                (r->b & BIO_HIT) != 0, (r->b & BIO_META) != 0);
+      else
+        fprintf(out, "%d %d\n", r->a, r->b);
+    }
+  }
+  fclose(out);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, pid, dpid, dropped;
+  uint mask;
+
+  mask = TR_ALL;
+  i = 1;
+  if(argc > 2 && strcmp(argv[1], "-e") == 0){
+    if((mask = parsemask(argv[2])) == 0){
+      printf(2, "trace: events are sched, syscall, bread, ide, kalloc, bio\n");
+      exit();
+    }
+    i += 2;
+  }
+  if(i >= argc){
+    printf(2, "usage: trace [-e event,...] cmd [arg ...]\n");
+    exit();
+  }
+  tracectl(mask);
+  if((dpid = fork()) == 0){
+    drain();
+    exit();
+  }
+  if((pid = fork()) == 0){
+    exec(argv[i], argv + i);
+    printf(2, "trace: exec %s failed\n", argv[i]);
+    exit();
+  }
+  while(pid > 0 && wait() != pid)
+    ;
+  dropped = tracectl(0);
+  if(dpid > 0)
+    wait();
+  if(dropped > 0)
+    printf(2, "trace: %d records dropped\n", dropped);
+  exit();
+}
@@ -0,0 +1,86 @@
+/* tracepoints record syscalls, switches, the buffer cache, the
+ * disk and the page allocator, each CPU's in time order. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+#include "syscall.h"
+#include "trace.h"
+
+int ppid;
+struct TraceRec buf[NCPU * NTRACEREC];
+uint64 last[NCPU];
+char data[512];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct TraceRec *r;
+    int fd, i, n, count[NTRACEEV];
+    char *p;
+    ppid = getpid();
+
+    assert(tracectl(TR_ALL) >= 0);
+    assert(getpid() == ppid);
+    fd = open("tracetest.tmp", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for(i = 0; i < 8; i++)
+        assert(write(fd, data, sizeof(data)) == sizeof(data));
+    assert(fsync(fd) == 0);
+    close(fd);
+    p = sbrk(4096);
+    assert(p != (char*)-1);
+    p[0] = 1;
+    sleep(1);
+    assert(tracectl(0) >= 0);
+
+    n = traceread(buf, NCPU * NTRACEREC);
+    assert(n > 0);
+    memset(count, 0, sizeof(count));
+    for(i = 0; i < n; i++){
+        r = &buf[i];
+        assert(r->ev < NTRACEEV && r->cpu < NCPU);
+        assert(r->tsc >= last[r->cpu]);
+        last[r->cpu] = r->tsc;
+        if(r->ev == TR_SYSEXIT && r->a == SYS_getpid && r->pid == ppid){
+            assert(r->b == ppid);
+        }
+        if(r->pid == ppid || r->ev == TR_IDEDONE)
+            count[r->ev]++;
+    }
+    assert(count[TR_SYSENTER] > 0 && count[TR_SYSEXIT] > 0);
+    assert(count[TR_SWITCHIN] > 0 && count[TR_SWITCHOUT] > 0);
+    assert(count[TR_BREAD] > 0);
+    assert(count[TR_IDEQUEUE] > 0 && count[TR_IDEDONE] > 0);
+    assert(count[TR_KALLOC] > 0);
+    assert(count[TR_BIO] > 0);
+
+    // Stopped and drained, so nothing more comes.
+    assert(traceread(buf, NCPU * NTRACEREC) == -1);
+
+    // Only the events asked for are traced.
+    assert(tracectl(1 << TR_SYSENTER) >= 0);
+    getpid();
+    assert(tracectl(0) >= 0);
+    n = 0;
+    while((i = traceread(buf, NCPU * NTRACEREC)) > 0){
+        for(r = buf; r < buf + i; r++){
+            assert(r->ev == TR_SYSENTER);
+            if(r->pid == ppid && r->a == SYS_getpid)
+                n++;
+        }
+    }
+    assert(n == 1);
+    unlink("tracetest.tmp");
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
@@ -0,0 +1,94 @@
+/* UDP sockets over the loopback address: datagrams keep their
+ * boundaries and sender, read and write work on a connected
+ * socket, poll sees a queued datagram, and sendmmsg/recvmmsg
+ * move several at once. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "poll.h"
+#include "socket.h"
+
+#define PORT 7000
+#define N 8
+
+char buf[2048];
+char bufs[N][64];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct mmsghdr m[N];
+    struct iovec iov[N];
+    struct pollfd pfd;
+    int s, c, i;
+
+    s = socket();
+    c = socket();
+    assert(s >= 0 && c >= 0);
+    assert(bind(s, PORT) == 0);
+    assert(bind(c, PORT) < 0);
+    assert(fcntl(s, F_SETFL, O_NONBLOCK) == 0);
+
+    // Nothing queued yet.
+    assert(read(s, buf, sizeof(buf)) < 0);
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    assert(poll(&pfd, 1, 0) == 0);
+
+    // A connected socket writes to its peer; each write is one
+    // datagram, and a short read drops the rest of it.
+    assert(connect(c, INADDR_LOOPBACK, PORT) == 0);
+    assert(write(c, "hello", 5) == 5);
+    assert(write(c, "world!", 6) == 6);
+    assert(poll(&pfd, 1, 0) == 1 && pfd.revents == POLLIN);
+    assert(read(s, buf, 3) == 3 && buf[0] == 'h' && buf[2] == 'l');
+    assert(read(s, buf, sizeof(buf)) == 6 && buf[5] == '!');
+    assert(read(s, buf, sizeof(buf)) < 0);
+
+    // Too big for one frame.
+    assert(write(c, buf, UDP_MAXDATA + 1) < 0);
+    assert(write(c, buf, UDP_MAXDATA) == UDP_MAXDATA);
+    assert(read(s, buf, sizeof(buf)) == UDP_MAXDATA);
+
+    // A batch each way, with the sender's port filled in.
+    for (i = 0; i < N; i++) {
+        bufs[i][0] = 'a' + i;
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len = i + 1;
+        m[i].msg_iov = &iov[i];
+        m[i].msg_iovlen = 1;
+        m[i].addr = INADDR_LOOPBACK;
+        m[i].port = PORT;
+    }
+    assert(sendmmsg(c, m, N) == N);
+    for (i = 0; i < N; i++) {
+        assert(m[i].len == i + 1);
+        bufs[i][0] = 0;
+        iov[i].iov_len = sizeof(bufs[i]);
+    }
+    assert(recvmmsg(s, m, N) == N);
+    for (i = 0; i < N; i++) {
+        assert(m[i].len == i + 1 && bufs[i][0] == 'a' + i);
+        assert(m[i].addr == INADDR_LOOPBACK && m[i].port != PORT);
+    }
+
+    // The reply goes back to where a datagram came from.
+    m[0].addr = m[1].addr;
+    m[0].port = m[1].port;
+    iov[0].iov_len = 1;
+    assert(sendmmsg(s, m, 1) == 1);
+    assert(read(c, buf, sizeof(buf)) == 1 && buf[0] == 'a');
+
+    close(s);
+    close(c);
+    printf(1, "TEST PASSED\n");
+    exit();
+}
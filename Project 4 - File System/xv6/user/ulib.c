@@ -3,6 +3,8 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "param.h"
+#include "vdso.h"
 
 char*
 strcpy(char *s, char *t)
@@ -23,23 +25,71 @@ strcmp(const char *p, const char *q)
   return (uchar)*p - (uchar)*q;
 }
 
+// Looks at a long at a time once s is aligned; an aligned long
+// never crosses into the next page.
 uint
 strlen(char *s)
 {
-  int n;
+  char *p;
+  uint *w;
 
-  for(n = 0; s[n]; n++)
+  for(p = s; (uint)p & 3; p++)
+    if(*p == 0)
+      return p - s;
+  for(w = (uint*)p; ((*w - 0x01010101) & ~*w & 0x80808080) == 0; w++)
     ;
-  return n;
+  for(p = (char*)w; *p; p++)
+    ;
+  return p - s;
 }
 
 void*
 memset(void *dst, int c, uint n)
 {
-  stosb(dst, c, n);
+  uint m;
+  char *d;
+
+  d = dst;
+  if(n >= 16){
+    c &= 0xFF;
+    m = -(uint)d & 3;
+    stosb(d, c, m);
+    d += m;
+    n -= m;
+    stosl(d, (c<<24)|(c<<16)|(c<<8)|c, n/4);
+    d += n & ~3;
+    n &= 3;
+  }
+  stosb(d, c, n);
   return dst;
 }
 
+// Find the first c in the n bytes at s.  Once s is aligned it
+// looks at a word at a time: a word holds c if, XORed with c in
+// every byte, it has a zero byte.
+void*
+memchr(const void *s, int c, uint n)
+{
+  const uchar *p;
+  uint m, x;
+
+  p = s;
+  c &= 0xFF;
+  for(; n > 0 && ((uint)p & 3); p++, n--)
+    if(*p == c)
+      return (void*)p;
+  m = c * 0x01010101;
+  for(; n >= 4; p += 4, n -= 4){
+    x = *(uint*)p ^ m;
+    if((x - 0x01010101) & ~x & 0x80808080)
+      break;
+  }
+  for(; n > 0; p++, n--)
+    if(*p == c)
+      return (void*)p;
+  return 0;
+}
+
 char*
 strchr(const char *s, char c)
 {
@@ -49,21 +99,67 @@ strchr(const char *s, char c)
   return 0;
 }
 
-char*
-gets(char *buf, int max)
+// Buffered line input.
+//
+// readline keeps a buffer for each of the first NRLFD fds and
+// refills it with one read when it runs dry, so reading a file
+// or pipe line by line costs a system call per RLBUF bytes
+// instead of one per byte; the console hands over a line per
+// read anyway.  Input in the buffer is gone from fd as far as
+// read or a child is concerned, so a program reads an fd
+// through readline or not at all, and to its end before closing
+// it if the fd number is to be reused.
+
+#define NRLFD 8
+#define RLBUF 512
+
+struct rlbuf {
+  int off;    // Next byte to hand out
+  int n;      // Bytes in buf
+  char buf[RLBUF];
+};
+
+static struct rlbuf rlbufs[NRLFD];
+
+// Read a line from fd into buf, up to and including the newline
+// but at most max-1 bytes, and nul-terminate it.  Returns its
+// length, 0 at end of file, or -1 if read failed first.
+int
+readline(int fd, char *buf, int max)
 {
-  int i, cc;
+  struct rlbuf *b;
+  int i, r;
   char c;
 
-  for(i=0; i+1 < max; ){
-    cc = read(0, &c, 1);
-    if(cc < 1)
-      break;
+  if(max < 1)
+    return -1;
+  b = fd >= 0 && fd < NRLFD ? &rlbufs[fd] : 0;
+  r = 0;
+  for(i = 0; i+1 < max; ){
+    if(b == 0){
+      if((r = read(fd, &c, 1)) < 1)
+        break;
+    } else {
+      if(b->off == b->n){
+        b->off = b->n = 0;
+        if((r = read(fd, b->buf, RLBUF)) < 1)
+          break;
+        b->n = r;
+      }
+      c = b->buf[b->off++];
+    }
     buf[i++] = c;
-    if(c == '\n' || c == '\r')
+    if(c == '\n')
       break;
   }
   buf[i] = '\0';
+  return i == 0 && r < 0 ? -1 : i;
+}
+
+char*
+gets(char *buf, int max)
+{
+  readline(0, buf, max);
   return buf;
 }
 
@@ -92,14 +188,86 @@ atoi(const char *s)
   return n;
 }
 
+// Copies a long at a time when dst and src are equally aligned.
 void*
 memmove(void *vdst, void *vsrc, int n)
 {
   char *dst, *src;
-  
+  uint m;
+
   dst = vdst;
   src = vsrc;
-  while(n-- > 0)
-    *dst++ = *src++;
+  if(n <= 0)
+    return vdst;
+  if(n < 16 || (((uint)src ^ (uint)dst) & 3) != 0){
+    if(src < dst && src + n > dst)
+      rmovsb(dst + n - 1, src + n - 1, n);
+    else
+      movsb(dst, src, n);
+  } else if(src < dst && src + n > dst){
+    m = (uint)(dst + n) & 3;
+    rmovsb(dst + n - 1, src + n - 1, m);
+    n -= m;
+    rmovsl(dst + n - 4, src + n - 4, n/4);
+    rmovsb(dst + (n & 3) - 1, src + (n & 3) - 1, n & 3);
+  } else {
+    m = -(uint)dst & 3;
+    movsb(dst, src, m);
+    dst += m;
+    src += m;
+    n -= m;
+    movsl(dst, src, n/4);
+    movsb(dst + (n & ~3), src + (n & ~3), n & 3);
+  }
   return vdst;
 }
+
+// uptime, getpid and the CPU, read from the vdso pages without
+// a system call.
+uint
+vuptime(void)
+{
+  return ((struct vdata*)VDSO)->ticks;
+}
+
+int
+vgetpid(void)
+{
+  return ((struct vproc*)VDSOPROC)->pid;
+}
+
+int
+vcpu(void)
+{
+  return ((struct vproc*)VDSOPROC)->cpu;
+}
+
+// CLOCK_MONOTONIC in nanoseconds, without a system call.
+uint64
+vnsuptime(void)
+{
+  struct vdata *v = (struct vdata*)VDSO;
+  uint64 ms;
+  uint r;
+
+  ms = div64(rdtsc() - v->boottsc, v->tsckhz, &r);
+  return ms * 1000000 + div64((uint64)r * 1000000, v->tsckhz, 0);
+}
+
+// What counter ctr from perfctr has counted for this process:
+// the total from the vproc page as of its last switch, plus
+// what the counter holds since.  A switch in between changes
+// pmcseq, and then we read again.
+uint64
+perfread(int ctr)
+{
+  struct vproc *v = (struct vproc*)VDSOPROC;
+  uint64 n;
+  uint seq;
+
+  do {
+    seq = v->pmcseq;
+    n = v->pmc[ctr] + rdpmc(ctr);
+  } while(v->pmcseq != seq);
+  return n;
+}
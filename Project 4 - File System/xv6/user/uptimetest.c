@@ -0,0 +1,118 @@
+/* uptime reads the clock without a lock: it never goes back
+ * while other processes hammer it, and agrees with the kstat
+ * clock counters, which count each CPU's timer ticks, user-mode
+ * ones apart. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "fcntl.h"
+
+#define NREADER 3
+#define KSTATSIZE 16384
+
+int ppid;
+char buf[KSTATSIZE + 1];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// Read all of kstat into buf.
+void
+snapshot(void)
+{
+    int fd, n;
+
+    fd = open("/kstat", O_RDONLY);
+    assert(fd >= 0);
+    n = read(fd, buf, KSTATSIZE);
+    assert(n > 0 && n < KSTATSIZE);
+    buf[n] = 0;
+    close(fd);
+}
+
+// The value of counter name in buf, or -1 if it isn't there.
+int
+value(char *name)
+{
+    char *p;
+    int i;
+
+    for (p = buf; *p; p = strchr(p, '\n') + 1) {
+        for (i = 0; name[i] && p[i] == name[i]; i++)
+            ;
+        if (name[i] == 0 && p[i] == ' ')
+            return atoi(p + i + 1);
+    }
+    return -1;
+}
+
+// Sum of counter clock.<cpu>.c over the CPUs.
+int
+total(char *c)
+{
+    char name[32];
+    int i, n, v;
+
+    n = 0;
+    for (i = 0; i < NCPU; i++) {
+        strcpy(name, "clock.");
+        name[6] = '0' + i;
+        name[7] = '.';
+        strcpy(name + 8, c);
+        if ((v = value(name)) < 0)
+            break;
+        n += v;
+    }
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    int i, t, end, u0, t0;
+    uint64 ns;
+    ppid = getpid();
+
+    // Readers on every CPU see it only go forward.
+    end = uptime() + 20;
+    for (i = 0; i < NREADER; i++) {
+        if (fork() == 0) {
+            t = uptime();
+            while (t < end) {
+                i = uptime();
+                assert(i >= t);
+                t = i;
+            }
+            exit();
+        }
+    }
+    for (i = 0; i < NREADER; i++)
+        assert(wait() > 0);
+    assert(uptime() >= end);
+
+    // kstat's tick count is uptime's.
+    t = uptime();
+    snapshot();
+    i = value("clock.ticks");
+    assert(i >= t && i <= uptime());
+    assert(value("clock.0.ticks") > 0);
+
+    // Spinning in user mode adds user-mode ticks.
+    u0 = total("uticks");
+    t0 = total("ticks");
+    assert(u0 >= 0 && t0 >= u0);
+    ns = vnsuptime() + (uint64)10 * 1000000000 / HZ;
+    while (vnsuptime() < ns)
+        ;
+    snapshot();
+    assert(total("uticks") > u0);
+    assert(total("ticks") > t0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
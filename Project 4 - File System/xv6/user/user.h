@@ -2,14 +2,44 @@
 #define _USER_H_
 
 struct stat;
+struct bcachestat;
+struct idestat;
+struct iovec;
+struct ProcessInfo;
+struct IntrStat;
+struct ProfSample;
+struct TraceRec;
+struct spawnact;
+struct LockStat;
+struct tagterm;
+struct tagrec;
+struct LatStat;
+struct ProcStat;
+struct direntstat;
+struct ksmstat;
+struct ShrinkStat;
+struct swapstat;
+struct pollfd;
+struct mmsghdr;
+struct ring;
+struct SyscallStat;
+struct timespec;
 
 #ifndef _KEY_H_
 #define _KEY_H_
 struct Key {
-  char key[10];  // at most 10 bytes for key
+  char key[32];  // at most 31 bytes for key, NUL-terminated
 };
 #endif // _KEY_H_
 
+#ifndef _VALUE_H_
+#define _VALUE_H_
+struct Value {
+  char value[255];  // at most 255 bytes for value
+  int length;       // bytes of value in use
+};
+#endif // _VALUE_H_
+
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
@@ -37,20 +67,92 @@ int removeFileTag(int fileDescriptor, char* key);
 int getFileTag(int fileDescriptor, char* key, char* buffer, int length);
 int getAllTags(int fileDescriptor, struct Key *keys, int maxTags);
 int getFilesByTag(char* key, char* value, int valueLength, char* results, int resultsLength);
+int tagFileBatch(int fileDescriptor, struct Key *keys, struct Value *values, int n);
+int getFileTags(int fileDescriptor, struct Key *keys, struct Value *values, int n);
+int getFilesByQuery(struct tagterm* terms, int n, char* results, int resultsLength);
+int getFilesByTagPage(char* key, char* value, int valueLength, struct tagrec* recs, int max, uint* cursor);
+int bcachestat(struct bcachestat*);
+int sync(void);
+int fsync(int);
+int idestat(struct idestat*);
+int pread(int, void*, int, uint);
+int pwrite(int, void*, int, uint);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+void* mmap(int, uint, uint, int);
+int madvise(void*, uint, int);
+int sendfile(int, int, int, int);
+int copy_file_range(int, int, int, int);
+int splice(int, int, int);
+int tee(int, int, int);
+int getprocs(struct ProcessInfo*);
+int setaffinity(int, uint);
+int lockstat(struct LockStat*, int);
+int ringenter(struct ring*);
+int syscallstat(int, struct SyscallStat*, int);
+int clock_gettime(int, struct timespec*);
+int intrstat(struct IntrStat*, int);
+int irqaffinity(int, int);
+int profctl(int);
+int profread(struct ProfSample*, int);
+int tracectl(uint);
+int traceread(struct TraceRec*, int);
+int spawn(char*, char**, struct spawnact*, int);
+int mktemplate(char***);
+int spawn_from(int, char**);
+int ftruncate(int, uint);
+int fallocate(int, uint, uint);
+int poll(struct pollfd*, int, int);
+int fcntl(int, int, int);
+int mount(char*, int);
+int socket(void);
+int bind(int, int);
+int connect(int, uint, int);
+int sendmmsg(int, struct mmsghdr*, int);
+int recvmmsg(int, struct mmsghdr*, int);
+int swapstat(struct swapstat*);
+int shrinkstat(struct ShrinkStat*, int);
+int ksm(int, struct ksmstat*);
+int getdents_stat(int, struct direntstat*, int);
+int getprocstat(struct ProcStat*, int, uint);
+int perfctr(int, int);
+int latencyctl(int);
+int getlatency(struct LatStat*, int);
+int aio_setup(void);
+int aio_read(int, int, void*, int, uint, uint);
+int aio_write(int, int, void*, int, uint, uint);
+int notify_open(int);
+int vmsplice(int, void*, int);
+int dropcaches(void);
 
 // user library functions (ulib.c)
 int stat(char*, struct stat*);
 char* strcpy(char*, char*);
 void *memmove(void*, void*, int);
 char* strchr(const char*, char c);
+void* memchr(const void*, int, uint);
 int strcmp(const char*, const char*);
 void printf(int, char*, ...);
 char* gets(char*, int max);
+int readline(int, char*, int max);
 uint strlen(char*);
 void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+uint vuptime(void);
+int vgetpid(void);
+int vcpu(void);
+uint64 vnsuptime(void);
+uint64 perfread(int);
+
+// buffered output (printf.c)
+typedef struct iobuf FILE;
+FILE* fdopen(int, char*);
+int fwrite(void*, uint, uint, FILE*);
+int fflush(FILE*);
+int fclose(FILE*);
+void fprintf(FILE*, char*, ...);
 
 #endif // _USER_H_
 
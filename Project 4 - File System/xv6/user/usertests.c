@@ -1,14 +1,15 @@
 /* user regression tests */
 #include "types.h"
+#include "param.h"
 #include "stat.h"
 #include "user.h"
 #include "fs.h"
 #include "fcntl.h"
 #include "syscall.h"
 #include "traps.h"
+#include "vdso.h"
 
 #define PAGE (4096)
-#define MAX_PROC_MEM (640 * 1024)
 
 char buf[2048];
 char name[3];
@@ -1241,12 +1242,30 @@ forktest(void)
   printf(1, "ok\n");
 }
 
+// Move the break to addr, in steps that fit sbrk's int argument.
+// Returns 0, or -1 if sbrk fails.
+int
+sbrkto(uint addr)
+{
+  uint cur;
+  int n;
+
+  while((cur = (uint)sbrk(0)) != addr){
+    if(addr > cur)
+      n = addr - cur > 0x40000000 ? 0x40000000 : addr - cur;
+    else
+      n = cur - addr > 0x40000000 ? -0x40000000 : -(int)(cur - addr);
+    if(sbrk(n) == (char*)0xffffffff)
+      return -1;
+  }
+  return 0;
+}
+
 void
 sbrktest(void)
 {
   int pid, ppid;
-  char *a, *b, *c, *lastaddr, *oldbrk, *p;
-  uint amt;
+  char *a, *b, *c, *lastaddr, *oldbrk;
 
   printf(stdout, "sbrk test\n");
   oldbrk = sbrk(0);
@@ -1278,21 +1297,19 @@ sbrktest(void)
     exit();
   wait();
 
-  // can one allocate the full 640K?
+  // can one allocate everything up to the stack's guard page?
   a = sbrk(0);
-  amt = (640 * 1024) - (uint)a;
-  p = sbrk(amt);
-  if(p != a){
-    printf(stdout, "sbrk test failed 640K test, p %x a %x\n", p, a);
+  if(sbrkto(MMAPTOP) < 0){
+    printf(stdout, "sbrk test failed MMAPTOP test, a %x\n", a);
     exit();
   }
-  lastaddr = (char*)(640 * 1024 - 1);
+  lastaddr = (char*)(MMAPTOP - 1);
   *lastaddr = 99;
 
-  // is one forbidden from allocating more than 640K?
+  // is one forbidden from allocating past it?
   c = sbrk(4096);
   if(c != (char*)0xffffffff){
-    printf(stdout, "sbrk allocated more than 640K, c %x\n", c);
+    printf(stdout, "sbrk allocated past MMAPTOP, c %x\n", c);
     exit();
   }
 
@@ -1324,7 +1341,7 @@ sbrktest(void)
 
   c = sbrk(4096);
   if(c != (char*)0xffffffff){
-    printf(stdout, "sbrk was able to re-allocate beyond 640K, c %x\n", c);
+    printf(stdout, "sbrk was able to re-allocate past MMAPTOP, c %x\n", c);
     exit();
   }
 
@@ -1344,8 +1361,7 @@ sbrktest(void)
     wait();
   }
 
-  if(sbrk(0) > oldbrk)
-    sbrk(-(sbrk(0) - oldbrk));
+  sbrkto((uint)oldbrk);
 
   printf(stdout, "sbrk test ok\n");
 }
@@ -1367,8 +1383,8 @@ void leaktest() {
   }
   for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
     if((pids[i] = fork()) == 0){
-      // allocate the full 640K - 1 page
-      sbrk(MAX_PROC_MEM - (1 * PAGE) - (uint)sbrk(0));
+      // allocate all but the last page
+      sbrkto(MMAPTOP - PAGE);
       write(fds[1], "x", 1);
       // sit around until killed
       for(;;) sleep(1000);
@@ -1379,8 +1395,8 @@ void leaktest() {
   kill(pids[0]);
   wait();
   if((pids[0] = fork()) == 0){
-     // allocate the full 640K page
-     sbrk(MAX_PROC_MEM - (uint)sbrk(0));
+     // allocate everything
+     sbrkto(MMAPTOP);
      write(fds[1], "x", 1);
      // sit around until killed
      for(;;) sleep(1000);
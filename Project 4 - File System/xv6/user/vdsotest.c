@@ -0,0 +1,65 @@
+/* The vdso pages give uptime, the pid and the CPU without a
+ * system call, and user code can't write them. */
+#include "types.h"
+#include "user.h"
+#include "param.h"
+#include "vdso.h"
+
+int ppid;
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+int
+main(int argc, char *argv[])
+{
+    ppid = getpid();
+    struct vdata *v = (struct vdata*)VDSO;
+    uint t;
+    int pid, fd[2];
+    char c;
+
+    assert(vgetpid() == ppid);
+    assert(vcpu() >= 0 && vcpu() < NCPU);
+    t = uptime();
+    assert(vuptime() >= t && vuptime() <= t + 1);
+
+    // The timer keeps it current.
+    t = vuptime();
+    sleep(3);
+    assert(vuptime() >= t + 2);
+    assert(v->tsc != 0 && v->tscpertick != 0);
+
+    // A child sees its own pid.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(vgetpid() == getpid() && vgetpid() != ppid);
+        exit();
+    }
+    assert(wait() == pid);
+    assert(vgetpid() == ppid);
+
+    // Writing the page faults and kills the writer.
+    assert(pipe(fd) == 0);
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        close(fd[0]);
+        v->ticks = 0;
+        write(fd[1], "x", 1);
+        exit();
+    }
+    close(fd[1]);
+    assert(read(fd[0], &c, 1) == 0);
+    assert(wait() == pid);
+    assert(vuptime() != 0);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
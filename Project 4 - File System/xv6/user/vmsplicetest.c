@@ -0,0 +1,124 @@
+/* vmsplice gifts whole pages to a pipe: readers see them as they
+ * were when gifted, however the giver writes to its pages after,
+ * whether they read them into page-aligned buffers, which take
+ * the pages themselves, or in pieces; gifts keep their place
+ * among written bytes; splice and tee pass them on. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define PGSIZE 4096
+#define NPG    4
+
+int ppid;
+char small[PGSIZE];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   kill(ppid); \
+   exit(); \
+}
+
+// n page-aligned pages of fresh heap.
+char*
+pages(int n)
+{
+    char *p;
+
+    p = sbrk(0);
+    assert(sbrk(PGSIZE - (uint)p % PGSIZE + n*PGSIZE) != (char*)-1);
+    return p + PGSIZE - (uint)p % PGSIZE;
+}
+
+// Are all n bytes at p equal to c?
+int
+filled(char *p, int n, char c)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (p[i] != c)
+            return 0;
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *buf, *rbuf;
+    int a[2], b[2], c[2], i, pid;
+    ppid = getpid();
+
+    buf = pages(NPG);
+    rbuf = pages(NPG);
+    for (i = 0; i < NPG; i++)
+        memset(buf + i*PGSIZE, 'a' + i, PGSIZE);
+    assert(pipe(a) == 0);
+
+    // Only whole, aligned pages, and only to a pipe's write end.
+    assert(vmsplice(a[1], buf + 1, PGSIZE) == -1);
+    assert(vmsplice(a[1], buf, PGSIZE - 1) == -1);
+    assert(vmsplice(a[0], buf, PGSIZE) == -1);
+
+    // Writing the pages after gifting them leaves the gifts alone.
+    assert(vmsplice(a[1], buf, 2*PGSIZE) == 2*PGSIZE);
+    memset(buf, 'z', 2*PGSIZE);
+    assert(read(a[0], rbuf, PGSIZE) == PGSIZE);
+    assert(filled(rbuf, PGSIZE, 'a'));
+    assert(read(a[0], small, 100) == 100);
+    assert(filled(small, 100, 'b'));
+    assert(read(a[0], small, PGSIZE) == PGSIZE - 100);
+    assert(filled(small, PGSIZE - 100, 'b'));
+
+    // The page the reader took is its own to write.
+    memset(rbuf, 'y', PGSIZE);
+    assert(filled(rbuf, PGSIZE, 'y'));
+    assert(filled(buf, 2*PGSIZE, 'z'));
+
+    // Gifts come between the bytes written before and after them.
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        assert(write(a[1], "hello", 5) == 5);
+        assert(vmsplice(a[1], buf + 2*PGSIZE, 2*PGSIZE) == 2*PGSIZE);
+        assert(write(a[1], "bye", 3) == 3);
+        exit();
+    }
+    assert(read(a[0], small, 5) == 5);
+    small[5] = 0;
+    assert(strcmp(small, "hello") == 0);
+    assert(read(a[0], rbuf, 2*PGSIZE) == 2*PGSIZE);
+    assert(filled(rbuf, PGSIZE, 'c'));
+    assert(filled(rbuf + PGSIZE, PGSIZE, 'd'));
+    assert(read(a[0], small, 10) == 3);
+    small[3] = 0;
+    assert(strcmp(small, "bye") == 0);
+    assert(wait() == pid);
+
+    // tee and splice pass gifts on, and a tee'd gift is still there.
+    assert(pipe(b) == 0 && pipe(c) == 0);
+    assert(vmsplice(a[1], buf + 3*PGSIZE, PGSIZE) == PGSIZE);
+    assert(tee(a[0], c[1], PGSIZE) == PGSIZE);
+    assert(splice(a[0], b[1], PGSIZE) == PGSIZE);
+    assert(read(b[0], rbuf, PGSIZE) == PGSIZE);
+    assert(filled(rbuf, PGSIZE, 'd'));
+    assert(read(c[0], rbuf + PGSIZE, PGSIZE) == PGSIZE);
+    assert(filled(rbuf + PGSIZE, PGSIZE, 'd'));
+
+    // Gifts still queued when the pipe goes are dropped with it.
+    assert(vmsplice(b[1], buf, PGSIZE) == PGSIZE);
+    close(b[0]);
+    close(b[1]);
+    close(c[0]);
+    close(c[1]);
+
+    // With the reader gone, there is no one to gift to.
+    close(a[0]);
+    assert(vmsplice(a[1], buf, PGSIZE) == -1);
+    close(a[1]);
+
+    printf(1, "TEST PASSED\n");
+    exit();
+}
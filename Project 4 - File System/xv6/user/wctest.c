@@ -0,0 +1,119 @@
+/* wc counts lines, words and bytes over several buffers, and cat
+ * copies a file, and a pipe into a pipe, byte for byte. */
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NLINE 4000
+
+char out[256];
+char in[8192];
+
+#define assert(x) if (x) {} else { \
+   printf(1, "%s: %d ", __FILE__, __LINE__); \
+   printf(1, "assert failed (%s)\n", # x); \
+   printf(1, "TEST FAILED\n"); \
+   exit(); \
+}
+
+// Run argv with stdin from fd0 and stdout to fd1.
+int
+run(char **argv, int fd0, int fd1)
+{
+    int pid;
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        if (fd0 != 0) {
+            close(0);
+            assert(dup(fd0) == 0);
+        }
+        close(1);
+        assert(dup(fd1) == 1);
+        exec(argv[0], argv);
+        printf(2, "wctest: exec %s failed\n", argv[0]);
+        exit();
+    }
+    return pid;
+}
+
+// Read from fd until it ends, checking that it is the lines
+// written; returns how many bytes came.
+int
+drain(int fd)
+{
+    int i, n, tot;
+
+    tot = 0;
+    while ((n = read(fd, in, sizeof(in))) > 0) {
+        for (i = 0; i < n; i++)
+            assert(in[i] == "ab cd\te\n"[(tot + i) % 8]);
+        tot += n;
+    }
+    return tot;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char *wcargv[] = { "wc", "wc.in", 0 };
+    char *catargv[] = { "cat", "wc.in", 0 };
+    char *catin[] = { "cat", 0 };
+    int fd, i, p[2], q[2], pid, pid2, size;
+
+    // Three words a line, in eight bytes.
+    unlink("wc.in");
+    fd = open("wc.in", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    for (i = 0; i < NLINE; i++)
+        assert(write(fd, "ab cd\te\n", 8) == 8);
+    close(fd);
+    size = NLINE * 8;
+
+    unlink("wc.out");
+    fd = open("wc.out", O_CREATE | O_RDWR);
+    assert(fd >= 0);
+    pid = run(wcargv, 0, fd);
+    assert(wait() == pid);
+    close(fd);
+    fd = open("wc.out", O_RDONLY);
+    i = read(fd, out, sizeof(out) - 1);
+    assert(i > 0);
+    out[i] = 0;
+    close(fd);
+    printf(1, "wctest: wc says %s", out);
+    assert(strcmp(out, "4000 12000 32000 wc.in\n") == 0);
+
+    // A file into a pipe.
+    assert(pipe(p) == 0);
+    pid = run(catargv, 0, p[1]);
+    close(p[1]);
+    assert(drain(p[0]) == size);
+    close(p[0]);
+    assert(wait() == pid);
+
+    // A pipe into a pipe.
+    assert(pipe(p) == 0 && pipe(q) == 0);
+    pid = run(catin, p[0], q[1]);
+    close(p[0]);
+    close(q[1]);
+    pid2 = fork();
+    assert(pid2 >= 0);
+    if (pid2 == 0) {
+        close(q[0]);
+        for (i = 0; i < NLINE; i++)
+            assert(write(p[1], "ab cd\te\n", 8) == 8);
+        exit();
+    }
+    close(p[1]);
+    assert(drain(q[0]) == size);
+    close(q[0]);
+    assert(wait() > 0 && wait() > 0);
+
+    unlink("wc.in");
+    unlink("wc.out");
+    printf(1, "TEST PASSED\n");
+    exit();
+}